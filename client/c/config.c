@@ -12,6 +12,9 @@
 #define FF_CLIENT_PARSE_ARG_PARSE_IP 2
 #define FF_CLIENT_PARSE_ARG_PARSE_PSK 3
 #define FF_CLIENT_PARSE_ARG_PARSE_PBKDF2_ITERATIONS 4
+#define FF_CLIENT_PARSE_ARG_PARSE_KEY_DERIVE_MODE 5
+#define FF_CLIENT_PARSE_ARG_PARSE_ENCRYPTION_MODE 6
+#define FF_CLIENT_PARSE_ARG_PARSE_KEY_ID 7
 
 static const char *default_ip_address = "127.0.0.1";
 
@@ -20,14 +23,14 @@ enum ff_client_action ff_client_parse_arguments(struct ff_client_config *config,
     enum ff_client_action action = FF_CLIENT_ACTION_MAKE_REQUEST;
     int state = FF_CLIENT_PARSE_ARG_STATE_DEFAULT;
     enum ff_log_type logging_level = FF_ERROR;
-    struct ff_encryption_config encryption_config = {.key = NULL, .pbkdf2_iterations = 1000};
+    struct ff_encryption_config encryption_config = {.key = NULL, .pbkdf2_iterations = 1000, .key_derivation_mode = FF_KEY_DERIVE_MODE_PBKDF2, .encryption_mode = FF_CRYPTO_MODE_AES_256_GCM};
 
     /*
      * Not strictly necessary as config is declared global static,
      * but the tests repeatedly call this function, so ensure it's
      * cleared each time for them.
      */
-    memset(config, 0, sizeof(struct ff_config));
+    memset(config, 0, sizeof(struct ff_client_config));
 
     for (int i = 1; i < argc; i++)
     {
@@ -63,6 +66,18 @@ enum ff_client_action ff_client_parse_arguments(struct ff_client_config *config,
             {
                 state = FF_CLIENT_PARSE_ARG_PARSE_PBKDF2_ITERATIONS;
             }
+            else if (strcasecmp(arg, "--key-derive-mode") == 0)
+            {
+                state = FF_CLIENT_PARSE_ARG_PARSE_KEY_DERIVE_MODE;
+            }
+            else if (strcasecmp(arg, "--encryption-mode") == 0)
+            {
+                state = FF_CLIENT_PARSE_ARG_PARSE_ENCRYPTION_MODE;
+            }
+            else if (strcasecmp(arg, "--key-id") == 0)
+            {
+                state = FF_CLIENT_PARSE_ARG_PARSE_KEY_ID;
+            }
             else if (strcasecmp(arg, "--https") == 0)
             {
                 config->https = true;
@@ -126,6 +141,60 @@ enum ff_client_action ff_client_parse_arguments(struct ff_client_config *config,
             state = FF_CLIENT_PARSE_ARG_STATE_DEFAULT;
             break;
 
+        case FF_CLIENT_PARSE_ARG_PARSE_KEY_DERIVE_MODE:
+            if (strcasecmp(arg, "pbkdf2") == 0)
+            {
+                encryption_config.key_derivation_mode = FF_KEY_DERIVE_MODE_PBKDF2;
+            }
+            else if (strcasecmp(arg, "hkdf") == 0)
+            {
+                encryption_config.key_derivation_mode = FF_KEY_DERIVE_MODE_HKDF;
+            }
+            else
+            {
+                fprintf(stderr, "Invalid --key-derive-mode argument: %s\n\n", arg);
+                action = FF_CLIENT_ACTION_INVALID_ARGS;
+                goto done;
+            }
+
+            state = FF_CLIENT_PARSE_ARG_STATE_DEFAULT;
+            break;
+
+        case FF_CLIENT_PARSE_ARG_PARSE_ENCRYPTION_MODE:
+            if (strcasecmp(arg, "aes-256-gcm") == 0)
+            {
+                encryption_config.encryption_mode = FF_CRYPTO_MODE_AES_256_GCM;
+            }
+            else if (strcasecmp(arg, "chacha20-poly1305") == 0)
+            {
+                encryption_config.encryption_mode = FF_CRYPTO_MODE_CHACHA20_POLY1305;
+            }
+            else
+            {
+                fprintf(stderr, "Invalid --encryption-mode argument: %s\n\n", arg);
+                action = FF_CLIENT_ACTION_INVALID_ARGS;
+                goto done;
+            }
+
+            state = FF_CLIENT_PARSE_ARG_STATE_DEFAULT;
+            break;
+
+        case FF_CLIENT_PARSE_ARG_PARSE_KEY_ID:
+        {
+            int key_id = atoi(arg);
+
+            if (key_id <= 0 || key_id > UINT16_MAX)
+            {
+                fprintf(stderr, "Invalid --key-id argument: %s\n\n", arg);
+                action = FF_CLIENT_ACTION_INVALID_ARGS;
+                goto done;
+            }
+
+            encryption_config.key_id = (uint16_t)key_id;
+            state = FF_CLIENT_PARSE_ARG_STATE_DEFAULT;
+            break;
+        }
+
         default:
             fputs("Unkown parse arg state\n\n", stderr);
             action = FF_CLIENT_ACTION_INVALID_ARGS;
@@ -163,6 +232,10 @@ make request: ff_client \n\
     --port dest_port_num\n\
     [--ip-address dest_server] # format: IPv[46] address or hostname \n\
     [--pre-shared-key pre_shared_key] # encrypt the payload \n\
+    [--pbkdf2-iterations num] # hashing iterations used to derive encryption keys \n\
+    [--key-derive-mode pbkdf2|hkdf] # hkdf is much faster but requires a high entropy key \n\
+    [--encryption-mode aes-256-gcm|chacha20-poly1305] # chacha20-poly1305 is faster without AES hardware \n\
+    [--key-id id] # id of the pre-shared key in the proxy's keyring \n\
     [--https]\n\
     -v[vv] \n\
     # Request body is read from STDIN\n\
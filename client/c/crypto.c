@@ -27,7 +27,17 @@ bool ff_client_encrypt_request(struct ff_request *request, struct ff_encryption_
         goto error;
     }
 
-    if (!ff_client_encrypt_request_aes_256_gcm_pbkdf2(request, config, &iv, &iv_len, &tag, &tag_len, &salt, &salt_len))
+    if (config->encryption_mode != 0)
+    {
+        encryption_mode = config->encryption_mode;
+    }
+
+    if (config->key_derivation_mode != 0)
+    {
+        key_derive_mode = config->key_derivation_mode;
+    }
+
+    if (!ff_client_encrypt_request_aead(request, config, encryption_mode, key_derive_mode, &iv, &iv_len, &tag, &tag_len, &salt, &salt_len))
     {
         goto error;
     }
@@ -62,6 +72,17 @@ bool ff_client_encrypt_request(struct ff_request *request, struct ff_encryption_
     ff_request_option_load_buff(request->options[request->options_length], salt_len, salt);
     request->options_length++;
 
+    if (config->key_id != 0)
+    {
+        uint8_t key_id[2] = {(uint8_t)(config->key_id >> 8), (uint8_t)config->key_id};
+
+        request->options[request->options_length] = ff_request_option_node_alloc();
+        request->options[request->options_length]->type = FF_REQUEST_OPTION_TYPE_KEY_ID;
+        request->options[request->options_length]->length = sizeof(key_id);
+        ff_request_option_load_buff(request->options[request->options_length], sizeof(key_id), key_id);
+        request->options_length++;
+    }
+
     goto done;
 
 error:
@@ -91,9 +112,11 @@ bool ff_client_encrypt_request(struct ff_request *request, struct ff_encryption_
     return ret_val;
 }
 
-bool ff_client_encrypt_request_aes_256_gcm_pbkdf2(
+bool ff_client_encrypt_request_aead(
     struct ff_request *request,
     struct ff_encryption_config *config,
+    uint8_t encryption_mode,
+    uint8_t key_derive_mode,
     uint8_t **iv,
     uint16_t *iv_len,
     uint8_t **tag,
@@ -108,7 +131,14 @@ bool ff_client_encrypt_request_aes_256_gcm_pbkdf2(
     uint8_t *ciphertext_buff = malloc(request->payload_length * sizeof(uint8_t));
     int ciphertext_len = 0;
     struct ff_request_payload_node *payload_chunk = request->payload;
-    struct ff_derived_key *key = ff_derived_key_alloc(32);
+    struct ff_derived_key *key = ff_derived_key_alloc(FF_CRYPTO_KEY_LENGTH);
+    const EVP_CIPHER *cipher = ff_client_cipher_for_mode(encryption_mode);
+
+    if (cipher == NULL)
+    {
+        ff_log(FF_ERROR, "Unknown encryption mode: %u", encryption_mode);
+        goto error;
+    }
 
     *salt_len = 16;
     *salt = (uint8_t *)calloc(1, *salt_len);
@@ -119,7 +149,7 @@ bool ff_client_encrypt_request_aes_256_gcm_pbkdf2(
         goto error;
     }
 
-    if (!ff_derive_key_pbkdf2(config, *salt, *salt_len, key))
+    if (!ff_client_derive_key(config, key_derive_mode, *salt, *salt_len, key))
     {
         ff_log(FF_ERROR, "Failed to derive encryption key while encrypting request");
         goto error;
@@ -140,13 +170,13 @@ bool ff_client_encrypt_request_aes_256_gcm_pbkdf2(
         goto error;
     }
 
-    if (!EVP_EncryptInit_ex(ctx, EVP_aes_256_gcm(), NULL, NULL, NULL))
+    if (!EVP_EncryptInit_ex(ctx, cipher, NULL, NULL, NULL))
     {
         ff_log(FF_ERROR, "Failed to init OpenSSL cipher");
         goto error;
     }
 
-    if (!EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_SET_IVLEN, *iv_len, NULL))
+    if (!EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_AEAD_SET_IVLEN, *iv_len, NULL))
     {
         ff_log(FF_ERROR, "Failed to update OpenSSL cipher - IV length");
         goto error;
@@ -180,7 +210,7 @@ bool ff_client_encrypt_request_aes_256_gcm_pbkdf2(
     *tag_len = 16;
     *tag = calloc(1, 16);
 
-    if (!EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_GET_TAG, *tag_len, *tag))
+    if (!EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_AEAD_GET_TAG, *tag_len, *tag))
     {
         ff_log(FF_ERROR, "Failed to get cipher tag");
         goto error;
@@ -219,3 +249,39 @@ bool ff_client_encrypt_request_aes_256_gcm_pbkdf2(
 
     return ret_val;
 }
+
+const EVP_CIPHER *ff_client_cipher_for_mode(uint8_t encryption_mode)
+{
+    switch (encryption_mode)
+    {
+    case FF_CRYPTO_MODE_AES_256_GCM:
+        return EVP_aes_256_gcm();
+
+    case FF_CRYPTO_MODE_CHACHA20_POLY1305:
+        return EVP_chacha20_poly1305();
+
+    default:
+        return NULL;
+    }
+}
+
+bool ff_client_derive_key(
+    struct ff_encryption_config *config,
+    uint8_t key_derive_mode,
+    uint8_t *salt,
+    uint16_t salt_len,
+    struct ff_derived_key *key)
+{
+    switch (key_derive_mode)
+    {
+    case FF_KEY_DERIVE_MODE_PBKDF2:
+        return ff_derive_key_pbkdf2(config, salt, salt_len, key);
+
+    case FF_KEY_DERIVE_MODE_HKDF:
+        return ff_derive_key_hkdf(config, salt, salt_len, key);
+
+    default:
+        ff_log(FF_ERROR, "Unknown key derivation mode: %u", key_derive_mode);
+        return false;
+    }
+}
@@ -1,13 +1,16 @@
 #include <stdio.h>
 #include <stdbool.h>
+#include <openssl/evp.h>
 #include "../../src/request.h"
 
 #ifndef FF_CLIENT_CRYPTO_P_H
 #define FF_CLIENT_CRYPTO_P_H
 
-bool ff_client_encrypt_request_aes_256_gcm_pbkdf2(
+bool ff_client_encrypt_request_aead(
     struct ff_request *request,
     struct ff_encryption_config *config,
+    uint8_t encryption_mode,
+    uint8_t key_derive_mode,
     uint8_t **iv,
     uint16_t *iv_len,
     uint8_t **tag,
@@ -15,4 +18,13 @@ bool ff_client_encrypt_request_aes_256_gcm_pbkdf2(
     uint8_t **salt,
     uint16_t *salt_len);
 
+const EVP_CIPHER *ff_client_cipher_for_mode(uint8_t encryption_mode);
+
+bool ff_client_derive_key(
+    struct ff_encryption_config *config,
+    uint8_t key_derive_mode,
+    uint8_t *salt,
+    uint16_t salt_len,
+    struct ff_derived_key *key);
+
 #endif
\ No newline at end of file
@@ -15,6 +15,11 @@ export interface FfClientOptions {
   port: number;
   preSharedKey?: string;
   pbkdf2Iterations?: number;
+  /**
+   * Seconds to reuse a salt and derived key across requests so the
+   * proxy can serve the key from its cache, 0 = new salt per request
+   */
+  saltReuseInterval?: number;
 }
 
 export interface FfRequestOptions {
@@ -39,7 +44,15 @@ interface Packet {
 const MAX_PACKET_LENGTH = 1300;
 const OPTION_HEADER_LENGTH = 3;
 
+interface SessionKey {
+  salt: Uint8Array;
+  derivedKey: Buffer;
+  expiresAt: number;
+}
+
 export class FfClient {
+  private sessionKey?: SessionKey;
+
   constructor(private readonly config: FfClientOptions) {
     if (this.config.preSharedKey && this.config.preSharedKey.length > 32) {
       throw new Error(`Pre-shared key cannot be longer than 32 chars`);
@@ -213,23 +226,7 @@ export class FfClient {
       throw new Error(`Cannot encrypt payload without pre-shared key`);
     }
 
-    const salt = Uint8Array.from(crypto.randomBytes(16));
-    const derivedKey = await new Promise<Buffer>((resolve, reject) =>
-      crypto.pbkdf2(
-        this.config.preSharedKey!,
-        salt,
-        this.config.pbkdf2Iterations || 1000,
-        256 / 8,
-        "SHA256",
-        (err, key) => {
-          if (err) {
-            reject(err);
-          } else {
-            resolve(key);
-          }
-        }
-      )
-    );
+    const { salt, derivedKey } = await this._getDerivedKey();
 
     const iv = Uint8Array.from(crypto.randomBytes(12));
 
@@ -254,6 +251,43 @@ export class FfClient {
     };
   };
 
+  public _getDerivedKey = async (): Promise<{
+    salt: Uint8Array;
+    derivedKey: Buffer;
+  }> => {
+    if (this.sessionKey && Date.now() < this.sessionKey.expiresAt) {
+      return this.sessionKey;
+    }
+
+    const salt = Uint8Array.from(crypto.randomBytes(16));
+    const derivedKey = await new Promise<Buffer>((resolve, reject) =>
+      crypto.pbkdf2(
+        this.config.preSharedKey!,
+        salt,
+        this.config.pbkdf2Iterations || 1000,
+        256 / 8,
+        "SHA256",
+        (err, key) => {
+          if (err) {
+            reject(err);
+          } else {
+            resolve(key);
+          }
+        }
+      )
+    );
+
+    if (this.config.saltReuseInterval) {
+      this.sessionKey = {
+        salt,
+        derivedKey,
+        expiresAt: Date.now() + this.config.saltReuseInterval * 1000,
+      };
+    }
+
+    return { salt, derivedKey };
+  };
+
   public _packetiseRequest = (request: FfRequest): Packet[] => {
     const packets = [] as Packet[];
     let bytesLeft = request.payload.length;
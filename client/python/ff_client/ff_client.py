@@ -19,6 +19,9 @@ class FfClient:
     def __init__(self, config: FfConfig):
         self.config = config
         self.logger = self.init_default_logger()
+        self.session_salt = None
+        self.session_key = None
+        self.session_expires_at = 0
 
     def init_default_logger(self):
         logger = logging.getLogger('ff')
@@ -101,11 +104,7 @@ class FfClient:
             raise RuntimeError(
                 'Cannot encrypt payload without pre_shared_key set')
 
-        salt = get_random_bytes(16)
-        derived_key = PBKDF2(self.config.pre_shared_key, salt, 
-                             dkLen=32,
-                             count=self.config.pbkdf2_iterations, 
-                             hmac_hash_module=SHA256)
+        salt, derived_key = self.get_derived_key()
 
         iv = get_random_bytes(12)
 
@@ -147,6 +146,24 @@ class FfClient:
         self.logger.debug('Encrypted request into %d bytes' % len(ciphertext))
         return ciphertext
 
+    def get_derived_key(self):
+        # Reusing the salt lets the proxy serve the derived key from its cache
+        if self.session_key is not None and time.time() < self.session_expires_at:
+            return self.session_salt, self.session_key
+
+        salt = get_random_bytes(16)
+        derived_key = PBKDF2(self.config.pre_shared_key, salt, 
+                             dkLen=32,
+                             count=self.config.pbkdf2_iterations, 
+                             hmac_hash_module=SHA256)
+
+        if self.config.salt_reuse_interval > 0:
+            self.session_salt = salt
+            self.session_key = derived_key
+            self.session_expires_at = time.time() + self.config.salt_reuse_interval
+
+        return salt, derived_key
+
     def packetise_request(self, request: FfRequest) -> List[UdpPacket]:
         self.logger.debug('Packetising request')
 
@@ -13,7 +13,7 @@ def is_valid_ip(s: str):
 
 
 class FfConfig:
-    def __init__(self, ip_address: str, port: int, pre_shared_key: Optional[str] = None, pbkdf2_iterations: int = 1000, log_level=logging.ERROR):
+    def __init__(self, ip_address: str, port: int, pre_shared_key: Optional[str] = None, pbkdf2_iterations: int = 1000, log_level=logging.ERROR, salt_reuse_interval: int = 0):
         if not is_valid_ip(ip_address):
             raise ValueError('ip_address must be a valid IP address')
 
@@ -23,8 +23,13 @@ class FfConfig:
         if pbkdf2_iterations <= 0:
             raise ValueError('pbkdf2_iterations must be greater than 0')
 
+        if salt_reuse_interval < 0:
+            raise ValueError('salt_reuse_interval must not be negative')
+
         self.ip_address = ip_address
         self.port = port
         self.pre_shared_key = pre_shared_key
         self.pbkdf2_iterations = pbkdf2_iterations
         self.log_level = log_level
+        # Seconds to reuse a salt and derived key across requests, 0 = new salt per request
+        self.salt_reuse_interval = salt_reuse_interval
@@ -14,6 +14,36 @@
 #define FF_PARSE_ARG_PARSE_PSK 3
 #define FF_PARSE_ARG_PARSE_PBKDF2_ITERATIONS 4
 #define FF_PARSE_ARG_PARSE_TIMESTAMP_FUDGE_FACTOR 5
+#define FF_PARSE_ARG_PARSE_MAX_PARTIAL_BYTES 6
+#define FF_PARSE_ARG_PARSE_MAX_PARTIALS_PER_SOURCE 7
+#define FF_PARSE_ARG_PARSE_PARTIAL_EVICTION_POLICY 8
+#define FF_PARSE_ARG_PARSE_STATS_INTERVAL 9
+#define FF_PARSE_ARG_PARSE_KEY_CACHE_SIZE 10
+#define FF_PARSE_ARG_PARSE_KEY_DERIVE_MODES 11
+#define FF_PARSE_ARG_PARSE_CRYPTO_WORKERS 12
+#define FF_PARSE_ARG_PARSE_CRYPTO_BATCH_SIZE 13
+#define FF_PARSE_ARG_PARSE_KEYRING 14
+#define FF_PARSE_ARG_PARSE_REPLAY_FILTER_CAPACITY 15
+#define FF_PARSE_ARG_PARSE_CA_BUNDLE 16
+#define FF_PARSE_ARG_PARSE_TLS_SESSION_CACHE_SIZE 17
+#define FF_PARSE_ARG_PARSE_TLS_SESSION_MAX_AGE 18
+#define FF_PARSE_ARG_PARSE_UPSTREAM_MAX_IDLE 19
+#define FF_PARSE_ARG_PARSE_UPSTREAM_IDLE_TIMEOUT 20
+#define FF_PARSE_ARG_PARSE_UPSTREAM_MAX_REQUESTS 21
+#define FF_PARSE_ARG_PARSE_DNS_CACHE_SIZE 22
+#define FF_PARSE_ARG_PARSE_DNS_SERVER 23
+#define FF_PARSE_ARG_PARSE_DNS_MAX_STALE 24
+#define FF_PARSE_ARG_PARSE_DNS_PREFETCH 25
+#define FF_PARSE_ARG_PARSE_UPSTREAM_COMPLETION 26
+#define FF_PARSE_ARG_PARSE_UPSTREAM_COMPLETION_TIMEOUT 27
+#define FF_PARSE_ARG_PARSE_UPSTREAM_ENGINE_THREADS 28
+#define FF_PARSE_ARG_PARSE_UPSTREAM_TCP_FASTOPEN 29
+#define FF_PARSE_ARG_PARSE_UPSTREAM_EARLY_DATA 30
+#define FF_PARSE_ARG_PARSE_HAPPY_EYEBALLS_DELAY 31
+#define FF_PARSE_ARG_PARSE_UPSTREAM_HTTP2 32
+#define FF_PARSE_ARG_PARSE_UPSTREAM_MAX_IN_FLIGHT 33
+#define FF_PARSE_ARG_PARSE_UPSTREAM_QUEUE_SIZE 34
+#define FF_PARSE_ARG_PARSE_UPSTREAM_QUEUE_TIMEOUT 35
 
 static char *default_listen_address = "0.0.0.0";
 
@@ -29,6 +59,36 @@ enum ff_action ff_parse_arguments(struct ff_config *config, int argc, char **arg
         .key = NULL,
         .pbkdf2_iterations = 1000};
     uint16_t timestamp_fudge_factor = 30;
+    uint64_t max_partial_bytes = 64 * 1024 * 1024;
+    uint32_t max_partials_per_source = 64;
+    enum ff_request_budget_policy partial_eviction_policy = FF_REQUEST_BUDGET_POLICY_EVICT_LRU;
+    uint16_t stats_interval = 0;
+    uint32_t key_cache_size = 1024;
+    uint16_t crypto_workers = 0;
+    uint16_t crypto_batch_size = 16;
+    char *keyring_path = NULL;
+    uint32_t replay_filter_capacity = 65536;
+    char *ca_bundle_path = NULL;
+    uint32_t tls_session_cache_size = 256;
+    uint32_t tls_session_max_age = 3600;
+    uint32_t upstream_max_idle = 4;
+    uint32_t upstream_idle_timeout = 30;
+    uint32_t upstream_max_requests = 1000;
+    uint32_t dns_cache_size = 1024;
+    char *dns_server = NULL;
+    uint32_t dns_max_stale = 300;
+    char *dns_prefetch = NULL;
+    enum ff_http_completion_policy upstream_completion = FF_HTTP_COMPLETION_RESPONSE;
+    uint32_t upstream_completion_timeout = 1000;
+    uint16_t upstream_engine_threads = 0;
+    uint32_t upstream_fastopen_size = 0;
+    char *upstream_early_data = NULL;
+    uint32_t happy_eyeballs_delay = 250;
+    char *upstream_http2 = NULL;
+    uint32_t upstream_max_in_flight = 0;
+    uint32_t upstream_queue_size = 64;
+    uint32_t upstream_queue_timeout = 1000;
+    bool upstream_adaptive_limit = false;
 
     for (int i = 1; i < argc; i++)
     {
@@ -71,6 +131,130 @@ enum ff_action ff_parse_arguments(struct ff_config *config, int argc, char **arg
             {
                 state = FF_PARSE_ARG_PARSE_TIMESTAMP_FUDGE_FACTOR;
             }
+            else if (strcasecmp(arg, "--max-partial-bytes") == 0)
+            {
+                state = FF_PARSE_ARG_PARSE_MAX_PARTIAL_BYTES;
+            }
+            else if (strcasecmp(arg, "--max-partials-per-source") == 0)
+            {
+                state = FF_PARSE_ARG_PARSE_MAX_PARTIALS_PER_SOURCE;
+            }
+            else if (strcasecmp(arg, "--partial-eviction-policy") == 0)
+            {
+                state = FF_PARSE_ARG_PARSE_PARTIAL_EVICTION_POLICY;
+            }
+            else if (strcasecmp(arg, "--stats-interval") == 0)
+            {
+                state = FF_PARSE_ARG_PARSE_STATS_INTERVAL;
+            }
+            else if (strcasecmp(arg, "--key-cache-size") == 0)
+            {
+                state = FF_PARSE_ARG_PARSE_KEY_CACHE_SIZE;
+            }
+            else if (strcasecmp(arg, "--key-derive-modes") == 0)
+            {
+                state = FF_PARSE_ARG_PARSE_KEY_DERIVE_MODES;
+            }
+            else if (strcasecmp(arg, "--crypto-workers") == 0)
+            {
+                state = FF_PARSE_ARG_PARSE_CRYPTO_WORKERS;
+            }
+            else if (strcasecmp(arg, "--crypto-batch-size") == 0)
+            {
+                state = FF_PARSE_ARG_PARSE_CRYPTO_BATCH_SIZE;
+            }
+            else if (strcasecmp(arg, "--keyring") == 0)
+            {
+                state = FF_PARSE_ARG_PARSE_KEYRING;
+            }
+            else if (strcasecmp(arg, "--replay-filter-capacity") == 0)
+            {
+                state = FF_PARSE_ARG_PARSE_REPLAY_FILTER_CAPACITY;
+            }
+            else if (strcasecmp(arg, "--ca-bundle") == 0)
+            {
+                state = FF_PARSE_ARG_PARSE_CA_BUNDLE;
+            }
+            else if (strcasecmp(arg, "--tls-session-cache-size") == 0)
+            {
+                state = FF_PARSE_ARG_PARSE_TLS_SESSION_CACHE_SIZE;
+            }
+            else if (strcasecmp(arg, "--tls-session-max-age") == 0)
+            {
+                state = FF_PARSE_ARG_PARSE_TLS_SESSION_MAX_AGE;
+            }
+            else if (strcasecmp(arg, "--upstream-max-idle") == 0)
+            {
+                state = FF_PARSE_ARG_PARSE_UPSTREAM_MAX_IDLE;
+            }
+            else if (strcasecmp(arg, "--upstream-idle-timeout") == 0)
+            {
+                state = FF_PARSE_ARG_PARSE_UPSTREAM_IDLE_TIMEOUT;
+            }
+            else if (strcasecmp(arg, "--upstream-max-requests") == 0)
+            {
+                state = FF_PARSE_ARG_PARSE_UPSTREAM_MAX_REQUESTS;
+            }
+            else if (strcasecmp(arg, "--dns-cache-size") == 0)
+            {
+                state = FF_PARSE_ARG_PARSE_DNS_CACHE_SIZE;
+            }
+            else if (strcasecmp(arg, "--dns-server") == 0)
+            {
+                state = FF_PARSE_ARG_PARSE_DNS_SERVER;
+            }
+            else if (strcasecmp(arg, "--dns-max-stale") == 0)
+            {
+                state = FF_PARSE_ARG_PARSE_DNS_MAX_STALE;
+            }
+            else if (strcasecmp(arg, "--dns-prefetch") == 0)
+            {
+                state = FF_PARSE_ARG_PARSE_DNS_PREFETCH;
+            }
+            else if (strcasecmp(arg, "--upstream-completion") == 0)
+            {
+                state = FF_PARSE_ARG_PARSE_UPSTREAM_COMPLETION;
+            }
+            else if (strcasecmp(arg, "--upstream-completion-timeout") == 0)
+            {
+                state = FF_PARSE_ARG_PARSE_UPSTREAM_COMPLETION_TIMEOUT;
+            }
+            else if (strcasecmp(arg, "--upstream-engine-threads") == 0)
+            {
+                state = FF_PARSE_ARG_PARSE_UPSTREAM_ENGINE_THREADS;
+            }
+            else if (strcasecmp(arg, "--upstream-tcp-fastopen") == 0)
+            {
+                state = FF_PARSE_ARG_PARSE_UPSTREAM_TCP_FASTOPEN;
+            }
+            else if (strcasecmp(arg, "--upstream-early-data") == 0)
+            {
+                state = FF_PARSE_ARG_PARSE_UPSTREAM_EARLY_DATA;
+            }
+            else if (strcasecmp(arg, "--happy-eyeballs-delay") == 0)
+            {
+                state = FF_PARSE_ARG_PARSE_HAPPY_EYEBALLS_DELAY;
+            }
+            else if (strcasecmp(arg, "--upstream-http2") == 0)
+            {
+                state = FF_PARSE_ARG_PARSE_UPSTREAM_HTTP2;
+            }
+            else if (strcasecmp(arg, "--upstream-max-in-flight") == 0)
+            {
+                state = FF_PARSE_ARG_PARSE_UPSTREAM_MAX_IN_FLIGHT;
+            }
+            else if (strcasecmp(arg, "--upstream-queue-size") == 0)
+            {
+                state = FF_PARSE_ARG_PARSE_UPSTREAM_QUEUE_SIZE;
+            }
+            else if (strcasecmp(arg, "--upstream-queue-timeout") == 0)
+            {
+                state = FF_PARSE_ARG_PARSE_UPSTREAM_QUEUE_TIMEOUT;
+            }
+            else if (strcasecmp(arg, "--upstream-adaptive-limit") == 0)
+            {
+                upstream_adaptive_limit = true;
+            }
             else if (strcasecmp(arg, "-vvv") == 0)
             {
                 logging_level = FF_DEBUG;
@@ -168,6 +352,455 @@ enum ff_action ff_parse_arguments(struct ff_config *config, int argc, char **arg
             break;
         }
 
+        case FF_PARSE_ARG_PARSE_MAX_PARTIAL_BYTES:
+        {
+            char *end = NULL;
+            unsigned long long parsed = strtoull(arg, &end, 10);
+
+            if (end == arg || *end != '\0' || *arg == '-')
+            {
+                fprintf(stderr, "Invalid --max-partial-bytes argument: %s\n\n", arg);
+                action = FF_ACTION_INVALID_ARGS;
+                goto done;
+            }
+
+            max_partial_bytes = (uint64_t)parsed;
+
+            state = FF_PARSE_ARG_STATE_DEFAULT;
+            break;
+        }
+
+        case FF_PARSE_ARG_PARSE_MAX_PARTIALS_PER_SOURCE:
+        {
+            int parsed = atoi(arg);
+
+            if (parsed < 0 || (parsed == 0 && strcmp(arg, "0") != 0))
+            {
+                fprintf(stderr, "Invalid --max-partials-per-source argument: %s\n\n", arg);
+                action = FF_ACTION_INVALID_ARGS;
+                goto done;
+            }
+
+            max_partials_per_source = (uint32_t)parsed;
+
+            state = FF_PARSE_ARG_STATE_DEFAULT;
+            break;
+        }
+
+        case FF_PARSE_ARG_PARSE_PARTIAL_EVICTION_POLICY:
+            if (strcasecmp(arg, "refuse") == 0)
+            {
+                partial_eviction_policy = FF_REQUEST_BUDGET_POLICY_REFUSE;
+            }
+            else if (strcasecmp(arg, "lru") == 0)
+            {
+                partial_eviction_policy = FF_REQUEST_BUDGET_POLICY_EVICT_LRU;
+            }
+            else if (strcasecmp(arg, "largest") == 0)
+            {
+                partial_eviction_policy = FF_REQUEST_BUDGET_POLICY_EVICT_LARGEST;
+            }
+            else
+            {
+                fprintf(stderr, "Invalid --partial-eviction-policy argument: %s\n\n", arg);
+                action = FF_ACTION_INVALID_ARGS;
+                goto done;
+            }
+
+            state = FF_PARSE_ARG_STATE_DEFAULT;
+            break;
+
+        case FF_PARSE_ARG_PARSE_STATS_INTERVAL:
+        {
+            int parsed = atoi(arg);
+
+            if (parsed <= 0 || parsed > UINT16_MAX)
+            {
+                fprintf(stderr, "Invalid --stats-interval argument: %s\n\n", arg);
+                action = FF_ACTION_INVALID_ARGS;
+                goto done;
+            }
+
+            stats_interval = (uint16_t)parsed;
+
+            state = FF_PARSE_ARG_STATE_DEFAULT;
+            break;
+        }
+
+        case FF_PARSE_ARG_PARSE_KEY_CACHE_SIZE:
+        {
+            int parsed = atoi(arg);
+
+            if (parsed < 0 || (parsed == 0 && strcmp(arg, "0") != 0))
+            {
+                fprintf(stderr, "Invalid --key-cache-size argument: %s\n\n", arg);
+                action = FF_ACTION_INVALID_ARGS;
+                goto done;
+            }
+
+            key_cache_size = (uint32_t)parsed;
+
+            state = FF_PARSE_ARG_STATE_DEFAULT;
+            break;
+        }
+
+        case FF_PARSE_ARG_PARSE_KEY_DERIVE_MODES:
+            if (!ff_parse_key_derivation_modes(arg, &encryption_config.allowed_key_derivation_modes))
+            {
+                fprintf(stderr, "Invalid --key-derive-modes argument: %s\n\n", arg);
+                action = FF_ACTION_INVALID_ARGS;
+                goto done;
+            }
+
+            state = FF_PARSE_ARG_STATE_DEFAULT;
+            break;
+
+        case FF_PARSE_ARG_PARSE_CRYPTO_WORKERS:
+        {
+            int parsed = atoi(arg);
+
+            if (parsed < 0 || parsed > UINT8_MAX || (parsed == 0 && strcmp(arg, "0") != 0))
+            {
+                fprintf(stderr, "Invalid --crypto-workers argument: %s\n\n", arg);
+                action = FF_ACTION_INVALID_ARGS;
+                goto done;
+            }
+
+            crypto_workers = (uint16_t)parsed;
+
+            state = FF_PARSE_ARG_STATE_DEFAULT;
+            break;
+        }
+
+        case FF_PARSE_ARG_PARSE_CRYPTO_BATCH_SIZE:
+        {
+            int parsed = atoi(arg);
+
+            if (parsed <= 0 || parsed > UINT16_MAX)
+            {
+                fprintf(stderr, "Invalid --crypto-batch-size argument: %s\n\n", arg);
+                action = FF_ACTION_INVALID_ARGS;
+                goto done;
+            }
+
+            crypto_batch_size = (uint16_t)parsed;
+
+            state = FF_PARSE_ARG_STATE_DEFAULT;
+            break;
+        }
+
+        case FF_PARSE_ARG_PARSE_KEYRING:
+            keyring_path = arg;
+            state = FF_PARSE_ARG_STATE_DEFAULT;
+            break;
+
+        case FF_PARSE_ARG_PARSE_REPLAY_FILTER_CAPACITY:
+        {
+            int parsed = atoi(arg);
+
+            if (parsed < 0 || (parsed == 0 && strcmp(arg, "0") != 0))
+            {
+                fprintf(stderr, "Invalid --replay-filter-capacity argument: %s\n\n", arg);
+                action = FF_ACTION_INVALID_ARGS;
+                goto done;
+            }
+
+            replay_filter_capacity = (uint32_t)parsed;
+
+            state = FF_PARSE_ARG_STATE_DEFAULT;
+            break;
+        }
+
+        case FF_PARSE_ARG_PARSE_CA_BUNDLE:
+            ca_bundle_path = arg;
+            state = FF_PARSE_ARG_STATE_DEFAULT;
+            break;
+
+        case FF_PARSE_ARG_PARSE_TLS_SESSION_CACHE_SIZE:
+        {
+            int parsed = atoi(arg);
+
+            if (parsed < 0 || (parsed == 0 && strcmp(arg, "0") != 0))
+            {
+                fprintf(stderr, "Invalid --tls-session-cache-size argument: %s\n\n", arg);
+                action = FF_ACTION_INVALID_ARGS;
+                goto done;
+            }
+
+            tls_session_cache_size = (uint32_t)parsed;
+
+            state = FF_PARSE_ARG_STATE_DEFAULT;
+            break;
+        }
+
+        case FF_PARSE_ARG_PARSE_TLS_SESSION_MAX_AGE:
+        {
+            int parsed = atoi(arg);
+
+            if (parsed <= 0)
+            {
+                fprintf(stderr, "Invalid --tls-session-max-age argument: %s\n\n", arg);
+                action = FF_ACTION_INVALID_ARGS;
+                goto done;
+            }
+
+            tls_session_max_age = (uint32_t)parsed;
+
+            state = FF_PARSE_ARG_STATE_DEFAULT;
+            break;
+        }
+
+        case FF_PARSE_ARG_PARSE_UPSTREAM_MAX_IDLE:
+        {
+            int parsed = atoi(arg);
+
+            if (parsed < 0 || (parsed == 0 && strcmp(arg, "0") != 0))
+            {
+                fprintf(stderr, "Invalid --upstream-max-idle argument: %s\n\n", arg);
+                action = FF_ACTION_INVALID_ARGS;
+                goto done;
+            }
+
+            upstream_max_idle = (uint32_t)parsed;
+
+            state = FF_PARSE_ARG_STATE_DEFAULT;
+            break;
+        }
+
+        case FF_PARSE_ARG_PARSE_UPSTREAM_IDLE_TIMEOUT:
+        {
+            int parsed = atoi(arg);
+
+            if (parsed <= 0)
+            {
+                fprintf(stderr, "Invalid --upstream-idle-timeout argument: %s\n\n", arg);
+                action = FF_ACTION_INVALID_ARGS;
+                goto done;
+            }
+
+            upstream_idle_timeout = (uint32_t)parsed;
+
+            state = FF_PARSE_ARG_STATE_DEFAULT;
+            break;
+        }
+
+        case FF_PARSE_ARG_PARSE_UPSTREAM_MAX_REQUESTS:
+        {
+            int parsed = atoi(arg);
+
+            if (parsed < 0 || (parsed == 0 && strcmp(arg, "0") != 0))
+            {
+                fprintf(stderr, "Invalid --upstream-max-requests argument: %s\n\n", arg);
+                action = FF_ACTION_INVALID_ARGS;
+                goto done;
+            }
+
+            upstream_max_requests = (uint32_t)parsed;
+
+            state = FF_PARSE_ARG_STATE_DEFAULT;
+            break;
+        }
+
+        case FF_PARSE_ARG_PARSE_DNS_CACHE_SIZE:
+        {
+            int parsed = atoi(arg);
+
+            if (parsed < 0 || (parsed == 0 && strcmp(arg, "0") != 0))
+            {
+                fprintf(stderr, "Invalid --dns-cache-size argument: %s\n\n", arg);
+                action = FF_ACTION_INVALID_ARGS;
+                goto done;
+            }
+
+            dns_cache_size = (uint32_t)parsed;
+
+            state = FF_PARSE_ARG_STATE_DEFAULT;
+            break;
+        }
+
+        case FF_PARSE_ARG_PARSE_DNS_SERVER:
+            dns_server = arg;
+            state = FF_PARSE_ARG_STATE_DEFAULT;
+            break;
+
+        case FF_PARSE_ARG_PARSE_DNS_MAX_STALE:
+        {
+            int parsed = atoi(arg);
+
+            if (parsed < 0 || (parsed == 0 && strcmp(arg, "0") != 0))
+            {
+                fprintf(stderr, "Invalid --dns-max-stale argument: %s\n\n", arg);
+                action = FF_ACTION_INVALID_ARGS;
+                goto done;
+            }
+
+            dns_max_stale = (uint32_t)parsed;
+
+            state = FF_PARSE_ARG_STATE_DEFAULT;
+            break;
+        }
+
+        case FF_PARSE_ARG_PARSE_DNS_PREFETCH:
+            dns_prefetch = arg;
+            state = FF_PARSE_ARG_STATE_DEFAULT;
+            break;
+
+        case FF_PARSE_ARG_PARSE_UPSTREAM_COMPLETION:
+            if (strcasecmp(arg, "response") == 0)
+            {
+                upstream_completion = FF_HTTP_COMPLETION_RESPONSE;
+            }
+            else if (strcasecmp(arg, "status") == 0)
+            {
+                upstream_completion = FF_HTTP_COMPLETION_STATUS;
+            }
+            else if (strcasecmp(arg, "acked") == 0)
+            {
+                upstream_completion = FF_HTTP_COMPLETION_ACKED;
+            }
+            else if (strcasecmp(arg, "drain") == 0)
+            {
+                upstream_completion = FF_HTTP_COMPLETION_DRAIN;
+            }
+            else
+            {
+                fprintf(stderr, "Invalid --upstream-completion argument: %s\n\n", arg);
+                action = FF_ACTION_INVALID_ARGS;
+                goto done;
+            }
+
+            state = FF_PARSE_ARG_STATE_DEFAULT;
+            break;
+
+        case FF_PARSE_ARG_PARSE_UPSTREAM_COMPLETION_TIMEOUT:
+        {
+            int parsed = atoi(arg);
+
+            if (parsed <= 0)
+            {
+                fprintf(stderr, "Invalid --upstream-completion-timeout argument: %s\n\n", arg);
+                action = FF_ACTION_INVALID_ARGS;
+                goto done;
+            }
+
+            upstream_completion_timeout = (uint32_t)parsed;
+
+            state = FF_PARSE_ARG_STATE_DEFAULT;
+            break;
+        }
+
+        case FF_PARSE_ARG_PARSE_UPSTREAM_ENGINE_THREADS:
+        {
+            int parsed = atoi(arg);
+
+            if (parsed < 0 || parsed > UINT8_MAX || (parsed == 0 && strcmp(arg, "0") != 0))
+            {
+                fprintf(stderr, "Invalid --upstream-engine-threads argument: %s\n\n", arg);
+                action = FF_ACTION_INVALID_ARGS;
+                goto done;
+            }
+
+            upstream_engine_threads = (uint16_t)parsed;
+
+            state = FF_PARSE_ARG_STATE_DEFAULT;
+            break;
+        }
+
+        case FF_PARSE_ARG_PARSE_UPSTREAM_TCP_FASTOPEN:
+        {
+            int parsed = atoi(arg);
+
+            if (parsed < 0 || (parsed == 0 && strcmp(arg, "0") != 0))
+            {
+                fprintf(stderr, "Invalid --upstream-tcp-fastopen argument: %s\n\n", arg);
+                action = FF_ACTION_INVALID_ARGS;
+                goto done;
+            }
+
+            upstream_fastopen_size = (uint32_t)parsed;
+
+            state = FF_PARSE_ARG_STATE_DEFAULT;
+            break;
+        }
+
+        case FF_PARSE_ARG_PARSE_UPSTREAM_EARLY_DATA:
+            upstream_early_data = arg;
+            state = FF_PARSE_ARG_STATE_DEFAULT;
+            break;
+
+        case FF_PARSE_ARG_PARSE_HAPPY_EYEBALLS_DELAY:
+        {
+            int parsed = atoi(arg);
+
+            if (parsed < 0 || (parsed == 0 && strcmp(arg, "0") != 0))
+            {
+                fprintf(stderr, "Invalid --happy-eyeballs-delay argument: %s\n\n", arg);
+                action = FF_ACTION_INVALID_ARGS;
+                goto done;
+            }
+
+            happy_eyeballs_delay = (uint32_t)parsed;
+
+            state = FF_PARSE_ARG_STATE_DEFAULT;
+            break;
+        }
+
+        case FF_PARSE_ARG_PARSE_UPSTREAM_HTTP2:
+            upstream_http2 = arg;
+            state = FF_PARSE_ARG_STATE_DEFAULT;
+            break;
+
+        case FF_PARSE_ARG_PARSE_UPSTREAM_MAX_IN_FLIGHT:
+        {
+            int parsed = atoi(arg);
+
+            if (parsed < 0 || (parsed == 0 && strcmp(arg, "0") != 0))
+            {
+                fprintf(stderr, "Invalid --upstream-max-in-flight argument: %s\n\n", arg);
+                action = FF_ACTION_INVALID_ARGS;
+                goto done;
+            }
+
+            upstream_max_in_flight = (uint32_t)parsed;
+
+            state = FF_PARSE_ARG_STATE_DEFAULT;
+            break;
+        }
+
+        case FF_PARSE_ARG_PARSE_UPSTREAM_QUEUE_SIZE:
+        {
+            int parsed = atoi(arg);
+
+            if (parsed < 0 || (parsed == 0 && strcmp(arg, "0") != 0))
+            {
+                fprintf(stderr, "Invalid --upstream-queue-size argument: %s\n\n", arg);
+                action = FF_ACTION_INVALID_ARGS;
+                goto done;
+            }
+
+            upstream_queue_size = (uint32_t)parsed;
+
+            state = FF_PARSE_ARG_STATE_DEFAULT;
+            break;
+        }
+
+        case FF_PARSE_ARG_PARSE_UPSTREAM_QUEUE_TIMEOUT:
+        {
+            int parsed = atoi(arg);
+
+            if (parsed < 0 || (parsed == 0 && strcmp(arg, "0") != 0))
+            {
+                fprintf(stderr, "Invalid --upstream-queue-timeout argument: %s\n\n", arg);
+                action = FF_ACTION_INVALID_ARGS;
+                goto done;
+            }
+
+            upstream_queue_timeout = (uint32_t)parsed;
+
+            state = FF_PARSE_ARG_STATE_DEFAULT;
+            break;
+        }
+
         default:
             fputs("Unkown parse arg state\n\n", stderr);
             action = FF_ACTION_INVALID_ARGS;
@@ -189,12 +822,77 @@ enum ff_action ff_parse_arguments(struct ff_config *config, int argc, char **arg
         config->encryption = encryption_config;
         config->logging_level = logging_level;
         config->timestamp_fudge_factor = timestamp_fudge_factor;
+        config->max_partial_bytes = max_partial_bytes;
+        config->max_partials_per_source = max_partials_per_source;
+        config->partial_eviction_policy = partial_eviction_policy;
+        config->stats_interval = stats_interval;
+        config->key_cache_size = key_cache_size;
+        config->crypto_workers = crypto_workers;
+        config->crypto_batch_size = crypto_batch_size;
+        config->keyring_path = keyring_path;
+        config->replay_filter_capacity = replay_filter_capacity;
+        config->ca_bundle_path = ca_bundle_path;
+        config->tls_session_cache_size = tls_session_cache_size;
+        config->tls_session_max_age = tls_session_max_age;
+        config->upstream_max_idle = upstream_max_idle;
+        config->upstream_idle_timeout = upstream_idle_timeout;
+        config->upstream_max_requests = upstream_max_requests;
+        config->dns_cache_size = dns_cache_size;
+        config->dns_server = dns_server;
+        config->dns_max_stale = dns_max_stale;
+        config->dns_prefetch = dns_prefetch;
+        config->upstream_completion = upstream_completion;
+        config->upstream_completion_timeout = upstream_completion_timeout;
+        config->upstream_engine_threads = upstream_engine_threads;
+        config->upstream_fastopen_size = upstream_fastopen_size;
+        config->upstream_early_data = upstream_early_data;
+        config->happy_eyeballs_delay = happy_eyeballs_delay;
+        config->upstream_http2 = upstream_http2;
+        config->upstream_max_in_flight = upstream_max_in_flight;
+        config->upstream_queue_size = upstream_queue_size;
+        config->upstream_queue_timeout = upstream_queue_timeout;
+        config->upstream_adaptive_limit = upstream_adaptive_limit;
     }
 
 done:
     return action;
 }
 
+bool ff_parse_key_derivation_modes(const char *arg, uint32_t *modes)
+{
+    const char *mode = arg;
+    size_t mode_length;
+
+    *modes = 0;
+
+    while (*mode != '\0')
+    {
+        mode_length = strcspn(mode, ",");
+
+        if (mode_length == strlen("pbkdf2") && strncasecmp(mode, "pbkdf2", mode_length) == 0)
+        {
+            *modes |= FF_KEY_DERIVE_MODE_FLAG(FF_KEY_DERIVE_MODE_PBKDF2);
+        }
+        else if (mode_length == strlen("hkdf") && strncasecmp(mode, "hkdf", mode_length) == 0)
+        {
+            *modes |= FF_KEY_DERIVE_MODE_FLAG(FF_KEY_DERIVE_MODE_HKDF);
+        }
+        else
+        {
+            return false;
+        }
+
+        mode += mode_length;
+
+        if (*mode == ',')
+        {
+            mode++;
+        }
+    }
+
+    return *modes != 0;
+}
+
 void ff_print_usage(FILE *fd)
 {
     const char message[] = "\
@@ -206,6 +904,37 @@ start proxy: ff\n\
     [--pbkdf2-iterations num] # hashing iterations used to derive encryption keys \n\
     [--timestamp-fudge-factor num] # amount of seconds away from the hosts time to tolerate for incoming requests \n\
     [--pre-shared-key pre_shared_key]\n\
+    [--keyring path] # file of id:key pre-shared keys selected by the request's key id, reloaded on SIGHUP \n\
+    [--max-partial-bytes num] # memory budget for partially received requests, 0 = unlimited \n\
+    [--max-partials-per-source num] # concurrent partial requests allowed per source address, 0 = unlimited \n\
+    [--partial-eviction-policy lru|largest|refuse] # action taken when the partial request budget is exhausted \n\
+    [--stats-interval secs] # print stats to stdout periodically \n\
+    [--key-cache-size num] # number of derived encryption keys to cache, 0 = disabled \n\
+    [--key-derive-modes pbkdf2,hkdf] # key derivation modes accepted on encrypted requests \n\
+    [--crypto-workers num] # CPU pinned threads decrypting completed requests, 0 = decrypt on the request thread \n\
+    [--crypto-batch-size num] # maximum requests a crypto worker decrypts at once \n\
+    [--replay-filter-capacity num] # encrypted requests remembered per replay window to reject replays, 0 = disabled \n\
+    [--ca-bundle path] # PEM file of CAs trusted for upstream HTTPS requests, reloaded on SIGHUP \n\
+    [--tls-session-cache-size num] # upstream hosts to keep TLS sessions for, 0 = disabled \n\
+    [--tls-session-max-age secs] # maximum age of a TLS session or ticket to resume \n\
+    [--upstream-max-idle num] # idle keep-alive connections kept per upstream address, 0 = disabled \n\
+    [--upstream-idle-timeout secs] # time an idle upstream connection is kept open \n\
+    [--upstream-max-requests num] # requests sent over an upstream connection before it is closed, 0 = unlimited \n\
+    [--dns-cache-size num] # upstream host names to cache DNS records for, 0 = use the system resolver every request \n\
+    [--dns-server ip[:port]] # DNS server to query, defaults to the nameservers in /etc/resolv.conf \n\
+    [--dns-max-stale secs] # time expired DNS records are served while being refreshed \n\
+    [--dns-prefetch host,...] # host names to resolve on startup \n\
+    [--upstream-completion response|status|acked|drain] # when a forwarded request's thread is released \n\
+    [--upstream-completion-timeout ms] # longest wait for a status line or acknowledgement \n\
+    [--upstream-engine-threads num] # event loops forwarding requests over non-blocking connections, 0 = a thread per request \n\
+    [--upstream-tcp-fastopen num] # plain HTTP upstream addresses to attempt TCP Fast Open with, 0 = disabled \n\
+    [--upstream-early-data host,...] # HTTPS upstream hosts safe requests are sent to as TLS 1.3 early data \n\
+    [--happy-eyeballs-delay ms] # time before racing a connection to an upstream's next address, 0 = only the first address \n\
+    [--upstream-http2 host,...] # HTTPS upstream hosts requests are multiplexed to over HTTP/2, requires --upstream-engine-threads \n\
+    [--upstream-max-in-flight num] # requests in flight to each upstream host, 0 = unlimited \n\
+    [--upstream-queue-size num] # requests queued per upstream host over its limit, more are dropped \n\
+    [--upstream-queue-timeout ms] # longest a request waits in an upstream host's queue \n\
+    [--upstream-adaptive-limit] # back each host's limit off while it's failing or slow \n\
     -v[vv] \n\
 \n\
 show version: ff --version\n\
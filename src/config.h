@@ -2,6 +2,8 @@
 #include <stdbool.h>
 #include "logging.h"
 #include "crypto.h"
+#include "request_budget.h"
+#include "http_completion.h"
 #include "version.h"
 
 #ifndef FF_CONFIG_H
@@ -15,6 +17,56 @@ struct ff_config
     struct ff_encryption_config encryption;
     enum ff_log_type logging_level;
     bool ipv6_v6only;
+    uint64_t max_partial_bytes;
+    uint32_t max_partials_per_source;
+    enum ff_request_budget_policy partial_eviction_policy;
+    uint16_t stats_interval;
+    uint32_t key_cache_size;
+    // 0 = decrypt on each request's own thread
+    uint16_t crypto_workers;
+    uint16_t crypto_batch_size;
+    // File of id:key lines, reloaded on SIGHUP
+    char *keyring_path;
+    // (salt, IV) pairs remembered per replay window, 0 = disabled
+    uint32_t replay_filter_capacity;
+    // Trust store for upstream HTTPS, reloaded on SIGHUP, NULL = OpenSSL's default verify paths
+    char *ca_bundle_path;
+    // Upstream hosts to keep TLS sessions for, 0 = full handshake every request
+    uint32_t tls_session_cache_size;
+    uint32_t tls_session_max_age;
+    // Idle keep-alive connections kept per upstream address or HTTPS host, 0 = close after every request
+    uint32_t upstream_max_idle;
+    uint32_t upstream_idle_timeout;
+    // 0 = unlimited
+    uint32_t upstream_max_requests;
+    // Host names cached with their DNS TTLs, 0 = getaddrinfo every request
+    uint32_t dns_cache_size;
+    // ip[:port], NULL = the nameservers in resolv.conf
+    char *dns_server;
+    uint32_t dns_max_stale;
+    // Comma separated host names resolved on startup
+    char *dns_prefetch;
+    enum ff_http_completion_policy upstream_completion;
+    // Milliseconds to wait for a status line or acknowledgement
+    uint32_t upstream_completion_timeout;
+    // Event loops forwarding requests, 0 = a blocking thread per request
+    uint16_t upstream_engine_threads;
+    // Plain HTTP upstream addresses to attempt TCP Fast Open with, 0 = disabled
+    uint32_t upstream_fastopen_size;
+    // Comma separated HTTPS upstream hosts sent safe requests as TLS 1.3 early data, NULL = disabled
+    char *upstream_early_data;
+    // Milliseconds between racing connections to an upstream's addresses, 0 = only the first address
+    uint32_t happy_eyeballs_delay;
+    // Comma separated HTTPS upstream hosts requests are multiplexed to over HTTP/2, NULL = disabled
+    char *upstream_http2;
+    // Requests in flight to each upstream host, 0 = unlimited
+    uint32_t upstream_max_in_flight;
+    // Requests queued per upstream host over its limit, more are dropped
+    uint32_t upstream_queue_size;
+    // Milliseconds a request waits in an upstream host's queue
+    uint32_t upstream_queue_timeout;
+    // Whether each host's limit backs off while it's failing or slow (AIMD)
+    bool upstream_adaptive_limit;
 };
 
 enum ff_action
@@ -27,6 +79,11 @@ enum ff_action
 
 enum ff_action ff_parse_arguments(struct ff_config *config, int argc, char **argv);
 
+/**
+ * Parses a comma separated list of key derivation modes into a bitmask of FF_KEY_DERIVE_MODE_FLAG values
+ */
+bool ff_parse_key_derivation_modes(const char *arg, uint32_t *modes);
+
 void ff_print_usage(FILE *fd);
 
 void ff_print_version(FILE *fd);
@@ -0,0 +1,287 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include "connection_pool.h"
+#include "connection_pool_p.h"
+#include "stats.h"
+#include "logging.h"
+#include "fnv.h"
+#include "alloc.h"
+
+struct ff_connection_pool *ff_connection_pool_init(
+    uint32_t max_idle_per_host,
+    uint32_t idle_timeout,
+    uint32_t max_requests,
+    ff_connection_pool_close close_connection)
+{
+    struct ff_connection_pool *pool = calloc(1, sizeof(struct ff_connection_pool));
+
+    pool->max_idle_per_host = max_idle_per_host;
+    pool->idle_timeout = idle_timeout;
+    pool->max_requests = max_requests;
+    pool->close_connection = close_connection;
+    pool->hosts = ff_hash_table_init(16);
+    pthread_mutex_init(&pool->mutex, NULL);
+
+    return pool;
+}
+
+bool ff_connection_pool_acquire(
+    struct ff_connection_pool *pool,
+    const char *key,
+    int *sockfd,
+    void **context,
+    uint32_t *requests)
+{
+    struct ff_connection_pool_host *host = NULL;
+    struct ff_connection_pool_connection *connection = NULL;
+    time_t idle_before = time(NULL) - (time_t)pool->idle_timeout;
+    bool acquired = false;
+
+    pthread_mutex_lock(&pool->mutex);
+
+    host = ff_connection_pool_find(pool, ff_connection_pool_hash(key), key);
+
+    while (host != NULL && (connection = host->idle) != NULL)
+    {
+        host->idle = connection->next;
+        host->idle_length--;
+
+        if (connection->idle_since > idle_before && ff_connection_pool_is_alive(connection->sockfd))
+        {
+            *sockfd = connection->sockfd;
+            *context = connection->context;
+            *requests = connection->requests;
+            acquired = true;
+            FREE(connection);
+            break;
+        }
+
+        ff_log(FF_DEBUG, "Discarding stale pooled connection to %s", key);
+        pool->close_connection(connection->sockfd, connection->context);
+        FF_STATS_DEC(upstream_connections_idle);
+        FREE(connection);
+    }
+
+    if (host != NULL && host->idle == NULL)
+    {
+        ff_connection_pool_remove_host(pool, host);
+    }
+
+    pthread_mutex_unlock(&pool->mutex);
+
+    if (acquired)
+    {
+        FF_STATS_DEC(upstream_connections_idle);
+        FF_STATS_INC(upstream_connections_reused);
+    }
+
+    return acquired;
+}
+
+void ff_connection_pool_release(
+    struct ff_connection_pool *pool,
+    const char *key,
+    int sockfd,
+    void *context,
+    uint32_t requests)
+{
+    uint64_t hash = ff_connection_pool_hash(key);
+    struct ff_connection_pool_host *host = NULL;
+    struct ff_connection_pool_connection *connection = NULL;
+
+    if (pool->max_requests != 0 && requests >= pool->max_requests)
+    {
+        pool->close_connection(sockfd, context);
+        return;
+    }
+
+    pthread_mutex_lock(&pool->mutex);
+
+    host = ff_connection_pool_find(pool, hash, key);
+
+    if (host != NULL && host->idle_length >= pool->max_idle_per_host)
+    {
+        pthread_mutex_unlock(&pool->mutex);
+        pool->close_connection(sockfd, context);
+        return;
+    }
+
+    if (host == NULL)
+    {
+        host = calloc(1, sizeof(struct ff_connection_pool_host));
+        host->hash = hash;
+        host->key = strdup(key);
+        host->next = ff_hash_table_get_item(pool->hosts, hash);
+        ff_hash_table_put_item(pool->hosts, hash, host);
+    }
+
+    connection = malloc(sizeof(struct ff_connection_pool_connection));
+    connection->sockfd = sockfd;
+    connection->context = context;
+    connection->requests = requests;
+    connection->idle_since = time(NULL);
+    connection->next = host->idle;
+    host->idle = connection;
+    host->idle_length++;
+    FF_STATS_INC(upstream_connections_idle);
+
+    pthread_mutex_unlock(&pool->mutex);
+}
+
+void ff_connection_pool_evict_idle(struct ff_connection_pool *pool)
+{
+    struct ff_hash_table_snapshot *snapshot = NULL;
+    struct ff_connection_pool_host *host = NULL;
+    struct ff_connection_pool_host *next = NULL;
+    time_t idle_before = time(NULL) - (time_t)pool->idle_timeout;
+
+    pthread_mutex_lock(&pool->mutex);
+
+    // Removing hosts takes the table lock an iterator would hold
+    snapshot = ff_hash_table_snapshot_init(pool->hosts);
+
+    while ((host = ff_hash_table_snapshot_next(snapshot, NULL)) != NULL)
+    {
+        // Hosts sharing a hash are chained from the table's value
+        for (; host != NULL; host = next)
+        {
+            next = host->next;
+            ff_connection_pool_evict_host(pool, host, idle_before);
+        }
+    }
+
+    ff_hash_table_snapshot_free(snapshot);
+
+    pthread_mutex_unlock(&pool->mutex);
+}
+
+void ff_connection_pool_evict_host(struct ff_connection_pool *pool, struct ff_connection_pool_host *host, time_t idle_before)
+{
+    struct ff_connection_pool_connection **connection = &host->idle;
+    struct ff_connection_pool_connection *expired = NULL;
+
+    while (*connection != NULL)
+    {
+        if ((*connection)->idle_since > idle_before)
+        {
+            connection = &(*connection)->next;
+            continue;
+        }
+
+        expired = *connection;
+        *connection = expired->next;
+        host->idle_length--;
+
+        pool->close_connection(expired->sockfd, expired->context);
+        FF_STATS_DEC(upstream_connections_idle);
+        FREE(expired);
+    }
+
+    if (host->idle == NULL)
+    {
+        ff_connection_pool_remove_host(pool, host);
+    }
+}
+
+uint64_t ff_connection_pool_hash(const char *key)
+{
+    return ff_fnv_hash_string(key);
+}
+
+struct ff_connection_pool_host *ff_connection_pool_find(struct ff_connection_pool *pool, uint64_t hash, const char *key)
+{
+    struct ff_connection_pool_host *host = ff_hash_table_get_item(pool->hosts, hash);
+
+    while (host != NULL && strcmp(host->key, key) != 0)
+    {
+        host = host->next;
+    }
+
+    return host;
+}
+
+void ff_connection_pool_remove_host(struct ff_connection_pool *pool, struct ff_connection_pool_host *host)
+{
+    struct ff_connection_pool_host *first = ff_hash_table_get_item(pool->hosts, host->hash);
+
+    if (first == host)
+    {
+        if (host->next == NULL)
+        {
+            ff_hash_table_remove_item(pool->hosts, host->hash);
+        }
+        else
+        {
+            ff_hash_table_put_item(pool->hosts, host->hash, host->next);
+        }
+    }
+    else
+    {
+        while (first->next != host)
+        {
+            first = first->next;
+        }
+
+        first->next = host->next;
+    }
+
+    FREE(host->key);
+    FREE(host);
+}
+
+bool ff_connection_pool_is_alive(int sockfd)
+{
+    char byte;
+    ssize_t peeked = recv(sockfd, &byte, 1, MSG_PEEK | MSG_DONTWAIT);
+
+    // Nothing to read is the only healthy state for an idle connection, EOF,
+    // a reset or a TLS close_notify all mean it can't be reused
+    return peeked < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+}
+
+void ff_connection_pool_flush(struct ff_connection_pool *pool)
+{
+    struct ff_hash_table_snapshot *snapshot = NULL;
+    struct ff_connection_pool_host *host = NULL;
+    struct ff_connection_pool_host *next = NULL;
+    // Every connection has been idle since before a future cutoff
+    time_t idle_before = time(NULL) + 1;
+
+    pthread_mutex_lock(&pool->mutex);
+
+    snapshot = ff_hash_table_snapshot_init(pool->hosts);
+
+    while ((host = ff_hash_table_snapshot_next(snapshot, NULL)) != NULL)
+    {
+        for (; host != NULL; host = next)
+        {
+            next = host->next;
+            ff_connection_pool_evict_host(pool, host, idle_before);
+        }
+    }
+
+    ff_hash_table_snapshot_free(snapshot);
+
+    pthread_mutex_unlock(&pool->mutex);
+}
+
+void ff_connection_pool_free(struct ff_connection_pool *pool)
+{
+    if (pool == NULL)
+    {
+        return;
+    }
+
+    ff_connection_pool_flush(pool);
+    ff_hash_table_free(pool->hosts);
+    pthread_mutex_destroy(&pool->mutex);
+    FREE(pool);
+}
@@ -0,0 +1,90 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+#include <pthread.h>
+#include "hash_table.h"
+
+#ifndef FF_CONNECTION_POOL_H
+#define FF_CONNECTION_POOL_H
+
+// Closes the connection and frees its context
+typedef void (*ff_connection_pool_close)(int sockfd, void *context);
+
+struct ff_connection_pool_connection
+{
+    int sockfd;
+    // Protocol state layered on the socket, NULL for plain TCP
+    void *context;
+    // Requests already sent over the connection
+    uint32_t requests;
+    time_t idle_since;
+    struct ff_connection_pool_connection *next;
+};
+
+struct ff_connection_pool_host
+{
+    uint64_t hash;
+    char *key;
+    // Most recently released first
+    struct ff_connection_pool_connection *idle;
+    uint32_t idle_length;
+    struct ff_connection_pool_host *next;
+};
+
+/**
+ * Idle upstream connections kept open for reuse, grouped by a key naming
+ * the upstream they are connected to.
+ */
+struct ff_connection_pool
+{
+    uint32_t max_idle_per_host;
+    uint32_t idle_timeout;
+    // 0 = unlimited
+    uint32_t max_requests;
+    ff_connection_pool_close close_connection;
+    struct ff_hash_table *hosts;
+    pthread_mutex_t mutex;
+};
+
+struct ff_connection_pool *ff_connection_pool_init(
+    uint32_t max_idle_per_host,
+    uint32_t idle_timeout,
+    uint32_t max_requests,
+    ff_connection_pool_close close_connection);
+
+/**
+ * Takes an idle connection to the upstream, returns false if none is alive.
+ * Connections the upstream has closed or sent unsolicited data on are closed.
+ */
+bool ff_connection_pool_acquire(
+    struct ff_connection_pool *pool,
+    const char *key,
+    int *sockfd,
+    void **context,
+    uint32_t *requests);
+
+/**
+ * Returns a connection after a response has been completely read, requests
+ * includes the one just made. The connection is closed if the upstream
+ * already has the maximum idle connections or it has served max_requests.
+ */
+void ff_connection_pool_release(
+    struct ff_connection_pool *pool,
+    const char *key,
+    int sockfd,
+    void *context,
+    uint32_t requests);
+
+/**
+ * Closes connections idle for longer than the idle timeout
+ */
+void ff_connection_pool_evict_idle(struct ff_connection_pool *pool);
+
+/**
+ * Closes every idle connection
+ */
+void ff_connection_pool_flush(struct ff_connection_pool *pool);
+
+void ff_connection_pool_free(struct ff_connection_pool *pool);
+
+#endif
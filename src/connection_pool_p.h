@@ -0,0 +1,25 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+#include "connection_pool.h"
+
+#ifndef FF_CONNECTION_POOL_P_H
+#define FF_CONNECTION_POOL_P_H
+
+uint64_t ff_connection_pool_hash(const char *key);
+
+struct ff_connection_pool_host *ff_connection_pool_find(struct ff_connection_pool *pool, uint64_t hash, const char *key);
+
+void ff_connection_pool_remove_host(struct ff_connection_pool *pool, struct ff_connection_pool_host *host);
+
+/**
+ * Closes the host's connections idle since before idle_before
+ */
+void ff_connection_pool_evict_host(struct ff_connection_pool *pool, struct ff_connection_pool_host *host, time_t idle_before);
+
+/**
+ * Returns false if the upstream closed the connection or sent data nobody asked for
+ */
+bool ff_connection_pool_is_alive(int sockfd);
+
+#endif
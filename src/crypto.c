@@ -2,15 +2,40 @@
 #include <stdlib.h>
 #include <stdbool.h>
 #include <string.h>
+#include <pthread.h>
 #include <openssl/evp.h>
 #include <openssl/ssl.h>
 #include <openssl/conf.h>
 #include <openssl/err.h>
+#include <openssl/kdf.h>
 #include "crypto.h"
 #include "crypto_p.h"
+#include "key_cache.h"
+#include "keyring.h"
+#include "replay_filter.h"
+#include "pbkdf2.h"
+#include "stats.h"
 #include "logging.h"
 #include "alloc.h"
 
+#define FF_CRYPTO_CIPHER_CTX_POOL_SIZE 64
+
+// Fetched once so requests don't repeat the algorithm lookup
+static const EVP_CIPHER *ff_crypto_aes_256_gcm = NULL;
+static const EVP_CIPHER *ff_crypto_chacha20_poly1305 = NULL;
+static pthread_once_t ff_crypto_fetch_once = PTHREAD_ONCE_INIT;
+
+// Initialised cipher contexts ready for reuse, requests only reset the key and IV
+struct ff_crypto_cipher_ctx_pool
+{
+    EVP_CIPHER_CTX *contexts[FF_CRYPTO_CIPHER_CTX_POOL_SIZE];
+    uint8_t length;
+};
+
+// Indexed by encryption mode
+static struct ff_crypto_cipher_ctx_pool ff_crypto_cipher_ctx_pools[FF_CRYPTO_MODE_MAX + 1];
+static pthread_mutex_t ff_crypto_cipher_ctx_pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+
 void ff_decrypt_request(struct ff_request *request, struct ff_encryption_config *config)
 {
     request->state = FF_REQUEST_STATE_DECRYPTING;
@@ -20,36 +45,15 @@ void ff_decrypt_request(struct ff_request *request, struct ff_encryption_config
     uint16_t iv_len = 0;
     uint8_t *tag = NULL;
     uint16_t tag_len = 0;
+    uint8_t key_derivation_mode = 0;
+    uint8_t *salt = NULL;
+    uint16_t salt_length = 0;
+    struct ff_keyring_key *keyring_key = NULL;
+    struct ff_encryption_config *key_config = NULL;
 
-    bool has_key = config != NULL && config->key != NULL;
-
-    for (uint8_t i = 0; i < request->options_length; i++)
-    {
-        switch (request->options[i]->type)
-        {
-        case FF_REQUEST_OPTION_TYPE_ENCRYPTION_MODE:
-            if (request->options[i]->length == 1)
-            {
-                encryption_mode = (uint8_t)*request->options[i]->value;
-            };
-            break;
-
-        case FF_REQUEST_OPTION_TYPE_ENCRYPTION_IV:
-            iv_len = request->options[i]->length;
-            iv = malloc(iv_len);
-            memcpy(iv, request->options[i]->value, iv_len);
-            break;
+    bool has_key = config != NULL && (config->key != NULL || config->keyring != NULL);
 
-        case FF_REQUEST_OPTION_TYPE_ENCRYPTION_TAG:
-            tag_len = request->options[i]->length;
-            tag = malloc(tag_len);
-            memcpy(tag, request->options[i]->value, tag_len);
-            break;
-
-        default:
-            break;
-        }
-    }
+    ff_crypto_read_encryption_options(request, &encryption_mode, &iv, &iv_len, &tag, &tag_len);
 
     if (encryption_mode == 0)
     {
@@ -82,23 +86,48 @@ void ff_decrypt_request(struct ff_request *request, struct ff_encryption_config
         goto error;
     }
 
+    ff_crypto_read_key_derivation_options(request, &key_derivation_mode, &salt, &salt_length);
+
+    // Checked before the key is derived so a replay costs a hash rather than a PBKDF2 run
+    if (config->replay_filter != NULL && ff_replay_filter_seen(config->replay_filter, salt, salt_length, iv, iv_len))
+    {
+        goto replayed;
+    }
+
+    if ((key_config = ff_crypto_resolve_key(request, config, &keyring_key)) == NULL)
+    {
+        goto error;
+    }
+
     switch (encryption_mode)
     {
     case FF_CRYPTO_MODE_AES_256_GCM:
-        if (ff_decrypt_request_aes_256_gcm(request, config, iv, iv_len, tag, tag_len))
-        {
-            goto done;
-        }
-        else
+    case FF_CRYPTO_MODE_CHACHA20_POLY1305:
+        if (!ff_decrypt_request_aead(request, key_config, encryption_mode, iv, iv_len, tag, tag_len))
         {
             goto error;
         }
+        break;
 
     default:
         ff_log(FF_WARNING, "Encountered request with unknown encryption mode: %u", encryption_mode);
         goto error;
     }
 
+    // Only recorded once authenticated so forged packets can't claim a genuine request's salt and IV,
+    // this also catches copies of a request that passed the check above concurrently
+    if (config->replay_filter != NULL && !ff_replay_filter_insert(config->replay_filter, salt, salt_length, iv, iv_len))
+    {
+        goto replayed;
+    }
+
+    goto done;
+
+replayed:
+    ff_log(FF_WARNING, "Rejected replayed request");
+    FF_STATS_INC(replay_filter_rejected);
+    goto error;
+
 error:
     request->state = FF_REQUEST_STATE_DECRYPTING_FAILED;
     goto cleanup;
@@ -108,22 +137,128 @@ void ff_decrypt_request(struct ff_request *request, struct ff_encryption_config
     goto cleanup;
 
 cleanup:
-    if (iv != NULL)
+    ff_keyring_release(keyring_key);
+    ff_decrypt_stream_discard(request);
+    return;
+}
+
+struct ff_encryption_config *ff_crypto_resolve_key(
+    struct ff_request *request,
+    struct ff_encryption_config *config,
+    struct ff_keyring_key **keyring_key)
+{
+    uint16_t key_id = 0;
+    bool has_key_id = false;
+
+    *keyring_key = NULL;
+
+    if (config == NULL)
     {
-        FREE(iv);
+        return NULL;
     }
 
-    if (tag != NULL)
+    for (uint8_t i = 0; i < request->options_length; i++)
     {
-        FREE(tag);
+        if (request->options[i]->type == FF_REQUEST_OPTION_TYPE_KEY_ID && request->options[i]->length == 2)
+        {
+            key_id = (uint16_t)(request->options[i]->value[0] << 8 | request->options[i]->value[1]);
+            has_key_id = true;
+        }
     }
 
-    return;
+    if (!has_key_id)
+    {
+        if (config->key == NULL)
+        {
+            ff_log(FF_WARNING, "Encountered encrypted request without a key id and no pre-shared-key was set");
+            return NULL;
+        }
+
+        return config;
+    }
+
+    if (config->keyring == NULL)
+    {
+        ff_log(FF_WARNING, "Encountered request with key id %u and no keyring was set", key_id);
+        return NULL;
+    }
+
+    if ((*keyring_key = ff_keyring_acquire(config->keyring, key_id)) == NULL)
+    {
+        ff_log(FF_WARNING, "Encountered request with unknown key id %u", key_id);
+        return NULL;
+    }
+
+    return &(*keyring_key)->encryption;
+}
+
+void ff_crypto_read_encryption_options(
+    struct ff_request *request,
+    uint8_t *encryption_mode,
+    uint8_t **iv,
+    uint16_t *iv_len,
+    uint8_t **tag,
+    uint16_t *tag_len)
+{
+    for (uint8_t i = 0; i < request->options_length; i++)
+    {
+        switch (request->options[i]->type)
+        {
+        case FF_REQUEST_OPTION_TYPE_ENCRYPTION_MODE:
+            if (request->options[i]->length == 1)
+            {
+                *encryption_mode = (uint8_t)*request->options[i]->value;
+            };
+            break;
+
+        case FF_REQUEST_OPTION_TYPE_ENCRYPTION_IV:
+            *iv_len = request->options[i]->length;
+            *iv = request->options[i]->value;
+            break;
+
+        case FF_REQUEST_OPTION_TYPE_ENCRYPTION_TAG:
+            *tag_len = request->options[i]->length;
+            *tag = request->options[i]->value;
+            break;
+
+        default:
+            break;
+        }
+    }
+}
+
+void ff_crypto_read_key_derivation_options(
+    struct ff_request *request,
+    uint8_t *key_derivation_mode,
+    uint8_t **salt,
+    uint16_t *salt_length)
+{
+    for (uint8_t i = 0; i < request->options_length; i++)
+    {
+        switch (request->options[i]->type)
+        {
+        case FF_REQUEST_OPTION_TYPE_KEY_DERIVE_MODE:
+            if (request->options[i]->length == 1)
+            {
+                *key_derivation_mode = (uint8_t)*request->options[i]->value;
+            };
+            break;
+
+        case FF_REQUEST_OPTION_TYPE_KEY_DERIVE_SALT:
+            *salt_length = request->options[i]->length;
+            *salt = request->options[i]->value;
+            break;
+
+        default:
+            break;
+        }
+    }
 }
 
-bool ff_decrypt_request_aes_256_gcm(
+bool ff_decrypt_request_aead(
     struct ff_request *request,
     struct ff_encryption_config *config,
+    uint8_t encryption_mode,
     uint8_t *iv,
     uint16_t iv_len,
     uint8_t *tag,
@@ -133,92 +268,91 @@ bool ff_decrypt_request_aes_256_gcm(
     int len;
     bool ret_val;
 
-    uint8_t *plaintext_buff = malloc(request->payload_length);
-    int plaintext_len = 0;
-    int ret;
+    uint8_t key_buff[FF_CRYPTO_KEY_LENGTH];
+    uint8_t final_buff[EVP_MAX_BLOCK_LENGTH];
+    struct ff_derived_key derived_key = {.key = key_buff, .length = sizeof(key_buff)};
+    uint64_t plaintext_len = 0;
+    uint64_t skip_length = 0;
     struct ff_request_payload_node *payload_chunk = request->payload;
+    struct ff_decrypt_stream *stream = request->decrypt_stream;
 
-    struct ff_derived_key *derived_key = ff_derived_key_alloc(32);
-
-    if (!ff_derive_key(request, config, derived_key))
+    if (stream != NULL)
     {
-        goto error;
+        // Continue from the prefix decrypted while the request was being received
+        if (stream->failed)
+        {
+            goto error;
+        }
+
+        ctx = stream->ctx;
+        skip_length = stream->decrypted_length;
+        goto decrypt;
     }
 
-    if (!(ctx = EVP_CIPHER_CTX_new()))
+    if (!ff_derive_key(request, config, &derived_key))
     {
-        ff_log(FF_ERROR, "Failed to create new OpenSSL cipher");
         goto error;
     }
 
-    if (!EVP_DecryptInit_ex(ctx, EVP_aes_256_gcm(), NULL, NULL, NULL))
+    if (!(ctx = ff_crypto_cipher_ctx_acquire(encryption_mode)))
     {
-        ff_log(FF_ERROR, "Failed to init OpenSSL cipher");
         goto error;
     }
 
-    if (!EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_SET_IVLEN, iv_len, NULL))
+    if (!EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_AEAD_SET_IVLEN, iv_len, NULL))
     {
         ff_log(FF_ERROR, "Failed to update OpenSSL cipher - IV length");
         goto error;
     }
 
-    if (!EVP_DecryptInit_ex(ctx, NULL, NULL, derived_key->key, iv))
+    if (!EVP_DecryptInit_ex(ctx, NULL, NULL, derived_key.key, iv))
     {
         ff_log(FF_ERROR, "Failed to init OpenSSL cipher with key and IV");
         goto error;
     }
 
-    do
+decrypt:
+    // Both ciphers are stream modes so each chunk is decrypted over itself
+    while (payload_chunk != NULL)
     {
-        if (!EVP_DecryptUpdate(ctx, plaintext_buff + plaintext_len, &len, payload_chunk->value, payload_chunk->length))
+        if (skip_length >= payload_chunk->length)
+        {
+            skip_length -= payload_chunk->length;
+            plaintext_len += payload_chunk->length;
+            payload_chunk = payload_chunk->next;
+            continue;
+        }
+
+        if (!EVP_DecryptUpdate(ctx, payload_chunk->value + skip_length, &len, payload_chunk->value + skip_length, payload_chunk->length - skip_length) ||
+            (uint64_t)len != payload_chunk->length - skip_length)
         {
             ff_log(FF_ERROR, "Failed decrypt request payload");
             goto error;
         }
 
-        plaintext_len += len;
-
-    } while ((payload_chunk = payload_chunk->next) != NULL);
+        plaintext_len += payload_chunk->length;
+        skip_length = 0;
+        payload_chunk = payload_chunk->next;
+    }
 
-    if (!EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_SET_TAG, tag_len, tag))
+    if (!EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_AEAD_SET_TAG, tag_len, tag))
     {
         ff_log(FF_ERROR, "Failed to set cipher tag");
         goto error;
     }
 
-    ret = EVP_DecryptFinal_ex(ctx, plaintext_buff + plaintext_len, &len);
-
-    if (ret > 0)
-    {
-        plaintext_len += len;
-        request->payload_length = plaintext_len;
-
-        payload_chunk = request->payload;
-        struct ff_request_payload_node *tmp_payload;
-
-        while (payload_chunk != NULL)
-        {
-            tmp_payload = payload_chunk;
-            payload_chunk = payload_chunk->next;
-            ff_request_payload_node_free(tmp_payload);
-        }
-
-        request->payload = ff_request_payload_node_alloc();
-        request->payload->length = plaintext_len;
-        request->payload->offset = 0;
-        request->payload->next = NULL;
-        request->payload->value = plaintext_buff;
-        goto done;
-    }
-    else
+    if (EVP_DecryptFinal_ex(ctx, final_buff, &len) <= 0 || len != 0)
     {
         ff_log(FF_ERROR, "Failed decrypt and finalize request payload");
         goto error;
     }
 
+    request->payload_length = plaintext_len;
+    goto done;
+
 error:
-    FREE(plaintext_buff);
+    // The payload may hold unauthenticated plaintext
+    ff_crypto_discard_payload(request);
     ret_val = false;
     goto cleanup;
 
@@ -228,12 +362,182 @@ bool ff_decrypt_request_aes_256_gcm(
     goto cleanup;
 
 cleanup:
-    EVP_CIPHER_CTX_free(ctx);
-    ff_derived_key_free(derived_key);
+    if (stream == NULL)
+    {
+        ff_crypto_cipher_ctx_release(encryption_mode, ctx);
+    }
+
+    OPENSSL_cleanse(key_buff, sizeof(key_buff));
+
+    return ret_val;
+}
+
+void ff_crypto_discard_payload(struct ff_request *request)
+{
+    struct ff_request_payload_node *payload_chunk = request->payload;
+    struct ff_request_payload_node *tmp_payload;
+
+    while (payload_chunk != NULL)
+    {
+        tmp_payload = payload_chunk;
+        payload_chunk = payload_chunk->next;
+        OPENSSL_cleanse(tmp_payload->value, tmp_payload->length);
+        ff_request_payload_node_free(tmp_payload);
+    }
+
+    request->payload = NULL;
+    request->payload_length = 0;
+}
+
+void ff_decrypt_request_incremental(struct ff_request *request, struct ff_encryption_config *config)
+{
+    if (request->decrypt_stream == NULL && !ff_decrypt_stream_start(request, config))
+    {
+        return;
+    }
+
+    ff_decrypt_stream_advance(request);
+}
+
+bool ff_decrypt_stream_start(struct ff_request *request, struct ff_encryption_config *config)
+{
+    uint8_t encryption_mode = 0;
+    uint8_t *iv = NULL;
+    uint16_t iv_len = 0;
+    uint8_t *tag = NULL;
+    uint16_t tag_len = 0;
+    uint8_t key_derivation_mode = 0;
+    uint8_t *salt = NULL;
+    uint16_t salt_length = 0;
+    uint8_t key_buff[FF_CRYPTO_KEY_LENGTH];
+    struct ff_derived_key derived_key = {.key = key_buff, .length = sizeof(key_buff)};
+    EVP_CIPHER_CTX *ctx = NULL;
+    struct ff_keyring_key *keyring_key = NULL;
+    bool ret_val = false;
+
+    if (config == NULL || (config->key == NULL && config->keyring == NULL) || request->options_length == 0)
+    {
+        goto cleanup;
+    }
+
+    ff_crypto_read_encryption_options(request, &encryption_mode, &iv, &iv_len, &tag, &tag_len);
+    ff_crypto_read_key_derivation_options(request, &key_derivation_mode, &salt, &salt_length);
+
+    if (ff_crypto_cipher_for_mode(encryption_mode) == NULL || iv == NULL || iv_len == 0 || salt == NULL || salt_length == 0)
+    {
+        goto cleanup;
+    }
+
+    // Leave replays for ff_decrypt_request to reject without deriving their key
+    if (config->replay_filter != NULL && ff_replay_filter_seen(config->replay_filter, salt, salt_length, iv, iv_len))
+    {
+        goto cleanup;
+    }
+
+    if ((config = ff_crypto_resolve_key(request, config, &keyring_key)) == NULL)
+    {
+        goto cleanup;
+    }
+
+    if (key_derivation_mode == FF_KEY_DERIVE_MODE_HKDF)
+    {
+        // Cheap enough to derive during packet ingest
+        if (!ff_derive_key(request, config, &derived_key))
+        {
+            goto cleanup;
+        }
+    }
+    // Deriving the key here would stall packet ingest, only start once it is cached
+    else if (config->key_cache == NULL ||
+             !ff_key_cache_peek(config->key_cache, key_derivation_mode, salt, salt_length, &derived_key))
+    {
+        goto cleanup;
+    }
+
+    if (!(ctx = ff_crypto_cipher_ctx_acquire(encryption_mode)))
+    {
+        goto cleanup;
+    }
+
+    if (!EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_AEAD_SET_IVLEN, iv_len, NULL) ||
+        !EVP_DecryptInit_ex(ctx, NULL, NULL, derived_key.key, iv))
+    {
+        ff_log(FF_ERROR, "Failed to init OpenSSL cipher for incremental decryption");
+        ff_crypto_cipher_ctx_release(encryption_mode, ctx);
+        goto cleanup;
+    }
+
+    request->decrypt_stream = calloc(1, sizeof(struct ff_decrypt_stream));
+    request->decrypt_stream->encryption_mode = encryption_mode;
+    request->decrypt_stream->ctx = ctx;
+    FF_STATS_INC(incremental_decrypt_requests);
+    ret_val = true;
+
+cleanup:
+    ff_keyring_release(keyring_key);
+    OPENSSL_cleanse(key_buff, sizeof(key_buff));
 
     return ret_val;
 }
 
+void ff_decrypt_stream_advance(struct ff_request *request)
+{
+    struct ff_decrypt_stream *stream = request->decrypt_stream;
+    struct ff_request_payload_node *payload_chunk = NULL;
+    int len;
+
+    if (stream->failed)
+    {
+        return;
+    }
+
+    // Chunks are stored in arrival order, feed any that extend the decrypted prefix
+    payload_chunk = request->payload;
+
+    while (payload_chunk != NULL)
+    {
+        if (payload_chunk->offset != stream->decrypted_length || payload_chunk->length == 0)
+        {
+            payload_chunk = payload_chunk->next;
+            continue;
+        }
+
+        if (!EVP_DecryptUpdate(stream->ctx, payload_chunk->value, &len, payload_chunk->value, payload_chunk->length) ||
+            len != payload_chunk->length)
+        {
+            ff_log(FF_ERROR, "Failed incrementally decrypting request payload");
+            stream->failed = true;
+            return;
+        }
+
+        stream->decrypted_length += payload_chunk->length;
+        FF_STATS_ADD(incremental_decrypt_bytes, payload_chunk->length);
+
+        // Restart the scan, a previously received chunk may now be contiguous
+        payload_chunk = request->payload;
+    }
+}
+
+void ff_decrypt_stream_discard(struct ff_request *request)
+{
+    struct ff_decrypt_stream *stream = request->decrypt_stream;
+
+    if (stream == NULL)
+    {
+        return;
+    }
+
+    // The payload holds unauthenticated plaintext unless the tag has been verified
+    if (request->state != FF_REQUEST_STATE_DECRYPTED)
+    {
+        ff_crypto_discard_payload(request);
+    }
+
+    ff_crypto_cipher_ctx_release(stream->encryption_mode, stream->ctx);
+    FREE(stream);
+    request->decrypt_stream = NULL;
+}
+
 struct ff_derived_key *ff_derived_key_alloc(uint16_t length)
 {
     struct ff_derived_key *key = malloc(sizeof(struct ff_derived_key));
@@ -268,27 +572,7 @@ bool ff_derive_key(
     uint16_t salt_length = 0;
     bool ret_val;
 
-    for (uint8_t i = 0; i < request->options_length; i++)
-    {
-        switch (request->options[i]->type)
-        {
-        case FF_REQUEST_OPTION_TYPE_KEY_DERIVE_MODE:
-            if (request->options[i]->length == 1)
-            {
-                key_derivation_mode = (uint8_t)*request->options[i]->value;
-            };
-            break;
-
-        case FF_REQUEST_OPTION_TYPE_KEY_DERIVE_SALT:
-            salt_length = request->options[i]->length;
-            salt = malloc(salt_length);
-            memcpy(salt, request->options[i]->value, salt_length);
-            break;
-
-        default:
-            break;
-        }
-    }
+    ff_crypto_read_key_derivation_options(request, &key_derivation_mode, &salt, &salt_length);
 
     if (key_derivation_mode == 0)
     {
@@ -302,17 +586,22 @@ bool ff_derive_key(
         goto error;
     }
 
-    switch (key_derivation_mode)
+    if (config->allowed_key_derivation_modes != 0 &&
+        (key_derivation_mode >= 32 || !(config->allowed_key_derivation_modes & FF_KEY_DERIVE_MODE_FLAG(key_derivation_mode))))
     {
-    case FF_KEY_DERIVE_MODE_PBKDF2:
-        if (!ff_derive_key_pbkdf2(config, salt, salt_length, out_key))
+        ff_log(FF_WARNING, "Encountered request with disallowed key derivation mode: %u", key_derivation_mode);
+        goto error;
+    }
+
+    if (config->key_cache != NULL)
+    {
+        if (!ff_key_cache_get(config->key_cache, key_derivation_mode, salt, salt_length, out_key, ff_derive_key_cache_miss, config))
         {
             goto error;
         }
-        break;
-
-    default:
-        ff_log(FF_WARNING, "Encountered request with unknown key derivation mode: %u", key_derivation_mode);
+    }
+    else if (!ff_derive_key_for_mode(config, key_derivation_mode, salt, salt_length, out_key))
+    {
         goto error;
     }
 
@@ -328,12 +617,38 @@ bool ff_derive_key(
     goto cleanup;
 
 cleanup:
-    if (salt != NULL)
+    return ret_val;
+}
+
+bool ff_derive_key_for_mode(
+    struct ff_encryption_config *config,
+    uint8_t key_derivation_mode,
+    uint8_t *salt,
+    uint16_t salt_length,
+    struct ff_derived_key *out_key)
+{
+    switch (key_derivation_mode)
     {
-        FREE(salt);
+    case FF_KEY_DERIVE_MODE_PBKDF2:
+        return ff_derive_key_pbkdf2(config, salt, salt_length, out_key);
+
+    case FF_KEY_DERIVE_MODE_HKDF:
+        return ff_derive_key_hkdf(config, salt, salt_length, out_key);
+
+    default:
+        ff_log(FF_WARNING, "Encountered request with unknown key derivation mode: %u", key_derivation_mode);
+        return false;
     }
+}
 
-    return ret_val;
+bool ff_derive_key_cache_miss(
+    void *config,
+    uint8_t key_derivation_mode,
+    uint8_t *salt,
+    uint16_t salt_length,
+    struct ff_derived_key *out_key)
+{
+    return ff_derive_key_for_mode((struct ff_encryption_config *)config, key_derivation_mode, salt, salt_length, out_key);
 }
 
 bool ff_derive_key_pbkdf2(
@@ -343,6 +658,11 @@ bool ff_derive_key_pbkdf2(
     struct ff_derived_key *out_key)
 
 {
+    if (config->pbkdf2 != NULL)
+    {
+        return ff_pbkdf2_hmac_sha256_derive(config->pbkdf2, salt, salt_length, config->pbkdf2_iterations, out_key->key, out_key->length);
+    }
+
     int res = PKCS5_PBKDF2_HMAC(
         (char *)config->key,
         strlen((char *)config->key),
@@ -363,6 +683,159 @@ bool ff_derive_key_pbkdf2(
     return success;
 }
 
+bool ff_derive_key_hkdf(
+    struct ff_encryption_config *config,
+    uint8_t *salt,
+    uint16_t salt_length,
+    struct ff_derived_key *out_key)
+{
+    EVP_PKEY_CTX *ctx = NULL;
+    size_t key_length = out_key->length;
+    bool ret_val;
+
+    if (!(ctx = EVP_PKEY_CTX_new_id(EVP_PKEY_HKDF, NULL)))
+    {
+        ff_log(FF_ERROR, "Failed to create OpenSSL HKDF context");
+        goto error;
+    }
+
+    if (EVP_PKEY_derive_init(ctx) <= 0 ||
+        EVP_PKEY_CTX_set_hkdf_md(ctx, EVP_sha256()) <= 0 ||
+        EVP_PKEY_CTX_set1_hkdf_salt(ctx, salt, salt_length) <= 0 ||
+        EVP_PKEY_CTX_set1_hkdf_key(ctx, config->key, strlen((char *)config->key)) <= 0 ||
+        EVP_PKEY_CTX_add1_hkdf_info(ctx, (unsigned char *)FF_KEY_DERIVE_HKDF_INFO, strlen(FF_KEY_DERIVE_HKDF_INFO)) <= 0)
+    {
+        ff_log(FF_ERROR, "Failed to init OpenSSL HKDF context");
+        goto error;
+    }
+
+    if (EVP_PKEY_derive(ctx, out_key->key, &key_length) <= 0 || key_length != out_key->length)
+    {
+        ff_log(FF_ERROR, ERR_error_string(ERR_get_error(), NULL));
+        ff_log(FF_ERROR, "Failed to derive key using HKDF algorithm");
+        goto error;
+    }
+
+    goto done;
+
+error:
+    ret_val = false;
+    goto cleanup;
+
+done:
+    ret_val = true;
+    goto cleanup;
+
+cleanup:
+    EVP_PKEY_CTX_free(ctx);
+
+    return ret_val;
+}
+
+void ff_crypto_fetch_ciphers()
+{
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+    ff_crypto_aes_256_gcm = EVP_CIPHER_fetch(NULL, "AES-256-GCM", NULL);
+    ff_crypto_chacha20_poly1305 = EVP_CIPHER_fetch(NULL, "ChaCha20-Poly1305", NULL);
+#endif
+
+    if (ff_crypto_aes_256_gcm == NULL)
+    {
+        ff_crypto_aes_256_gcm = EVP_aes_256_gcm();
+    }
+
+    if (ff_crypto_chacha20_poly1305 == NULL)
+    {
+        ff_crypto_chacha20_poly1305 = EVP_chacha20_poly1305();
+    }
+}
+
+const EVP_CIPHER *ff_crypto_cipher_for_mode(uint8_t encryption_mode)
+{
+    pthread_once(&ff_crypto_fetch_once, ff_crypto_fetch_ciphers);
+
+    switch (encryption_mode)
+    {
+    case FF_CRYPTO_MODE_AES_256_GCM:
+        return ff_crypto_aes_256_gcm;
+
+    case FF_CRYPTO_MODE_CHACHA20_POLY1305:
+        return ff_crypto_chacha20_poly1305;
+
+    default:
+        return NULL;
+    }
+}
+
+EVP_CIPHER_CTX *ff_crypto_cipher_ctx_acquire(uint8_t encryption_mode)
+{
+    EVP_CIPHER_CTX *ctx = NULL;
+    const EVP_CIPHER *cipher = ff_crypto_cipher_for_mode(encryption_mode);
+    struct ff_crypto_cipher_ctx_pool *pool = NULL;
+
+    if (cipher == NULL)
+    {
+        ff_log(FF_ERROR, "Unknown encryption mode: %u", encryption_mode);
+        return NULL;
+    }
+
+    pool = &ff_crypto_cipher_ctx_pools[encryption_mode];
+
+    pthread_mutex_lock(&ff_crypto_cipher_ctx_pool_mutex);
+
+    if (pool->length > 0)
+    {
+        ctx = pool->contexts[--pool->length];
+    }
+
+    pthread_mutex_unlock(&ff_crypto_cipher_ctx_pool_mutex);
+
+    if (ctx != NULL)
+    {
+        return ctx;
+    }
+
+    if (!(ctx = EVP_CIPHER_CTX_new()))
+    {
+        ff_log(FF_ERROR, "Failed to create new OpenSSL cipher");
+        return NULL;
+    }
+
+    if (!EVP_DecryptInit_ex(ctx, cipher, NULL, NULL, NULL))
+    {
+        ff_log(FF_ERROR, "Failed to init OpenSSL cipher");
+        EVP_CIPHER_CTX_free(ctx);
+        return NULL;
+    }
+
+    return ctx;
+}
+
+void ff_crypto_cipher_ctx_release(uint8_t encryption_mode, EVP_CIPHER_CTX *ctx)
+{
+    struct ff_crypto_cipher_ctx_pool *pool = NULL;
+
+    if (ctx == NULL)
+    {
+        return;
+    }
+
+    pool = &ff_crypto_cipher_ctx_pools[encryption_mode];
+
+    pthread_mutex_lock(&ff_crypto_cipher_ctx_pool_mutex);
+
+    if (pool->length < FF_CRYPTO_CIPHER_CTX_POOL_SIZE)
+    {
+        pool->contexts[pool->length++] = ctx;
+        ctx = NULL;
+    }
+
+    pthread_mutex_unlock(&ff_crypto_cipher_ctx_pool_mutex);
+
+    // Pool is full
+    EVP_CIPHER_CTX_free(ctx);
+}
+
 void ff_init_openssl()
 {
     (void)SSL_library_init();
@@ -374,4 +847,6 @@ void ff_init_openssl()
 #if OPENSSL_VERSION_NUMBER < 0x10100000L // If OpenSSL < 1.1.0
     OPENSSL_config(NULL);
 #endif
+
+    pthread_once(&ff_crypto_fetch_once, ff_crypto_fetch_ciphers);
 }
@@ -5,21 +5,58 @@
 #ifndef FF_CRYPTO_H
 #define FF_CRYPTO_H
 
+// Every supported cipher uses 256 bit keys
+#define FF_CRYPTO_KEY_LENGTH 32
+
 enum ff_request_encryption_type
 {
-    FF_CRYPTO_MODE_AES_256_GCM = 1
+    FF_CRYPTO_MODE_AES_256_GCM = 1,
+    // Faster than AES-GCM on hardware without AES instructions
+    FF_CRYPTO_MODE_CHACHA20_POLY1305 = 2
 };
 
+#define FF_CRYPTO_MODE_MAX FF_CRYPTO_MODE_CHACHA20_POLY1305
+
 enum ff_request_key_derivation_type
 {
-    FF_KEY_DERIVE_MODE_PBKDF2 = 1
+    FF_KEY_DERIVE_MODE_PBKDF2 = 1,
+    // Single HMAC extract and expand, for high entropy pre-shared keys
+    FF_KEY_DERIVE_MODE_HKDF = 2
 };
 
+#define FF_KEY_DERIVE_MODE_FLAG(mode) (1u << (mode))
+#define FF_KEY_DERIVE_MODES_ALL (FF_KEY_DERIVE_MODE_FLAG(FF_KEY_DERIVE_MODE_PBKDF2) | FF_KEY_DERIVE_MODE_FLAG(FF_KEY_DERIVE_MODE_HKDF))
+
+// Context string binding HKDF output to request encryption keys
+#define FF_KEY_DERIVE_HKDF_INFO "ff-request-key"
+
+struct ff_key_cache;
+struct ff_pbkdf2_hmac_sha256;
+struct ff_keyring;
+struct ff_keyring_key;
+struct ff_replay_filter;
+
 struct ff_encryption_config
 {
     // NULL-terminated key
     uint8_t *key;
     uint32_t pbkdf2_iterations;
+    // Bitmask of FF_KEY_DERIVE_MODE_FLAG values accepted on requests, 0 = accept all
+    uint32_t allowed_key_derivation_modes;
+    // Mode used to derive keys when encrypting requests (client only), 0 = PBKDF2
+    uint8_t key_derivation_mode;
+    // Cipher used when encrypting requests (client only), 0 = AES-256-GCM
+    uint8_t encryption_mode;
+    // Optional precomputed HMAC state for the key, NULL = use OpenSSL's PBKDF2
+    struct ff_pbkdf2_hmac_sha256 *pbkdf2;
+    // Optional cache of derived keys, NULL = derive for every request
+    struct ff_key_cache *key_cache;
+    // Optional keys selected by the request's key id option, NULL = only use key
+    struct ff_keyring *keyring;
+    // Keyring id sent with requests (client only), 0 = none
+    uint16_t key_id;
+    // Optional filter rejecting requests whose salt and IV were already accepted, NULL = timestamp window only
+    struct ff_replay_filter *replay_filter;
 };
 
 struct ff_derived_key
@@ -30,6 +67,26 @@ struct ff_derived_key
 
 void ff_decrypt_request(struct ff_request *request, struct ff_encryption_config *config);
 
+/**
+ * Decrypts newly contiguous payload chunks of a partially received request.
+ * Only starts once the request's key is cached or can be derived cheaply
+ * (HKDF), the plaintext must not be used until ff_decrypt_request has
+ * verified the tag.
+ */
+void ff_decrypt_request_incremental(struct ff_request *request, struct ff_encryption_config *config);
+
+void ff_decrypt_stream_discard(struct ff_request *request);
+
+/**
+ * Returns the config holding the key the request is encrypted with, either
+ * the keyring key named by its key id option or config itself. A keyring key
+ * is returned in keyring_key and must be released by the caller.
+ */
+struct ff_encryption_config *ff_crypto_resolve_key(
+    struct ff_request *request,
+    struct ff_encryption_config *config,
+    struct ff_keyring_key **keyring_key);
+
 struct ff_derived_key *ff_derived_key_alloc(uint16_t length);
 
 void ff_derived_key_free(struct ff_derived_key *);
@@ -44,6 +101,13 @@ bool ff_derive_key_pbkdf2(
     uint8_t *salt,
     uint16_t salt_length,
     struct ff_derived_key *out_key);
+
+bool ff_derive_key_hkdf(
+    struct ff_encryption_config *config,
+    uint8_t *salt,
+    uint16_t salt_length,
+    struct ff_derived_key *out_key);
+
 void ff_init_openssl();
 
 #endif
\ No newline at end of file
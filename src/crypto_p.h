@@ -1,16 +1,69 @@
 #include <stdbool.h>
+#include <openssl/evp.h>
 #include "parser.h"
 #include "request.h"
 
 #ifndef FF_CRYPTO_P_H
 #define FF_CRYPTO_P_H
 
-bool ff_decrypt_request_aes_256_gcm(
+struct ff_decrypt_stream
+{
+    uint8_t encryption_mode;
+    EVP_CIPHER_CTX *ctx;
+    // Length of the contiguous payload prefix decrypted in place so far
+    uint64_t decrypted_length;
+    bool failed;
+};
+
+void ff_crypto_read_encryption_options(
+    struct ff_request *request,
+    uint8_t *encryption_mode,
+    uint8_t **iv,
+    uint16_t *iv_len,
+    uint8_t **tag,
+    uint16_t *tag_len);
+
+void ff_crypto_read_key_derivation_options(
+    struct ff_request *request,
+    uint8_t *key_derivation_mode,
+    uint8_t **salt,
+    uint16_t *salt_length);
+
+bool ff_decrypt_stream_start(struct ff_request *request, struct ff_encryption_config *config);
+
+void ff_decrypt_stream_advance(struct ff_request *request);
+
+bool ff_decrypt_request_aead(
     struct ff_request *request,
     struct ff_encryption_config *config,
+    uint8_t encryption_mode,
     uint8_t *iv,
     uint16_t iv_len,
     uint8_t *tag,
     uint16_t tag_len);
 
+bool ff_derive_key_for_mode(
+    struct ff_encryption_config *config,
+    uint8_t key_derivation_mode,
+    uint8_t *salt,
+    uint16_t salt_length,
+    struct ff_derived_key *out_key);
+
+bool ff_derive_key_cache_miss(
+    void *config,
+    uint8_t key_derivation_mode,
+    uint8_t *salt,
+    uint16_t salt_length,
+    struct ff_derived_key *out_key);
+
+void ff_crypto_discard_payload(struct ff_request *request);
+
+void ff_crypto_fetch_ciphers();
+
+const EVP_CIPHER *ff_crypto_cipher_for_mode(uint8_t encryption_mode);
+
+EVP_CIPHER_CTX *ff_crypto_cipher_ctx_acquire(uint8_t encryption_mode);
+
+void ff_crypto_cipher_ctx_release(uint8_t encryption_mode, EVP_CIPHER_CTX *ctx);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,221 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <sched.h>
+#include <pthread.h>
+#include <time.h>
+#include "crypto_pool.h"
+#include "crypto_pool_p.h"
+#include "stats.h"
+#include "logging.h"
+#include "alloc.h"
+
+struct ff_crypto_pool *ff_crypto_pool_init(
+    struct ff_encryption_config *config,
+    uint16_t worker_count,
+    uint16_t batch_size,
+    ff_crypto_pool_callback on_decrypted)
+{
+    struct ff_crypto_pool *pool = calloc(1, sizeof(struct ff_crypto_pool));
+    struct ff_crypto_pool_worker_args *worker_args = NULL;
+
+    pool->config = config;
+    pool->on_decrypted = on_decrypted;
+    pool->worker_count = worker_count;
+    pool->batch_size = batch_size == 0 ? 1 : batch_size;
+    pool->workers = calloc(worker_count, sizeof(pthread_t));
+    pthread_mutex_init(&pool->mutex, NULL);
+    pthread_cond_init(&pool->queued, NULL);
+
+    if (sched_getaffinity(0, sizeof(pool->cpus), &pool->cpus) == 0)
+    {
+        pool->cpu_count = CPU_COUNT(&pool->cpus);
+    }
+    else
+    {
+        ff_log(FF_WARNING, "Failed to read allowed CPUs, crypto workers won't be pinned");
+    }
+
+    for (uint16_t i = 0; i < worker_count; i++)
+    {
+        worker_args = malloc(sizeof(struct ff_crypto_pool_worker_args));
+        worker_args->pool = pool;
+        worker_args->index = i;
+
+        pthread_create(&pool->workers[i], NULL, ff_crypto_pool_worker_loop, (void *)worker_args);
+    }
+
+    ff_log(FF_DEBUG, "Started %u crypto workers (batch size: %u)", worker_count, pool->batch_size);
+
+    return pool;
+}
+
+void ff_crypto_pool_submit(struct ff_crypto_pool *pool, struct ff_request *request, void *context)
+{
+    struct ff_crypto_pool_job *job = malloc(sizeof(struct ff_crypto_pool_job));
+
+    job->request = request;
+    job->context = context;
+    job->next = NULL;
+
+    pthread_mutex_lock(&pool->mutex);
+
+    if (pool->queue_last == NULL)
+    {
+        pool->queue_first = job;
+    }
+    else
+    {
+        pool->queue_last->next = job;
+    }
+
+    pool->queue_last = job;
+    pool->queue_length++;
+    FF_STATS_INC(crypto_queue_depth);
+
+    pthread_cond_signal(&pool->queued);
+    pthread_mutex_unlock(&pool->mutex);
+}
+
+void *ff_crypto_pool_worker_loop(void *args)
+{
+    struct ff_crypto_pool_worker_args *worker_args = (struct ff_crypto_pool_worker_args *)args;
+    struct ff_crypto_pool *pool = worker_args->pool;
+    struct ff_crypto_pool_job *batch = NULL;
+
+    ff_crypto_pool_pin_worker(pool, worker_args->index);
+    FREE(worker_args);
+
+    while (ff_crypto_pool_take_batch(pool, &batch) > 0)
+    {
+        ff_crypto_pool_run_batch(pool, batch);
+    }
+
+    return NULL;
+}
+
+uint16_t ff_crypto_pool_take_batch(struct ff_crypto_pool *pool, struct ff_crypto_pool_job **batch)
+{
+    struct ff_crypto_pool_job *last = NULL;
+    uint16_t length = 0;
+
+    pthread_mutex_lock(&pool->mutex);
+
+    while (pool->queue_length == 0 && !pool->stopping)
+    {
+        pthread_cond_wait(&pool->queued, &pool->mutex);
+    }
+
+    *batch = pool->queue_first;
+    last = pool->queue_first;
+
+    while (last != NULL && ++length < pool->batch_size && last->next != NULL)
+    {
+        last = last->next;
+    }
+
+    if (last != NULL)
+    {
+        pool->queue_first = last->next;
+        last->next = NULL;
+
+        if (pool->queue_first == NULL)
+        {
+            pool->queue_last = NULL;
+        }
+    }
+
+    pool->queue_length -= length;
+    FF_STATS_SUB(crypto_queue_depth, length);
+
+    pthread_mutex_unlock(&pool->mutex);
+
+    return length;
+}
+
+void ff_crypto_pool_run_batch(struct ff_crypto_pool *pool, struct ff_crypto_pool_job *batch)
+{
+    struct ff_crypto_pool_job *job = NULL;
+    struct timespec start;
+    struct timespec end;
+    uint64_t batch_length = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    // Derive and decrypt the whole batch before any request leaves the stage so
+    // the worker's caches stay warm with key schedules and cipher state
+    for (job = batch; job != NULL; job = job->next)
+    {
+        ff_request_vectorise_payload(job->request);
+        ff_decrypt_request(job->request, pool->config);
+        batch_length++;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    FF_STATS_INC(crypto_batches);
+    FF_STATS_ADD(crypto_batch_requests, batch_length);
+    FF_STATS_ADD(crypto_batch_usecs, (end.tv_sec - start.tv_sec) * 1000000 + (end.tv_nsec - start.tv_nsec) / 1000);
+
+    while (batch != NULL)
+    {
+        job = batch;
+        batch = batch->next;
+        pool->on_decrypted(job->request, job->context);
+        FREE(job);
+    }
+}
+
+void ff_crypto_pool_pin_worker(struct ff_crypto_pool *pool, uint16_t index)
+{
+    // Allowed CPU ids need not be contiguous, so the set is walked to the chosen one
+    int target = pool->cpu_count > 0 ? index % pool->cpu_count : 0;
+    int cpu = 0;
+    cpu_set_t cpu_set;
+
+    if (pool->cpu_count <= 0)
+    {
+        return;
+    }
+
+    for (; cpu < CPU_SETSIZE; cpu++)
+    {
+        if (CPU_ISSET(cpu, &pool->cpus) && target-- == 0)
+        {
+            break;
+        }
+    }
+
+    CPU_ZERO(&cpu_set);
+    CPU_SET(cpu, &cpu_set);
+
+    if (pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set) != 0)
+    {
+        ff_log(FF_WARNING, "Failed to pin crypto worker %u to CPU %d", index, cpu);
+    }
+}
+
+void ff_crypto_pool_free(struct ff_crypto_pool *pool)
+{
+    if (pool == NULL)
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&pool->mutex);
+    pool->stopping = true;
+    pthread_cond_broadcast(&pool->queued);
+    pthread_mutex_unlock(&pool->mutex);
+
+    for (uint16_t i = 0; i < pool->worker_count; i++)
+    {
+        pthread_join(pool->workers[i], NULL);
+    }
+
+    pthread_cond_destroy(&pool->queued);
+    pthread_mutex_destroy(&pool->mutex);
+    FREE(pool->workers);
+    FREE(pool);
+}
@@ -0,0 +1,62 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <sched.h>
+#include "request.h"
+#include "crypto.h"
+
+#ifndef FF_CRYPTO_POOL_H
+#define FF_CRYPTO_POOL_H
+
+/**
+ * Called on a crypto worker once a request has been decrypted (or failed
+ * decryption, see request->state), ownership of the request passes back
+ * to the caller.
+ */
+typedef void (*ff_crypto_pool_callback)(struct ff_request *request, void *context);
+
+struct ff_crypto_pool_job
+{
+    struct ff_request *request;
+    void *context;
+    struct ff_crypto_pool_job *next;
+};
+
+struct ff_crypto_pool
+{
+    struct ff_encryption_config *config;
+    ff_crypto_pool_callback on_decrypted;
+    uint16_t worker_count;
+    // Maximum number of requests a worker takes from the queue at once
+    uint16_t batch_size;
+    pthread_t *workers;
+    struct ff_crypto_pool_job *queue_first;
+    struct ff_crypto_pool_job *queue_last;
+    uint32_t queue_length;
+    // Set on shutdown, workers exit once the queue is drained
+    bool stopping;
+    pthread_mutex_t mutex;
+    pthread_cond_t queued;
+    // CPUs the process may run on, workers are spread across them in order
+    cpu_set_t cpus;
+    int cpu_count;
+};
+
+struct ff_crypto_pool *ff_crypto_pool_init(
+    struct ff_encryption_config *config,
+    uint16_t worker_count,
+    uint16_t batch_size,
+    ff_crypto_pool_callback on_decrypted);
+
+/**
+ * Queues a fully received request for decryption, the pool owns the
+ * request until on_decrypted is called.
+ */
+void ff_crypto_pool_submit(struct ff_crypto_pool *pool, struct ff_request *request, void *context);
+
+/**
+ * Decrypts any queued requests then stops and frees the workers.
+ */
+void ff_crypto_pool_free(struct ff_crypto_pool *pool);
+
+#endif
@@ -0,0 +1,24 @@
+#include <stdint.h>
+#include "crypto_pool.h"
+
+#ifndef FF_CRYPTO_POOL_P_H
+#define FF_CRYPTO_POOL_P_H
+
+struct ff_crypto_pool_worker_args
+{
+    struct ff_crypto_pool *pool;
+    uint16_t index;
+};
+
+void *ff_crypto_pool_worker_loop(void *args);
+
+uint16_t ff_crypto_pool_take_batch(struct ff_crypto_pool *pool, struct ff_crypto_pool_job **batch);
+
+void ff_crypto_pool_run_batch(struct ff_crypto_pool *pool, struct ff_crypto_pool_job *batch);
+
+/**
+ * Pins the calling worker to the index-th of the pool's allowed CPUs, wrapping around
+ */
+void ff_crypto_pool_pin_worker(struct ff_crypto_pool *pool, uint16_t index);
+
+#endif
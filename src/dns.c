@@ -0,0 +1,825 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <openssl/rand.h>
+#include "dns.h"
+#include "dns_p.h"
+#include "logging.h"
+#include "alloc.h"
+
+struct ff_dns_resolver *ff_dns_resolver_init(const char *server, const char *hosts_path)
+{
+    struct ff_dns_resolver *resolver = calloc(1, sizeof(struct ff_dns_resolver));
+
+    resolver->timeout_ms = FF_DNS_TIMEOUT_MS;
+    resolver->attempts = FF_DNS_ATTEMPTS;
+
+    if (server == NULL)
+    {
+        ff_dns_read_resolv_conf(FF_DNS_RESOLV_CONF_PATH, resolver);
+    }
+    else if (ff_dns_parse_server(server, &resolver->servers[0], &resolver->server_lengths[0]))
+    {
+        resolver->servers_length = 1;
+    }
+    else
+    {
+        ff_log(FF_ERROR, "Invalid DNS server address: %s", server);
+        FREE(resolver);
+        return NULL;
+    }
+
+    if (hosts_path != NULL)
+    {
+        resolver->hosts = ff_dns_read_hosts(hosts_path);
+    }
+
+    return resolver;
+}
+
+int ff_dns_open_socket(struct ff_dns_resolver *resolver, uint8_t attempt)
+{
+    uint8_t index = attempt % resolver->servers_length;
+    int sockfd = socket(resolver->servers[index].ss_family, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+
+    // Connecting filters out datagrams from anyone but the server
+    if (sockfd < 0 || connect(sockfd, (struct sockaddr *)&resolver->servers[index], resolver->server_lengths[index]) != 0)
+    {
+        ff_log(FF_ERROR, "Failed to open DNS socket (errno: %d)", errno);
+
+        if (sockfd >= 0)
+        {
+            close(sockfd);
+        }
+
+        return -1;
+    }
+
+    return sockfd;
+}
+
+enum ff_dns_status ff_dns_resolve(struct ff_dns_resolver *resolver, const char *name, struct ff_dns_result *result)
+{
+    struct ff_dns_query queries[2] = {{.type = FF_DNS_TYPE_A}, {.type = FF_DNS_TYPE_AAAA}};
+    uint8_t messages[2][FF_DNS_MAX_MESSAGE_LENGTH];
+    size_t message_lengths[2];
+    uint8_t response[FF_DNS_MAX_MESSAGE_LENGTH];
+    struct ff_dns_hosts_entry *host = NULL;
+    struct pollfd poll_fd;
+    struct timespec now;
+    int64_t deadline;
+    int64_t remaining;
+    ssize_t received;
+    uint8_t pending = 2;
+    int sockfd = -1;
+
+    memset(result, 0, sizeof(struct ff_dns_result));
+    result->status = FF_DNS_STATUS_FAILED;
+
+    if (ff_dns_parse_literal(name, result))
+    {
+        return result->status;
+    }
+
+    if ((host = ff_dns_hosts_find(resolver->hosts, name)) != NULL)
+    {
+        *result = host->result;
+        return result->status;
+    }
+
+    for (uint8_t i = 0; i < 2; i++)
+    {
+        // Random ids and the kernel's random source port make spoofed answers hard to land
+        if (RAND_bytes((uint8_t *)&queries[i].id, sizeof(queries[i].id)) != 1)
+        {
+            ff_log(FF_ERROR, "Failed to generate DNS query id");
+            goto cleanup;
+        }
+
+        message_lengths[i] = ff_dns_query_encode(queries[i].id, name, queries[i].type, messages[i], sizeof(messages[i]));
+
+        if (message_lengths[i] == 0)
+        {
+            ff_log(FF_WARNING, "Invalid host name for DNS lookup: %.*s", FF_DNS_MAX_NAME_LENGTH, name);
+            result->status = FF_DNS_STATUS_NOT_FOUND;
+            result->ttl = FF_DNS_DEFAULT_NEGATIVE_TTL;
+            goto cleanup;
+        }
+    }
+
+    for (uint8_t attempt = 0; attempt < resolver->attempts && pending > 0; attempt++)
+    {
+        if (sockfd < 0 || resolver->servers_length > 1)
+        {
+            if (sockfd >= 0)
+            {
+                close(sockfd);
+            }
+
+            if ((sockfd = ff_dns_open_socket(resolver, attempt)) < 0)
+            {
+                continue;
+            }
+
+            poll_fd.fd = sockfd;
+            poll_fd.events = POLLIN;
+        }
+
+        for (uint8_t i = 0; i < 2; i++)
+        {
+            if (!queries[i].answered && send(sockfd, messages[i], message_lengths[i], 0) < 0)
+            {
+                ff_log(FF_WARNING, "Failed to send DNS query for %s (errno: %d)", name, errno);
+            }
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        deadline = (int64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000 + resolver->timeout_ms;
+
+        while (pending > 0)
+        {
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            remaining = deadline - ((int64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000);
+
+            if (remaining <= 0 || poll(&poll_fd, 1, (int)remaining) <= 0)
+            {
+                break;
+            }
+
+            if ((received = recv(sockfd, response, sizeof(response), 0)) <= 0)
+            {
+                // An ICMP error from the server, try again on the next attempt
+                break;
+            }
+
+            for (uint8_t i = 0; i < 2; i++)
+            {
+                if (!queries[i].answered &&
+                    ff_dns_response_parse(response, (size_t)received, queries[i].id, name, queries[i].type, &queries[i].result))
+                {
+                    queries[i].answered = true;
+                    pending--;
+                    break;
+                }
+            }
+        }
+    }
+
+    ff_dns_result_merge(queries, 2, result);
+
+    if (result->status == FF_DNS_STATUS_FAILED)
+    {
+        ff_log(FF_WARNING, "DNS lookup of %s failed", name);
+    }
+
+cleanup:
+    if (sockfd >= 0)
+    {
+        close(sockfd);
+    }
+
+    return result->status;
+}
+
+void ff_dns_result_merge(struct ff_dns_query *queries, uint8_t length, struct ff_dns_result *result)
+{
+    bool found = false;
+    bool failed = false;
+
+    result->status = FF_DNS_STATUS_FAILED;
+    result->ttl = UINT32_MAX;
+    result->length = 0;
+
+    for (uint8_t i = 0; i < length; i++)
+    {
+        if (!queries[i].answered || queries[i].result.status == FF_DNS_STATUS_FAILED)
+        {
+            failed = true;
+            continue;
+        }
+
+        if (queries[i].result.status == FF_DNS_STATUS_OK)
+        {
+            found = true;
+        }
+
+        for (uint8_t j = 0; j < queries[i].result.length && result->length < FF_DNS_MAX_ADDRESSES; j++)
+        {
+            result->addresses[result->length++] = queries[i].result.addresses[j];
+        }
+
+        result->ttl = queries[i].result.ttl < result->ttl ? queries[i].result.ttl : result->ttl;
+    }
+
+    if (found)
+    {
+        result->status = FF_DNS_STATUS_OK;
+    }
+    else if (!failed)
+    {
+        // Both queries say there is nothing to connect to
+        result->status = FF_DNS_STATUS_NOT_FOUND;
+    }
+    else
+    {
+        result->ttl = 0;
+    }
+}
+
+uint16_t ff_dns_read_uint16(const uint8_t *buff)
+{
+    return (uint16_t)((buff[0] << 8) | buff[1]);
+}
+
+uint32_t ff_dns_read_uint32(const uint8_t *buff)
+{
+    return ((uint32_t)buff[0] << 24) | ((uint32_t)buff[1] << 16) | ((uint32_t)buff[2] << 8) | (uint32_t)buff[3];
+}
+
+void ff_dns_write_uint16(uint8_t *buff, uint16_t value)
+{
+    buff[0] = (uint8_t)(value >> 8);
+    buff[1] = (uint8_t)value;
+}
+
+size_t ff_dns_query_encode(uint16_t id, const char *name, uint16_t type, uint8_t *buff, size_t buff_length)
+{
+    size_t name_length = strlen(name);
+    const char *label = name;
+    size_t label_length;
+    size_t offset = FF_DNS_HEADER_LENGTH;
+
+    // A fully qualified name's trailing dot is the root label written below
+    if (name_length > 0 && name[name_length - 1] == '.')
+    {
+        name_length--;
+    }
+
+    if (name_length == 0 || name_length > FF_DNS_MAX_NAME_LENGTH || buff_length < FF_DNS_HEADER_LENGTH + name_length + 6)
+    {
+        return 0;
+    }
+
+    memset(buff, 0, FF_DNS_HEADER_LENGTH);
+    ff_dns_write_uint16(buff, id);
+    ff_dns_write_uint16(buff + 2, FF_DNS_FLAG_RD);
+    ff_dns_write_uint16(buff + 4, 1);
+
+    while (label < name + name_length)
+    {
+        label_length = strcspn(label, ".");
+        label_length = label + label_length > name + name_length ? (size_t)(name + name_length - label) : label_length;
+
+        if (label_length == 0 || label_length > 63)
+        {
+            return 0;
+        }
+
+        buff[offset++] = (uint8_t)label_length;
+        memcpy(buff + offset, label, label_length);
+        offset += label_length;
+        label += label_length + 1;
+    }
+
+    buff[offset++] = 0;
+    ff_dns_write_uint16(buff + offset, type);
+    ff_dns_write_uint16(buff + offset + 2, FF_DNS_CLASS_IN);
+
+    return offset + 4;
+}
+
+bool ff_dns_read_name(const uint8_t *message, size_t length, size_t *offset, char *out, size_t out_length)
+{
+    size_t position = *offset;
+    size_t written = 0;
+    uint8_t label_length;
+    uint8_t jumps = 0;
+    bool jumped = false;
+
+    while (1)
+    {
+        if (position >= length)
+        {
+            return false;
+        }
+
+        label_length = message[position];
+
+        if ((label_length & 0xc0) == 0xc0)
+        {
+            // Compression pointer to an earlier name, bounded so loops can't hang the parser
+            if (position + 1 >= length || ++jumps > FF_DNS_MAX_COMPRESSION_JUMPS)
+            {
+                return false;
+            }
+
+            if (!jumped)
+            {
+                *offset = position + 2;
+                jumped = true;
+            }
+
+            position = ((size_t)(label_length & 0x3f) << 8) | message[position + 1];
+            continue;
+        }
+
+        if ((label_length & 0xc0) != 0)
+        {
+            return false;
+        }
+
+        if (label_length == 0)
+        {
+            if (!jumped)
+            {
+                *offset = position + 1;
+            }
+
+            break;
+        }
+
+        position++;
+
+        if (position + label_length > length)
+        {
+            return false;
+        }
+
+        if (out != NULL)
+        {
+            // Room for the separator and NULL terminator
+            if (written + label_length + 2 > out_length)
+            {
+                return false;
+            }
+
+            if (written > 0)
+            {
+                out[written++] = '.';
+            }
+
+            for (uint8_t i = 0; i < label_length; i++)
+            {
+                out[written++] = (char)tolower(message[position + i]);
+            }
+        }
+
+        position += label_length;
+    }
+
+    if (out != NULL)
+    {
+        out[written] = '\0';
+    }
+
+    return true;
+}
+
+bool ff_dns_read_record(
+    const uint8_t *message,
+    size_t length,
+    size_t *offset,
+    char *owner,
+    uint16_t *type,
+    uint32_t *ttl,
+    size_t *rdata_offset,
+    uint16_t *rdata_length)
+{
+    if (!ff_dns_read_name(message, length, offset, owner, FF_DNS_MAX_NAME_LENGTH + 2) || *offset + 10 > length)
+    {
+        return false;
+    }
+
+    *type = ff_dns_read_uint16(message + *offset);
+    *ttl = ff_dns_read_uint32(message + *offset + 4);
+    *rdata_length = ff_dns_read_uint16(message + *offset + 8);
+    *rdata_offset = *offset + 10;
+
+    // Records of other classes are ignored by the callers
+    if (ff_dns_read_uint16(message + *offset + 2) != FF_DNS_CLASS_IN)
+    {
+        *type = 0;
+    }
+
+    // TTLs with the top bit set are treated as 0 (RFC 2181)
+    if (*ttl > INT32_MAX)
+    {
+        *ttl = 0;
+    }
+
+    *offset = *rdata_offset + *rdata_length;
+
+    return *offset <= length;
+}
+
+bool ff_dns_response_parse(const uint8_t *message, size_t length, uint16_t id, const char *name, uint16_t type, struct ff_dns_result *result)
+{
+    char question[FF_DNS_MAX_NAME_LENGTH + 2];
+    char owner[FF_DNS_MAX_NAME_LENGTH + 2];
+    char target[FF_DNS_MAX_NAME_LENGTH + 2];
+    size_t offset = FF_DNS_HEADER_LENGTH;
+    size_t answers_offset;
+    size_t rdata_offset;
+    size_t name_length = strlen(name);
+    uint16_t flags;
+    uint16_t answer_count;
+    uint16_t authority_count;
+    uint16_t record_type;
+    uint16_t rdata_length;
+    uint32_t record_ttl;
+    uint32_t ttl = UINT32_MAX;
+    bool followed;
+
+    if (length < FF_DNS_HEADER_LENGTH || ff_dns_read_uint16(message) != id)
+    {
+        return false;
+    }
+
+    flags = ff_dns_read_uint16(message + 2);
+    answer_count = ff_dns_read_uint16(message + 6);
+    authority_count = ff_dns_read_uint16(message + 8);
+
+    if ((flags & FF_DNS_FLAG_QR) == 0 || ff_dns_read_uint16(message + 4) != 1)
+    {
+        return false;
+    }
+
+    // The question must be echoed back exactly, ignoring case and the root label
+    name_length = name_length > 0 && name[name_length - 1] == '.' ? name_length - 1 : name_length;
+
+    if (!ff_dns_read_name(message, length, &offset, question, sizeof(question)) ||
+        strlen(question) != name_length || strncasecmp(question, name, name_length) != 0 ||
+        offset + 4 > length || ff_dns_read_uint16(message + offset) != type ||
+        ff_dns_read_uint16(message + offset + 2) != FF_DNS_CLASS_IN)
+    {
+        return false;
+    }
+
+    memset(result, 0, sizeof(struct ff_dns_result));
+    result->status = FF_DNS_STATUS_FAILED;
+    answers_offset = offset + 4;
+
+    if ((flags & FF_DNS_RCODE_MASK) != FF_DNS_RCODE_NOERROR && (flags & FF_DNS_RCODE_MASK) != FF_DNS_RCODE_NXDOMAIN)
+    {
+        return true;
+    }
+
+    // Follow the CNAME chain from the queried name, the records may be in any order
+    snprintf(target, sizeof(target), "%s", question);
+
+    for (uint8_t hops = 0; hops < FF_DNS_MAX_CNAME_CHAIN; hops++)
+    {
+        followed = false;
+        offset = answers_offset;
+
+        for (uint16_t i = 0; i < answer_count && !followed; i++)
+        {
+            if (!ff_dns_read_record(message, length, &offset, owner, &record_type, &record_ttl, &rdata_offset, &rdata_length))
+            {
+                return true;
+            }
+
+            if (record_type == FF_DNS_TYPE_CNAME && strcmp(owner, target) == 0 &&
+                ff_dns_read_name(message, length, &rdata_offset, target, sizeof(target)))
+            {
+                ttl = record_ttl < ttl ? record_ttl : ttl;
+                followed = true;
+            }
+        }
+
+        if (!followed)
+        {
+            break;
+        }
+    }
+
+    offset = answers_offset;
+
+    for (uint16_t i = 0; i < answer_count; i++)
+    {
+        if (!ff_dns_read_record(message, length, &offset, owner, &record_type, &record_ttl, &rdata_offset, &rdata_length))
+        {
+            return true;
+        }
+
+        if (record_type != type || strcmp(owner, target) != 0)
+        {
+            continue;
+        }
+
+        if ((type == FF_DNS_TYPE_A && rdata_length == 4) || (type == FF_DNS_TYPE_AAAA && rdata_length == 16))
+        {
+            ff_dns_result_add(result, type == FF_DNS_TYPE_A ? AF_INET : AF_INET6, message + rdata_offset);
+            ttl = record_ttl < ttl ? record_ttl : ttl;
+        }
+    }
+
+    if (result->length > 0)
+    {
+        result->status = FF_DNS_STATUS_OK;
+        result->ttl = ttl;
+        return true;
+    }
+
+    if ((flags & FF_DNS_FLAG_TC) != 0)
+    {
+        // Truncated before any usable answer
+        return true;
+    }
+
+    // NXDOMAIN or no records of the type, cached for the SOA's negative TTL (RFC 2308)
+    result->status = FF_DNS_STATUS_NOT_FOUND;
+    result->ttl = FF_DNS_DEFAULT_NEGATIVE_TTL;
+
+    for (uint16_t i = 0; i < authority_count; i++)
+    {
+        if (!ff_dns_read_record(message, length, &offset, owner, &record_type, &record_ttl, &rdata_offset, &rdata_length))
+        {
+            break;
+        }
+
+        if (record_type == FF_DNS_TYPE_SOA && rdata_length >= 4)
+        {
+            uint32_t minimum = ff_dns_read_uint32(message + rdata_offset + rdata_length - 4);
+
+            result->ttl = minimum < record_ttl ? minimum : record_ttl;
+            break;
+        }
+    }
+
+    return true;
+}
+
+void ff_dns_result_add(struct ff_dns_result *result, int family, const void *address)
+{
+    struct sockaddr_storage *storage = NULL;
+
+    if (result->length >= FF_DNS_MAX_ADDRESSES)
+    {
+        return;
+    }
+
+    storage = &result->addresses[result->length++];
+    memset(storage, 0, sizeof(struct sockaddr_storage));
+
+    if (family == AF_INET)
+    {
+        ((struct sockaddr_in *)storage)->sin_family = AF_INET;
+        memcpy(&((struct sockaddr_in *)storage)->sin_addr, address, sizeof(struct in_addr));
+    }
+    else
+    {
+        ((struct sockaddr_in6 *)storage)->sin6_family = AF_INET6;
+        memcpy(&((struct sockaddr_in6 *)storage)->sin6_addr, address, sizeof(struct in6_addr));
+    }
+}
+
+bool ff_dns_parse_literal(const char *name, struct ff_dns_result *result)
+{
+    char address[INET6_ADDRSTRLEN];
+    uint8_t parsed[sizeof(struct in6_addr)];
+    size_t name_length = strlen(name);
+
+    // IPv6 hosts are bracketed in URLs and Host headers
+    if (name_length > 2 && name[0] == '[' && name[name_length - 1] == ']')
+    {
+        name++;
+        name_length -= 2;
+    }
+
+    if (name_length >= sizeof(address))
+    {
+        return false;
+    }
+
+    memcpy(address, name, name_length);
+    address[name_length] = '\0';
+
+    memset(result, 0, sizeof(struct ff_dns_result));
+
+    if (inet_pton(AF_INET, address, parsed) == 1)
+    {
+        ff_dns_result_add(result, AF_INET, parsed);
+    }
+    else if (inet_pton(AF_INET6, address, parsed) == 1)
+    {
+        ff_dns_result_add(result, AF_INET6, parsed);
+    }
+    else
+    {
+        result->status = FF_DNS_STATUS_FAILED;
+        return false;
+    }
+
+    result->status = FF_DNS_STATUS_OK;
+    result->ttl = FF_DNS_LOCAL_TTL;
+
+    return true;
+}
+
+void ff_dns_result_address(struct ff_dns_result *result, uint8_t index, uint16_t port, struct sockaddr_storage *address, socklen_t *address_length)
+{
+    *address = result->addresses[index];
+
+    if (address->ss_family == AF_INET)
+    {
+        ((struct sockaddr_in *)address)->sin_port = htons(port);
+        *address_length = sizeof(struct sockaddr_in);
+    }
+    else
+    {
+        ((struct sockaddr_in6 *)address)->sin6_port = htons(port);
+        *address_length = sizeof(struct sockaddr_in6);
+    }
+}
+
+bool ff_dns_parse_server(const char *server, struct sockaddr_storage *address, socklen_t *address_length)
+{
+    char host[INET6_ADDRSTRLEN];
+    const char *port = NULL;
+    const char *host_end = NULL;
+    struct ff_dns_result parsed;
+    char *port_end = NULL;
+    unsigned long port_number = FF_DNS_PORT;
+
+    if (server[0] == '[')
+    {
+        // [ipv6]:port
+        server++;
+        host_end = strchr(server, ']');
+
+        if (host_end == NULL || (host_end[1] != '\0' && host_end[1] != ':'))
+        {
+            return false;
+        }
+
+        port = host_end[1] == ':' ? host_end + 2 : NULL;
+    }
+    else if ((host_end = strchr(server, ':')) != NULL && strchr(host_end + 1, ':') == NULL)
+    {
+        // ipv4:port
+        port = host_end + 1;
+    }
+    else
+    {
+        // A bare address
+        host_end = server + strlen(server);
+    }
+
+    if ((size_t)(host_end - server) >= sizeof(host))
+    {
+        return false;
+    }
+
+    memcpy(host, server, host_end - server);
+    host[host_end - server] = '\0';
+
+    if (port != NULL)
+    {
+        errno = 0;
+        port_number = strtoul(port, &port_end, 10);
+
+        if (errno != 0 || *port_end != '\0' || port_end == port || port_number == 0 || port_number > UINT16_MAX)
+        {
+            return false;
+        }
+    }
+
+    if (!ff_dns_parse_literal(host, &parsed))
+    {
+        return false;
+    }
+
+    ff_dns_result_address(&parsed, 0, (uint16_t)port_number, address, address_length);
+
+    return true;
+}
+
+void ff_dns_read_resolv_conf(const char *path, struct ff_dns_resolver *resolver)
+{
+    FILE *fd = fopen(path, "r");
+    char line[256];
+    char *token = NULL;
+    char *save = NULL;
+    uint8_t index;
+
+    resolver->servers_length = 0;
+
+    while (fd != NULL && resolver->servers_length < FF_DNS_MAX_SERVERS && fgets(line, sizeof(line), fd) != NULL)
+    {
+        if ((token = strtok_r(line, " \t\r\n", &save)) == NULL || strcmp(token, "nameserver") != 0)
+        {
+            continue;
+        }
+
+        index = resolver->servers_length;
+
+        // Addresses with a scope id aren't supported and are skipped
+        if ((token = strtok_r(NULL, " \t\r\n", &save)) != NULL &&
+            ff_dns_parse_server(token, &resolver->servers[index], &resolver->server_lengths[index]))
+        {
+            resolver->servers_length++;
+        }
+    }
+
+    if (fd != NULL)
+    {
+        fclose(fd);
+    }
+
+    if (resolver->servers_length == 0)
+    {
+        ff_dns_parse_server("127.0.0.1", &resolver->servers[0], &resolver->server_lengths[0]);
+        resolver->servers_length = 1;
+    }
+}
+
+struct ff_dns_hosts_entry *ff_dns_read_hosts(const char *path)
+{
+    FILE *fd = fopen(path, "r");
+    struct ff_dns_hosts_entry *hosts = NULL;
+    struct ff_dns_hosts_entry *entry = NULL;
+    struct ff_dns_result address;
+    char line[1024];
+    char *token = NULL;
+    char *save = NULL;
+
+    if (fd == NULL)
+    {
+        ff_log(FF_DEBUG, "Failed to open hosts file %s (errno: %d)", path, errno);
+        return NULL;
+    }
+
+    while (fgets(line, sizeof(line), fd) != NULL)
+    {
+        line[strcspn(line, "#")] = '\0';
+
+        if ((token = strtok_r(line, " \t\r\n", &save)) == NULL || !ff_dns_parse_literal(token, &address))
+        {
+            continue;
+        }
+
+        while ((token = strtok_r(NULL, " \t\r\n", &save)) != NULL)
+        {
+            if ((entry = ff_dns_hosts_find(hosts, token)) == NULL)
+            {
+                entry = calloc(1, sizeof(struct ff_dns_hosts_entry));
+                entry->name = strdup(token);
+                entry->result.status = FF_DNS_STATUS_OK;
+                entry->result.ttl = FF_DNS_LOCAL_TTL;
+                entry->next = hosts;
+                hosts = entry;
+            }
+
+            if (entry->result.length < FF_DNS_MAX_ADDRESSES)
+            {
+                entry->result.addresses[entry->result.length++] = address.addresses[0];
+            }
+        }
+    }
+
+    fclose(fd);
+
+    return hosts;
+}
+
+struct ff_dns_hosts_entry *ff_dns_hosts_find(struct ff_dns_hosts_entry *hosts, const char *name)
+{
+    while (hosts != NULL && strcasecmp(hosts->name, name) != 0)
+    {
+        hosts = hosts->next;
+    }
+
+    return hosts;
+}
+
+void ff_dns_resolver_free(struct ff_dns_resolver *resolver)
+{
+    struct ff_dns_hosts_entry *entry = NULL;
+
+    if (resolver == NULL)
+    {
+        return;
+    }
+
+    while ((entry = resolver->hosts) != NULL)
+    {
+        resolver->hosts = entry->next;
+        FREE(entry->name);
+        FREE(entry);
+    }
+
+    FREE(resolver);
+}
@@ -0,0 +1,82 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/socket.h>
+
+#ifndef FF_DNS_H
+#define FF_DNS_H
+
+#define FF_DNS_PORT 53
+#define FF_DNS_RESOLV_CONF_PATH "/etc/resolv.conf"
+#define FF_DNS_HOSTS_PATH "/etc/hosts"
+#define FF_DNS_MAX_ADDRESSES 8
+#define FF_DNS_MAX_NAME_LENGTH 253
+#define FF_DNS_TIMEOUT_MS 2000
+#define FF_DNS_ATTEMPTS 2
+// As many nameservers as libc reads from resolv.conf
+#define FF_DNS_MAX_SERVERS 3
+// Cached for names answered by the hosts file or written as an ip address
+#define FF_DNS_LOCAL_TTL 3600
+
+enum ff_dns_status
+{
+    FF_DNS_STATUS_OK = 1,
+    // The name does not exist or has no addresses, safe to cache
+    FF_DNS_STATUS_NOT_FOUND = 2,
+    // Timed out or the server failed, must not be cached
+    FF_DNS_STATUS_FAILED = 3
+};
+
+struct ff_dns_result
+{
+    enum ff_dns_status status;
+    // Seconds the result may be cached for, the lowest TTL of the records used
+    uint32_t ttl;
+    uint8_t length;
+    // IPv4 addresses first, ports are left as 0
+    struct sockaddr_storage addresses[FF_DNS_MAX_ADDRESSES];
+};
+
+struct ff_dns_hosts_entry
+{
+    char *name;
+    struct ff_dns_result result;
+    struct ff_dns_hosts_entry *next;
+};
+
+/**
+ * Stub resolver querying recursive servers over UDP for A and AAAA
+ * records, so the record TTLs are known to the cache. Each retry moves on
+ * to the next server.
+ */
+struct ff_dns_resolver
+{
+    struct sockaddr_storage servers[FF_DNS_MAX_SERVERS];
+    socklen_t server_lengths[FF_DNS_MAX_SERVERS];
+    uint8_t servers_length;
+    uint32_t timeout_ms;
+    uint8_t attempts;
+    // Names from the hosts file, answered without a query
+    struct ff_dns_hosts_entry *hosts;
+};
+
+/**
+ * server = ip[:port] or [ipv6]:port, NULL = the nameservers in resolv.conf.
+ * hosts_path NULL = don't read a hosts file.
+ */
+struct ff_dns_resolver *ff_dns_resolver_init(const char *server, const char *hosts_path);
+
+enum ff_dns_status ff_dns_resolve(struct ff_dns_resolver *resolver, const char *name, struct ff_dns_result *result);
+
+/**
+ * Answers names which are ip addresses without a lookup
+ */
+bool ff_dns_parse_literal(const char *name, struct ff_dns_result *result);
+
+/**
+ * Copies a resolved address with the port set
+ */
+void ff_dns_result_address(struct ff_dns_result *result, uint8_t index, uint16_t port, struct sockaddr_storage *address, socklen_t *address_length);
+
+void ff_dns_resolver_free(struct ff_dns_resolver *resolver);
+
+#endif
@@ -0,0 +1,517 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <openssl/rand.h>
+#include "dns_async.h"
+#include "dns_async_p.h"
+#include "stats.h"
+#include "logging.h"
+#include "fnv.h"
+#include "alloc.h"
+
+struct ff_dns_async_resolver *ff_dns_async_resolver_init(struct ff_dns_resolver *resolver, struct ff_event_loop *loop)
+{
+    struct ff_dns_async_resolver *async = calloc(1, sizeof(struct ff_dns_async_resolver));
+
+    async->resolver = resolver;
+    async->loop = loop;
+    async->lookups = ff_hash_table_init(16);
+
+    return async;
+}
+
+void ff_dns_async_resolve(struct ff_dns_async_resolver *async, const char *name, ff_dns_async_callback callback, void *context)
+{
+    struct ff_dns_async_request *request = malloc(sizeof(struct ff_dns_async_request));
+
+    request->async = async;
+    request->name = strdup(name);
+    request->callback = callback;
+    request->context = context;
+
+    ff_event_loop_post(async->loop, ff_dns_async_start, (void *)request);
+}
+
+void ff_dns_async_start(struct ff_event_loop *loop, void *context)
+{
+    struct ff_dns_async_request *request = (struct ff_dns_async_request *)context;
+    struct ff_dns_async_resolver *async = request->async;
+    struct ff_dns_async_lookup *lookup = NULL;
+    struct ff_dns_async_waiter *waiter = NULL;
+    struct ff_dns_async_query *query = NULL;
+    struct ff_dns_result result;
+    uint16_t ids[2];
+    uint64_t hash;
+
+    (void)loop;
+
+    if (ff_dns_async_resolve_locally(async, request->name, &result))
+    {
+        request->callback(request->name, &result, request->context);
+        goto cleanup;
+    }
+
+    waiter = malloc(sizeof(struct ff_dns_async_waiter));
+    waiter->callback = request->callback;
+    waiter->context = request->context;
+    waiter->next = NULL;
+
+    hash = ff_dns_async_hash(request->name);
+
+    if ((lookup = ff_dns_async_find(async, hash, request->name)) != NULL)
+    {
+        // Answered by the queries already sent for the name
+        waiter->next = lookup->waiters;
+        lookup->waiters = waiter;
+        FF_STATS_INC(dns_lookups_coalesced);
+        goto cleanup;
+    }
+
+    // Random ids and the kernel's random source port make spoofed answers hard to land,
+    // predictable ids would let them through so the lookup fails instead
+    if (RAND_bytes((uint8_t *)ids, sizeof(ids)) != 1)
+    {
+        ff_log(FF_ERROR, "Failed to generate DNS query ids for %s", request->name);
+        memset(&result, 0, sizeof(struct ff_dns_result));
+        result.status = FF_DNS_STATUS_FAILED;
+        request->callback(request->name, &result, request->context);
+        FREE(waiter);
+        goto cleanup;
+    }
+
+    lookup = calloc(1, sizeof(struct ff_dns_async_lookup));
+    lookup->async = async;
+    lookup->hash = hash;
+    lookup->name = request->name;
+    lookup->pending = 2;
+    lookup->sockfd = -1;
+    lookup->waiters = waiter;
+    request->name = NULL;
+
+    for (uint8_t i = 0; i < 2; i++)
+    {
+        query = &lookup->queries[i];
+        query->lookup = lookup;
+        query->query.type = i == 0 ? FF_DNS_TYPE_A : FF_DNS_TYPE_AAAA;
+        query->tcp_fd = -1;
+        query->query.id = ids[i];
+
+        query->message_length = ff_dns_query_encode(query->query.id, lookup->name, query->query.type, query->message + 2, FF_DNS_MAX_MESSAGE_LENGTH);
+        ff_dns_write_uint16(query->message, (uint16_t)query->message_length);
+    }
+
+    lookup->next = ff_hash_table_get_item(async->lookups, hash);
+    ff_hash_table_put_item(async->lookups, hash, lookup);
+    FF_STATS_INC(dns_lookups_in_flight);
+
+    ff_event_loop_timer_init(&lookup->timer, ff_dns_async_on_timeout, (void *)lookup);
+    ff_dns_async_send(lookup);
+
+cleanup:
+    FREE(request->name);
+    FREE(request);
+}
+
+bool ff_dns_async_resolve_locally(struct ff_dns_async_resolver *async, const char *name, struct ff_dns_result *result)
+{
+    struct ff_dns_hosts_entry *host = NULL;
+    uint8_t message[FF_DNS_MAX_MESSAGE_LENGTH];
+
+    memset(result, 0, sizeof(struct ff_dns_result));
+
+    if (ff_dns_parse_literal(name, result))
+    {
+        return true;
+    }
+
+    if ((host = ff_dns_hosts_find(async->resolver->hosts, name)) != NULL)
+    {
+        *result = host->result;
+        return true;
+    }
+
+    if (ff_dns_query_encode(0, name, FF_DNS_TYPE_A, message, sizeof(message)) == 0)
+    {
+        ff_log(FF_WARNING, "Invalid host name for DNS lookup: %.*s", FF_DNS_MAX_NAME_LENGTH, name);
+        result->status = FF_DNS_STATUS_NOT_FOUND;
+        result->ttl = FF_DNS_DEFAULT_NEGATIVE_TTL;
+        return true;
+    }
+
+    return false;
+}
+
+void ff_dns_async_send(struct ff_dns_async_lookup *lookup)
+{
+    struct ff_dns_resolver *resolver = lookup->async->resolver;
+    struct ff_dns_async_query *query = NULL;
+
+    // Each retry goes to the next server
+    if (lookup->sockfd < 0 || resolver->servers_length > 1)
+    {
+        ff_dns_async_close_socket(lookup);
+
+        if ((lookup->sockfd = ff_dns_open_socket(resolver, lookup->attempt)) >= 0)
+        {
+            fcntl(lookup->sockfd, F_SETFL, fcntl(lookup->sockfd, F_GETFL) | O_NONBLOCK);
+            ff_event_loop_watch_init(&lookup->watch, lookup->sockfd, ff_dns_async_on_readable, (void *)lookup);
+
+            if (!ff_event_loop_watch(lookup->async->loop, &lookup->watch, EPOLLIN))
+            {
+                ff_dns_async_close_socket(lookup);
+            }
+        }
+    }
+
+    for (uint8_t i = 0; i < 2 && lookup->sockfd >= 0; i++)
+    {
+        query = &lookup->queries[i];
+
+        if (query->query.answered || query->tcp_fd >= 0)
+        {
+            continue;
+        }
+
+        if (send(lookup->sockfd, query->message + 2, query->message_length, 0) < 0)
+        {
+            ff_log(FF_WARNING, "Failed to send DNS query for %s (errno: %d)", lookup->name, errno);
+        }
+
+        FF_STATS_INC(dns_queries);
+    }
+
+    ff_event_loop_timer_start(lookup->async->loop, &lookup->timer, resolver->timeout_ms);
+}
+
+void ff_dns_async_on_readable(struct ff_event_loop *loop, uint32_t events, void *context)
+{
+    struct ff_dns_async_lookup *lookup = (struct ff_dns_async_lookup *)context;
+    struct ff_dns_async_query *query = NULL;
+    uint8_t response[FF_DNS_MAX_MESSAGE_LENGTH];
+    ssize_t received;
+
+    (void)loop;
+    (void)events;
+
+    // An ICMP error from the server fails the recv, the retry timer tries the next server
+    while ((received = recv(lookup->sockfd, response, sizeof(response), MSG_DONTWAIT)) >= 0)
+    {
+        for (uint8_t i = 0; i < 2; i++)
+        {
+            query = &lookup->queries[i];
+
+            if (query->query.answered || query->tcp_fd >= 0 ||
+                !ff_dns_response_parse(response, (size_t)received, query->query.id, lookup->name, query->query.type, &query->query.result))
+            {
+                continue;
+            }
+
+            if (query->query.result.status == FF_DNS_STATUS_FAILED && (ff_dns_read_uint16(response + 2) & FF_DNS_FLAG_TC) != 0)
+            {
+                FF_STATS_INC(dns_tcp_fallbacks);
+                ff_dns_async_tcp_start(query);
+            }
+            else
+            {
+                query->query.answered = true;
+                lookup->pending--;
+            }
+
+            break;
+        }
+
+        if (lookup->pending == 0)
+        {
+            ff_dns_async_complete(lookup);
+            return;
+        }
+    }
+}
+
+void ff_dns_async_on_timeout(struct ff_event_loop *loop, void *context)
+{
+    struct ff_dns_async_lookup *lookup = (struct ff_dns_async_lookup *)context;
+
+    (void)loop;
+
+    if (++lookup->attempt >= lookup->async->resolver->attempts)
+    {
+        ff_dns_async_complete(lookup);
+        return;
+    }
+
+    FF_STATS_INC(dns_query_retries);
+
+    // Slow TCP retries are abandoned, the retry starts again over UDP
+    ff_dns_async_tcp_close(&lookup->queries[0]);
+    ff_dns_async_tcp_close(&lookup->queries[1]);
+    ff_dns_async_send(lookup);
+}
+
+void ff_dns_async_tcp_start(struct ff_dns_async_query *query)
+{
+    struct ff_dns_async_lookup *lookup = query->lookup;
+    struct ff_dns_resolver *resolver = lookup->async->resolver;
+    uint8_t index = lookup->attempt % resolver->servers_length;
+    int sockfd = socket(resolver->servers[index].ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+
+    if (sockfd < 0 ||
+        (connect(sockfd, (struct sockaddr *)&resolver->servers[index], resolver->server_lengths[index]) != 0 && errno != EINPROGRESS))
+    {
+        ff_log(FF_WARNING, "Failed to connect to DNS server over TCP (errno: %d)", errno);
+        goto error;
+    }
+
+    query->tcp_fd = sockfd;
+    query->tcp_written = 0;
+    query->tcp_read = 0;
+    ff_event_loop_watch_init(&query->tcp_watch, sockfd, ff_dns_async_tcp_on_event, (void *)query);
+
+    if (!ff_event_loop_watch(lookup->async->loop, &query->tcp_watch, EPOLLOUT))
+    {
+        ff_dns_async_tcp_close(query);
+    }
+
+    return;
+
+error:
+    if (sockfd >= 0)
+    {
+        close(sockfd);
+    }
+}
+
+void ff_dns_async_tcp_on_event(struct ff_event_loop *loop, uint32_t events, void *context)
+{
+    struct ff_dns_async_query *query = (struct ff_dns_async_query *)context;
+    struct ff_dns_async_lookup *lookup = query->lookup;
+    size_t total = query->message_length + 2;
+    ssize_t transferred;
+
+    (void)events;
+
+    if (query->tcp_written < total)
+    {
+        // The first write also reports a failed connect
+        if ((transferred = send(query->tcp_fd, query->message + query->tcp_written, total - query->tcp_written, MSG_NOSIGNAL)) < 0)
+        {
+            goto error;
+        }
+
+        if ((query->tcp_written += (size_t)transferred) == total && !ff_event_loop_watch(loop, &query->tcp_watch, EPOLLIN))
+        {
+            goto failed;
+        }
+
+        return;
+    }
+
+    if (query->tcp_read < 2)
+    {
+        if ((transferred = recv(query->tcp_fd, query->tcp_length_prefix + query->tcp_read, 2 - query->tcp_read, 0)) <= 0)
+        {
+            goto error;
+        }
+
+        if ((query->tcp_read += (size_t)transferred) < 2)
+        {
+            return;
+        }
+
+        if ((query->tcp_response_length = ff_dns_read_uint16(query->tcp_length_prefix)) == 0)
+        {
+            goto failed;
+        }
+
+        query->tcp_response = malloc(query->tcp_response_length);
+    }
+
+    if ((transferred = recv(query->tcp_fd, query->tcp_response + query->tcp_read - 2, query->tcp_response_length - (query->tcp_read - 2), 0)) <= 0)
+    {
+        goto error;
+    }
+
+    if ((query->tcp_read += (size_t)transferred) < query->tcp_response_length + 2)
+    {
+        return;
+    }
+
+    if (!ff_dns_response_parse(query->tcp_response, query->tcp_response_length, query->query.id, lookup->name, query->query.type, &query->query.result))
+    {
+        goto failed;
+    }
+
+    ff_dns_async_tcp_close(query);
+    query->query.answered = true;
+
+    if (--lookup->pending == 0)
+    {
+        ff_dns_async_complete(lookup);
+    }
+
+    return;
+
+error:
+    if (transferred < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+    {
+        return;
+    }
+
+failed:
+    // Left unanswered for the retry timer
+    ff_log(FF_WARNING, "DNS query over TCP for %s failed (errno: %d)", lookup->name, errno);
+    ff_dns_async_tcp_close(query);
+}
+
+void ff_dns_async_tcp_close(struct ff_dns_async_query *query)
+{
+    if (query->tcp_fd < 0)
+    {
+        return;
+    }
+
+    ff_event_loop_unwatch(query->lookup->async->loop, &query->tcp_watch);
+    close(query->tcp_fd);
+    query->tcp_fd = -1;
+    FREE(query->tcp_response);
+}
+
+void ff_dns_async_close_socket(struct ff_dns_async_lookup *lookup)
+{
+    if (lookup->sockfd < 0)
+    {
+        return;
+    }
+
+    ff_event_loop_unwatch(lookup->async->loop, &lookup->watch);
+    close(lookup->sockfd);
+    lookup->sockfd = -1;
+}
+
+void ff_dns_async_complete(struct ff_dns_async_lookup *lookup)
+{
+    struct ff_dns_query queries[2] = {lookup->queries[0].query, lookup->queries[1].query};
+    struct ff_dns_async_waiter *waiter = NULL;
+    struct ff_dns_result result;
+
+    ff_dns_result_merge(queries, 2, &result);
+
+    if (result.status == FF_DNS_STATUS_FAILED)
+    {
+        ff_log(FF_WARNING, "DNS lookup of %s failed", lookup->name);
+    }
+
+    ff_dns_async_unlink(lookup->async, lookup);
+    ff_event_loop_timer_stop(lookup->async->loop, &lookup->timer);
+    ff_dns_async_close_socket(lookup);
+    ff_dns_async_tcp_close(&lookup->queries[0]);
+    ff_dns_async_tcp_close(&lookup->queries[1]);
+    FF_STATS_DEC(dns_lookups_in_flight);
+
+    while ((waiter = lookup->waiters) != NULL)
+    {
+        lookup->waiters = waiter->next;
+        waiter->callback(lookup->name, &result, waiter->context);
+        FREE(waiter);
+    }
+
+    FREE(lookup->name);
+    FREE(lookup);
+}
+
+uint64_t ff_dns_async_hash(const char *name)
+{
+    uint64_t hash = FF_FNV_OFFSET;
+    uint8_t lower;
+
+    // Matches the case insensitive comparison of names
+    for (; *name != '\0'; name++)
+    {
+        lower = (uint8_t)tolower((unsigned char)*name);
+        hash = ff_fnv_update(hash, &lower, 1);
+    }
+
+    return hash;
+}
+
+struct ff_dns_async_lookup *ff_dns_async_find(struct ff_dns_async_resolver *async, uint64_t hash, const char *name)
+{
+    struct ff_dns_async_lookup *lookup = ff_hash_table_get_item(async->lookups, hash);
+
+    while (lookup != NULL && strcasecmp(lookup->name, name) != 0)
+    {
+        lookup = lookup->next;
+    }
+
+    return lookup;
+}
+
+void ff_dns_async_unlink(struct ff_dns_async_resolver *async, struct ff_dns_async_lookup *lookup)
+{
+    struct ff_dns_async_lookup *first = ff_hash_table_get_item(async->lookups, lookup->hash);
+
+    if (first == lookup)
+    {
+        if (lookup->next == NULL)
+        {
+            ff_hash_table_remove_item(async->lookups, lookup->hash);
+        }
+        else
+        {
+            ff_hash_table_put_item(async->lookups, lookup->hash, lookup->next);
+        }
+    }
+    else
+    {
+        while (first->next != lookup)
+        {
+            first = first->next;
+        }
+
+        first->next = lookup->next;
+    }
+
+    lookup->next = NULL;
+}
+
+void ff_dns_async_fail_all(struct ff_event_loop *loop, void *context)
+{
+    struct ff_dns_async_resolver *async = (struct ff_dns_async_resolver *)context;
+    struct ff_hash_table_snapshot *snapshot = ff_hash_table_snapshot_init(async->lookups);
+    struct ff_dns_async_lookup *lookup = NULL;
+    struct ff_dns_async_lookup *next = NULL;
+
+    (void)loop;
+
+    while ((lookup = ff_hash_table_snapshot_next(snapshot, NULL)) != NULL)
+    {
+        for (; lookup != NULL; lookup = next)
+        {
+            next = lookup->next;
+            ff_dns_async_complete(lookup);
+        }
+    }
+
+    ff_hash_table_snapshot_free(snapshot);
+}
+
+void ff_dns_async_resolver_free(struct ff_dns_async_resolver *async)
+{
+    if (async == NULL)
+    {
+        return;
+    }
+
+    ff_event_loop_call(async->loop, ff_dns_async_fail_all, (void *)async);
+    ff_hash_table_free(async->lookups);
+    FREE(async);
+}
@@ -0,0 +1,42 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include "dns.h"
+#include "event_loop.h"
+#include "hash_table.h"
+
+#ifndef FF_DNS_ASYNC_H
+#define FF_DNS_ASYNC_H
+
+/**
+ * Called on the loop's thread once the name is resolved
+ */
+typedef void (*ff_dns_async_callback)(const char *name, struct ff_dns_result *result, void *context);
+
+/**
+ * Non-blocking counterpart of ff_dns_resolve run by an event loop. The A
+ * and AAAA queries go out together, retries are driven by timers and
+ * concurrent lookups of the same name share one set of queries.
+ */
+struct ff_dns_async_resolver
+{
+    // Servers, hosts file and timeouts, not owned
+    struct ff_dns_resolver *resolver;
+    struct ff_event_loop *loop;
+    // Lookups in flight by name, only touched on the loop's thread
+    struct ff_hash_table *lookups;
+};
+
+struct ff_dns_async_resolver *ff_dns_async_resolver_init(struct ff_dns_resolver *resolver, struct ff_event_loop *loop);
+
+/**
+ * Starts resolving the name, callable from any thread. The callback is
+ * always run on the loop's thread, even for names answered locally.
+ */
+void ff_dns_async_resolve(struct ff_dns_async_resolver *async, const char *name, ff_dns_async_callback callback, void *context);
+
+/**
+ * Fails the lookups still in flight and frees the resolver, the loop must still be running
+ */
+void ff_dns_async_resolver_free(struct ff_dns_async_resolver *async);
+
+#endif
@@ -0,0 +1,102 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "dns_async.h"
+#include "dns_p.h"
+#include "event_loop.h"
+
+#ifndef FF_DNS_ASYNC_P_H
+#define FF_DNS_ASYNC_P_H
+
+struct ff_dns_async_request
+{
+    struct ff_dns_async_resolver *async;
+    char *name;
+    ff_dns_async_callback callback;
+    void *context;
+};
+
+struct ff_dns_async_waiter
+{
+    ff_dns_async_callback callback;
+    void *context;
+    struct ff_dns_async_waiter *next;
+};
+
+struct ff_dns_async_lookup;
+
+/**
+ * One of the lookup's A or AAAA queries. Truncated UDP answers are
+ * retried over TCP (RFC 7766) with the same message.
+ */
+struct ff_dns_async_query
+{
+    struct ff_dns_async_lookup *lookup;
+    struct ff_dns_query query;
+    // Prefixed with the 2 byte length used over TCP
+    uint8_t message[2 + FF_DNS_MAX_MESSAGE_LENGTH];
+    size_t message_length;
+    int tcp_fd;
+    struct ff_event_loop_watch tcp_watch;
+    size_t tcp_written;
+    uint8_t *tcp_response;
+    size_t tcp_response_length;
+    size_t tcp_read;
+    uint8_t tcp_length_prefix[2];
+};
+
+struct ff_dns_async_lookup
+{
+    struct ff_dns_async_resolver *async;
+    uint64_t hash;
+    char *name;
+    struct ff_dns_async_query queries[2];
+    uint8_t pending;
+    uint8_t attempt;
+    int sockfd;
+    struct ff_event_loop_watch watch;
+    struct ff_event_loop_timer timer;
+    struct ff_dns_async_waiter *waiters;
+    struct ff_dns_async_lookup *next;
+};
+
+uint64_t ff_dns_async_hash(const char *name);
+
+struct ff_dns_async_lookup *ff_dns_async_find(struct ff_dns_async_resolver *async, uint64_t hash, const char *name);
+
+void ff_dns_async_start(struct ff_event_loop *loop, void *context);
+
+/**
+ * Answers names which don't need a query, returns false if the name must be looked up
+ */
+bool ff_dns_async_resolve_locally(struct ff_dns_async_resolver *async, const char *name, struct ff_dns_result *result);
+
+/**
+ * Sends the unanswered queries to the attempt's server and schedules the next retry
+ */
+void ff_dns_async_send(struct ff_dns_async_lookup *lookup);
+
+void ff_dns_async_on_readable(struct ff_event_loop *loop, uint32_t events, void *context);
+
+void ff_dns_async_on_timeout(struct ff_event_loop *loop, void *context);
+
+void ff_dns_async_answered(struct ff_dns_async_query *query, const uint8_t *response, size_t length);
+
+void ff_dns_async_tcp_start(struct ff_dns_async_query *query);
+
+void ff_dns_async_tcp_on_event(struct ff_event_loop *loop, uint32_t events, void *context);
+
+void ff_dns_async_tcp_close(struct ff_dns_async_query *query);
+
+void ff_dns_async_close_socket(struct ff_dns_async_lookup *lookup);
+
+/**
+ * Merges the answers, removes the lookup and runs its waiters
+ */
+void ff_dns_async_complete(struct ff_dns_async_lookup *lookup);
+
+void ff_dns_async_unlink(struct ff_dns_async_resolver *async, struct ff_dns_async_lookup *lookup);
+
+void ff_dns_async_fail_all(struct ff_event_loop *loop, void *context);
+
+#endif
@@ -0,0 +1,335 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+#include <pthread.h>
+#include "dns_cache.h"
+#include "dns_cache_p.h"
+#include "stats.h"
+#include "logging.h"
+#include "alloc.h"
+
+struct ff_dns_cache *ff_dns_cache_init(struct ff_dns_resolver *resolver, struct ff_event_loop *loop, uint32_t capacity, uint32_t max_stale)
+{
+    struct ff_dns_cache *cache = calloc(1, sizeof(struct ff_dns_cache));
+
+    cache->resolver = resolver;
+    cache->async = ff_dns_async_resolver_init(resolver, loop);
+    cache->max_stale = max_stale;
+    cache->entries = ff_lru_table_init(capacity, NULL, ff_dns_cache_entry_free);
+    pthread_mutex_init(&cache->mutex, NULL);
+    pthread_cond_init(&cache->refreshed, NULL);
+
+    return cache;
+}
+
+bool ff_dns_cache_lookup(struct ff_dns_cache *cache, const char *name, struct ff_dns_result *result)
+{
+    struct ff_dns_cache_wait wait = {.result = result, .done = false};
+
+    pthread_mutex_init(&wait.mutex, NULL);
+    pthread_cond_init(&wait.resolved, NULL);
+
+    ff_dns_cache_lookup_async(cache, name, ff_dns_cache_lookup_resolved, (void *)&wait);
+
+    pthread_mutex_lock(&wait.mutex);
+
+    while (!wait.done)
+    {
+        pthread_cond_wait(&wait.resolved, &wait.mutex);
+    }
+
+    pthread_mutex_unlock(&wait.mutex);
+
+    pthread_cond_destroy(&wait.resolved);
+    pthread_mutex_destroy(&wait.mutex);
+
+    return result->status == FF_DNS_STATUS_OK;
+}
+
+void ff_dns_cache_lookup_resolved(struct ff_dns_result *result, void *context)
+{
+    struct ff_dns_cache_wait *wait = (struct ff_dns_cache_wait *)context;
+
+    pthread_mutex_lock(&wait->mutex);
+    *wait->result = *result;
+    wait->done = true;
+    pthread_cond_signal(&wait->resolved);
+    pthread_mutex_unlock(&wait->mutex);
+}
+
+void ff_dns_cache_lookup_async(struct ff_dns_cache *cache, const char *name, ff_dns_cache_callback callback, void *context)
+{
+    char normalised[FF_DNS_MAX_NAME_LENGTH + 2];
+    struct ff_dns_cache_miss_args *args = NULL;
+    struct ff_dns_result result;
+
+    if (ff_dns_cache_get(cache, name, normalised, &result))
+    {
+        callback(&result, context);
+        return;
+    }
+
+    args = malloc(sizeof(struct ff_dns_cache_miss_args));
+    args->cache = cache;
+    args->callback = callback;
+    args->context = context;
+
+    ff_dns_async_resolve(cache->async, normalised, ff_dns_cache_miss_resolved, (void *)args);
+}
+
+void ff_dns_cache_miss_resolved(const char *name, struct ff_dns_result *result, void *context)
+{
+    struct ff_dns_cache_miss_args *args = (struct ff_dns_cache_miss_args *)context;
+
+    ff_dns_cache_resolved(args->cache, name, result);
+    args->callback(result, args->context);
+
+    FREE(args);
+}
+
+bool ff_dns_cache_get(struct ff_dns_cache *cache, const char *name, char *normalised, struct ff_dns_result *result)
+{
+    struct ff_dns_cache_entry *entry = NULL;
+    size_t length = strlen(name);
+    time_t now = time(NULL);
+
+    memset(result, 0, sizeof(struct ff_dns_result));
+
+    if (ff_dns_parse_literal(name, result))
+    {
+        return true;
+    }
+
+    // Names differing only in case or a trailing dot share an entry
+    length = length > 0 && name[length - 1] == '.' ? length - 1 : length;
+
+    if (length == 0 || length > FF_DNS_MAX_NAME_LENGTH)
+    {
+        result->status = FF_DNS_STATUS_NOT_FOUND;
+        return true;
+    }
+
+    for (size_t i = 0; i < length; i++)
+    {
+        normalised[i] = (char)tolower((unsigned char)name[i]);
+    }
+
+    normalised[length] = '\0';
+
+    pthread_mutex_lock(&cache->mutex);
+
+    entry = ff_dns_cache_find(cache, normalised);
+
+    if (entry != NULL && now < entry->expires_at)
+    {
+        ff_lru_table_touch(cache->entries, &entry->lru);
+        *result = entry->result;
+        pthread_mutex_unlock(&cache->mutex);
+
+        if (result->status == FF_DNS_STATUS_OK)
+        {
+            FF_STATS_INC(dns_cache_hits);
+        }
+        else
+        {
+            FF_STATS_INC(dns_cache_negative_hits);
+        }
+
+        return true;
+    }
+
+    if (entry != NULL && entry->result.status == FF_DNS_STATUS_OK && now - entry->expires_at < (time_t)cache->max_stale)
+    {
+        ff_lru_table_touch(cache->entries, &entry->lru);
+        *result = entry->result;
+
+        if (!entry->refreshing)
+        {
+            ff_dns_cache_refresh(cache, entry);
+        }
+
+        pthread_mutex_unlock(&cache->mutex);
+        FF_STATS_INC(dns_cache_stale_hits);
+
+        return true;
+    }
+
+    pthread_mutex_unlock(&cache->mutex);
+
+    FF_STATS_INC(dns_cache_misses);
+
+    return false;
+}
+
+void ff_dns_cache_prefetch(struct ff_dns_cache *cache, const char *names)
+{
+    struct ff_dns_cache_prefetch_args args = {.pending = 1, .resolved = 0};
+    char *list = strdup(names);
+    char *name = NULL;
+    char *save = NULL;
+    uint32_t requested = 0;
+
+    pthread_mutex_init(&args.mutex, NULL);
+    pthread_cond_init(&args.resolved_all, NULL);
+
+    // The lookups run in parallel, pending starts at 1 so it can't reach 0 before they are all started
+    for (name = strtok_r(list, ", ", &save); name != NULL; name = strtok_r(NULL, ", ", &save))
+    {
+        pthread_mutex_lock(&args.mutex);
+        args.pending++;
+        pthread_mutex_unlock(&args.mutex);
+
+        requested++;
+        ff_dns_cache_lookup_async(cache, name, ff_dns_cache_prefetch_resolved, (void *)&args);
+    }
+
+    pthread_mutex_lock(&args.mutex);
+    args.pending--;
+
+    while (args.pending > 0)
+    {
+        pthread_cond_wait(&args.resolved_all, &args.mutex);
+    }
+
+    pthread_mutex_unlock(&args.mutex);
+
+    ff_log(FF_INFO, "Prefetched DNS records for %u of %u hosts", args.resolved, requested);
+
+    pthread_cond_destroy(&args.resolved_all);
+    pthread_mutex_destroy(&args.mutex);
+    FREE(list);
+}
+
+void ff_dns_cache_prefetch_resolved(struct ff_dns_result *result, void *context)
+{
+    struct ff_dns_cache_prefetch_args *args = (struct ff_dns_cache_prefetch_args *)context;
+
+    pthread_mutex_lock(&args->mutex);
+
+    if (result->status == FF_DNS_STATUS_OK)
+    {
+        args->resolved++;
+    }
+
+    if (--args->pending == 0)
+    {
+        pthread_cond_signal(&args->resolved_all);
+    }
+
+    pthread_mutex_unlock(&args->mutex);
+}
+
+void ff_dns_cache_resolved(struct ff_dns_cache *cache, const char *name, struct ff_dns_result *result)
+{
+    if (result->status == FF_DNS_STATUS_FAILED)
+    {
+        FF_STATS_INC(dns_resolve_failures);
+        return;
+    }
+
+    pthread_mutex_lock(&cache->mutex);
+    ff_dns_cache_store(cache, name, result, time(NULL));
+    pthread_mutex_unlock(&cache->mutex);
+}
+
+void ff_dns_cache_store(struct ff_dns_cache *cache, const char *name, struct ff_dns_result *result, time_t now)
+{
+    struct ff_dns_cache_entry *entry = ff_dns_cache_find(cache, name);
+    uint32_t ttl = result->ttl;
+
+    if (cache->entries->capacity == 0)
+    {
+        return;
+    }
+
+    if (result->status == FF_DNS_STATUS_OK)
+    {
+        ttl = ttl > FF_DNS_CACHE_MAX_TTL ? FF_DNS_CACHE_MAX_TTL : ttl;
+    }
+    else
+    {
+        ttl = ttl > FF_DNS_CACHE_MAX_NEGATIVE_TTL ? FF_DNS_CACHE_MAX_NEGATIVE_TTL : ttl;
+    }
+
+    if (entry == NULL)
+    {
+        entry = (struct ff_dns_cache_entry *)ff_lru_table_insert_string(cache->entries, name, sizeof(struct ff_dns_cache_entry));
+    }
+    else
+    {
+        ff_lru_table_touch(cache->entries, &entry->lru);
+    }
+
+    entry->result = *result;
+    entry->expires_at = now + (time_t)ttl;
+}
+
+void ff_dns_cache_refresh(struct ff_dns_cache *cache, struct ff_dns_cache_entry *entry)
+{
+    ff_log(FF_DEBUG, "Refreshing DNS records for %s", (char *)entry->lru.key);
+
+    entry->refreshing = true;
+    cache->refreshes++;
+
+    ff_dns_async_resolve(cache->async, (char *)entry->lru.key, ff_dns_cache_refresh_resolved, (void *)cache);
+}
+
+void ff_dns_cache_refresh_resolved(const char *name, struct ff_dns_result *result, void *context)
+{
+    struct ff_dns_cache *cache = (struct ff_dns_cache *)context;
+    struct ff_dns_cache_entry *entry = NULL;
+
+    // A failed refresh leaves the stale answer in place until max_stale passes
+    ff_dns_cache_resolved(cache, name, result);
+
+    pthread_mutex_lock(&cache->mutex);
+
+    if ((entry = ff_dns_cache_find(cache, name)) != NULL)
+    {
+        entry->refreshing = false;
+    }
+
+    cache->refreshes--;
+    pthread_cond_broadcast(&cache->refreshed);
+    pthread_mutex_unlock(&cache->mutex);
+}
+
+struct ff_dns_cache_entry *ff_dns_cache_find(struct ff_dns_cache *cache, const char *name)
+{
+    return (struct ff_dns_cache_entry *)ff_lru_table_find_string(cache->entries, name);
+}
+
+void ff_dns_cache_entry_free(struct ff_lru_table_entry *entry)
+{
+    FREE(entry);
+}
+
+void ff_dns_cache_free(struct ff_dns_cache *cache)
+{
+    if (cache == NULL)
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&cache->mutex);
+
+    while (cache->refreshes > 0)
+    {
+        pthread_cond_wait(&cache->refreshed, &cache->mutex);
+    }
+
+    pthread_mutex_unlock(&cache->mutex);
+
+    // Lookups still in flight fail before the resolver they use is freed, and
+    // before the entries so none can be stored once they have been freed
+    ff_dns_async_resolver_free(cache->async);
+    ff_lru_table_free(cache->entries);
+    ff_dns_resolver_free(cache->resolver);
+    pthread_cond_destroy(&cache->refreshed);
+    pthread_mutex_destroy(&cache->mutex);
+    FREE(cache);
+}
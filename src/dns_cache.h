@@ -0,0 +1,76 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+#include <pthread.h>
+#include "dns.h"
+#include "dns_async.h"
+#include "event_loop.h"
+#include "lru_table.h"
+
+#ifndef FF_DNS_CACHE_H
+#define FF_DNS_CACHE_H
+
+// Upper bound on how long any answer is trusted, regardless of its TTL
+#define FF_DNS_CACHE_MAX_TTL 86400
+#define FF_DNS_CACHE_MAX_NEGATIVE_TTL 300
+
+struct ff_dns_cache_entry
+{
+    // Keyed by the normalised name
+    struct ff_lru_table_entry lru;
+    struct ff_dns_result result;
+    time_t expires_at;
+    // A background lookup is replacing the expired result
+    bool refreshing;
+};
+
+/**
+ * Called with the addresses of the name, or the reason it has none in result->status
+ */
+typedef void (*ff_dns_cache_callback)(struct ff_dns_result *result, void *context);
+
+/**
+ * Resolved upstream host names kept for their record TTLs, including names
+ * which don't exist. Expired addresses are served for up to max_stale seconds
+ * while a background lookup refreshes them, so a slow resolver only delays
+ * the first request for a name. Misses and refreshes are resolved by an
+ * event loop rather than a thread per lookup.
+ */
+struct ff_dns_cache
+{
+    struct ff_dns_resolver *resolver;
+    struct ff_dns_async_resolver *async;
+    uint32_t max_stale;
+    struct ff_lru_table *entries;
+    // Background refreshes still running, waited for when freeing
+    uint32_t refreshes;
+    pthread_mutex_t mutex;
+    pthread_cond_t refreshed;
+};
+
+/**
+ * The cache takes ownership of the resolver, lookups are sent from the loop
+ */
+struct ff_dns_cache *ff_dns_cache_init(struct ff_dns_resolver *resolver, struct ff_event_loop *loop, uint32_t capacity, uint32_t max_stale);
+
+/**
+ * Copies the addresses of the name into result, returns false if the name
+ * does not exist or could not be resolved. Blocks on a miss, so must not be
+ * called from the cache's event loop.
+ */
+bool ff_dns_cache_lookup(struct ff_dns_cache *cache, const char *name, struct ff_dns_result *result);
+
+/**
+ * Runs the callback with the addresses of the name. Cached names are answered
+ * before this returns, misses on the event loop's thread once resolved.
+ */
+void ff_dns_cache_lookup_async(struct ff_dns_cache *cache, const char *name, ff_dns_cache_callback callback, void *context);
+
+/**
+ * Resolves a comma separated list of names in parallel ahead of their first request
+ */
+void ff_dns_cache_prefetch(struct ff_dns_cache *cache, const char *names);
+
+void ff_dns_cache_free(struct ff_dns_cache *cache);
+
+#endif
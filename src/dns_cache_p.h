@@ -0,0 +1,66 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+#include <pthread.h>
+#include "dns_cache.h"
+
+#ifndef FF_DNS_CACHE_P_H
+#define FF_DNS_CACHE_P_H
+
+struct ff_dns_cache_wait
+{
+    struct ff_dns_result *result;
+    bool done;
+    pthread_mutex_t mutex;
+    pthread_cond_t resolved;
+};
+
+struct ff_dns_cache_miss_args
+{
+    struct ff_dns_cache *cache;
+    ff_dns_cache_callback callback;
+    void *context;
+};
+
+struct ff_dns_cache_prefetch_args
+{
+    uint32_t pending;
+    uint32_t resolved;
+    pthread_mutex_t mutex;
+    pthread_cond_t resolved_all;
+};
+
+struct ff_dns_cache_entry *ff_dns_cache_find(struct ff_dns_cache *cache, const char *name);
+
+/**
+ * Copies a cached (or locally answered) result for the name, returns false
+ * on a miss with the name normalised for the lookup
+ */
+bool ff_dns_cache_get(struct ff_dns_cache *cache, const char *name, char *normalised, struct ff_dns_result *result);
+
+void ff_dns_cache_lookup_resolved(struct ff_dns_result *result, void *context);
+
+void ff_dns_cache_miss_resolved(const char *name, struct ff_dns_result *result, void *context);
+
+void ff_dns_cache_prefetch_resolved(struct ff_dns_result *result, void *context);
+
+/**
+ * Caches the answer unless the lookup failed
+ */
+void ff_dns_cache_resolved(struct ff_dns_cache *cache, const char *name, struct ff_dns_result *result);
+
+/**
+ * Stores the result for the name, must be called with the cache locked
+ */
+void ff_dns_cache_store(struct ff_dns_cache *cache, const char *name, struct ff_dns_result *result, time_t now);
+
+/**
+ * Starts a background lookup of the entry's name, must be called with the cache locked
+ */
+void ff_dns_cache_refresh(struct ff_dns_cache *cache, struct ff_dns_cache_entry *entry);
+
+void ff_dns_cache_refresh_resolved(const char *name, struct ff_dns_result *result, void *context);
+
+void ff_dns_cache_entry_free(struct ff_lru_table_entry *entry);
+
+#endif
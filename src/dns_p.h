@@ -0,0 +1,99 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/socket.h>
+#include "dns.h"
+
+#ifndef FF_DNS_P_H
+#define FF_DNS_P_H
+
+#define FF_DNS_HEADER_LENGTH 12
+// Without EDNS servers truncate UDP responses to 512 bytes
+#define FF_DNS_MAX_MESSAGE_LENGTH 512
+#define FF_DNS_MAX_CNAME_CHAIN 8
+#define FF_DNS_MAX_COMPRESSION_JUMPS 16
+// Used when a negative response has no SOA record
+#define FF_DNS_DEFAULT_NEGATIVE_TTL 30
+
+#define FF_DNS_TYPE_A 1
+#define FF_DNS_TYPE_CNAME 5
+#define FF_DNS_TYPE_SOA 6
+#define FF_DNS_TYPE_AAAA 28
+#define FF_DNS_CLASS_IN 1
+
+#define FF_DNS_FLAG_QR 0x8000
+#define FF_DNS_FLAG_TC 0x0200
+#define FF_DNS_FLAG_RD 0x0100
+#define FF_DNS_RCODE_MASK 0x000f
+#define FF_DNS_RCODE_NOERROR 0
+#define FF_DNS_RCODE_NXDOMAIN 3
+
+struct ff_dns_query
+{
+    uint16_t id;
+    uint16_t type;
+    bool answered;
+    struct ff_dns_result result;
+};
+
+/**
+ * Writes a recursive query for the name, returns the message length or 0 if the name is invalid
+ */
+size_t ff_dns_query_encode(uint16_t id, const char *name, uint16_t type, uint8_t *buff, size_t buff_length);
+
+/**
+ * Parses a response to the query, following CNAMEs from the queried name.
+ * Returns false if the message isn't a response to the query.
+ */
+bool ff_dns_response_parse(const uint8_t *message, size_t length, uint16_t id, const char *name, uint16_t type, struct ff_dns_result *result);
+
+/**
+ * Reads a possibly compressed name at offset into out (lower cased, without
+ * the trailing dot), advancing offset past it
+ */
+bool ff_dns_read_name(const uint8_t *message, size_t length, size_t *offset, char *out, size_t out_length);
+
+uint16_t ff_dns_read_uint16(const uint8_t *buff);
+
+uint32_t ff_dns_read_uint32(const uint8_t *buff);
+
+void ff_dns_write_uint16(uint8_t *buff, uint16_t value);
+
+/**
+ * Reads the record at offset, advancing offset past it. The owner is lower
+ * cased and type is 0 for records outside the IN class.
+ */
+bool ff_dns_read_record(
+    const uint8_t *message,
+    size_t length,
+    size_t *offset,
+    char *owner,
+    uint16_t *type,
+    uint32_t *ttl,
+    size_t *rdata_offset,
+    uint16_t *rdata_length);
+
+/**
+ * Opens a UDP socket connected to the server used for the attempt
+ */
+int ff_dns_open_socket(struct ff_dns_resolver *resolver, uint8_t attempt);
+
+bool ff_dns_parse_server(const char *server, struct sockaddr_storage *address, socklen_t *address_length);
+
+/**
+ * Reads the resolver's nameservers from resolv.conf, defaulting to the local host like libc
+ */
+void ff_dns_read_resolv_conf(const char *path, struct ff_dns_resolver *resolver);
+
+struct ff_dns_hosts_entry *ff_dns_read_hosts(const char *path);
+
+struct ff_dns_hosts_entry *ff_dns_hosts_find(struct ff_dns_hosts_entry *hosts, const char *name);
+
+void ff_dns_result_add(struct ff_dns_result *result, int family, const void *address);
+
+/**
+ * Merges the A and AAAA answers into one result
+ */
+void ff_dns_result_merge(struct ff_dns_query *queries, uint8_t length, struct ff_dns_result *result);
+
+#endif
@@ -0,0 +1,402 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include "event_loop.h"
+#include "event_loop_p.h"
+#include "logging.h"
+#include "alloc.h"
+
+struct ff_event_loop *ff_event_loop_init(void)
+{
+    struct ff_event_loop *loop = calloc(1, sizeof(struct ff_event_loop));
+    struct epoll_event event = {.events = EPOLLIN, .data.ptr = NULL};
+
+    loop->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    loop->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    pthread_mutex_init(&loop->mutex, NULL);
+
+    if (loop->epoll_fd < 0 || loop->wake_fd < 0 || epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, loop->wake_fd, &event) != 0)
+    {
+        ff_log(FF_ERROR, "Failed to create event loop (errno: %d)", errno);
+        goto error;
+    }
+
+    if (pthread_create(&loop->thread, NULL, ff_event_loop_run, (void *)loop) != 0)
+    {
+        ff_log(FF_ERROR, "Failed to start event loop thread");
+        goto error;
+    }
+
+    return loop;
+
+error:
+    if (loop->epoll_fd >= 0)
+    {
+        close(loop->epoll_fd);
+    }
+
+    if (loop->wake_fd >= 0)
+    {
+        close(loop->wake_fd);
+    }
+
+    pthread_mutex_destroy(&loop->mutex);
+    FREE(loop);
+
+    return NULL;
+}
+
+void *ff_event_loop_run(void *args)
+{
+    struct ff_event_loop *loop = (struct ff_event_loop *)args;
+    struct epoll_event events[FF_EVENT_LOOP_MAX_EVENTS];
+    struct ff_event_loop_watch *watch = NULL;
+    uint64_t wakes;
+    int length;
+
+    while (!loop->stopping)
+    {
+        length = epoll_wait(loop->epoll_fd, events, FF_EVENT_LOOP_MAX_EVENTS, ff_event_loop_timeout(loop));
+
+        if (length < 0 && errno != EINTR)
+        {
+            ff_log(FF_ERROR, "Event loop wait failed (errno: %d)", errno);
+            break;
+        }
+
+        loop->events = events;
+        loop->events_length = length < 0 ? 0 : length;
+
+        for (int i = 0; i < loop->events_length; i++)
+        {
+            if (events[i].data.ptr == NULL)
+            {
+                continue;
+            }
+
+            watch = (struct ff_event_loop_watch *)events[i].data.ptr;
+            watch->on_event(loop, events[i].events, watch->context);
+        }
+
+        loop->events = NULL;
+        loop->events_length = 0;
+
+        // Tasks are run for every wake up so a busy loop doesn't starve them
+        if (read(loop->wake_fd, &wakes, sizeof(wakes)) < 0 && errno != EAGAIN)
+        {
+            ff_log(FF_WARNING, "Failed to read event loop wake up (errno: %d)", errno);
+        }
+
+        ff_event_loop_run_tasks(loop);
+        ff_event_loop_run_timers(loop);
+    }
+
+    return NULL;
+}
+
+uint64_t ff_event_loop_clock(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (uint64_t)now.tv_sec * 1000 + (uint64_t)now.tv_nsec / 1000000;
+}
+
+int ff_event_loop_timeout(struct ff_event_loop *loop)
+{
+    uint64_t now;
+
+    if (loop->timers_length == 0)
+    {
+        return -1;
+    }
+
+    now = ff_event_loop_clock();
+
+    return loop->timers[0]->due <= now ? 0 : (int)(loop->timers[0]->due - now);
+}
+
+void ff_event_loop_watch_init(struct ff_event_loop_watch *watch, int fd, ff_event_loop_io_callback on_event, void *context)
+{
+    watch->fd = fd;
+    watch->on_event = on_event;
+    watch->context = context;
+    watch->added = false;
+}
+
+bool ff_event_loop_watch(struct ff_event_loop *loop, struct ff_event_loop_watch *watch, uint32_t events)
+{
+    struct epoll_event event = {.events = events, .data.ptr = watch};
+
+    if (epoll_ctl(loop->epoll_fd, watch->added ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, watch->fd, &event) != 0)
+    {
+        ff_log(FF_ERROR, "Failed to watch socket %d (errno: %d)", watch->fd, errno);
+        return false;
+    }
+
+    watch->added = true;
+
+    return true;
+}
+
+void ff_event_loop_unwatch(struct ff_event_loop *loop, struct ff_event_loop_watch *watch)
+{
+    if (!watch->added)
+    {
+        return;
+    }
+
+    epoll_ctl(loop->epoll_fd, EPOLL_CTL_DEL, watch->fd, NULL);
+    watch->added = false;
+
+    // The owner may free the watch before the rest of the batch is dispatched
+    for (int i = 0; i < loop->events_length; i++)
+    {
+        if (loop->events[i].data.ptr == watch)
+        {
+            loop->events[i].data.ptr = NULL;
+        }
+    }
+}
+
+void ff_event_loop_timer_init(struct ff_event_loop_timer *timer, ff_event_loop_callback on_expired, void *context)
+{
+    timer->due = 0;
+    timer->index = UINT32_MAX;
+    timer->on_expired = on_expired;
+    timer->context = context;
+}
+
+void ff_event_loop_timer_start(struct ff_event_loop *loop, struct ff_event_loop_timer *timer, uint64_t delay_ms)
+{
+    ff_event_loop_timer_stop(loop, timer);
+
+    if (loop->timers_length == loop->timers_capacity)
+    {
+        loop->timers_capacity = loop->timers_capacity == 0 ? 64 : loop->timers_capacity * 2;
+        loop->timers = realloc(loop->timers, loop->timers_capacity * sizeof(struct ff_event_loop_timer *));
+    }
+
+    timer->due = ff_event_loop_clock() + delay_ms;
+    timer->index = loop->timers_length++;
+    loop->timers[timer->index] = timer;
+
+    ff_event_loop_heap_up(loop, timer->index);
+}
+
+void ff_event_loop_timer_stop(struct ff_event_loop *loop, struct ff_event_loop_timer *timer)
+{
+    uint32_t index = timer->index;
+
+    if (index == UINT32_MAX)
+    {
+        return;
+    }
+
+    loop->timers_length--;
+
+    if (index != loop->timers_length)
+    {
+        ff_event_loop_heap_swap(loop, index, loop->timers_length);
+        ff_event_loop_heap_up(loop, index);
+        ff_event_loop_heap_down(loop, index);
+    }
+
+    timer->index = UINT32_MAX;
+}
+
+void ff_event_loop_run_timers(struct ff_event_loop *loop)
+{
+    struct ff_event_loop_timer *timer = NULL;
+    uint64_t now = ff_event_loop_clock();
+
+    while (loop->timers_length > 0 && loop->timers[0]->due <= now)
+    {
+        timer = loop->timers[0];
+        ff_event_loop_timer_stop(loop, timer);
+        timer->on_expired(loop, timer->context);
+    }
+}
+
+void ff_event_loop_heap_swap(struct ff_event_loop *loop, uint32_t a, uint32_t b)
+{
+    struct ff_event_loop_timer *timer = loop->timers[a];
+
+    loop->timers[a] = loop->timers[b];
+    loop->timers[b] = timer;
+    loop->timers[a]->index = a;
+    loop->timers[b]->index = b;
+}
+
+void ff_event_loop_heap_up(struct ff_event_loop *loop, uint32_t index)
+{
+    while (index > 0 && loop->timers[index]->due < loop->timers[(index - 1) / 2]->due)
+    {
+        ff_event_loop_heap_swap(loop, index, (index - 1) / 2);
+        index = (index - 1) / 2;
+    }
+}
+
+void ff_event_loop_heap_down(struct ff_event_loop *loop, uint32_t index)
+{
+    uint32_t smallest;
+
+    while (1)
+    {
+        smallest = index;
+
+        if (2 * index + 1 < loop->timers_length && loop->timers[2 * index + 1]->due < loop->timers[smallest]->due)
+        {
+            smallest = 2 * index + 1;
+        }
+
+        if (2 * index + 2 < loop->timers_length && loop->timers[2 * index + 2]->due < loop->timers[smallest]->due)
+        {
+            smallest = 2 * index + 2;
+        }
+
+        if (smallest == index)
+        {
+            break;
+        }
+
+        ff_event_loop_heap_swap(loop, index, smallest);
+        index = smallest;
+    }
+}
+
+void ff_event_loop_post(struct ff_event_loop *loop, ff_event_loop_callback run, void *context)
+{
+    struct ff_event_loop_task *task = malloc(sizeof(struct ff_event_loop_task));
+    uint64_t wake = 1;
+
+    task->run = run;
+    task->context = context;
+    task->next = NULL;
+
+    pthread_mutex_lock(&loop->mutex);
+
+    if (loop->tasks_last == NULL)
+    {
+        loop->tasks_first = task;
+    }
+    else
+    {
+        loop->tasks_last->next = task;
+    }
+
+    loop->tasks_last = task;
+
+    pthread_mutex_unlock(&loop->mutex);
+
+    if (write(loop->wake_fd, &wake, sizeof(wake)) < 0)
+    {
+        ff_log(FF_WARNING, "Failed to wake event loop (errno: %d)", errno);
+    }
+}
+
+void ff_event_loop_run_tasks(struct ff_event_loop *loop)
+{
+    struct ff_event_loop_task *task = NULL;
+    struct ff_event_loop_task *next = NULL;
+
+    pthread_mutex_lock(&loop->mutex);
+    task = loop->tasks_first;
+    loop->tasks_first = NULL;
+    loop->tasks_last = NULL;
+    pthread_mutex_unlock(&loop->mutex);
+
+    while (task != NULL)
+    {
+        next = task->next;
+        task->run(loop, task->context);
+        FREE(task);
+        task = next;
+    }
+}
+
+void ff_event_loop_call(struct ff_event_loop *loop, ff_event_loop_callback run, void *context)
+{
+    struct ff_event_loop_call_args args = {.run = run, .context = context, .done = false};
+
+    if (ff_event_loop_is_current(loop))
+    {
+        run(loop, context);
+        return;
+    }
+
+    pthread_mutex_init(&args.mutex, NULL);
+    pthread_cond_init(&args.called, NULL);
+
+    ff_event_loop_post(loop, ff_event_loop_run_call, (void *)&args);
+
+    pthread_mutex_lock(&args.mutex);
+
+    while (!args.done)
+    {
+        pthread_cond_wait(&args.called, &args.mutex);
+    }
+
+    pthread_mutex_unlock(&args.mutex);
+
+    pthread_cond_destroy(&args.called);
+    pthread_mutex_destroy(&args.mutex);
+}
+
+void ff_event_loop_run_call(struct ff_event_loop *loop, void *context)
+{
+    struct ff_event_loop_call_args *args = (struct ff_event_loop_call_args *)context;
+
+    args->run(loop, args->context);
+
+    pthread_mutex_lock(&args->mutex);
+    args->done = true;
+    pthread_cond_signal(&args->called);
+    pthread_mutex_unlock(&args->mutex);
+}
+
+bool ff_event_loop_is_current(struct ff_event_loop *loop)
+{
+    return pthread_equal(pthread_self(), loop->thread);
+}
+
+void ff_event_loop_stop(struct ff_event_loop *loop, void *context)
+{
+    (void)context;
+
+    loop->stopping = true;
+}
+
+void ff_event_loop_free(struct ff_event_loop *loop)
+{
+    struct ff_event_loop_task *task = NULL;
+
+    if (loop == NULL)
+    {
+        return;
+    }
+
+    ff_event_loop_post(loop, ff_event_loop_stop, NULL);
+    pthread_join(loop->thread, NULL);
+
+    while ((task = loop->tasks_first) != NULL)
+    {
+        loop->tasks_first = task->next;
+        FREE(task);
+    }
+
+    close(loop->epoll_fd);
+    close(loop->wake_fd);
+    pthread_mutex_destroy(&loop->mutex);
+    FREE(loop->timers);
+    FREE(loop);
+}
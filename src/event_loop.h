@@ -0,0 +1,109 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+
+#ifndef FF_EVENT_LOOP_H
+#define FF_EVENT_LOOP_H
+
+#define FF_EVENT_LOOP_MAX_EVENTS 64
+
+struct ff_event_loop;
+
+typedef void (*ff_event_loop_io_callback)(struct ff_event_loop *loop, uint32_t events, void *context);
+
+typedef void (*ff_event_loop_callback)(struct ff_event_loop *loop, void *context);
+
+/**
+ * A file descriptor registered with a loop. Watches and timers are embedded
+ * in their owner's state so a loop with many connections doesn't allocate
+ * per event.
+ */
+struct ff_event_loop_watch
+{
+    int fd;
+    ff_event_loop_io_callback on_event;
+    void *context;
+    bool added;
+};
+
+struct ff_event_loop_timer
+{
+    // Milliseconds on the loop's monotonic clock
+    uint64_t due;
+    // Position in the loop's timer heap, UINT32_MAX when not scheduled
+    uint32_t index;
+    ff_event_loop_callback on_expired;
+    void *context;
+};
+
+struct ff_event_loop_task
+{
+    ff_event_loop_callback run;
+    void *context;
+    struct ff_event_loop_task *next;
+};
+
+/**
+ * An epoll loop running on its own thread. Watches and timers belong to
+ * the loop's thread, other threads hand it work with ff_event_loop_post.
+ */
+struct ff_event_loop
+{
+    int epoll_fd;
+    // eventfd woken when tasks are posted
+    int wake_fd;
+    pthread_t thread;
+    bool stopping;
+    struct ff_event_loop_timer **timers;
+    uint32_t timers_length;
+    uint32_t timers_capacity;
+    // The epoll batch being dispatched, cleared of watches removed mid batch
+    struct epoll_event *events;
+    int events_length;
+    struct ff_event_loop_task *tasks_first;
+    struct ff_event_loop_task *tasks_last;
+    pthread_mutex_t mutex;
+};
+
+struct ff_event_loop *ff_event_loop_init(void);
+
+void ff_event_loop_watch_init(struct ff_event_loop_watch *watch, int fd, ff_event_loop_io_callback on_event, void *context);
+
+/**
+ * Starts or changes the events (EPOLLIN, EPOLLOUT) reported for the watch
+ */
+bool ff_event_loop_watch(struct ff_event_loop *loop, struct ff_event_loop_watch *watch, uint32_t events);
+
+/**
+ * Stops reporting events for the watch, it may be freed once this returns
+ */
+void ff_event_loop_unwatch(struct ff_event_loop *loop, struct ff_event_loop_watch *watch);
+
+void ff_event_loop_timer_init(struct ff_event_loop_timer *timer, ff_event_loop_callback on_expired, void *context);
+
+/**
+ * (Re)schedules the timer to fire once after delay_ms
+ */
+void ff_event_loop_timer_start(struct ff_event_loop *loop, struct ff_event_loop_timer *timer, uint64_t delay_ms);
+
+void ff_event_loop_timer_stop(struct ff_event_loop *loop, struct ff_event_loop_timer *timer);
+
+/**
+ * Runs the function on the loop's thread, callable from any thread
+ */
+void ff_event_loop_post(struct ff_event_loop *loop, ff_event_loop_callback run, void *context);
+
+/**
+ * Runs the function on the loop's thread and waits for it to return
+ */
+void ff_event_loop_call(struct ff_event_loop *loop, ff_event_loop_callback run, void *context);
+
+bool ff_event_loop_is_current(struct ff_event_loop *loop);
+
+/**
+ * Stops the loop's thread, tasks posted but not yet run are dropped
+ */
+void ff_event_loop_free(struct ff_event_loop *loop);
+
+#endif
@@ -0,0 +1,41 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include "event_loop.h"
+
+#ifndef FF_EVENT_LOOP_P_H
+#define FF_EVENT_LOOP_P_H
+
+struct ff_event_loop_call_args
+{
+    ff_event_loop_callback run;
+    void *context;
+    bool done;
+    pthread_mutex_t mutex;
+    pthread_cond_t called;
+};
+
+void *ff_event_loop_run(void *args);
+
+uint64_t ff_event_loop_clock(void);
+
+/**
+ * The epoll_wait timeout until the earliest timer is due
+ */
+int ff_event_loop_timeout(struct ff_event_loop *loop);
+
+void ff_event_loop_run_tasks(struct ff_event_loop *loop);
+
+void ff_event_loop_run_timers(struct ff_event_loop *loop);
+
+void ff_event_loop_heap_swap(struct ff_event_loop *loop, uint32_t a, uint32_t b);
+
+void ff_event_loop_heap_up(struct ff_event_loop *loop, uint32_t index);
+
+void ff_event_loop_heap_down(struct ff_event_loop *loop, uint32_t index);
+
+void ff_event_loop_run_call(struct ff_event_loop *loop, void *context);
+
+void ff_event_loop_stop(struct ff_event_loop *loop, void *context);
+
+#endif
@@ -0,0 +1,27 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include "fnv.h"
+
+uint64_t ff_fnv_update(uint64_t hash, const void *data, size_t length)
+{
+    const uint8_t *bytes = (const uint8_t *)data;
+
+    for (size_t i = 0; i < length; i++)
+    {
+        hash ^= bytes[i];
+        hash *= FF_FNV_PRIME;
+    }
+
+    return hash;
+}
+
+uint64_t ff_fnv_hash(const void *data, size_t length)
+{
+    return ff_fnv_update(FF_FNV_OFFSET, data, length);
+}
+
+uint64_t ff_fnv_hash_string(const char *string)
+{
+    return ff_fnv_update(FF_FNV_OFFSET, string, strlen(string));
+}
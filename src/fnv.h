@@ -0,0 +1,20 @@
+#include <stdint.h>
+#include <stddef.h>
+
+#ifndef FF_FNV_H
+#define FF_FNV_H
+
+#define FF_FNV_OFFSET 0xcbf29ce484222325ULL
+#define FF_FNV_PRIME 0x100000001b3ULL
+
+/**
+ * 64 bit FNV-1a, a fast unkeyed hash for lookups in tables of names and
+ * addresses. Bytes are folded into a hash started from FF_FNV_OFFSET.
+ */
+uint64_t ff_fnv_update(uint64_t hash, const void *data, size_t length);
+
+uint64_t ff_fnv_hash(const void *data, size_t length);
+
+uint64_t ff_fnv_hash_string(const char *string);
+
+#endif
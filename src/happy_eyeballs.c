@@ -0,0 +1,342 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include "happy_eyeballs.h"
+#include "happy_eyeballs_p.h"
+#include "logging.h"
+#include "stats.h"
+#include "alloc.h"
+
+struct ff_happy_eyeballs *ff_happy_eyeballs_init(uint32_t capacity, uint32_t attempt_delay_ms)
+{
+    struct ff_happy_eyeballs *eyeballs = calloc(1, sizeof(struct ff_happy_eyeballs));
+
+    eyeballs->attempt_delay_ms = attempt_delay_ms;
+    eyeballs->hosts = ff_lru_table_init(capacity, NULL, ff_happy_eyeballs_host_free);
+    pthread_mutex_init(&eyeballs->mutex, NULL);
+
+    return eyeballs;
+}
+
+void ff_happy_eyeballs_sort(struct ff_happy_eyeballs *eyeballs, const char *host, struct ff_dns_result *result)
+{
+    struct sockaddr_storage sorted[FF_DNS_MAX_ADDRESSES];
+    bool used[FF_DNS_MAX_ADDRESSES] = {false};
+    struct ff_happy_eyeballs_host *entry = NULL;
+    sa_family_t family = AF_INET6;
+    uint8_t length = 0;
+
+    if (eyeballs == NULL)
+    {
+        result->length = result->length > 1 ? 1 : result->length;
+        return;
+    }
+
+    pthread_mutex_lock(&eyeballs->mutex);
+
+    entry = ff_happy_eyeballs_find(eyeballs, host);
+
+    for (uint8_t i = 0; entry != NULL && i < result->length; i++)
+    {
+        if (ff_happy_eyeballs_address_equal(&result->addresses[i], &entry->address))
+        {
+            sorted[length++] = result->addresses[i];
+            used[i] = true;
+            family = result->addresses[i].ss_family == AF_INET6 ? AF_INET : AF_INET6;
+            break;
+        }
+    }
+
+    pthread_mutex_unlock(&eyeballs->mutex);
+
+    while (length < result->length)
+    {
+        uint8_t next = FF_DNS_MAX_ADDRESSES;
+
+        // The next address of the other family, or any left once a family runs out
+        for (uint8_t i = 0; i < result->length; i++)
+        {
+            if (!used[i] && (next == FF_DNS_MAX_ADDRESSES || result->addresses[i].ss_family == family))
+            {
+                next = i;
+
+                if (result->addresses[i].ss_family == family)
+                {
+                    break;
+                }
+            }
+        }
+
+        sorted[length++] = result->addresses[next];
+        used[next] = true;
+        family = result->addresses[next].ss_family == AF_INET6 ? AF_INET : AF_INET6;
+    }
+
+    memcpy(result->addresses, sorted, length * sizeof(struct sockaddr_storage));
+}
+
+void ff_happy_eyeballs_record(struct ff_happy_eyeballs *eyeballs, const char *host, struct sockaddr_storage *address)
+{
+    struct ff_happy_eyeballs_host *entry = NULL;
+
+    if (eyeballs == NULL || eyeballs->hosts->capacity == 0)
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&eyeballs->mutex);
+
+    entry = ff_happy_eyeballs_touch(eyeballs, host);
+    entry->address = *address;
+
+    if (address->ss_family == AF_INET)
+    {
+        ((struct sockaddr_in *)&entry->address)->sin_port = 0;
+    }
+    else
+    {
+        ((struct sockaddr_in6 *)&entry->address)->sin6_port = 0;
+    }
+
+    pthread_mutex_unlock(&eyeballs->mutex);
+}
+
+bool ff_happy_eyeballs_racing(struct ff_dns_result *result)
+{
+    return result->length > 1;
+}
+
+int ff_happy_eyeballs_attempt(struct sockaddr_storage *address, socklen_t address_length, ff_happy_eyeballs_prepare prepare, void *context, bool *connected)
+{
+    int sockfd = socket(address->ss_family, SOCK_STREAM | SOCK_NONBLOCK, 0);
+
+    *connected = false;
+
+    if (sockfd < 0)
+    {
+        ff_log(FF_ERROR, "Failed to open socket");
+        return -1;
+    }
+
+    if (prepare != NULL)
+    {
+        prepare(sockfd, address, context);
+    }
+
+    FF_STATS_INC(upstream_connect_attempts);
+
+    if (connect(sockfd, (struct sockaddr *)address, address_length) == 0)
+    {
+        *connected = true;
+        return sockfd;
+    }
+
+    if (errno == EINPROGRESS)
+    {
+        return sockfd;
+    }
+
+    // Addresses of a family without a route fail straight away
+    close(sockfd);
+
+    return -1;
+}
+
+int ff_happy_eyeballs_connect(
+    struct ff_happy_eyeballs *eyeballs,
+    const char *host,
+    struct ff_dns_result *result,
+    uint16_t port,
+    uint32_t timeout_ms,
+    ff_happy_eyeballs_prepare prepare,
+    void *context,
+    struct sockaddr_storage *address,
+    socklen_t *address_length)
+{
+    struct pollfd fds[FF_DNS_MAX_ADDRESSES];
+    uint8_t indexes[FF_DNS_MAX_ADDRESSES];
+    struct sockaddr_storage attempt_address;
+    socklen_t attempt_length;
+    nfds_t active = 0;
+    uint8_t next = 0;
+    int winner = -1;
+    int sockfd = -1;
+    bool connected = false;
+    int error;
+    socklen_t error_length;
+    uint32_t attempt_delay_ms = eyeballs == NULL ? timeout_ms : eyeballs->attempt_delay_ms;
+    uint64_t now = ff_happy_eyeballs_now_ms();
+    uint64_t deadline = now + timeout_ms;
+    uint64_t next_attempt = now;
+    uint64_t wait_ms;
+
+    while (winner < 0)
+    {
+        now = ff_happy_eyeballs_now_ms();
+
+        // The next attempt starts once the delay has passed, or straight away when the others have failed
+        while (winner < 0 && next < result->length && (active == 0 || now >= next_attempt))
+        {
+            ff_dns_result_address(result, next, port, &attempt_address, &attempt_length);
+
+            if ((sockfd = ff_happy_eyeballs_attempt(&attempt_address, attempt_length, prepare, context, &connected)) < 0)
+            {
+                next++;
+                next_attempt = now;
+                continue;
+            }
+
+            if (connected)
+            {
+                winner = next++;
+                break;
+            }
+
+            fds[active] = (struct pollfd){.fd = sockfd, .events = POLLOUT};
+            indexes[active++] = next++;
+            next_attempt = now + attempt_delay_ms;
+        }
+
+        if (winner >= 0)
+        {
+            break;
+        }
+
+        if (active == 0 || now >= deadline)
+        {
+            goto error;
+        }
+
+        wait_ms = deadline - now;
+
+        if (next < result->length && next_attempt - now < wait_ms)
+        {
+            wait_ms = next_attempt - now;
+        }
+
+        if (poll(fds, active, (int)wait_ms) < 0 && errno != EINTR)
+        {
+            goto error;
+        }
+
+        for (nfds_t i = 0; i < active; i++)
+        {
+            if (fds[i].revents == 0)
+            {
+                continue;
+            }
+
+            error = 0;
+            error_length = sizeof(error);
+
+            if (getsockopt(fds[i].fd, SOL_SOCKET, SO_ERROR, (void *)&error, &error_length) == 0 && error == 0)
+            {
+                winner = indexes[i];
+                sockfd = fds[i].fd;
+                fds[i] = fds[--active];
+                indexes[i] = indexes[active];
+                break;
+            }
+
+            close(fds[i].fd);
+            fds[i] = fds[--active];
+            indexes[i] = indexes[active];
+            next_attempt = now;
+            i--;
+        }
+    }
+
+    for (nfds_t i = 0; i < active; i++)
+    {
+        close(fds[i].fd);
+    }
+
+    fcntl(sockfd, F_SETFL, fcntl(sockfd, F_GETFL) & ~O_NONBLOCK);
+    ff_dns_result_address(result, (uint8_t)winner, port, address, address_length);
+    ff_happy_eyeballs_record(eyeballs, host, address);
+
+    if (winner != 0)
+    {
+        ff_log(FF_DEBUG, "Connected to %s with its address %d after earlier addresses were slow or failed", host, winner);
+        FF_STATS_INC(upstream_connect_fallbacks);
+    }
+
+    return sockfd;
+
+error:
+    for (nfds_t i = 0; i < active; i++)
+    {
+        close(fds[i].fd);
+    }
+
+    return -1;
+}
+
+bool ff_happy_eyeballs_address_equal(struct sockaddr_storage *a, struct sockaddr_storage *b)
+{
+    if (a->ss_family != b->ss_family)
+    {
+        return false;
+    }
+
+    if (a->ss_family == AF_INET)
+    {
+        return memcmp(&((struct sockaddr_in *)a)->sin_addr, &((struct sockaddr_in *)b)->sin_addr, sizeof(struct in_addr)) == 0;
+    }
+
+    return memcmp(&((struct sockaddr_in6 *)a)->sin6_addr, &((struct sockaddr_in6 *)b)->sin6_addr, sizeof(struct in6_addr)) == 0;
+}
+
+uint64_t ff_happy_eyeballs_now_ms(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (uint64_t)now.tv_sec * 1000 + (uint64_t)now.tv_nsec / 1000000;
+}
+
+struct ff_happy_eyeballs_host *ff_happy_eyeballs_find(struct ff_happy_eyeballs *eyeballs, const char *name)
+{
+    return (struct ff_happy_eyeballs_host *)ff_lru_table_find_string(eyeballs->hosts, name);
+}
+
+struct ff_happy_eyeballs_host *ff_happy_eyeballs_touch(struct ff_happy_eyeballs *eyeballs, const char *name)
+{
+    struct ff_happy_eyeballs_host *entry = ff_happy_eyeballs_find(eyeballs, name);
+
+    if (entry != NULL)
+    {
+        ff_lru_table_touch(eyeballs->hosts, &entry->lru);
+        return entry;
+    }
+
+    return (struct ff_happy_eyeballs_host *)ff_lru_table_insert_string(eyeballs->hosts, name, sizeof(struct ff_happy_eyeballs_host));
+}
+
+void ff_happy_eyeballs_host_free(struct ff_lru_table_entry *entry)
+{
+    FREE(entry);
+}
+
+void ff_happy_eyeballs_free(struct ff_happy_eyeballs *eyeballs)
+{
+    if (eyeballs == NULL)
+    {
+        return;
+    }
+
+    ff_lru_table_free(eyeballs->hosts);
+    pthread_mutex_destroy(&eyeballs->mutex);
+    FREE(eyeballs);
+}
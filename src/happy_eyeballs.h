@@ -0,0 +1,85 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include "dns.h"
+#include "lru_table.h"
+
+#ifndef FF_HAPPY_EYEBALLS_H
+#define FF_HAPPY_EYEBALLS_H
+
+struct ff_happy_eyeballs_host
+{
+    // Keyed by host name
+    struct ff_lru_table_entry lru;
+    // The address the last connection to the host was established with, port 0
+    struct sockaddr_storage address;
+};
+
+/**
+ * Connects to hosts with several addresses by racing them (RFC 8305),
+ * starting an attempt every attempt delay until one is established, so a
+ * blackholed address costs a delay rather than the kernel's connect
+ * timeout. The address each host last connected with is attempted first.
+ * Bounded by host count with least recently used eviction.
+ */
+struct ff_happy_eyeballs
+{
+    // Milliseconds between starting attempts
+    uint32_t attempt_delay_ms;
+    struct ff_lru_table *hosts;
+    pthread_mutex_t mutex;
+};
+
+/**
+ * Called with each attempt's socket before it connects
+ */
+typedef void (*ff_happy_eyeballs_prepare)(int sockfd, struct sockaddr_storage *address, void *context);
+
+struct ff_happy_eyeballs *ff_happy_eyeballs_init(uint32_t capacity, uint32_t attempt_delay_ms);
+
+/**
+ * Orders the host's addresses to be attempted, the address last connected
+ * with first, then alternating address families starting with its family,
+ * or IPv6 without one. eyeballs NULL = only the first address is kept.
+ */
+void ff_happy_eyeballs_sort(struct ff_happy_eyeballs *eyeballs, const char *host, struct ff_dns_result *result);
+
+/**
+ * Remembers the address a connection to the host was established with
+ */
+void ff_happy_eyeballs_record(struct ff_happy_eyeballs *eyeballs, const char *host, struct sockaddr_storage *address);
+
+/**
+ * Returns true if the sorted addresses will be raced. With a TCP Fast Open
+ * cookie cached connect() returns straight away without sending a SYN, so
+ * such an attempt would win the race whether or not its address is
+ * reachable. Fast open is only used when there's no race.
+ */
+bool ff_happy_eyeballs_racing(struct ff_dns_result *result);
+
+/**
+ * Opens a non-blocking socket and starts connecting to the address, returns
+ * -1 if it failed straight away. connected is set if connect() completed.
+ */
+int ff_happy_eyeballs_attempt(struct sockaddr_storage *address, socklen_t address_length, ff_happy_eyeballs_prepare prepare, void *context, bool *connected);
+
+/**
+ * Races blocking connections to the sorted addresses, returning the first
+ * established socket, in blocking mode, or -1 if none could be within
+ * timeout_ms. The winning address is copied to address.
+ */
+int ff_happy_eyeballs_connect(
+    struct ff_happy_eyeballs *eyeballs,
+    const char *host,
+    struct ff_dns_result *result,
+    uint16_t port,
+    uint32_t timeout_ms,
+    ff_happy_eyeballs_prepare prepare,
+    void *context,
+    struct sockaddr_storage *address,
+    socklen_t *address_length);
+
+void ff_happy_eyeballs_free(struct ff_happy_eyeballs *eyeballs);
+
+#endif
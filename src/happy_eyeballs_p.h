@@ -0,0 +1,24 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include "happy_eyeballs.h"
+
+#ifndef FF_HAPPY_EYEBALLS_P_H
+#define FF_HAPPY_EYEBALLS_P_H
+
+struct ff_happy_eyeballs_host *ff_happy_eyeballs_find(struct ff_happy_eyeballs *eyeballs, const char *name);
+
+/**
+ * Finds the host's entry, inserting one if missing, and marks it most recently used
+ */
+struct ff_happy_eyeballs_host *ff_happy_eyeballs_touch(struct ff_happy_eyeballs *eyeballs, const char *name);
+
+void ff_happy_eyeballs_host_free(struct ff_lru_table_entry *entry);
+
+/**
+ * Compares the addresses ignoring their ports
+ */
+bool ff_happy_eyeballs_address_equal(struct sockaddr_storage *a, struct sockaddr_storage *b);
+
+uint64_t ff_happy_eyeballs_now_ms(void);
+
+#endif
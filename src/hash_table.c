@@ -29,6 +29,10 @@ struct ff_hash_table *ff_hash_table_init(uint8_t prefix_bit_length)
     hash_table->linked_list = NULL;
     hash_table->linked_list_last = NULL;
 
+    hash_table->epoch = 0;
+    hash_table->snapshots = NULL;
+    hash_table->retired = NULL;
+
     return hash_table;
 }
 
@@ -192,26 +196,7 @@ void ff_hash_table_remove_item(struct ff_hash_table *hash_table, uint64_t item_i
                 buckets->nodes = node->next;
             }
 
-            // Remove from global linked list
-            if (node->prev_in_list != NULL)
-            {
-                node->prev_in_list->next_in_list = node->next_in_list;
-            }
-
-            if (node->next_in_list != NULL)
-            {
-                node->next_in_list->prev_in_list = node->prev_in_list;
-            }
-
-            if (hash_table->linked_list == node)
-            {
-                hash_table->linked_list = node->next_in_list;
-            }
-
-            if (hash_table->linked_list_last == node)
-            {
-                hash_table->linked_list_last = node->prev_in_list;
-            }
+            ff_hash_table_unlink_from_list(hash_table, node);
 
             hash_table->length--;
             FREE(node);
@@ -263,9 +248,48 @@ void ff_hash_table_remove_item(struct ff_hash_table *hash_table, uint64_t item_i
     FREE(bucket_list);
 }
 
+void ff_hash_table_unlink_from_list(struct ff_hash_table *hash_table, struct ff_hash_table_node *node)
+{
+    // Step active snapshots back so they continue from the following node
+    for (struct ff_hash_table_snapshot *snapshot = hash_table->snapshots; snapshot != NULL; snapshot = snapshot->next)
+    {
+        if (snapshot->current_node == node)
+        {
+            snapshot->current_node = node->prev_in_list;
+            snapshot->started = node->prev_in_list != NULL;
+        }
+
+        if (snapshot->last_node == node)
+        {
+            snapshot->last_node = node->prev_in_list;
+        }
+    }
+
+    if (node->prev_in_list != NULL)
+    {
+        node->prev_in_list->next_in_list = node->next_in_list;
+    }
+
+    if (node->next_in_list != NULL)
+    {
+        node->next_in_list->prev_in_list = node->prev_in_list;
+    }
+
+    if (hash_table->linked_list == node)
+    {
+        hash_table->linked_list = node->next_in_list;
+    }
+
+    if (hash_table->linked_list_last == node)
+    {
+        hash_table->linked_list_last = node->prev_in_list;
+    }
+}
+
 void ff_hash_table_free(struct ff_hash_table *hash_table)
 {
     ff_hash_table_free_bucket_level(hash_table->bucket_levels, hash_table->buckets);
+    ff_hash_table_free_retired(ff_hash_table_reclaim(hash_table, true));
 
     FREE(hash_table);
 }
@@ -303,6 +327,154 @@ void ff_hash_table_iterator_free(struct ff_hash_table_iterator *iterator)
     pthread_mutex_unlock(&ff_hash_table_data_mutex);
 }
 
+struct ff_hash_table_snapshot *ff_hash_table_snapshot_init(struct ff_hash_table *hash_table)
+{
+    struct ff_hash_table_snapshot *snapshot = calloc(1, sizeof(struct ff_hash_table_snapshot));
+
+    pthread_mutex_lock(&ff_hash_table_data_mutex);
+
+    snapshot->hash_table = hash_table;
+    snapshot->epoch = hash_table->epoch++;
+    snapshot->current_node = NULL;
+    // Items are appended to the list so anything after the current last item was inserted after the snapshot
+    snapshot->last_node = hash_table->linked_list_last;
+    snapshot->started = false;
+    snapshot->next = hash_table->snapshots;
+    hash_table->snapshots = snapshot;
+
+    pthread_mutex_unlock(&ff_hash_table_data_mutex);
+
+    return snapshot;
+}
+
+void *ff_hash_table_snapshot_next(struct ff_hash_table_snapshot *snapshot, uint64_t *item_id)
+{
+    void *value = NULL;
+
+    pthread_mutex_lock(&ff_hash_table_data_mutex);
+
+    if (snapshot->last_node == NULL || (snapshot->started && snapshot->current_node == snapshot->last_node))
+    {
+        goto cleanup;
+    }
+
+    if (!snapshot->started)
+    {
+        snapshot->current_node = snapshot->hash_table->linked_list;
+        snapshot->started = true;
+    }
+    else
+    {
+        snapshot->current_node = snapshot->current_node->next_in_list;
+    }
+
+    value = snapshot->current_node->value;
+
+    if (item_id != NULL)
+    {
+        *item_id = snapshot->current_node->item_id;
+    }
+
+cleanup:
+    pthread_mutex_unlock(&ff_hash_table_data_mutex);
+
+    return value;
+}
+
+void ff_hash_table_snapshot_free(struct ff_hash_table_snapshot *snapshot)
+{
+    struct ff_hash_table *hash_table = snapshot->hash_table;
+    struct ff_hash_table_retired *retired = NULL;
+
+    pthread_mutex_lock(&ff_hash_table_data_mutex);
+
+    struct ff_hash_table_snapshot **link = &hash_table->snapshots;
+
+    while (*link != snapshot)
+    {
+        link = &(*link)->next;
+    }
+
+    *link = snapshot->next;
+    retired = ff_hash_table_reclaim(hash_table, false);
+
+    pthread_mutex_unlock(&ff_hash_table_data_mutex);
+
+    ff_hash_table_free_retired(retired);
+    FREE(snapshot);
+}
+
+void ff_hash_table_retire_value(struct ff_hash_table *hash_table, void *value, ff_hash_table_value_free free_value)
+{
+    pthread_mutex_lock(&ff_hash_table_data_mutex);
+
+    if (hash_table->snapshots != NULL)
+    {
+        // Snapshots taken before now may still return this value
+        struct ff_hash_table_retired *retired = malloc(sizeof(struct ff_hash_table_retired));
+        retired->epoch = hash_table->epoch;
+        retired->value = value;
+        retired->free_value = free_value;
+        retired->next = hash_table->retired;
+        hash_table->retired = retired;
+        value = NULL;
+    }
+
+    pthread_mutex_unlock(&ff_hash_table_data_mutex);
+
+    if (value != NULL)
+    {
+        free_value(value);
+    }
+}
+
+struct ff_hash_table_retired *ff_hash_table_reclaim(struct ff_hash_table *hash_table, bool force)
+{
+    uint64_t min_epoch = UINT64_MAX;
+    struct ff_hash_table_retired *reclaimed = NULL;
+    struct ff_hash_table_retired **link = &hash_table->retired;
+
+    for (struct ff_hash_table_snapshot *snapshot = hash_table->snapshots; snapshot != NULL; snapshot = snapshot->next)
+    {
+        if (snapshot->epoch < min_epoch)
+        {
+            min_epoch = snapshot->epoch;
+        }
+    }
+
+    // A value retired at epoch E is only visible to snapshots with an epoch below E
+    while (*link != NULL)
+    {
+        struct ff_hash_table_retired *retired = *link;
+
+        if (force || retired->epoch <= min_epoch)
+        {
+            *link = retired->next;
+            retired->next = reclaimed;
+            reclaimed = retired;
+        }
+        else
+        {
+            link = &retired->next;
+        }
+    }
+
+    return reclaimed;
+}
+
+void ff_hash_table_free_retired(struct ff_hash_table_retired *retired)
+{
+    struct ff_hash_table_retired *next = NULL;
+
+    while (retired != NULL)
+    {
+        next = retired->next;
+        retired->free_value(retired->value);
+        FREE(retired);
+        retired = next;
+    }
+}
+
 void ff_hash_table_free_bucket_level(uint8_t bucket_levels, union ff_hash_table_bucket *bucket)
 {
     assert(bucket_levels > 0);
@@ -5,6 +5,8 @@
 #ifndef FF_HASH_TABLE_H
 #define FF_HASH_TABLE_H
 
+typedef void (*ff_hash_table_value_free)(void *value);
+
 struct ff_hash_table
 {
     const uint8_t prefix_bit_length;
@@ -13,6 +15,11 @@ struct ff_hash_table
     union ff_hash_table_bucket *buckets;
     struct ff_hash_table_node *linked_list;
     struct ff_hash_table_node *linked_list_last;
+    // Incremented each time a snapshot is taken
+    uint64_t epoch;
+    struct ff_hash_table_snapshot *snapshots;
+    // Values retired while snapshots were active, freed once those snapshots are freed
+    struct ff_hash_table_retired *retired;
 };
 
 struct ff_hash_table_iterator
@@ -22,6 +29,26 @@ struct ff_hash_table_iterator
     bool started;
 };
 
+/**
+ * A snapshot iterates the items present when it was taken without holding
+ * the table lock between calls, so inserts and removes proceed during a scan.
+ *
+ * - Items inserted after the snapshot was taken are never returned
+ * - Items removed before the snapshot reaches them are skipped
+ * - Items whose value is replaced are returned with the latest value
+ * - Values passed to ff_hash_table_retire_value remain valid until every
+ *   snapshot which could have returned them has been freed
+ */
+struct ff_hash_table_snapshot
+{
+    struct ff_hash_table *hash_table;
+    uint64_t epoch;
+    struct ff_hash_table_node *current_node;
+    struct ff_hash_table_node *last_node;
+    bool started;
+    struct ff_hash_table_snapshot *next;
+};
+
 struct ff_hash_table *ff_hash_table_init(uint8_t prefix_bit_length);
 
 void *ff_hash_table_get_item(struct ff_hash_table *, uint64_t item_id);
@@ -36,6 +63,14 @@ void *ff_hash_table_iterator_next(struct ff_hash_table_iterator *);
 
 void ff_hash_table_iterator_free(struct ff_hash_table_iterator *);
 
+struct ff_hash_table_snapshot *ff_hash_table_snapshot_init(struct ff_hash_table *);
+
+void *ff_hash_table_snapshot_next(struct ff_hash_table_snapshot *, uint64_t *item_id);
+
+void ff_hash_table_snapshot_free(struct ff_hash_table_snapshot *);
+
+void ff_hash_table_retire_value(struct ff_hash_table *, void *value, ff_hash_table_value_free free_value);
+
 void ff_hash_table_free(struct ff_hash_table *);
 
 #endif
\ No newline at end of file
@@ -19,6 +19,14 @@ struct ff_hash_table_node
     struct ff_hash_table_node *next_in_list;
 };
 
+struct ff_hash_table_retired
+{
+    uint64_t epoch;
+    void *value;
+    ff_hash_table_value_free free_value;
+    struct ff_hash_table_retired *next;
+};
+
 union ff_hash_table_bucket *ff_hash_table_init_bucket();
 
 union ff_hash_table_bucket *ff_hash_table_get_or_create_bucket(
@@ -29,4 +37,10 @@ union ff_hash_table_bucket *ff_hash_table_get_or_create_bucket(
 
 void ff_hash_table_free_bucket_level(uint8_t bucket_levels, union ff_hash_table_bucket *bucket);
 
+void ff_hash_table_unlink_from_list(struct ff_hash_table *hash_table, struct ff_hash_table_node *node);
+
+struct ff_hash_table_retired *ff_hash_table_reclaim(struct ff_hash_table *hash_table, bool force);
+
+void ff_hash_table_free_retired(struct ff_hash_table_retired *retired);
+
 #endif
\ No newline at end of file
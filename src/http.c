@@ -5,20 +5,62 @@
 #include <string.h>
 #include <ctype.h>
 #include <unistd.h>
+#include <errno.h>
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <netdb.h>
 #include <arpa/inet.h>
 #include <math.h>
+#include <pthread.h>
 #include <openssl/ssl.h>
 #include <openssl/err.h>
 #include "alloc.h"
 #include "http.h"
 #include "http_p.h"
 #include "logging.h"
-
-void ff_http_send_request(struct ff_request *request)
+#include "stats.h"
+#include "tls_session_cache.h"
+#include "http_response.h"
+#include "connection_pool.h"
+#include "dns_cache.h"
+#include "http_completion.h"
+#include "http_engine.h"
+#include "tcp_fastopen.h"
+#include "happy_eyeballs.h"
+
+// Parsing the trust store is far more expensive than the handshake itself so it's shared by every request
+static SSL_CTX *ff_http_tls_context = NULL;
+static char *ff_http_tls_ca_bundle = NULL;
+static pthread_mutex_t ff_http_tls_context_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct ff_tls_session_cache *ff_http_tls_sessions = NULL;
+// Idle keep-alive connections to plain HTTP upstreams, keyed by resolved address and port
+static struct ff_connection_pool *ff_http_connections = NULL;
+// Established and verified connections to HTTPS upstreams, keyed by host and port
+static struct ff_connection_pool *ff_http_tls_connections = NULL;
+// Upstream host names resolved with their TTLs, NULL = getaddrinfo on every request
+static struct ff_dns_cache *ff_http_dns = NULL;
+static enum ff_http_completion_policy ff_http_completion = FF_HTTP_COMPLETION_RESPONSE;
+static uint32_t ff_http_completion_timeout_ms = FF_HTTP_RESPONSE_MAX_WAIT_SECS * 1000;
+// Reads status lines in the background for FF_HTTP_COMPLETION_DRAIN
+static struct ff_http_drainer *ff_http_drainer = NULL;
+// Forwards requests sent with ff_http_send_request_async, NULL = on the calling thread
+static struct ff_http_engine *ff_http_engine = NULL;
+// Plain HTTP upstreams TCP Fast Open is attempted with, NULL = disabled
+static struct ff_tcp_fastopen *ff_http_fastopen = NULL;
+// Comma separated HTTPS hosts safe requests are sent to as early data, NULL = disabled
+static char *ff_http_early_data_hosts = NULL;
+// Comma separated HTTPS hosts forwarded requests are multiplexed to over HTTP/2, NULL = disabled
+static char *ff_http2_hosts = NULL;
+// Races connections across a host's addresses, NULL = only the first address is attempted
+static struct ff_happy_eyeballs *ff_http_eyeballs = NULL;
+// Requests in flight and queued per upstream host, NULL = unlimited
+static struct ff_upstream_limits *ff_http_limits = NULL;
+// Ports upstreams are connected to, only changed by tests
+static uint16_t ff_http_port = FF_HTTP_PORT;
+static uint16_t ff_http_tls_port = FF_HTTP_TLS_PORT;
+
+bool ff_http_request_is_https(struct ff_request *request)
 {
     bool https = false;
 
@@ -37,14 +79,30 @@ void ff_http_send_request(struct ff_request *request)
         }
     }
 
+    return https;
+}
+
+void ff_http_send_request(struct ff_request *request)
+{
+    bool https = ff_http_request_is_https(request);
     char *host_name = ff_http_get_destination_host(request);
     bool success = false;
+    struct timespec started;
+    struct ff_upstream_sample sample = {0};
 
     if (host_name == NULL)
     {
         goto error;
     }
 
+    if (!ff_upstream_limits_wait(ff_http_limits, host_name))
+    {
+        ff_log(FF_WARNING, "Too many requests in flight to host: %s", host_name);
+        goto error;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &started);
+
     if (https)
     {
         success = ff_http_send_request_tls(request, host_name);
@@ -54,6 +112,11 @@ void ff_http_send_request(struct ff_request *request)
         success = ff_http_send_request_unencrypted(request, host_name);
     }
 
+    // Connecting isn't timed apart from the rest on this path
+    sample.success = success;
+    sample.response_usecs = ff_http_completion_usecs_since(&started);
+    ff_upstream_limits_release(ff_http_limits, host_name, &sample);
+
     if (success)
     {
         goto done;
@@ -80,89 +143,228 @@ void ff_http_send_request(struct ff_request *request)
     return;
 }
 
+void ff_http_send_request_async(struct ff_request *request, ff_http_engine_callback callback, void *context)
+{
+    char *host_name;
+
+    if (ff_http_engine == NULL)
+    {
+        ff_http_send_request(request);
+        callback(request, context);
+        return;
+    }
+
+    if ((host_name = ff_http_get_destination_host(request)) == NULL)
+    {
+        request->state = FF_REQUEST_STATE_SENDING_FAILED;
+        callback(request, context);
+        return;
+    }
+
+    // The forward owns the host name from here on
+    ff_http_engine_submit(ff_http_engine, request, host_name, ff_http_request_is_https(request), callback, context);
+}
+
+void ff_http_set_ports(uint16_t port, uint16_t tls_port)
+{
+    ff_http_port = port;
+    ff_http_tls_port = tls_port;
+}
+
+bool ff_http_async_init(uint16_t workers)
+{
+    ff_http_async_free();
+
+    if (workers == 0)
+    {
+        return true;
+    }
+
+    if ((ff_http_engine = ff_http_engine_init(workers)) == NULL)
+    {
+        return false;
+    }
+
+    ff_http_engine->http_port = ff_http_port;
+    ff_http_engine->https_port = ff_http_tls_port;
+    ff_http_engine->dns = ff_http_dns;
+    ff_http_engine->connections = ff_http_connections;
+    ff_http_engine->tls_connections = ff_http_tls_connections;
+    ff_http_engine->completion = ff_http_completion;
+    ff_http_engine->completion_timeout_ms = ff_http_completion_timeout_ms;
+    ff_http_engine->fastopen = ff_http_fastopen;
+    ff_http_engine->early_data_hosts = ff_http_early_data_hosts;
+    ff_http_engine->eyeballs = ff_http_eyeballs;
+    ff_http_engine->http2_hosts = ff_http2_hosts;
+    ff_http_engine->limits = ff_http_limits;
+
+    if (ff_http_dns == NULL)
+    {
+        ff_log(FF_WARNING, "Upstream host names are resolved on the event loops without the DNS cache, which blocks them");
+    }
+
+    return true;
+}
+
+void ff_http_async_free(void)
+{
+    ff_http_engine_free(ff_http_engine);
+    ff_http_engine = NULL;
+}
+
 bool ff_http_send_request_unencrypted(struct ff_request *request, char *host_name)
 {
     bool ret;
-    struct addrinfo hints;
-    struct addrinfo *res = NULL;
-    char formatted_address[INET6_ADDRSTRLEN] = {0};
-    struct timeval timeout = {.tv_sec = FF_HTTP_RESPONSE_MAX_WAIT_SECS, .tv_usec = 0};
-    int err;
-    int sockfd = 0;
+    struct ff_dns_result addresses;
+    struct sockaddr_storage address;
+    socklen_t address_length;
+    char connection_key[FF_HTTP_CONNECTION_KEY_MAX_LENGTH];
+    int sockfd = -1;
+    void *context = NULL;
+    uint32_t requests = 0;
+    bool keep_alive = false;
+    bool head_request = false;
+    bool reused = false;
+    // The upstream closed or reset the connection before responding
+    bool closed = false;
+    bool fastopen = true;
+    // The SYN data of a new fast open connection reached the upstream
+    bool delivered = true;
     ssize_t chunk = 0;
-    uint32_t sent = 0;
     uint32_t received = 0;
     char response[FF_HTTP_RESPONSE_BUFF_SIZE] = {0};
+    struct ff_http_reader reader;
+    struct ff_http_response parsed_response;
+    struct timespec written;
 
     if (host_name == NULL)
     {
         goto error;
     }
 
-    ff_log(FF_DEBUG, "Performing DNS lookup of %s", host_name);
-    memset(&hints, 0, sizeof(hints));
-    hints.ai_family = AF_UNSPEC;
-    hints.ai_socktype = SOCK_STREAM;
-    err = getaddrinfo(host_name, "80", &hints, &res);
-    if (err)
+    if (!ff_http_resolve(host_name, &addresses))
     {
-        ff_log(FF_WARNING, "Failed to perform DNS lookup for host: %s", host_name);
         goto error;
     }
 
     // TODO: filter out private IP ranges
 
-    sockfd = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
-    if (sockfd < 0)
-    {
-        ff_log(FF_ERROR, "Failed to open socket");
-        goto error;
-    }
+    // Pooled connections are looked up by the address which would be attempted first
+    ff_happy_eyeballs_sort(ff_http_eyeballs, host_name, &addresses);
+    ff_dns_result_address(&addresses, 0, ff_http_port, &address, &address_length);
+    ff_http_connection_key(&address, ff_http_port, connection_key, sizeof(connection_key));
 
-    setsockopt(sockfd, SOL_SOCKET, SO_RCVTIMEO, (void *)&timeout, sizeof(timeout));
+    ff_log(FF_DEBUG, "Resolved host %s to %s", host_name, connection_key);
 
-    if (res->ai_family == AF_INET)
+    // Only a connection whose response has been read in full can be reused
+    keep_alive = ff_http_connections != NULL &&
+                 ff_http_completion == FF_HTTP_COMPLETION_RESPONSE &&
+                 ff_http_request_keep_alive(request, &head_request);
+
+    if (keep_alive && ff_connection_pool_acquire(ff_http_connections, connection_key, &sockfd, &context, &requests))
     {
-        inet_ntop(AF_INET, &((struct sockaddr_in *)res->ai_addr)->sin_addr, formatted_address, INET_ADDRSTRLEN);
+        ff_log(FF_DEBUG, "Reusing connection to %s (%u previous requests)", connection_key, requests);
+        reused = true;
     }
-    else
+
+connect:
+    if (sockfd < 0)
     {
-        inet_ntop(AF_INET6, &((struct sockaddr_in6 *)res->ai_addr)->sin6_addr, formatted_address, INET6_ADDRSTRLEN);
+        if ((sockfd = ff_http_connect(&addresses, ff_http_port, host_name, fastopen, &address, &address_length)) < 0)
+        {
+            goto error;
+        }
+
+        ff_http_connection_key(&address, ff_http_port, connection_key, sizeof(connection_key));
+        requests = 0;
+        FF_STATS_INC(upstream_connections_opened);
     }
 
-    ff_log(FF_DEBUG, "Resolved host %s to ip address %s", host_name, formatted_address);
+    if (!ff_http_write_request(sockfd, request, host_name))
+    {
+        closed = ff_http_connection_reset(errno);
+
+        if (!reused)
+        {
+            delivered = ff_tcp_fastopen_record(ff_http_fastopen, sockfd, connection_key, false);
+        }
 
-    err = connect(sockfd, res->ai_addr, res->ai_addrlen);
-    if (err)
+        goto retry;
+    }
+
+    // Writing blocks until a new connection is established, so whether the SYN data was accepted is known
+    if (!reused)
     {
-        ff_log(FF_WARNING, "Failed to connect to host: %s", host_name);
-        goto error;
+        delivered = ff_tcp_fastopen_record(ff_http_fastopen, sockfd, connection_key, true);
     }
 
-    do
+    requests++;
+    clock_gettime(CLOCK_MONOTONIC, &written);
+
+    if (keep_alive)
     {
-        chunk = write(sockfd, request->payload->value + sent, request->payload_length - sent);
+        ff_http_reader_init(&reader, ff_http_socket_read, &sockfd);
 
-        if (chunk < 0)
+        if (!ff_http_response_read(&reader, head_request, &parsed_response))
         {
-            ff_log(FF_WARNING, "Failed to write to socket: %s (%d bytes remaining)", host_name, request->payload_length - sent);
+            ff_log(FF_WARNING, "Failed to read response from socket for host: %s (%lu bytes received)", host_name, reader.received);
+
+            if (reader.received == 0)
+            {
+                closed = reader.closed;
+                goto retry;
+            }
+
             goto error;
         }
 
-        if (chunk == 0)
+        ff_log(FF_DEBUG, "Finished receiving response from %s (%lu bytes received)", host_name, reader.received);
+        ff_log(FF_DEBUG, "Response: %s", parsed_response.status_line);
+
+        if (ff_http_response_reusable(&reader, &parsed_response))
         {
-            break;
+            ff_connection_pool_release(ff_http_connections, connection_key, sockfd, NULL, requests);
+            sockfd = -1;
         }
 
-        sent += (uint32_t)chunk;
-    } while (sent < request->payload_length);
+        goto completed;
+    }
 
-    ff_log(FF_DEBUG, "Finished sending request to %s over HTTP (%d bytes sent)", host_name, sent);
+    switch (ff_http_completion)
+    {
+    case FF_HTTP_COMPLETION_ACKED:
+        if (!ff_http_wait_acked(sockfd, ff_http_completion_timeout_ms))
+        {
+            ff_log(FF_WARNING, "Host failed to acknowledge the request: %s", host_name);
+            goto error;
+        }
+
+        goto completed;
+
+    case FF_HTTP_COMPLETION_DRAIN:
+        ff_http_drainer_submit(ff_http_drainer, sockfd, NULL, ff_http_drain_socket_read, ff_http_connection_close);
+        sockfd = -1;
+        goto completed;
+
+    case FF_HTTP_COMPLETION_STATUS:
+        ff_http_set_receive_timeout(sockfd, ff_http_completion_timeout_ms);
+        break;
+
+    default:
+        break;
+    }
 
     do
     {
         chunk = recv(sockfd, response + received, sizeof(response) - received - 1, 0);
 
+        if (chunk < 0 && ff_http_completion == FF_HTTP_COMPLETION_STATUS && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            // The request was delivered, a slow upstream doesn't fail it
+            ff_log(FF_DEBUG, "Timed out waiting for status line from host: %s (%d bytes received)", host_name, received);
+            goto completed;
+        }
+
         if (chunk < 0)
         {
             ff_log(FF_WARNING, "Failed to read response from socket for host: %s (%d bytes received)", host_name, received);
@@ -185,8 +387,47 @@ bool ff_http_send_request_unencrypted(struct ff_request *request, char *host_nam
     ff_log(FF_DEBUG, "Finished receiving response from %s (%d bytes received)", host_name, received);
     size_t response_header_length = strchr((char *)response, '\n') - response;
     ff_log(FF_DEBUG, "Response: %.*s", response_header_length > 100l ? 100 : (int)response_header_length, response);
+    goto completed;
+
+completed:
+    ff_http_completion_record(ff_http_completion, &written);
     goto done;
 
+retry:
+    // The upstream may close an idle connection just as we reuse it. The request is
+    // only sent again on a new one when the connection was closed or reset before
+    // any response arrived, and sending it twice is harmless, as a timeout may
+    // mean the upstream is still processing it
+    if (reused)
+    {
+        if (!closed || !ff_http_request_is_idempotent(request))
+        {
+            goto error;
+        }
+
+        ff_log(FF_DEBUG, "Pooled connection to %s was closed by the upstream, reconnecting", connection_key);
+        close(sockfd);
+        sockfd = -1;
+        reused = false;
+        goto connect;
+    }
+
+    // SYNs carrying data may be dropped or reset on the path, the request is
+    // sent again without fast open. Once the SYN data was delivered the
+    // upstream may have received the request, so it is only sent again as it
+    // would be on a pooled connection.
+    if (fastopen && ff_tcp_fastopen_enabled(sockfd) &&
+        (!delivered || (closed && ff_http_request_is_idempotent(request))))
+    {
+        ff_log(FF_DEBUG, "Retrying connection to %s without TCP Fast Open", connection_key);
+        close(sockfd);
+        sockfd = -1;
+        fastopen = false;
+        goto connect;
+    }
+
+    goto error;
+
 error:
     ret = false;
     goto cleanup;
@@ -196,12 +437,7 @@ bool ff_http_send_request_unencrypted(struct ff_request *request, char *host_nam
     goto cleanup;
 
 cleanup:
-    if (res != NULL)
-    {
-        freeaddrinfo(res);
-    }
-
-    if (sockfd != 0)
+    if (sockfd >= 0)
     {
         close(sockfd);
     }
@@ -209,172 +445,1084 @@ bool ff_http_send_request_unencrypted(struct ff_request *request, char *host_nam
     return ret;
 }
 
-bool ff_http_send_request_tls(struct ff_request *request, char *host_name)
+bool ff_http_resolve(char *host_name, struct ff_dns_result *result)
 {
-    bool ret;
-    long res = 1;
-
-    SSL_CTX *ctx = NULL;
-    BIO *web = NULL;
-    SSL *ssl = NULL;
-    char error_string[256] = {0};
-
-    int chunk = 0;
-    int sent = 0;
-    int received = 0;
-    char response[FF_HTTP_RESPONSE_BUFF_SIZE] = {0};
-
-    const SSL_METHOD *method = SSLv23_method();
-    if (method == NULL)
-    {
-        ff_log(FF_ERROR, "Failed to initialise OpenSSL method");
-        goto error;
-    }
+    ff_log(FF_DEBUG, "Performing DNS lookup of %s", host_name);
 
-    ctx = SSL_CTX_new(method);
-    if (ctx == NULL)
+    if (ff_http_dns != NULL ? !ff_dns_cache_lookup(ff_http_dns, host_name, result) : !ff_http_getaddrinfo(host_name, result))
     {
-        ff_log(FF_ERROR, "Failed to initialise OpenSSL context");
-        goto error;
+        ff_log(FF_WARNING, "Failed to perform DNS lookup for host: %s", host_name);
+        return false;
     }
 
-    SSL_CTX_set_default_verify_paths(ctx);
-
-    web = BIO_new_ssl_connect(ctx);
-
-    if (web == NULL)
-    {
-        ff_log(FF_ERROR, "Failed to initialise OpenSSL connection");
-        goto error;
-    }
+    return true;
+}
 
-    res = BIO_set_conn_hostname(web, host_name);
-    res = BIO_set_conn_port(web, "443");
-    if (res != 1)
-    {
-        ff_log(FF_ERROR, "Failed to set OpenSSL connection host name");
-        goto error;
-    }
+bool ff_http_getaddrinfo(char *host_name, struct ff_dns_result *result)
+{
+    struct addrinfo hints;
+    struct addrinfo *res = NULL;
 
-    BIO_get_ssl(web, &ssl);
-    if (ssl == NULL)
-    {
-        ff_log(FF_ERROR, "Failed to set OpenSSL ssl");
-        goto error;
-    }
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
 
-    const char *const PREFERRED_CIPHERS = "HIGH:!aNULL:!kRSA:!PSK:!SRP:!MD5:!RC4";
-    res = SSL_set_cipher_list(ssl, PREFERRED_CIPHERS);
-    if (res != 1)
+    if (getaddrinfo(host_name, NULL, &hints, &res) != 0)
     {
-        ff_log(FF_ERROR, "Failed to set OpenSSL preferred ciphers");
-        goto error;
+        return false;
     }
 
-    res = SSL_set_tlsext_host_name(ssl, host_name);
-    if (res != 1)
-    {
-        ff_log(FF_ERROR, "Failed to set OpenSSL TLS host name");
-        goto error;
-    }
+    memset(result, 0, sizeof(struct ff_dns_result));
+    result->status = FF_DNS_STATUS_OK;
 
-#ifndef OPENSSL_SKIP_HOST_VALIDATION
+    for (struct addrinfo *info = res; info != NULL && result->length < FF_DNS_MAX_ADDRESSES; info = info->ai_next)
     {
-        X509_VERIFY_PARAM *param = SSL_get0_param(ssl);
-
-        res = X509_VERIFY_PARAM_set1_host(param, host_name, strlen(host_name));
-        if (res != 1)
+        if (info->ai_family == AF_INET || info->ai_family == AF_INET6)
         {
-            ff_log(FF_ERROR, "Failed to set OpenSSL param host name");
-            goto error;
+            memcpy(&result->addresses[result->length++], info->ai_addr, info->ai_addrlen);
         }
     }
-#endif
 
-    SSL_set_verify(ssl, SSL_VERIFY_PEER, NULL);
+    freeaddrinfo(res);
 
-    res = BIO_do_connect(web);
-    if (res != 1)
-    {
-        ERR_error_string(ERR_get_error(), error_string);
-        ff_log(FF_WARNING, "Failed to perform OpenSSL request connection: %s", error_string);
-        goto error;
-    }
+    return result->length > 0;
+}
 
-    res = BIO_do_handshake(web);
-    if (res != 1)
-    {
-        ERR_error_string(ERR_get_error(), error_string);
-        ff_log(FF_WARNING, "Failed to perform OpenSSL request handshake: %s", error_string);
-        goto error;
-    }
+void ff_http_connection_key(struct sockaddr_storage *address, uint16_t port, char *key, size_t length)
+{
+    char formatted_address[INET6_ADDRSTRLEN] = {0};
 
-    X509 *cert = SSL_get_peer_certificate(ssl);
-    if (cert)
+    if (address->ss_family == AF_INET)
     {
-        X509_free(cert);
+        inet_ntop(AF_INET, &((struct sockaddr_in *)address)->sin_addr, formatted_address, INET_ADDRSTRLEN);
+        snprintf(key, length, "%s:%u", formatted_address, port);
     }
-    if (cert == NULL)
+    else
     {
-        ff_log(FF_WARNING, "Server did not present a certificate");
-        goto error;
+        inet_ntop(AF_INET6, &((struct sockaddr_in6 *)address)->sin6_addr, formatted_address, INET6_ADDRSTRLEN);
+        snprintf(key, length, "[%s]:%u", formatted_address, port);
     }
+}
 
-    res = SSL_get_verify_result(ssl);
-    if (res != X509_V_OK)
+int ff_http_connect(struct ff_dns_result *addresses, uint16_t port, char *host_name, bool fastopen, struct sockaddr_storage *address, socklen_t *address_length)
+{
+    struct timeval timeout = {.tv_sec = FF_HTTP_RESPONSE_MAX_WAIT_SECS, .tv_usec = 0};
+    int sockfd = ff_happy_eyeballs_connect(
+        ff_http_eyeballs,
+        host_name,
+        addresses,
+        port,
+        FF_HTTP_RESPONSE_MAX_WAIT_SECS * 1000,
+        fastopen && !ff_happy_eyeballs_racing(addresses) ? ff_http_connect_fastopen : NULL,
+        (void *)ff_http_fastopen,
+        address,
+        address_length);
+
+    if (sockfd < 0)
     {
-        ERR_error_string(ERR_get_error(), error_string);
-        ff_log(FF_WARNING, "Server certificate could not be validated against CA: %s", error_string);
-        goto error;
+        ff_log(FF_WARNING, "Failed to connect to host: %s", host_name);
+        return -1;
     }
 
-    do
-    {
-        chunk = BIO_write(web, request->payload->value + sent, request->payload_length - sent);
-        sent += chunk;
-    } while (chunk > 0);
+    setsockopt(sockfd, SOL_SOCKET, SO_RCVTIMEO, (void *)&timeout, sizeof(timeout));
 
-    ff_log(FF_DEBUG, "Finished sending request to %s over HTTPS (%d bytes sent)", host_name, sent);
+    return sockfd;
+}
+
+void ff_http_connect_fastopen(int sockfd, struct sockaddr_storage *address, void *context)
+{
+    char destination[FF_HTTP_CONNECTION_KEY_MAX_LENGTH];
+    uint16_t port = ntohs(address->ss_family == AF_INET ? ((struct sockaddr_in *)address)->sin_port : ((struct sockaddr_in6 *)address)->sin6_port);
+
+    ff_http_connection_key(address, port, destination, sizeof(destination));
+    ff_tcp_fastopen_enable((struct ff_tcp_fastopen *)context, sockfd, destination);
+}
+
+bool ff_http_write_request(int sockfd, struct ff_request *request, char *host_name)
+{
+    ssize_t chunk = 0;
+    uint32_t sent = 0;
 
     do
     {
-        chunk = BIO_read(web, response + received, sizeof(response) - received);
+        // A pooled connection may have been reset by the upstream, report it rather than raising SIGPIPE
+        chunk = send(sockfd, request->payload->value + sent, request->payload_length - sent, MSG_NOSIGNAL);
+
+        if (chunk < 0)
+        {
+            int error = errno;
 
-        received += chunk;
+            ff_log(FF_WARNING, "Failed to write to socket: %s (%d bytes remaining)", host_name, request->payload_length - sent);
+            errno = error;
+            return false;
+        }
 
-        if (received > 5 && strncasecmp(response, "http/", 5) == 0)
+        if (chunk == 0)
         {
             break;
         }
-    } while (chunk > 0 || BIO_should_retry(web));
 
-    ff_log(FF_DEBUG, "Finished receiving response from %s (%d bytes received)", host_name, received);
-    size_t response_header_length = strchr((char *)response, '\n') - response;
-    ff_log(FF_DEBUG, "Response: %.*s", response_header_length > 100l ? 100 : response_header_length, response);
-    goto done;
+        sent += (uint32_t)chunk;
+    } while (sent < request->payload_length);
 
-error:
-    ret = false;
-    goto cleanup;
+    ff_log(FF_DEBUG, "Finished sending request to %s over HTTP (%d bytes sent)", host_name, sent);
 
-done:
-    ret = true;
-    goto cleanup;
+    return true;
+}
 
-cleanup:
-    if (web != NULL)
-    {
-        BIO_free_all(web);
-    }
+ssize_t ff_http_socket_read(void *context, void *buff, size_t length)
+{
+    return recv(*(int *)context, buff, length, 0);
+}
 
+void ff_http_connection_close(int sockfd, void *context)
+{
+    (void)context;
+
+    close(sockfd);
+}
+
+void ff_http_set_receive_timeout(int sockfd, uint32_t timeout_ms)
+{
+    struct timeval timeout = {.tv_sec = timeout_ms / 1000, .tv_usec = (timeout_ms % 1000) * 1000};
+
+    setsockopt(sockfd, SOL_SOCKET, SO_RCVTIMEO, (void *)&timeout, sizeof(timeout));
+}
+
+ssize_t ff_http_drain_socket_read(int sockfd, void *context, void *buff, size_t length)
+{
+    (void)context;
+
+    return recv(sockfd, buff, length, MSG_DONTWAIT);
+}
+
+bool ff_http_completion_init(enum ff_http_completion_policy policy, uint32_t timeout_ms)
+{
+    ff_http_completion_free();
+
+    if (policy == FF_HTTP_COMPLETION_DRAIN && (ff_http_drainer = ff_http_drainer_init(timeout_ms)) == NULL)
+    {
+        return false;
+    }
+
+    ff_http_completion = policy;
+    ff_http_completion_timeout_ms = timeout_ms;
+
+    ff_log(FF_DEBUG, "Upstream requests complete on: %s", ff_http_completion_policy_name(policy));
+
+    return true;
+}
+
+void ff_http_completion_free(void)
+{
+    ff_http_drainer_free(ff_http_drainer);
+    ff_http_drainer = NULL;
+    ff_http_completion = FF_HTTP_COMPLETION_RESPONSE;
+    ff_http_completion_timeout_ms = FF_HTTP_RESPONSE_MAX_WAIT_SECS * 1000;
+}
+
+void ff_http_connections_init(uint32_t max_idle_per_host, uint32_t idle_timeout, uint32_t max_requests)
+{
+    ff_http_connections_free();
+
+    if (max_idle_per_host == 0)
+    {
+        return;
+    }
+
+    ff_http_connections = ff_connection_pool_init(max_idle_per_host, idle_timeout, max_requests, ff_http_connection_close);
+    ff_http_tls_connections = ff_connection_pool_init(max_idle_per_host, idle_timeout, max_requests, ff_http_tls_connection_close);
+}
+
+void ff_http_connections_evict_idle(void)
+{
+    if (ff_http_connections != NULL)
+    {
+        ff_connection_pool_evict_idle(ff_http_connections);
+    }
+
+    if (ff_http_tls_connections != NULL)
+    {
+        ff_connection_pool_evict_idle(ff_http_tls_connections);
+    }
+}
+
+void ff_http_dns_init(struct ff_dns_cache *cache)
+{
+    ff_http_dns_free();
+    ff_http_dns = cache;
+}
+
+void ff_http_dns_free(void)
+{
+    ff_dns_cache_free(ff_http_dns);
+    ff_http_dns = NULL;
+}
+
+void ff_http_fastopen_init(uint32_t capacity)
+{
+    ff_http_fastopen_free();
+
+    if (capacity != 0)
+    {
+        ff_http_fastopen = ff_tcp_fastopen_init(capacity, FF_HTTP_FASTOPEN_MAX_FALLBACKS, FF_HTTP_FASTOPEN_BACKOFF_SECS);
+    }
+}
+
+void ff_http_fastopen_free(void)
+{
+    ff_tcp_fastopen_free(ff_http_fastopen);
+    ff_http_fastopen = NULL;
+}
+
+void ff_http_early_data_init(const char *hosts)
+{
+    ff_http_early_data_free();
+    ff_http_early_data_hosts = hosts == NULL ? NULL : strdup(hosts);
+}
+
+void ff_http_early_data_free(void)
+{
+    FREE(ff_http_early_data_hosts);
+}
+
+bool ff_http_early_data_allowed(const char *hosts, struct ff_request *request, const char *host_name)
+{
+    return ff_http_request_is_safe(request) && ff_http_host_listed(hosts, host_name);
+}
+
+void ff_http_http2_init(const char *hosts)
+{
+    ff_http_http2_free();
+    ff_http2_hosts = hosts == NULL ? NULL : strdup(hosts);
+}
+
+void ff_http_http2_free(void)
+{
+    FREE(ff_http2_hosts);
+}
+
+bool ff_http_host_listed(const char *hosts, const char *host_name)
+{
+    size_t host_length = strlen(host_name);
+    const char *entry = NULL;
+    size_t length;
+
+    if (hosts == NULL)
+    {
+        return false;
+    }
+
+    while (*hosts != '\0')
+    {
+        length = strcspn(hosts, ",");
+        entry = hosts;
+        hosts += length;
+
+        // Lists written as "a.example, b.example" match both hosts
+        while (length > 0 && isspace((unsigned char)*entry))
+        {
+            entry++;
+            length--;
+        }
+
+        while (length > 0 && isspace((unsigned char)entry[length - 1]))
+        {
+            length--;
+        }
+
+        if (length == host_length && strncasecmp(entry, host_name, length) == 0)
+        {
+            return true;
+        }
+
+        if (*hosts == ',')
+        {
+            hosts++;
+        }
+    }
+
+    return false;
+}
+
+void ff_http_happy_eyeballs_init(uint32_t attempt_delay_ms)
+{
+    ff_http_happy_eyeballs_free();
+
+    if (attempt_delay_ms != 0)
+    {
+        ff_http_eyeballs = ff_happy_eyeballs_init(FF_HTTP_HAPPY_EYEBALLS_MAX_HOSTS, attempt_delay_ms);
+    }
+}
+
+void ff_http_happy_eyeballs_free(void)
+{
+    ff_happy_eyeballs_free(ff_http_eyeballs);
+    ff_http_eyeballs = NULL;
+}
+
+void ff_http_limits_init(uint32_t max_in_flight, uint32_t queue_size, uint32_t queue_timeout_ms, bool adaptive)
+{
+    ff_http_limits_free();
+
+    if (max_in_flight != 0)
+    {
+        ff_http_limits = ff_upstream_limits_init(FF_HTTP_UPSTREAM_LIMITS_MAX_HOSTS, max_in_flight, queue_size, queue_timeout_ms, adaptive);
+    }
+}
+
+void ff_http_limits_print_stats(FILE *fd, void *context)
+{
+    (void)context;
+
+    if (ff_http_limits != NULL)
+    {
+        ff_upstream_limits_print_stats(fd, ff_http_limits);
+    }
+}
+
+void ff_http_limits_free(void)
+{
+    ff_upstream_limits_free(ff_http_limits);
+    ff_http_limits = NULL;
+}
+
+void ff_http_connections_free(void)
+{
+    ff_connection_pool_free(ff_http_connections);
+    ff_http_connections = NULL;
+    ff_connection_pool_free(ff_http_tls_connections);
+    ff_http_tls_connections = NULL;
+}
+
+bool ff_http_send_request_tls(struct ff_request *request, char *host_name)
+{
+    bool ret;
+    BIO *web = NULL;
+    int sockfd = -1;
+    uint32_t requests = 0;
+    bool keep_alive = false;
+    bool head_request = false;
+    bool reused = false;
+    // The upstream closed or reset the connection before responding
+    bool closed = false;
+    bool early_data = false;
+    char session_host[FF_HTTP_TLS_SESSION_HOST_MAX_LENGTH];
+
+    int chunk = 0;
+    int sent = 0;
+    int received = 0;
+    char response[FF_HTTP_RESPONSE_BUFF_SIZE] = {0};
+    struct ff_http_reader reader;
+    struct ff_http_response parsed_response;
+    struct timespec written;
+    uint64_t max_wait_usecs = ff_http_completion == FF_HTTP_COMPLETION_STATUS
+                                  ? (uint64_t)ff_http_completion_timeout_ms * 1000
+                                  : (uint64_t)FF_HTTP_RESPONSE_MAX_WAIT_SECS * 1000000;
+
+    snprintf(session_host, sizeof(session_host), "%s:%u", host_name, ff_http_tls_port);
+
+    // Only a connection whose response has been read in full can be reused
+    keep_alive = ff_http_tls_connections != NULL &&
+                 ff_http_completion == FF_HTTP_COMPLETION_RESPONSE &&
+                 ff_http_request_keep_alive(request, &head_request);
+
+    if (keep_alive && ff_connection_pool_acquire(ff_http_tls_connections, session_host, &sockfd, (void **)&web, &requests))
+    {
+        ff_log(FF_DEBUG, "Reusing TLS connection to %s (%u previous requests)", session_host, requests);
+        reused = true;
+    }
+
+connect:
+    if (web == NULL)
+    {
+        web = ff_http_tls_connect(
+            host_name,
+            session_host,
+            ff_http_early_data_allowed(ff_http_early_data_hosts, request, host_name) ? request : NULL,
+            &early_data);
+
+        if (web == NULL)
+        {
+            goto error;
+        }
+
+        requests = 0;
+        FF_STATS_INC(upstream_connections_opened);
+    }
+
+    // Early data the upstream accepted was the whole request
+    sent = early_data ? (int)request->payload_length : 0;
+    errno = 0;
+
+    while ((uint32_t)sent < request->payload_length)
+    {
+        if ((chunk = BIO_write(web, request->payload->value + sent, request->payload_length - sent)) <= 0)
+        {
+            break;
+        }
+
+        sent += chunk;
+    }
+
+    if ((uint32_t)sent < request->payload_length)
+    {
+        closed = ff_http_connection_reset(errno);
+        ff_log(FF_WARNING, "Failed to write to TLS connection: %s (%d bytes remaining)", host_name, request->payload_length - sent);
+        goto retry;
+    }
+
+    ff_log(FF_DEBUG, "Finished sending request to %s over HTTPS (%d bytes sent)", host_name, sent);
+
+    requests++;
+    clock_gettime(CLOCK_MONOTONIC, &written);
+
+    if (keep_alive)
+    {
+        ff_http_reader_init(&reader, ff_http_tls_read, web);
+
+        if (!ff_http_response_read(&reader, head_request, &parsed_response))
+        {
+            ff_log(FF_WARNING, "Failed to read response from TLS connection for host: %s (%lu bytes received)", host_name, reader.received);
+
+            if (reader.received == 0)
+            {
+                closed = reader.closed;
+                goto retry;
+            }
+
+            goto error;
+        }
+
+        ff_log(FF_DEBUG, "Finished receiving response from %s (%lu bytes received)", host_name, reader.received);
+        ff_log(FF_DEBUG, "Response: %s", parsed_response.status_line);
+
+        if (ff_http_response_reusable(&reader, &parsed_response))
+        {
+            BIO_get_fd(web, &sockfd);
+            ff_connection_pool_release(ff_http_tls_connections, session_host, sockfd, web, requests);
+            web = NULL;
+        }
+
+        goto completed;
+    }
+
+    BIO_get_fd(web, &sockfd);
+
+    switch (ff_http_completion)
+    {
+    case FF_HTTP_COMPLETION_ACKED:
+        if (!ff_http_wait_acked(sockfd, ff_http_completion_timeout_ms))
+        {
+            ff_log(FF_WARNING, "TLS host failed to acknowledge the request: %s", host_name);
+            goto error;
+        }
+
+        goto completed;
+
+    case FF_HTTP_COMPLETION_DRAIN:
+        ff_http_drainer_submit(ff_http_drainer, sockfd, web, ff_http_tls_drain_read, ff_http_tls_connection_close);
+        web = NULL;
+        goto completed;
+
+    case FF_HTTP_COMPLETION_STATUS:
+        ff_http_set_receive_timeout(sockfd, ff_http_completion_timeout_ms);
+        break;
+
+    default:
+        break;
+    }
+
+    do
+    {
+        chunk = BIO_read(web, response + received, sizeof(response) - received);
+
+        received += chunk > 0 ? chunk : 0;
+
+        if (received > 5 && strncasecmp(response, "http/", 5) == 0)
+        {
+            break;
+        }
+
+        // A receive timeout reads as a retry, without a deadline this would spin
+    } while ((chunk > 0 || BIO_should_retry(web)) && ff_http_completion_usecs_since(&written) < max_wait_usecs);
+
+    ff_log(FF_DEBUG, "Finished receiving response from %s (%d bytes received)", host_name, received);
+    size_t response_header_length = received > 0 ? strcspn(response, "\n") : 0;
+    ff_log(FF_DEBUG, "Response: %.*s", response_header_length > 100l ? 100 : (int)response_header_length, response);
+    goto completed;
+
+completed:
+    ff_http_completion_record(ff_http_completion, &written);
+    goto done;
+
+retry:
+    // As for plain HTTP, only a connection closed or reset before any response
+    // arrived has an idempotent request sent again on a new one
+    if (reused && closed && ff_http_request_is_idempotent(request))
+    {
+        ff_log(FF_DEBUG, "Pooled TLS connection to %s was closed by the upstream, reconnecting", session_host);
+        ff_http_tls_connection_close(-1, web);
+        web = NULL;
+        reused = false;
+        goto connect;
+    }
+
+    goto error;
+
+error:
+    ret = false;
+    goto cleanup;
+
+done:
+    ret = true;
+    goto cleanup;
+
+cleanup:
+    if (web != NULL)
+    {
+        ff_http_tls_connection_close(-1, web);
+    }
+
+    return ret;
+}
+
+BIO *ff_http_tls_connect(char *host_name, char *session_host, struct ff_request *early_data, bool *early_data_accepted)
+{
+    BIO *web = NULL;
+    SSL *ssl = NULL;
+    struct ff_dns_result addresses;
+    struct sockaddr_storage address;
+    socklen_t address_length;
+    int sockfd = -1;
+    size_t written = 0;
+    bool early_data_sent = false;
+    char error_string[256] = {0};
+
+    *early_data_accepted = false;
+
+    // Resolved through the DNS cache rather than letting OpenSSL call getaddrinfo
+    if (!ff_http_resolve(host_name, &addresses))
+    {
+        goto error;
+    }
+
+    ff_happy_eyeballs_sort(ff_http_eyeballs, host_name, &addresses);
+
+    if ((sockfd = ff_http_connect(&addresses, ff_http_tls_port, host_name, false, &address, &address_length)) < 0)
+    {
+        goto error;
+    }
+
+    // The socket is closed with the chain from here on
+    web = ff_http_tls_new(sockfd, host_name, session_host);
+    sockfd = -1;
+
+    if (web == NULL)
+    {
+        goto error;
+    }
+
+    // Sent with the ClientHello, the handshake then sends EndOfEarlyData
+    if (early_data != NULL && ff_http_tls_early_data_begin(web, early_data))
+    {
+        BIO_get_ssl(web, &ssl);
+
+        for (size_t sent = 0; sent < early_data->payload_length; sent += written)
+        {
+            if (SSL_write_early_data(ssl, early_data->payload->value + sent, early_data->payload_length - sent, &written) != 1)
+            {
+                ERR_error_string(ERR_get_error(), error_string);
+                ff_log(FF_WARNING, "Failed to write TLS early data to %s: %s", host_name, error_string);
+                goto error;
+            }
+        }
+
+        early_data_sent = true;
+    }
+
+    if (BIO_do_handshake(web) != 1)
+    {
+        ERR_error_string(ERR_get_error(), error_string);
+        ff_log(FF_WARNING, "Failed to perform OpenSSL request handshake: %s", error_string);
+        goto error;
+    }
+
+    if (!ff_http_tls_handshake_verify(web, session_host))
+    {
+        goto error;
+    }
+
+    if (early_data_sent)
+    {
+        *early_data_accepted = ff_http_tls_early_data_accepted(web, session_host);
+    }
+
+    goto done;
+
+error:
+    if (web != NULL)
+    {
+        ff_http_tls_connection_close(-1, web);
+        web = NULL;
+    }
+
+    if (sockfd >= 0)
+    {
+        close(sockfd);
+    }
+
+    goto cleanup;
+
+done:
+    goto cleanup;
+
+cleanup:
+    return web;
+}
+
+BIO *ff_http_tls_new(int sockfd, char *host_name, char *session_host)
+{
+    long res = 1;
+    SSL_CTX *ctx = NULL;
+    BIO *web = NULL;
+    BIO *socket_bio = NULL;
+    SSL *ssl = NULL;
+    SSL_SESSION *session = NULL;
+
+    ctx = ff_http_tls_context_acquire();
+    if (ctx == NULL)
+    {
+        goto error;
+    }
+
+    web = BIO_new_ssl(ctx, 1);
+    socket_bio = BIO_new_socket(sockfd, BIO_CLOSE);
+
+    if (web == NULL || socket_bio == NULL)
+    {
+        ff_log(FF_ERROR, "Failed to initialise OpenSSL connection");
+        goto error;
+    }
+
+    // The socket is closed with the chain from here on
+    BIO_push(web, socket_bio);
+    socket_bio = NULL;
+    sockfd = -1;
+
+    BIO_get_ssl(web, &ssl);
+    if (ssl == NULL)
+    {
+        ff_log(FF_ERROR, "Failed to set OpenSSL ssl");
+        goto error;
+    }
+
+    // Read by ff_http_tls_session_new to store the sessions the host issues, which
+    // may arrive while a later request is using the pooled connection
+    SSL_set_app_data(ssl, strdup(session_host));
+
+    if (ff_http_tls_sessions != NULL && (session = ff_tls_session_cache_get(ff_http_tls_sessions, session_host)) != NULL)
+    {
+        SSL_set_session(ssl, session);
+        SSL_SESSION_free(session);
+    }
+
+    res = SSL_set_tlsext_host_name(ssl, host_name);
+    if (res != 1)
+    {
+        ff_log(FF_ERROR, "Failed to set OpenSSL TLS host name");
+        goto error;
+    }
+
+#ifndef OPENSSL_SKIP_HOST_VALIDATION
+    {
+        X509_VERIFY_PARAM *param = SSL_get0_param(ssl);
+
+        res = X509_VERIFY_PARAM_set1_host(param, host_name, strlen(host_name));
+        if (res != 1)
+        {
+            ff_log(FF_ERROR, "Failed to set OpenSSL param host name");
+            goto error;
+        }
+    }
+#endif
+
+    goto done;
+
+error:
+    if (web != NULL)
+    {
+        ff_http_tls_connection_close(-1, web);
+        web = NULL;
+    }
+
+    if (socket_bio != NULL)
+    {
+        BIO_free(socket_bio);
+    }
+
+    if (sockfd >= 0)
+    {
+        close(sockfd);
+    }
+
+    goto cleanup;
+
+done:
+    goto cleanup;
+
+cleanup:
+    // The connection holds its own reference to the context
     if (ctx != NULL)
     {
         SSL_CTX_free(ctx);
     }
 
+    return web;
+}
+
+bool ff_http_tls_handshake_verify(BIO *web, char *session_host)
+{
+    SSL *ssl = NULL;
+    long res;
+    char error_string[256] = {0};
+
+    BIO_get_ssl(web, &ssl);
+
+    X509 *cert = SSL_get_peer_certificate(ssl);
+    if (cert)
+    {
+        X509_free(cert);
+    }
+    if (cert == NULL)
+    {
+        ff_log(FF_WARNING, "Server did not present a certificate");
+        return false;
+    }
+
+    res = SSL_get_verify_result(ssl);
+    if (res != X509_V_OK)
+    {
+        ERR_error_string(ERR_get_error(), error_string);
+        ff_log(FF_WARNING, "Server certificate could not be validated against CA: %s", error_string);
+        return false;
+    }
+
+    if (SSL_session_reused(ssl))
+    {
+        ff_log(FF_DEBUG, "Resumed TLS session with %s", session_host);
+        FF_STATS_INC(tls_handshakes_resumed);
+    }
+    else
+    {
+        FF_STATS_INC(tls_handshakes_full);
+    }
+
+    if (ff_http_tls_sessions != NULL)
+    {
+        ff_tls_session_cache_record_handshake(ff_http_tls_sessions, session_host, SSL_session_reused(ssl));
+    }
+
+    return true;
+}
+
+bool ff_http_tls_early_data_begin(BIO *web, struct ff_request *request)
+{
+    SSL *ssl = NULL;
+    SSL_SESSION *session = NULL;
+
+    BIO_get_ssl(web, &ssl);
+
+    // Only TLS 1.3 tickets from upstreams accepting early data allow any
+    if (ssl == NULL || (session = SSL_get0_session(ssl)) == NULL ||
+        SSL_SESSION_get_max_early_data(session) < request->payload_length)
+    {
+        return false;
+    }
+
+    FF_STATS_INC(tls_early_data_attempts);
+
+    return true;
+}
+
+bool ff_http_tls_early_data_accepted(BIO *web, char *session_host)
+{
+    SSL *ssl = NULL;
+
+    BIO_get_ssl(web, &ssl);
+
+    if (SSL_get_early_data_status(ssl) == SSL_EARLY_DATA_ACCEPTED)
+    {
+        ff_log(FF_DEBUG, "Upstream %s accepted request sent as TLS early data", session_host);
+        FF_STATS_INC(tls_early_data_accepted);
+        return true;
+    }
+
+    ff_log(FF_DEBUG, "Upstream %s rejected TLS early data, sending request after the handshake", session_host);
+    FF_STATS_INC(tls_early_data_rejected);
+
+    return false;
+}
+
+ssize_t ff_http_tls_read(void *context, void *buff, size_t length)
+{
+    BIO *web = (BIO *)context;
+    int chunk;
+    bool closed;
+
+    errno = 0;
+
+    do
+    {
+        chunk = BIO_read(web, buff, (int)length);
+
+        if (chunk > 0)
+        {
+            return chunk;
+        }
+
+        // The receive timeout reads as a retry, which would otherwise be retried forever
+        if (errno == EAGAIN || errno == EWOULDBLOCK)
+        {
+            return -1;
+        }
+    } while (BIO_should_retry(web));
+
+    // A close_notify from the upstream reads as EOF, as does the connection closing without one
+    closed = chunk == 0 || ERR_GET_REASON(ERR_peek_last_error()) == SSL_R_UNEXPECTED_EOF_WHILE_READING;
+    ERR_clear_error();
+
+    return closed ? 0 : -1;
+}
+
+ssize_t ff_http_tls_drain_read(int sockfd, void *context, void *buff, size_t length)
+{
+    BIO *web = (BIO *)context;
+    int chunk;
+
+    (void)sockfd;
+
+    chunk = BIO_read(web, buff, (int)length);
+
+    if (chunk < 0 && BIO_should_retry(web))
+    {
+        errno = EAGAIN;
+    }
+
+    return chunk;
+}
+
+void ff_http_tls_connection_close(int sockfd, void *context)
+{
+    BIO *web = (BIO *)context;
+    SSL *ssl = NULL;
+    char *session_host = NULL;
+
+    (void)sockfd;
+
+    BIO_get_ssl(web, &ssl);
+
+    if (ssl != NULL)
+    {
+        session_host = (char *)SSL_get_app_data(ssl);
+
+        // Send our close_notify so the upstream sees a clean shutdown rather
+        // than a truncated connection, without waiting for its reply
+        if (SSL_is_init_finished(ssl))
+        {
+            SSL_shutdown(ssl);
+        }
+    }
+
+    BIO_free_all(web);
+    FREE(session_host);
+}
+
+bool ff_http_tls_init(const char *ca_bundle)
+{
+    SSL_CTX *ctx = ff_http_tls_context_new(ca_bundle);
+    SSL_CTX *old_ctx = NULL;
+
+    if (ctx == NULL)
+    {
+        return false;
+    }
+
+    pthread_mutex_lock(&ff_http_tls_context_mutex);
+    old_ctx = ff_http_tls_context;
+    ff_http_tls_context = ctx;
+    FREE(ff_http_tls_ca_bundle);
+    ff_http_tls_ca_bundle = ca_bundle == NULL ? NULL : strdup(ca_bundle);
+    pthread_mutex_unlock(&ff_http_tls_context_mutex);
+
+    if (old_ctx != NULL)
+    {
+        SSL_CTX_free(old_ctx);
+    }
+
+    // Stored sessions and pooled connections skip verification against the new trust store
+    if (ff_http_tls_sessions != NULL)
+    {
+        ff_tls_session_cache_flush(ff_http_tls_sessions);
+    }
+
+    if (ff_http_tls_connections != NULL)
+    {
+        ff_connection_pool_flush(ff_http_tls_connections);
+    }
+
+    return true;
+}
+
+bool ff_http_tls_reload(void)
+{
+    char *ca_bundle = NULL;
+    bool ret;
+
+    pthread_mutex_lock(&ff_http_tls_context_mutex);
+    ca_bundle = ff_http_tls_ca_bundle == NULL ? NULL : strdup(ff_http_tls_ca_bundle);
+    pthread_mutex_unlock(&ff_http_tls_context_mutex);
+
+    if ((ret = ff_http_tls_init(ca_bundle)))
+    {
+        ff_log(FF_INFO, "Reloaded TLS context");
+    }
+    else
+    {
+        ff_log(FF_ERROR, "Failed to reload TLS context, keeping the current context");
+    }
+
+    FREE(ca_bundle);
+
     return ret;
 }
 
+SSL_CTX *ff_http_tls_context_new(const char *ca_bundle)
+{
+    SSL_CTX *ctx = NULL;
+    const SSL_METHOD *method = SSLv23_method();
+    char error_string[256] = {0};
+
+    if (method == NULL)
+    {
+        ff_log(FF_ERROR, "Failed to initialise OpenSSL method");
+        goto error;
+    }
+
+    ctx = SSL_CTX_new(method);
+    if (ctx == NULL)
+    {
+        ff_log(FF_ERROR, "Failed to initialise OpenSSL context");
+        goto error;
+    }
+
+    if (ca_bundle != NULL)
+    {
+        if (SSL_CTX_load_verify_locations(ctx, ca_bundle, NULL) != 1)
+        {
+            ERR_error_string(ERR_get_error(), error_string);
+            ff_log(FF_ERROR, "Failed to load CA bundle %s: %s", ca_bundle, error_string);
+            goto error;
+        }
+    }
+    else if (SSL_CTX_set_default_verify_paths(ctx) != 1)
+    {
+        ff_log(FF_WARNING, "Failed to load OpenSSL default verify paths");
+    }
+
+    if (SSL_CTX_set_cipher_list(ctx, FF_HTTP_TLS_PREFERRED_CIPHERS) != 1)
+    {
+        ff_log(FF_ERROR, "Failed to set OpenSSL preferred ciphers");
+        goto error;
+    }
+
+    SSL_CTX_set_verify(ctx, SSL_VERIFY_PEER, NULL);
+
+    // Sessions are kept per upstream host by ff_http_tls_session_new rather than OpenSSL's server side cache
+    SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+    SSL_CTX_sess_set_new_cb(ctx, ff_http_tls_session_new);
+
+    return ctx;
+
+error:
+    if (ctx != NULL)
+    {
+        SSL_CTX_free(ctx);
+    }
+
+    return NULL;
+}
+
+SSL_CTX *ff_http_tls_context_acquire(void)
+{
+    SSL_CTX *ctx = NULL;
+
+    pthread_mutex_lock(&ff_http_tls_context_mutex);
+
+    if (ff_http_tls_context == NULL)
+    {
+        ff_http_tls_context = ff_http_tls_context_new(NULL);
+    }
+
+    if ((ctx = ff_http_tls_context) != NULL)
+    {
+        SSL_CTX_up_ref(ctx);
+    }
+
+    pthread_mutex_unlock(&ff_http_tls_context_mutex);
+
+    return ctx;
+}
+
+int ff_http_tls_session_new(SSL *ssl, SSL_SESSION *session)
+{
+    char *session_host = (char *)SSL_get_app_data(ssl);
+
+    if (ff_http_tls_sessions == NULL || session_host == NULL)
+    {
+        return 0;
+    }
+
+    ff_tls_session_cache_put(ff_http_tls_sessions, session_host, session);
+
+    // The cache now owns the session reference
+    return 1;
+}
+
+void ff_http_tls_sessions_init(uint32_t capacity, uint32_t max_age)
+{
+    ff_tls_session_cache_free(ff_http_tls_sessions);
+    ff_http_tls_sessions = capacity == 0 ? NULL : ff_tls_session_cache_init(capacity, max_age);
+}
+
+void ff_http_tls_print_stats(FILE *fd, void *context)
+{
+    (void)context;
+
+    if (ff_http_tls_sessions != NULL)
+    {
+        ff_tls_session_cache_print_stats(fd, ff_http_tls_sessions);
+    }
+}
+
+void ff_http_tls_free(void)
+{
+    pthread_mutex_lock(&ff_http_tls_context_mutex);
+
+    if (ff_http_tls_context != NULL)
+    {
+        SSL_CTX_free(ff_http_tls_context);
+        ff_http_tls_context = NULL;
+    }
+
+    FREE(ff_http_tls_ca_bundle);
+
+    pthread_mutex_unlock(&ff_http_tls_context_mutex);
+
+    ff_tls_session_cache_free(ff_http_tls_sessions);
+    ff_http_tls_sessions = NULL;
+}
+
 char *ff_http_get_destination_host(struct ff_request *request)
 {
     // @see https://stackoverflow.com/questions/8724954/what-is-the-maximum-number-of-characters-for-a-host-name-in-unix
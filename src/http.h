@@ -1,9 +1,144 @@
+#include <stdio.h>
+#include <stdint.h>
 #include <stdbool.h>
 #include "request.h"
+#include "dns_cache.h"
+#include "http_completion.h"
+#include "http_engine.h"
 
 #ifndef FF_HTTP_H
 #define FF_HTTP_H
 
 void ff_http_send_request(struct ff_request *request);
 
+/**
+ * Sends the request and runs the callback once it has been forwarded, on an
+ * event loop when the engine is running, otherwise before returning
+ */
+void ff_http_send_request_async(struct ff_request *request, ff_http_engine_callback callback, void *context);
+
+/**
+ * Creates the TLS context shared by upstream HTTPS requests, loading the
+ * trust store once. ca_bundle NULL = OpenSSL's default verify paths.
+ * Requests made before this is called use a context with the defaults.
+ */
+bool ff_http_tls_init(const char *ca_bundle);
+
+/**
+ * Replaces the shared TLS context with one freshly loaded from the same
+ * CA bundle, requests in flight finish with the previous context.
+ */
+bool ff_http_tls_reload(void);
+
+/**
+ * Enables resuming TLS sessions with upstream hosts, capacity 0 = disabled.
+ * Must be called before any requests are sent.
+ */
+void ff_http_tls_sessions_init(uint32_t capacity, uint32_t max_age);
+
+/**
+ * Stats printer listing TLS handshakes per upstream host
+ */
+void ff_http_tls_print_stats(FILE *fd, void *context);
+
+void ff_http_tls_free(void);
+
+/**
+ * Sends safe requests to the comma separated HTTPS hosts as TLS 1.3 early
+ * data when resuming a session that allows it, NULL = disabled. Early data
+ * can be replayed by an attacker, so only list hosts whose safe methods
+ * have no side effects. Must be called before any requests are sent.
+ */
+void ff_http_early_data_init(const char *hosts);
+
+void ff_http_early_data_free(void);
+
+/**
+ * Enables reusing keep-alive connections to upstreams, keeping up to
+ * max_idle_per_host idle connections per HTTP address or HTTPS host,
+ * 0 = disabled. Connections are closed after max_requests, 0 = unlimited.
+ * Must be called before any requests are sent.
+ */
+void ff_http_connections_init(uint32_t max_idle_per_host, uint32_t idle_timeout, uint32_t max_requests);
+
+/**
+ * Closes pooled connections which have been idle longer than the idle timeout
+ */
+void ff_http_connections_evict_idle(void);
+
+void ff_http_connections_free(void);
+
+/**
+ * Attempts TCP Fast Open on new connections to plain HTTP upstreams,
+ * tracking up to capacity destinations, 0 = disabled. Must be called
+ * before any requests are sent.
+ */
+void ff_http_fastopen_init(uint32_t capacity);
+
+void ff_http_fastopen_free(void);
+
+/**
+ * Races connections across an upstream's addresses (RFC 8305), starting
+ * the next every attempt_delay_ms until one is established, and attempts
+ * the address each host last connected with first. 0 = only the first
+ * address is attempted. Must be called before any requests are sent.
+ */
+void ff_http_happy_eyeballs_init(uint32_t attempt_delay_ms);
+
+void ff_http_happy_eyeballs_free(void);
+
+/**
+ * Multiplexes requests forwarded by the upstream engine to the comma
+ * separated HTTPS hosts as streams over one HTTP/2 connection per worker,
+ * negotiated over ALPN, falling back to HTTP/1.1 for hosts which don't
+ * negotiate it. NULL = disabled. Must be called before any requests are sent.
+ */
+void ff_http_http2_init(const char *hosts);
+
+void ff_http_http2_free(void);
+
+/**
+ * Limits the requests in flight to each upstream host to max_in_flight,
+ * queueing up to queue_size more for up to queue_timeout_ms each and
+ * failing the rest. adaptive = the limit backs off while a host is failing
+ * or slow. 0 = unlimited. Must be called before any requests are sent.
+ */
+void ff_http_limits_init(uint32_t max_in_flight, uint32_t queue_size, uint32_t queue_timeout_ms, bool adaptive);
+
+/**
+ * Stats printer listing the requests in flight and queued per upstream host
+ */
+void ff_http_limits_print_stats(FILE *fd, void *context);
+
+void ff_http_limits_free(void);
+
+/**
+ * Resolves upstream hosts through the cache, taking ownership of it.
+ * Must be called before any requests are sent.
+ */
+void ff_http_dns_init(struct ff_dns_cache *cache);
+
+void ff_http_dns_free(void);
+
+/**
+ * Sets when forwarded requests are considered complete, timeout_ms bounds
+ * the wait for a status line or acknowledgement. Must be called before any
+ * requests are sent, returns false if the drainer could not be started.
+ */
+bool ff_http_completion_init(enum ff_http_completion_policy policy, uint32_t timeout_ms);
+
+void ff_http_completion_free(void);
+
+/**
+ * Forwards requests sent with ff_http_send_request_async on workers event
+ * loops rather than a blocking thread each, 0 = disabled. Must be called
+ * after the connection pools, DNS cache and completion policy are set up.
+ */
+bool ff_http_async_init(uint16_t workers);
+
+/**
+ * Fails forwards in progress, must be called before the DNS cache and connection pools are freed
+ */
+void ff_http_async_free(void);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,686 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <ctype.h>
+#include "http2.h"
+#include "http2_p.h"
+#include "http_response.h"
+#include "http_response_p.h"
+#include "alloc.h"
+
+// RFC 7541 Appendix A
+static const struct ff_http2_static_header ff_http2_static_table[FF_HTTP2_STATIC_TABLE_LENGTH] = {
+    {":authority", ""},
+    {":method", "GET"},
+    {":method", "POST"},
+    {":path", "/"},
+    {":path", "/index.html"},
+    {":scheme", "http"},
+    {":scheme", "https"},
+    {":status", "200"},
+    {":status", "204"},
+    {":status", "206"},
+    {":status", "304"},
+    {":status", "400"},
+    {":status", "404"},
+    {":status", "500"},
+    {"accept-charset", ""},
+    {"accept-encoding", "gzip, deflate"},
+    {"accept-language", ""},
+    {"accept-ranges", ""},
+    {"accept", ""},
+    {"access-control-allow-origin", ""},
+    {"age", ""},
+    {"allow", ""},
+    {"authorization", ""},
+    {"cache-control", ""},
+    {"content-disposition", ""},
+    {"content-encoding", ""},
+    {"content-language", ""},
+    {"content-length", ""},
+    {"content-location", ""},
+    {"content-range", ""},
+    {"content-type", ""},
+    {"cookie", ""},
+    {"date", ""},
+    {"etag", ""},
+    {"expect", ""},
+    {"expires", ""},
+    {"from", ""},
+    {"host", ""},
+    {"if-match", ""},
+    {"if-modified-since", ""},
+    {"if-none-match", ""},
+    {"if-range", ""},
+    {"if-unmodified-since", ""},
+    {"last-modified", ""},
+    {"link", ""},
+    {"location", ""},
+    {"max-forwards", ""},
+    {"proxy-authenticate", ""},
+    {"proxy-authorization", ""},
+    {"range", ""},
+    {"referer", ""},
+    {"refresh", ""},
+    {"retry-after", ""},
+    {"server", ""},
+    {"set-cookie", ""},
+    {"strict-transport-security", ""},
+    {"transfer-encoding", ""},
+    {"user-agent", ""},
+    {"vary", ""},
+    {"via", ""},
+    {"www-authenticate", ""}};
+
+void ff_http2_buff_append(struct ff_http2_buff *buff, const void *data, uint32_t length)
+{
+    if (buff->length + length > buff->capacity)
+    {
+        buff->capacity = buff->capacity == 0 ? FF_HTTP2_BUFF_INITIAL_CAPACITY : buff->capacity;
+
+        while (buff->length + length > buff->capacity)
+        {
+            buff->capacity *= 2;
+        }
+
+        buff->data = realloc(buff->data, buff->capacity);
+    }
+
+    memcpy(buff->data + buff->length, data, length);
+    buff->length += length;
+}
+
+void ff_http2_buff_free(struct ff_http2_buff *buff)
+{
+    FREE(buff->data);
+    buff->length = 0;
+    buff->capacity = 0;
+}
+
+void ff_http2_frame_write(struct ff_http2_buff *buff, uint8_t type, uint8_t flags, uint32_t stream_id, const void *payload, uint32_t length)
+{
+    uint8_t header[FF_HTTP2_FRAME_HEADER_LENGTH] = {
+        (uint8_t)(length >> 16),
+        (uint8_t)(length >> 8),
+        (uint8_t)length,
+        type,
+        flags,
+        (uint8_t)((stream_id >> 24) & 0x7f),
+        (uint8_t)(stream_id >> 16),
+        (uint8_t)(stream_id >> 8),
+        (uint8_t)stream_id};
+
+    ff_http2_buff_append(buff, header, sizeof(header));
+
+    if (length > 0)
+    {
+        ff_http2_buff_append(buff, payload, length);
+    }
+}
+
+void ff_http2_frame_header_read(const uint8_t *buff, struct ff_http2_frame_header *header)
+{
+    header->length = (uint32_t)buff[0] << 16 | (uint32_t)buff[1] << 8 | buff[2];
+    header->type = buff[3];
+    header->flags = buff[4];
+    // The reserved bit is ignored
+    header->stream_id = ((uint32_t)buff[5] & 0x7f) << 24 | (uint32_t)buff[6] << 16 | (uint32_t)buff[7] << 8 | buff[8];
+}
+
+uint32_t ff_http2_uint32_read(const uint8_t *buff)
+{
+    return (uint32_t)buff[0] << 24 | (uint32_t)buff[1] << 16 | (uint32_t)buff[2] << 8 | buff[3];
+}
+
+void ff_http2_uint32_write(uint8_t *buff, uint32_t value)
+{
+    buff[0] = (uint8_t)(value >> 24);
+    buff[1] = (uint8_t)(value >> 16);
+    buff[2] = (uint8_t)(value >> 8);
+    buff[3] = (uint8_t)value;
+}
+
+bool ff_http2_request_convert(struct ff_request *request, const char *host_name, struct ff_http2_request *converted)
+{
+    char *http_request = (char *)request->payload->value;
+    char *end = http_request + request->payload_length;
+    char *next_line = memchr(http_request, '\n', request->payload_length);
+    char *line_end = NULL;
+    char *line = NULL;
+    char *headers = NULL;
+    char *headers_end = NULL;
+    char *body = NULL;
+    char *method_end = NULL;
+    char *target = NULL;
+    char *target_end = NULL;
+    char *path = NULL;
+    const char *authority = host_name;
+    size_t authority_length = strlen(host_name);
+    bool target_authority = false;
+    bool chunked = false;
+    char name[FF_HTTP2_MAX_HEADER_NAME_LENGTH];
+    const char *value = NULL;
+    size_t value_length = 0;
+    size_t connection_length = 0;
+    char connection[FF_HTTP_READER_BUFF_SIZE] = {0};
+    struct ff_http2_buff fields = {0};
+
+    memset(converted, 0, sizeof(struct ff_http2_request));
+
+    if (next_line == NULL)
+    {
+        goto error;
+    }
+
+    line_end = ff_http2_line_end(http_request, next_line);
+
+    if ((method_end = memchr(http_request, ' ', line_end - http_request)) == NULL || method_end == http_request)
+    {
+        goto error;
+    }
+
+    target = method_end + 1;
+
+    if ((target_end = memchr(target, ' ', line_end - target)) == NULL || target_end == target)
+    {
+        goto error;
+    }
+
+    // CONNECT opens a tunnel rather than making a request
+    if (method_end - http_request == 7 && strncmp(http_request, "CONNECT", 7) == 0)
+    {
+        goto error;
+    }
+
+    path = target;
+
+    // An absolute-form target carries the authority, which takes precedence over Host
+    if (*target != '/' && *target != '*')
+    {
+        char *scheme_end = memmem(target, target_end - target, "://", 3);
+
+        if (scheme_end == NULL)
+        {
+            goto error;
+        }
+
+        authority = scheme_end + 3;
+        path = memchr(authority, '/', target_end - authority);
+        path = path == NULL ? target_end : path;
+        authority_length = path - authority;
+        target_authority = true;
+    }
+
+    // The Connection and Transfer-Encoding headers decide how the rest are sent
+    headers = next_line + 1;
+
+    for (line = headers;; line = next_line + 1)
+    {
+        if (line >= end || (next_line = memchr(line, '\n', end - line)) == NULL)
+        {
+            goto error;
+        }
+
+        if ((line_end = ff_http2_line_end(line, next_line)) == line)
+        {
+            headers_end = line;
+            body = next_line + 1;
+            break;
+        }
+
+        if (!ff_http2_header_parse(line, line_end, name, &value, &value_length))
+        {
+            goto error;
+        }
+
+        if (strcmp(name, "connection") == 0 && connection_length + value_length + 1 < sizeof(connection))
+        {
+            connection[connection_length++] = ',';
+            memcpy(connection + connection_length, value, value_length);
+            connection_length += value_length;
+        }
+        else if (strcmp(name, "transfer-encoding") == 0)
+        {
+            // Chunked is always the final coding
+            chunked = value_length >= 7 && strncasecmp(value + value_length - 7, "chunked", 7) == 0;
+        }
+        else if (strcmp(name, "host") == 0 && !target_authority)
+        {
+            authority = value;
+            authority_length = value_length;
+        }
+    }
+
+    for (line = headers; line < headers_end; line = next_line + 1)
+    {
+        next_line = memchr(line, '\n', headers_end - line);
+        ff_http2_header_parse(line, ff_http2_line_end(line, next_line), name, &value, &value_length);
+
+        if (!ff_http2_header_excluded(name, value, value_length, connection))
+        {
+            ff_http2_hpack_header_write(&fields, name, value, value_length);
+        }
+    }
+
+    // Pseudo-headers come first
+    ff_http2_hpack_header_write(&converted->headers, ":method", http_request, method_end - http_request);
+    ff_http2_hpack_header_write(&converted->headers, ":scheme", "https", 5);
+    ff_http2_hpack_header_write(&converted->headers, ":authority", authority, authority_length);
+    ff_http2_hpack_header_write(&converted->headers, ":path", path == target_end ? "/" : path, path == target_end ? 1 : target_end - path);
+
+    if (fields.length > 0)
+    {
+        ff_http2_buff_append(&converted->headers, fields.data, fields.length);
+    }
+
+    if (chunked)
+    {
+        if (!ff_http2_request_dechunk(body, end, &converted->body))
+        {
+            goto error;
+        }
+    }
+    else if (body < end)
+    {
+        ff_http2_buff_append(&converted->body, body, (uint32_t)(end - body));
+    }
+
+    ff_http2_buff_free(&fields);
+
+    return true;
+
+error:
+    ff_http2_buff_free(&fields);
+    ff_http2_request_free(converted);
+
+    return false;
+}
+
+void ff_http2_request_free(struct ff_http2_request *converted)
+{
+    ff_http2_buff_free(&converted->headers);
+    ff_http2_buff_free(&converted->body);
+}
+
+bool ff_http2_response_status(const uint8_t *block, uint32_t length, uint16_t *status)
+{
+    const uint8_t *pos = block;
+    const uint8_t *end = block + length;
+    const uint8_t *name = NULL;
+    const uint8_t *value = NULL;
+    uint32_t index = 0;
+    uint32_t name_length = 0;
+    uint32_t value_length = 0;
+    bool name_huffman = false;
+    bool value_huffman = false;
+    bool is_status;
+
+    *status = 0;
+
+    while (pos < end)
+    {
+        if (*pos & 0x80)
+        {
+            // Indexed field, only the static table has entries
+            if (!ff_http2_hpack_integer_read(&pos, end, 7, &index) || index == 0 || index > FF_HTTP2_STATIC_TABLE_LENGTH)
+            {
+                return false;
+            }
+
+            if (strcmp(ff_http2_static_table[index - 1].name, ":status") == 0)
+            {
+                *status = (uint16_t)atoi(ff_http2_static_table[index - 1].value);
+            }
+
+            continue;
+        }
+
+        if ((*pos & 0xe0) == 0x20)
+        {
+            // Dynamic table size update, there are no entries to evict
+            if (!ff_http2_hpack_integer_read(&pos, end, 5, &index))
+            {
+                return false;
+            }
+
+            continue;
+        }
+
+        // Literals with incremental indexing have a 6 bit name index, without indexing and never indexed 4 bits.
+        // Fields added to a table of size 0 are evicted straight away.
+        if (!ff_http2_hpack_integer_read(&pos, end, (*pos & 0x40) ? 6 : 4, &index) || index > FF_HTTP2_STATIC_TABLE_LENGTH)
+        {
+            return false;
+        }
+
+        if (index == 0 && !ff_http2_hpack_string_read(&pos, end, &name, &name_length, &name_huffman))
+        {
+            return false;
+        }
+
+        if (!ff_http2_hpack_string_read(&pos, end, &value, &value_length, &value_huffman))
+        {
+            return false;
+        }
+
+        is_status = index != 0
+                        ? strcmp(ff_http2_static_table[index - 1].name, ":status") == 0
+                        : !name_huffman && name_length == 7 && memcmp(name, ":status", 7) == 0;
+
+        if (is_status && !ff_http2_hpack_status_parse(value, value_length, value_huffman, status))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void ff_http2_hpack_integer_write(struct ff_http2_buff *buff, uint8_t first, uint8_t prefix_bits, uint32_t value)
+{
+    uint8_t max = (uint8_t)((1 << prefix_bits) - 1);
+    uint8_t byte;
+
+    if (value < max)
+    {
+        byte = first | (uint8_t)value;
+        ff_http2_buff_append(buff, &byte, 1);
+        return;
+    }
+
+    byte = first | max;
+    ff_http2_buff_append(buff, &byte, 1);
+    value -= max;
+
+    while (value >= 0x80)
+    {
+        byte = (uint8_t)(value & 0x7f) | 0x80;
+        ff_http2_buff_append(buff, &byte, 1);
+        value >>= 7;
+    }
+
+    byte = (uint8_t)value;
+    ff_http2_buff_append(buff, &byte, 1);
+}
+
+bool ff_http2_hpack_integer_read(const uint8_t **pos, const uint8_t *end, uint8_t prefix_bits, uint32_t *value)
+{
+    uint8_t max = (uint8_t)((1 << prefix_bits) - 1);
+    uint32_t shift = 0;
+    uint8_t byte;
+
+    if (*pos >= end)
+    {
+        return false;
+    }
+
+    *value = *(*pos)++ & max;
+
+    if (*value < max)
+    {
+        return true;
+    }
+
+    do
+    {
+        // Nothing this decodes needs more than 28 bits
+        if (*pos >= end || shift > 21)
+        {
+            return false;
+        }
+
+        byte = *(*pos)++;
+        *value += (uint32_t)(byte & 0x7f) << shift;
+        shift += 7;
+    } while (byte & 0x80);
+
+    return true;
+}
+
+void ff_http2_hpack_string_write(struct ff_http2_buff *buff, const char *value, size_t length)
+{
+    ff_http2_hpack_integer_write(buff, 0x00, 7, (uint32_t)length);
+
+    if (length > 0)
+    {
+        ff_http2_buff_append(buff, value, (uint32_t)length);
+    }
+}
+
+bool ff_http2_hpack_string_read(const uint8_t **pos, const uint8_t *end, const uint8_t **value, uint32_t *length, bool *huffman)
+{
+    if (*pos >= end)
+    {
+        return false;
+    }
+
+    *huffman = (**pos & 0x80) != 0;
+
+    if (!ff_http2_hpack_integer_read(pos, end, 7, length) || *length > (uint32_t)(end - *pos))
+    {
+        return false;
+    }
+
+    *value = *pos;
+    *pos += *length;
+
+    return true;
+}
+
+void ff_http2_hpack_header_write(struct ff_http2_buff *buff, const char *name, const char *value, size_t value_length)
+{
+    uint32_t name_index = 0;
+    // Intermediaries are told not to index credentials either
+    uint8_t literal = strcmp(name, "authorization") == 0 || strcmp(name, "proxy-authorization") == 0 || strcmp(name, "cookie") == 0
+                          ? 0x10
+                          : 0x00;
+
+    for (uint32_t i = 0; i < FF_HTTP2_STATIC_TABLE_LENGTH; i++)
+    {
+        if (strcmp(ff_http2_static_table[i].name, name) != 0)
+        {
+            continue;
+        }
+
+        if (strlen(ff_http2_static_table[i].value) == value_length && strncmp(ff_http2_static_table[i].value, value, value_length) == 0)
+        {
+            ff_http2_hpack_integer_write(buff, 0x80, 7, i + 1);
+            return;
+        }
+
+        name_index = name_index == 0 ? i + 1 : name_index;
+    }
+
+    ff_http2_hpack_integer_write(buff, literal, 4, name_index);
+
+    if (name_index == 0)
+    {
+        ff_http2_hpack_string_write(buff, name, strlen(name));
+    }
+
+    ff_http2_hpack_string_write(buff, value, value_length);
+}
+
+bool ff_http2_hpack_status_parse(const uint8_t *value, uint32_t length, bool huffman, uint16_t *status)
+{
+    char digits[3];
+    uint32_t count = 0;
+    uint32_t bits = 0;
+    uint32_t remaining = length * 8;
+    uint32_t code;
+
+    if (!huffman)
+    {
+        if (length != 3)
+        {
+            return false;
+        }
+
+        memcpy(digits, value, 3);
+        count = 3;
+    }
+    else
+    {
+        // Three digits take at most 18 bits
+        if (length > 3)
+        {
+            return false;
+        }
+
+        for (uint32_t i = 0; i < length; i++)
+        {
+            bits = bits << 8 | value[i];
+        }
+
+        // '0' to '2' have 5 bit codes 0x0 to 0x2, '3' to '9' 6 bit codes 0x19 to 0x1f (RFC 7541 Appendix B)
+        while (remaining >= 5 && count < 3)
+        {
+            if ((code = (bits >> (remaining - 5)) & 0x1f) <= 0x2)
+            {
+                digits[count++] = (char)('0' + code);
+                remaining -= 5;
+            }
+            else if (remaining >= 6 && (code = (bits >> (remaining - 6)) & 0x3f) >= 0x19 && code <= 0x1f)
+            {
+                digits[count++] = (char)('3' + code - 0x19);
+                remaining -= 6;
+            }
+            else
+            {
+                break;
+            }
+        }
+
+        // Padded with fewer than 8 of the EOS code's leading ones
+        if (remaining >= 8 || (bits & ((1u << remaining) - 1)) != (1u << remaining) - 1)
+        {
+            return false;
+        }
+    }
+
+    if (count != 3 || !isdigit((unsigned char)digits[0]) || !isdigit((unsigned char)digits[1]) || !isdigit((unsigned char)digits[2]))
+    {
+        return false;
+    }
+
+    *status = (uint16_t)((digits[0] - '0') * 100 + (digits[1] - '0') * 10 + (digits[2] - '0'));
+
+    return true;
+}
+
+bool ff_http2_header_excluded(const char *name, const char *value, size_t value_length, char *connection)
+{
+    static const char *excluded[] = {"connection", "keep-alive", "proxy-connection", "transfer-encoding", "upgrade", "host"};
+
+    for (size_t i = 0; i < sizeof(excluded) / sizeof(excluded[0]); i++)
+    {
+        if (strcmp(name, excluded[i]) == 0)
+        {
+            return true;
+        }
+    }
+
+    // TE may only advertise support for trailers
+    if (strcmp(name, "te") == 0)
+    {
+        return !(value_length == 8 && strncasecmp(value, "trailers", 8) == 0);
+    }
+
+    return ff_http_header_has_token(connection, name);
+}
+
+bool ff_http2_header_parse(char *line, char *line_end, char *name, const char **value, size_t *value_length)
+{
+    char *colon = memchr(line, ':', line_end - line);
+    size_t name_length;
+
+    if (colon == NULL || colon == line || (name_length = (size_t)(colon - line)) >= FF_HTTP2_MAX_HEADER_NAME_LENGTH)
+    {
+        return false;
+    }
+
+    for (size_t i = 0; i < name_length; i++)
+    {
+        if (line[i] == ' ' || line[i] == '\t')
+        {
+            return false;
+        }
+
+        name[i] = (char)tolower((unsigned char)line[i]);
+    }
+
+    name[name_length] = '\0';
+    *value = colon + 1;
+
+    while (*value < line_end && (**value == ' ' || **value == '\t'))
+    {
+        (*value)++;
+    }
+
+    *value_length = (size_t)(line_end - *value);
+
+    while (*value_length > 0 && ((*value)[*value_length - 1] == ' ' || (*value)[*value_length - 1] == '\t'))
+    {
+        (*value_length)--;
+    }
+
+    return true;
+}
+
+char *ff_http2_line_end(char *line, char *next_line)
+{
+    return next_line > line && *(next_line - 1) == '\r' ? next_line - 1 : next_line;
+}
+
+bool ff_http2_request_dechunk(char *body, char *end, struct ff_http2_buff *decoded)
+{
+    char *next_line = NULL;
+    char *size_end = NULL;
+    uint64_t chunk_length;
+
+    while (1)
+    {
+        if (body >= end || (next_line = memchr(body, '\n', end - body)) == NULL)
+        {
+            return false;
+        }
+
+        chunk_length = (uint64_t)strtoull(body, &size_end, 16);
+
+        // Chunk extensions follow a semicolon
+        if (size_end == body || (size_end != ff_http2_line_end(body, next_line) && *size_end != ';' && *size_end != ' '))
+        {
+            return false;
+        }
+
+        body = next_line + 1;
+
+        // Trailers aren't forwarded
+        if (chunk_length == 0)
+        {
+            return true;
+        }
+
+        if (chunk_length > (uint64_t)(end - body))
+        {
+            return false;
+        }
+
+        ff_http2_buff_append(decoded, body, (uint32_t)chunk_length);
+        body += chunk_length;
+
+        if (body < end && *body == '\r')
+        {
+            body++;
+        }
+
+        if (body >= end || *body != '\n')
+        {
+            return false;
+        }
+
+        body++;
+    }
+}
@@ -0,0 +1,123 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include "request.h"
+
+#ifndef FF_HTTP2_H
+#define FF_HTTP2_H
+
+#define FF_HTTP2_PREFACE "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n"
+#define FF_HTTP2_PREFACE_LENGTH 24
+// Offered over ALPN, preferring h2
+#define FF_HTTP2_ALPN_PROTOCOLS "\x02h2\x08http/1.1"
+#define FF_HTTP2_FRAME_HEADER_LENGTH 9
+// Flow control window and frame size until SETTINGS change them (RFC 9113)
+#define FF_HTTP2_DEFAULT_WINDOW 65535
+#define FF_HTTP2_DEFAULT_MAX_FRAME_SIZE 16384
+#define FF_HTTP2_MAX_FRAME_SIZE 16777215
+#define FF_HTTP2_MAX_WINDOW 0x7fffffff
+#define FF_HTTP2_MAX_STREAM_ID 0x7fffffff
+// Largest response header block accepted across HEADERS and CONTINUATION frames
+#define FF_HTTP2_MAX_HEADER_BLOCK 65536
+
+enum ff_http2_frame_type
+{
+    FF_HTTP2_FRAME_DATA = 0x0,
+    FF_HTTP2_FRAME_HEADERS = 0x1,
+    FF_HTTP2_FRAME_PRIORITY = 0x2,
+    FF_HTTP2_FRAME_RST_STREAM = 0x3,
+    FF_HTTP2_FRAME_SETTINGS = 0x4,
+    FF_HTTP2_FRAME_PUSH_PROMISE = 0x5,
+    FF_HTTP2_FRAME_PING = 0x6,
+    FF_HTTP2_FRAME_GOAWAY = 0x7,
+    FF_HTTP2_FRAME_WINDOW_UPDATE = 0x8,
+    FF_HTTP2_FRAME_CONTINUATION = 0x9
+};
+
+#define FF_HTTP2_FLAG_END_STREAM 0x1
+#define FF_HTTP2_FLAG_ACK 0x1
+#define FF_HTTP2_FLAG_END_HEADERS 0x4
+#define FF_HTTP2_FLAG_PADDED 0x8
+#define FF_HTTP2_FLAG_PRIORITY 0x20
+
+enum ff_http2_setting
+{
+    FF_HTTP2_SETTINGS_HEADER_TABLE_SIZE = 0x1,
+    FF_HTTP2_SETTINGS_ENABLE_PUSH = 0x2,
+    FF_HTTP2_SETTINGS_MAX_CONCURRENT_STREAMS = 0x3,
+    FF_HTTP2_SETTINGS_INITIAL_WINDOW_SIZE = 0x4,
+    FF_HTTP2_SETTINGS_MAX_FRAME_SIZE = 0x5,
+    FF_HTTP2_SETTINGS_MAX_HEADER_LIST_SIZE = 0x6
+};
+
+enum ff_http2_error
+{
+    FF_HTTP2_NO_ERROR = 0x0,
+    FF_HTTP2_PROTOCOL_ERROR = 0x1,
+    FF_HTTP2_FLOW_CONTROL_ERROR = 0x3,
+    FF_HTTP2_FRAME_SIZE_ERROR = 0x6,
+    FF_HTTP2_REFUSED_STREAM = 0x7,
+    FF_HTTP2_CANCEL = 0x8,
+    FF_HTTP2_COMPRESSION_ERROR = 0x9
+};
+
+struct ff_http2_frame_header
+{
+    uint32_t length;
+    uint8_t type;
+    uint8_t flags;
+    uint32_t stream_id;
+};
+
+/**
+ * A growable byte buffer, for header blocks and frames waiting to be written
+ */
+struct ff_http2_buff
+{
+    uint8_t *data;
+    uint32_t length;
+    uint32_t capacity;
+};
+
+/**
+ * An HTTP/1.1 request converted to a stream's header block and body
+ */
+struct ff_http2_request
+{
+    struct ff_http2_buff headers;
+    struct ff_http2_buff body;
+};
+
+void ff_http2_buff_append(struct ff_http2_buff *buff, const void *data, uint32_t length);
+
+void ff_http2_buff_free(struct ff_http2_buff *buff);
+
+/**
+ * Appends a frame header followed by the payload
+ */
+void ff_http2_frame_write(struct ff_http2_buff *buff, uint8_t type, uint8_t flags, uint32_t stream_id, const void *payload, uint32_t length);
+
+void ff_http2_frame_header_read(const uint8_t *buff, struct ff_http2_frame_header *header);
+
+uint32_t ff_http2_uint32_read(const uint8_t *buff);
+
+void ff_http2_uint32_write(uint8_t *buff, uint32_t value);
+
+/**
+ * Converts the HTTP/1.1 request in the payload into HPACK encoded headers,
+ * the pseudo-headers taken from the request line and Host header (or
+ * host_name without one) and connection specific headers removed, and its
+ * body with any chunked transfer coding removed. Nothing is added to the
+ * encoder's dynamic table. Returns false if the request can't be parsed.
+ */
+bool ff_http2_request_convert(struct ff_request *request, const char *host_name, struct ff_http2_request *converted);
+
+void ff_http2_request_free(struct ff_http2_request *converted);
+
+/**
+ * Finds the :status in a response header block encoded for a decoder whose
+ * dynamic table size is 0, status is left 0 if it has none. Returns false
+ * if the block is malformed or refers to the dynamic table.
+ */
+bool ff_http2_response_status(const uint8_t *block, uint32_t length, uint16_t *status);
+
+#endif
@@ -0,0 +1,1039 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <openssl/err.h>
+#include "http2_connection.h"
+#include "http2_connection_p.h"
+#include "http_engine_p.h"
+#include "http_p.h"
+#include "logging.h"
+#include "stats.h"
+#include "alloc.h"
+
+struct ff_http2_connection *ff_http2_connection_init(struct ff_http_engine_worker *worker, const char *key, struct ff_http_forward *opener)
+{
+    struct ff_http2_connection *connection = calloc(1, sizeof(struct ff_http2_connection));
+
+    connection->worker = worker;
+    connection->state = FF_HTTP2_CONNECTION_OPENING;
+    snprintf(connection->key, sizeof(connection->key), "%s", key);
+    connection->opener = opener;
+    connection->sockfd = -1;
+    connection->next_stream_id = 1;
+    connection->max_streams = FF_HTTP2_CONNECTION_INITIAL_STREAMS;
+    connection->initial_window = FF_HTTP2_DEFAULT_WINDOW;
+    connection->max_frame_size = FF_HTTP2_DEFAULT_MAX_FRAME_SIZE;
+    connection->send_window = FF_HTTP2_DEFAULT_WINDOW;
+    ff_event_loop_watch_init(&connection->watch, -1, ff_http2_connection_on_event, (void *)connection);
+
+    connection->next = worker->http2_connections;
+
+    if (worker->http2_connections != NULL)
+    {
+        worker->http2_connections->prev = connection;
+    }
+
+    worker->http2_connections = connection;
+
+    return connection;
+}
+
+struct ff_http2_connection *ff_http2_connection_find(struct ff_http_engine_worker *worker, const char *key)
+{
+    struct ff_http2_connection *connection;
+
+    for (connection = worker->http2_connections; connection != NULL; connection = connection->next)
+    {
+        if (connection->state == FF_HTTP2_CONNECTION_CLOSING || strcmp(connection->key, key) != 0)
+        {
+            continue;
+        }
+
+        // Upstreams may gain h2 support, the marker holds no socket so is freed straight away
+        if (connection->state == FF_HTTP2_CONNECTION_HTTP1 && connection->http1_until <= time(NULL))
+        {
+            ff_http2_connection_close(connection);
+            return NULL;
+        }
+
+        return connection;
+    }
+
+    return NULL;
+}
+
+void ff_http2_connection_submit(struct ff_http2_connection *connection, struct ff_http_forward *forward)
+{
+    forward->http2 = connection;
+    forward->state = FF_HTTP_FORWARD_STREAMING;
+    memset(&forward->stream, 0, sizeof(struct ff_http2_stream));
+    ff_http2_stream_append(&connection->pending_first, &connection->pending_last, forward);
+
+    if (connection->state != FF_HTTP2_CONNECTION_OPEN || connection->streams_length >= connection->max_streams)
+    {
+        FF_STATS_INC(upstream_http2_streams_queued);
+        return;
+    }
+
+    if (ff_http2_connection_start_streams(connection))
+    {
+        ff_http2_connection_update(connection);
+    }
+}
+
+bool ff_http2_connection_opened(struct ff_http_forward *forward)
+{
+    struct ff_http2_connection *connection = forward->http2;
+    struct ff_http_forward *pending = connection->pending_first;
+    const unsigned char *protocol = NULL;
+    unsigned int protocol_length = 0;
+    SSL *ssl = NULL;
+    // HPACK's dynamic table isn't used for responses, and nothing is pushed
+    uint8_t settings[12] = {0};
+    int nodelay = 1;
+
+    BIO_get_ssl(forward->web, &ssl);
+    SSL_get0_alpn_selected(ssl, &protocol, &protocol_length);
+    connection->opener = NULL;
+
+    if (protocol_length != 2 || memcmp(protocol, "h2", 2) != 0)
+    {
+        ff_log(FF_INFO, "Upstream %s did not negotiate HTTP/2, its requests are sent over HTTP/1.1", connection->key);
+        connection->state = FF_HTTP2_CONNECTION_HTTP1;
+        connection->http1_until = time(NULL) + FF_HTTP2_CONNECTION_HTTP1_SECS;
+        connection->pending_first = NULL;
+        connection->pending_last = NULL;
+        forward->http2 = NULL;
+        ff_http2_connection_redispatch(pending);
+        return false;
+    }
+
+    // The connection takes over the opener's socket, its request is the first stream
+    ff_event_loop_unwatch(connection->worker->loop, &forward->watch);
+    connection->sockfd = forward->sockfd;
+    connection->web = forward->web;
+    forward->sockfd = -1;
+    forward->web = NULL;
+    connection->state = FF_HTTP2_CONNECTION_OPEN;
+    // Queued frames are only appended to, so partial writes are retried from a buffer which may move
+    SSL_set_mode(ssl, SSL_MODE_ENABLE_PARTIAL_WRITE | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+    // Frames are written as soon as they're queued, a stream's last DATA frame isn't held back behind an ACK
+    setsockopt(connection->sockfd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+    ff_event_loop_watch_init(&connection->watch, connection->sockfd, ff_http2_connection_on_event, (void *)connection);
+    FF_STATS_INC(upstream_http2_connections_opened);
+
+    settings[1] = FF_HTTP2_SETTINGS_HEADER_TABLE_SIZE;
+    settings[7] = FF_HTTP2_SETTINGS_ENABLE_PUSH;
+    ff_http2_buff_append(&connection->output, FF_HTTP2_PREFACE, FF_HTTP2_PREFACE_LENGTH);
+    ff_http2_frame_write(&connection->output, FF_HTTP2_FRAME_SETTINGS, 0, 0, settings, sizeof(settings));
+
+    forward->state = FF_HTTP_FORWARD_STREAMING;
+    memset(&forward->stream, 0, sizeof(struct ff_http2_stream));
+    ff_http2_stream_prepend(&connection->pending_first, &connection->pending_last, forward);
+
+    ff_log(FF_DEBUG, "Opened HTTP/2 connection to %s", connection->key);
+
+    if (ff_http2_connection_start_streams(connection))
+    {
+        ff_http2_connection_update(connection);
+    }
+
+    return true;
+}
+
+void ff_http2_connection_release(struct ff_http_forward *forward)
+{
+    struct ff_http2_connection *connection = forward->http2;
+    struct ff_http_forward *pending = NULL;
+    uint8_t error[4];
+
+    forward->http2 = NULL;
+
+    if (connection->opener == forward)
+    {
+        // The forwards waiting on it try again, the first opening a new connection
+        pending = connection->pending_first;
+        connection->pending_first = NULL;
+        connection->pending_last = NULL;
+        ff_http2_connection_close(connection);
+        ff_http2_connection_redispatch(pending);
+        return;
+    }
+
+    if (forward->stream.id == 0)
+    {
+        ff_http2_stream_remove(&connection->pending_first, &connection->pending_last, forward);
+    }
+    else
+    {
+        ff_http2_stream_remove(&connection->streams_first, &connection->streams_last, forward);
+        connection->streams_length--;
+
+        // Cancelled so the upstream stops sending the rest of the response
+        if (!forward->stream.remote_closed && connection->sockfd >= 0)
+        {
+            ff_http2_uint32_write(error, FF_HTTP2_CANCEL);
+            ff_http2_frame_write(&connection->output, FF_HTTP2_FRAME_RST_STREAM, 0, forward->stream.id, error, sizeof(error));
+        }
+    }
+
+    ff_http2_request_free(&forward->stream.request);
+
+    if (connection->state == FF_HTTP2_CONNECTION_CLOSING && connection->streams_length == 0)
+    {
+        ff_http2_connection_close(connection);
+        return;
+    }
+
+    if (ff_http2_connection_start_streams(connection) && !connection->processing && connection->sockfd >= 0)
+    {
+        ff_http2_connection_update(connection);
+    }
+}
+
+void ff_http2_connections_free(struct ff_http_engine_worker *worker)
+{
+    while (worker->http2_connections != NULL)
+    {
+        ff_http2_connection_close(worker->http2_connections);
+    }
+}
+
+void ff_http2_connection_on_event(struct ff_event_loop *loop, uint32_t events, void *context)
+{
+    struct ff_http2_connection *connection = (struct ff_http2_connection *)context;
+    bool success;
+
+    (void)loop;
+    (void)events;
+
+    connection->want_write = false;
+    connection->processing = true;
+    success = ff_http2_connection_read(connection);
+    connection->processing = false;
+
+    if (connection->closed)
+    {
+        ff_http2_connection_free(connection);
+        return;
+    }
+
+    if (!success)
+    {
+        ff_http2_connection_fail(connection);
+        return;
+    }
+
+    ff_http2_connection_update(connection);
+}
+
+bool ff_http2_connection_read(struct ff_http2_connection *connection)
+{
+    SSL *ssl = NULL;
+    int chunk;
+
+    BIO_get_ssl(connection->web, &ssl);
+
+    while (!connection->closed)
+    {
+        ERR_clear_error();
+
+        if ((chunk = SSL_read(ssl, connection->input + connection->input_length, (int)(sizeof(connection->input) - connection->input_length))) <= 0)
+        {
+            switch (SSL_get_error(ssl, chunk))
+            {
+            case SSL_ERROR_WANT_READ:
+                return true;
+
+            case SSL_ERROR_WANT_WRITE:
+                // A key update may need to be sent before reading can continue
+                connection->want_write = true;
+                return true;
+
+            default:
+                return false;
+            }
+        }
+
+        connection->input_length += (uint32_t)chunk;
+
+        if (!ff_http2_connection_process(connection))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool ff_http2_connection_process(struct ff_http2_connection *connection)
+{
+    struct ff_http2_frame_header header;
+    uint32_t offset = 0;
+
+    while (!connection->closed && connection->input_length - offset >= FF_HTTP2_FRAME_HEADER_LENGTH)
+    {
+        ff_http2_frame_header_read(connection->input + offset, &header);
+
+        // SETTINGS_MAX_FRAME_SIZE is left at its default
+        if (header.length > FF_HTTP2_DEFAULT_MAX_FRAME_SIZE)
+        {
+            ff_log(FF_WARNING, "Received oversized HTTP/2 frame from %s (%u bytes)", connection->key, header.length);
+            return false;
+        }
+
+        if (connection->input_length - offset < FF_HTTP2_FRAME_HEADER_LENGTH + header.length)
+        {
+            break;
+        }
+
+        if (!ff_http2_connection_frame_received(connection, &header, connection->input + offset + FF_HTTP2_FRAME_HEADER_LENGTH))
+        {
+            return false;
+        }
+
+        offset += FF_HTTP2_FRAME_HEADER_LENGTH + header.length;
+    }
+
+    memmove(connection->input, connection->input + offset, connection->input_length - offset);
+    connection->input_length -= offset;
+
+    return true;
+}
+
+bool ff_http2_connection_frame_received(struct ff_http2_connection *connection, struct ff_http2_frame_header *header, uint8_t *payload)
+{
+    struct ff_http_forward *forward = NULL;
+    uint8_t increment[4];
+
+    // A header block can't be interleaved with other frames
+    if (connection->header_block_stream != 0 && header->type != FF_HTTP2_FRAME_CONTINUATION)
+    {
+        ff_log(FF_WARNING, "Received interleaved header block from %s", connection->key);
+        return false;
+    }
+
+    switch (header->type)
+    {
+    case FF_HTTP2_FRAME_DATA:
+        if (header->stream_id == 0)
+        {
+            break;
+        }
+
+        // Padding counts towards flow control too
+        if ((connection->received += header->length) >= FF_HTTP2_CONNECTION_WINDOW_UPDATE_THRESHOLD)
+        {
+            ff_http2_uint32_write(increment, connection->received);
+            ff_http2_frame_write(&connection->output, FF_HTTP2_FRAME_WINDOW_UPDATE, 0, 0, increment, sizeof(increment));
+            connection->received = 0;
+        }
+
+        if ((header->flags & FF_HTTP2_FLAG_END_STREAM) && (forward = ff_http2_connection_stream(connection, header->stream_id)) != NULL)
+        {
+            forward->stream.remote_closed = true;
+        }
+
+        return true;
+
+    case FF_HTTP2_FRAME_HEADERS:
+        return ff_http2_connection_headers_received(connection, header, payload);
+
+    case FF_HTTP2_FRAME_CONTINUATION:
+        return ff_http2_connection_continuation_received(connection, header, payload);
+
+    case FF_HTTP2_FRAME_SETTINGS:
+        return ff_http2_connection_settings_received(connection, header, payload);
+
+    case FF_HTTP2_FRAME_WINDOW_UPDATE:
+        return ff_http2_connection_window_update_received(connection, header, payload);
+
+    case FF_HTTP2_FRAME_PING:
+        if (header->stream_id != 0 || header->length != 8)
+        {
+            break;
+        }
+
+        if (!(header->flags & FF_HTTP2_FLAG_ACK))
+        {
+            ff_http2_frame_write(&connection->output, FF_HTTP2_FRAME_PING, FF_HTTP2_FLAG_ACK, 0, payload, header->length);
+        }
+
+        return true;
+
+    case FF_HTTP2_FRAME_RST_STREAM:
+        if (header->stream_id == 0 || header->length != 4)
+        {
+            break;
+        }
+
+        if ((forward = ff_http2_connection_stream(connection, header->stream_id)) != NULL)
+        {
+            ff_http2_connection_stream_reset(connection, forward, ff_http2_uint32_read(payload));
+        }
+
+        return true;
+
+    case FF_HTTP2_FRAME_GOAWAY:
+        if (header->stream_id != 0 || header->length < 8)
+        {
+            break;
+        }
+
+        ff_log(FF_DEBUG, "Received GOAWAY from %s (last stream %u, error %u)", connection->key, ff_http2_uint32_read(payload) & FF_HTTP2_MAX_STREAM_ID, ff_http2_uint32_read(payload + 4));
+        ff_http2_connection_goaway(connection, ff_http2_uint32_read(payload) & FF_HTTP2_MAX_STREAM_ID);
+        return true;
+
+    case FF_HTTP2_FRAME_PUSH_PROMISE:
+        // Disabled by our SETTINGS
+        break;
+
+    default:
+        // PRIORITY and unknown frames are ignored
+        return true;
+    }
+
+    ff_log(FF_WARNING, "Received invalid HTTP/2 frame from %s (type %u, stream %u, %u bytes)", connection->key, header->type, header->stream_id, header->length);
+    return false;
+}
+
+bool ff_http2_connection_headers_received(struct ff_http2_connection *connection, struct ff_http2_frame_header *header, uint8_t *payload)
+{
+    uint32_t length = header->length;
+    uint32_t padding = 0;
+
+    if (header->stream_id == 0)
+    {
+        goto error;
+    }
+
+    if (header->flags & FF_HTTP2_FLAG_PADDED)
+    {
+        if (length < 1)
+        {
+            goto error;
+        }
+
+        padding = payload[0];
+        payload++;
+        length--;
+    }
+
+    // Stream dependency and weight
+    if (header->flags & FF_HTTP2_FLAG_PRIORITY)
+    {
+        if (length < 5)
+        {
+            goto error;
+        }
+
+        payload += 5;
+        length -= 5;
+    }
+
+    if (padding > length)
+    {
+        goto error;
+    }
+
+    connection->header_block.length = 0;
+    ff_http2_buff_append(&connection->header_block, payload, length - padding);
+    connection->header_block_end_stream = (header->flags & FF_HTTP2_FLAG_END_STREAM) != 0;
+
+    if (!(header->flags & FF_HTTP2_FLAG_END_HEADERS))
+    {
+        connection->header_block_stream = header->stream_id;
+        return true;
+    }
+
+    return ff_http2_connection_response_received(connection, header->stream_id);
+
+error:
+    ff_log(FF_WARNING, "Received invalid HTTP/2 HEADERS frame from %s", connection->key);
+    return false;
+}
+
+bool ff_http2_connection_continuation_received(struct ff_http2_connection *connection, struct ff_http2_frame_header *header, uint8_t *payload)
+{
+    if (header->stream_id == 0 || header->stream_id != connection->header_block_stream)
+    {
+        ff_log(FF_WARNING, "Received unexpected HTTP/2 CONTINUATION frame from %s", connection->key);
+        return false;
+    }
+
+    if (connection->header_block.length + header->length > FF_HTTP2_MAX_HEADER_BLOCK)
+    {
+        ff_log(FF_WARNING, "Received oversized HTTP/2 header block from %s", connection->key);
+        return false;
+    }
+
+    ff_http2_buff_append(&connection->header_block, payload, header->length);
+
+    if (!(header->flags & FF_HTTP2_FLAG_END_HEADERS))
+    {
+        return true;
+    }
+
+    connection->header_block_stream = 0;
+
+    return ff_http2_connection_response_received(connection, header->stream_id);
+}
+
+bool ff_http2_connection_response_received(struct ff_http2_connection *connection, uint32_t stream_id)
+{
+    struct ff_http_forward *forward = NULL;
+    uint16_t status = 0;
+
+    // Decoded even when the stream is no longer wanted, the block may be malformed
+    if (!ff_http2_response_status(connection->header_block.data, connection->header_block.length, &status))
+    {
+        ff_log(FF_WARNING, "Failed to decode HTTP/2 response headers from %s", connection->key);
+        return false;
+    }
+
+    if ((forward = ff_http2_connection_stream(connection, stream_id)) == NULL)
+    {
+        return true;
+    }
+
+    forward->stream.remote_closed = connection->header_block_end_stream;
+
+    // Interim responses come before the final one
+    if (status >= 100 && status < 200)
+    {
+        return true;
+    }
+
+    if (status == 0)
+    {
+        ff_log(FF_WARNING, "Received response without a status from host: %s", forward->host_name);
+        ff_http_forward_finish(forward, false);
+        return true;
+    }
+
+    forward->framer.response.status = status;
+    snprintf(forward->framer.response.status_line, sizeof(forward->framer.response.status_line), "HTTP/2 %u", status);
+    ff_log(FF_DEBUG, "Response: %s (stream %u)", forward->framer.response.status_line, stream_id);
+
+    // The rest of the response isn't needed, the stream is cancelled as the forward finishes
+    ff_http_forward_finish(forward, true);
+
+    return true;
+}
+
+bool ff_http2_connection_settings_received(struct ff_http2_connection *connection, struct ff_http2_frame_header *header, uint8_t *payload)
+{
+    struct ff_http_forward *forward = NULL;
+    uint16_t setting;
+    uint32_t value;
+
+    if (header->stream_id != 0)
+    {
+        goto error;
+    }
+
+    if (header->flags & FF_HTTP2_FLAG_ACK)
+    {
+        return header->length == 0;
+    }
+
+    if (header->length % 6 != 0)
+    {
+        goto error;
+    }
+
+    // Until the first SETTINGS only one stream is opened, an upstream which doesn't set a limit has no limit
+    if (!connection->settings_received)
+    {
+        connection->settings_received = true;
+        connection->max_streams = FF_HTTP2_CONNECTION_MAX_STREAMS;
+    }
+
+    for (uint32_t offset = 0; offset < header->length; offset += 6)
+    {
+        setting = (uint16_t)(payload[offset] << 8 | payload[offset + 1]);
+        value = ff_http2_uint32_read(payload + offset + 2);
+
+        switch (setting)
+        {
+        case FF_HTTP2_SETTINGS_MAX_CONCURRENT_STREAMS:
+            connection->max_streams = value < FF_HTTP2_CONNECTION_MAX_STREAMS ? value : FF_HTTP2_CONNECTION_MAX_STREAMS;
+            break;
+
+        case FF_HTTP2_SETTINGS_INITIAL_WINDOW_SIZE:
+            if (value > FF_HTTP2_MAX_WINDOW)
+            {
+                goto error;
+            }
+
+            // Applies to the windows of streams already open too
+            for (forward = connection->streams_first; forward != NULL; forward = forward->stream.next)
+            {
+                if ((forward->stream.send_window += (int64_t)value - connection->initial_window) > FF_HTTP2_MAX_WINDOW)
+                {
+                    ff_log(FF_WARNING, "HTTP/2 stream window overflowed for %s (stream %u)", connection->key, forward->stream.id);
+                    return false;
+                }
+            }
+
+            connection->initial_window = value;
+            break;
+
+        case FF_HTTP2_SETTINGS_MAX_FRAME_SIZE:
+            if (value < FF_HTTP2_DEFAULT_MAX_FRAME_SIZE || value > FF_HTTP2_MAX_FRAME_SIZE)
+            {
+                goto error;
+            }
+
+            connection->max_frame_size = value;
+            break;
+
+        default:
+            break;
+        }
+    }
+
+    ff_http2_frame_write(&connection->output, FF_HTTP2_FRAME_SETTINGS, FF_HTTP2_FLAG_ACK, 0, NULL, 0);
+    ff_http2_connection_start_streams(connection);
+
+    return true;
+
+error:
+    ff_log(FF_WARNING, "Received invalid HTTP/2 SETTINGS frame from %s", connection->key);
+    return false;
+}
+
+bool ff_http2_connection_window_update_received(struct ff_http2_connection *connection, struct ff_http2_frame_header *header, uint8_t *payload)
+{
+    struct ff_http_forward *forward = NULL;
+    uint32_t increment;
+    uint8_t error[4];
+
+    if (header->length != 4 || (increment = ff_http2_uint32_read(payload) & FF_HTTP2_MAX_WINDOW) == 0)
+    {
+        ff_log(FF_WARNING, "Received invalid HTTP/2 WINDOW_UPDATE frame from %s", connection->key);
+        return false;
+    }
+
+    if (header->stream_id == 0)
+    {
+        if ((connection->send_window += increment) > FF_HTTP2_MAX_WINDOW)
+        {
+            ff_log(FF_WARNING, "HTTP/2 connection window overflowed for %s", connection->key);
+            return false;
+        }
+    }
+    else if ((forward = ff_http2_connection_stream(connection, header->stream_id)) != NULL &&
+             (forward->stream.send_window += increment) > FF_HTTP2_MAX_WINDOW)
+    {
+        // Only the stream is failed, it's reset rather than cancelled
+        ff_log(FF_WARNING, "HTTP/2 stream window overflowed for host: %s (stream %u)", forward->host_name, forward->stream.id);
+        ff_http2_uint32_write(error, FF_HTTP2_FLOW_CONTROL_ERROR);
+        ff_http2_frame_write(&connection->output, FF_HTTP2_FRAME_RST_STREAM, 0, forward->stream.id, error, sizeof(error));
+        forward->stream.remote_closed = true;
+        ff_http_forward_finish(forward, false);
+    }
+
+    ff_http2_connection_send_data(connection);
+
+    return true;
+}
+
+void ff_http2_connection_stream_reset(struct ff_http2_connection *connection, struct ff_http_forward *forward, uint32_t error)
+{
+    forward->stream.remote_closed = true;
+
+    if (error == FF_HTTP2_REFUSED_STREAM)
+    {
+        ff_log(FF_DEBUG, "Upstream %s refused stream %u, sending it again", connection->key, forward->stream.id);
+        ff_http2_stream_remove(&connection->streams_first, &connection->streams_last, forward);
+        connection->streams_length--;
+        forward->stream.id = 0;
+        ff_http2_stream_prepend(&connection->pending_first, &connection->pending_last, forward);
+        ff_http2_connection_start_streams(connection);
+        return;
+    }
+
+    ff_log(FF_WARNING, "Upstream reset stream for host: %s (error %u)", forward->host_name, error);
+    ff_http_forward_finish(forward, false);
+}
+
+bool ff_http2_connection_goaway(struct ff_http2_connection *connection, uint32_t last_stream_id)
+{
+    struct ff_http_forward *retry_first = NULL;
+    struct ff_http_forward *retry_last = NULL;
+    struct ff_http_forward *forward = connection->streams_first;
+    struct ff_http_forward *next = NULL;
+    bool open;
+
+    connection->state = FF_HTTP2_CONNECTION_CLOSING;
+
+    // Streams the upstream didn't process are safe to send again, before those still waiting
+    for (; forward != NULL; forward = next)
+    {
+        next = forward->stream.next;
+
+        if (forward->stream.id > last_stream_id)
+        {
+            ff_http2_stream_remove(&connection->streams_first, &connection->streams_last, forward);
+            connection->streams_length--;
+            ff_http2_stream_append(&retry_first, &retry_last, forward);
+        }
+    }
+
+    while ((forward = connection->pending_first) != NULL)
+    {
+        ff_http2_stream_remove(&connection->pending_first, &connection->pending_last, forward);
+        ff_http2_stream_append(&retry_first, &retry_last, forward);
+    }
+
+    if (!(open = connection->streams_length > 0))
+    {
+        ff_http2_connection_close(connection);
+    }
+
+    ff_http2_connection_redispatch(retry_first);
+
+    return open;
+}
+
+bool ff_http2_connection_start_streams(struct ff_http2_connection *connection)
+{
+    struct ff_http_forward *forward = NULL;
+
+    while (connection->state == FF_HTTP2_CONNECTION_OPEN &&
+           !connection->worker->stopping &&
+           (forward = connection->pending_first) != NULL &&
+           connection->streams_length < connection->max_streams)
+    {
+        if (connection->next_stream_id > FF_HTTP2_MAX_STREAM_ID)
+        {
+            // Later requests are sent over a new connection, the streams still open carry on
+            if (!ff_http2_connection_goaway(connection, FF_HTTP2_MAX_STREAM_ID))
+            {
+                return false;
+            }
+
+            break;
+        }
+
+        ff_http2_stream_remove(&connection->pending_first, &connection->pending_last, forward);
+
+        // Refused streams are sent again as already converted
+        if (forward->stream.request.headers.length == 0 && !ff_http2_request_convert(forward->request, forward->host_name, &forward->stream.request))
+        {
+            ff_log(FF_WARNING, "Failed to convert request to HTTP/2 for host: %s", forward->host_name);
+            forward->http2 = NULL;
+            ff_http_forward_finish(forward, false);
+            continue;
+        }
+
+        forward->stream.id = connection->next_stream_id;
+        forward->stream.send_window = connection->initial_window;
+        forward->stream.body_sent = 0;
+        forward->stream.remote_closed = false;
+        connection->next_stream_id += 2;
+        ff_http2_stream_append(&connection->streams_first, &connection->streams_last, forward);
+        connection->streams_length++;
+
+        ff_http2_connection_headers_write(connection, forward);
+        clock_gettime(CLOCK_MONOTONIC, &forward->written);
+        FF_STATS_INC(upstream_http2_streams_opened);
+    }
+
+    ff_http2_connection_send_data(connection);
+
+    return true;
+}
+
+void ff_http2_connection_headers_write(struct ff_http2_connection *connection, struct ff_http_forward *forward)
+{
+    struct ff_http2_buff *headers = &forward->stream.request.headers;
+    uint32_t offset = 0;
+    uint32_t chunk;
+    uint8_t flags;
+
+    do
+    {
+        chunk = headers->length - offset < connection->max_frame_size ? headers->length - offset : connection->max_frame_size;
+        flags = offset + chunk == headers->length ? FF_HTTP2_FLAG_END_HEADERS : 0;
+
+        if (offset == 0)
+        {
+            flags |= forward->stream.request.body.length == 0 ? FF_HTTP2_FLAG_END_STREAM : 0;
+        }
+
+        ff_http2_frame_write(
+            &connection->output,
+            offset == 0 ? FF_HTTP2_FRAME_HEADERS : FF_HTTP2_FRAME_CONTINUATION,
+            flags,
+            forward->stream.id,
+            headers->data + offset,
+            chunk);
+
+        offset += chunk;
+    } while (offset < headers->length);
+}
+
+void ff_http2_connection_send_data(struct ff_http2_connection *connection)
+{
+    struct ff_http_forward *forward = NULL;
+    struct ff_http2_stream *stream = NULL;
+    int64_t chunk;
+
+    for (forward = connection->streams_first; forward != NULL; forward = forward->stream.next)
+    {
+        stream = &forward->stream;
+
+        while (stream->body_sent < stream->request.body.length && stream->send_window > 0 && connection->send_window > 0)
+        {
+            chunk = stream->request.body.length - stream->body_sent;
+            chunk = chunk < stream->send_window ? chunk : stream->send_window;
+            chunk = chunk < connection->send_window ? chunk : connection->send_window;
+            chunk = chunk < connection->max_frame_size ? chunk : connection->max_frame_size;
+
+            ff_http2_frame_write(
+                &connection->output,
+                FF_HTTP2_FRAME_DATA,
+                stream->body_sent + chunk == stream->request.body.length ? FF_HTTP2_FLAG_END_STREAM : 0,
+                stream->id,
+                stream->request.body.data + stream->body_sent,
+                (uint32_t)chunk);
+
+            stream->body_sent += (uint32_t)chunk;
+            stream->send_window -= chunk;
+            connection->send_window -= chunk;
+
+            if (stream->body_sent == stream->request.body.length)
+            {
+                clock_gettime(CLOCK_MONOTONIC, &forward->written);
+            }
+        }
+    }
+}
+
+bool ff_http2_connection_flush(struct ff_http2_connection *connection)
+{
+    SSL *ssl = NULL;
+    int chunk;
+
+    BIO_get_ssl(connection->web, &ssl);
+
+    while (connection->output_sent < connection->output.length)
+    {
+        ERR_clear_error();
+
+        if ((chunk = SSL_write(ssl, connection->output.data + connection->output_sent, (int)(connection->output.length - connection->output_sent))) <= 0)
+        {
+            switch (SSL_get_error(ssl, chunk))
+            {
+            case SSL_ERROR_WANT_WRITE:
+            case SSL_ERROR_WANT_READ:
+                return true;
+
+            default:
+                ff_log(FF_WARNING, "Failed to write to HTTP/2 connection: %s", connection->key);
+                return false;
+            }
+        }
+
+        connection->output_sent += (uint32_t)chunk;
+    }
+
+    connection->output.length = 0;
+    connection->output_sent = 0;
+
+    return true;
+}
+
+void ff_http2_connection_update(struct ff_http2_connection *connection)
+{
+    uint32_t events = EPOLLIN;
+
+    if (!ff_http2_connection_flush(connection))
+    {
+        ff_http2_connection_fail(connection);
+        return;
+    }
+
+    if (connection->output_sent < connection->output.length || connection->want_write)
+    {
+        events |= EPOLLOUT;
+    }
+
+    if (!ff_event_loop_watch(connection->worker->loop, &connection->watch, events))
+    {
+        ff_log(FF_ERROR, "Failed to watch HTTP/2 connection to %s", connection->key);
+        ff_http2_connection_fail(connection);
+    }
+}
+
+void ff_http2_connection_fail(struct ff_http2_connection *connection)
+{
+    struct ff_http_forward *streams = connection->streams_first;
+    struct ff_http_forward *pending = connection->pending_first;
+    struct ff_http_forward *next = NULL;
+
+    if (connection->streams_length > 0)
+    {
+        ff_log(FF_WARNING, "HTTP/2 connection to %s failed with %u streams open", connection->key, connection->streams_length);
+    }
+    else
+    {
+        ff_log(FF_DEBUG, "HTTP/2 connection to %s closed", connection->key);
+    }
+
+    connection->streams_first = NULL;
+    connection->streams_last = NULL;
+    connection->streams_length = 0;
+    connection->pending_first = NULL;
+    connection->pending_last = NULL;
+    ff_http2_connection_close(connection);
+
+    // Open streams may have been processed so are failed, those waiting are sent on a new connection
+    for (; streams != NULL; streams = next)
+    {
+        next = streams->stream.next;
+        streams->http2 = NULL;
+        ff_http2_request_free(&streams->stream.request);
+        ff_http_forward_finish(streams, false);
+    }
+
+    ff_http2_connection_redispatch(pending);
+}
+
+void ff_http2_connection_close(struct ff_http2_connection *connection)
+{
+    struct ff_http_engine_worker *worker = connection->worker;
+
+    if (!connection->closed)
+    {
+        connection->closed = true;
+
+        if (connection->prev == NULL)
+        {
+            worker->http2_connections = connection->next;
+        }
+        else
+        {
+            connection->prev->next = connection->next;
+        }
+
+        if (connection->next != NULL)
+        {
+            connection->next->prev = connection->prev;
+        }
+    }
+
+    // Otherwise freed once the frames being handled are done with it
+    if (!connection->processing)
+    {
+        ff_http2_connection_free(connection);
+    }
+}
+
+void ff_http2_connection_free(struct ff_http2_connection *connection)
+{
+    if (connection->web != NULL)
+    {
+        ff_event_loop_unwatch(connection->worker->loop, &connection->watch);
+        ff_http_tls_connection_close(connection->sockfd, (void *)connection->web);
+    }
+
+    ff_http2_buff_free(&connection->output);
+    ff_http2_buff_free(&connection->header_block);
+    FREE(connection);
+}
+
+void ff_http2_connection_redispatch(struct ff_http_forward *forwards)
+{
+    struct ff_http_forward *next = NULL;
+
+    for (; forwards != NULL; forwards = next)
+    {
+        next = forwards->stream.next;
+        forwards->http2 = NULL;
+        ff_http2_request_free(&forwards->stream.request);
+        memset(&forwards->stream, 0, sizeof(struct ff_http2_stream));
+        ff_http_forward_dispatch(forwards);
+    }
+}
+
+struct ff_http_forward *ff_http2_connection_stream(struct ff_http2_connection *connection, uint32_t stream_id)
+{
+    struct ff_http_forward *forward;
+
+    for (forward = connection->streams_first; forward != NULL; forward = forward->stream.next)
+    {
+        if (forward->stream.id == stream_id)
+        {
+            return forward;
+        }
+    }
+
+    return NULL;
+}
+
+void ff_http2_stream_append(struct ff_http_forward **first, struct ff_http_forward **last, struct ff_http_forward *forward)
+{
+    forward->stream.prev = *last;
+    forward->stream.next = NULL;
+
+    if (*last != NULL)
+    {
+        (*last)->stream.next = forward;
+    }
+    else
+    {
+        *first = forward;
+    }
+
+    *last = forward;
+}
+
+void ff_http2_stream_prepend(struct ff_http_forward **first, struct ff_http_forward **last, struct ff_http_forward *forward)
+{
+    forward->stream.prev = NULL;
+    forward->stream.next = *first;
+
+    if (*first != NULL)
+    {
+        (*first)->stream.prev = forward;
+    }
+    else
+    {
+        *last = forward;
+    }
+
+    *first = forward;
+}
+
+void ff_http2_stream_remove(struct ff_http_forward **first, struct ff_http_forward **last, struct ff_http_forward *forward)
+{
+    if (forward->stream.prev != NULL)
+    {
+        forward->stream.prev->stream.next = forward->stream.next;
+    }
+    else
+    {
+        *first = forward->stream.next;
+    }
+
+    if (forward->stream.next != NULL)
+    {
+        forward->stream.next->stream.prev = forward->stream.prev;
+    }
+    else
+    {
+        *last = forward->stream.prev;
+    }
+
+    forward->stream.prev = NULL;
+    forward->stream.next = NULL;
+}
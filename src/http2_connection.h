@@ -0,0 +1,120 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <limits.h>
+#include <openssl/ssl.h>
+#include "event_loop.h"
+#include "http2.h"
+#include "http_engine.h"
+
+#ifndef FF_HTTP2_CONNECTION_H
+#define FF_HTTP2_CONNECTION_H
+
+// Streams opened before the upstream's SETTINGS say how many it allows
+#define FF_HTTP2_CONNECTION_INITIAL_STREAMS 1
+// Limits upstreams which allow unlimited streams
+#define FF_HTTP2_CONNECTION_MAX_STREAMS 256
+// Received DATA is acknowledged once this much of the connection window is used
+#define FF_HTTP2_CONNECTION_WINDOW_UPDATE_THRESHOLD (FF_HTTP2_DEFAULT_WINDOW / 2)
+// Seconds an upstream which didn't negotiate h2 is sent HTTP/1.1 before it's tried again
+#define FF_HTTP2_CONNECTION_HTTP1_SECS 300
+
+enum ff_http2_connection_state
+{
+    // The first forward to the host is connecting and negotiating the protocol
+    FF_HTTP2_CONNECTION_OPENING = 1,
+    FF_HTTP2_CONNECTION_OPEN = 2,
+    // The upstream sent GOAWAY, streams already open finish but no more are opened
+    FF_HTTP2_CONNECTION_CLOSING = 3,
+    // The upstream didn't negotiate h2, its requests are sent over HTTP/1.1 until http1_until
+    FF_HTTP2_CONNECTION_HTTP1 = 4
+};
+
+/**
+ * A worker's connection to an HTTPS upstream which requests are multiplexed
+ * over as streams, within the upstream's concurrency limit and flow control
+ * windows. Opened by the first forward to the host over TLS with ALPN,
+ * forwards arriving meanwhile wait for it. Only a response's HEADERS are
+ * read, the rest of the stream is cancelled.
+ */
+struct ff_http2_connection
+{
+    struct ff_http_engine_worker *worker;
+    enum ff_http2_connection_state state;
+    time_t http1_until;
+    // The forwards' connection key, host and port
+    char key[_POSIX_HOST_NAME_MAX + 8];
+    // The forward opening the connection
+    struct ff_http_forward *opener;
+    int sockfd;
+    BIO *web;
+    struct ff_event_loop_watch watch;
+    // TLS wants the socket writable before it can read
+    bool want_write;
+    // Frames waiting to be written
+    struct ff_http2_buff output;
+    uint32_t output_sent;
+    uint8_t input[FF_HTTP2_FRAME_HEADER_LENGTH + FF_HTTP2_DEFAULT_MAX_FRAME_SIZE];
+    uint32_t input_length;
+    // A response header block continued in CONTINUATION frames
+    struct ff_http2_buff header_block;
+    uint32_t header_block_stream;
+    bool header_block_end_stream;
+    bool settings_received;
+    uint32_t next_stream_id;
+    // The upstream's settings
+    uint32_t max_streams;
+    uint32_t initial_window;
+    uint32_t max_frame_size;
+    int64_t send_window;
+    // DATA received but not yet acknowledged with a WINDOW_UPDATE
+    uint32_t received;
+    uint32_t streams_length;
+    struct ff_http_forward *streams_first;
+    struct ff_http_forward *streams_last;
+    // Waiting for the connection to open or for a stream, in order
+    struct ff_http_forward *pending_first;
+    struct ff_http_forward *pending_last;
+    // Frames are being handled, closing is left until they are
+    bool processing;
+    bool closed;
+    struct ff_http2_connection *prev;
+    struct ff_http2_connection *next;
+};
+
+/**
+ * Starts a connection to the host which the forward will open
+ */
+struct ff_http2_connection *ff_http2_connection_init(struct ff_http_engine_worker *worker, const char *key, struct ff_http_forward *opener);
+
+/**
+ * Returns the worker's connection for the key, excluding those closing.
+ * An expired HTTP/1.1 marker is closed so the upstream is tried again.
+ */
+struct ff_http2_connection *ff_http2_connection_find(struct ff_http_engine_worker *worker, const char *key);
+
+/**
+ * Sends the forward's request as a stream once the connection is open and
+ * the upstream allows another
+ */
+void ff_http2_connection_submit(struct ff_http2_connection *connection, struct ff_http_forward *forward);
+
+/**
+ * Called once the opener's TLS handshake has finished. If the upstream
+ * negotiated h2 the connection takes over the opener's socket and sends its
+ * request as the first stream, otherwise the opener carries on over
+ * HTTP/1.1 and false is returned.
+ */
+bool ff_http2_connection_opened(struct ff_http_forward *forward);
+
+/**
+ * Detaches a finishing forward, cancelling its stream if it's open, or
+ * retrying the forwards waiting on a connection it failed to open
+ */
+void ff_http2_connection_release(struct ff_http_forward *forward);
+
+/**
+ * Closes the worker's connections, which have no streams left
+ */
+void ff_http2_connections_free(struct ff_http_engine_worker *worker);
+
+#endif
@@ -0,0 +1,101 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include "http2_connection.h"
+
+#ifndef FF_HTTP2_CONNECTION_P_H
+#define FF_HTTP2_CONNECTION_P_H
+
+void ff_http2_connection_on_event(struct ff_event_loop *loop, uint32_t events, void *context);
+
+/**
+ * Reads and handles frames until the connection has nothing ready, returns
+ * false if it failed or was closed by the upstream
+ */
+bool ff_http2_connection_read(struct ff_http2_connection *connection);
+
+/**
+ * Handles the complete frames buffered, keeping any partial one
+ */
+bool ff_http2_connection_process(struct ff_http2_connection *connection);
+
+bool ff_http2_connection_frame_received(struct ff_http2_connection *connection, struct ff_http2_frame_header *header, uint8_t *payload);
+
+bool ff_http2_connection_headers_received(struct ff_http2_connection *connection, struct ff_http2_frame_header *header, uint8_t *payload);
+
+bool ff_http2_connection_continuation_received(struct ff_http2_connection *connection, struct ff_http2_frame_header *header, uint8_t *payload);
+
+/**
+ * Finishes the stream's forward once its final response header block has arrived
+ */
+bool ff_http2_connection_response_received(struct ff_http2_connection *connection, uint32_t stream_id);
+
+bool ff_http2_connection_settings_received(struct ff_http2_connection *connection, struct ff_http2_frame_header *header, uint8_t *payload);
+
+bool ff_http2_connection_window_update_received(struct ff_http2_connection *connection, struct ff_http2_frame_header *header, uint8_t *payload);
+
+/**
+ * Fails the stream's forward, or sends it again if the upstream refused it before processing it
+ */
+void ff_http2_connection_stream_reset(struct ff_http2_connection *connection, struct ff_http_forward *forward, uint32_t error);
+
+/**
+ * Stops opening streams, sending those after last_stream_id and those
+ * waiting again on a new connection. Returns false if no streams were left
+ * open so the connection was closed, it may have been freed.
+ */
+bool ff_http2_connection_goaway(struct ff_http2_connection *connection, uint32_t last_stream_id);
+
+/**
+ * Opens streams for waiting forwards while the upstream allows more. Returns
+ * false if running out of stream IDs closed the connection, it may have
+ * been freed.
+ */
+bool ff_http2_connection_start_streams(struct ff_http2_connection *connection);
+
+/**
+ * Queues the stream's header block, split into CONTINUATION frames beyond the upstream's frame size
+ */
+void ff_http2_connection_headers_write(struct ff_http2_connection *connection, struct ff_http_forward *forward);
+
+/**
+ * Queues as much of the streams' bodies as their flow control windows allow
+ */
+void ff_http2_connection_send_data(struct ff_http2_connection *connection);
+
+/**
+ * Writes queued frames until the socket would block, returns false if it failed
+ */
+bool ff_http2_connection_flush(struct ff_http2_connection *connection);
+
+/**
+ * Flushes the connection and waits for it to become readable, or writable
+ * while frames are queued, failing it on error
+ */
+void ff_http2_connection_update(struct ff_http2_connection *connection);
+
+/**
+ * Closes the connection, failing its open streams and sending those waiting again
+ */
+void ff_http2_connection_fail(struct ff_http2_connection *connection);
+
+/**
+ * Removes the connection from its worker, it's freed once its frames are no longer being handled
+ */
+void ff_http2_connection_close(struct ff_http2_connection *connection);
+
+void ff_http2_connection_free(struct ff_http2_connection *connection);
+
+/**
+ * Dispatches forwards taken from a connection again, they no longer belong to it
+ */
+void ff_http2_connection_redispatch(struct ff_http_forward *forwards);
+
+struct ff_http_forward *ff_http2_connection_stream(struct ff_http2_connection *connection, uint32_t stream_id);
+
+void ff_http2_stream_append(struct ff_http_forward **first, struct ff_http_forward **last, struct ff_http_forward *forward);
+
+void ff_http2_stream_prepend(struct ff_http_forward **first, struct ff_http_forward **last, struct ff_http_forward *forward);
+
+void ff_http2_stream_remove(struct ff_http_forward **first, struct ff_http_forward **last, struct ff_http_forward *forward);
+
+#endif
@@ -0,0 +1,68 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "http2.h"
+
+#ifndef FF_HTTP2_P_H
+#define FF_HTTP2_P_H
+
+#define FF_HTTP2_BUFF_INITIAL_CAPACITY 256
+#define FF_HTTP2_STATIC_TABLE_LENGTH 61
+#define FF_HTTP2_MAX_HEADER_NAME_LENGTH 256
+
+struct ff_http2_static_header
+{
+    const char *name;
+    const char *value;
+};
+
+/**
+ * Writes an HPACK integer into the low prefix_bits of a byte starting with first (RFC 7541 5.1)
+ */
+void ff_http2_hpack_integer_write(struct ff_http2_buff *buff, uint8_t first, uint8_t prefix_bits, uint32_t value);
+
+bool ff_http2_hpack_integer_read(const uint8_t **pos, const uint8_t *end, uint8_t prefix_bits, uint32_t *value);
+
+/**
+ * Writes a string literal without Huffman coding
+ */
+void ff_http2_hpack_string_write(struct ff_http2_buff *buff, const char *value, size_t length);
+
+/**
+ * Reads a string literal, pointing value at its still encoded bytes
+ */
+bool ff_http2_hpack_string_read(const uint8_t **pos, const uint8_t *end, const uint8_t **value, uint32_t *length, bool *huffman);
+
+/**
+ * Writes a header with a lower case name, using the static table where it
+ * has the name or the whole field and never the dynamic table
+ */
+void ff_http2_hpack_header_write(struct ff_http2_buff *buff, const char *name, const char *value, size_t value_length);
+
+/**
+ * Parses a :status value, which is three digits so only their Huffman codes are decoded
+ */
+bool ff_http2_hpack_status_parse(const uint8_t *value, uint32_t length, bool huffman, uint16_t *status);
+
+/**
+ * Returns true if the header is specific to the HTTP/1.1 connection and
+ * must not be sent over HTTP/2, including those listed by its Connection header
+ */
+bool ff_http2_header_excluded(const char *name, const char *value, size_t value_length, char *connection);
+
+/**
+ * Parses the header line, lower casing its name into name and trimming its value
+ */
+bool ff_http2_header_parse(char *line, char *line_end, char *name, const char **value, size_t *value_length);
+
+/**
+ * Returns the end of the line's content, before the CR of a CRLF
+ */
+char *ff_http2_line_end(char *line, char *next_line);
+
+/**
+ * Appends the body with its chunked transfer coding removed, trailers are dropped
+ */
+bool ff_http2_request_dechunk(char *body, char *end, struct ff_http2_buff *decoded);
+
+#endif
@@ -0,0 +1,288 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <linux/sockios.h>
+#include "http_completion.h"
+#include "http_completion_p.h"
+#include "stats.h"
+#include "logging.h"
+#include "alloc.h"
+
+// Indexed by policy
+static uint64_t ff_http_completions[FF_HTTP_COMPLETION_POLICIES + 1] = {0};
+static uint64_t ff_http_completion_usecs[FF_HTTP_COMPLETION_POLICIES + 1] = {0};
+
+const char *ff_http_completion_policy_name(enum ff_http_completion_policy policy)
+{
+    switch (policy)
+    {
+    case FF_HTTP_COMPLETION_RESPONSE:
+        return "response";
+
+    case FF_HTTP_COMPLETION_STATUS:
+        return "status";
+
+    case FF_HTTP_COMPLETION_ACKED:
+        return "acked";
+
+    case FF_HTTP_COMPLETION_DRAIN:
+        return "drain";
+
+    default:
+        return "unknown";
+    }
+}
+
+uint64_t ff_http_completion_usecs_since(struct timespec *start)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (uint64_t)(now.tv_sec - start->tv_sec) * 1000000 + (uint64_t)((now.tv_nsec - start->tv_nsec) / 1000);
+}
+
+void ff_http_completion_record(enum ff_http_completion_policy policy, struct timespec *written)
+{
+    if (policy < FF_HTTP_COMPLETION_RESPONSE || policy > FF_HTTP_COMPLETION_DRAIN)
+    {
+        return;
+    }
+
+    __atomic_add_fetch(&ff_http_completions[policy], 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&ff_http_completion_usecs[policy], ff_http_completion_usecs_since(written), __ATOMIC_RELAXED);
+}
+
+void ff_http_completion_print_stats(FILE *fd, void *context)
+{
+    uint64_t completions;
+
+    (void)context;
+
+    for (int policy = FF_HTTP_COMPLETION_RESPONSE; policy <= FF_HTTP_COMPLETION_DRAIN; policy++)
+    {
+        if ((completions = __atomic_load_n(&ff_http_completions[policy], __ATOMIC_RELAXED)) == 0)
+        {
+            continue;
+        }
+
+        fprintf(fd, "upstream_completions[%s] %lu\n", ff_http_completion_policy_name(policy), (unsigned long)completions);
+        fprintf(fd, "upstream_completion_avg_usecs[%s] %lu\n",
+                ff_http_completion_policy_name(policy),
+                (unsigned long)(__atomic_load_n(&ff_http_completion_usecs[policy], __ATOMIC_RELAXED) / completions));
+    }
+}
+
+enum ff_http_ack_state ff_http_check_acked(int sockfd)
+{
+    struct tcp_info info;
+    socklen_t info_length = sizeof(info);
+    int error = 0;
+    socklen_t error_length = sizeof(error);
+    int unacknowledged = 0;
+
+    if (getsockopt(sockfd, SOL_SOCKET, SO_ERROR, &error, &error_length) != 0 || error != 0 ||
+        getsockopt(sockfd, IPPROTO_TCP, TCP_INFO, &info, &info_length) != 0 ||
+        (info.tcpi_state != TCP_ESTABLISHED && info.tcpi_state != TCP_CLOSE_WAIT))
+    {
+        return FF_HTTP_ACK_FAILED;
+    }
+
+    // For TCP the output queue holds bytes sent but not yet acknowledged as well as unsent ones
+    if (ioctl(sockfd, SIOCOUTQ, &unacknowledged) != 0)
+    {
+        return FF_HTTP_ACK_FAILED;
+    }
+
+    return unacknowledged == 0 && info.tcpi_unacked == 0 ? FF_HTTP_ACK_DONE : FF_HTTP_ACK_PENDING;
+}
+
+bool ff_http_wait_acked(int sockfd, uint32_t timeout_ms)
+{
+    struct timespec start;
+    uint32_t backoff = 1000;
+    enum ff_http_ack_state state;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    while ((state = ff_http_check_acked(sockfd)) == FF_HTTP_ACK_PENDING)
+    {
+        if (ff_http_completion_usecs_since(&start) >= (uint64_t)timeout_ms * 1000)
+        {
+            FF_STATS_INC(upstream_acks_timed_out);
+            return false;
+        }
+
+        usleep(backoff);
+        backoff = backoff * 2 > FF_HTTP_ACK_MAX_POLL_USECS ? FF_HTTP_ACK_MAX_POLL_USECS : backoff * 2;
+    }
+
+    return state == FF_HTTP_ACK_DONE;
+}
+
+struct ff_http_drainer *ff_http_drainer_init(uint32_t timeout_ms)
+{
+    struct ff_http_drainer *drainer = calloc(1, sizeof(struct ff_http_drainer));
+
+    drainer->timeout_ms = timeout_ms;
+
+    if ((drainer->loop = ff_event_loop_init()) == NULL)
+    {
+        FREE(drainer);
+        return NULL;
+    }
+
+    return drainer;
+}
+
+void ff_http_drainer_submit(struct ff_http_drainer *drainer, int sockfd, void *context, ff_http_drain_read read, ff_http_drain_close close)
+{
+    struct ff_http_drain *drain = calloc(1, sizeof(struct ff_http_drain));
+
+    drain->drainer = drainer;
+    drain->sockfd = sockfd;
+    drain->context = context;
+    drain->read = read;
+    drain->close = close;
+    clock_gettime(CLOCK_MONOTONIC, &drain->started);
+
+    FF_STATS_INC(upstream_drains_active);
+    ff_event_loop_post(drainer->loop, ff_http_drain_start, (void *)drain);
+}
+
+void ff_http_drain_start(struct ff_event_loop *loop, void *context)
+{
+    struct ff_http_drain *drain = (struct ff_http_drain *)context;
+    struct ff_http_drainer *drainer = drain->drainer;
+
+    drain->next = drainer->active;
+
+    if (drainer->active != NULL)
+    {
+        drainer->active->prev = drain;
+    }
+
+    drainer->active = drain;
+
+    fcntl(drain->sockfd, F_SETFL, fcntl(drain->sockfd, F_GETFL) | O_NONBLOCK);
+    ff_event_loop_watch_init(&drain->watch, drain->sockfd, ff_http_drain_on_readable, (void *)drain);
+    ff_event_loop_timer_init(&drain->timer, ff_http_drain_on_timeout, (void *)drain);
+
+    if (!ff_event_loop_watch(loop, &drain->watch, EPOLLIN))
+    {
+        ff_http_drain_finish(drain, false);
+        return;
+    }
+
+    ff_event_loop_timer_start(loop, &drain->timer, drainer->timeout_ms);
+
+    // TLS may have buffered part of the response already, which the socket won't report
+    ff_http_drain_on_readable(loop, EPOLLIN, (void *)drain);
+}
+
+void ff_http_drain_on_readable(struct ff_event_loop *loop, uint32_t events, void *context)
+{
+    struct ff_http_drain *drain = (struct ff_http_drain *)context;
+    char buff[FF_HTTP_DRAIN_BUFF_SIZE];
+    ssize_t chunk;
+
+    (void)loop;
+    (void)events;
+
+    while ((chunk = drain->read(drain->sockfd, drain->context, buff, sizeof(buff))) > 0)
+    {
+        drain->received += (uint64_t)chunk;
+
+        if (memchr(buff, '\n', (size_t)chunk) != NULL)
+        {
+            ff_http_drain_finish(drain, true);
+            return;
+        }
+    }
+
+    if (chunk < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+    {
+        return;
+    }
+
+    ff_log(FF_DEBUG, "Upstream connection closed while draining (%lu bytes received)", (unsigned long)drain->received);
+    ff_http_drain_finish(drain, false);
+}
+
+void ff_http_drain_on_timeout(struct ff_event_loop *loop, void *context)
+{
+    struct ff_http_drain *drain = (struct ff_http_drain *)context;
+
+    (void)loop;
+
+    ff_log(FF_DEBUG, "Timed out draining upstream connection (%lu bytes received)", (unsigned long)drain->received);
+    FF_STATS_INC(upstream_drains_timed_out);
+    ff_http_drain_finish(drain, false);
+}
+
+void ff_http_drain_finish(struct ff_http_drain *drain, bool complete)
+{
+    struct ff_http_drainer *drainer = drain->drainer;
+
+    if (complete)
+    {
+        FF_STATS_INC(upstream_drains_completed);
+        FF_STATS_ADD(upstream_drain_usecs, ff_http_completion_usecs_since(&drain->started));
+    }
+
+    if (drain->prev == NULL)
+    {
+        drainer->active = drain->next;
+    }
+    else
+    {
+        drain->prev->next = drain->next;
+    }
+
+    if (drain->next != NULL)
+    {
+        drain->next->prev = drain->prev;
+    }
+
+    ff_event_loop_unwatch(drainer->loop, &drain->watch);
+    ff_event_loop_timer_stop(drainer->loop, &drain->timer);
+    drain->close(drain->sockfd, drain->context);
+    FF_STATS_DEC(upstream_drains_active);
+
+    FREE(drain);
+}
+
+void ff_http_drainer_close_all(struct ff_event_loop *loop, void *context)
+{
+    struct ff_http_drainer *drainer = (struct ff_http_drainer *)context;
+
+    (void)loop;
+
+    while (drainer->active != NULL)
+    {
+        ff_http_drain_finish(drainer->active, false);
+    }
+}
+
+void ff_http_drainer_free(struct ff_http_drainer *drainer)
+{
+    if (drainer == NULL)
+    {
+        return;
+    }
+
+    // Drains submitted before this are started first, the loop runs tasks in order
+    ff_event_loop_call(drainer->loop, ff_http_drainer_close_all, (void *)drainer);
+    ff_event_loop_free(drainer->loop);
+    FREE(drainer);
+}
@@ -0,0 +1,118 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+#include <sys/types.h>
+#include "event_loop.h"
+
+#ifndef FF_HTTP_COMPLETION_H
+#define FF_HTTP_COMPLETION_H
+
+#define FF_HTTP_COMPLETION_POLICIES 4
+
+/**
+ * When a forwarded request is considered complete and its thread is released
+ */
+enum ff_http_completion_policy
+{
+    // Wait for the response, read in full when the connection is pooled
+    FF_HTTP_COMPLETION_RESPONSE = 1,
+    // Read only the status line, waiting at most the completion timeout
+    FF_HTTP_COMPLETION_STATUS = 2,
+    // Close once the upstream has acknowledged every byte of the request
+    FF_HTTP_COMPLETION_ACKED = 3,
+    // Hand the connection to the drainer, which reads the status line in the background
+    FF_HTTP_COMPLETION_DRAIN = 4
+};
+
+/**
+ * How far the upstream has acknowledged the bytes sent on a connection
+ */
+enum ff_http_ack_state
+{
+    FF_HTTP_ACK_PENDING = 1,
+    FF_HTTP_ACK_DONE = 2,
+    // The connection failed, or its state couldn't be read
+    FF_HTTP_ACK_FAILED = 3
+};
+
+/**
+ * Non-blocking read for the drainer, returns -1 with errno EAGAIN when no data is ready
+ */
+typedef ssize_t (*ff_http_drain_read)(int sockfd, void *context, void *buff, size_t length);
+
+typedef void (*ff_http_drain_close)(int sockfd, void *context);
+
+struct ff_http_drainer;
+
+struct ff_http_drain
+{
+    struct ff_http_drainer *drainer;
+    int sockfd;
+    void *context;
+    ff_http_drain_read read;
+    ff_http_drain_close close;
+    struct ff_event_loop_watch watch;
+    struct ff_event_loop_timer timer;
+    struct timespec started;
+    uint64_t received;
+    struct ff_http_drain *prev;
+    struct ff_http_drain *next;
+};
+
+/**
+ * Upstream connections whose requests have been sent, read on an event loop
+ * until the status line arrives so the forwarding threads don't wait for it
+ */
+struct ff_http_drainer
+{
+    struct ff_event_loop *loop;
+    uint32_t timeout_ms;
+    // Drains in progress, only touched on the loop's thread
+    struct ff_http_drain *active;
+};
+
+const char *ff_http_completion_policy_name(enum ff_http_completion_policy policy);
+
+/**
+ * Microseconds elapsed on the monotonic clock since start
+ */
+uint64_t ff_http_completion_usecs_since(struct timespec *start);
+
+/**
+ * Records the time from the request being written until it completed under the policy
+ */
+void ff_http_completion_record(enum ff_http_completion_policy policy, struct timespec *written);
+
+/**
+ * Stats printer listing completions and their latency per policy
+ */
+void ff_http_completion_print_stats(FILE *fd, void *context);
+
+/**
+ * Checks whether the upstream has acknowledged everything sent on the socket.
+ * A reset empties the output queue too, so it's only done while the
+ * connection is still established or closed by the upstream alone.
+ */
+enum ff_http_ack_state ff_http_check_acked(int sockfd);
+
+/**
+ * Waits until the upstream has acknowledged everything sent on the socket,
+ * returns false if the connection failed or that took longer than timeout_ms
+ */
+bool ff_http_wait_acked(int sockfd, uint32_t timeout_ms);
+
+struct ff_http_drainer *ff_http_drainer_init(uint32_t timeout_ms);
+
+/**
+ * Takes ownership of the connection, closing it with close once the status
+ * line is read, the upstream closes it or the timeout passes
+ */
+void ff_http_drainer_submit(struct ff_http_drainer *drainer, int sockfd, void *context, ff_http_drain_read read, ff_http_drain_close close);
+
+/**
+ * Closes the connections still being drained
+ */
+void ff_http_drainer_free(struct ff_http_drainer *drainer);
+
+#endif
@@ -0,0 +1,25 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include "http_completion.h"
+
+#ifndef FF_HTTP_COMPLETION_P_H
+#define FF_HTTP_COMPLETION_P_H
+
+#define FF_HTTP_DRAIN_BUFF_SIZE 1024
+// Polling for acknowledgements backs off from 1ms up to this
+#define FF_HTTP_ACK_MAX_POLL_USECS 20000
+
+void ff_http_drain_start(struct ff_event_loop *loop, void *context);
+
+void ff_http_drain_on_readable(struct ff_event_loop *loop, uint32_t events, void *context);
+
+void ff_http_drain_on_timeout(struct ff_event_loop *loop, void *context);
+
+/**
+ * Closes the connection and frees the drain, complete = the status line was read
+ */
+void ff_http_drain_finish(struct ff_http_drain *drain, bool complete);
+
+void ff_http_drainer_close_all(struct ff_event_loop *loop, void *context);
+
+#endif
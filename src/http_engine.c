@@ -0,0 +1,1022 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <openssl/err.h>
+#include "http_engine.h"
+#include "http_engine_p.h"
+#include "http2_connection.h"
+#include "http_p.h"
+#include "logging.h"
+#include "stats.h"
+#include "alloc.h"
+
+struct ff_http_engine *ff_http_engine_init(uint16_t workers)
+{
+    struct ff_http_engine *engine = calloc(1, sizeof(struct ff_http_engine));
+
+    engine->http_port = FF_HTTP_PORT;
+    engine->https_port = FF_HTTP_TLS_PORT;
+    engine->completion = FF_HTTP_COMPLETION_RESPONSE;
+    engine->completion_timeout_ms = FF_HTTP_RESPONSE_MAX_WAIT_SECS * 1000;
+    engine->timeout_ms = FF_HTTP_RESPONSE_MAX_WAIT_SECS * 1000;
+    engine->workers = calloc(workers, sizeof(struct ff_http_engine_worker));
+
+    for (uint16_t i = 0; i < workers; i++)
+    {
+        engine->workers[i].engine = engine;
+
+        if ((engine->workers[i].loop = ff_event_loop_init()) == NULL)
+        {
+            ff_http_engine_free(engine);
+            return NULL;
+        }
+
+        engine->workers_length++;
+    }
+
+    return engine;
+}
+
+void ff_http_engine_submit(struct ff_http_engine *engine, struct ff_request *request, char *host_name, bool https, ff_http_engine_callback callback, void *context)
+{
+    struct ff_http_forward *forward = calloc(1, sizeof(struct ff_http_forward));
+    uint32_t worker = __atomic_fetch_add(&engine->next_worker, 1, __ATOMIC_RELAXED) % engine->workers_length;
+    bool keep_alive = ff_http_request_keep_alive(request, &forward->head_request);
+
+    forward->worker = &engine->workers[worker];
+    forward->request = request;
+    forward->callback = callback;
+    forward->context = context;
+    forward->host_name = host_name;
+    forward->https = https;
+    forward->sockfd = -1;
+    // Only a connection whose response has been read in full can be reused
+    forward->keep_alive = keep_alive &&
+                          (https ? engine->tls_connections : engine->connections) != NULL &&
+                          engine->completion == FF_HTTP_COMPLETION_RESPONSE;
+
+    ff_event_loop_watch_init(&forward->watch, -1, ff_http_forward_on_event, (void *)forward);
+    ff_event_loop_timer_init(&forward->timer, ff_http_forward_on_timer, (void *)forward);
+    ff_event_loop_timer_init(&forward->attempt_timer, ff_http_forward_attempt_on_timer, (void *)forward);
+    forward->waiter.on_admitted = ff_http_forward_on_admitted;
+    forward->waiter.context = (void *)forward;
+
+    FF_STATS_INC(upstream_engine_forwards_active);
+    ff_event_loop_post(forward->worker->loop, ff_http_forward_start, (void *)forward);
+}
+
+void ff_http_forward_start(struct ff_event_loop *loop, void *context)
+{
+    struct ff_http_forward *forward = (struct ff_http_forward *)context;
+    struct ff_http_engine_worker *worker = forward->worker;
+    struct ff_http_engine *engine = worker->engine;
+
+    forward->state = FF_HTTP_FORWARD_RESOLVING;
+    forward->next = worker->forwards;
+
+    if (worker->forwards != NULL)
+    {
+        worker->forwards->prev = forward;
+    }
+
+    worker->forwards = forward;
+
+    if (engine->dns != NULL)
+    {
+        __atomic_add_fetch(&worker->resolving, 1, __ATOMIC_RELAXED);
+        ff_dns_cache_lookup_async(engine->dns, forward->host_name, ff_http_forward_resolved, (void *)forward);
+        return;
+    }
+
+    // Blocks the loop, the DNS cache should be enabled alongside the engine
+    forward->resolved = ff_http_getaddrinfo(forward->host_name, &forward->addresses);
+
+    ff_http_forward_connect(loop, (void *)forward);
+}
+
+void ff_http_forward_resolved(struct ff_dns_result *result, void *context)
+{
+    struct ff_http_forward *forward = (struct ff_http_forward *)context;
+
+    if (result->status == FF_DNS_STATUS_OK && result->length > 0)
+    {
+        forward->addresses = *result;
+        forward->resolved = true;
+    }
+
+    // Misses are answered on the DNS cache's loop rather than the forward's
+    ff_event_loop_post(forward->worker->loop, ff_http_forward_connect, (void *)forward);
+}
+
+void ff_http_forward_connect(struct ff_event_loop *loop, void *context)
+{
+    struct ff_http_forward *forward = (struct ff_http_forward *)context;
+    struct ff_http_engine_worker *worker = forward->worker;
+    struct ff_http_engine *engine = worker->engine;
+
+    if (engine->dns != NULL)
+    {
+        __atomic_sub_fetch(&worker->resolving, 1, __ATOMIC_RELEASE);
+    }
+
+    if (!forward->resolved)
+    {
+        ff_log(FF_WARNING, "Failed to perform DNS lookup for host: %s", forward->host_name);
+        ff_http_forward_finish(forward, false);
+        return;
+    }
+
+    if (worker->stopping)
+    {
+        ff_http_forward_finish(forward, false);
+        return;
+    }
+
+    // Pooled connections are looked up by the address which would be attempted first
+    ff_happy_eyeballs_sort(engine->eyeballs, forward->host_name, &forward->addresses);
+    ff_dns_result_address(&forward->addresses, 0, forward->https ? engine->https_port : engine->http_port, &forward->address, &forward->address_length);
+
+    if (forward->https)
+    {
+        snprintf(forward->connection_key, sizeof(forward->connection_key), "%s:%u", forward->host_name, engine->https_port);
+    }
+    else
+    {
+        ff_http_connection_key(&forward->address, engine->http_port, forward->connection_key, sizeof(forward->connection_key));
+    }
+
+    switch (ff_upstream_limits_acquire(engine->limits, forward->host_name, &forward->waiter))
+    {
+    case FF_UPSTREAM_LIMITS_REJECTED:
+        ff_log(FF_WARNING, "Too many requests queued for host: %s", forward->host_name);
+        ff_http_forward_finish(forward, false);
+        return;
+
+    case FF_UPSTREAM_LIMITS_QUEUED:
+        forward->state = FF_HTTP_FORWARD_QUEUED;
+        ff_event_loop_timer_start(loop, &forward->timer, engine->limits->queue_timeout_ms);
+        return;
+
+    default:
+        break;
+    }
+
+    forward->limited = engine->limits != NULL;
+    ff_event_loop_timer_start(loop, &forward->timer, engine->timeout_ms);
+    ff_http_forward_dispatch(forward);
+}
+
+void ff_http_forward_on_admitted(struct ff_upstream_waiter *waiter)
+{
+    struct ff_http_forward *forward = (struct ff_http_forward *)waiter->context;
+
+    // Released by a request to the same host, possibly on another worker
+    ff_event_loop_post(forward->worker->loop, ff_http_forward_admitted, (void *)forward);
+}
+
+void ff_http_forward_admitted(struct ff_event_loop *loop, void *context)
+{
+    struct ff_http_forward *forward = (struct ff_http_forward *)context;
+
+    forward->limited = true;
+    ff_event_loop_timer_start(loop, &forward->timer, forward->worker->engine->timeout_ms);
+    ff_http_forward_dispatch(forward);
+}
+
+void ff_http_forward_dispatch(struct ff_http_forward *forward)
+{
+    struct ff_http_engine_worker *worker = forward->worker;
+    struct ff_http_engine *engine = worker->engine;
+    struct ff_connection_pool *pool = forward->https ? engine->tls_connections : engine->connections;
+    struct ff_http2_connection *http2 = NULL;
+    void *connection = NULL;
+
+    if (worker->stopping)
+    {
+        ff_http_forward_finish(forward, false);
+        return;
+    }
+
+    if (forward->https && ff_http_host_listed(engine->http2_hosts, forward->host_name))
+    {
+        if ((http2 = ff_http2_connection_find(worker, forward->connection_key)) == NULL)
+        {
+            forward->http2 = ff_http2_connection_init(worker, forward->connection_key, forward);
+            ff_http_forward_open(forward, false);
+            return;
+        }
+
+        // Otherwise the upstream only speaks HTTP/1.1
+        if (http2->state != FF_HTTP2_CONNECTION_HTTP1)
+        {
+            ff_http2_connection_submit(http2, forward);
+            return;
+        }
+    }
+
+    if (forward->keep_alive && ff_connection_pool_acquire(pool, forward->connection_key, &forward->sockfd, &connection, &forward->requests))
+    {
+        ff_log(FF_DEBUG, "Reusing connection to %s (%u previous requests)", forward->connection_key, forward->requests);
+        forward->reused = true;
+        forward->web = (BIO *)connection;
+        fcntl(forward->sockfd, F_SETFL, fcntl(forward->sockfd, F_GETFL) | O_NONBLOCK);
+        ff_event_loop_watch_init(&forward->watch, forward->sockfd, ff_http_forward_on_event, (void *)forward);
+
+        forward->state = FF_HTTP_FORWARD_WRITING;
+        ff_http_forward_write(forward);
+        return;
+    }
+
+    ff_http_forward_open(forward, !forward->https);
+}
+
+void ff_http_forward_open(struct ff_http_forward *forward, bool fastopen)
+{
+    forward->reused = false;
+    forward->early_data = false;
+    forward->fastopen = false;
+    forward->requests = 0;
+    forward->sent = 0;
+    forward->state = FF_HTTP_FORWARD_CONNECTING;
+    forward->next_address = 0;
+    forward->attempt_fastopen = fastopen && !ff_happy_eyeballs_racing(&forward->addresses);
+    clock_gettime(CLOCK_MONOTONIC, &forward->opened);
+
+    ff_http_forward_attempt_next(forward);
+}
+
+void ff_http_forward_attempt_next(struct ff_http_forward *forward)
+{
+    struct ff_http_engine_worker *worker = forward->worker;
+    struct ff_http_engine *engine = worker->engine;
+    struct ff_http_forward_attempt *attempt = NULL;
+    struct sockaddr_storage address;
+    socklen_t address_length;
+    bool connected = false;
+
+    ff_event_loop_timer_stop(worker->loop, &forward->attempt_timer);
+
+    while (forward->next_address < forward->addresses.length)
+    {
+        attempt = &forward->attempts[forward->next_address];
+        attempt->forward = forward;
+        attempt->fastopen = false;
+        ff_dns_result_address(&forward->addresses, forward->next_address++, forward->https ? engine->https_port : engine->http_port, &address, &address_length);
+
+        // With a cookie cached connect() returns straight away and the request is sent in the SYN
+        attempt->sockfd = ff_happy_eyeballs_attempt(
+            &address,
+            address_length,
+            forward->attempt_fastopen ? ff_http_forward_attempt_prepare : NULL,
+            (void *)attempt,
+            &connected);
+
+        if (attempt->sockfd < 0)
+        {
+            continue;
+        }
+
+        if (connected)
+        {
+            ff_http_forward_attempt_won(attempt);
+            return;
+        }
+
+        ff_event_loop_watch_init(&attempt->watch, attempt->sockfd, ff_http_forward_attempt_on_event, (void *)attempt);
+
+        if (!ff_event_loop_watch(worker->loop, &attempt->watch, EPOLLOUT))
+        {
+            ff_log(FF_ERROR, "Failed to watch connection to host: %s", forward->host_name);
+            close(attempt->sockfd);
+            attempt->sockfd = -1;
+            continue;
+        }
+
+        if (engine->eyeballs != NULL && forward->next_address < forward->addresses.length)
+        {
+            ff_event_loop_timer_start(worker->loop, &forward->attempt_timer, engine->eyeballs->attempt_delay_ms);
+        }
+
+        return;
+    }
+
+    if (!ff_http_forward_attempting(forward))
+    {
+        ff_log(FF_WARNING, "Failed to connect to host: %s", forward->host_name);
+        ff_http_forward_finish(forward, false);
+    }
+}
+
+void ff_http_forward_attempt_prepare(int sockfd, struct sockaddr_storage *address, void *context)
+{
+    struct ff_http_forward_attempt *attempt = (struct ff_http_forward_attempt *)context;
+    struct ff_http_engine *engine = attempt->forward->worker->engine;
+    char destination[FF_HTTP_CONNECTION_KEY_MAX_LENGTH];
+
+    ff_http_connection_key(address, engine->http_port, destination, sizeof(destination));
+    attempt->fastopen = ff_tcp_fastopen_enable(engine->fastopen, sockfd, destination);
+}
+
+void ff_http_forward_attempt_on_event(struct ff_event_loop *loop, uint32_t events, void *context)
+{
+    struct ff_http_forward_attempt *attempt = (struct ff_http_forward_attempt *)context;
+    int error = 0;
+    socklen_t error_length = sizeof(error);
+
+    (void)events;
+
+    if (getsockopt(attempt->sockfd, SOL_SOCKET, SO_ERROR, (void *)&error, &error_length) == 0 && error == 0)
+    {
+        ff_http_forward_attempt_won(attempt);
+        return;
+    }
+
+    ff_log(FF_DEBUG, "Failed to connect to %s with its address %d", attempt->forward->host_name, (int)(attempt - attempt->forward->attempts));
+    ff_event_loop_unwatch(loop, &attempt->watch);
+    close(attempt->sockfd);
+    attempt->sockfd = -1;
+
+    // The next address is attempted straight away rather than after the delay
+    ff_http_forward_attempt_next(attempt->forward);
+}
+
+void ff_http_forward_attempt_on_timer(struct ff_event_loop *loop, void *context)
+{
+    (void)loop;
+
+    ff_http_forward_attempt_next((struct ff_http_forward *)context);
+}
+
+void ff_http_forward_attempt_won(struct ff_http_forward_attempt *attempt)
+{
+    struct ff_http_forward *forward = attempt->forward;
+    struct ff_http_engine *engine = forward->worker->engine;
+    uint8_t index = (uint8_t)(attempt - forward->attempts);
+
+    ff_event_loop_unwatch(forward->worker->loop, &attempt->watch);
+    forward->sockfd = attempt->sockfd;
+    forward->fastopen = attempt->fastopen;
+    attempt->sockfd = -1;
+    ff_http_forward_attempts_cancel(forward);
+
+    ff_dns_result_address(&forward->addresses, index, forward->https ? engine->https_port : engine->http_port, &forward->address, &forward->address_length);
+    ff_happy_eyeballs_record(engine->eyeballs, forward->host_name, &forward->address);
+
+    if (!forward->https)
+    {
+        ff_http_connection_key(&forward->address, engine->http_port, forward->connection_key, sizeof(forward->connection_key));
+    }
+
+    if (index != 0)
+    {
+        ff_log(FF_DEBUG, "Connected to %s with its address %u after earlier addresses were slow or failed", forward->host_name, index);
+        FF_STATS_INC(upstream_connect_fallbacks);
+    }
+
+    ff_event_loop_watch_init(&forward->watch, forward->sockfd, ff_http_forward_on_event, (void *)forward);
+    ff_http_forward_connected(forward);
+}
+
+bool ff_http_forward_attempting(struct ff_http_forward *forward)
+{
+    for (uint8_t i = 0; i < forward->next_address; i++)
+    {
+        if (forward->attempts[i].sockfd >= 0)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void ff_http_forward_attempts_cancel(struct ff_http_forward *forward)
+{
+    ff_event_loop_timer_stop(forward->worker->loop, &forward->attempt_timer);
+
+    for (uint8_t i = 0; i < forward->next_address; i++)
+    {
+        if (forward->attempts[i].sockfd >= 0)
+        {
+            ff_event_loop_unwatch(forward->worker->loop, &forward->attempts[i].watch);
+            close(forward->attempts[i].sockfd);
+            forward->attempts[i].sockfd = -1;
+        }
+    }
+}
+
+void ff_http_forward_connected(struct ff_http_forward *forward)
+{
+    SSL *ssl = NULL;
+    int error = 0;
+    socklen_t error_length = sizeof(error);
+
+    if (getsockopt(forward->sockfd, SOL_SOCKET, SO_ERROR, (void *)&error, &error_length) != 0 || error != 0)
+    {
+        ff_log(FF_WARNING, "Failed to connect to host: %s", forward->host_name);
+        ff_http_forward_finish(forward, false);
+        return;
+    }
+
+    FF_STATS_INC(upstream_connections_opened);
+    forward->connect_usecs = ff_http_completion_usecs_since(&forward->opened);
+
+    if (!forward->https)
+    {
+        forward->state = FF_HTTP_FORWARD_WRITING;
+        ff_http_forward_write(forward);
+        return;
+    }
+
+    // The socket is closed with the chain from here on, including on failure
+    if ((forward->web = ff_http_tls_new(forward->sockfd, forward->host_name, forward->connection_key)) == NULL)
+    {
+        ff_event_loop_unwatch(forward->worker->loop, &forward->watch);
+        forward->sockfd = -1;
+        ff_http_forward_finish(forward, false);
+        return;
+    }
+
+    // The upstream picks h2 if it supports it, the connection then carries other forwards' requests
+    if (forward->http2 != NULL)
+    {
+        BIO_get_ssl(forward->web, &ssl);
+        SSL_set_alpn_protos(ssl, (const unsigned char *)FF_HTTP2_ALPN_PROTOCOLS, sizeof(FF_HTTP2_ALPN_PROTOCOLS) - 1);
+    }
+
+    forward->early_data = forward->http2 == NULL &&
+                          ff_http_early_data_allowed(forward->worker->engine->early_data_hosts, forward->request, forward->host_name) &&
+                          ff_http_tls_early_data_begin(forward->web, forward->request);
+    forward->state = FF_HTTP_FORWARD_HANDSHAKING;
+    ff_http_forward_handshake(forward);
+}
+
+void ff_http_forward_handshake(struct ff_http_forward *forward)
+{
+    struct ff_request *request = forward->request;
+    SSL *ssl = NULL;
+    int result;
+    size_t written;
+    uint32_t events;
+    char error_string[256] = {0};
+
+    BIO_get_ssl(forward->web, &ssl);
+
+    // Sent with the ClientHello, the handshake then sends EndOfEarlyData
+    while (forward->early_data && forward->sent < request->payload_length)
+    {
+        ERR_clear_error();
+
+        if ((result = SSL_write_early_data(ssl, request->payload->value + forward->sent, request->payload_length - forward->sent, &written)) != 1)
+        {
+            goto wait;
+        }
+
+        forward->sent += (uint32_t)written;
+    }
+
+    ERR_clear_error();
+
+    if ((result = SSL_do_handshake(ssl)) == 1)
+    {
+        if (!ff_http_tls_handshake_verify(forward->web, forward->connection_key))
+        {
+            ff_http_forward_finish(forward, false);
+            return;
+        }
+
+        // The connection carries on with the request as its first stream
+        if (forward->http2 != NULL && ff_http2_connection_opened(forward))
+        {
+            return;
+        }
+
+        // Accepted early data was the whole request, otherwise it's sent now
+        if (forward->early_data && !ff_http_tls_early_data_accepted(forward->web, forward->connection_key))
+        {
+            forward->sent = 0;
+        }
+
+        forward->early_data = false;
+        forward->state = FF_HTTP_FORWARD_WRITING;
+        ff_http_forward_write(forward);
+        return;
+    }
+
+wait:
+    if ((events = ff_http_forward_tls_wait_events(forward, result)) == 0)
+    {
+        ERR_error_string(ERR_get_error(), error_string);
+        ff_log(FF_WARNING, "Failed to perform OpenSSL request handshake: %s", error_string);
+        ff_http_forward_finish(forward, false);
+        return;
+    }
+
+    if (!ff_http_forward_wait(forward, events))
+    {
+        ff_http_forward_finish(forward, false);
+    }
+}
+
+void ff_http_forward_write(struct ff_http_forward *forward)
+{
+    struct ff_request *request = forward->request;
+    SSL *ssl = NULL;
+    ssize_t chunk;
+    uint32_t events;
+
+    while (forward->sent < request->payload_length)
+    {
+        if (forward->https)
+        {
+            BIO_get_ssl(forward->web, &ssl);
+            ERR_clear_error();
+            errno = 0;
+
+            // Retried with the same arguments until the whole remainder is written
+            chunk = SSL_write(ssl, request->payload->value + forward->sent, (int)(request->payload_length - forward->sent));
+
+            if (chunk <= 0 && (events = ff_http_forward_tls_wait_events(forward, (int)chunk)) != 0)
+            {
+                if (!ff_http_forward_wait(forward, events))
+                {
+                    ff_http_forward_finish(forward, false);
+                }
+
+                return;
+            }
+        }
+        else
+        {
+            // A pooled connection may have been reset by the upstream, report it rather than raising SIGPIPE
+            chunk = send(forward->sockfd, request->payload->value + forward->sent, request->payload_length - forward->sent, MSG_NOSIGNAL | MSG_DONTWAIT);
+
+            // Data beyond what fits in a fast open SYN waits for the handshake
+            if (chunk < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINPROGRESS))
+            {
+                if (!ff_http_forward_wait(forward, EPOLLOUT))
+                {
+                    ff_http_forward_finish(forward, false);
+                }
+
+                return;
+            }
+        }
+
+        if (chunk <= 0)
+        {
+            // Captured before logging can clobber errno
+            bool closed = ff_http_connection_reset(errno);
+
+            ff_log(FF_WARNING, "Failed to write to connection: %s (%u bytes remaining)", forward->host_name, request->payload_length - forward->sent);
+            ff_http_forward_fail(forward, closed);
+            return;
+        }
+
+        forward->sent += (uint32_t)chunk;
+    }
+
+    ff_http_forward_written(forward);
+}
+
+void ff_http_forward_written(struct ff_http_forward *forward)
+{
+    struct ff_http_engine_worker *worker = forward->worker;
+    struct ff_http_engine *engine = worker->engine;
+
+    ff_log(FF_DEBUG, "Finished sending request to %s (%u bytes sent)", forward->host_name, forward->sent);
+
+    forward->requests++;
+    clock_gettime(CLOCK_MONOTONIC, &forward->written);
+    ff_http_reader_init(&forward->reader, forward->https ? ff_http_forward_tls_read : ff_http_forward_socket_read, (void *)forward);
+
+    switch (engine->completion)
+    {
+    case FF_HTTP_COMPLETION_ACKED:
+        forward->state = FF_HTTP_FORWARD_ACKING;
+        forward->ack_poll_ms = 1;
+        ff_event_loop_unwatch(worker->loop, &forward->watch);
+        ff_http_forward_on_timer(worker->loop, (void *)forward);
+        return;
+
+    case FF_HTTP_COMPLETION_DRAIN:
+        // Released straight away, the status line is still read to close the connection cleanly
+        ff_http_forward_notify(forward, true);
+        ff_http_response_framer_init(&forward->framer, forward->head_request, true);
+        ff_event_loop_timer_start(worker->loop, &forward->timer, engine->completion_timeout_ms);
+        break;
+
+    case FF_HTTP_COMPLETION_STATUS:
+        ff_http_response_framer_init(&forward->framer, forward->head_request, true);
+        ff_event_loop_timer_start(worker->loop, &forward->timer, engine->completion_timeout_ms);
+        break;
+
+    default:
+        ff_http_response_framer_init(&forward->framer, forward->head_request, false);
+        break;
+    }
+
+    forward->state = FF_HTTP_FORWARD_READING;
+    ff_http_forward_read(forward);
+}
+
+void ff_http_forward_read(struct ff_http_forward *forward)
+{
+    forward->want_write = false;
+
+    switch (ff_http_response_frame(&forward->reader, &forward->framer))
+    {
+    case FF_HTTP_FRAME_DONE:
+        ff_log(FF_DEBUG, "Response: %s", forward->framer.response.status_line);
+        ff_http_forward_finish(forward, true);
+        break;
+
+    case FF_HTTP_FRAME_AGAIN:
+        if (!ff_http_forward_wait(forward, EPOLLIN | (forward->want_write ? EPOLLOUT : 0)))
+        {
+            ff_http_forward_finish(forward, false);
+        }
+        break;
+
+    default:
+        ff_log(FF_WARNING, "Failed to read response from host: %s (%lu bytes received)", forward->host_name, (unsigned long)forward->reader.received);
+        ff_http_forward_fail(forward, forward->reader.closed);
+        break;
+    }
+}
+
+void ff_http_forward_on_event(struct ff_event_loop *loop, uint32_t events, void *context)
+{
+    struct ff_http_forward *forward = (struct ff_http_forward *)context;
+
+    (void)loop;
+    (void)events;
+
+    switch (forward->state)
+    {
+    case FF_HTTP_FORWARD_HANDSHAKING:
+        ff_http_forward_handshake(forward);
+        break;
+
+    case FF_HTTP_FORWARD_WRITING:
+        ff_http_forward_write(forward);
+        break;
+
+    case FF_HTTP_FORWARD_READING:
+        ff_http_forward_read(forward);
+        break;
+
+    default:
+        break;
+    }
+}
+
+void ff_http_forward_on_timer(struct ff_event_loop *loop, void *context)
+{
+    struct ff_http_forward *forward = (struct ff_http_forward *)context;
+    struct ff_http_engine *engine = forward->worker->engine;
+    enum ff_http_ack_state acked;
+
+    if (forward->state == FF_HTTP_FORWARD_QUEUED)
+    {
+        // Otherwise it was admitted as it timed out and carries on once the admission arrives
+        if (ff_upstream_limits_cancel(engine->limits, &forward->waiter, true))
+        {
+            ff_log(FF_WARNING, "Timed out waiting to forward request to host: %s", forward->host_name);
+            ff_http_forward_finish(forward, false);
+        }
+
+        return;
+    }
+
+    if (forward->state == FF_HTTP_FORWARD_ACKING)
+    {
+        if ((acked = ff_http_check_acked(forward->sockfd)) != FF_HTTP_ACK_PENDING)
+        {
+            if (acked == FF_HTTP_ACK_FAILED)
+            {
+                ff_log(FF_WARNING, "Host failed to acknowledge the request: %s", forward->host_name);
+            }
+
+            ff_http_forward_finish(forward, acked == FF_HTTP_ACK_DONE);
+            return;
+        }
+
+        if (ff_http_completion_usecs_since(&forward->written) >= (uint64_t)engine->completion_timeout_ms * 1000)
+        {
+            FF_STATS_INC(upstream_acks_timed_out);
+            ff_log(FF_WARNING, "Timed out waiting for host to acknowledge the request: %s", forward->host_name);
+            ff_http_forward_finish(forward, false);
+            return;
+        }
+
+        ff_event_loop_timer_start(loop, &forward->timer, forward->ack_poll_ms);
+        forward->ack_poll_ms = forward->ack_poll_ms * 2 > FF_HTTP_ENGINE_ACK_MAX_POLL_MS ? FF_HTTP_ENGINE_ACK_MAX_POLL_MS : forward->ack_poll_ms * 2;
+        return;
+    }
+
+    if (forward->state == FF_HTTP_FORWARD_READING && forward->framer.status_only)
+    {
+        // The request was delivered, a slow upstream doesn't fail it
+        ff_log(FF_DEBUG, "Timed out waiting for status line from host: %s", forward->host_name);
+        ff_http_forward_finish(forward, true);
+        return;
+    }
+
+    ff_log(FF_WARNING, "Timed out forwarding request to host: %s", forward->host_name);
+    ff_http_forward_finish(forward, false);
+}
+
+bool ff_http_forward_wait(struct ff_http_forward *forward, uint32_t events)
+{
+    if (!ff_event_loop_watch(forward->worker->loop, &forward->watch, events))
+    {
+        ff_log(FF_ERROR, "Failed to watch connection to host: %s", forward->host_name);
+        return false;
+    }
+
+    return true;
+}
+
+uint32_t ff_http_forward_tls_wait_events(struct ff_http_forward *forward, int result)
+{
+    SSL *ssl = NULL;
+
+    BIO_get_ssl(forward->web, &ssl);
+
+    switch (SSL_get_error(ssl, result))
+    {
+    case SSL_ERROR_WANT_READ:
+        return EPOLLIN;
+
+    case SSL_ERROR_WANT_WRITE:
+        return EPOLLOUT;
+
+    default:
+        return 0;
+    }
+}
+
+ssize_t ff_http_forward_socket_read(void *context, void *buff, size_t length)
+{
+    struct ff_http_forward *forward = (struct ff_http_forward *)context;
+
+    return recv(forward->sockfd, buff, length, MSG_DONTWAIT);
+}
+
+ssize_t ff_http_forward_tls_read(void *context, void *buff, size_t length)
+{
+    struct ff_http_forward *forward = (struct ff_http_forward *)context;
+    SSL *ssl = NULL;
+    int chunk;
+
+    BIO_get_ssl(forward->web, &ssl);
+    ERR_clear_error();
+
+    if ((chunk = SSL_read(ssl, buff, (int)length)) > 0)
+    {
+        return chunk;
+    }
+
+    switch (SSL_get_error(ssl, chunk))
+    {
+    case SSL_ERROR_WANT_READ:
+        errno = EAGAIN;
+        return -1;
+
+    case SSL_ERROR_WANT_WRITE:
+        // A key update may need to be sent before reading can continue
+        forward->want_write = true;
+        errno = EAGAIN;
+        return -1;
+
+    case SSL_ERROR_ZERO_RETURN:
+        // A close_notify from the upstream reads as EOF
+        return 0;
+
+    default:
+        // Closing without a close_notify reads as EOF, a reset keeps its errno
+        if (ERR_GET_REASON(ERR_peek_last_error()) == SSL_R_UNEXPECTED_EOF_WHILE_READING)
+        {
+            return 0;
+        }
+
+        if (!ff_http_connection_reset(errno))
+        {
+            errno = EIO;
+        }
+
+        return -1;
+    }
+}
+
+void ff_http_forward_notify(struct ff_http_forward *forward, bool success)
+{
+    struct ff_request *request = forward->request;
+
+    if (request == NULL)
+    {
+        return;
+    }
+
+    forward->request = NULL;
+    request->state = success ? FF_REQUEST_STATE_SENT : FF_REQUEST_STATE_SENDING_FAILED;
+
+    if (success)
+    {
+        ff_http_completion_record(forward->worker->engine->completion, &forward->written);
+    }
+
+    forward->callback(request, forward->context);
+}
+
+void ff_http_forward_fail(struct ff_http_forward *forward, bool closed)
+{
+    bool delivered;
+
+    // The upstream may close an idle connection just as we reuse it. As on the blocking path,
+    // only an idempotent request is sent again on a new one, and only when the upstream
+    // closed or reset the connection before any of the response arrived
+    if (forward->reused && closed && forward->reader.received == 0 && forward->request != NULL && ff_http_request_is_idempotent(forward->request) && !forward->worker->stopping)
+    {
+        ff_log(FF_DEBUG, "Pooled connection to %s was closed by the upstream, reconnecting", forward->connection_key);
+        ff_event_loop_unwatch(forward->worker->loop, &forward->watch);
+        ff_http_forward_close_connection(forward);
+        ff_http_forward_open(forward, !forward->https);
+        return;
+    }
+
+    // SYNs carrying data may be dropped or reset on the path, the request is
+    // sent again without fast open. Once the SYN data was delivered the
+    // upstream may have received the request, so it is only sent again as it
+    // would be on a pooled connection.
+    if (forward->fastopen && forward->reader.received == 0 && forward->request != NULL && !forward->worker->stopping)
+    {
+        forward->fastopen = false;
+        delivered = ff_tcp_fastopen_record(forward->worker->engine->fastopen, forward->sockfd, forward->connection_key, forward->sent == forward->request->payload_length);
+
+        if (!delivered || (closed && ff_http_request_is_idempotent(forward->request)))
+        {
+            ff_log(FF_DEBUG, "Retrying connection to %s without TCP Fast Open", forward->connection_key);
+            ff_event_loop_unwatch(forward->worker->loop, &forward->watch);
+            ff_http_forward_close_connection(forward);
+            ff_http_forward_open(forward, false);
+            return;
+        }
+    }
+
+    ff_http_forward_finish(forward, false);
+}
+
+void ff_http_forward_finish(struct ff_http_forward *forward, bool success)
+{
+    struct ff_http_engine_worker *worker = forward->worker;
+    struct ff_http_engine *engine = worker->engine;
+    struct ff_upstream_sample sample = {
+        .success = success,
+        .connect_usecs = forward->connect_usecs,
+        .response_usecs = forward->written.tv_sec != 0 || forward->written.tv_nsec != 0 ? ff_http_completion_usecs_since(&forward->written) : 0};
+
+    if (forward->http2 != NULL)
+    {
+        ff_http2_connection_release(forward);
+    }
+
+    ff_event_loop_unwatch(worker->loop, &forward->watch);
+    ff_event_loop_timer_stop(worker->loop, &forward->timer);
+    ff_http_forward_attempts_cancel(forward);
+
+    if (forward->fastopen && forward->sockfd >= 0)
+    {
+        ff_tcp_fastopen_record(engine->fastopen, forward->sockfd, forward->connection_key, true);
+        forward->fastopen = false;
+    }
+
+    if (success && forward->keep_alive && forward->state == FF_HTTP_FORWARD_READING && ff_http_response_reusable(&forward->reader, &forward->framer.response))
+    {
+        ff_connection_pool_release(
+            forward->https ? engine->tls_connections : engine->connections,
+            forward->connection_key,
+            forward->sockfd,
+            (void *)forward->web,
+            forward->requests);
+        forward->sockfd = -1;
+        forward->web = NULL;
+    }
+
+    ff_http_forward_close_connection(forward);
+
+    if (forward->limited)
+    {
+        // Failures while stopping say nothing about the upstream
+        ff_upstream_limits_release(engine->limits, forward->host_name, worker->stopping ? NULL : &sample);
+        forward->limited = false;
+    }
+
+    if (forward->prev == NULL)
+    {
+        worker->forwards = forward->next;
+    }
+    else
+    {
+        forward->prev->next = forward->next;
+    }
+
+    if (forward->next != NULL)
+    {
+        forward->next->prev = forward->prev;
+    }
+
+    // Drains notify before finishing, so only count requests which are failed here
+    if (!success && forward->request != NULL)
+    {
+        FF_STATS_INC(upstream_engine_forwards_failed);
+    }
+
+    ff_http_forward_notify(forward, success);
+    FF_STATS_DEC(upstream_engine_forwards_active);
+
+    FREE(forward->host_name);
+    FREE(forward);
+}
+
+void ff_http_forward_close_connection(struct ff_http_forward *forward)
+{
+    if (forward->web != NULL)
+    {
+        ff_http_tls_connection_close(forward->sockfd, (void *)forward->web);
+    }
+    else if (forward->sockfd >= 0)
+    {
+        close(forward->sockfd);
+    }
+
+    forward->web = NULL;
+    forward->sockfd = -1;
+}
+
+void ff_http_engine_worker_stop(struct ff_event_loop *loop, void *context)
+{
+    struct ff_http_engine_worker *worker = (struct ff_http_engine_worker *)context;
+    struct ff_http_forward *forward = worker->forwards;
+
+    (void)loop;
+
+    worker->stopping = true;
+
+    while (forward != NULL)
+    {
+        // Left for the DNS cache's callback, which fails them once stopping, or for an admission already on its way
+        if (forward->state == FF_HTTP_FORWARD_RESOLVING ||
+            (forward->state == FF_HTTP_FORWARD_QUEUED && !ff_upstream_limits_cancel(worker->engine->limits, &forward->waiter, false)))
+        {
+            forward = forward->next;
+            continue;
+        }
+
+        // Finishing a forward opening an HTTP/2 connection finishes those waiting on it too
+        ff_http_forward_finish(forward, false);
+        forward = worker->forwards;
+    }
+
+    ff_http2_connections_free(worker);
+}
+
+void ff_http_engine_free(struct ff_http_engine *engine)
+{
+    struct ff_http_engine_worker *worker;
+
+    if (engine == NULL)
+    {
+        return;
+    }
+
+    // Every worker stops before any loop is freed, finishing a forward can admit one queued on another worker
+    for (uint16_t i = 0; i < engine->workers_length; i++)
+    {
+        ff_event_loop_call(engine->workers[i].loop, ff_http_engine_worker_stop, (void *)&engine->workers[i]);
+    }
+
+    for (uint16_t i = 0; i < engine->workers_length; i++)
+    {
+        worker = &engine->workers[i];
+
+        // Lookups fail within the resolver's timeout, the last is finished by the
+        // task which decremented the count, which runs before the loop stops
+        while (__atomic_load_n(&worker->resolving, __ATOMIC_ACQUIRE) > 0)
+        {
+            usleep(FF_HTTP_ENGINE_RESOLVING_POLL_USECS);
+        }
+
+        ff_event_loop_free(worker->loop);
+    }
+
+    FREE(engine->workers);
+    FREE(engine);
+}
@@ -0,0 +1,205 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <limits.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <openssl/ssl.h>
+#include "request.h"
+#include "event_loop.h"
+#include "dns_cache.h"
+#include "connection_pool.h"
+#include "http_response.h"
+#include "http_completion.h"
+#include "tcp_fastopen.h"
+#include "happy_eyeballs.h"
+#include "http2.h"
+#include "upstream_limits.h"
+
+#ifndef FF_HTTP_ENGINE_H
+#define FF_HTTP_ENGINE_H
+
+/**
+ * Called once the request has been forwarded, request->state is
+ * FF_REQUEST_STATE_SENT or FF_REQUEST_STATE_SENDING_FAILED. Runs on one of
+ * the engine's loops, so must not block.
+ */
+typedef void (*ff_http_engine_callback)(struct ff_request *request, void *context);
+
+enum ff_http_forward_state
+{
+    FF_HTTP_FORWARD_RESOLVING = 1,
+    FF_HTTP_FORWARD_CONNECTING = 2,
+    FF_HTTP_FORWARD_HANDSHAKING = 3,
+    FF_HTTP_FORWARD_WRITING = 4,
+    // Waiting for the upstream to acknowledge the request
+    FF_HTTP_FORWARD_ACKING = 5,
+    FF_HTTP_FORWARD_READING = 6,
+    // Sent, or waiting to be sent, as a stream of an HTTP/2 connection
+    FF_HTTP_FORWARD_STREAMING = 7,
+    // Waiting for the host to have fewer requests in flight
+    FF_HTTP_FORWARD_QUEUED = 8
+};
+
+struct ff_http_engine_worker;
+struct ff_http_forward;
+struct ff_http2_connection;
+
+/**
+ * A forward's request as a stream of a multiplexed HTTP/2 connection
+ */
+struct ff_http2_stream
+{
+    // 0 while waiting for the connection or for the upstream to allow another stream
+    uint32_t id;
+    int64_t send_window;
+    struct ff_http2_request request;
+    uint32_t body_sent;
+    // The upstream has ended or reset the stream
+    bool remote_closed;
+    // In the connection's list of open or waiting streams
+    struct ff_http_forward *prev;
+    struct ff_http_forward *next;
+};
+
+/**
+ * A connection to one of the forward's addresses, raced against the others
+ */
+struct ff_http_forward_attempt
+{
+    struct ff_http_forward *forward;
+    // -1 once it has failed, been cancelled or won
+    int sockfd;
+    // TCP Fast Open was enabled on the socket
+    bool fastopen;
+    struct ff_event_loop_watch watch;
+};
+
+/**
+ * A request being forwarded, advanced by its worker's loop as its
+ * connection becomes ready
+ */
+struct ff_http_forward
+{
+    struct ff_http_engine_worker *worker;
+    enum ff_http_forward_state state;
+    // NULL once the callback has run
+    struct ff_request *request;
+    ff_http_engine_callback callback;
+    void *context;
+    char *host_name;
+    bool https;
+    // The response will be read in full so the connection can be pooled
+    bool keep_alive;
+    bool head_request;
+    // Sent over a pooled connection, retried on a new one if the upstream closed it
+    bool reused;
+    bool resolved;
+    // In the order they're attempted, ports left as 0
+    struct ff_dns_result addresses;
+    uint8_t next_address;
+    // Attempts may enable TCP Fast Open, only when the addresses aren't raced
+    bool attempt_fastopen;
+    struct ff_http_forward_attempt attempts[FF_DNS_MAX_ADDRESSES];
+    // Starts the next attempt while earlier ones are still connecting
+    struct ff_event_loop_timer attempt_timer;
+    // The address connected to, or that would be attempted first
+    struct sockaddr_storage address;
+    socklen_t address_length;
+    // Pool key, the address for HTTP or host name for HTTPS
+    char connection_key[_POSIX_HOST_NAME_MAX + 8];
+    int sockfd;
+    BIO *web;
+    // TLS wants the socket writable before it can read
+    bool want_write;
+    // TCP Fast Open was enabled on the connection and its outcome not yet recorded
+    bool fastopen;
+    // The request is being sent as TLS early data ahead of the handshake
+    bool early_data;
+    uint32_t requests;
+    uint32_t sent;
+    // When the forward started opening a connection, and how long it took
+    struct timespec opened;
+    uint64_t connect_usecs;
+    struct timespec written;
+    struct ff_http_reader reader;
+    struct ff_http_response_framer framer;
+    struct ff_event_loop_watch watch;
+    // The forward's deadline, or the next acknowledgement poll
+    struct ff_event_loop_timer timer;
+    uint32_t ack_poll_ms;
+    // The HTTP/2 connection the request is sent over, or which the forward is opening
+    struct ff_http2_connection *http2;
+    struct ff_http2_stream stream;
+    // Queued behind the host's in flight limit
+    struct ff_upstream_waiter waiter;
+    // Holds one of the host's in flight slots
+    bool limited;
+    struct ff_http_forward *prev;
+    struct ff_http_forward *next;
+};
+
+struct ff_http_engine_worker
+{
+    struct ff_http_engine *engine;
+    struct ff_event_loop *loop;
+    // Forwards in progress, only touched on the loop's thread
+    struct ff_http_forward *forwards;
+    // Forwards waiting on the DNS cache, which can't be cancelled, updated atomically
+    uint32_t resolving;
+    // Per upstream host, only touched on the loop's thread
+    struct ff_http2_connection *http2_connections;
+    bool stopping;
+};
+
+/**
+ * Forwards requests over non-blocking connections driven by a few event
+ * loops, so concurrent requests cost a socket and a forward rather than a
+ * thread each
+ */
+struct ff_http_engine
+{
+    struct ff_http_engine_worker *workers;
+    uint16_t workers_length;
+    // Round robin position for assigning forwards to workers
+    uint32_t next_worker;
+    uint16_t http_port;
+    uint16_t https_port;
+    // Not owned, NULL = getaddrinfo on the loop's thread
+    struct ff_dns_cache *dns;
+    // Not owned, NULL = a new connection per request
+    struct ff_connection_pool *connections;
+    struct ff_connection_pool *tls_connections;
+    // Not owned, NULL = TCP Fast Open disabled
+    struct ff_tcp_fastopen *fastopen;
+    // Not owned, comma separated HTTPS hosts sent safe requests as early data, NULL = disabled
+    const char *early_data_hosts;
+    // Not owned, NULL = only the first address is attempted
+    struct ff_happy_eyeballs *eyeballs;
+    // Not owned, comma separated HTTPS hosts requests are multiplexed to over HTTP/2, NULL = disabled
+    const char *http2_hosts;
+    // Not owned, NULL = requests in flight to a host are unlimited
+    struct ff_upstream_limits *limits;
+    enum ff_http_completion_policy completion;
+    uint32_t completion_timeout_ms;
+    // Longest a forward may take from connecting to its response
+    uint32_t timeout_ms;
+};
+
+/**
+ * Starts an event loop thread per worker. The upstreams, pools and policy
+ * are set on the returned engine before any requests are submitted.
+ */
+struct ff_http_engine *ff_http_engine_init(uint16_t workers);
+
+/**
+ * Forwards the request to the host, which the forward takes ownership of
+ */
+void ff_http_engine_submit(struct ff_http_engine *engine, struct ff_request *request, char *host_name, bool https, ff_http_engine_callback callback, void *context);
+
+/**
+ * Fails forwards still in progress and stops the loops. Forwards waiting on
+ * the DNS cache are waited for, the cache must still be running.
+ */
+void ff_http_engine_free(struct ff_http_engine *engine);
+
+#endif
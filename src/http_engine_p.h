@@ -0,0 +1,114 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/types.h>
+#include "http_engine.h"
+
+#ifndef FF_HTTP_ENGINE_P_H
+#define FF_HTTP_ENGINE_P_H
+
+// Acknowledgements are polled from 1ms backing off up to this
+#define FF_HTTP_ENGINE_ACK_MAX_POLL_MS 20
+// Shutdown polls the workers for lookups still waiting on the DNS cache
+#define FF_HTTP_ENGINE_RESOLVING_POLL_USECS 1000
+
+void ff_http_forward_start(struct ff_event_loop *loop, void *context);
+
+void ff_http_forward_resolved(struct ff_dns_result *result, void *context);
+
+void ff_http_forward_connect(struct ff_event_loop *loop, void *context);
+
+/**
+ * Posts an admitted forward to its worker
+ */
+void ff_http_forward_on_admitted(struct ff_upstream_waiter *waiter);
+
+void ff_http_forward_admitted(struct ff_event_loop *loop, void *context);
+
+/**
+ * Sends the forward's request over the host's HTTP/2 connection, a pooled
+ * connection or a new one, also retrying forwards an HTTP/2 connection gave up on
+ */
+void ff_http_forward_dispatch(struct ff_http_forward *forward);
+
+/**
+ * Opens a new connection for the forward, attempting TCP Fast Open if fastopen
+ */
+void ff_http_forward_open(struct ff_http_forward *forward, bool fastopen);
+
+/**
+ * Starts connecting to the next address, or fails the forward once every
+ * address has been attempted and none are still connecting
+ */
+void ff_http_forward_attempt_next(struct ff_http_forward *forward);
+
+void ff_http_forward_attempt_prepare(int sockfd, struct sockaddr_storage *address, void *context);
+
+void ff_http_forward_attempt_on_event(struct ff_event_loop *loop, uint32_t events, void *context);
+
+void ff_http_forward_attempt_on_timer(struct ff_event_loop *loop, void *context);
+
+/**
+ * Carries on with the attempt's connection, closing the others
+ */
+void ff_http_forward_attempt_won(struct ff_http_forward_attempt *attempt);
+
+/**
+ * Returns true if any of the forward's attempts are still connecting
+ */
+bool ff_http_forward_attempting(struct ff_http_forward *forward);
+
+/**
+ * Closes attempts still connecting and stops starting new ones
+ */
+void ff_http_forward_attempts_cancel(struct ff_http_forward *forward);
+
+void ff_http_forward_connected(struct ff_http_forward *forward);
+
+void ff_http_forward_handshake(struct ff_http_forward *forward);
+
+void ff_http_forward_write(struct ff_http_forward *forward);
+
+void ff_http_forward_written(struct ff_http_forward *forward);
+
+void ff_http_forward_read(struct ff_http_forward *forward);
+
+void ff_http_forward_on_event(struct ff_event_loop *loop, uint32_t events, void *context);
+
+void ff_http_forward_on_timer(struct ff_event_loop *loop, void *context);
+
+/**
+ * Waits for the events on the forward's socket, returns false if it could not be watched
+ */
+bool ff_http_forward_wait(struct ff_http_forward *forward, uint32_t events);
+
+/**
+ * Maps an OpenSSL result onto the events to wait for, 0 if the call failed
+ */
+uint32_t ff_http_forward_tls_wait_events(struct ff_http_forward *forward, int result);
+
+ssize_t ff_http_forward_socket_read(void *context, void *buff, size_t length);
+
+ssize_t ff_http_forward_tls_read(void *context, void *buff, size_t length);
+
+/**
+ * Runs the callback and releases the request, the forward may carry on
+ * reading the status line afterwards
+ */
+void ff_http_forward_notify(struct ff_http_forward *forward, bool success);
+
+/**
+ * Retries an idempotent forward over a pooled connection which the upstream
+ * closed before responding, otherwise finishes it as failed
+ */
+void ff_http_forward_fail(struct ff_http_forward *forward, bool closed);
+
+/**
+ * Returns the connection to the pool or closes it, then frees the forward
+ */
+void ff_http_forward_finish(struct ff_http_forward *forward, bool success);
+
+void ff_http_forward_close_connection(struct ff_http_forward *forward);
+
+void ff_http_engine_worker_stop(struct ff_event_loop *loop, void *context);
+
+#endif
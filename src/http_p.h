@@ -1,5 +1,12 @@
+#include <stdint.h>
 #include <stdbool.h>
+#include <limits.h>
+#include <sys/types.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <openssl/ssl.h>
 #include "request.h"
+#include "dns.h"
 
 #ifndef FF_HTTP_P_H
 #define FF_HTTP_P_H
@@ -7,12 +14,150 @@
 #define FF_HTTP_HOST_HEADER_MAX_SEARCH_LENGTH 8096
 #define FF_HTTP_RESPONSE_BUFF_SIZE 4096
 #define FF_HTTP_RESPONSE_MAX_WAIT_SECS 10
+#define FF_HTTP_TLS_PREFERRED_CIPHERS "HIGH:!aNULL:!kRSA:!PSK:!SRP:!MD5:!RC4"
+#define FF_HTTP_PORT 80
+#define FF_HTTP_TLS_PORT 443
+// [ipv6 address]:port
+#define FF_HTTP_CONNECTION_KEY_MAX_LENGTH (INET6_ADDRSTRLEN + 8)
+// host:port
+#define FF_HTTP_TLS_SESSION_HOST_MAX_LENGTH (_POSIX_HOST_NAME_MAX + 8)
+// Connections without SYN data acknowledged before fast open is skipped, the first only requests a cookie
+#define FF_HTTP_FASTOPEN_MAX_FALLBACKS 3
+#define FF_HTTP_FASTOPEN_BACKOFF_SECS 600
+// Hosts whose last connected address is remembered
+#define FF_HTTP_HAPPY_EYEBALLS_MAX_HOSTS 1024
+// Hosts whose requests in flight are limited, idle ones are forgotten beyond this
+#define FF_HTTP_UPSTREAM_LIMITS_MAX_HOSTS 1024
+
+/**
+ * Returns true if the request's options ask for it to be sent over HTTPS
+ */
+bool ff_http_request_is_https(struct ff_request *request);
 
 bool ff_http_send_request_unencrypted(struct ff_request *request, char *host_name);
 
+/**
+ * Resolves the host's addresses through the DNS cache when enabled,
+ * otherwise getaddrinfo. Ports are left as 0.
+ */
+bool ff_http_resolve(char *host_name, struct ff_dns_result *result);
+
+bool ff_http_getaddrinfo(char *host_name, struct ff_dns_result *result);
+
+/**
+ * Formats the address and port as a connection pool key
+ */
+void ff_http_connection_key(struct sockaddr_storage *address, uint16_t port, char *key, size_t length);
+
+/**
+ * Opens a connection to one of the sorted addresses, racing them when happy
+ * eyeballs is enabled, and copies the address connected to. Returns -1 on
+ * failure. With fastopen TCP Fast Open is attempted, in which case
+ * connecting may be deferred to the first write.
+ */
+int ff_http_connect(struct ff_dns_result *addresses, uint16_t port, char *host_name, bool fastopen, struct sockaddr_storage *address, socklen_t *address_length);
+
+/**
+ * Enables TCP Fast Open on a connection attempt, context is the struct ff_tcp_fastopen
+ */
+void ff_http_connect_fastopen(int sockfd, struct sockaddr_storage *address, void *context);
+
+bool ff_http_write_request(int sockfd, struct ff_request *request, char *host_name);
+
+/**
+ * Reads from the socket pointed to by context for ff_http_reader
+ */
+ssize_t ff_http_socket_read(void *context, void *buff, size_t length);
+
+void ff_http_connection_close(int sockfd, void *context);
+
+void ff_http_set_receive_timeout(int sockfd, uint32_t timeout_ms);
+
+/**
+ * Overrides the ports upstreams are connected to, by default 80 and 443
+ */
+void ff_http_set_ports(uint16_t port, uint16_t tls_port);
+
+/**
+ * Non-blocking socket read for the drainer
+ */
+ssize_t ff_http_drain_socket_read(int sockfd, void *context, void *buff, size_t length);
+
 bool ff_http_send_request_tls(struct ff_request *request, char *host_name);
 
+/**
+ * Opens a verified TLS connection to the host, returns NULL on failure.
+ * When early_data is not NULL it's sent before the handshake if the resumed
+ * session allows, early_data_accepted is set if the upstream accepted it
+ * and the request doesn't need to be written again.
+ */
+BIO *ff_http_tls_connect(char *host_name, char *session_host, struct ff_request *early_data, bool *early_data_accepted);
+
+/**
+ * Layers a TLS client for the host over the connected socket, resuming a
+ * cached session when there is one. Takes ownership of the socket, which is
+ * closed on failure. The handshake is left to the caller.
+ */
+BIO *ff_http_tls_new(int sockfd, char *host_name, char *session_host);
+
+/**
+ * Checks the upstream's certificate once the handshake has finished and
+ * records whether its session was resumed
+ */
+bool ff_http_tls_handshake_verify(BIO *web, char *session_host);
+
+/**
+ * Returns true if the request may be sent as early data to the host, being
+ * safe and the host in the comma separated hosts, NULL = none
+ */
+bool ff_http_early_data_allowed(const char *hosts, struct ff_request *request, const char *host_name);
+
+/**
+ * Returns true if the host is in the comma separated hosts, compared case
+ * insensitively ignoring whitespace around each entry, NULL = none
+ */
+bool ff_http_host_listed(const char *hosts, const char *host_name);
+
+/**
+ * Returns true if the session being resumed on the connection allows the
+ * whole request to be sent as early data, counting the attempt
+ */
+bool ff_http_tls_early_data_begin(BIO *web, struct ff_request *request);
+
+/**
+ * Records whether the upstream accepted the early data once the handshake
+ * has finished, a rejected request must be written again
+ */
+bool ff_http_tls_early_data_accepted(BIO *web, char *session_host);
+
+/**
+ * Reads from the TLS connection pointed to by context for ff_http_reader
+ */
+ssize_t ff_http_tls_read(void *context, void *buff, size_t length);
+
+/**
+ * Non-blocking read from the TLS connection in context for the drainer
+ */
+ssize_t ff_http_tls_drain_read(int sockfd, void *context, void *buff, size_t length);
+
+/**
+ * Sends close_notify and frees the connection
+ */
+void ff_http_tls_connection_close(int sockfd, void *context);
+
 char *ff_http_get_destination_host(struct ff_request *request);
 
+SSL_CTX *ff_http_tls_context_new(const char *ca_bundle);
+
+/**
+ * Returns a reference to the shared TLS context, released with SSL_CTX_free
+ */
+SSL_CTX *ff_http_tls_context_acquire(void);
+
+/**
+ * Called by OpenSSL with each session (or TLS 1.3 ticket) issued by an upstream host
+ */
+int ff_http_tls_session_new(SSL *ssl, SSL_SESSION *session);
+
 
 #endif
\ No newline at end of file
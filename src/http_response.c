@@ -0,0 +1,653 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <errno.h>
+#include "http_response.h"
+#include "http_response_p.h"
+#include "logging.h"
+
+void ff_http_reader_init(struct ff_http_reader *reader, ff_http_reader_read read, void *context)
+{
+    reader->read = read;
+    reader->context = context;
+    reader->start = 0;
+    reader->end = 0;
+    reader->received = 0;
+    reader->blocked = false;
+    reader->closed = false;
+}
+
+bool ff_http_response_read(struct ff_http_reader *reader, bool head_request, struct ff_http_response *response)
+{
+    bool has_body;
+
+    do
+    {
+        if (!ff_http_response_read_head(reader, response))
+        {
+            return false;
+        }
+
+        // Interim responses are followed by the final response on the same connection
+    } while (response->status >= 100 && response->status < 200 && response->status != 101);
+
+    if (response->status == 101)
+    {
+        // Switched away from HTTP, the connection is no longer ours to reuse
+        response->keep_alive = false;
+        return true;
+    }
+
+    has_body = !head_request && response->status != 204 && response->status != 304;
+
+    if (!has_body)
+    {
+        return true;
+    }
+
+    if (response->chunked)
+    {
+        return ff_http_response_read_chunked_body(reader, response);
+    }
+
+    if (response->content_length < 0 || response->content_length > FF_HTTP_RESPONSE_MAX_DRAIN_BYTES)
+    {
+        // Framed by the connection closing or too large to drain
+        response->keep_alive = false;
+        return true;
+    }
+
+    return ff_http_reader_skip(reader, (uint64_t)response->content_length);
+}
+
+bool ff_http_response_read_head(struct ff_http_reader *reader, struct ff_http_response *response)
+{
+    char *line = NULL;
+
+    memset(response, 0, sizeof(struct ff_http_response));
+    response->content_length = -1;
+
+    if (!ff_http_reader_read_line(reader, &line) || !ff_http_response_parse_status_line(line, response))
+    {
+        return false;
+    }
+
+    while (ff_http_reader_read_line(reader, &line))
+    {
+        if (*line == '\0')
+        {
+            break;
+        }
+
+        if (!ff_http_response_parse_header(line, response))
+        {
+            ff_log(FF_WARNING, "Received malformed response header");
+            return false;
+        }
+    }
+
+    return line != NULL && *line == '\0';
+}
+
+void ff_http_response_framer_init(struct ff_http_response_framer *framer, bool head_request, bool status_only)
+{
+    memset(framer, 0, sizeof(struct ff_http_response_framer));
+    framer->state = FF_HTTP_FRAMER_HEAD;
+    framer->head_request = head_request;
+    framer->status_only = status_only;
+}
+
+enum ff_http_frame_result ff_http_response_frame(struct ff_http_reader *reader, struct ff_http_response_framer *framer)
+{
+    struct ff_http_response *response = &framer->response;
+    char *line = NULL;
+    size_t buffered;
+
+    while (1)
+    {
+        switch (framer->state)
+        {
+        case FF_HTTP_FRAMER_HEAD:
+            if (framer->status_only)
+            {
+                if (!ff_http_reader_read_line(reader, &line))
+                {
+                    goto unavailable;
+                }
+
+                memset(response, 0, sizeof(struct ff_http_response));
+
+                if (!ff_http_response_parse_status_line(line, response))
+                {
+                    return FF_HTTP_FRAME_ERROR;
+                }
+
+                // The rest of the response is never read so the connection can't be reused
+                response->keep_alive = false;
+                framer->state = FF_HTTP_FRAMER_DONE;
+                break;
+            }
+
+            // Headers are parsed once all of them have arrived so a head is never half read
+            if (!ff_http_reader_fill_head(reader))
+            {
+                goto unavailable;
+            }
+
+            if (!ff_http_response_read_head(reader, response))
+            {
+                return FF_HTTP_FRAME_ERROR;
+            }
+
+            if (response->status >= 100 && response->status < 200 && response->status != 101)
+            {
+                break;
+            }
+
+            if (response->status == 101)
+            {
+                response->keep_alive = false;
+                framer->state = FF_HTTP_FRAMER_DONE;
+            }
+            else if (framer->head_request || response->status == 204 || response->status == 304)
+            {
+                framer->state = FF_HTTP_FRAMER_DONE;
+            }
+            else if (response->chunked)
+            {
+                framer->state = FF_HTTP_FRAMER_CHUNK_SIZE;
+            }
+            else if (response->content_length < 0 || response->content_length > FF_HTTP_RESPONSE_MAX_DRAIN_BYTES)
+            {
+                response->keep_alive = false;
+                framer->state = FF_HTTP_FRAMER_DONE;
+            }
+            else
+            {
+                framer->remaining = (uint64_t)response->content_length;
+                framer->state = FF_HTTP_FRAMER_BODY;
+            }
+            break;
+
+        case FF_HTTP_FRAMER_BODY:
+        case FF_HTTP_FRAMER_CHUNK_DATA:
+            while (framer->remaining > 0)
+            {
+                if (reader->start == reader->end && !ff_http_reader_fill(reader))
+                {
+                    goto unavailable;
+                }
+
+                buffered = reader->end - reader->start;
+                buffered = buffered > framer->remaining ? (size_t)framer->remaining : buffered;
+                reader->start += buffered;
+                framer->remaining -= buffered;
+            }
+
+            framer->state = framer->state == FF_HTTP_FRAMER_BODY ? FF_HTTP_FRAMER_DONE : FF_HTTP_FRAMER_CHUNK_END;
+            break;
+
+        case FF_HTTP_FRAMER_CHUNK_SIZE:
+            if (!ff_http_reader_read_line(reader, &line))
+            {
+                goto unavailable;
+            }
+
+            if (!ff_http_response_parse_chunk_size(line, &framer->remaining))
+            {
+                return FF_HTTP_FRAME_ERROR;
+            }
+
+            if (framer->remaining == 0)
+            {
+                framer->state = FF_HTTP_FRAMER_TRAILERS;
+                break;
+            }
+
+            framer->drained += framer->remaining;
+
+            if (framer->drained > FF_HTTP_RESPONSE_MAX_DRAIN_BYTES)
+            {
+                response->keep_alive = false;
+                framer->state = FF_HTTP_FRAMER_DONE;
+                break;
+            }
+
+            framer->state = FF_HTTP_FRAMER_CHUNK_DATA;
+            break;
+
+        case FF_HTTP_FRAMER_CHUNK_END:
+            if (!ff_http_reader_read_line(reader, &line))
+            {
+                goto unavailable;
+            }
+
+            if (*line != '\0')
+            {
+                return FF_HTTP_FRAME_ERROR;
+            }
+
+            framer->state = FF_HTTP_FRAMER_CHUNK_SIZE;
+            break;
+
+        case FF_HTTP_FRAMER_TRAILERS:
+            if (!ff_http_reader_read_line(reader, &line))
+            {
+                goto unavailable;
+            }
+
+            if (*line == '\0')
+            {
+                framer->state = FF_HTTP_FRAMER_DONE;
+            }
+            break;
+
+        case FF_HTTP_FRAMER_DONE:
+            return FF_HTTP_FRAME_DONE;
+
+        default:
+            return FF_HTTP_FRAME_ERROR;
+        }
+    }
+
+unavailable:
+    return reader->blocked ? FF_HTTP_FRAME_AGAIN : FF_HTTP_FRAME_ERROR;
+}
+
+bool ff_http_response_parse_status_line(char *line, struct ff_http_response *response)
+{
+    char *end = NULL;
+    long status;
+
+    snprintf(response->status_line, sizeof(response->status_line), "%s", line);
+
+    if (strncasecmp(line, "HTTP/1.1 ", 9) == 0)
+    {
+        response->keep_alive = true;
+    }
+    else if (strncasecmp(line, "HTTP/1.0 ", 9) == 0)
+    {
+        response->keep_alive = false;
+    }
+    else
+    {
+        ff_log(FF_WARNING, "Received response with unsupported status line: %.*s", FF_HTTP_RESPONSE_STATUS_LINE_LOG_LENGTH, line);
+        return false;
+    }
+
+    status = strtol(line + 9, &end, 10);
+
+    if (end != line + 12 || status < 100 || status > 999)
+    {
+        ff_log(FF_WARNING, "Received response with invalid status code: %.*s", FF_HTTP_RESPONSE_STATUS_LINE_LOG_LENGTH, line);
+        return false;
+    }
+
+    response->status = (uint16_t)status;
+
+    return true;
+}
+
+bool ff_http_response_parse_header(char *line, struct ff_http_response *response)
+{
+    char *value = strchr(line, ':');
+    char *end = NULL;
+    long long content_length;
+
+    if (value == NULL)
+    {
+        return false;
+    }
+
+    *value++ = '\0';
+
+    while (*value == ' ' || *value == '\t')
+    {
+        value++;
+    }
+
+    if (strcasecmp(line, "Content-Length") == 0)
+    {
+        content_length = strtoll(value, &end, 10);
+
+        // Conflicting lengths can't be framed safely
+        if (end == value || content_length < 0 ||
+            (response->content_length >= 0 && response->content_length != content_length))
+        {
+            return false;
+        }
+
+        response->content_length = (int64_t)content_length;
+    }
+    else if (strcasecmp(line, "Transfer-Encoding") == 0)
+    {
+        response->chunked = ff_http_header_has_token(value, "chunked");
+    }
+    else if (strcasecmp(line, "Connection") == 0)
+    {
+        if (ff_http_header_has_token(value, "close"))
+        {
+            response->keep_alive = false;
+        }
+        else if (ff_http_header_has_token(value, "keep-alive"))
+        {
+            response->keep_alive = true;
+        }
+    }
+
+    return true;
+}
+
+bool ff_http_response_parse_chunk_size(char *line, uint64_t *length)
+{
+    char *end = NULL;
+
+    *length = (uint64_t)strtoull(line, &end, 16);
+
+    // Chunk extensions follow a semicolon
+    if (end == line || (*end != '\0' && *end != ';' && *end != ' '))
+    {
+        ff_log(FF_WARNING, "Received response with invalid chunk size");
+        return false;
+    }
+
+    return true;
+}
+
+bool ff_http_response_read_chunked_body(struct ff_http_reader *reader, struct ff_http_response *response)
+{
+    char *line = NULL;
+    uint64_t chunk_length;
+    uint64_t drained = 0;
+
+    while (1)
+    {
+        if (!ff_http_reader_read_line(reader, &line) || !ff_http_response_parse_chunk_size(line, &chunk_length))
+        {
+            return false;
+        }
+
+        if (chunk_length == 0)
+        {
+            break;
+        }
+
+        drained += chunk_length;
+
+        if (drained > FF_HTTP_RESPONSE_MAX_DRAIN_BYTES)
+        {
+            response->keep_alive = false;
+            return true;
+        }
+
+        if (!ff_http_reader_skip(reader, chunk_length) || !ff_http_reader_read_line(reader, &line) || *line != '\0')
+        {
+            return false;
+        }
+    }
+
+    // Trailers end with an empty line
+    while (ff_http_reader_read_line(reader, &line))
+    {
+        if (*line == '\0')
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool ff_http_reader_fill(struct ff_http_reader *reader)
+{
+    ssize_t chunk;
+
+    if (reader->start > 0)
+    {
+        memmove(reader->buff, reader->buff + reader->start, reader->end - reader->start);
+        reader->end -= reader->start;
+        reader->start = 0;
+    }
+
+    // Reserve a byte to NULL terminate lines
+    if (reader->end >= sizeof(reader->buff) - 1)
+    {
+        return false;
+    }
+
+    chunk = reader->read(reader->context, reader->buff + reader->end, sizeof(reader->buff) - 1 - reader->end);
+    reader->blocked = chunk < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+    reader->closed = chunk == 0 || (chunk < 0 && ff_http_connection_reset(errno));
+
+    if (chunk <= 0)
+    {
+        return false;
+    }
+
+    reader->end += (size_t)chunk;
+    reader->received += (uint64_t)chunk;
+
+    return true;
+}
+
+bool ff_http_reader_fill_head(struct ff_http_reader *reader)
+{
+    char *line_end;
+    char *buffered_end;
+
+    while (1)
+    {
+        buffered_end = reader->buff + reader->end;
+
+        // An empty line ends the headers, which may be a bare or CRLF line ending
+        for (line_end = memchr(reader->buff + reader->start, '\n', reader->end - reader->start);
+             line_end != NULL;
+             line_end = memchr(line_end + 1, '\n', (size_t)(buffered_end - line_end - 1)))
+        {
+            if ((line_end + 1 < buffered_end && *(line_end + 1) == '\n') ||
+                (line_end + 2 < buffered_end && *(line_end + 1) == '\r' && *(line_end + 2) == '\n'))
+            {
+                return true;
+            }
+        }
+
+        if (!ff_http_reader_fill(reader))
+        {
+            return false;
+        }
+    }
+}
+
+bool ff_http_reader_read_line(struct ff_http_reader *reader, char **line)
+{
+    char *line_end = NULL;
+
+    *line = NULL;
+
+    while ((line_end = memchr(reader->buff + reader->start, '\n', reader->end - reader->start)) == NULL)
+    {
+        if (!ff_http_reader_fill(reader))
+        {
+            return false;
+        }
+    }
+
+    *line = reader->buff + reader->start;
+    reader->start = (size_t)(line_end - reader->buff) + 1;
+
+    if (line_end > *line && *(line_end - 1) == '\r')
+    {
+        line_end--;
+    }
+
+    *line_end = '\0';
+
+    return true;
+}
+
+bool ff_http_reader_skip(struct ff_http_reader *reader, uint64_t length)
+{
+    size_t buffered;
+
+    while (length > 0)
+    {
+        if (reader->start == reader->end && !ff_http_reader_fill(reader))
+        {
+            return false;
+        }
+
+        buffered = reader->end - reader->start;
+        buffered = buffered > length ? (size_t)length : buffered;
+        reader->start += buffered;
+        length -= buffered;
+    }
+
+    return true;
+}
+
+bool ff_http_header_has_token(char *value, const char *token)
+{
+    size_t token_length = strlen(token);
+    char *item = value;
+    size_t item_length;
+
+    while (*item != '\0')
+    {
+        while (*item == ' ' || *item == '\t' || *item == '\r' || *item == ',')
+        {
+            item++;
+        }
+
+        item_length = strcspn(item, ", \t\r");
+
+        if (item_length == token_length && strncasecmp(item, token, token_length) == 0)
+        {
+            return true;
+        }
+
+        item += item_length;
+    }
+
+    return false;
+}
+
+bool ff_http_request_keep_alive(struct ff_request *request, bool *head_request)
+{
+    char *http_request = (char *)request->payload->value;
+    uint64_t length = request->payload_length;
+    char *line_end = memchr(http_request, '\n', length);
+    char *version_end = NULL;
+    char *line = NULL;
+    char *next_line = NULL;
+    bool keep_alive;
+
+    *head_request = length >= 5 && strncmp(http_request, "HEAD ", 5) == 0;
+
+    if (line_end == NULL)
+    {
+        return false;
+    }
+
+    version_end = line_end > http_request && *(line_end - 1) == '\r' ? line_end - 1 : line_end;
+
+    // The request line ends with the HTTP version
+    if (version_end - http_request >= 8 && strncasecmp(version_end - 8, "HTTP/1.1", 8) == 0)
+    {
+        keep_alive = true;
+    }
+    else
+    {
+        keep_alive = false;
+    }
+
+    for (line = line_end + 1; line < http_request + length; line = next_line + 1)
+    {
+        if ((next_line = memchr(line, '\n', http_request + length - line)) == NULL)
+        {
+            break;
+        }
+
+        if (next_line == line || (next_line == line + 1 && *line == '\r'))
+        {
+            break;
+        }
+
+        if (next_line - line > 11 && strncasecmp(line, "connection:", 11) == 0)
+        {
+            char value[FF_HTTP_READER_BUFF_SIZE];
+            size_t value_length = (size_t)(next_line - line - 11);
+
+            value_length = value_length >= sizeof(value) ? sizeof(value) - 1 : value_length;
+            memcpy(value, line + 11, value_length);
+            value[value_length] = '\0';
+
+            if (ff_http_header_has_token(value, "close"))
+            {
+                keep_alive = false;
+            }
+            else if (ff_http_header_has_token(value, "keep-alive"))
+            {
+                keep_alive = true;
+            }
+        }
+    }
+
+    return keep_alive;
+}
+
+bool ff_http_request_is_safe(struct ff_request *request)
+{
+    static const char *safe_methods[] = {"GET ", "HEAD ", "OPTIONS ", "TRACE "};
+
+    return ff_http_request_has_method(request, safe_methods, sizeof(safe_methods) / sizeof(safe_methods[0]));
+}
+
+bool ff_http_request_is_idempotent(struct ff_request *request)
+{
+    static const char *idempotent_methods[] = {"GET ", "HEAD ", "OPTIONS ", "TRACE ", "PUT ", "DELETE "};
+
+    return ff_http_request_has_method(request, idempotent_methods, sizeof(idempotent_methods) / sizeof(idempotent_methods[0]));
+}
+
+bool ff_http_request_has_method(struct ff_request *request, const char **methods, size_t length)
+{
+    char *http_request = (char *)request->payload->value;
+
+    for (size_t i = 0; i < length; i++)
+    {
+        size_t method_length = strlen(methods[i]);
+
+        // Methods are case sensitive
+        if (request->payload_length >= method_length && strncmp(http_request, methods[i], method_length) == 0)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool ff_http_response_reusable(struct ff_http_reader *reader, struct ff_http_response *response)
+{
+    if (!response->keep_alive)
+    {
+        return false;
+    }
+
+    if (reader->start != reader->end)
+    {
+        ff_log(FF_DEBUG, "Closing connection with %zu unexpected bytes after the response", reader->end - reader->start);
+        return false;
+    }
+
+    return true;
+}
+
+bool ff_http_connection_reset(int error)
+{
+    return error == ECONNRESET || error == EPIPE;
+}
@@ -0,0 +1,131 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/types.h>
+#include "request.h"
+
+#ifndef FF_HTTP_RESPONSE_H
+#define FF_HTTP_RESPONSE_H
+
+#define FF_HTTP_READER_BUFF_SIZE 4096
+// Larger bodies are not drained to reuse the connection, it is closed instead
+#define FF_HTTP_RESPONSE_MAX_DRAIN_BYTES (1024 * 1024)
+#define FF_HTTP_RESPONSE_STATUS_LINE_LOG_LENGTH 100
+
+// Returns the bytes read, 0 on EOF or -1 on error. Non-blocking reads
+// return -1 with errno EAGAIN when no data is ready.
+typedef ssize_t (*ff_http_reader_read)(void *context, void *buff, size_t length);
+
+/**
+ * Buffers reads from an upstream connection so responses can be framed
+ */
+struct ff_http_reader
+{
+    ff_http_reader_read read;
+    void *context;
+    char buff[FF_HTTP_READER_BUFF_SIZE];
+    size_t start;
+    size_t end;
+    uint64_t received;
+    // The last read failed only because no data was ready
+    bool blocked;
+    // The last read found the connection closed or reset by the upstream
+    bool closed;
+};
+
+struct ff_http_response
+{
+    uint16_t status;
+    // The connection is positioned at the start of the next response and may be reused
+    bool keep_alive;
+    bool chunked;
+    // -1 = not sent
+    int64_t content_length;
+    char status_line[FF_HTTP_RESPONSE_STATUS_LINE_LOG_LENGTH + 1];
+};
+
+enum ff_http_framer_state
+{
+    FF_HTTP_FRAMER_HEAD = 1,
+    FF_HTTP_FRAMER_BODY = 2,
+    FF_HTTP_FRAMER_CHUNK_SIZE = 3,
+    FF_HTTP_FRAMER_CHUNK_DATA = 4,
+    FF_HTTP_FRAMER_CHUNK_END = 5,
+    FF_HTTP_FRAMER_TRAILERS = 6,
+    FF_HTTP_FRAMER_DONE = 7
+};
+
+enum ff_http_frame_result
+{
+    // The response has been read, or can't be framed and is marked as not keep alive
+    FF_HTTP_FRAME_DONE = 1,
+    // Waiting on the reader for more data
+    FF_HTTP_FRAME_AGAIN = 2,
+    FF_HTTP_FRAME_ERROR = 3
+};
+
+/**
+ * Progress through a response read from a non-blocking reader, resumed
+ * each time the connection becomes readable
+ */
+struct ff_http_response_framer
+{
+    enum ff_http_framer_state state;
+    bool head_request;
+    // Only the status line is wanted, the rest of the response is left unread
+    bool status_only;
+    // Bytes left of the body or current chunk
+    uint64_t remaining;
+    uint64_t drained;
+    struct ff_http_response response;
+};
+
+void ff_http_reader_init(struct ff_http_reader *reader, ff_http_reader_read read, void *context);
+
+/**
+ * Reads a response up to its end. Bodies which can only be framed by the
+ * connection closing, or are too large to drain, are left unread and the
+ * response is marked as not keep alive. Returns false if the response could
+ * not be read or framed.
+ */
+bool ff_http_response_read(struct ff_http_reader *reader, bool head_request, struct ff_http_response *response);
+
+/**
+ * Returns true if the connection may be pooled once the response was read.
+ * Bytes buffered past the end of the response would be taken as the start
+ * of the next one, so the connection is closed instead.
+ */
+bool ff_http_response_reusable(struct ff_http_reader *reader, struct ff_http_response *response);
+
+void ff_http_response_framer_init(struct ff_http_response_framer *framer, bool head_request, bool status_only);
+
+/**
+ * Reads as much of the response as the reader has ready, framing it the
+ * same way as ff_http_response_read without blocking
+ */
+enum ff_http_frame_result ff_http_response_frame(struct ff_http_reader *reader, struct ff_http_response_framer *framer);
+
+/**
+ * Returns true if the upstream may keep the connection open after responding
+ * to the request, based on its HTTP version and Connection header
+ */
+bool ff_http_request_keep_alive(struct ff_request *request, bool *head_request);
+
+/**
+ * Returns true if the request's method is safe (RFC 9110), so replaying it
+ * has no effect on the upstream beyond what sending it once would
+ */
+bool ff_http_request_is_safe(struct ff_request *request);
+
+/**
+ * Returns true if the request's method is idempotent (RFC 9110), so it may
+ * be sent again when the connection closes before a response arrives
+ */
+bool ff_http_request_is_idempotent(struct ff_request *request);
+
+/**
+ * Returns true if a read or write failed with this errno because the upstream
+ * closed or reset the connection, rather than timing out
+ */
+bool ff_http_connection_reset(int error);
+
+#endif
@@ -0,0 +1,40 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include "http_response.h"
+
+#ifndef FF_HTTP_RESPONSE_P_H
+#define FF_HTTP_RESPONSE_P_H
+
+bool ff_http_reader_fill(struct ff_http_reader *reader);
+
+/**
+ * Consumes the next line, returned without its line ending and NULL terminated
+ */
+bool ff_http_reader_read_line(struct ff_http_reader *reader, char **line);
+
+bool ff_http_reader_skip(struct ff_http_reader *reader, uint64_t length);
+
+/**
+ * Returns true once a status line and its headers are buffered, reading
+ * more until they are or the reader has nothing ready
+ */
+bool ff_http_reader_fill_head(struct ff_http_reader *reader);
+
+/**
+ * Reads a status line and its headers, the final response may be preceded by interim ones
+ */
+bool ff_http_response_read_head(struct ff_http_reader *reader, struct ff_http_response *response);
+
+bool ff_http_response_parse_status_line(char *line, struct ff_http_response *response);
+
+bool ff_http_response_parse_header(char *line, struct ff_http_response *response);
+
+bool ff_http_response_parse_chunk_size(char *line, uint64_t *length);
+
+bool ff_http_response_read_chunked_body(struct ff_http_reader *reader, struct ff_http_response *response);
+
+bool ff_http_header_has_token(char *value, const char *token);
+
+bool ff_http_request_has_method(struct ff_request *request, const char **methods, size_t length);
+
+#endif
@@ -0,0 +1,243 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <pthread.h>
+#include <openssl/crypto.h>
+#include "key_cache.h"
+#include "key_cache_p.h"
+#include "stats.h"
+#include "logging.h"
+#include "alloc.h"
+
+struct ff_key_cache *ff_key_cache_init(uint32_t capacity)
+{
+    struct ff_key_cache *cache = calloc(1, sizeof(struct ff_key_cache));
+
+    cache->entries = ff_lru_table_init(capacity, ff_key_cache_evictable, ff_key_cache_release);
+    pthread_mutex_init(&cache->mutex, NULL);
+    pthread_cond_init(&cache->derived, NULL);
+
+    return cache;
+}
+
+uint8_t *ff_key_cache_key(uint8_t key_derivation_mode, uint8_t *salt, uint16_t salt_length, uint8_t *buffer)
+{
+    uint8_t *key = buffer;
+
+    if (1 + (size_t)salt_length > FF_KEY_CACHE_KEY_BUFFER_LENGTH)
+    {
+        key = malloc(1 + (size_t)salt_length);
+    }
+
+    key[0] = key_derivation_mode;
+    memcpy(key + 1, salt, salt_length);
+
+    return key;
+}
+
+struct ff_key_cache_entry *ff_key_cache_find(struct ff_key_cache *cache, uint8_t *key, size_t key_length)
+{
+    return (struct ff_key_cache_entry *)ff_lru_table_find(cache->entries, key, key_length);
+}
+
+bool ff_key_cache_get(
+    struct ff_key_cache *cache,
+    uint8_t key_derivation_mode,
+    uint8_t *salt,
+    uint16_t salt_length,
+    struct ff_derived_key *out_key,
+    ff_key_cache_derive derive,
+    void *context)
+{
+    bool ret_val = false;
+    bool derived;
+    uint8_t buffer[FF_KEY_CACHE_KEY_BUFFER_LENGTH];
+    uint8_t *key = ff_key_cache_key(key_derivation_mode, salt, salt_length, buffer);
+    size_t key_length = 1 + (size_t)salt_length;
+    struct ff_key_cache_entry *entry = NULL;
+
+    pthread_mutex_lock(&cache->mutex);
+
+    while ((entry = ff_key_cache_find(cache, key, key_length)) != NULL)
+    {
+        if (entry->state == FF_KEY_CACHE_ENTRY_READY)
+        {
+            break;
+        }
+
+        // Another thread is deriving this key, wait for it rather than repeating the work
+        FF_STATS_INC(key_cache_coalesced);
+        entry->waiters++;
+
+        while (entry->state == FF_KEY_CACHE_ENTRY_PENDING)
+        {
+            pthread_cond_wait(&cache->derived, &cache->mutex);
+        }
+
+        entry->waiters--;
+
+        if (entry->state == FF_KEY_CACHE_ENTRY_READY && entry->key->length == out_key->length)
+        {
+            memcpy(out_key->key, entry->key->key, out_key->length);
+            ret_val = true;
+        }
+
+        if (!entry->linked && entry->waiters == 0)
+        {
+            ff_key_cache_entry_free(entry);
+        }
+
+        if (ret_val)
+        {
+            FF_STATS_INC(key_cache_hits);
+            goto cleanup;
+        }
+
+        // The derivation failed or the entry was evicted before we woke, look again
+    }
+
+    if (entry != NULL && entry->key->length == out_key->length)
+    {
+        ff_lru_table_touch(cache->entries, &entry->lru);
+        memcpy(out_key->key, entry->key->key, out_key->length);
+        FF_STATS_INC(key_cache_hits);
+        ret_val = true;
+        goto cleanup;
+    }
+
+    FF_STATS_INC(key_cache_misses);
+
+    if (entry != NULL)
+    {
+        // Cached with a different key length, replace it
+        ff_key_cache_unlink(cache, entry);
+    }
+
+    entry = ff_key_cache_insert(cache, key, key_length, out_key->length);
+
+    pthread_mutex_unlock(&cache->mutex);
+
+    derived = derive(context, key_derivation_mode, salt, salt_length, entry->key);
+
+    pthread_mutex_lock(&cache->mutex);
+
+    if (derived)
+    {
+        entry->state = FF_KEY_CACHE_ENTRY_READY;
+        ff_lru_table_touch(cache->entries, &entry->lru);
+        memcpy(out_key->key, entry->key->key, out_key->length);
+        ret_val = true;
+    }
+    else
+    {
+        entry->state = FF_KEY_CACHE_ENTRY_FAILED;
+        ff_key_cache_unlink(cache, entry);
+    }
+
+    pthread_cond_broadcast(&cache->derived);
+
+cleanup:
+    pthread_mutex_unlock(&cache->mutex);
+
+    if (key != buffer)
+    {
+        FREE(key);
+    }
+
+    return ret_val;
+}
+
+bool ff_key_cache_peek(
+    struct ff_key_cache *cache,
+    uint8_t key_derivation_mode,
+    uint8_t *salt,
+    uint16_t salt_length,
+    struct ff_derived_key *out_key)
+{
+    bool ret_val = false;
+    uint8_t buffer[FF_KEY_CACHE_KEY_BUFFER_LENGTH];
+    uint8_t *key = ff_key_cache_key(key_derivation_mode, salt, salt_length, buffer);
+    struct ff_key_cache_entry *entry = NULL;
+
+    pthread_mutex_lock(&cache->mutex);
+
+    entry = ff_key_cache_find(cache, key, 1 + (size_t)salt_length);
+
+    if (entry != NULL && entry->state == FF_KEY_CACHE_ENTRY_READY && entry->key->length == out_key->length)
+    {
+        ff_lru_table_touch(cache->entries, &entry->lru);
+        memcpy(out_key->key, entry->key->key, out_key->length);
+        FF_STATS_INC(key_cache_hits);
+        ret_val = true;
+    }
+
+    pthread_mutex_unlock(&cache->mutex);
+
+    if (key != buffer)
+    {
+        FREE(key);
+    }
+
+    return ret_val;
+}
+
+struct ff_key_cache_entry *ff_key_cache_insert(struct ff_key_cache *cache, uint8_t *key, size_t key_length, uint16_t derived_key_length)
+{
+    uint64_t evictions = cache->entries->evictions;
+    struct ff_key_cache_entry *entry = NULL;
+
+    // Pending entries are never evicted so the cache may briefly exceed its capacity
+    entry = (struct ff_key_cache_entry *)ff_lru_table_insert(cache->entries, key, key_length, sizeof(struct ff_key_cache_entry));
+
+    FF_STATS_ADD(key_cache_evictions, cache->entries->evictions - evictions);
+
+    entry->key = ff_derived_key_alloc(derived_key_length);
+    entry->state = FF_KEY_CACHE_ENTRY_PENDING;
+    entry->linked = true;
+
+    return entry;
+}
+
+void ff_key_cache_unlink(struct ff_key_cache *cache, struct ff_key_cache_entry *entry)
+{
+    ff_lru_table_remove(cache->entries, &entry->lru);
+}
+
+bool ff_key_cache_evictable(struct ff_lru_table_entry *entry)
+{
+    return ((struct ff_key_cache_entry *)entry)->state == FF_KEY_CACHE_ENTRY_READY;
+}
+
+void ff_key_cache_release(struct ff_lru_table_entry *lru)
+{
+    struct ff_key_cache_entry *entry = (struct ff_key_cache_entry *)lru;
+
+    entry->linked = false;
+
+    if (entry->waiters == 0)
+    {
+        ff_key_cache_entry_free(entry);
+    }
+}
+
+void ff_key_cache_entry_free(struct ff_key_cache_entry *entry)
+{
+    OPENSSL_cleanse(entry->key->key, entry->key->length);
+    ff_derived_key_free(entry->key);
+    FREE(entry);
+}
+
+void ff_key_cache_free(struct ff_key_cache *cache)
+{
+    if (cache == NULL)
+    {
+        return;
+    }
+
+    ff_lru_table_free(cache->entries);
+    pthread_cond_destroy(&cache->derived);
+    pthread_mutex_destroy(&cache->mutex);
+    FREE(cache);
+}
@@ -0,0 +1,74 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include "crypto.h"
+#include "lru_table.h"
+
+#ifndef FF_KEY_CACHE_H
+#define FF_KEY_CACHE_H
+
+enum ff_key_cache_entry_state
+{
+    // The key is being derived by another thread
+    FF_KEY_CACHE_ENTRY_PENDING = 1,
+    FF_KEY_CACHE_ENTRY_READY = 2,
+    // Derivation failed, waiting threads must retry
+    FF_KEY_CACHE_ENTRY_FAILED = 3
+};
+
+struct ff_key_cache_entry
+{
+    // Keyed by the derivation mode followed by the salt
+    struct ff_lru_table_entry lru;
+    struct ff_derived_key *key;
+    enum ff_key_cache_entry_state state;
+    // Threads blocked waiting for this entry to be derived
+    uint32_t waiters;
+    // False once the entry has been removed from the cache, freed by the last waiter
+    bool linked;
+};
+
+struct ff_key_cache
+{
+    // Pending entries are not evictable
+    struct ff_lru_table *entries;
+    pthread_mutex_t mutex;
+    pthread_cond_t derived;
+};
+
+typedef bool (*ff_key_cache_derive)(
+    void *context,
+    uint8_t key_derivation_mode,
+    uint8_t *salt,
+    uint16_t salt_length,
+    struct ff_derived_key *out_key);
+
+struct ff_key_cache *ff_key_cache_init(uint32_t capacity);
+
+/**
+ * Copies the key derived from (key_derivation_mode, salt) into out_key.
+ * On a miss the key is derived using the supplied function, concurrent
+ * callers for the same salt block until the first caller has finished.
+ */
+bool ff_key_cache_get(
+    struct ff_key_cache *cache,
+    uint8_t key_derivation_mode,
+    uint8_t *salt,
+    uint16_t salt_length,
+    struct ff_derived_key *out_key,
+    ff_key_cache_derive derive,
+    void *context);
+
+/**
+ * Copies the key into out_key only if it has already been derived, never blocks on derivation.
+ */
+bool ff_key_cache_peek(
+    struct ff_key_cache *cache,
+    uint8_t key_derivation_mode,
+    uint8_t *salt,
+    uint16_t salt_length,
+    struct ff_derived_key *out_key);
+
+void ff_key_cache_free(struct ff_key_cache *cache);
+
+#endif
@@ -0,0 +1,29 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "key_cache.h"
+
+#ifndef FF_KEY_CACHE_P_H
+#define FF_KEY_CACHE_P_H
+
+#define FF_KEY_CACHE_KEY_BUFFER_LENGTH 64
+
+/**
+ * Writes the table key for (key_derivation_mode, salt) into buffer if it fits,
+ * otherwise into a new allocation which the caller frees
+ */
+uint8_t *ff_key_cache_key(uint8_t key_derivation_mode, uint8_t *salt, uint16_t salt_length, uint8_t *buffer);
+
+struct ff_key_cache_entry *ff_key_cache_find(struct ff_key_cache *cache, uint8_t *key, size_t key_length);
+
+struct ff_key_cache_entry *ff_key_cache_insert(struct ff_key_cache *cache, uint8_t *key, size_t key_length, uint16_t derived_key_length);
+
+void ff_key_cache_unlink(struct ff_key_cache *cache, struct ff_key_cache_entry *entry);
+
+bool ff_key_cache_evictable(struct ff_lru_table_entry *entry);
+
+void ff_key_cache_release(struct ff_lru_table_entry *entry);
+
+void ff_key_cache_entry_free(struct ff_key_cache_entry *entry);
+
+#endif
@@ -0,0 +1,264 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <openssl/crypto.h>
+#include "keyring.h"
+#include "keyring_p.h"
+#include "key_cache.h"
+#include "pbkdf2.h"
+#include "logging.h"
+#include "alloc.h"
+
+struct ff_keyring *ff_keyring_init(const char *path, struct ff_encryption_config *defaults, uint32_t key_cache_size)
+{
+    struct ff_keyring *keyring = calloc(1, sizeof(struct ff_keyring));
+
+    keyring->path = strdup(path);
+    keyring->defaults = *defaults;
+    keyring->defaults.key = NULL;
+    keyring->defaults.pbkdf2 = NULL;
+    keyring->defaults.key_cache = NULL;
+    keyring->defaults.keyring = NULL;
+    keyring->defaults.replay_filter = NULL;
+    keyring->key_cache_size = key_cache_size;
+    pthread_mutex_init(&keyring->mutex, NULL);
+
+    if (!(keyring->keys = ff_keyring_load(keyring, &keyring->length)))
+    {
+        ff_keyring_free(keyring);
+        return NULL;
+    }
+
+    ff_log(FF_INFO, "Loaded %u keys from keyring %s", keyring->length, keyring->path);
+
+    return keyring;
+}
+
+bool ff_keyring_reload(struct ff_keyring *keyring)
+{
+    struct ff_hash_table *keys = NULL;
+    struct ff_hash_table *old_keys = NULL;
+    uint32_t length = 0;
+
+    if (!(keys = ff_keyring_load(keyring, &length)))
+    {
+        ff_log(FF_ERROR, "Failed to reload keyring %s, keeping the current keys", keyring->path);
+        return false;
+    }
+
+    pthread_mutex_lock(&keyring->mutex);
+    old_keys = keyring->keys;
+    keyring->keys = keys;
+    keyring->length = length;
+    pthread_mutex_unlock(&keyring->mutex);
+
+    // Keys removed from the file are freed once the requests using them finish
+    ff_keyring_keys_release(old_keys);
+
+    ff_log(FF_INFO, "Reloaded %u keys from keyring %s", length, keyring->path);
+
+    return true;
+}
+
+struct ff_hash_table *ff_keyring_load(struct ff_keyring *keyring, uint32_t *length)
+{
+    FILE *fd = NULL;
+    char line[FF_KEYRING_MAX_LINE_LENGTH];
+    uint32_t line_number = 0;
+    uint16_t id;
+    char *key = NULL;
+    struct ff_keyring_key *existing = NULL;
+    struct ff_keyring_key *loaded = NULL;
+    struct ff_hash_table *keys = ff_hash_table_init(8);
+
+    *length = 0;
+
+    if (!(fd = fopen(keyring->path, "r")))
+    {
+        ff_log(FF_ERROR, "Failed to open keyring %s (errno: %d)", keyring->path, errno);
+        goto error;
+    }
+
+    while (fgets(line, sizeof(line), fd) != NULL)
+    {
+        line_number++;
+        line[strcspn(line, "\r\n")] = '\0';
+
+        if (line[0] == '\0' || line[0] == '#')
+        {
+            continue;
+        }
+
+        if (!ff_keyring_parse_line(line, &id, &key))
+        {
+            ff_log(FF_ERROR, "Invalid key on line %u of keyring %s", line_number, keyring->path);
+            goto error;
+        }
+
+        if (ff_hash_table_get_item(keys, id) != NULL)
+        {
+            ff_log(FF_ERROR, "Duplicate key id %u on line %u of keyring %s", id, line_number, keyring->path);
+            goto error;
+        }
+
+        // Reuse unchanged keys so their derived key caches survive the reload
+        existing = keyring->keys == NULL ? NULL : ff_keyring_acquire(keyring, id);
+
+        if (existing != NULL && strcmp((char *)existing->encryption.key, key) == 0)
+        {
+            loaded = existing;
+        }
+        else
+        {
+            if (existing != NULL)
+            {
+                ff_keyring_release(existing);
+            }
+
+            loaded = ff_keyring_key_init(keyring, id, key);
+        }
+
+        OPENSSL_cleanse(line, sizeof(line));
+        ff_hash_table_put_item(keys, id, loaded);
+        (*length)++;
+    }
+
+    if (*length == 0)
+    {
+        ff_log(FF_ERROR, "Keyring %s does not contain any keys", keyring->path);
+        goto error;
+    }
+
+    goto done;
+
+error:
+    ff_keyring_keys_release(keys);
+    keys = NULL;
+    goto cleanup;
+
+done:
+    goto cleanup;
+
+cleanup:
+    OPENSSL_cleanse(line, sizeof(line));
+
+    if (fd != NULL)
+    {
+        fclose(fd);
+    }
+
+    return keys;
+}
+
+bool ff_keyring_parse_line(char *line, uint16_t *id, char **key)
+{
+    char *separator = strchr(line, ':');
+    char *end = NULL;
+    unsigned long parsed;
+
+    if (separator == NULL || separator == line || separator[1] == '\0')
+    {
+        return false;
+    }
+
+    *separator = '\0';
+    errno = 0;
+    parsed = strtoul(line, &end, 10);
+
+    if (errno != 0 || *end != '\0' || parsed == 0 || parsed > UINT16_MAX)
+    {
+        return false;
+    }
+
+    *id = (uint16_t)parsed;
+    *key = separator + 1;
+
+    return true;
+}
+
+struct ff_keyring_key *ff_keyring_key_init(struct ff_keyring *keyring, uint16_t id, const char *key)
+{
+    struct ff_keyring_key *keyring_key = calloc(1, sizeof(struct ff_keyring_key));
+
+    keyring_key->id = id;
+    keyring_key->references = 1;
+    keyring_key->encryption = keyring->defaults;
+    keyring_key->encryption.key = (uint8_t *)strdup(key);
+    keyring_key->encryption.pbkdf2 = ff_pbkdf2_hmac_sha256_init(keyring_key->encryption.key, strlen(key));
+
+    if (keyring->key_cache_size != 0)
+    {
+        keyring_key->encryption.key_cache = ff_key_cache_init(keyring->key_cache_size);
+    }
+
+    return keyring_key;
+}
+
+struct ff_keyring_key *ff_keyring_acquire(struct ff_keyring *keyring, uint16_t id)
+{
+    struct ff_keyring_key *key = NULL;
+
+    pthread_mutex_lock(&keyring->mutex);
+
+    if ((key = ff_hash_table_get_item(keyring->keys, id)) != NULL)
+    {
+        __atomic_add_fetch(&key->references, 1, __ATOMIC_RELAXED);
+    }
+
+    pthread_mutex_unlock(&keyring->mutex);
+
+    return key;
+}
+
+void ff_keyring_release(struct ff_keyring_key *key)
+{
+    if (key == NULL || __atomic_sub_fetch(&key->references, 1, __ATOMIC_ACQ_REL) != 0)
+    {
+        return;
+    }
+
+    OPENSSL_cleanse(key->encryption.key, strlen((char *)key->encryption.key));
+    FREE(key->encryption.key);
+    ff_pbkdf2_hmac_sha256_free(key->encryption.pbkdf2);
+    ff_key_cache_free(key->encryption.key_cache);
+    FREE(key);
+}
+
+void ff_keyring_keys_release(struct ff_hash_table *keys)
+{
+    struct ff_hash_table_snapshot *snapshot = NULL;
+    struct ff_keyring_key *key = NULL;
+
+    if (keys == NULL)
+    {
+        return;
+    }
+
+    // Freeing a key frees its key cache's table, which needs the lock an iterator would hold
+    snapshot = ff_hash_table_snapshot_init(keys);
+
+    while ((key = ff_hash_table_snapshot_next(snapshot, NULL)) != NULL)
+    {
+        ff_keyring_release(key);
+    }
+
+    ff_hash_table_snapshot_free(snapshot);
+    ff_hash_table_free(keys);
+}
+
+void ff_keyring_free(struct ff_keyring *keyring)
+{
+    if (keyring == NULL)
+    {
+        return;
+    }
+
+    ff_keyring_keys_release(keyring->keys);
+    pthread_mutex_destroy(&keyring->mutex);
+    FREE(keyring->path);
+    FREE(keyring);
+}
@@ -0,0 +1,59 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include "crypto.h"
+#include "hash_table.h"
+
+#ifndef FF_KEYRING_H
+#define FF_KEYRING_H
+
+#define FF_KEYRING_MAX_LINE_LENGTH 1024
+
+/**
+ * A pre-shared key along with the state precomputed for it, shared between
+ * keyring generations while the key is unchanged so reloads keep its caches.
+ */
+struct ff_keyring_key
+{
+    uint16_t id;
+    // Held by each keyring generation containing the key and each request using it
+    uint32_t references;
+    struct ff_encryption_config encryption;
+};
+
+struct ff_keyring
+{
+    char *path;
+    // Settings applied to every key, the key itself is ignored
+    struct ff_encryption_config defaults;
+    uint32_t key_cache_size;
+    // Current generation, key id -> struct ff_keyring_key
+    struct ff_hash_table *keys;
+    uint32_t length;
+    pthread_mutex_t mutex;
+};
+
+/**
+ * Loads a keyring file containing one key per line formatted as "id:key",
+ * where id is between 1 and 65535. Blank lines and lines beginning with #
+ * are ignored. Returns NULL if the file could not be loaded.
+ */
+struct ff_keyring *ff_keyring_init(const char *path, struct ff_encryption_config *defaults, uint32_t key_cache_size);
+
+/**
+ * Reloads the keyring from its file, requests holding keys from the previous
+ * generation are unaffected. The current keys are kept if the file is invalid.
+ */
+bool ff_keyring_reload(struct ff_keyring *keyring);
+
+/**
+ * Returns the key with the supplied id or NULL, the key must be released
+ * with ff_keyring_release once it is no longer needed.
+ */
+struct ff_keyring_key *ff_keyring_acquire(struct ff_keyring *keyring, uint16_t id);
+
+void ff_keyring_release(struct ff_keyring_key *key);
+
+void ff_keyring_free(struct ff_keyring *keyring);
+
+#endif
@@ -0,0 +1,16 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include "keyring.h"
+
+#ifndef FF_KEYRING_P_H
+#define FF_KEYRING_P_H
+
+struct ff_hash_table *ff_keyring_load(struct ff_keyring *keyring, uint32_t *length);
+
+bool ff_keyring_parse_line(char *line, uint16_t *id, char **key);
+
+struct ff_keyring_key *ff_keyring_key_init(struct ff_keyring *keyring, uint16_t id, const char *key);
+
+void ff_keyring_keys_release(struct ff_hash_table *keys);
+
+#endif
@@ -0,0 +1,183 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "lru_table.h"
+#include "lru_table_p.h"
+#include "hash_table.h"
+#include "fnv.h"
+#include "alloc.h"
+
+struct ff_lru_table *ff_lru_table_init(uint32_t capacity, ff_lru_table_evictable evictable, ff_lru_table_release release)
+{
+    struct ff_lru_table *table = calloc(1, sizeof(struct ff_lru_table));
+
+    table->capacity = capacity;
+    table->entries = ff_hash_table_init(16);
+    table->evictable = evictable;
+    table->release = release;
+
+    return table;
+}
+
+struct ff_lru_table_entry *ff_lru_table_find(struct ff_lru_table *table, const void *key, size_t key_length)
+{
+    return ff_lru_table_find_hashed(table, ff_fnv_hash(key, key_length), key, key_length);
+}
+
+struct ff_lru_table_entry *ff_lru_table_find_string(struct ff_lru_table *table, const char *key)
+{
+    return ff_lru_table_find(table, key, strlen(key));
+}
+
+struct ff_lru_table_entry *ff_lru_table_find_hashed(struct ff_lru_table *table, uint64_t hash, const void *key, size_t key_length)
+{
+    struct ff_lru_table_entry *entry = ff_hash_table_get_item(table->entries, hash);
+
+    while (entry != NULL && (entry->key_length != key_length || memcmp(entry->key, key, key_length) != 0))
+    {
+        entry = entry->next;
+    }
+
+    return entry;
+}
+
+void ff_lru_table_touch(struct ff_lru_table *table, struct ff_lru_table_entry *entry)
+{
+    ff_lru_table_lru_remove(table, entry);
+    ff_lru_table_lru_append(table, entry);
+}
+
+struct ff_lru_table_entry *ff_lru_table_insert(struct ff_lru_table *table, const void *key, size_t key_length, size_t entry_size)
+{
+    uint64_t hash = ff_fnv_hash(key, key_length);
+    struct ff_lru_table_entry *entry = table->lru_first;
+    struct ff_lru_table_entry *next = NULL;
+
+    while (table->length >= table->capacity && entry != NULL)
+    {
+        next = entry->lru_next;
+
+        if (table->evictable == NULL || table->evictable(entry))
+        {
+            ff_lru_table_remove(table, entry);
+            table->evictions++;
+        }
+
+        entry = next;
+    }
+
+    entry = calloc(1, entry_size);
+    entry->hash = hash;
+    entry->key = malloc(key_length + 1);
+    memcpy(entry->key, key, key_length);
+    entry->key[key_length] = '\0';
+    entry->key_length = key_length;
+    entry->next = ff_hash_table_get_item(table->entries, hash);
+
+    ff_hash_table_put_item(table->entries, hash, entry);
+    ff_lru_table_lru_append(table, entry);
+    table->length++;
+
+    return entry;
+}
+
+struct ff_lru_table_entry *ff_lru_table_insert_string(struct ff_lru_table *table, const char *key, size_t entry_size)
+{
+    return ff_lru_table_insert(table, key, strlen(key), entry_size);
+}
+
+void ff_lru_table_remove(struct ff_lru_table *table, struct ff_lru_table_entry *entry)
+{
+    ff_lru_table_unlink(table, entry);
+
+    FREE(entry->key);
+    table->release(entry);
+}
+
+void ff_lru_table_unlink(struct ff_lru_table *table, struct ff_lru_table_entry *entry)
+{
+    struct ff_lru_table_entry *first = ff_hash_table_get_item(table->entries, entry->hash);
+
+    if (first == entry)
+    {
+        if (entry->next == NULL)
+        {
+            ff_hash_table_remove_item(table->entries, entry->hash);
+        }
+        else
+        {
+            ff_hash_table_put_item(table->entries, entry->hash, entry->next);
+        }
+    }
+    else
+    {
+        while (first->next != entry)
+        {
+            first = first->next;
+        }
+
+        first->next = entry->next;
+    }
+
+    ff_lru_table_lru_remove(table, entry);
+    entry->next = NULL;
+    table->length--;
+}
+
+void ff_lru_table_lru_remove(struct ff_lru_table *table, struct ff_lru_table_entry *entry)
+{
+    if (entry->lru_prev == NULL)
+    {
+        table->lru_first = entry->lru_next;
+    }
+    else
+    {
+        entry->lru_prev->lru_next = entry->lru_next;
+    }
+
+    if (entry->lru_next == NULL)
+    {
+        table->lru_last = entry->lru_prev;
+    }
+    else
+    {
+        entry->lru_next->lru_prev = entry->lru_prev;
+    }
+
+    entry->lru_prev = NULL;
+    entry->lru_next = NULL;
+}
+
+void ff_lru_table_lru_append(struct ff_lru_table *table, struct ff_lru_table_entry *entry)
+{
+    entry->lru_prev = table->lru_last;
+    entry->lru_next = NULL;
+
+    if (table->lru_last == NULL)
+    {
+        table->lru_first = entry;
+    }
+    else
+    {
+        table->lru_last->lru_next = entry;
+    }
+
+    table->lru_last = entry;
+}
+
+void ff_lru_table_free(struct ff_lru_table *table)
+{
+    if (table == NULL)
+    {
+        return;
+    }
+
+    while (table->lru_first != NULL)
+    {
+        ff_lru_table_remove(table, table->lru_first);
+    }
+
+    ff_hash_table_free(table->entries);
+    FREE(table);
+}
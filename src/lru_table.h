@@ -0,0 +1,84 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "hash_table.h"
+
+#ifndef FF_LRU_TABLE_H
+#define FF_LRU_TABLE_H
+
+/**
+ * Embedded as the first member of a table's entries
+ */
+struct ff_lru_table_entry
+{
+    uint64_t hash;
+    // Copied with a terminating null so string keys can be read back
+    uint8_t *key;
+    size_t key_length;
+    // Entries whose keys share a hash
+    struct ff_lru_table_entry *next;
+    struct ff_lru_table_entry *lru_prev;
+    struct ff_lru_table_entry *lru_next;
+};
+
+/**
+ * Returns false if the entry is in use and must be kept over capacity
+ */
+typedef bool (*ff_lru_table_evictable)(struct ff_lru_table_entry *entry);
+
+/**
+ * Called as an entry leaves the table, to free it
+ */
+typedef void (*ff_lru_table_release)(struct ff_lru_table_entry *entry);
+
+/**
+ * Entries keyed by strings or bytes, hashed with FNV-1a and bounded by
+ * count with least recently used eviction. Not thread safe, the owner
+ * locks around it along with the entries' own state.
+ */
+struct ff_lru_table
+{
+    uint32_t capacity;
+    uint32_t length;
+    struct ff_hash_table *entries;
+    // Ordered from least to most recently used
+    struct ff_lru_table_entry *lru_first;
+    struct ff_lru_table_entry *lru_last;
+    // Entries removed by inserts over capacity
+    uint64_t evictions;
+    // NULL = any entry can be evicted
+    ff_lru_table_evictable evictable;
+    ff_lru_table_release release;
+};
+
+struct ff_lru_table *ff_lru_table_init(uint32_t capacity, ff_lru_table_evictable evictable, ff_lru_table_release release);
+
+struct ff_lru_table_entry *ff_lru_table_find(struct ff_lru_table *table, const void *key, size_t key_length);
+
+struct ff_lru_table_entry *ff_lru_table_find_string(struct ff_lru_table *table, const char *key);
+
+/**
+ * Marks the entry most recently used
+ */
+void ff_lru_table_touch(struct ff_lru_table *table, struct ff_lru_table_entry *entry);
+
+/**
+ * Inserts a zeroed entry of entry_size bytes for a key not in the table as
+ * the most recently used, first evicting entries over capacity. Entries
+ * which can't be evicted may leave the table over capacity.
+ */
+struct ff_lru_table_entry *ff_lru_table_insert(struct ff_lru_table *table, const void *key, size_t key_length, size_t entry_size);
+
+struct ff_lru_table_entry *ff_lru_table_insert_string(struct ff_lru_table *table, const char *key, size_t entry_size);
+
+/**
+ * Removes the entry and releases it
+ */
+void ff_lru_table_remove(struct ff_lru_table *table, struct ff_lru_table_entry *entry);
+
+/**
+ * Releases every entry along with the table
+ */
+void ff_lru_table_free(struct ff_lru_table *table);
+
+#endif
@@ -0,0 +1,15 @@
+#include <stdint.h>
+#include "lru_table.h"
+
+#ifndef FF_LRU_TABLE_P_H
+#define FF_LRU_TABLE_P_H
+
+struct ff_lru_table_entry *ff_lru_table_find_hashed(struct ff_lru_table *table, uint64_t hash, const void *key, size_t key_length);
+
+void ff_lru_table_unlink(struct ff_lru_table *table, struct ff_lru_table_entry *entry);
+
+void ff_lru_table_lru_remove(struct ff_lru_table *table, struct ff_lru_table_entry *entry);
+
+void ff_lru_table_lru_append(struct ff_lru_table *table, struct ff_lru_table_entry *entry);
+
+#endif
@@ -15,6 +15,8 @@ static struct ff_config ff_global_config;
 int main(int argc, char **argv)
 {
     signal(SIGINT, ff_sigint_handler);
+    // Writes to an upstream connection reset while pooled fail with EPIPE instead
+    signal(SIGPIPE, SIG_IGN);
 
     enum ff_action action = ff_parse_arguments(&ff_global_config, argc, argv);
     int ret = EXIT_SUCCESS;
@@ -0,0 +1,159 @@
+// SHA256_Transform is deprecated in OpenSSL 3 but remains the only way to run a
+// single compression from a saved state without the EVP dispatch overhead
+#define OPENSSL_SUPPRESS_DEPRECATED
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <openssl/sha.h>
+#include <openssl/crypto.h>
+#include "pbkdf2.h"
+#include "pbkdf2_p.h"
+#include "alloc.h"
+
+struct ff_pbkdf2_hmac_sha256 *ff_pbkdf2_hmac_sha256_init(const uint8_t *key, size_t key_length)
+{
+    struct ff_pbkdf2_hmac_sha256 *pbkdf2 = calloc(1, sizeof(struct ff_pbkdf2_hmac_sha256));
+    uint8_t block[FF_PBKDF2_SHA256_BLOCK_LENGTH] = {0};
+    uint8_t pad[FF_PBKDF2_SHA256_BLOCK_LENGTH];
+
+    // HMAC hashes keys longer than the block size
+    if (key_length > FF_PBKDF2_SHA256_BLOCK_LENGTH)
+    {
+        SHA256(key, key_length, block);
+    }
+    else
+    {
+        memcpy(block, key, key_length);
+    }
+
+    for (int i = 0; i < FF_PBKDF2_SHA256_BLOCK_LENGTH; i++)
+    {
+        pad[i] = block[i] ^ 0x36;
+    }
+
+    SHA256_Init(&pbkdf2->inner);
+    SHA256_Update(&pbkdf2->inner, pad, sizeof(pad));
+
+    for (int i = 0; i < FF_PBKDF2_SHA256_BLOCK_LENGTH; i++)
+    {
+        pad[i] = block[i] ^ 0x5c;
+    }
+
+    SHA256_Init(&pbkdf2->outer);
+    SHA256_Update(&pbkdf2->outer, pad, sizeof(pad));
+
+    OPENSSL_cleanse(block, sizeof(block));
+    OPENSSL_cleanse(pad, sizeof(pad));
+
+    return pbkdf2;
+}
+
+bool ff_pbkdf2_hmac_sha256_derive(
+    struct ff_pbkdf2_hmac_sha256 *pbkdf2,
+    const uint8_t *salt,
+    uint16_t salt_length,
+    uint32_t iterations,
+    uint8_t *out_key,
+    uint16_t out_key_length)
+{
+    uint8_t block[SHA256_DIGEST_LENGTH];
+    uint32_t block_index = 1;
+    uint16_t offset = 0;
+
+    if (pbkdf2 == NULL || iterations == 0)
+    {
+        return false;
+    }
+
+    while (offset < out_key_length)
+    {
+        uint16_t length = out_key_length - offset < SHA256_DIGEST_LENGTH ? out_key_length - offset : SHA256_DIGEST_LENGTH;
+
+        ff_pbkdf2_hmac_sha256_block(pbkdf2, salt, salt_length, iterations, block_index++, block);
+        memcpy(out_key + offset, block, length);
+        offset += length;
+    }
+
+    OPENSSL_cleanse(block, sizeof(block));
+
+    return true;
+}
+
+void ff_pbkdf2_hmac_sha256_block(
+    struct ff_pbkdf2_hmac_sha256 *pbkdf2,
+    const uint8_t *salt,
+    uint16_t salt_length,
+    uint32_t iterations,
+    uint32_t block_index,
+    uint8_t *out_block)
+{
+    SHA256_CTX ctx;
+    uint8_t index_be[4] = {(uint8_t)(block_index >> 24), (uint8_t)(block_index >> 16), (uint8_t)(block_index >> 8), (uint8_t)block_index};
+    uint8_t u[FF_PBKDF2_SHA256_BLOCK_LENGTH] = {0};
+    uint32_t t[8];
+
+    // U1 = HMAC(key, salt || INT(block_index))
+    ctx = pbkdf2->inner;
+    SHA256_Update(&ctx, salt, salt_length);
+    SHA256_Update(&ctx, index_be, sizeof(index_be));
+    SHA256_Final(u, &ctx);
+
+    ctx = pbkdf2->outer;
+    SHA256_Update(&ctx, u, SHA256_DIGEST_LENGTH);
+    SHA256_Final(u, &ctx);
+
+    for (int j = 0; j < 8; j++)
+    {
+        t[j] = (uint32_t)u[j * 4] << 24 | (uint32_t)u[j * 4 + 1] << 16 | (uint32_t)u[j * 4 + 2] << 8 | u[j * 4 + 3];
+    }
+
+    // Subsequent messages are a single digest following the pad block, so
+    // pre-pad them once: 0x80 terminator then the 768 bit message length
+    u[SHA256_DIGEST_LENGTH] = 0x80;
+    u[FF_PBKDF2_SHA256_BLOCK_LENGTH - 2] = 0x03;
+
+    for (uint32_t i = 1; i < iterations; i++)
+    {
+        memcpy(ctx.h, pbkdf2->inner.h, sizeof(ctx.h));
+        SHA256_Transform(&ctx, u);
+        ff_pbkdf2_store_be32(u, ctx.h, 8);
+
+        memcpy(ctx.h, pbkdf2->outer.h, sizeof(ctx.h));
+        SHA256_Transform(&ctx, u);
+        ff_pbkdf2_store_be32(u, ctx.h, 8);
+
+        for (int j = 0; j < 8; j++)
+        {
+            t[j] ^= ctx.h[j];
+        }
+    }
+
+    ff_pbkdf2_store_be32(out_block, t, 8);
+
+    OPENSSL_cleanse(&ctx, sizeof(ctx));
+    OPENSSL_cleanse(u, sizeof(u));
+    OPENSSL_cleanse(t, sizeof(t));
+}
+
+void ff_pbkdf2_store_be32(uint8_t *out, const uint32_t *words, uint8_t length)
+{
+    for (uint8_t i = 0; i < length; i++)
+    {
+        out[i * 4] = (uint8_t)(words[i] >> 24);
+        out[i * 4 + 1] = (uint8_t)(words[i] >> 16);
+        out[i * 4 + 2] = (uint8_t)(words[i] >> 8);
+        out[i * 4 + 3] = (uint8_t)words[i];
+    }
+}
+
+void ff_pbkdf2_hmac_sha256_free(struct ff_pbkdf2_hmac_sha256 *pbkdf2)
+{
+    if (pbkdf2 == NULL)
+    {
+        return;
+    }
+
+    OPENSSL_cleanse(pbkdf2, sizeof(struct ff_pbkdf2_hmac_sha256));
+    FREE(pbkdf2);
+}
@@ -0,0 +1,27 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifndef FF_PBKDF2_H
+#define FF_PBKDF2_H
+
+/**
+ * PBKDF2-HMAC-SHA256 for a fixed password. The HMAC inner and outer pad
+ * states are hashed once up front so each iteration only runs the two
+ * compression function calls covering the previous block's output.
+ */
+struct ff_pbkdf2_hmac_sha256;
+
+struct ff_pbkdf2_hmac_sha256 *ff_pbkdf2_hmac_sha256_init(const uint8_t *key, size_t key_length);
+
+bool ff_pbkdf2_hmac_sha256_derive(
+    struct ff_pbkdf2_hmac_sha256 *pbkdf2,
+    const uint8_t *salt,
+    uint16_t salt_length,
+    uint32_t iterations,
+    uint8_t *out_key,
+    uint16_t out_key_length);
+
+void ff_pbkdf2_hmac_sha256_free(struct ff_pbkdf2_hmac_sha256 *pbkdf2);
+
+#endif
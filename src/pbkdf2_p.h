@@ -0,0 +1,27 @@
+#include <stdint.h>
+#include <openssl/sha.h>
+#include "pbkdf2.h"
+
+#ifndef FF_PBKDF2_P_H
+#define FF_PBKDF2_P_H
+
+#define FF_PBKDF2_SHA256_BLOCK_LENGTH 64
+
+struct ff_pbkdf2_hmac_sha256
+{
+    // SHA-256 states after absorbing (key ^ ipad) and (key ^ opad)
+    SHA256_CTX inner;
+    SHA256_CTX outer;
+};
+
+void ff_pbkdf2_hmac_sha256_block(
+    struct ff_pbkdf2_hmac_sha256 *pbkdf2,
+    const uint8_t *salt,
+    uint16_t salt_length,
+    uint32_t iterations,
+    uint32_t block_index,
+    uint8_t *out_block);
+
+void ff_pbkdf2_store_be32(uint8_t *out, const uint32_t *words, uint8_t length);
+
+#endif
@@ -0,0 +1,243 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include <openssl/rand.h>
+#include "replay_filter.h"
+#include "replay_filter_p.h"
+#include "logging.h"
+#include "alloc.h"
+
+struct ff_replay_filter *ff_replay_filter_init(uint32_t capacity, uint32_t rotate_interval)
+{
+    struct ff_replay_filter *filter = calloc(1, sizeof(struct ff_replay_filter));
+    uint64_t bits = (uint64_t)capacity * FF_REPLAY_FILTER_BITS_PER_ENTRY;
+    size_t generation_size;
+
+    filter->block_count = (uint32_t)((bits + FF_REPLAY_FILTER_BLOCK_BITS - 1) / FF_REPLAY_FILTER_BLOCK_BITS);
+    filter->block_count = filter->block_count == 0 ? 1 : filter->block_count;
+    filter->rotate_interval = rotate_interval == 0 ? 1 : rotate_interval;
+    generation_size = (size_t)filter->block_count * FF_REPLAY_FILTER_BLOCK_WORDS * sizeof(uint64_t);
+
+    // A random key stops clients from choosing salts that collide in the filter
+    if (RAND_bytes(filter->key, sizeof(filter->key)) != 1)
+    {
+        ff_log(FF_ERROR, "Failed to generate replay filter key");
+        goto error;
+    }
+
+    for (int i = 0; i < 2; i++)
+    {
+        if (posix_memalign((void **)&filter->generations[i], 64, generation_size) != 0)
+        {
+            ff_log(FF_ERROR, "Failed to allocate replay filter");
+            goto error;
+        }
+
+        memset(filter->generations[i], 0, generation_size);
+    }
+
+    filter->rotated_at = ff_replay_filter_now();
+    pthread_rwlock_init(&filter->lock, NULL);
+
+    ff_log(FF_DEBUG, "Initialised replay filter (blocks: %u, rotate interval: %u)", filter->block_count, filter->rotate_interval);
+
+    return filter;
+
+error:
+    FREE(filter->generations[0]);
+    FREE(filter->generations[1]);
+    FREE(filter);
+    return NULL;
+}
+
+bool ff_replay_filter_seen(
+    struct ff_replay_filter *filter,
+    uint8_t *salt,
+    uint16_t salt_length,
+    uint8_t *iv,
+    uint16_t iv_length)
+{
+    return ff_replay_filter_seen_at(filter, salt, salt_length, iv, iv_length, ff_replay_filter_now());
+}
+
+bool ff_replay_filter_insert(
+    struct ff_replay_filter *filter,
+    uint8_t *salt,
+    uint16_t salt_length,
+    uint8_t *iv,
+    uint16_t iv_length)
+{
+    return ff_replay_filter_insert_at(filter, salt, salt_length, iv, iv_length, ff_replay_filter_now());
+}
+
+bool ff_replay_filter_seen_at(
+    struct ff_replay_filter *filter,
+    uint8_t *salt,
+    uint16_t salt_length,
+    uint8_t *iv,
+    uint16_t iv_length,
+    uint64_t now)
+{
+    struct ff_replay_filter_probe probe;
+    bool seen;
+
+    ff_replay_filter_probe_init(filter, salt, salt_length, iv, iv_length, &probe);
+
+    if (now - __atomic_load_n(&filter->rotated_at, __ATOMIC_RELAXED) >= filter->rotate_interval)
+    {
+        ff_replay_filter_rotate(filter, now);
+    }
+
+    pthread_rwlock_rdlock(&filter->lock);
+
+    // Inserts only take place under the write lock so plain reads are safe here
+    seen = ff_replay_filter_contains(filter->generations[filter->current], &probe) ||
+           ff_replay_filter_contains(filter->generations[!filter->current], &probe);
+
+    pthread_rwlock_unlock(&filter->lock);
+
+    return seen;
+}
+
+bool ff_replay_filter_insert_at(
+    struct ff_replay_filter *filter,
+    uint8_t *salt,
+    uint16_t salt_length,
+    uint8_t *iv,
+    uint16_t iv_length,
+    uint64_t now)
+{
+    struct ff_replay_filter_probe probe;
+    uint64_t *block = NULL;
+    bool inserted = false;
+
+    ff_replay_filter_probe_init(filter, salt, salt_length, iv, iv_length, &probe);
+
+    if (now - __atomic_load_n(&filter->rotated_at, __ATOMIC_RELAXED) >= filter->rotate_interval)
+    {
+        ff_replay_filter_rotate(filter, now);
+    }
+
+    // Exclusive so two concurrent copies of a request can't both observe the other's bits as missing
+    pthread_rwlock_wrlock(&filter->lock);
+
+    if (ff_replay_filter_contains(filter->generations[filter->current], &probe) ||
+        ff_replay_filter_contains(filter->generations[!filter->current], &probe))
+    {
+        goto cleanup;
+    }
+
+    block = filter->generations[filter->current] + (size_t)probe.block * FF_REPLAY_FILTER_BLOCK_WORDS;
+
+    for (int i = 0; i < FF_REPLAY_FILTER_BLOCK_WORDS; i++)
+    {
+        block[i] |= probe.masks[i];
+    }
+
+    inserted = true;
+
+cleanup:
+    pthread_rwlock_unlock(&filter->lock);
+
+    return inserted;
+}
+
+void ff_replay_filter_probe_init(
+    struct ff_replay_filter *filter,
+    uint8_t *salt,
+    uint16_t salt_length,
+    uint8_t *iv,
+    uint16_t iv_length,
+    struct ff_replay_filter_probe *probe)
+{
+    struct ff_siphash state;
+    uint64_t hash[2];
+    uint8_t salt_length_bytes[2] = {(uint8_t)(salt_length >> 8), (uint8_t)salt_length};
+    uint16_t bit;
+
+    // The salt is length prefixed so no two (salt, IV) pairs hash the same bytes
+    ff_siphash_init(&state, filter->key);
+    ff_siphash_update(&state, salt_length_bytes, sizeof(salt_length_bytes));
+    ff_siphash_update(&state, salt, salt_length);
+    ff_siphash_update(&state, iv, iv_length);
+    ff_siphash_final128(&state, hash);
+
+    probe->block = (uint32_t)(((hash[0] & UINT32_MAX) * filter->block_count) >> 32);
+    memset(probe->masks, 0, sizeof(probe->masks));
+
+    for (int i = 0; i < FF_REPLAY_FILTER_HASHES; i++)
+    {
+        bit = (uint16_t)((hash[1] >> (9 * i)) & (FF_REPLAY_FILTER_BLOCK_BITS - 1));
+        probe->masks[bit / 64] |= 1ULL << (bit % 64);
+    }
+}
+
+bool ff_replay_filter_contains(uint64_t *generation, struct ff_replay_filter_probe *probe)
+{
+    uint64_t *block = generation + (size_t)probe->block * FF_REPLAY_FILTER_BLOCK_WORDS;
+
+    for (int i = 0; i < FF_REPLAY_FILTER_BLOCK_WORDS; i++)
+    {
+        if ((block[i] & probe->masks[i]) != probe->masks[i])
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void ff_replay_filter_rotate(struct ff_replay_filter *filter, uint64_t now)
+{
+    size_t generation_size = (size_t)filter->block_count * FF_REPLAY_FILTER_BLOCK_WORDS * sizeof(uint64_t);
+    uint64_t elapsed;
+
+    pthread_rwlock_wrlock(&filter->lock);
+
+    elapsed = now - filter->rotated_at;
+
+    // Another thread may have rotated while we waited for the lock
+    if (elapsed < filter->rotate_interval)
+    {
+        goto cleanup;
+    }
+
+    // After two idle intervals the current generation has expired as well
+    if (elapsed >= 2 * (uint64_t)filter->rotate_interval)
+    {
+        memset(filter->generations[filter->current], 0, generation_size);
+    }
+
+    filter->current = !filter->current;
+    memset(filter->generations[filter->current], 0, generation_size);
+    __atomic_store_n(&filter->rotated_at, now, __ATOMIC_RELAXED);
+
+cleanup:
+    pthread_rwlock_unlock(&filter->lock);
+}
+
+uint64_t ff_replay_filter_now()
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (uint64_t)now.tv_sec;
+}
+
+void ff_replay_filter_free(struct ff_replay_filter *filter)
+{
+    if (filter == NULL)
+    {
+        return;
+    }
+
+    pthread_rwlock_destroy(&filter->lock);
+    FREE(filter->generations[0]);
+    FREE(filter->generations[1]);
+    FREE(filter);
+}
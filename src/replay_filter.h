@@ -0,0 +1,61 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include "siphash.h"
+
+#ifndef FF_REPLAY_FILTER_H
+#define FF_REPLAY_FILTER_H
+
+// Each block is one cache line so a lookup touches one line per generation
+#define FF_REPLAY_FILTER_BLOCK_WORDS 8
+#define FF_REPLAY_FILTER_BLOCK_BITS (FF_REPLAY_FILTER_BLOCK_WORDS * 64)
+#define FF_REPLAY_FILTER_BITS_PER_ENTRY 24
+#define FF_REPLAY_FILTER_HASHES 7
+
+/**
+ * Remembers the (salt, IV) pairs of recently accepted requests using two
+ * generations of blocked Bloom filters. The current generation is swapped
+ * out every rotate interval so a pair is remembered for between one and two
+ * intervals in constant memory. False positives reject a genuine request,
+ * roughly 1 in 4000 when both generations are at capacity.
+ */
+struct ff_replay_filter
+{
+    uint8_t key[FF_SIPHASH_KEY_LENGTH];
+    uint32_t block_count;
+    uint32_t rotate_interval;
+    // Indexed by current, the other generation is the previous interval's
+    uint64_t *generations[2];
+    uint8_t current;
+    uint64_t rotated_at;
+    pthread_rwlock_t lock;
+};
+
+/**
+ * capacity is the number of pairs expected per rotate interval (secs)
+ */
+struct ff_replay_filter *ff_replay_filter_init(uint32_t capacity, uint32_t rotate_interval);
+
+/**
+ * Returns true if the pair may have been inserted already, never modifies the filter.
+ */
+bool ff_replay_filter_seen(
+    struct ff_replay_filter *filter,
+    uint8_t *salt,
+    uint16_t salt_length,
+    uint8_t *iv,
+    uint16_t iv_length);
+
+/**
+ * Records the pair, returns false if it may have been inserted already.
+ */
+bool ff_replay_filter_insert(
+    struct ff_replay_filter *filter,
+    uint8_t *salt,
+    uint16_t salt_length,
+    uint8_t *iv,
+    uint16_t iv_length);
+
+void ff_replay_filter_free(struct ff_replay_filter *filter);
+
+#endif
@@ -0,0 +1,45 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include "replay_filter.h"
+
+#ifndef FF_REPLAY_FILTER_P_H
+#define FF_REPLAY_FILTER_P_H
+
+// The bits a pair maps to within its block
+struct ff_replay_filter_probe
+{
+    uint32_t block;
+    uint64_t masks[FF_REPLAY_FILTER_BLOCK_WORDS];
+};
+
+void ff_replay_filter_probe_init(
+    struct ff_replay_filter *filter,
+    uint8_t *salt,
+    uint16_t salt_length,
+    uint8_t *iv,
+    uint16_t iv_length,
+    struct ff_replay_filter_probe *probe);
+
+bool ff_replay_filter_contains(uint64_t *generation, struct ff_replay_filter_probe *probe);
+
+bool ff_replay_filter_seen_at(
+    struct ff_replay_filter *filter,
+    uint8_t *salt,
+    uint16_t salt_length,
+    uint8_t *iv,
+    uint16_t iv_length,
+    uint64_t now);
+
+bool ff_replay_filter_insert_at(
+    struct ff_replay_filter *filter,
+    uint8_t *salt,
+    uint16_t salt_length,
+    uint8_t *iv,
+    uint16_t iv_length,
+    uint64_t now);
+
+void ff_replay_filter_rotate(struct ff_replay_filter *filter, uint64_t now);
+
+uint64_t ff_replay_filter_now();
+
+#endif
@@ -6,6 +6,7 @@
 #include "alloc.h"
 #include "constants.h"
 #include "logging.h"
+#include "crypto.h"
 
 struct ff_request_option_node *ff_request_option_node_alloc()
 {
@@ -87,6 +88,8 @@ void ff_request_free(struct ff_request *request)
         ff_request_option_node_free(request->options[i]);
     }
 
+    ff_decrypt_stream_discard(request);
+
     FREE(request->options);
 
     struct ff_request_payload_node *payload_node = request->payload;
@@ -102,6 +105,11 @@ void ff_request_free(struct ff_request *request)
     FREE(request);
 }
 
+void ff_request_free_value(void *request)
+{
+    ff_request_free((struct ff_request *)request);
+}
+
 void ff_request_vectorise_payload(struct ff_request *request)
 {
     if (request->payload->next == NULL)
@@ -49,6 +49,8 @@ enum ff_request_option_type
     FF_REQUEST_OPTION_TYPE_ENCRYPTION_TAG = 3,
     FF_REQUEST_OPTION_TYPE_KEY_DERIVE_MODE = 5,
     FF_REQUEST_OPTION_TYPE_KEY_DERIVE_SALT = 6,
+    // Identifies the keyring key the request is encrypted with (uint16)
+    FF_REQUEST_OPTION_TYPE_KEY_ID = 9,
 
     // Whether the upstream request should be over HTTPS (bool)
     FF_REQUEST_OPTION_TYPE_HTTPS = 4,
@@ -72,11 +74,13 @@ struct ff_request_payload_node
     struct ff_request_payload_node *next;
 };
 
+struct ff_decrypt_stream;
+
 struct ff_request
 {
     enum ff_request_state state;
     enum ff_request_version version;
-    struct sockaddr source;
+    struct sockaddr_storage source;
     time_t received_at;
     uint64_t request_id;
     uint8_t options_length;
@@ -85,6 +89,12 @@ struct ff_request
     uint64_t payload_length;
     uint64_t received_length;
     struct ff_request_payload_node *payload;
+    // Memory reserved while partially received (see request_budget.c)
+    uint64_t budget_bytes;
+    struct ff_request *budget_prev;
+    struct ff_request *budget_next;
+    // Decryption state while the payload is decrypted as it arrives (see crypto.c)
+    struct ff_decrypt_stream *decrypt_stream;
 };
 
 struct __raw_ff_request_header
@@ -118,6 +128,8 @@ struct ff_request *ff_request_alloc(void);
 
 void ff_request_free(struct ff_request *);
 
+void ff_request_free_value(void *request);
+
 void ff_request_vectorise_payload(struct ff_request *request);
 
 #endif
\ No newline at end of file
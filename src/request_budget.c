@@ -0,0 +1,371 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <pthread.h>
+#include <netinet/in.h>
+#include "request_budget.h"
+#include "request_budget_p.h"
+#include "stats.h"
+#include "logging.h"
+#include "fnv.h"
+#include "alloc.h"
+
+struct ff_request_budget *ff_request_budget_init(
+    struct ff_hash_table *requests,
+    uint64_t max_bytes,
+    uint32_t max_partials_per_source,
+    enum ff_request_budget_policy policy)
+{
+    struct ff_request_budget *budget = calloc(1, sizeof(struct ff_request_budget));
+
+    budget->requests = requests;
+    budget->sources = ff_hash_table_init(16);
+    budget->max_bytes = max_bytes;
+    budget->max_partials_per_source = max_partials_per_source;
+    budget->policy = policy;
+    pthread_mutex_init(&budget->mutex, NULL);
+
+    return budget;
+}
+
+uint64_t ff_request_budget_charge(struct ff_request *request)
+{
+    return sizeof(struct ff_request) + request->payload_length;
+}
+
+void ff_request_budget_source_key(struct sockaddr *address, struct ff_request_budget_key *key)
+{
+    memset(key, 0, sizeof(struct ff_request_budget_key));
+    key->family = address->sa_family;
+
+    if (address->sa_family == AF_INET)
+    {
+        memcpy(key->address, &((struct sockaddr_in *)address)->sin_addr, sizeof(struct in_addr));
+    }
+    else if (address->sa_family == AF_INET6)
+    {
+        memcpy(key->address, &((struct sockaddr_in6 *)address)->sin6_addr, sizeof(struct in6_addr));
+    }
+}
+
+uint64_t ff_request_budget_hash_source(struct ff_request_budget_key *key)
+{
+    return ff_fnv_hash(key, sizeof(struct ff_request_budget_key));
+}
+
+struct ff_request_budget_source *ff_request_budget_get_source(
+    struct ff_request_budget *budget,
+    struct sockaddr *address,
+    bool should_create)
+{
+    struct ff_request_budget_key key;
+    uint64_t hash;
+    struct ff_request_budget_source *first = NULL;
+    struct ff_request_budget_source *source = NULL;
+
+    ff_request_budget_source_key(address, &key);
+    hash = ff_request_budget_hash_source(&key);
+    first = source = ff_hash_table_get_item(budget->sources, hash);
+
+    while (source != NULL)
+    {
+        if (memcmp(&source->key, &key, sizeof(struct ff_request_budget_key)) == 0)
+        {
+            return source;
+        }
+
+        source = source->next;
+    }
+
+    if (!should_create)
+    {
+        return NULL;
+    }
+
+    source = calloc(1, sizeof(struct ff_request_budget_source));
+    source->key = key;
+    source->next = first;
+    ff_hash_table_put_item(budget->sources, hash, source);
+
+    return source;
+}
+
+bool ff_request_budget_admit(struct ff_request_budget *budget, struct ff_request *request)
+{
+    bool admitted = false;
+    uint64_t charge = ff_request_budget_charge(request);
+    struct ff_request_budget_source *source = NULL;
+    struct ff_request *victim = NULL;
+
+    pthread_mutex_lock(&budget->mutex);
+
+    if (request->budget_bytes != 0)
+    {
+        admitted = true;
+        goto cleanup;
+    }
+
+    source = ff_request_budget_get_source(budget, (struct sockaddr *)&request->source, false);
+
+    if (budget->max_partials_per_source != 0 && source != NULL && source->partials >= budget->max_partials_per_source)
+    {
+        ff_log(FF_WARNING, "Refusing partial request %lu, source has reached limit of %u concurrent partial requests",
+               request->request_id, budget->max_partials_per_source);
+        FF_STATS_INC(partial_requests_refused_source);
+        goto cleanup;
+    }
+
+    if (budget->max_bytes != 0 && charge > budget->max_bytes)
+    {
+        ff_log(FF_WARNING, "Refusing partial request %lu, length %lu exceeds memory budget",
+               request->request_id, request->payload_length);
+        FF_STATS_INC(partial_requests_refused_memory);
+        goto cleanup;
+    }
+
+    while (budget->max_bytes != 0 && budget->used_bytes + charge > budget->max_bytes)
+    {
+        if (budget->policy == FF_REQUEST_BUDGET_POLICY_REFUSE || (victim = ff_request_budget_find_victim(budget)) == NULL)
+        {
+            ff_log(FF_WARNING, "Refusing partial request %lu, memory budget exhausted (%lu bytes in use)",
+                   request->request_id, budget->used_bytes);
+            FF_STATS_INC(partial_requests_refused_memory);
+            goto cleanup;
+        }
+
+        ff_log(FF_WARNING, "Evicting partial request %lu to admit request %lu", victim->request_id, request->request_id);
+        ff_request_budget_unlink(budget, victim);
+        ff_hash_table_remove_item(budget->requests, victim->request_id);
+        ff_hash_table_retire_value(budget->requests, victim, ff_request_free_value);
+        FF_STATS_INC(partial_requests_evicted);
+    }
+
+    if (source == NULL)
+    {
+        source = ff_request_budget_get_source(budget, (struct sockaddr *)&request->source, true);
+    }
+
+    source->partials++;
+
+    request->budget_bytes = charge;
+    request->budget_prev = budget->lru_last;
+    request->budget_next = NULL;
+
+    if (budget->lru_last == NULL)
+    {
+        budget->lru_first = request;
+    }
+    else
+    {
+        budget->lru_last->budget_next = request;
+    }
+
+    budget->lru_last = request;
+    budget->used_bytes += charge;
+    budget->length++;
+
+    FF_STATS_ADD(partial_requests_bytes, charge);
+    FF_STATS_INC(partial_requests_active);
+
+    admitted = true;
+
+cleanup:
+    pthread_mutex_unlock(&budget->mutex);
+
+    return admitted;
+}
+
+void ff_request_budget_touch(struct ff_request_budget *budget, struct ff_request *request)
+{
+    pthread_mutex_lock(&budget->mutex);
+
+    if (request->budget_bytes == 0 || budget->lru_last == request)
+    {
+        goto cleanup;
+    }
+
+    // Move to the most recently active end of the list
+    if (request->budget_prev == NULL)
+    {
+        budget->lru_first = request->budget_next;
+    }
+    else
+    {
+        request->budget_prev->budget_next = request->budget_next;
+    }
+
+    request->budget_next->budget_prev = request->budget_prev;
+
+    request->budget_prev = budget->lru_last;
+    request->budget_next = NULL;
+    budget->lru_last->budget_next = request;
+    budget->lru_last = request;
+
+cleanup:
+    pthread_mutex_unlock(&budget->mutex);
+}
+
+void ff_request_budget_release(struct ff_request_budget *budget, struct ff_request *request)
+{
+    pthread_mutex_lock(&budget->mutex);
+
+    ff_request_budget_unlink(budget, request);
+
+    pthread_mutex_unlock(&budget->mutex);
+}
+
+void ff_request_budget_unlink(struct ff_request_budget *budget, struct ff_request *request)
+{
+    if (request->budget_bytes == 0)
+    {
+        return;
+    }
+
+    if (request->budget_prev == NULL)
+    {
+        budget->lru_first = request->budget_next;
+    }
+    else
+    {
+        request->budget_prev->budget_next = request->budget_next;
+    }
+
+    if (request->budget_next == NULL)
+    {
+        budget->lru_last = request->budget_prev;
+    }
+    else
+    {
+        request->budget_next->budget_prev = request->budget_prev;
+    }
+
+    struct ff_request_budget_source *source = ff_request_budget_get_source(budget, (struct sockaddr *)&request->source, false);
+
+    if (source != NULL && --source->partials == 0)
+    {
+        uint64_t hash = ff_request_budget_hash_source(&source->key);
+        struct ff_request_budget_source *first = ff_hash_table_get_item(budget->sources, hash);
+
+        if (first == source)
+        {
+            if (source->next == NULL)
+            {
+                ff_hash_table_remove_item(budget->sources, hash);
+            }
+            else
+            {
+                ff_hash_table_put_item(budget->sources, hash, source->next);
+            }
+        }
+        else
+        {
+            while (first->next != source)
+            {
+                first = first->next;
+            }
+
+            first->next = source->next;
+        }
+
+        FREE(source);
+    }
+
+    budget->used_bytes -= request->budget_bytes;
+    budget->length--;
+
+    FF_STATS_SUB(partial_requests_bytes, request->budget_bytes);
+    FF_STATS_DEC(partial_requests_active);
+
+    request->budget_bytes = 0;
+    request->budget_prev = NULL;
+    request->budget_next = NULL;
+}
+
+struct ff_request *ff_request_budget_find_victim(struct ff_request_budget *budget)
+{
+    struct ff_request *victim = budget->lru_first;
+
+    if (budget->policy == FF_REQUEST_BUDGET_POLICY_EVICT_LARGEST)
+    {
+        for (struct ff_request *request = budget->lru_first; request != NULL; request = request->budget_next)
+        {
+            if (request->budget_bytes > victim->budget_bytes)
+            {
+                victim = request;
+            }
+        }
+    }
+
+    return victim;
+}
+
+bool ff_request_budget_expire(struct ff_request_budget *budget, uint64_t request_id)
+{
+    bool expired = false;
+
+    pthread_mutex_lock(&budget->mutex);
+
+    struct ff_request *request = ff_hash_table_get_item(budget->requests, request_id);
+
+    if (request == NULL || request->budget_bytes == 0)
+    {
+        goto cleanup;
+    }
+
+    ff_request_budget_unlink(budget, request);
+    ff_hash_table_remove_item(budget->requests, request_id);
+
+    // The receiving thread may still hold a reference so defer freeing to ff_request_budget_collect
+    request->budget_next = budget->expired;
+    budget->expired = request;
+    expired = true;
+
+cleanup:
+    pthread_mutex_unlock(&budget->mutex);
+
+    return expired;
+}
+
+void ff_request_budget_collect(struct ff_request_budget *budget)
+{
+    struct ff_request *request = NULL;
+    struct ff_request *next = NULL;
+
+    if (__atomic_load_n(&budget->expired, __ATOMIC_RELAXED) == NULL)
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&budget->mutex);
+    request = budget->expired;
+    budget->expired = NULL;
+    pthread_mutex_unlock(&budget->mutex);
+
+    while (request != NULL)
+    {
+        next = request->budget_next;
+        ff_hash_table_retire_value(budget->requests, request, ff_request_free_value);
+        request = next;
+    }
+}
+
+void ff_request_budget_free(struct ff_request_budget *budget)
+{
+    if (budget == NULL)
+    {
+        return;
+    }
+
+    ff_request_budget_collect(budget);
+
+    while (budget->lru_first != NULL)
+    {
+        ff_request_budget_unlink(budget, budget->lru_first);
+    }
+
+    ff_hash_table_free(budget->sources);
+    pthread_mutex_destroy(&budget->mutex);
+    FREE(budget);
+}
@@ -0,0 +1,76 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include "request.h"
+#include "hash_table.h"
+
+#ifndef FF_REQUEST_BUDGET_H
+#define FF_REQUEST_BUDGET_H
+
+enum ff_request_budget_policy
+{
+    // Refuse new partial requests once the memory budget is exhausted
+    FF_REQUEST_BUDGET_POLICY_REFUSE = 1,
+    // Evict the least recently active partial requests to make room
+    FF_REQUEST_BUDGET_POLICY_EVICT_LRU = 2,
+    // Evict the partial requests with the largest reservation to make room
+    FF_REQUEST_BUDGET_POLICY_EVICT_LARGEST = 3
+};
+
+/**
+ * A source's IP address without its port, so a client's quota holds
+ * whichever port it sends from
+ */
+struct ff_request_budget_key
+{
+    sa_family_t family;
+    // IPv4 addresses fill the first 4 bytes, the rest are zero
+    uint8_t address[16];
+};
+
+struct ff_request_budget_source
+{
+    struct ff_request_budget_key key;
+    uint32_t partials;
+    struct ff_request_budget_source *next;
+};
+
+struct ff_request_budget
+{
+    // 0 = unlimited
+    uint64_t max_bytes;
+    // 0 = unlimited
+    uint32_t max_partials_per_source;
+    enum ff_request_budget_policy policy;
+    uint64_t used_bytes;
+    uint32_t length;
+    struct ff_hash_table *requests;
+    struct ff_hash_table *sources;
+    // Partial requests ordered from least to most recently active
+    struct ff_request *lru_first;
+    struct ff_request *lru_last;
+    // Expired requests which are freed on the next call to ff_request_budget_collect
+    struct ff_request *expired;
+    pthread_mutex_t mutex;
+};
+
+struct ff_request_budget *ff_request_budget_init(
+    struct ff_hash_table *requests,
+    uint64_t max_bytes,
+    uint32_t max_partials_per_source,
+    enum ff_request_budget_policy policy);
+
+bool ff_request_budget_admit(struct ff_request_budget *budget, struct ff_request *request);
+
+void ff_request_budget_touch(struct ff_request_budget *budget, struct ff_request *request);
+
+void ff_request_budget_release(struct ff_request_budget *budget, struct ff_request *request);
+
+bool ff_request_budget_expire(struct ff_request_budget *budget, uint64_t request_id);
+
+void ff_request_budget_collect(struct ff_request_budget *budget);
+
+void ff_request_budget_free(struct ff_request_budget *budget);
+
+#endif
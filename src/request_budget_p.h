@@ -0,0 +1,25 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/socket.h>
+#include "request.h"
+#include "request_budget.h"
+
+#ifndef FF_REQUEST_BUDGET_P_H
+#define FF_REQUEST_BUDGET_P_H
+
+uint64_t ff_request_budget_charge(struct ff_request *request);
+
+void ff_request_budget_source_key(struct sockaddr *address, struct ff_request_budget_key *key);
+
+uint64_t ff_request_budget_hash_source(struct ff_request_budget_key *key);
+
+struct ff_request_budget_source *ff_request_budget_get_source(
+    struct ff_request_budget *budget,
+    struct sockaddr *address,
+    bool should_create);
+
+void ff_request_budget_unlink(struct ff_request_budget *budget, struct ff_request *request);
+
+struct ff_request *ff_request_budget_find_victim(struct ff_request_budget *budget);
+
+#endif
@@ -4,17 +4,27 @@
 #include <string.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/resource.h>
 #include <netinet/in.h>
 #include <netdb.h>
 #include <arpa/inet.h>
 #include <pthread.h>
 #include <errno.h>
 #include <time.h>
+#include <signal.h>
 #include "server.h"
 #include "server_p.h"
 #include "parser.h"
 #include "http.h"
+#include "dns_cache.h"
+#include "event_loop.h"
 #include "logging.h"
+#include "stats.h"
+#include "key_cache.h"
+#include "crypto_pool.h"
+#include "keyring.h"
+#include "replay_filter.h"
+#include "pbkdf2.h"
 #include "alloc.h"
 #include "os/linux_endian.h"
 
@@ -34,21 +44,158 @@ int ff_proxy_start(struct ff_config *config)
     struct addrinfo *res;
     char buffer[FF_PROXY_BUFF_SIZE];
     int recv_len;
-    struct sockaddr_storage src_address;
+    // Zeroed so bytes past the family's address compare equal across packets
+    struct sockaddr_storage src_address = {0};
     socklen_t src_address_length = sizeof(src_address);
     struct ff_hash_table *requests = ff_hash_table_init(16);
+    struct ff_request_budget *budget = ff_request_budget_init(
+        requests,
+        config->max_partial_bytes,
+        config->max_partials_per_source,
+        config->partial_eviction_policy);
+    struct ff_clean_up_args cleanup_args = {.requests = requests, .budget = budget};
+    struct ff_crypto_pool *crypto_pool = NULL;
+    struct ff_event_loop *dns_loop = NULL;
+
+    if (config->encryption.key != NULL)
+    {
+        config->encryption.pbkdf2 = ff_pbkdf2_hmac_sha256_init(config->encryption.key, strlen((char *)config->encryption.key));
+    }
+
+    if (config->encryption.key != NULL && config->key_cache_size != 0)
+    {
+        config->encryption.key_cache = ff_key_cache_init(config->key_cache_size);
+    }
+
+    if (config->keyring_path != NULL &&
+        !(config->encryption.keyring = ff_keyring_init(config->keyring_path, &config->encryption, config->key_cache_size)))
+    {
+        ff_log(FF_FATAL, "Failed to load keyring");
+        return EXIT_FAILURE;
+    }
+
+    // A replay is accepted while its timestamp is within the fudge factor of the host's time,
+    // up to twice the fudge factor after the original arrived
+    if ((config->encryption.key != NULL || config->encryption.keyring != NULL) &&
+        config->replay_filter_capacity != 0 &&
+        !(config->encryption.replay_filter = ff_replay_filter_init(config->replay_filter_capacity, 2 * (uint32_t)config->timestamp_fudge_factor)))
+    {
+        ff_log(FF_FATAL, "Failed to initialise replay filter");
+        return EXIT_FAILURE;
+    }
+
+    // Every thread inherits the blocked signal so only the reload thread receives it
+    sigset_t reload_signals;
+    sigemptyset(&reload_signals);
+    sigaddset(&reload_signals, SIGHUP);
+    pthread_sigmask(SIG_BLOCK, &reload_signals, NULL);
 
     pthread_t cleanup_thread;
     pthread_attr_t cleanup_thread_attrs;
     pthread_attr_init(&cleanup_thread_attrs);
     pthread_attr_setdetachstate(&cleanup_thread_attrs, PTHREAD_CREATE_DETACHED);
-    pthread_create(&cleanup_thread, &cleanup_thread_attrs, (void *)ff_proxy_clean_up_old_requests_loop, (void *)requests);
+    pthread_create(&cleanup_thread, &cleanup_thread_attrs, (void *)ff_proxy_clean_up_old_requests_loop, (void *)&cleanup_args);
+
+    ff_stats_register_printer(ff_proxy_print_request_stats, (void *)requests);
+
+    if (config->stats_interval != 0)
+    {
+        pthread_t stats_thread;
+        pthread_create(&stats_thread, &cleanup_thread_attrs, (void *)ff_proxy_print_stats_loop, (void *)config);
+    }
+
+    pthread_t reload_thread;
+    pthread_create(&reload_thread, &cleanup_thread_attrs, (void *)ff_proxy_reload_loop, (void *)config);
+
     pthread_attr_destroy(&cleanup_thread_attrs);
 
     ff_log(FF_DEBUG, "Initialising OpenSSL");
     ff_init_openssl();
     ff_log(FF_DEBUG, "Initialised OpenSSL");
 
+    if (!ff_http_tls_init(config->ca_bundle_path))
+    {
+        ff_log(FF_FATAL, "Failed to initialise TLS context");
+        return EXIT_FAILURE;
+    }
+
+    ff_http_tls_sessions_init(config->tls_session_cache_size, config->tls_session_max_age);
+    ff_stats_register_printer(ff_http_tls_print_stats, NULL);
+    ff_http_connections_init(config->upstream_max_idle, config->upstream_idle_timeout, config->upstream_max_requests);
+    ff_http_fastopen_init(config->upstream_fastopen_size);
+    ff_http_early_data_init(config->upstream_early_data);
+    ff_http_happy_eyeballs_init(config->happy_eyeballs_delay);
+    ff_http_http2_init(config->upstream_http2);
+    ff_http_limits_init(config->upstream_max_in_flight, config->upstream_queue_size, config->upstream_queue_timeout, config->upstream_adaptive_limit);
+    ff_stats_register_printer(ff_http_limits_print_stats, NULL);
+
+    if (config->upstream_adaptive_limit && config->upstream_max_in_flight == 0)
+    {
+        ff_log(FF_WARNING, "Adaptive upstream limits require --upstream-max-in-flight, requests won't be limited");
+    }
+
+    if (config->upstream_early_data != NULL && config->tls_session_cache_size == 0)
+    {
+        ff_log(FF_WARNING, "TLS early data requires resumed sessions, it won't be sent with the TLS session cache disabled");
+    }
+
+    if (config->upstream_http2 != NULL && config->upstream_engine_threads == 0)
+    {
+        ff_log(FF_WARNING, "HTTP/2 upstreams are only multiplexed by the upstream engine, requests are sent over HTTP/1.1 with --upstream-engine-threads 0");
+    }
+
+    if (config->dns_cache_size != 0)
+    {
+        struct ff_dns_resolver *resolver = ff_dns_resolver_init(config->dns_server, FF_DNS_HOSTS_PATH);
+
+        if (resolver == NULL || (dns_loop = ff_event_loop_init()) == NULL)
+        {
+            ff_log(FF_FATAL, "Failed to initialise DNS resolver");
+            ff_dns_resolver_free(resolver);
+            return EXIT_FAILURE;
+        }
+
+        struct ff_dns_cache *dns_cache = ff_dns_cache_init(resolver, dns_loop, config->dns_cache_size, config->dns_max_stale);
+
+        if (config->dns_prefetch != NULL)
+        {
+            ff_dns_cache_prefetch(dns_cache, config->dns_prefetch);
+        }
+
+        ff_http_dns_init(dns_cache);
+    }
+
+    if (!ff_http_completion_init(config->upstream_completion, config->upstream_completion_timeout))
+    {
+        ff_log(FF_FATAL, "Failed to initialise upstream completion");
+        return EXIT_FAILURE;
+    }
+
+    ff_stats_register_printer(ff_http_completion_print_stats, NULL);
+
+    if (config->upstream_engine_threads != 0)
+    {
+        // Each concurrent forward holds a socket open
+        struct rlimit files;
+
+        if (getrlimit(RLIMIT_NOFILE, &files) == 0 && files.rlim_cur < files.rlim_max)
+        {
+            files.rlim_cur = files.rlim_max;
+            setrlimit(RLIMIT_NOFILE, &files);
+        }
+    }
+
+    if (!ff_http_async_init(config->upstream_engine_threads))
+    {
+        ff_log(FF_FATAL, "Failed to initialise upstream engine");
+        return EXIT_FAILURE;
+    }
+
+    if (config->crypto_workers != 0)
+    {
+        crypto_pool = ff_crypto_pool_init(&config->encryption, config->crypto_workers, config->crypto_batch_size, ff_proxy_request_decrypted);
+    }
+
     ff_log(FF_INFO, "Starting UDP proxy on %s%s%s:%s",
            strchr(config->ip_address, ':') ? "[" : "", config->ip_address,
            strchr(config->ip_address, ':') ? "]" : "", config->port);
@@ -111,26 +258,58 @@ int ff_proxy_start(struct ff_config *config)
         getnameinfo((struct sockaddr *)&src_address, src_address_length, ip_string, sizeof(ip_string), NULL, 0, NI_NUMERICHOST);
         ff_log(FF_DEBUG, "Received packet of %d bytes from %s", recv_len, ip_string);
 
-        ff_proxy_process_incoming_packet(config, requests, (struct sockaddr *)&src_address, buffer, recv_len);
+        ff_proxy_process_incoming_packet(config, requests, budget, crypto_pool, (struct sockaddr *)&src_address, buffer, recv_len);
 
         /* need to reset for subsequent recvfrom()'s */
         src_address_length = sizeof(src_address);
     }
 
+    ff_crypto_pool_free(crypto_pool);
+    ff_request_budget_free(budget);
     ff_hash_table_free(requests);
+    ff_key_cache_free(config->encryption.key_cache);
+    config->encryption.key_cache = NULL;
+    ff_keyring_free(config->encryption.keyring);
+    config->encryption.keyring = NULL;
+    ff_replay_filter_free(config->encryption.replay_filter);
+    config->encryption.replay_filter = NULL;
+    ff_http_async_free();
+    ff_http_tls_free();
+    ff_http_completion_free();
+    ff_http_connections_free();
+    ff_http_fastopen_free();
+    ff_http_early_data_free();
+    ff_http_happy_eyeballs_free();
+    ff_http_http2_free();
+    ff_http_limits_free();
+    ff_http_dns_free();
+    ff_event_loop_free(dns_loop);
+    ff_pbkdf2_hmac_sha256_free(config->encryption.pbkdf2);
+    config->encryption.pbkdf2 = NULL;
 
     return 0;
 }
 
-void ff_proxy_process_incoming_packet(struct ff_config *config, struct ff_hash_table *requests, struct sockaddr *src_address, void *packet_buff, int buff_len)
+void ff_proxy_process_incoming_packet(
+    struct ff_config *config,
+    struct ff_hash_table *requests,
+    struct ff_request_budget *budget,
+    struct ff_crypto_pool *crypto_pool,
+    struct sockaddr *src_address,
+    void *packet_buff,
+    int buff_len)
 {
     bool is_raw_http = ff_request_is_raw_http(buff_len, packet_buff);
+    bool is_new_request = false;
     uint64_t request_id = 0;
     struct ff_request *request;
     pthread_t thread;
     pthread_attr_t thread_attrs;
     struct ff_process_request_args *thread_args;
 
+    // Free any requests expired by the clean up thread, no references are held across packets
+    ff_request_budget_collect(budget);
+
     if (is_raw_http)
     {
         ff_log(FF_DEBUG, "Incoming packet is raw HTTP request");
@@ -152,19 +331,39 @@ void ff_proxy_process_incoming_packet(struct ff_config *config, struct ff_hash_t
 
         if (request == NULL)
         {
+            is_new_request = true;
             request = ff_request_alloc();
             time(&request->received_at);
-            memcpy(&request->source, src_address, sizeof(struct sockaddr));
+            memcpy(&request->source, src_address, sizeof(struct sockaddr_storage));
             ff_hash_table_put_item(requests, request_id, (void *)request);
         }
 
-        if (memcmp(&request->source, src_address, sizeof(struct sockaddr)) != 0)
+        if (memcmp(&request->source, src_address, sizeof(struct sockaddr_storage)) != 0)
         {
             ff_log(FF_WARNING, "Incoming packet IP address does not match original source IP address/port for request %lu (will discard)", request->request_id);
             goto done;
         }
 
         ff_request_parse_chunk(request, buff_len, packet_buff);
+
+        if (request->state != FF_REQUEST_STATE_RECEIVING)
+        {
+            ff_request_budget_release(budget, request);
+        }
+        else if (!is_new_request)
+        {
+            ff_request_budget_touch(budget, request);
+        }
+        else if (!ff_request_budget_admit(budget, request))
+        {
+            request->state = FF_REQUEST_STATE_RECEIVING_FAIL;
+        }
+
+        // The remaining bytes and tag verification happen once the request completes
+        if (request->state == FF_REQUEST_STATE_RECEIVING)
+        {
+            ff_decrypt_request_incremental(request, &config->encryption);
+        }
     }
 
     switch (request->state)
@@ -176,8 +375,12 @@ void ff_proxy_process_incoming_packet(struct ff_config *config, struct ff_hash_t
         if (request_id != 0)
         {
             ff_hash_table_remove_item(requests, request_id);
+            ff_hash_table_retire_value(requests, request, ff_request_free_value);
+        }
+        else
+        {
+            ff_request_free(request);
         }
-        ff_request_free(request);
         break;
 
     case FF_REQUEST_STATE_RECEIVED:
@@ -188,6 +391,13 @@ void ff_proxy_process_incoming_packet(struct ff_config *config, struct ff_hash_t
         thread_args->request = request;
         thread_args->requests = requests;
 
+        if (crypto_pool != NULL)
+        {
+            // Forwarded by ff_proxy_request_decrypted once a crypto worker is done
+            ff_crypto_pool_submit(crypto_pool, request, (void *)thread_args);
+            break;
+        }
+
         pthread_attr_init(&thread_attrs);
         pthread_attr_setdetachstate(&thread_attrs, PTHREAD_CREATE_DETACHED);
 
@@ -208,12 +418,42 @@ void ff_proxy_process_request(struct ff_process_request_args *args)
 {
     struct ff_config *config = args->config;
     struct ff_request *request = args->request;
-    struct ff_hash_table *requests = args->requests;
 
     ff_request_vectorise_payload(request);
 
     ff_decrypt_request(request, &config->encryption);
 
+    ff_proxy_forward_request(args);
+}
+
+void ff_proxy_request_decrypted(struct ff_request *request, void *context)
+{
+    struct ff_process_request_args *args = (struct ff_process_request_args *)context;
+    pthread_t thread;
+    pthread_attr_t thread_attrs;
+
+    (void)request;
+
+    // The engine doesn't block, otherwise upstream I/O stays off the crypto workers
+    if (args->config->upstream_engine_threads != 0)
+    {
+        ff_proxy_forward_request(args);
+        return;
+    }
+
+    pthread_attr_init(&thread_attrs);
+    pthread_attr_setdetachstate(&thread_attrs, PTHREAD_CREATE_DETACHED);
+
+    pthread_create(&thread, &thread_attrs, (void *)ff_proxy_forward_request, (void *)args);
+
+    pthread_attr_destroy(&thread_attrs);
+}
+
+void ff_proxy_forward_request(struct ff_process_request_args *args)
+{
+    struct ff_config *config = args->config;
+    struct ff_request *request = args->request;
+
     if (request->state != FF_REQUEST_STATE_DECRYPTED)
     {
         goto error;
@@ -232,7 +472,19 @@ void ff_proxy_process_request(struct ff_process_request_args *args)
         goto error;
     }
 
-    ff_http_send_request(request);
+    // Finished by ff_proxy_request_forwarded
+    ff_http_send_request_async(request, ff_proxy_request_forwarded, (void *)args);
+    return;
+
+error:
+    request->state = FF_REQUEST_STATE_SENDING_FAILED;
+    ff_proxy_request_forwarded(request, (void *)args);
+}
+
+void ff_proxy_request_forwarded(struct ff_request *request, void *context)
+{
+    struct ff_process_request_args *args = (struct ff_process_request_args *)context;
+    struct ff_hash_table *requests = args->requests;
 
     if (request->state != FF_REQUEST_STATE_SENT)
     {
@@ -253,9 +505,13 @@ void ff_proxy_process_request(struct ff_process_request_args *args)
     if (request->request_id != 0)
     {
         ff_hash_table_remove_item(requests, request->request_id);
+        ff_hash_table_retire_value(requests, request, ff_request_free_value);
+    }
+    else
+    {
+        ff_request_free(request);
     }
 
-    ff_request_free(request);
     FREE(args);
 }
 
@@ -287,40 +543,109 @@ bool ff_proxy_validate_request_timestamp(struct ff_request *request, struct ff_c
     return diff <= config->timestamp_fudge_factor;
 }
 
-void ff_proxy_clean_up_old_requests_loop(struct ff_hash_table *requests)
+void ff_proxy_clean_up_old_requests_loop(struct ff_clean_up_args *args)
 {
+    struct ff_hash_table *requests = args->requests;
+    struct ff_request_budget *budget = args->budget;
+
     while (1)
     {
         sleep(FF_PROXY_CLEAN_INTERVAL_SECS);
 
+        ff_log(FF_DEBUG, "Closing idle upstream connections");
+        ff_http_connections_evict_idle();
+
         ff_log(FF_DEBUG, "Cleaning up partially received requests");
 
         time_t now;
         time(&now);
 
-        struct ff_hash_table_iterator *iterator = ff_hash_table_iterator_init(requests);
+        // Values are retired rather than freed so they remain valid for the duration of the scan
+        struct ff_hash_table_snapshot *snapshot = ff_hash_table_snapshot_init(requests);
         struct ff_request *request = NULL;
-        struct ff_request **requests_to_remove = calloc(1, requests->length * sizeof(struct ff_request *));
-        uint32_t count = 0;
+        uint64_t request_id = 0;
+        uint32_t expired = 0;
 
-        while ((request = ff_hash_table_iterator_next(iterator)) != NULL)
+        while ((request = ff_hash_table_snapshot_next(snapshot, &request_id)) != NULL)
         {
             bool has_expired = request->state == FF_REQUEST_STATE_RECEIVING &&
                                difftime(now, request->received_at) >= FF_PROXY_OLD_REQUEST_THRESHOLD_SECS;
 
-            if (has_expired)
+            if (has_expired && ff_request_budget_expire(budget, request_id))
+            {
+                expired++;
+            }
+        }
+
+        ff_hash_table_snapshot_free(snapshot);
+
+        ff_log(expired == 0 ? FF_DEBUG : FF_WARNING, "Cleaned up %u expired partial requests", expired);
+    }
+}
+
+void ff_proxy_print_request_stats(FILE *fd, void *context)
+{
+    struct ff_hash_table *requests = (struct ff_hash_table *)context;
+    struct ff_hash_table_snapshot *snapshot = ff_hash_table_snapshot_init(requests);
+    struct ff_request *request = NULL;
+    uint64_t receiving = 0;
+    uint64_t processing = 0;
+    double oldest_age = 0;
+    time_t now;
+
+    time(&now);
+
+    while ((request = ff_hash_table_snapshot_next(snapshot, NULL)) != NULL)
+    {
+        if (request->state == FF_REQUEST_STATE_RECEIVING)
+        {
+            receiving++;
+
+            if (difftime(now, request->received_at) > oldest_age)
             {
-                requests_to_remove[count++] = request;
+                oldest_age = difftime(now, request->received_at);
             }
         }
+        else
+        {
+            processing++;
+        }
+    }
+
+    ff_hash_table_snapshot_free(snapshot);
+
+    fprintf(fd, "requests_receiving %lu\n", (unsigned long)receiving);
+    fprintf(fd, "requests_processing %lu\n", (unsigned long)processing);
+    fprintf(fd, "requests_oldest_partial_age_secs %.0f\n", oldest_age);
+}
+
+void ff_proxy_print_stats_loop(struct ff_config *config)
+{
+    while (1)
+    {
+        sleep(config->stats_interval);
+
+        ff_stats_print(stdout);
+    }
+}
 
-        ff_hash_table_iterator_free(iterator);
+void ff_proxy_reload_loop(struct ff_config *config)
+{
+    sigset_t reload_signals;
+    int signal;
+
+    sigemptyset(&reload_signals);
+    sigaddset(&reload_signals, SIGHUP);
+
+    while (sigwait(&reload_signals, &signal) == 0)
+    {
+        ff_log(FF_INFO, "Received SIGHUP, reloading");
 
-        for (uint32_t i = 0; i < count; i++)
+        if (config->encryption.keyring != NULL)
         {
-            ff_hash_table_remove_item(requests, requests_to_remove[i]->request_id);
+            ff_keyring_reload(config->encryption.keyring);
         }
 
-        ff_log(count == 0 ? FF_DEBUG : FF_WARNING, "Cleaned up %u expired partial requests", count);
+        ff_http_tls_reload();
     }
 }
@@ -5,6 +5,8 @@
 #include "parser.h"
 #include "crypto.h"
 #include "http.h"
+#include "request_budget.h"
+#include "crypto_pool.h"
 
 #ifndef FF_SERVER_P_H
 #define FF_SERVER_P_H
@@ -16,17 +18,40 @@ struct ff_process_request_args
     struct ff_hash_table *requests;
 };
 
+struct ff_clean_up_args
+{
+    struct ff_hash_table *requests;
+    struct ff_request_budget *budget;
+};
+
 void ff_proxy_process_incoming_packet(
     struct ff_config *config,
     struct ff_hash_table *requests,
+    struct ff_request_budget *budget,
+    struct ff_crypto_pool *crypto_pool,
     struct sockaddr *src_address,
     void *packet_buff,
     int buff_len);
 
 void ff_proxy_process_request(struct ff_process_request_args *args);
 
+void ff_proxy_request_decrypted(struct ff_request *request, void *context);
+
+void ff_proxy_forward_request(struct ff_process_request_args *args);
+
+/**
+ * Releases the request once it has been forwarded, or failed to be
+ */
+void ff_proxy_request_forwarded(struct ff_request *request, void *context);
+
 bool ff_proxy_validate_request_timestamp(struct ff_request *request, struct ff_config *config);
 
-void ff_proxy_clean_up_old_requests_loop(struct ff_hash_table *requests);
+void ff_proxy_clean_up_old_requests_loop(struct ff_clean_up_args *args);
+
+void ff_proxy_print_request_stats(FILE *fd, void *context);
+
+void ff_proxy_print_stats_loop(struct ff_config *config);
+
+void ff_proxy_reload_loop(struct ff_config *config);
 
 #endif
\ No newline at end of file
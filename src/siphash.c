@@ -0,0 +1,105 @@
+#include <stdint.h>
+#include <stddef.h>
+#include "siphash.h"
+
+#define FF_SIPHASH_ROTL(x, b) (uint64_t)(((x) << (b)) | ((x) >> (64 - (b))))
+
+#define FF_SIPHASH_ROUND(state)                          \
+    do                                                   \
+    {                                                    \
+        (state)->v0 += (state)->v1;                      \
+        (state)->v1 = FF_SIPHASH_ROTL((state)->v1, 13);  \
+        (state)->v1 ^= (state)->v0;                      \
+        (state)->v0 = FF_SIPHASH_ROTL((state)->v0, 32);  \
+        (state)->v2 += (state)->v3;                      \
+        (state)->v3 = FF_SIPHASH_ROTL((state)->v3, 16);  \
+        (state)->v3 ^= (state)->v2;                      \
+        (state)->v0 += (state)->v3;                      \
+        (state)->v3 = FF_SIPHASH_ROTL((state)->v3, 21);  \
+        (state)->v3 ^= (state)->v0;                      \
+        (state)->v2 += (state)->v1;                      \
+        (state)->v1 = FF_SIPHASH_ROTL((state)->v1, 17);  \
+        (state)->v1 ^= (state)->v2;                      \
+        (state)->v2 = FF_SIPHASH_ROTL((state)->v2, 32);  \
+    } while (0)
+
+static uint64_t ff_siphash_read_le64(const uint8_t *bytes)
+{
+    uint64_t value = 0;
+
+    for (int i = 7; i >= 0; i--)
+    {
+        value = (value << 8) | bytes[i];
+    }
+
+    return value;
+}
+
+static void ff_siphash_compress(struct ff_siphash *state, uint64_t word)
+{
+    state->v3 ^= word;
+    FF_SIPHASH_ROUND(state);
+    FF_SIPHASH_ROUND(state);
+    state->v0 ^= word;
+}
+
+void ff_siphash_init(struct ff_siphash *state, const uint8_t key[FF_SIPHASH_KEY_LENGTH])
+{
+    uint64_t k0 = ff_siphash_read_le64(key);
+    uint64_t k1 = ff_siphash_read_le64(key + 8);
+
+    state->v0 = k0 ^ 0x736f6d6570736575ULL;
+    // 128 bit output variant
+    state->v1 = k1 ^ 0x646f72616e646f6dULL ^ 0xee;
+    state->v2 = k0 ^ 0x6c7967656e657261ULL;
+    state->v3 = k1 ^ 0x7465646279746573ULL;
+    state->tail = 0;
+    state->length = 0;
+}
+
+void ff_siphash_update(struct ff_siphash *state, const uint8_t *data, size_t length)
+{
+    size_t i = 0;
+
+    // Finish a word started by a previous update
+    while (i < length && (state->length & 7) != 0)
+    {
+        state->tail |= (uint64_t)data[i++] << (8 * (state->length++ & 7));
+
+        if ((state->length & 7) == 0)
+        {
+            ff_siphash_compress(state, state->tail);
+            state->tail = 0;
+        }
+    }
+
+    for (; i + 8 <= length; i += 8)
+    {
+        ff_siphash_compress(state, ff_siphash_read_le64(data + i));
+        state->length += 8;
+    }
+
+    while (i < length)
+    {
+        state->tail |= (uint64_t)data[i++] << (8 * (state->length++ & 7));
+    }
+}
+
+void ff_siphash_final128(struct ff_siphash *state, uint64_t out[2])
+{
+    ff_siphash_compress(state, state->tail | (state->length << 56));
+
+    state->v2 ^= 0xee;
+    for (int i = 0; i < 4; i++)
+    {
+        FF_SIPHASH_ROUND(state);
+    }
+    out[0] = state->v0 ^ state->v1 ^ state->v2 ^ state->v3;
+
+    state->v1 ^= 0xdd;
+    for (int i = 0; i < 4; i++)
+    {
+        FF_SIPHASH_ROUND(state);
+    }
+    out[1] = state->v0 ^ state->v1 ^ state->v2 ^ state->v3;
+}
@@ -0,0 +1,30 @@
+#include <stdint.h>
+#include <stddef.h>
+
+#ifndef FF_SIPHASH_H
+#define FF_SIPHASH_H
+
+#define FF_SIPHASH_KEY_LENGTH 16
+
+/**
+ * Incremental SipHash-2-4 with 128 bit output, a keyed hash that stays
+ * unpredictable to clients choosing the hashed bytes.
+ */
+struct ff_siphash
+{
+    uint64_t v0;
+    uint64_t v1;
+    uint64_t v2;
+    uint64_t v3;
+    // Bytes not yet forming a full 8 byte word, little endian
+    uint64_t tail;
+    uint64_t length;
+};
+
+void ff_siphash_init(struct ff_siphash *state, const uint8_t key[FF_SIPHASH_KEY_LENGTH]);
+
+void ff_siphash_update(struct ff_siphash *state, const uint8_t *data, size_t length);
+
+void ff_siphash_final128(struct ff_siphash *state, uint64_t out[2]);
+
+#endif
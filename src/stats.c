@@ -0,0 +1,54 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "stats.h"
+#include "logging.h"
+
+struct ff_stats ff_global_stats = {0};
+
+static pthread_mutex_t ff_stats_printers_mutex = PTHREAD_MUTEX_INITIALIZER;
+static ff_stats_printer ff_stats_printers[FF_STATS_MAX_PRINTERS];
+static void *ff_stats_printer_contexts[FF_STATS_MAX_PRINTERS];
+static uint8_t ff_stats_printers_length = 0;
+
+void ff_stats_register_printer(ff_stats_printer printer, void *context)
+{
+    pthread_mutex_lock(&ff_stats_printers_mutex);
+
+    if (ff_stats_printers_length >= FF_STATS_MAX_PRINTERS)
+    {
+        ff_log(FF_WARNING, "Too many stats printers registered (max: %d)", FF_STATS_MAX_PRINTERS);
+        goto cleanup;
+    }
+
+    ff_stats_printers[ff_stats_printers_length] = printer;
+    ff_stats_printer_contexts[ff_stats_printers_length] = context;
+    ff_stats_printers_length++;
+
+cleanup:
+    pthread_mutex_unlock(&ff_stats_printers_mutex);
+}
+
+void ff_stats_print(FILE *fd)
+{
+#define FF_STATS_PRINT_COUNTER(name) fprintf(fd, "%s %lu\n", #name, (unsigned long)FF_STATS_GET(name));
+    FF_STATS_COUNTERS(FF_STATS_PRINT_COUNTER)
+#undef FF_STATS_PRINT_COUNTER
+
+    pthread_mutex_lock(&ff_stats_printers_mutex);
+
+    for (uint8_t i = 0; i < ff_stats_printers_length; i++)
+    {
+        ff_stats_printers[i](fd, ff_stats_printer_contexts[i]);
+    }
+
+    pthread_mutex_unlock(&ff_stats_printers_mutex);
+
+    fflush(fd);
+}
+
+void ff_stats_reset(void)
+{
+    memset(&ff_global_stats, 0, sizeof(ff_global_stats));
+}
@@ -0,0 +1,89 @@
+#include <stdio.h>
+#include <stdint.h>
+
+#ifndef FF_STATS_H
+#define FF_STATS_H
+
+#define FF_STATS_MAX_PRINTERS 16
+
+// Process wide counters, printed in declaration order by ff_stats_print
+#define FF_STATS_COUNTERS(X)              \
+    X(partial_requests_active)            \
+    X(partial_requests_bytes)             \
+    X(partial_requests_evicted)           \
+    X(partial_requests_refused_memory)    \
+    X(partial_requests_refused_source)    \
+    X(key_cache_hits)                     \
+    X(key_cache_misses)                   \
+    X(key_cache_coalesced)                \
+    X(key_cache_evictions)                \
+    X(incremental_decrypt_requests)       \
+    X(incremental_decrypt_bytes)          \
+    X(crypto_queue_depth)                 \
+    X(crypto_batches)                     \
+    X(crypto_batch_requests)              \
+    X(crypto_batch_usecs)                 \
+    X(replay_filter_rejected)             \
+    X(tls_handshakes_full)                \
+    X(tls_handshakes_resumed)             \
+    X(tls_early_data_attempts)            \
+    X(tls_early_data_accepted)            \
+    X(tls_early_data_rejected)            \
+    X(upstream_connections_opened)        \
+    X(upstream_connections_reused)        \
+    X(upstream_connections_idle)          \
+    X(dns_cache_hits)                     \
+    X(dns_cache_stale_hits)               \
+    X(dns_cache_negative_hits)            \
+    X(dns_cache_misses)                   \
+    X(dns_resolve_failures)               \
+    X(dns_queries)                        \
+    X(dns_query_retries)                  \
+    X(dns_tcp_fallbacks)                  \
+    X(dns_lookups_coalesced)              \
+    X(dns_lookups_in_flight)              \
+    X(upstream_acks_timed_out)            \
+    X(upstream_drains_active)             \
+    X(upstream_drains_completed)          \
+    X(upstream_drains_timed_out)          \
+    X(upstream_drain_usecs)               \
+    X(upstream_engine_forwards_active)    \
+    X(upstream_engine_forwards_failed)    \
+    X(upstream_fastopen_attempts)         \
+    X(upstream_fastopen_accepted)         \
+    X(upstream_fastopen_fallbacks)        \
+    X(upstream_connect_attempts)          \
+    X(upstream_connect_fallbacks)         \
+    X(upstream_http2_connections_opened)  \
+    X(upstream_http2_streams_opened)      \
+    X(upstream_http2_streams_queued)      \
+    X(upstream_limit_queued)              \
+    X(upstream_limit_rejected)            \
+    X(upstream_limit_queue_timeouts)      \
+    X(upstream_limit_wait_usecs)          \
+    X(upstream_limit_decreases)
+
+struct ff_stats
+{
+#define FF_STATS_DECLARE_COUNTER(name) uint64_t name;
+    FF_STATS_COUNTERS(FF_STATS_DECLARE_COUNTER)
+#undef FF_STATS_DECLARE_COUNTER
+};
+
+extern struct ff_stats ff_global_stats;
+
+#define FF_STATS_ADD(name, value) __atomic_add_fetch(&ff_global_stats.name, (value), __ATOMIC_RELAXED)
+#define FF_STATS_SUB(name, value) __atomic_sub_fetch(&ff_global_stats.name, (value), __ATOMIC_RELAXED)
+#define FF_STATS_INC(name) FF_STATS_ADD(name, 1)
+#define FF_STATS_DEC(name) FF_STATS_SUB(name, 1)
+#define FF_STATS_GET(name) __atomic_load_n(&ff_global_stats.name, __ATOMIC_RELAXED)
+
+typedef void (*ff_stats_printer)(FILE *fd, void *context);
+
+void ff_stats_register_printer(ff_stats_printer printer, void *context);
+
+void ff_stats_print(FILE *fd);
+
+void ff_stats_reset(void);
+
+#endif
@@ -0,0 +1,156 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include "tcp_fastopen.h"
+#include "tcp_fastopen_p.h"
+#include "logging.h"
+#include "stats.h"
+#include "alloc.h"
+
+struct ff_tcp_fastopen *ff_tcp_fastopen_init(uint32_t capacity, uint32_t max_fallbacks, uint32_t backoff)
+{
+    struct ff_tcp_fastopen *fastopen = calloc(1, sizeof(struct ff_tcp_fastopen));
+
+    fastopen->max_fallbacks = max_fallbacks;
+    fastopen->backoff = backoff;
+    fastopen->destinations = ff_lru_table_init(capacity, NULL, ff_tcp_fastopen_destination_free);
+    pthread_mutex_init(&fastopen->mutex, NULL);
+
+    return fastopen;
+}
+
+bool ff_tcp_fastopen_enable(struct ff_tcp_fastopen *fastopen, int sockfd, const char *destination)
+{
+    struct ff_tcp_fastopen_destination *entry = NULL;
+    bool disabled = false;
+
+    if (fastopen == NULL)
+    {
+        return false;
+    }
+
+    pthread_mutex_lock(&fastopen->mutex);
+
+    entry = ff_tcp_fastopen_find(fastopen, destination);
+    disabled = entry != NULL && entry->disabled_until > time(NULL);
+
+    pthread_mutex_unlock(&fastopen->mutex);
+
+    if (disabled)
+    {
+        return false;
+    }
+
+    if (setsockopt(sockfd, IPPROTO_TCP, TCP_FASTOPEN_CONNECT, &(int){1}, sizeof(int)) != 0)
+    {
+        ff_log(FF_DEBUG, "Failed to enable TCP Fast Open for %s", destination);
+        return false;
+    }
+
+    FF_STATS_INC(upstream_fastopen_attempts);
+
+    return true;
+}
+
+bool ff_tcp_fastopen_enabled(int sockfd)
+{
+    int enabled = 0;
+    socklen_t enabled_length = sizeof(enabled);
+
+    return getsockopt(sockfd, IPPROTO_TCP, TCP_FASTOPEN_CONNECT, &enabled, &enabled_length) == 0 && enabled;
+}
+
+bool ff_tcp_fastopen_record(struct ff_tcp_fastopen *fastopen, int sockfd, const char *destination, bool written)
+{
+    struct ff_tcp_fastopen_destination *entry = NULL;
+    struct tcp_info info;
+    socklen_t info_length = sizeof(info);
+    bool delivered = true;
+
+    if (fastopen == NULL || !ff_tcp_fastopen_enabled(sockfd) ||
+        getsockopt(sockfd, IPPROTO_TCP, TCP_INFO, &info, &info_length) != 0)
+    {
+        return true;
+    }
+
+    pthread_mutex_lock(&fastopen->mutex);
+
+    entry = ff_tcp_fastopen_touch(fastopen, destination);
+
+    // Connections which were established and then reset also end up closed,
+    // so only a failed write or a handshake still in progress means the SYN
+    // data never reached the destination
+    if (!written || info.tcpi_state == TCP_SYN_SENT)
+    {
+        FF_STATS_INC(upstream_fastopen_fallbacks);
+        ff_log(FF_INFO, "Connection to %s failed with TCP Fast Open, not attempting it for %u seconds", destination, fastopen->backoff);
+        delivered = false;
+        entry->fallbacks = 0;
+        entry->disabled_until = time(NULL) + (time_t)fastopen->backoff;
+        goto cleanup;
+    }
+
+    if (info.tcpi_options & TCPI_OPT_SYN_DATA)
+    {
+        FF_STATS_INC(upstream_fastopen_accepted);
+        entry->fallbacks = 0;
+        goto cleanup;
+    }
+
+    // Includes the first connection to a destination, which only requests a cookie
+    FF_STATS_INC(upstream_fastopen_fallbacks);
+
+    if (++entry->fallbacks >= fastopen->max_fallbacks)
+    {
+        ff_log(FF_INFO, "Upstream %s isn't accepting TCP Fast Open, not attempting it for %u seconds", destination, fastopen->backoff);
+        entry->fallbacks = 0;
+        entry->disabled_until = time(NULL) + (time_t)fastopen->backoff;
+    }
+
+cleanup:
+    pthread_mutex_unlock(&fastopen->mutex);
+
+    return delivered;
+}
+
+struct ff_tcp_fastopen_destination *ff_tcp_fastopen_find(struct ff_tcp_fastopen *fastopen, const char *destination)
+{
+    return (struct ff_tcp_fastopen_destination *)ff_lru_table_find_string(fastopen->destinations, destination);
+}
+
+struct ff_tcp_fastopen_destination *ff_tcp_fastopen_touch(struct ff_tcp_fastopen *fastopen, const char *destination)
+{
+    struct ff_tcp_fastopen_destination *entry = ff_tcp_fastopen_find(fastopen, destination);
+
+    if (entry != NULL)
+    {
+        ff_lru_table_touch(fastopen->destinations, &entry->lru);
+        return entry;
+    }
+
+    return (struct ff_tcp_fastopen_destination *)ff_lru_table_insert_string(fastopen->destinations, destination, sizeof(struct ff_tcp_fastopen_destination));
+}
+
+void ff_tcp_fastopen_destination_free(struct ff_lru_table_entry *entry)
+{
+    FREE(entry);
+}
+
+void ff_tcp_fastopen_free(struct ff_tcp_fastopen *fastopen)
+{
+    if (fastopen == NULL)
+    {
+        return;
+    }
+
+    ff_lru_table_free(fastopen->destinations);
+    pthread_mutex_destroy(&fastopen->mutex);
+    FREE(fastopen);
+}
@@ -0,0 +1,64 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+#include <pthread.h>
+#include "lru_table.h"
+
+#ifndef FF_TCP_FASTOPEN_H
+#define FF_TCP_FASTOPEN_H
+
+struct ff_tcp_fastopen_destination
+{
+    // Keyed by address:port
+    struct ff_lru_table_entry lru;
+    // Consecutive connections whose SYN data wasn't acknowledged
+    uint32_t fallbacks;
+    // Fast open isn't attempted with the destination before this
+    time_t disabled_until;
+};
+
+/**
+ * Client side TCP Fast Open (RFC 7413) to upstream addresses. The kernel
+ * keeps each destination's cookie, this tracks whether the destination
+ * acknowledges the data sent in the SYN and stops sending it to those that
+ * don't. Bounded by destination count with least recently used eviction.
+ */
+struct ff_tcp_fastopen
+{
+    // Consecutive fallbacks before a destination is skipped
+    uint32_t max_fallbacks;
+    // Seconds a destination is skipped for
+    uint32_t backoff;
+    struct ff_lru_table *destinations;
+    pthread_mutex_t mutex;
+};
+
+struct ff_tcp_fastopen *ff_tcp_fastopen_init(uint32_t capacity, uint32_t max_fallbacks, uint32_t backoff);
+
+/**
+ * Enables fast open on the unconnected socket unless the destination has
+ * stopped acknowledging SYN data, returns whether it was enabled. When a
+ * cookie is cached connect() returns immediately and the first write is
+ * sent in the SYN, otherwise the handshake requests a cookie for next time.
+ */
+bool ff_tcp_fastopen_enable(struct ff_tcp_fastopen *fastopen, int sockfd, const char *destination);
+
+/**
+ * Returns whether fast open was enabled on the socket
+ */
+bool ff_tcp_fastopen_enabled(int sockfd);
+
+/**
+ * Records whether the destination acknowledged the SYN data of a connection
+ * fast open was enabled on, at most once per connection. Data that wasn't is
+ * resent by the kernel after the handshake. Returns false if the SYN data was
+ * never delivered, because writing the request failed or the handshake never
+ * completed, in which case the destination is skipped and the request can be
+ * sent again without fast open. A connection reset after it was established
+ * may have delivered the request and returns true.
+ */
+bool ff_tcp_fastopen_record(struct ff_tcp_fastopen *fastopen, int sockfd, const char *destination, bool written);
+
+void ff_tcp_fastopen_free(struct ff_tcp_fastopen *fastopen);
+
+#endif
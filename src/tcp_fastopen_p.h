@@ -0,0 +1,16 @@
+#include <stdint.h>
+#include "tcp_fastopen.h"
+
+#ifndef FF_TCP_FASTOPEN_P_H
+#define FF_TCP_FASTOPEN_P_H
+
+struct ff_tcp_fastopen_destination *ff_tcp_fastopen_find(struct ff_tcp_fastopen *fastopen, const char *destination);
+
+/**
+ * Finds the destination's entry, inserting one if missing, and marks it most recently used
+ */
+struct ff_tcp_fastopen_destination *ff_tcp_fastopen_touch(struct ff_tcp_fastopen *fastopen, const char *destination);
+
+void ff_tcp_fastopen_destination_free(struct ff_lru_table_entry *entry);
+
+#endif
@@ -0,0 +1,198 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <openssl/ssl.h>
+#include "tls_session_cache.h"
+#include "tls_session_cache_p.h"
+#include "logging.h"
+#include "alloc.h"
+
+struct ff_tls_session_cache *ff_tls_session_cache_init(uint32_t capacity, uint32_t max_age)
+{
+    struct ff_tls_session_cache *cache = calloc(1, sizeof(struct ff_tls_session_cache));
+
+    cache->max_age = max_age;
+    cache->entries = ff_lru_table_init(capacity, NULL, ff_tls_session_cache_entry_free);
+    pthread_mutex_init(&cache->mutex, NULL);
+
+    return cache;
+}
+
+SSL_SESSION *ff_tls_session_cache_get(struct ff_tls_session_cache *cache, const char *host)
+{
+    struct ff_tls_session_cache_entry *entry = NULL;
+    SSL_SESSION *session = NULL;
+
+    pthread_mutex_lock(&cache->mutex);
+
+    entry = ff_tls_session_cache_find(cache, host);
+
+    if (entry == NULL || entry->session == NULL)
+    {
+        goto cleanup;
+    }
+
+    if (ff_tls_session_cache_session_expired(cache, entry, time(NULL)))
+    {
+        SSL_SESSION_free(entry->session);
+        entry->session = NULL;
+        goto cleanup;
+    }
+
+    ff_lru_table_touch(cache->entries, &entry->lru);
+
+    if (SSL_SESSION_get_protocol_version(entry->session) >= TLS1_3_VERSION)
+    {
+        // Reusing a ticket lets observers link connections, the resumed connection is issued new ones
+        session = entry->session;
+        entry->session = NULL;
+    }
+    else
+    {
+        session = entry->session;
+        SSL_SESSION_up_ref(session);
+    }
+
+cleanup:
+    pthread_mutex_unlock(&cache->mutex);
+
+    return session;
+}
+
+void ff_tls_session_cache_put(struct ff_tls_session_cache *cache, const char *host, SSL_SESSION *session)
+{
+    struct ff_tls_session_cache_entry *entry = NULL;
+
+    if (cache->entries->capacity == 0 || !SSL_SESSION_is_resumable(session))
+    {
+        SSL_SESSION_free(session);
+        return;
+    }
+
+    pthread_mutex_lock(&cache->mutex);
+
+    entry = ff_tls_session_cache_touch(cache, host);
+
+    if (entry->session != NULL)
+    {
+        SSL_SESSION_free(entry->session);
+    }
+
+    entry->session = session;
+    entry->stored_at = time(NULL);
+
+    pthread_mutex_unlock(&cache->mutex);
+}
+
+void ff_tls_session_cache_record_handshake(struct ff_tls_session_cache *cache, const char *host, bool resumed)
+{
+    struct ff_tls_session_cache_entry *entry = NULL;
+
+    if (cache->entries->capacity == 0)
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&cache->mutex);
+
+    entry = ff_tls_session_cache_touch(cache, host);
+
+    if (resumed)
+    {
+        entry->resumed_handshakes++;
+    }
+    else
+    {
+        entry->full_handshakes++;
+    }
+
+    pthread_mutex_unlock(&cache->mutex);
+}
+
+void ff_tls_session_cache_flush(struct ff_tls_session_cache *cache)
+{
+    struct ff_tls_session_cache_entry *entry = NULL;
+
+    pthread_mutex_lock(&cache->mutex);
+
+    for (entry = (struct ff_tls_session_cache_entry *)cache->entries->lru_first; entry != NULL; entry = (struct ff_tls_session_cache_entry *)entry->lru.lru_next)
+    {
+        if (entry->session != NULL)
+        {
+            SSL_SESSION_free(entry->session);
+            entry->session = NULL;
+        }
+    }
+
+    pthread_mutex_unlock(&cache->mutex);
+}
+
+void ff_tls_session_cache_print_stats(FILE *fd, void *context)
+{
+    struct ff_tls_session_cache *cache = (struct ff_tls_session_cache *)context;
+    struct ff_tls_session_cache_entry *entry = NULL;
+
+    pthread_mutex_lock(&cache->mutex);
+
+    for (entry = (struct ff_tls_session_cache_entry *)cache->entries->lru_first; entry != NULL; entry = (struct ff_tls_session_cache_entry *)entry->lru.lru_next)
+    {
+        fprintf(fd, "tls_handshakes_resumed[%s] %lu\n", (char *)entry->lru.key, (unsigned long)entry->resumed_handshakes);
+        fprintf(fd, "tls_handshakes_full[%s] %lu\n", (char *)entry->lru.key, (unsigned long)entry->full_handshakes);
+    }
+
+    pthread_mutex_unlock(&cache->mutex);
+}
+
+struct ff_tls_session_cache_entry *ff_tls_session_cache_find(struct ff_tls_session_cache *cache, const char *host)
+{
+    return (struct ff_tls_session_cache_entry *)ff_lru_table_find_string(cache->entries, host);
+}
+
+struct ff_tls_session_cache_entry *ff_tls_session_cache_touch(struct ff_tls_session_cache *cache, const char *host)
+{
+    struct ff_tls_session_cache_entry *entry = ff_tls_session_cache_find(cache, host);
+
+    if (entry != NULL)
+    {
+        ff_lru_table_touch(cache->entries, &entry->lru);
+        return entry;
+    }
+
+    return (struct ff_tls_session_cache_entry *)ff_lru_table_insert_string(cache->entries, host, sizeof(struct ff_tls_session_cache_entry));
+}
+
+bool ff_tls_session_cache_session_expired(struct ff_tls_session_cache *cache, struct ff_tls_session_cache_entry *entry, time_t now)
+{
+    // The server's lifetime hint bounds how long it will accept the session
+    time_t server_expiry = (time_t)SSL_SESSION_get_time(entry->session) + (time_t)SSL_SESSION_get_timeout(entry->session);
+
+    return now - entry->stored_at >= (time_t)cache->max_age || now >= server_expiry;
+}
+
+void ff_tls_session_cache_entry_free(struct ff_lru_table_entry *lru)
+{
+    struct ff_tls_session_cache_entry *entry = (struct ff_tls_session_cache_entry *)lru;
+
+    if (entry->session != NULL)
+    {
+        SSL_SESSION_free(entry->session);
+    }
+
+    FREE(entry);
+}
+
+void ff_tls_session_cache_free(struct ff_tls_session_cache *cache)
+{
+    if (cache == NULL)
+    {
+        return;
+    }
+
+    ff_lru_table_free(cache->entries);
+    pthread_mutex_destroy(&cache->mutex);
+    FREE(cache);
+}
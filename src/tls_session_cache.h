@@ -0,0 +1,62 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+#include <pthread.h>
+#include <openssl/ssl.h>
+#include "lru_table.h"
+
+#ifndef FF_TLS_SESSION_CACHE_H
+#define FF_TLS_SESSION_CACHE_H
+
+struct ff_tls_session_cache_entry
+{
+    // Keyed by host:port
+    struct ff_lru_table_entry lru;
+    // NULL once used or expired, the entry remains to hold the host's stats
+    SSL_SESSION *session;
+    time_t stored_at;
+    uint64_t resumed_handshakes;
+    uint64_t full_handshakes;
+};
+
+/**
+ * Client side TLS sessions (TLS 1.2 session ids and TLS 1.3 tickets) of
+ * upstream hosts, bounded by host count with least recently used eviction.
+ */
+struct ff_tls_session_cache
+{
+    // Sessions older than this are never resumed, regardless of the server's lifetime hint
+    uint32_t max_age;
+    struct ff_lru_table *entries;
+    pthread_mutex_t mutex;
+};
+
+struct ff_tls_session_cache *ff_tls_session_cache_init(uint32_t capacity, uint32_t max_age);
+
+/**
+ * Returns a reference to a session to resume with the host, or NULL.
+ * TLS 1.3 tickets are removed so each is only used once.
+ */
+SSL_SESSION *ff_tls_session_cache_get(struct ff_tls_session_cache *cache, const char *host);
+
+/**
+ * Stores the session for the host, taking ownership of the reference
+ */
+void ff_tls_session_cache_put(struct ff_tls_session_cache *cache, const char *host, SSL_SESSION *session);
+
+void ff_tls_session_cache_record_handshake(struct ff_tls_session_cache *cache, const char *host, bool resumed);
+
+/**
+ * Drops every stored session, keeping the per host stats
+ */
+void ff_tls_session_cache_flush(struct ff_tls_session_cache *cache);
+
+/**
+ * Stats printer listing resumed and full handshakes per cached host
+ */
+void ff_tls_session_cache_print_stats(FILE *fd, void *context);
+
+void ff_tls_session_cache_free(struct ff_tls_session_cache *cache);
+
+#endif
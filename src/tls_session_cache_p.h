@@ -0,0 +1,18 @@
+#include <stdint.h>
+#include "tls_session_cache.h"
+
+#ifndef FF_TLS_SESSION_CACHE_P_H
+#define FF_TLS_SESSION_CACHE_P_H
+
+struct ff_tls_session_cache_entry *ff_tls_session_cache_find(struct ff_tls_session_cache *cache, const char *host);
+
+/**
+ * Finds the host's entry, inserting one if missing, and marks it most recently used
+ */
+struct ff_tls_session_cache_entry *ff_tls_session_cache_touch(struct ff_tls_session_cache *cache, const char *host);
+
+bool ff_tls_session_cache_session_expired(struct ff_tls_session_cache *cache, struct ff_tls_session_cache_entry *entry, time_t now);
+
+void ff_tls_session_cache_entry_free(struct ff_lru_table_entry *entry);
+
+#endif
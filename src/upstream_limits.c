@@ -0,0 +1,391 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include "upstream_limits.h"
+#include "upstream_limits_p.h"
+#include "logging.h"
+#include "stats.h"
+#include "alloc.h"
+
+struct ff_upstream_limits *ff_upstream_limits_init(uint32_t capacity, uint32_t max_in_flight, uint32_t queue_size, uint32_t queue_timeout_ms, bool adaptive)
+{
+    struct ff_upstream_limits *limits = calloc(1, sizeof(struct ff_upstream_limits));
+
+    limits->max_in_flight = max_in_flight;
+    limits->queue_size = queue_size;
+    limits->queue_timeout_ms = queue_timeout_ms;
+    limits->adaptive = adaptive;
+    limits->hosts = ff_lru_table_init(capacity, ff_upstream_limits_evictable, ff_upstream_limits_host_free);
+    pthread_mutex_init(&limits->mutex, NULL);
+
+    return limits;
+}
+
+enum ff_upstream_limits_result ff_upstream_limits_acquire(struct ff_upstream_limits *limits, const char *host, struct ff_upstream_waiter *waiter)
+{
+    struct ff_upstream_host *entry = NULL;
+    enum ff_upstream_limits_result result;
+
+    if (limits == NULL)
+    {
+        return FF_UPSTREAM_LIMITS_ADMITTED;
+    }
+
+    pthread_mutex_lock(&limits->mutex);
+
+    entry = ff_upstream_limits_touch(limits, host);
+
+    // Requests already waiting go first
+    if (entry->queue_first == NULL && entry->in_flight < ff_upstream_limits_current(entry))
+    {
+        entry->in_flight++;
+        result = FF_UPSTREAM_LIMITS_ADMITTED;
+        goto done;
+    }
+
+    if (entry->queue_length >= limits->queue_size)
+    {
+        entry->rejected++;
+        FF_STATS_INC(upstream_limit_rejected);
+        result = FF_UPSTREAM_LIMITS_REJECTED;
+        goto done;
+    }
+
+    waiter->host = entry;
+    waiter->admitted = false;
+    waiter->prev = entry->queue_last;
+    waiter->next = NULL;
+    clock_gettime(CLOCK_MONOTONIC, &waiter->queued);
+
+    if (entry->queue_last == NULL)
+    {
+        entry->queue_first = waiter;
+    }
+    else
+    {
+        entry->queue_last->next = waiter;
+    }
+
+    entry->queue_last = waiter;
+    entry->queue_length++;
+    FF_STATS_INC(upstream_limit_queued);
+    result = FF_UPSTREAM_LIMITS_QUEUED;
+
+done:
+    pthread_mutex_unlock(&limits->mutex);
+
+    return result;
+}
+
+bool ff_upstream_limits_cancel(struct ff_upstream_limits *limits, struct ff_upstream_waiter *waiter, bool timed_out)
+{
+    bool cancelled = false;
+
+    pthread_mutex_lock(&limits->mutex);
+
+    if (!waiter->admitted)
+    {
+        if (timed_out)
+        {
+            waiter->host->queue_timeouts++;
+            FF_STATS_INC(upstream_limit_queue_timeouts);
+        }
+
+        ff_upstream_limits_queue_remove(waiter->host, waiter);
+        waiter->host = NULL;
+        cancelled = true;
+    }
+
+    pthread_mutex_unlock(&limits->mutex);
+
+    return cancelled;
+}
+
+bool ff_upstream_limits_wait(struct ff_upstream_limits *limits, const char *host)
+{
+    struct ff_upstream_limits_wait_args args = {.done = false};
+    struct ff_upstream_waiter waiter = {.on_admitted = ff_upstream_limits_wait_admitted, .context = (void *)&args};
+    pthread_condattr_t attributes;
+    struct timespec deadline;
+    enum ff_upstream_limits_result result;
+    int error = 0;
+
+    if ((result = ff_upstream_limits_acquire(limits, host, &waiter)) != FF_UPSTREAM_LIMITS_QUEUED)
+    {
+        return result == FF_UPSTREAM_LIMITS_ADMITTED;
+    }
+
+    // The deadline is on the same clock the queue measures waits with
+    pthread_condattr_init(&attributes);
+    pthread_condattr_setclock(&attributes, CLOCK_MONOTONIC);
+    pthread_cond_init(&args.admitted, &attributes);
+    pthread_condattr_destroy(&attributes);
+    pthread_mutex_init(&args.mutex, NULL);
+
+    deadline = waiter.queued;
+    deadline.tv_sec += limits->queue_timeout_ms / 1000;
+    deadline.tv_nsec += (long)(limits->queue_timeout_ms % 1000) * 1000000;
+
+    if (deadline.tv_nsec >= 1000000000)
+    {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+    }
+
+    pthread_mutex_lock(&args.mutex);
+
+    while (!args.done && error != ETIMEDOUT)
+    {
+        error = pthread_cond_timedwait(&args.admitted, &args.mutex, &deadline);
+    }
+
+    // Admitted as it timed out, the callback is on its way
+    if (!args.done && !ff_upstream_limits_cancel(limits, &waiter, true))
+    {
+        while (!args.done)
+        {
+            pthread_cond_wait(&args.admitted, &args.mutex);
+        }
+    }
+
+    pthread_mutex_unlock(&args.mutex);
+
+    pthread_cond_destroy(&args.admitted);
+    pthread_mutex_destroy(&args.mutex);
+
+    return args.done;
+}
+
+void ff_upstream_limits_wait_admitted(struct ff_upstream_waiter *waiter)
+{
+    struct ff_upstream_limits_wait_args *args = (struct ff_upstream_limits_wait_args *)waiter->context;
+
+    pthread_mutex_lock(&args->mutex);
+    args->done = true;
+    pthread_cond_signal(&args->admitted);
+    pthread_mutex_unlock(&args->mutex);
+}
+
+void ff_upstream_limits_release(struct ff_upstream_limits *limits, const char *host, struct ff_upstream_sample *sample)
+{
+    struct ff_upstream_host *entry = NULL;
+    struct ff_upstream_waiter *admitted = NULL;
+    struct ff_upstream_waiter *waiter = NULL;
+    struct ff_upstream_waiter *next = NULL;
+    uint64_t wait_usecs;
+
+    if (limits == NULL)
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&limits->mutex);
+
+    // Hosts with requests in flight aren't evicted
+    if ((entry = ff_upstream_limits_find(limits, host)) == NULL || entry->in_flight == 0)
+    {
+        ff_log(FF_ERROR, "Released a request slot which wasn't held for host: %s", host);
+        pthread_mutex_unlock(&limits->mutex);
+        return;
+    }
+
+    entry->in_flight--;
+
+    if (sample != NULL && limits->adaptive)
+    {
+        ff_upstream_limits_adapt(limits, entry, sample);
+    }
+
+    while ((waiter = entry->queue_first) != NULL && entry->in_flight < ff_upstream_limits_current(entry))
+    {
+        ff_upstream_limits_queue_remove(entry, waiter);
+        waiter->admitted = true;
+        waiter->host = NULL;
+        entry->in_flight++;
+
+        wait_usecs = ff_upstream_limits_usecs_since(&waiter->queued);
+        entry->admitted_from_queue++;
+        entry->wait_usecs += wait_usecs;
+        FF_STATS_ADD(upstream_limit_wait_usecs, wait_usecs);
+
+        waiter->next = admitted;
+        admitted = waiter;
+    }
+
+    pthread_mutex_unlock(&limits->mutex);
+
+    // Called without the lock as they may acquire again, in the order they were queued
+    for (waiter = NULL; admitted != NULL; admitted = next)
+    {
+        next = admitted->next;
+        admitted->next = waiter;
+        waiter = admitted;
+    }
+
+    for (; waiter != NULL; waiter = next)
+    {
+        next = waiter->next;
+        waiter->on_admitted(waiter);
+    }
+}
+
+void ff_upstream_limits_adapt(struct ff_upstream_limits *limits, struct ff_upstream_host *entry, struct ff_upstream_sample *sample)
+{
+    bool congested = !sample->success;
+
+    if (sample->success && sample->connect_usecs != 0)
+    {
+        congested |= entry->connect_baseline != 0 && sample->connect_usecs > entry->connect_baseline * FF_UPSTREAM_LIMITS_LATENCY_TOLERANCE;
+        entry->connect_baseline = ff_upstream_limits_baseline(entry->connect_baseline, sample->connect_usecs);
+    }
+
+    if (sample->success && sample->response_usecs != 0)
+    {
+        congested |= entry->response_baseline != 0 && sample->response_usecs > entry->response_baseline * FF_UPSTREAM_LIMITS_LATENCY_TOLERANCE;
+        entry->response_baseline = ff_upstream_limits_baseline(entry->response_baseline, sample->response_usecs);
+    }
+
+    entry->since_decrease++;
+
+    if (!congested)
+    {
+        entry->limit += 1.0 / entry->limit;
+        entry->limit = entry->limit > limits->max_in_flight ? limits->max_in_flight : entry->limit;
+        return;
+    }
+
+    // Requests in flight when the limit was cut report the same congestion
+    if (entry->since_decrease < ff_upstream_limits_current(entry))
+    {
+        return;
+    }
+
+    entry->limit *= FF_UPSTREAM_LIMITS_BACKOFF;
+    entry->limit = entry->limit < 1 ? 1 : entry->limit;
+    entry->since_decrease = 0;
+    FF_STATS_INC(upstream_limit_decreases);
+    ff_log(FF_DEBUG, "Reduced request limit for host %s to %u", (char *)entry->lru.key, ff_upstream_limits_current(entry));
+}
+
+uint64_t ff_upstream_limits_baseline(uint64_t baseline, uint64_t usecs)
+{
+    if (baseline == 0 || usecs < baseline)
+    {
+        return usecs;
+    }
+
+    return baseline + (usecs - baseline) / FF_UPSTREAM_LIMITS_BASELINE_DECAY;
+}
+
+uint32_t ff_upstream_limits_current(struct ff_upstream_host *entry)
+{
+    return entry->limit < 1 ? 1 : (uint32_t)entry->limit;
+}
+
+void ff_upstream_limits_queue_remove(struct ff_upstream_host *entry, struct ff_upstream_waiter *waiter)
+{
+    if (waiter->prev == NULL)
+    {
+        entry->queue_first = waiter->next;
+    }
+    else
+    {
+        waiter->prev->next = waiter->next;
+    }
+
+    if (waiter->next == NULL)
+    {
+        entry->queue_last = waiter->prev;
+    }
+    else
+    {
+        waiter->next->prev = waiter->prev;
+    }
+
+    waiter->prev = NULL;
+    waiter->next = NULL;
+    entry->queue_length--;
+}
+
+void ff_upstream_limits_print_stats(FILE *fd, void *context)
+{
+    struct ff_upstream_limits *limits = (struct ff_upstream_limits *)context;
+    struct ff_upstream_host *entry = NULL;
+
+    pthread_mutex_lock(&limits->mutex);
+
+    for (entry = (struct ff_upstream_host *)limits->hosts->lru_first; entry != NULL; entry = (struct ff_upstream_host *)entry->lru.lru_next)
+    {
+        fprintf(fd, "upstream_in_flight[%s] %u\n", (char *)entry->lru.key, entry->in_flight);
+        fprintf(fd, "upstream_limit[%s] %u\n", (char *)entry->lru.key, ff_upstream_limits_current(entry));
+        fprintf(fd, "upstream_queue_depth[%s] %u\n", (char *)entry->lru.key, entry->queue_length);
+        fprintf(fd, "upstream_queue_avg_wait_usecs[%s] %lu\n",
+                (char *)entry->lru.key,
+                (unsigned long)(entry->admitted_from_queue == 0 ? 0 : entry->wait_usecs / entry->admitted_from_queue));
+        fprintf(fd, "upstream_queue_timeouts[%s] %lu\n", (char *)entry->lru.key, (unsigned long)entry->queue_timeouts);
+        fprintf(fd, "upstream_queue_rejected[%s] %lu\n", (char *)entry->lru.key, (unsigned long)entry->rejected);
+    }
+
+    pthread_mutex_unlock(&limits->mutex);
+}
+
+struct ff_upstream_host *ff_upstream_limits_find(struct ff_upstream_limits *limits, const char *name)
+{
+    return (struct ff_upstream_host *)ff_lru_table_find_string(limits->hosts, name);
+}
+
+struct ff_upstream_host *ff_upstream_limits_touch(struct ff_upstream_limits *limits, const char *name)
+{
+    struct ff_upstream_host *entry = ff_upstream_limits_find(limits, name);
+
+    if (entry != NULL)
+    {
+        ff_lru_table_touch(limits->hosts, &entry->lru);
+        return entry;
+    }
+
+    entry = (struct ff_upstream_host *)ff_lru_table_insert_string(limits->hosts, name, sizeof(struct ff_upstream_host));
+    entry->limit = limits->max_in_flight;
+    // Not cut yet, so the first congestion cuts it
+    entry->since_decrease = limits->max_in_flight;
+
+    return entry;
+}
+
+bool ff_upstream_limits_evictable(struct ff_lru_table_entry *lru)
+{
+    struct ff_upstream_host *entry = (struct ff_upstream_host *)lru;
+
+    return entry->in_flight == 0 && entry->queue_first == NULL;
+}
+
+void ff_upstream_limits_host_free(struct ff_lru_table_entry *entry)
+{
+    FREE(entry);
+}
+
+uint64_t ff_upstream_limits_usecs_since(struct timespec *start)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (uint64_t)(now.tv_sec - start->tv_sec) * 1000000 + (now.tv_nsec - start->tv_nsec) / 1000;
+}
+
+void ff_upstream_limits_free(struct ff_upstream_limits *limits)
+{
+    if (limits == NULL)
+    {
+        return;
+    }
+
+    ff_lru_table_free(limits->hosts);
+    pthread_mutex_destroy(&limits->mutex);
+    FREE(limits);
+}
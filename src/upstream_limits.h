@@ -0,0 +1,135 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+#include <pthread.h>
+#include "lru_table.h"
+
+#ifndef FF_UPSTREAM_LIMITS_H
+#define FF_UPSTREAM_LIMITS_H
+
+// An adaptive limit is cut to this fraction of itself when an upstream is congested
+#define FF_UPSTREAM_LIMITS_BACKOFF 0.9
+// Latency more than this multiple of the host's baseline is taken as congestion
+#define FF_UPSTREAM_LIMITS_LATENCY_TOLERANCE 2
+// Baselines move this fraction of the way towards latencies above them, following lasting changes
+#define FF_UPSTREAM_LIMITS_BASELINE_DECAY 16
+
+enum ff_upstream_limits_result
+{
+    FF_UPSTREAM_LIMITS_ADMITTED = 1,
+    FF_UPSTREAM_LIMITS_QUEUED = 2,
+    // The host's queue is full
+    FF_UPSTREAM_LIMITS_REJECTED = 3
+};
+
+struct ff_upstream_waiter;
+
+/**
+ * Called once a queued request is admitted, on the thread which released
+ * the slot it was given
+ */
+typedef void (*ff_upstream_limits_callback)(struct ff_upstream_waiter *waiter);
+
+/**
+ * A request waiting in a host's queue, embedded in its owner's state
+ */
+struct ff_upstream_waiter
+{
+    ff_upstream_limits_callback on_admitted;
+    void *context;
+    struct ff_upstream_host *host;
+    struct timespec queued;
+    bool admitted;
+    struct ff_upstream_waiter *prev;
+    struct ff_upstream_waiter *next;
+};
+
+/**
+ * How a request to a host went, fed back to its adaptive limit
+ */
+struct ff_upstream_sample
+{
+    bool success;
+    // Time to establish a new connection, 0 = none was opened
+    uint64_t connect_usecs;
+    // Time from the request being written to its completion, 0 = never written
+    uint64_t response_usecs;
+};
+
+struct ff_upstream_host
+{
+    // Keyed by host name
+    struct ff_lru_table_entry lru;
+    uint32_t in_flight;
+    // Fractional so additive increases accumulate across requests
+    double limit;
+    // Requests finished since the limit was last cut, it's cut at most once per limit's worth
+    uint32_t since_decrease;
+    // Lowest recent latencies in microseconds, 0 = none seen yet
+    uint64_t connect_baseline;
+    uint64_t response_baseline;
+    uint32_t queue_length;
+    struct ff_upstream_waiter *queue_first;
+    struct ff_upstream_waiter *queue_last;
+    uint64_t admitted_from_queue;
+    uint64_t wait_usecs;
+    uint64_t queue_timeouts;
+    uint64_t rejected;
+};
+
+/**
+ * Limits the requests in flight to each upstream host, queueing those over
+ * the limit in arrival order up to a bounded depth for up to a timeout.
+ * Adaptive limits start at the maximum and follow AIMD, growing by one per
+ * limit's worth of requests finishing with connect and response latencies
+ * near the host's baseline, and cut by FF_UPSTREAM_LIMITS_BACKOFF when a
+ * request fails or is slow. Shared by every thread, bounded by host count
+ * with idle hosts evicted least recently used first.
+ */
+struct ff_upstream_limits
+{
+    uint32_t max_in_flight;
+    uint32_t queue_size;
+    uint32_t queue_timeout_ms;
+    bool adaptive;
+    struct ff_lru_table *hosts;
+    pthread_mutex_t mutex;
+};
+
+struct ff_upstream_limits *ff_upstream_limits_init(uint32_t capacity, uint32_t max_in_flight, uint32_t queue_size, uint32_t queue_timeout_ms, bool adaptive);
+
+/**
+ * Admits a request to the host if it's under its limit, otherwise queues
+ * the waiter, whose callback is called once it's admitted. limits NULL =
+ * always admitted.
+ */
+enum ff_upstream_limits_result ff_upstream_limits_acquire(struct ff_upstream_limits *limits, const char *host, struct ff_upstream_waiter *waiter);
+
+/**
+ * Removes a waiter from its host's queue, counting a queue timeout if
+ * timed_out. Returns false if it has already been admitted, its callback
+ * is then still to be called.
+ */
+bool ff_upstream_limits_cancel(struct ff_upstream_limits *limits, struct ff_upstream_waiter *waiter, bool timed_out);
+
+/**
+ * Blocks until a request to the host is admitted, returns false if the
+ * queue was full or the queue timeout passed
+ */
+bool ff_upstream_limits_wait(struct ff_upstream_limits *limits, const char *host);
+
+/**
+ * Ends an admitted request, adapting the host's limit to the sample when
+ * not NULL, and admits the requests queued behind it
+ */
+void ff_upstream_limits_release(struct ff_upstream_limits *limits, const char *host, struct ff_upstream_sample *sample);
+
+/**
+ * Stats printer listing the in flight requests, limit and queue of each host
+ */
+void ff_upstream_limits_print_stats(FILE *fd, void *context);
+
+void ff_upstream_limits_free(struct ff_upstream_limits *limits);
+
+#endif
@@ -0,0 +1,55 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include "upstream_limits.h"
+
+#ifndef FF_UPSTREAM_LIMITS_P_H
+#define FF_UPSTREAM_LIMITS_P_H
+
+/**
+ * Signals a blocked ff_upstream_limits_wait
+ */
+struct ff_upstream_limits_wait_args
+{
+    pthread_mutex_t mutex;
+    pthread_cond_t admitted;
+    bool done;
+};
+
+void ff_upstream_limits_wait_admitted(struct ff_upstream_waiter *waiter);
+
+/**
+ * Adapts the host's limit to how a request went (AIMD)
+ */
+void ff_upstream_limits_adapt(struct ff_upstream_limits *limits, struct ff_upstream_host *entry, struct ff_upstream_sample *sample);
+
+/**
+ * Moves the baseline to a lower latency straight away, or part of the way to a higher one
+ */
+uint64_t ff_upstream_limits_baseline(uint64_t baseline, uint64_t usecs);
+
+/**
+ * The requests the host may have in flight, at least one
+ */
+uint32_t ff_upstream_limits_current(struct ff_upstream_host *entry);
+
+void ff_upstream_limits_queue_remove(struct ff_upstream_host *entry, struct ff_upstream_waiter *waiter);
+
+struct ff_upstream_host *ff_upstream_limits_find(struct ff_upstream_limits *limits, const char *name);
+
+/**
+ * Finds the host's entry, inserting one if missing and evicting idle hosts
+ * over capacity, and marks it most recently used
+ */
+struct ff_upstream_host *ff_upstream_limits_touch(struct ff_upstream_limits *limits, const char *name);
+
+/**
+ * Hosts with requests in flight or queued are kept
+ */
+bool ff_upstream_limits_evictable(struct ff_lru_table_entry *entry);
+
+void ff_upstream_limits_host_free(struct ff_lru_table_entry *entry);
+
+uint64_t ff_upstream_limits_usecs_since(struct timespec *start);
+
+#endif
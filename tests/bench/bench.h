@@ -0,0 +1,21 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+
+#ifndef FF_BENCH_H
+#define FF_BENCH_H
+
+static inline double ff_bench_now()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (double)now.tv_sec + (double)now.tv_nsec / 1e9;
+}
+
+static inline void ff_bench_report(const char *name, uint64_t operations, double seconds)
+{
+    printf("%-48s %10lu ops %10.3f s %12.2f us/op\n", name, operations, seconds, seconds * 1e6 / operations);
+}
+
+#endif
@@ -0,0 +1,141 @@
+#include <stdlib.h>
+#include <string.h>
+#include "bench.h"
+#include "../../src/crypto.h"
+#include "../../src/crypto_p.h"
+#include "../../src/pbkdf2.h"
+#include "../../src/alloc.h"
+
+#define FF_BENCH_PBKDF2_ROUNDS 2000
+#define FF_BENCH_DECRYPT_SETUP_ROUNDS 200000
+#define FF_BENCH_CIPHER_BYTES (64 * 1024 * 1024)
+
+void bench_pbkdf2()
+{
+    struct ff_encryption_config config = {.key = (uint8_t *)"testkey", .pbkdf2_iterations = 1000};
+    struct ff_derived_key *key = ff_derived_key_alloc(32);
+    uint8_t salt[16] = {0};
+    double start;
+
+    start = ff_bench_now();
+    for (uint32_t i = 0; i < FF_BENCH_PBKDF2_ROUNDS; i++)
+    {
+        // Unique salts so no round benefits from the previous one
+        memcpy(salt, &i, sizeof(i));
+        ff_derive_key_pbkdf2(&config, salt, sizeof(salt), key);
+    }
+    ff_bench_report("pbkdf2 openssl (1000 iterations)", FF_BENCH_PBKDF2_ROUNDS, ff_bench_now() - start);
+
+    config.pbkdf2 = ff_pbkdf2_hmac_sha256_init(config.key, strlen((char *)config.key));
+
+    start = ff_bench_now();
+    for (uint32_t i = 0; i < FF_BENCH_PBKDF2_ROUNDS; i++)
+    {
+        memcpy(salt, &i, sizeof(i));
+        ff_derive_key_pbkdf2(&config, salt, sizeof(salt), key);
+    }
+    ff_bench_report("pbkdf2 precomputed hmac (1000 iterations)", FF_BENCH_PBKDF2_ROUNDS, ff_bench_now() - start);
+
+    ff_pbkdf2_hmac_sha256_free(config.pbkdf2);
+    config.pbkdf2 = NULL;
+
+    start = ff_bench_now();
+    for (uint32_t i = 0; i < FF_BENCH_PBKDF2_ROUNDS; i++)
+    {
+        memcpy(salt, &i, sizeof(i));
+        ff_derive_key_hkdf(&config, salt, sizeof(salt), key);
+    }
+    ff_bench_report("hkdf-sha256", FF_BENCH_PBKDF2_ROUNDS, ff_bench_now() - start);
+
+    ff_derived_key_free(key);
+}
+
+void bench_decrypt_setup()
+{
+    uint8_t key[32] = {0};
+    uint8_t iv[12] = {0};
+    EVP_CIPHER_CTX *ctx = NULL;
+    double start;
+
+    // Previous per-request setup: new context and cipher lookup for every request
+    start = ff_bench_now();
+    for (uint32_t i = 0; i < FF_BENCH_DECRYPT_SETUP_ROUNDS; i++)
+    {
+        ctx = EVP_CIPHER_CTX_new();
+        EVP_DecryptInit_ex(ctx, EVP_aes_256_gcm(), NULL, NULL, NULL);
+        EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_SET_IVLEN, sizeof(iv), NULL);
+        EVP_DecryptInit_ex(ctx, NULL, NULL, key, iv);
+        EVP_CIPHER_CTX_free(ctx);
+    }
+    ff_bench_report("aes-256-gcm decrypt setup (new context)", FF_BENCH_DECRYPT_SETUP_ROUNDS, ff_bench_now() - start);
+
+    start = ff_bench_now();
+    for (uint32_t i = 0; i < FF_BENCH_DECRYPT_SETUP_ROUNDS; i++)
+    {
+        ctx = ff_crypto_cipher_ctx_acquire(FF_CRYPTO_MODE_AES_256_GCM);
+        EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_SET_IVLEN, sizeof(iv), NULL);
+        EVP_DecryptInit_ex(ctx, NULL, NULL, key, iv);
+        ff_crypto_cipher_ctx_release(FF_CRYPTO_MODE_AES_256_GCM, ctx);
+    }
+    ff_bench_report("aes-256-gcm decrypt setup (pooled context)", FF_BENCH_DECRYPT_SETUP_ROUNDS, ff_bench_now() - start);
+}
+
+void bench_cipher_mode(uint8_t encryption_mode, const char *name, uint32_t payload_length)
+{
+    uint8_t key[32] = {0};
+    uint8_t iv[12] = {0};
+    uint8_t tag[16];
+    uint8_t *payload = calloc(1, payload_length);
+    uint32_t rounds = FF_BENCH_CIPHER_BYTES / payload_length;
+    char label[64];
+    EVP_CIPHER_CTX *ctx = EVP_CIPHER_CTX_new();
+    int len;
+    double start;
+
+    // Client side: one context re-initialised with the cipher for each request, ff_client_encrypt_request
+    // also allocates a fresh context per request which isn't measured here
+    start = ff_bench_now();
+    for (uint32_t i = 0; i < rounds; i++)
+    {
+        EVP_EncryptInit_ex(ctx, ff_crypto_cipher_for_mode(encryption_mode), NULL, NULL, NULL);
+        EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_AEAD_SET_IVLEN, sizeof(iv), NULL);
+        EVP_EncryptInit_ex(ctx, NULL, NULL, key, iv);
+        EVP_EncryptUpdate(ctx, payload, &len, payload, payload_length);
+        EVP_EncryptFinal_ex(ctx, payload, &len);
+        EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_AEAD_GET_TAG, sizeof(tag), tag);
+    }
+    snprintf(label, sizeof(label), "%s encrypt (%u bytes)", name, payload_length);
+    ff_bench_report(label, rounds, ff_bench_now() - start);
+
+    EVP_CIPHER_CTX_free(ctx);
+
+    // Server side: pooled context, in place decrypt with tag verification. The
+    // payload is not restored between rounds so verification fails after the
+    // first, which costs the same as a successful check.
+    start = ff_bench_now();
+    for (uint32_t i = 0; i < rounds; i++)
+    {
+        ctx = ff_crypto_cipher_ctx_acquire(encryption_mode);
+        EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_AEAD_SET_IVLEN, sizeof(iv), NULL);
+        EVP_DecryptInit_ex(ctx, NULL, NULL, key, iv);
+        EVP_DecryptUpdate(ctx, payload, &len, payload, payload_length);
+        EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_AEAD_SET_TAG, sizeof(tag), tag);
+        EVP_DecryptFinal_ex(ctx, tag, &len);
+        ff_crypto_cipher_ctx_release(encryption_mode, ctx);
+    }
+    snprintf(label, sizeof(label), "%s decrypt (%u bytes)", name, payload_length);
+    ff_bench_report(label, rounds, ff_bench_now() - start);
+
+    FREE(payload);
+}
+
+void bench_cipher_modes()
+{
+    uint32_t payload_lengths[] = {64, 1024, 16 * 1024, 1024 * 1024};
+
+    for (size_t i = 0; i < sizeof(payload_lengths) / sizeof(payload_lengths[0]); i++)
+    {
+        bench_cipher_mode(FF_CRYPTO_MODE_AES_256_GCM, "aes-256-gcm", payload_lengths[i]);
+        bench_cipher_mode(FF_CRYPTO_MODE_CHACHA20_POLY1305, "chacha20-poly1305", payload_lengths[i]);
+    }
+}
@@ -0,0 +1,15 @@
+#include "../../src/crypto.h"
+#include "../../src/logging.h"
+#include "bench_crypto.c"
+
+int main(void)
+{
+    ff_set_logging_level(FF_ERROR);
+    ff_init_openssl();
+
+    bench_pbkdf2();
+    bench_decrypt_setup();
+    bench_cipher_modes();
+
+    return 0;
+}
@@ -255,7 +255,7 @@ void test_client_make_request_http_and_encrypted()
     fwrite(contents, sizeof(contents[0]), sizeof(contents) - 1, fd);
     fseek(fd, 0, SEEK_SET);
 
-    struct ff_client_config *config = malloc(sizeof(struct ff_client_config));
+    struct ff_client_config *config = calloc(1, sizeof(struct ff_client_config));
     config->https = true;
     config->encryption.key = (uint8_t *)"test key";
     config->encryption.pbkdf2_iterations = 1000;
@@ -151,6 +151,64 @@ void test_client_parse_args_make_request_https()
     TEST_ASSERT_EQUAL_MESSAGE(true, config.https, "https check failed");
 }
 
+void test_client_parse_args_make_request_key_derive_mode()
+{
+    struct ff_client_config config;
+    enum ff_client_action action;
+    char *args[] = {"ff_client", "--port", "8080", "--pre-shared-key", "abc123", "--key-derive-mode", "hkdf"};
+
+    action = ff_client_parse_arguments(&config, sizeof(args) / sizeof(args[0]), args);
+
+    TEST_ASSERT_EQUAL_MESSAGE(FF_CLIENT_ACTION_MAKE_REQUEST, action, "action check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(FF_KEY_DERIVE_MODE_HKDF, config.encryption.key_derivation_mode, "key derive mode check failed");
+}
+
+void test_client_parse_args_invalid_key_derive_mode()
+{
+    struct ff_client_config config;
+    enum ff_client_action action;
+    char *args[] = {"ff_client", "--port", "8080", "--key-derive-mode", "scrypt"};
+
+    action = ff_client_parse_arguments(&config, sizeof(args) / sizeof(args[0]), args);
+
+    TEST_ASSERT_EQUAL_MESSAGE(FF_CLIENT_ACTION_INVALID_ARGS, action, "action check failed");
+}
+
+void test_client_parse_args_make_request_encryption_mode()
+{
+    struct ff_client_config config;
+    enum ff_client_action action;
+    char *args[] = {"ff_client", "--port", "8080", "--pre-shared-key", "abc123", "--encryption-mode", "chacha20-poly1305"};
+
+    action = ff_client_parse_arguments(&config, sizeof(args) / sizeof(args[0]), args);
+
+    TEST_ASSERT_EQUAL_MESSAGE(FF_CLIENT_ACTION_MAKE_REQUEST, action, "action check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(FF_CRYPTO_MODE_CHACHA20_POLY1305, config.encryption.encryption_mode, "encryption mode check failed");
+}
+
+void test_client_parse_args_invalid_encryption_mode()
+{
+    struct ff_client_config config;
+    enum ff_client_action action;
+    char *args[] = {"ff_client", "--port", "8080", "--encryption-mode", "aes-128-cbc"};
+
+    action = ff_client_parse_arguments(&config, sizeof(args) / sizeof(args[0]), args);
+
+    TEST_ASSERT_EQUAL_MESSAGE(FF_CLIENT_ACTION_INVALID_ARGS, action, "action check failed");
+}
+
+void test_client_parse_args_make_request_key_id()
+{
+    struct ff_client_config config;
+    enum ff_client_action action;
+    char *args[] = {"ff_client", "--port", "8080", "--pre-shared-key", "abc123", "--key-id", "513"};
+
+    action = ff_client_parse_arguments(&config, sizeof(args) / sizeof(args[0]), args);
+
+    TEST_ASSERT_EQUAL_MESSAGE(FF_CLIENT_ACTION_MAKE_REQUEST, action, "action check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(513, config.encryption.key_id, "key id check failed");
+}
+
 void test_client_print_usage()
 {
     ff_print_usage(stdout);
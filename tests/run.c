@@ -4,10 +4,34 @@
 #include "server/test_parser.c"
 #include "server/test_hash_table.c"
 #include "server/test_crypto.c"
+#include "server/test_http_support.c"
 #include "server/test_http.c"
 #include "server/test_config.c"
 #include "server/test_logging.c"
 #include "server/test_server.c"
+#include "server/test_stats.c"
+#include "server/test_request_budget.c"
+#include "server/test_key_cache.c"
+#include "server/test_crypto_pool.c"
+#include "server/test_keyring.c"
+#include "server/test_siphash.c"
+#include "server/test_lru_table.c"
+#include "server/test_replay_filter.c"
+#include "server/test_tls_session_cache.c"
+#include "server/test_http_response.c"
+#include "server/test_connection_pool.c"
+#include "server/test_dns.c"
+#include "server/test_dns_cache.c"
+#include "server/test_event_loop.c"
+#include "server/test_dns_async.c"
+#include "server/test_http_completion.c"
+#include "server/test_http_engine.c"
+#include "server/test_tcp_fastopen.c"
+#include "server/test_http_early_data.c"
+#include "server/test_happy_eyeballs.c"
+#include "server/test_http2.c"
+#include "server/test_upstream_limits.c"
+#include "server/test_pbkdf2.c"
 #include "client/test_config.c"
 #include "client/test_crypto.c"
 #include "client/test_client.c"
@@ -67,6 +91,10 @@ int main(void)
     RUN_TEST(test_hash_table_iterator_init_empty);
     RUN_TEST(test_hash_table_iterator_init_with_item);
     RUN_TEST(test_hash_table_iterator_next);
+    RUN_TEST(test_hash_table_snapshot_next);
+    RUN_TEST(test_hash_table_snapshot_does_not_block_writers);
+    RUN_TEST(test_hash_table_snapshot_remove_last_item);
+    RUN_TEST(test_hash_table_snapshot_retire_value);
 
     RUN_TEST(test_request_decrypt_with_unencrypted_request_with_key);
     RUN_TEST(test_request_decrypt_without_key);
@@ -75,6 +103,18 @@ int main(void)
     RUN_TEST(test_request_decrypt_without_tag);
     RUN_TEST(test_request_decrypt_valid);
     RUN_TEST(test_request_decrypt_invalid);
+    // Decrypt again with the context left over from the failed tag check
+    RUN_TEST(test_request_decrypt_valid);
+    RUN_TEST(test_crypto_cipher_ctx_reused);
+    RUN_TEST(test_request_decrypt_incremental);
+    RUN_TEST(test_request_decrypt_incremental_invalid_tag);
+    RUN_TEST(test_request_decrypt_incremental_requires_cached_key);
+    RUN_TEST(test_derive_key_hkdf);
+    RUN_TEST(test_request_encrypt_and_decrypt_hkdf);
+    RUN_TEST(test_request_decrypt_disallowed_key_derivation_mode);
+    RUN_TEST(test_request_decrypt_incremental_hkdf_without_cache);
+    RUN_TEST(test_request_encrypt_and_decrypt_chacha20_poly1305);
+    RUN_TEST(test_request_decrypt_chacha20_poly1305_invalid_tag);
 
     RUN_TEST(test_http_get_host_valid_request);
     RUN_TEST(test_http_get_host_valid_request_with_carriage);
@@ -86,9 +126,14 @@ int main(void)
     RUN_TEST(test_http_unencrypted_google);
     RUN_TEST(test_http_unencrypted_google_connection_keep_alive);
     RUN_TEST(test_http_unencrypted_invalid_host);
+    RUN_TEST(test_http_unencrypted_pooled_connection_closed);
     RUN_TEST(test_http_tls_google);
     RUN_TEST(test_http_tls_google_connection_keep_alive);
+    RUN_TEST(test_http_tls_pooled_connection_closed);
     RUN_TEST(test_http_tls_invalid_host);
+    RUN_TEST(test_http_tls_context_shared);
+    RUN_TEST(test_http_tls_init_invalid_ca_bundle);
+    RUN_TEST(test_http_tls_reload_keeps_acquired_context);
 
     RUN_TEST(test_parse_args_empty);
     RUN_TEST(test_parse_args_help);
@@ -102,6 +147,26 @@ int main(void)
     RUN_TEST(test_parse_args_start_proxy_psk);
     RUN_TEST(test_parse_args_start_proxy_psk_pbkdf2_iterations);
     RUN_TEST(test_parse_args_start_proxy_timestamp_fudge_factor);
+    RUN_TEST(test_parse_args_start_proxy_partial_budget);
+    RUN_TEST(test_parse_args_start_proxy_key_cache_size);
+    RUN_TEST(test_parse_args_start_proxy_key_derive_modes);
+    RUN_TEST(test_parse_args_start_proxy_invalid_key_derive_modes);
+    RUN_TEST(test_parse_key_derivation_modes);
+    RUN_TEST(test_parse_args_start_proxy_crypto_workers);
+    RUN_TEST(test_parse_args_start_proxy_keyring);
+    RUN_TEST(test_parse_args_start_proxy_replay_filter_capacity);
+    RUN_TEST(test_parse_args_start_proxy_ca_bundle);
+    RUN_TEST(test_parse_args_start_proxy_tls_session_cache);
+    RUN_TEST(test_parse_args_start_proxy_upstream_connections);
+    RUN_TEST(test_parse_args_start_proxy_dns_cache);
+    RUN_TEST(test_parse_args_start_proxy_upstream_completion);
+    RUN_TEST(test_parse_args_start_proxy_upstream_engine_threads);
+    RUN_TEST(test_parse_args_start_proxy_upstream_tcp_fastopen);
+    RUN_TEST(test_parse_args_start_proxy_upstream_early_data);
+    RUN_TEST(test_parse_args_start_proxy_happy_eyeballs_delay);
+    RUN_TEST(test_parse_args_start_proxy_upstream_http2);
+    RUN_TEST(test_parse_args_start_proxy_upstream_limits);
+    RUN_TEST(test_parse_args_start_proxy_invalid_partial_eviction_policy);
     RUN_TEST(test_print_usage);
     RUN_TEST(test_print_version);
 
@@ -116,6 +181,11 @@ int main(void)
     RUN_TEST(test_client_parse_args_make_request_debug);
     RUN_TEST(test_client_parse_args_make_request_psk);
     RUN_TEST(test_client_parse_args_make_request_https);
+    RUN_TEST(test_client_parse_args_make_request_key_derive_mode);
+    RUN_TEST(test_client_parse_args_invalid_key_derive_mode);
+    RUN_TEST(test_client_parse_args_make_request_encryption_mode);
+    RUN_TEST(test_client_parse_args_invalid_encryption_mode);
+    RUN_TEST(test_client_parse_args_make_request_key_id);
     RUN_TEST(test_client_print_usage);
     RUN_TEST(test_client_print_version);
 
@@ -136,6 +206,149 @@ int main(void)
     RUN_TEST(test_validate_request_timestamp_valid);
     RUN_TEST(test_validate_request_timestamp_invalid);
 
+    RUN_TEST(test_stats_print);
+
+    RUN_TEST(test_request_budget_admit_and_release);
+    RUN_TEST(test_request_budget_refuse_when_exhausted);
+    RUN_TEST(test_request_budget_evict_lru);
+    RUN_TEST(test_request_budget_evict_largest);
+    RUN_TEST(test_request_budget_source_quota);
+    RUN_TEST(test_request_budget_source_ipv6);
+    RUN_TEST(test_request_budget_expire_and_collect);
+
+    RUN_TEST(test_key_cache_hit_and_miss);
+    RUN_TEST(test_key_cache_evicts_least_recently_used);
+    RUN_TEST(test_key_cache_failed_derivation_not_cached);
+    RUN_TEST(test_key_cache_single_flight);
+
+    RUN_TEST(test_crypto_pool_decrypts_batches);
+    RUN_TEST(test_crypto_pool_take_batch_limits_size);
+    RUN_TEST(test_crypto_pool_pin_worker_allowed_cpus);
+
+    RUN_TEST(test_keyring_load);
+    RUN_TEST(test_keyring_load_invalid);
+    RUN_TEST(test_keyring_reload_keeps_acquired_keys);
+    RUN_TEST(test_keyring_decrypt_request_by_key_id);
+
+    RUN_TEST(test_siphash_reference_vectors);
+    RUN_TEST(test_siphash_incremental_updates);
+
+    RUN_TEST(test_fnv_reference_vectors);
+    RUN_TEST(test_lru_table_evicts_least_recently_used);
+    RUN_TEST(test_lru_table_keeps_unevictable_entries);
+
+    RUN_TEST(test_replay_filter_insert_and_seen);
+    RUN_TEST(test_replay_filter_rotation);
+    RUN_TEST(test_replay_filter_false_positive_rate);
+    RUN_TEST(test_replay_filter_rejects_replayed_request);
+
+    RUN_TEST(test_tls_session_cache_put_and_get);
+    RUN_TEST(test_tls_session_cache_tls13_tickets_used_once);
+    RUN_TEST(test_tls_session_cache_expiry);
+    RUN_TEST(test_tls_session_cache_evicts_least_recently_used);
+    RUN_TEST(test_tls_session_cache_handshake_stats);
+
+    RUN_TEST(test_http_response_content_length);
+    RUN_TEST(test_http_response_chunked);
+    RUN_TEST(test_http_response_without_body);
+    RUN_TEST(test_http_response_interim_response);
+    RUN_TEST(test_http_response_not_reusable);
+    RUN_TEST(test_http_response_invalid);
+    RUN_TEST(test_http_response_frame);
+    RUN_TEST(test_http_request_keep_alive);
+    RUN_TEST(test_http_request_is_safe);
+    RUN_TEST(test_http_request_is_idempotent);
+    RUN_TEST(test_http_reader_closed);
+    RUN_TEST(test_http_response_reusable);
+
+    RUN_TEST(test_connection_pool_acquire_and_release);
+    RUN_TEST(test_connection_pool_discards_closed_connections);
+    RUN_TEST(test_connection_pool_limits);
+    RUN_TEST(test_connection_pool_evict_idle);
+    RUN_TEST(test_connection_pool_flush);
+
+    RUN_TEST(test_dns_query_encode);
+    RUN_TEST(test_dns_response_parse);
+    RUN_TEST(test_dns_response_parse_negative);
+    RUN_TEST(test_dns_read_name_compression_loop);
+    RUN_TEST(test_dns_parse_server);
+    RUN_TEST(test_dns_resolve_literal_and_hosts);
+    RUN_TEST(test_dns_resolve);
+    RUN_TEST(test_dns_read_resolv_conf);
+
+    RUN_TEST(test_dns_cache_hit);
+    RUN_TEST(test_dns_cache_negative);
+    RUN_TEST(test_dns_cache_stale_while_refreshing);
+    RUN_TEST(test_dns_cache_evicts_least_recently_used);
+    RUN_TEST(test_dns_cache_prefetch);
+    RUN_TEST(test_dns_cache_lookup_async);
+
+    RUN_TEST(test_event_loop_timers);
+    RUN_TEST(test_event_loop_watch_and_unwatch);
+    RUN_TEST(test_event_loop_post_from_threads);
+
+    RUN_TEST(test_dns_async_resolve);
+    RUN_TEST(test_dns_async_coalesces_lookups);
+    RUN_TEST(test_dns_async_tcp_fallback);
+    RUN_TEST(test_dns_async_retries_next_server);
+    RUN_TEST(test_dns_async_free_fails_lookups);
+
+    RUN_TEST(test_http_completion_policy_names);
+    RUN_TEST(test_http_completion_print_stats);
+    RUN_TEST(test_http_completion_wait_acked);
+    RUN_TEST(test_http_completion_wait_acked_reset);
+    RUN_TEST(test_http_completion_drainer);
+    RUN_TEST(test_http_completion_drainer_free_closes_drains);
+
+    RUN_TEST(test_http_engine_forwards_requests);
+    RUN_TEST(test_http_engine_connection_refused);
+    RUN_TEST(test_http_engine_resolves_with_dns_cache);
+    RUN_TEST(test_http_engine_completion_policies);
+    RUN_TEST(test_http_engine_free_fails_forwards);
+    RUN_TEST(test_http_engine_pooled_connection_closed);
+
+    RUN_TEST(test_tcp_fastopen_enable);
+    RUN_TEST(test_tcp_fastopen_record_fallbacks);
+    RUN_TEST(test_tcp_fastopen_record_failed_connection);
+    RUN_TEST(test_tcp_fastopen_record_reset_connection);
+    RUN_TEST(test_tcp_fastopen_evicts_least_recently_used);
+    RUN_TEST(test_tcp_fastopen_engine_forwards_requests);
+
+    RUN_TEST(test_http_early_data_allowed);
+    RUN_TEST(test_http_early_data_engine_accepted);
+    RUN_TEST(test_http_early_data_engine_rejected);
+    RUN_TEST(test_http_early_data_send_request_accepted);
+    RUN_TEST(test_http_early_data_send_request_rejected);
+
+    RUN_TEST(test_happy_eyeballs_sort);
+    RUN_TEST(test_happy_eyeballs_evicts_least_recently_used);
+    RUN_TEST(test_happy_eyeballs_connect_races_addresses);
+    RUN_TEST(test_happy_eyeballs_connect_fails);
+    RUN_TEST(test_happy_eyeballs_engine_races_addresses);
+
+    RUN_TEST(test_http2_request_convert);
+    RUN_TEST(test_http2_response_status);
+    RUN_TEST(test_http2_engine_multiplexes_streams);
+    RUN_TEST(test_http2_engine_flow_control);
+    RUN_TEST(test_http2_engine_stop_fails_streams);
+    RUN_TEST(test_http2_engine_falls_back_to_http1);
+    RUN_TEST(test_http2_engine_stream_ids_exhausted);
+    RUN_TEST(test_http2_engine_stream_window_overflow);
+
+    RUN_TEST(test_upstream_limits_acquire_and_release);
+    RUN_TEST(test_upstream_limits_cancel);
+    RUN_TEST(test_upstream_limits_wait);
+    RUN_TEST(test_upstream_limits_adaptive);
+    RUN_TEST(test_upstream_limits_evicts_idle_hosts);
+    RUN_TEST(test_upstream_limits_engine_queues_requests);
+    RUN_TEST(test_upstream_limits_engine_queue_timeout);
+    RUN_TEST(test_upstream_limits_engine_free_fails_queued);
+
+    RUN_TEST(test_pbkdf2_hmac_sha256_derive);
+    RUN_TEST(test_pbkdf2_hmac_sha256_derive_multiple_blocks);
+    RUN_TEST(test_pbkdf2_hmac_sha256_derive_long_key);
+    RUN_TEST(test_pbkdf2_hmac_sha256_rfc7914_vector);
+
     RUN_TEST(test_log_debug);
     return UNITY_END();
 }
\ No newline at end of file
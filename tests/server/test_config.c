@@ -159,6 +159,377 @@ void test_parse_args_start_proxy_timestamp_fudge_factor()
     TEST_ASSERT_EQUAL_MESSAGE(10, config.timestamp_fudge_factor, "timestamp fudge factor check failed");
 }
 
+void test_parse_args_start_proxy_partial_budget()
+{
+    struct ff_config config;
+    enum ff_action action;
+    char *args[] = {"ff", "--port", "8080", "--max-partial-bytes", "1048576", "--max-partials-per-source", "8",
+                    "--partial-eviction-policy", "largest", "--stats-interval", "15"};
+
+    action = ff_parse_arguments(&config, sizeof(args) / sizeof(args[0]), args);
+
+    TEST_ASSERT_EQUAL_MESSAGE(FF_ACTION_START_PROXY, action, "action check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(1048576, config.max_partial_bytes, "max partial bytes check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(8, config.max_partials_per_source, "max partials per source check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(FF_REQUEST_BUDGET_POLICY_EVICT_LARGEST, config.partial_eviction_policy, "eviction policy check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(15, config.stats_interval, "stats interval check failed");
+}
+
+void test_parse_args_start_proxy_key_cache_size()
+{
+    struct ff_config config;
+    enum ff_action action;
+    char *args[] = {"ff", "--port", "8080", "--key-cache-size", "0"};
+
+    action = ff_parse_arguments(&config, sizeof(args) / sizeof(args[0]), args);
+
+    TEST_ASSERT_EQUAL_MESSAGE(FF_ACTION_START_PROXY, action, "action check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(0, config.key_cache_size, "key cache size check failed");
+}
+
+void test_parse_args_start_proxy_key_derive_modes()
+{
+    struct ff_config config;
+    enum ff_action action;
+    char *args[] = {"ff", "--port", "8080", "--key-derive-modes", "hkdf"};
+
+    action = ff_parse_arguments(&config, sizeof(args) / sizeof(args[0]), args);
+
+    TEST_ASSERT_EQUAL_MESSAGE(FF_ACTION_START_PROXY, action, "action check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(FF_KEY_DERIVE_MODE_FLAG(FF_KEY_DERIVE_MODE_HKDF), config.encryption.allowed_key_derivation_modes, "key derive modes check failed");
+}
+
+void test_parse_args_start_proxy_invalid_key_derive_modes()
+{
+    struct ff_config config;
+    enum ff_action action;
+    char *args[] = {"ff", "--port", "8080", "--key-derive-modes", "pbkdf2,scrypt"};
+
+    action = ff_parse_arguments(&config, sizeof(args) / sizeof(args[0]), args);
+
+    TEST_ASSERT_EQUAL_MESSAGE(FF_ACTION_INVALID_ARGS, action, "action check failed");
+}
+
+void test_parse_key_derivation_modes()
+{
+    uint32_t modes;
+
+    TEST_ASSERT_EQUAL_MESSAGE(true, ff_parse_key_derivation_modes("pbkdf2,HKDF", &modes), "return (1) check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(FF_KEY_DERIVE_MODES_ALL, modes, "modes check failed");
+
+    TEST_ASSERT_EQUAL_MESSAGE(false, ff_parse_key_derivation_modes("", &modes), "return (2) check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(false, ff_parse_key_derivation_modes("pbkdf", &modes), "return (3) check failed");
+}
+
+void test_parse_args_start_proxy_crypto_workers()
+{
+    struct ff_config config;
+    enum ff_action action;
+    char *args[] = {"ff", "--port", "8080", "--crypto-workers", "4", "--crypto-batch-size", "32"};
+
+    action = ff_parse_arguments(&config, sizeof(args) / sizeof(args[0]), args);
+
+    TEST_ASSERT_EQUAL_MESSAGE(FF_ACTION_START_PROXY, action, "action check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(4, config.crypto_workers, "crypto workers check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(32, config.crypto_batch_size, "crypto batch size check failed");
+}
+
+void test_parse_args_start_proxy_keyring()
+{
+    struct ff_config config;
+    enum ff_action action;
+    char *args[] = {"ff", "--port", "8080", "--keyring", "/etc/ff/keyring"};
+
+    action = ff_parse_arguments(&config, sizeof(args) / sizeof(args[0]), args);
+
+    TEST_ASSERT_EQUAL_MESSAGE(FF_ACTION_START_PROXY, action, "action check failed");
+    TEST_ASSERT_EQUAL_STRING_MESSAGE("/etc/ff/keyring", config.keyring_path, "keyring path check failed");
+}
+
+void test_parse_args_start_proxy_replay_filter_capacity()
+{
+    struct ff_config config;
+    enum ff_action action;
+    char *args[] = {"ff", "--port", "8080", "--replay-filter-capacity", "0"};
+    char *default_args[] = {"ff", "--port", "8080"};
+    char *invalid_args[] = {"ff", "--port", "8080", "--replay-filter-capacity", "-1"};
+
+    action = ff_parse_arguments(&config, sizeof(default_args) / sizeof(default_args[0]), default_args);
+
+    TEST_ASSERT_EQUAL_MESSAGE(FF_ACTION_START_PROXY, action, "action check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(65536, config.replay_filter_capacity, "default capacity check failed");
+
+    action = ff_parse_arguments(&config, sizeof(args) / sizeof(args[0]), args);
+
+    TEST_ASSERT_EQUAL_MESSAGE(FF_ACTION_START_PROXY, action, "action check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(0, config.replay_filter_capacity, "capacity check failed");
+
+    action = ff_parse_arguments(&config, sizeof(invalid_args) / sizeof(invalid_args[0]), invalid_args);
+
+    TEST_ASSERT_EQUAL_MESSAGE(FF_ACTION_INVALID_ARGS, action, "invalid action check failed");
+}
+
+void test_parse_args_start_proxy_ca_bundle()
+{
+    struct ff_config config;
+    enum ff_action action;
+    char *args[] = {"ff", "--port", "8080", "--ca-bundle", "/etc/ssl/certs/ca-certificates.crt"};
+
+    action = ff_parse_arguments(&config, sizeof(args) / sizeof(args[0]), args);
+
+    TEST_ASSERT_EQUAL_MESSAGE(FF_ACTION_START_PROXY, action, "action check failed");
+    TEST_ASSERT_EQUAL_STRING_MESSAGE("/etc/ssl/certs/ca-certificates.crt", config.ca_bundle_path, "ca bundle check failed");
+}
+
+void test_parse_args_start_proxy_tls_session_cache()
+{
+    struct ff_config config;
+    enum ff_action action;
+    char *args[] = {"ff", "--port", "8080", "--tls-session-cache-size", "0", "--tls-session-max-age", "600"};
+    char *invalid_args[] = {"ff", "--port", "8080", "--tls-session-max-age", "0"};
+
+    action = ff_parse_arguments(&config, sizeof(args) / sizeof(args[0]), args);
+
+    TEST_ASSERT_EQUAL_MESSAGE(FF_ACTION_START_PROXY, action, "action check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(0, config.tls_session_cache_size, "cache size check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(600, config.tls_session_max_age, "max age check failed");
+
+    action = ff_parse_arguments(&config, sizeof(invalid_args) / sizeof(invalid_args[0]), invalid_args);
+
+    TEST_ASSERT_EQUAL_MESSAGE(FF_ACTION_INVALID_ARGS, action, "invalid action check failed");
+}
+
+void test_parse_args_start_proxy_upstream_connections()
+{
+    struct ff_config config;
+    enum ff_action action;
+    char *args[] = {"ff", "--port", "8080", "--upstream-max-idle", "0", "--upstream-idle-timeout", "5", "--upstream-max-requests", "0"};
+    char *default_args[] = {"ff", "--port", "8080"};
+    char *invalid_args[] = {"ff", "--port", "8080", "--upstream-idle-timeout", "0"};
+
+    action = ff_parse_arguments(&config, sizeof(args) / sizeof(args[0]), args);
+
+    TEST_ASSERT_EQUAL_MESSAGE(FF_ACTION_START_PROXY, action, "action check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(0, config.upstream_max_idle, "max idle check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(5, config.upstream_idle_timeout, "idle timeout check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(0, config.upstream_max_requests, "max requests check failed");
+
+    action = ff_parse_arguments(&config, sizeof(default_args) / sizeof(default_args[0]), default_args);
+
+    TEST_ASSERT_EQUAL_MESSAGE(FF_ACTION_START_PROXY, action, "default action check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(4, config.upstream_max_idle, "default max idle check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(30, config.upstream_idle_timeout, "default idle timeout check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(1000, config.upstream_max_requests, "default max requests check failed");
+
+    action = ff_parse_arguments(&config, sizeof(invalid_args) / sizeof(invalid_args[0]), invalid_args);
+
+    TEST_ASSERT_EQUAL_MESSAGE(FF_ACTION_INVALID_ARGS, action, "invalid action check failed");
+}
+
+void test_parse_args_start_proxy_dns_cache()
+{
+    struct ff_config config;
+    enum ff_action action;
+    char *args[] = {"ff", "--port", "8080", "--dns-cache-size", "64", "--dns-server", "10.0.0.53:5353", "--dns-max-stale", "0", "--dns-prefetch", "a.example,b.example"};
+    char *default_args[] = {"ff", "--port", "8080"};
+    char *invalid_args[] = {"ff", "--port", "8080", "--dns-cache-size", "-1"};
+
+    action = ff_parse_arguments(&config, sizeof(args) / sizeof(args[0]), args);
+
+    TEST_ASSERT_EQUAL_MESSAGE(FF_ACTION_START_PROXY, action, "action check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(64, config.dns_cache_size, "cache size check failed");
+    TEST_ASSERT_EQUAL_STRING_MESSAGE("10.0.0.53:5353", config.dns_server, "server check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(0, config.dns_max_stale, "max stale check failed");
+    TEST_ASSERT_EQUAL_STRING_MESSAGE("a.example,b.example", config.dns_prefetch, "prefetch check failed");
+
+    action = ff_parse_arguments(&config, sizeof(default_args) / sizeof(default_args[0]), default_args);
+
+    TEST_ASSERT_EQUAL_MESSAGE(FF_ACTION_START_PROXY, action, "default action check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(1024, config.dns_cache_size, "default cache size check failed");
+    TEST_ASSERT_NULL_MESSAGE(config.dns_server, "default server check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(300, config.dns_max_stale, "default max stale check failed");
+    TEST_ASSERT_NULL_MESSAGE(config.dns_prefetch, "default prefetch check failed");
+
+    action = ff_parse_arguments(&config, sizeof(invalid_args) / sizeof(invalid_args[0]), invalid_args);
+
+    TEST_ASSERT_EQUAL_MESSAGE(FF_ACTION_INVALID_ARGS, action, "invalid action check failed");
+}
+
+void test_parse_args_start_proxy_upstream_completion()
+{
+    struct ff_config config;
+    enum ff_action action;
+    char *args[] = {"ff", "--port", "8080", "--upstream-completion", "drain", "--upstream-completion-timeout", "250"};
+    char *default_args[] = {"ff", "--port", "8080"};
+    char *invalid_args[] = {"ff", "--port", "8080", "--upstream-completion", "never"};
+    char *invalid_timeout_args[] = {"ff", "--port", "8080", "--upstream-completion-timeout", "0"};
+
+    action = ff_parse_arguments(&config, sizeof(args) / sizeof(args[0]), args);
+
+    TEST_ASSERT_EQUAL_MESSAGE(FF_ACTION_START_PROXY, action, "action check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(FF_HTTP_COMPLETION_DRAIN, config.upstream_completion, "completion check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(250, config.upstream_completion_timeout, "timeout check failed");
+
+    action = ff_parse_arguments(&config, sizeof(default_args) / sizeof(default_args[0]), default_args);
+
+    TEST_ASSERT_EQUAL_MESSAGE(FF_ACTION_START_PROXY, action, "default action check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(FF_HTTP_COMPLETION_RESPONSE, config.upstream_completion, "default completion check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(1000, config.upstream_completion_timeout, "default timeout check failed");
+
+    action = ff_parse_arguments(&config, sizeof(invalid_args) / sizeof(invalid_args[0]), invalid_args);
+
+    TEST_ASSERT_EQUAL_MESSAGE(FF_ACTION_INVALID_ARGS, action, "invalid action check failed");
+
+    action = ff_parse_arguments(&config, sizeof(invalid_timeout_args) / sizeof(invalid_timeout_args[0]), invalid_timeout_args);
+
+    TEST_ASSERT_EQUAL_MESSAGE(FF_ACTION_INVALID_ARGS, action, "invalid timeout action check failed");
+}
+
+void test_parse_args_start_proxy_upstream_engine_threads()
+{
+    struct ff_config config;
+    enum ff_action action;
+    char *args[] = {"ff", "--port", "8080", "--upstream-engine-threads", "4"};
+    char *default_args[] = {"ff", "--port", "8080"};
+    char *invalid_args[] = {"ff", "--port", "8080", "--upstream-engine-threads", "1000"};
+
+    action = ff_parse_arguments(&config, sizeof(args) / sizeof(args[0]), args);
+
+    TEST_ASSERT_EQUAL_MESSAGE(FF_ACTION_START_PROXY, action, "action check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(4, config.upstream_engine_threads, "threads check failed");
+
+    action = ff_parse_arguments(&config, sizeof(default_args) / sizeof(default_args[0]), default_args);
+
+    TEST_ASSERT_EQUAL_MESSAGE(FF_ACTION_START_PROXY, action, "default action check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(0, config.upstream_engine_threads, "default threads check failed");
+
+    action = ff_parse_arguments(&config, sizeof(invalid_args) / sizeof(invalid_args[0]), invalid_args);
+
+    TEST_ASSERT_EQUAL_MESSAGE(FF_ACTION_INVALID_ARGS, action, "invalid action check failed");
+}
+
+void test_parse_args_start_proxy_upstream_tcp_fastopen()
+{
+    struct ff_config config;
+    enum ff_action action;
+    char *args[] = {"ff", "--port", "8080", "--upstream-tcp-fastopen", "128"};
+    char *default_args[] = {"ff", "--port", "8080"};
+    char *invalid_args[] = {"ff", "--port", "8080", "--upstream-tcp-fastopen", "some"};
+
+    action = ff_parse_arguments(&config, sizeof(args) / sizeof(args[0]), args);
+
+    TEST_ASSERT_EQUAL_MESSAGE(FF_ACTION_START_PROXY, action, "action check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(128, config.upstream_fastopen_size, "size check failed");
+
+    action = ff_parse_arguments(&config, sizeof(default_args) / sizeof(default_args[0]), default_args);
+
+    TEST_ASSERT_EQUAL_MESSAGE(FF_ACTION_START_PROXY, action, "default action check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(0, config.upstream_fastopen_size, "default size check failed");
+
+    action = ff_parse_arguments(&config, sizeof(invalid_args) / sizeof(invalid_args[0]), invalid_args);
+
+    TEST_ASSERT_EQUAL_MESSAGE(FF_ACTION_INVALID_ARGS, action, "invalid action check failed");
+}
+
+void test_parse_args_start_proxy_upstream_early_data()
+{
+    struct ff_config config;
+    enum ff_action action;
+    char *args[] = {"ff", "--port", "8080", "--upstream-early-data", "a.example,b.example"};
+    char *default_args[] = {"ff", "--port", "8080"};
+
+    action = ff_parse_arguments(&config, sizeof(args) / sizeof(args[0]), args);
+
+    TEST_ASSERT_EQUAL_MESSAGE(FF_ACTION_START_PROXY, action, "action check failed");
+    TEST_ASSERT_EQUAL_STRING_MESSAGE("a.example,b.example", config.upstream_early_data, "hosts check failed");
+
+    action = ff_parse_arguments(&config, sizeof(default_args) / sizeof(default_args[0]), default_args);
+
+    TEST_ASSERT_EQUAL_MESSAGE(FF_ACTION_START_PROXY, action, "default action check failed");
+    TEST_ASSERT_NULL_MESSAGE(config.upstream_early_data, "default hosts check failed");
+}
+
+void test_parse_args_start_proxy_happy_eyeballs_delay()
+{
+    struct ff_config config;
+    enum ff_action action;
+    char *args[] = {"ff", "--port", "8080", "--happy-eyeballs-delay", "100"};
+    char *default_args[] = {"ff", "--port", "8080"};
+    char *invalid_args[] = {"ff", "--port", "8080", "--happy-eyeballs-delay", "soon"};
+
+    action = ff_parse_arguments(&config, sizeof(args) / sizeof(args[0]), args);
+
+    TEST_ASSERT_EQUAL_MESSAGE(FF_ACTION_START_PROXY, action, "action check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(100, config.happy_eyeballs_delay, "delay check failed");
+
+    action = ff_parse_arguments(&config, sizeof(default_args) / sizeof(default_args[0]), default_args);
+
+    TEST_ASSERT_EQUAL_MESSAGE(FF_ACTION_START_PROXY, action, "default action check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(250, config.happy_eyeballs_delay, "default delay check failed");
+
+    action = ff_parse_arguments(&config, sizeof(invalid_args) / sizeof(invalid_args[0]), invalid_args);
+
+    TEST_ASSERT_EQUAL_MESSAGE(FF_ACTION_INVALID_ARGS, action, "invalid action check failed");
+}
+
+void test_parse_args_start_proxy_upstream_http2()
+{
+    struct ff_config config;
+    enum ff_action action;
+    char *args[] = {"ff", "--port", "8080", "--upstream-http2", "a.example,b.example"};
+    char *default_args[] = {"ff", "--port", "8080"};
+
+    action = ff_parse_arguments(&config, sizeof(args) / sizeof(args[0]), args);
+
+    TEST_ASSERT_EQUAL_MESSAGE(FF_ACTION_START_PROXY, action, "action check failed");
+    TEST_ASSERT_EQUAL_STRING_MESSAGE("a.example,b.example", config.upstream_http2, "hosts check failed");
+
+    action = ff_parse_arguments(&config, sizeof(default_args) / sizeof(default_args[0]), default_args);
+
+    TEST_ASSERT_EQUAL_MESSAGE(FF_ACTION_START_PROXY, action, "default action check failed");
+    TEST_ASSERT_NULL_MESSAGE(config.upstream_http2, "default hosts check failed");
+}
+
+void test_parse_args_start_proxy_upstream_limits()
+{
+    struct ff_config config;
+    enum ff_action action;
+    char *args[] = {"ff", "--port", "8080", "--upstream-max-in-flight", "8", "--upstream-queue-size", "16", "--upstream-queue-timeout", "500", "--upstream-adaptive-limit"};
+    char *default_args[] = {"ff", "--port", "8080"};
+    char *invalid_args[] = {"ff", "--port", "8080", "--upstream-max-in-flight", "many"};
+
+    action = ff_parse_arguments(&config, sizeof(args) / sizeof(args[0]), args);
+
+    TEST_ASSERT_EQUAL_MESSAGE(FF_ACTION_START_PROXY, action, "action check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(8, config.upstream_max_in_flight, "max in flight check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(16, config.upstream_queue_size, "queue size check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(500, config.upstream_queue_timeout, "queue timeout check failed");
+    TEST_ASSERT_TRUE_MESSAGE(config.upstream_adaptive_limit, "adaptive check failed");
+
+    action = ff_parse_arguments(&config, sizeof(default_args) / sizeof(default_args[0]), default_args);
+
+    TEST_ASSERT_EQUAL_MESSAGE(FF_ACTION_START_PROXY, action, "default action check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(0, config.upstream_max_in_flight, "default max in flight check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(64, config.upstream_queue_size, "default queue size check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(1000, config.upstream_queue_timeout, "default queue timeout check failed");
+    TEST_ASSERT_FALSE_MESSAGE(config.upstream_adaptive_limit, "default adaptive check failed");
+
+    action = ff_parse_arguments(&config, sizeof(invalid_args) / sizeof(invalid_args[0]), invalid_args);
+
+    TEST_ASSERT_EQUAL_MESSAGE(FF_ACTION_INVALID_ARGS, action, "invalid action check failed");
+}
+
+void test_parse_args_start_proxy_invalid_partial_eviction_policy()
+{
+    struct ff_config config;
+    enum ff_action action;
+    char *args[] = {"ff", "--port", "8080", "--partial-eviction-policy", "random"};
+
+    action = ff_parse_arguments(&config, sizeof(args) / sizeof(args[0]), args);
+
+    TEST_ASSERT_EQUAL_MESSAGE(FF_ACTION_INVALID_ARGS, action, "action check failed");
+}
+
 void test_print_usage()
 {
     ff_print_usage(stdout);
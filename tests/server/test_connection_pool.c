@@ -0,0 +1,182 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include "../include/unity.h"
+#include "../../src/connection_pool.h"
+#include "../../src/connection_pool_p.h"
+#include "../../src/stats.h"
+
+static uint32_t test_connection_pool_closed = 0;
+
+void test_connection_pool_close(int sockfd, void *context)
+{
+    (void)context;
+
+    close(sockfd);
+    test_connection_pool_closed++;
+}
+
+void test_connection_pool_acquire_and_release()
+{
+    struct ff_connection_pool *pool = ff_connection_pool_init(2, 30, 0, test_connection_pool_close);
+    int sockets[2];
+    int sockfd = -1;
+    void *context = NULL;
+    uint32_t requests = 0;
+    int marker = 0;
+
+    ff_stats_reset();
+    test_connection_pool_closed = 0;
+    socketpair(AF_UNIX, SOCK_STREAM, 0, sockets);
+
+    TEST_ASSERT_FALSE_MESSAGE(ff_connection_pool_acquire(pool, "10.0.0.1:80", &sockfd, &context, &requests), "empty check failed");
+
+    ff_connection_pool_release(pool, "10.0.0.1:80", sockets[0], &marker, 1);
+
+    TEST_ASSERT_EQUAL_MESSAGE(1, FF_STATS_GET(upstream_connections_idle), "idle stat check failed");
+    TEST_ASSERT_FALSE_MESSAGE(ff_connection_pool_acquire(pool, "10.0.0.2:80", &sockfd, &context, &requests), "other host check failed");
+    TEST_ASSERT_MESSAGE(ff_connection_pool_acquire(pool, "10.0.0.1:80", &sockfd, &context, &requests), "acquire check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(sockets[0], sockfd, "sockfd check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(&marker, context, "context check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(1, requests, "requests check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(0, FF_STATS_GET(upstream_connections_idle), "idle stat check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(1, FF_STATS_GET(upstream_connections_reused), "reused stat check failed");
+    TEST_ASSERT_FALSE_MESSAGE(ff_connection_pool_acquire(pool, "10.0.0.1:80", &sockfd, &context, &requests), "taken check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(0, test_connection_pool_closed, "closed check failed");
+
+    close(sockets[0]);
+    close(sockets[1]);
+    ff_connection_pool_free(pool);
+}
+
+void test_connection_pool_discards_closed_connections()
+{
+    struct ff_connection_pool *pool = ff_connection_pool_init(4, 30, 0, test_connection_pool_close);
+    int closed[2];
+    int unsolicited[2];
+    int sockfd = -1;
+    void *context = NULL;
+    uint32_t requests = 0;
+
+    ff_stats_reset();
+    test_connection_pool_closed = 0;
+    socketpair(AF_UNIX, SOCK_STREAM, 0, closed);
+    socketpair(AF_UNIX, SOCK_STREAM, 0, unsolicited);
+
+    ff_connection_pool_release(pool, "host", closed[0], NULL, 1);
+    ff_connection_pool_release(pool, "host", unsolicited[0], NULL, 1);
+
+    // The upstream closes one connection and writes to the other while they're idle
+    close(closed[1]);
+    TEST_ASSERT_EQUAL_MESSAGE(1, write(unsolicited[1], "x", 1), "write check failed");
+
+    TEST_ASSERT_FALSE_MESSAGE(ff_connection_pool_acquire(pool, "host", &sockfd, &context, &requests), "acquire check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(2, test_connection_pool_closed, "closed check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(0, FF_STATS_GET(upstream_connections_idle), "idle stat check failed");
+
+    close(unsolicited[1]);
+    ff_connection_pool_free(pool);
+}
+
+void test_connection_pool_limits()
+{
+    struct ff_connection_pool *pool = ff_connection_pool_init(1, 30, 3, test_connection_pool_close);
+    int first[2];
+    int second[2];
+    int third[2];
+    int sockfd = -1;
+    void *context = NULL;
+    uint32_t requests = 0;
+
+    ff_stats_reset();
+    test_connection_pool_closed = 0;
+    socketpair(AF_UNIX, SOCK_STREAM, 0, first);
+    socketpair(AF_UNIX, SOCK_STREAM, 0, second);
+    socketpair(AF_UNIX, SOCK_STREAM, 0, third);
+
+    ff_connection_pool_release(pool, "host", first[0], NULL, 1);
+    // Over the per host maximum
+    ff_connection_pool_release(pool, "host", second[0], NULL, 1);
+    TEST_ASSERT_EQUAL_MESSAGE(1, test_connection_pool_closed, "max idle check failed");
+
+    // Served its maximum requests
+    ff_connection_pool_release(pool, "other", third[0], NULL, 3);
+    TEST_ASSERT_EQUAL_MESSAGE(2, test_connection_pool_closed, "max requests check failed");
+    TEST_ASSERT_FALSE_MESSAGE(ff_connection_pool_acquire(pool, "other", &sockfd, &context, &requests), "max requests acquire check failed");
+
+    TEST_ASSERT_MESSAGE(ff_connection_pool_acquire(pool, "host", &sockfd, &context, &requests), "acquire check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(first[0], sockfd, "sockfd check failed");
+
+    close(first[0]);
+    close(first[1]);
+    close(second[1]);
+    close(third[1]);
+    ff_connection_pool_free(pool);
+}
+
+void test_connection_pool_evict_idle()
+{
+    struct ff_connection_pool *pool = ff_connection_pool_init(4, 30, 0, test_connection_pool_close);
+    struct ff_connection_pool_host *host = NULL;
+    int stale[2];
+    int fresh[2];
+    int sockfd = -1;
+    void *context = NULL;
+    uint32_t requests = 0;
+
+    ff_stats_reset();
+    test_connection_pool_closed = 0;
+    socketpair(AF_UNIX, SOCK_STREAM, 0, stale);
+    socketpair(AF_UNIX, SOCK_STREAM, 0, fresh);
+
+    ff_connection_pool_release(pool, "stale", stale[0], NULL, 1);
+    ff_connection_pool_release(pool, "fresh", fresh[0], NULL, 1);
+
+    host = ff_connection_pool_find(pool, ff_connection_pool_hash("stale"), "stale");
+    host->idle->idle_since -= 31;
+
+    ff_connection_pool_evict_idle(pool);
+
+    TEST_ASSERT_EQUAL_MESSAGE(1, test_connection_pool_closed, "closed check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(NULL, ff_connection_pool_find(pool, ff_connection_pool_hash("stale"), "stale"), "host removed check failed");
+    TEST_ASSERT_MESSAGE(ff_connection_pool_acquire(pool, "fresh", &sockfd, &context, &requests), "fresh check failed");
+
+    ff_connection_pool_release(pool, "fresh", sockfd, NULL, 2);
+    ff_connection_pool_free(pool);
+
+    TEST_ASSERT_EQUAL_MESSAGE(2, test_connection_pool_closed, "free check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(0, FF_STATS_GET(upstream_connections_idle), "idle stat check failed");
+
+    close(stale[1]);
+    close(fresh[1]);
+}
+
+void test_connection_pool_flush()
+{
+    struct ff_connection_pool *pool = ff_connection_pool_init(4, 30, 0, test_connection_pool_close);
+    int first[2];
+    int second[2];
+    int sockfd = -1;
+    void *context = NULL;
+    uint32_t requests = 0;
+
+    ff_stats_reset();
+    test_connection_pool_closed = 0;
+    socketpair(AF_UNIX, SOCK_STREAM, 0, first);
+    socketpair(AF_UNIX, SOCK_STREAM, 0, second);
+
+    ff_connection_pool_release(pool, "example.com:443", first[0], NULL, 1);
+    ff_connection_pool_release(pool, "example.org:443", second[0], NULL, 1);
+
+    ff_connection_pool_flush(pool);
+
+    TEST_ASSERT_EQUAL_MESSAGE(2, test_connection_pool_closed, "closed check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(0, FF_STATS_GET(upstream_connections_idle), "idle stat check failed");
+    TEST_ASSERT_FALSE_MESSAGE(ff_connection_pool_acquire(pool, "example.com:443", &sockfd, &context, &requests), "acquire check failed");
+
+    close(first[1]);
+    close(second[1]);
+    ff_connection_pool_free(pool);
+}
@@ -5,6 +5,8 @@
 #include "../../src/parser.h"
 #include "../../src/alloc.h"
 #include "../../src/crypto.h"
+#include "../../src/crypto_p.h"
+#include "../../src/key_cache.h"
 #include "../../client/c/crypto.h"
 
 void test_request_decrypt_with_unencrypted_request_with_key()
@@ -15,6 +17,8 @@ void test_request_decrypt_with_unencrypted_request_with_key()
     ff_decrypt_request(request, &key);
 
     TEST_ASSERT_EQUAL_MESSAGE(FF_REQUEST_STATE_DECRYPTING_FAILED, request->state, "state check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(NULL, request->payload, "payload discarded check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(0, request->payload_length, "payload length check failed");
 
     ff_request_free(request);
 }
@@ -54,6 +58,8 @@ void test_request_decrypt_with_unknown_encryption_mode()
     ff_decrypt_request(request, &key);
 
     TEST_ASSERT_EQUAL_MESSAGE(FF_REQUEST_STATE_DECRYPTING_FAILED, request->state, "state check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(NULL, request->payload, "payload discarded check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(0, request->payload_length, "payload length check failed");
 
     ff_request_free(request);
 }
@@ -79,6 +85,8 @@ void test_request_decrypt_without_iv()
     ff_decrypt_request(request, &key);
 
     TEST_ASSERT_EQUAL_MESSAGE(FF_REQUEST_STATE_DECRYPTING_FAILED, request->state, "state check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(NULL, request->payload, "payload discarded check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(0, request->payload_length, "payload length check failed");
 
     ff_request_free(request);
 }
@@ -104,6 +112,8 @@ void test_request_decrypt_without_tag()
     ff_decrypt_request(request, &key);
 
     TEST_ASSERT_EQUAL_MESSAGE(FF_REQUEST_STATE_DECRYPTING_FAILED, request->state, "state check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(NULL, request->payload, "payload discarded check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(0, request->payload_length, "payload length check failed");
 
     ff_request_free(request);
 }
@@ -157,10 +167,12 @@ void test_request_decrypt_valid()
     request->payload->length = sizeof(ciphertext) / sizeof(ciphertext[0]);
     request->payload->value = (uint8_t *)malloc(sizeof(ciphertext) / sizeof(ciphertext[0]));
     memcpy(request->payload->value, ciphertext, sizeof(ciphertext) / sizeof(ciphertext[0]));
+    uint8_t *payload_buff = request->payload->value;
 
     ff_decrypt_request(request, &config);
 
     TEST_ASSERT_EQUAL_MESSAGE(FF_REQUEST_STATE_DECRYPTED, request->state, "state check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(payload_buff, request->payload->value, "in place check failed");
     TEST_ASSERT_EQUAL_MESSAGE(11, request->payload_length, "payload length check failed");
     TEST_ASSERT_EQUAL_MESSAGE(0, request->payload->offset, "payload node offset check failed");
     TEST_ASSERT_EQUAL_MESSAGE(11, request->payload->length, "payload node length check failed");
@@ -208,6 +220,323 @@ void test_request_decrypt_invalid()
     ff_decrypt_request(request, &key);
 
     TEST_ASSERT_EQUAL_MESSAGE(FF_REQUEST_STATE_DECRYPTING_FAILED, request->state, "state check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(NULL, request->payload, "payload discarded check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(0, request->payload_length, "payload length check failed");
+
+    ff_request_free(request);
+}
+
+void test_crypto_cipher_ctx_reused()
+{
+    EVP_CIPHER_CTX *ctx_1 = ff_crypto_cipher_ctx_acquire(FF_CRYPTO_MODE_AES_256_GCM);
+    EVP_CIPHER_CTX *ctx_2 = NULL;
+
+    TEST_ASSERT_NOT_NULL_MESSAGE(ctx_1, "acquire (1) check failed");
+
+    ff_crypto_cipher_ctx_release(FF_CRYPTO_MODE_AES_256_GCM, ctx_1);
+    ctx_2 = ff_crypto_cipher_ctx_acquire(FF_CRYPTO_MODE_AES_256_GCM);
+
+    TEST_ASSERT_EQUAL_MESSAGE(ctx_1, ctx_2, "reuse check failed");
+
+    ff_crypto_cipher_ctx_release(FF_CRYPTO_MODE_AES_256_GCM, ctx_2);
+
+    // Contexts are pooled per cipher
+    ff_crypto_cipher_ctx_release(FF_CRYPTO_MODE_AES_256_GCM, ctx_1);
+    ctx_2 = ff_crypto_cipher_ctx_acquire(FF_CRYPTO_MODE_CHACHA20_POLY1305);
+
+    TEST_ASSERT_NOT_NULL_MESSAGE(ctx_2, "acquire (2) check failed");
+    TEST_ASSERT_NOT_EQUAL_MESSAGE(ctx_1, ctx_2, "per cipher pool check failed");
+
+    ff_crypto_cipher_ctx_release(FF_CRYPTO_MODE_CHACHA20_POLY1305, ctx_2);
+
+    TEST_ASSERT_EQUAL_MESSAGE(NULL, ff_crypto_cipher_ctx_acquire(9), "unknown mode check failed");
+}
+
+struct ff_request *test_crypto_alloc_encrypted_request(int8_t *tag)
+{
+    struct ff_request *request = ff_request_alloc();
+    uint8_t encryption_mode = FF_CRYPTO_MODE_AES_256_GCM;
+    uint8_t key_derive_mode = FF_KEY_DERIVE_MODE_PBKDF2;
+
+    request->options_length = 5;
+    request->options = (struct ff_request_option_node **)malloc(sizeof(struct ff_request_option_node *) * request->options_length);
+
+    for (int i = 0; i < 5; i++)
+    {
+        request->options[i] = ff_request_option_node_alloc();
+    }
+
+    request->options[0]->type = FF_REQUEST_OPTION_TYPE_ENCRYPTION_MODE;
+    request->options[0]->length = 1;
+    ff_request_option_load_buff(request->options[0], 1, &encryption_mode);
+
+    request->options[1]->type = FF_REQUEST_OPTION_TYPE_ENCRYPTION_IV;
+    request->options[1]->length = 12;
+    ff_request_option_load_buff(request->options[1], 12, "test12345678");
+
+    request->options[2]->type = FF_REQUEST_OPTION_TYPE_ENCRYPTION_TAG;
+    request->options[2]->length = 16;
+    ff_request_option_load_buff(request->options[2], 16, tag);
+
+    request->options[3]->type = FF_REQUEST_OPTION_TYPE_KEY_DERIVE_MODE;
+    request->options[3]->length = 1;
+    ff_request_option_load_buff(request->options[3], 1, &key_derive_mode);
+
+    request->options[4]->type = FF_REQUEST_OPTION_TYPE_KEY_DERIVE_SALT;
+    request->options[4]->length = 16;
+    ff_request_option_load_buff(request->options[4], 16, "test123456789012");
+
+    // Ciphertext for plaintext: "hello world"
+    request->payload_length = 11;
+
+    return request;
+}
+
+void test_crypto_add_payload_chunk(struct ff_request *request, int8_t *ciphertext, uint16_t offset, uint16_t length)
+{
+    struct ff_request_payload_node *node = ff_request_payload_node_alloc();
+    node->offset = offset;
+    node->length = length;
+    ff_request_payload_load_buff(node, length, ciphertext + offset);
+
+    node->next = request->payload;
+    request->payload = node;
+}
+
+void test_request_decrypt_incremental()
+{
+    int8_t ciphertext[] = {33, -93, -49, -95, -55, 127, -104, -114, 38, -82, -60};
+    int8_t tag[] = {117, 32, -60, -128, 15, 100, -18, 96, 81, 1, -52, -51, 96, 127, 10, -1};
+    struct ff_encryption_config config = {.key = (uint8_t *)"testkey", .pbkdf2_iterations = 1000};
+    struct ff_request *request = test_crypto_alloc_encrypted_request(tag);
+    struct ff_derived_key *key = ff_derived_key_alloc(32);
+
+    // Warm the cache, incremental decryption never derives keys itself
+    config.key_cache = ff_key_cache_init(4);
+    ff_derive_key(request, &config, key);
+
+    // Chunks arrive out of order, the prefix is only decrypted once contiguous
+    test_crypto_add_payload_chunk(request, ciphertext, 4, 3);
+    ff_decrypt_request_incremental(request, &config);
+
+    TEST_ASSERT_NOT_NULL_MESSAGE(request->decrypt_stream, "stream check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(0, request->decrypt_stream->decrypted_length, "decrypted length (1) check failed");
+
+    test_crypto_add_payload_chunk(request, ciphertext, 0, 4);
+    ff_decrypt_request_incremental(request, &config);
+
+    TEST_ASSERT_EQUAL_MESSAGE(7, request->decrypt_stream->decrypted_length, "decrypted length (2) check failed");
+
+    test_crypto_add_payload_chunk(request, ciphertext, 7, 4);
+    request->state = FF_REQUEST_STATE_RECEIVED;
+    ff_request_vectorise_payload(request);
+    ff_decrypt_request(request, &config);
+
+    TEST_ASSERT_EQUAL_MESSAGE(FF_REQUEST_STATE_DECRYPTED, request->state, "state check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(NULL, request->decrypt_stream, "stream released check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(11, request->payload_length, "payload length check failed");
+    TEST_ASSERT_EQUAL_STRING_LEN_MESSAGE("hello world", request->payload->value, 11, "payload check failed");
+
+    ff_request_free(request);
+    ff_derived_key_free(key);
+    ff_key_cache_free(config.key_cache);
+}
+
+void test_request_decrypt_incremental_invalid_tag()
+{
+    int8_t ciphertext[] = {33, -93, -49, -95, -55, 127, -104, -114, 38, -82, -60};
+    int8_t tag[16] = {0};
+    struct ff_encryption_config config = {.key = (uint8_t *)"testkey", .pbkdf2_iterations = 1000};
+    struct ff_request *request = test_crypto_alloc_encrypted_request(tag);
+    struct ff_derived_key *key = ff_derived_key_alloc(32);
+
+    config.key_cache = ff_key_cache_init(4);
+    ff_derive_key(request, &config, key);
+
+    test_crypto_add_payload_chunk(request, ciphertext, 0, 7);
+    ff_decrypt_request_incremental(request, &config);
+
+    TEST_ASSERT_EQUAL_MESSAGE(7, request->decrypt_stream->decrypted_length, "decrypted length check failed");
+
+    test_crypto_add_payload_chunk(request, ciphertext, 7, 4);
+    ff_request_vectorise_payload(request);
+    ff_decrypt_request(request, &config);
+
+    TEST_ASSERT_EQUAL_MESSAGE(FF_REQUEST_STATE_DECRYPTING_FAILED, request->state, "state check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(NULL, request->payload, "payload discarded check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(NULL, request->decrypt_stream, "stream released check failed");
+
+    ff_request_free(request);
+    ff_derived_key_free(key);
+    ff_key_cache_free(config.key_cache);
+}
+
+void test_request_decrypt_incremental_requires_cached_key()
+{
+    int8_t ciphertext[] = {33, -93, -49, -95, -55, 127, -104, -114, 38, -82, -60};
+    int8_t tag[] = {117, 32, -60, -128, 15, 100, -18, 96, 81, 1, -52, -51, 96, 127, 10, -1};
+    struct ff_encryption_config config = {.key = (uint8_t *)"testkey", .pbkdf2_iterations = 1000};
+    struct ff_request *request = test_crypto_alloc_encrypted_request(tag);
+
+    config.key_cache = ff_key_cache_init(4);
+
+    test_crypto_add_payload_chunk(request, ciphertext, 0, 7);
+    ff_decrypt_request_incremental(request, &config);
+
+    TEST_ASSERT_EQUAL_MESSAGE(NULL, request->decrypt_stream, "stream check failed");
+
+    test_crypto_add_payload_chunk(request, ciphertext, 7, 4);
+    ff_request_vectorise_payload(request);
+    ff_decrypt_request(request, &config);
+
+    TEST_ASSERT_EQUAL_MESSAGE(FF_REQUEST_STATE_DECRYPTED, request->state, "state check failed");
+    TEST_ASSERT_EQUAL_STRING_LEN_MESSAGE("hello world", request->payload->value, 11, "payload check failed");
+
+    ff_request_free(request);
+    ff_key_cache_free(config.key_cache);
+}
+
+void test_derive_key_hkdf()
+{
+    struct ff_encryption_config config = {.key = (uint8_t *)"testkey"};
+    struct ff_derived_key *key = ff_derived_key_alloc(32);
+    uint8_t salt[] = "test123456789012";
+    // HKDF-SHA256(ikm = "testkey", salt, info = "ff-request-key")
+    uint8_t expected_key[] = {210, 45, 87, 36, 188, 123, 201, 236, 86, 231, 4, 132, 79, 173, 39, 107,
+                              55, 138, 159, 83, 144, 132, 157, 157, 93, 25, 51, 78, 128, 171, 105, 72};
+
+    bool res = ff_derive_key_hkdf(&config, salt, 16, key);
+
+    TEST_ASSERT_EQUAL_MESSAGE(true, res, "return check failed");
+    TEST_ASSERT_EQUAL_MEMORY_MESSAGE(expected_key, key->key, 32, "key check failed");
+
+    ff_derived_key_free(key);
+}
+
+void test_request_encrypt_and_decrypt_hkdf()
+{
+    struct ff_request *request = ff_request_alloc();
+    struct ff_encryption_config config = {.key = (uint8_t *)"testkey", .key_derivation_mode = FF_KEY_DERIVE_MODE_HKDF};
+    char *payload = "hello world";
+
+    request->options = malloc(sizeof(struct ff_request_option_node *) * FF_REQUEST_MAX_OPTIONS);
+    request->payload_length = strlen(payload);
+    request->payload = ff_request_payload_node_alloc();
+    request->payload->length = strlen(payload);
+    ff_request_payload_load_buff(request->payload, strlen(payload), payload);
+
+    TEST_ASSERT_EQUAL_MESSAGE(true, ff_client_encrypt_request(request, &config), "encrypt check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(FF_KEY_DERIVE_MODE_HKDF, request->options[3]->value[0], "key derive mode check failed");
+
+    // Only accept HKDF derived keys
+    config.allowed_key_derivation_modes = FF_KEY_DERIVE_MODE_FLAG(FF_KEY_DERIVE_MODE_HKDF);
+    ff_decrypt_request(request, &config);
+
+    TEST_ASSERT_EQUAL_MESSAGE(FF_REQUEST_STATE_DECRYPTED, request->state, "state check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(11, request->payload_length, "payload length check failed");
+    TEST_ASSERT_EQUAL_STRING_LEN_MESSAGE(payload, request->payload->value, 11, "payload check failed");
+
+    ff_request_free(request);
+}
+
+void test_request_decrypt_disallowed_key_derivation_mode()
+{
+    struct ff_request *request = ff_request_alloc();
+    struct ff_encryption_config config = {.key = (uint8_t *)"testkey", .pbkdf2_iterations = 1000, .key_derivation_mode = FF_KEY_DERIVE_MODE_HKDF};
+    char *payload = "hello world";
+
+    request->options = malloc(sizeof(struct ff_request_option_node *) * FF_REQUEST_MAX_OPTIONS);
+    request->payload_length = strlen(payload);
+    request->payload = ff_request_payload_node_alloc();
+    request->payload->length = strlen(payload);
+    ff_request_payload_load_buff(request->payload, strlen(payload), payload);
+
+    ff_client_encrypt_request(request, &config);
+
+    config.allowed_key_derivation_modes = FF_KEY_DERIVE_MODE_FLAG(FF_KEY_DERIVE_MODE_PBKDF2);
+    ff_decrypt_request(request, &config);
+
+    TEST_ASSERT_EQUAL_MESSAGE(FF_REQUEST_STATE_DECRYPTING_FAILED, request->state, "state check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(NULL, request->payload, "payload discarded check failed");
+
+    ff_request_free(request);
+}
+
+void test_request_decrypt_incremental_hkdf_without_cache()
+{
+    struct ff_request *request = ff_request_alloc();
+    struct ff_encryption_config config = {.key = (uint8_t *)"testkey", .key_derivation_mode = FF_KEY_DERIVE_MODE_HKDF};
+    char *payload = "hello world";
+
+    request->options = malloc(sizeof(struct ff_request_option_node *) * FF_REQUEST_MAX_OPTIONS);
+    request->payload_length = strlen(payload);
+    request->payload = ff_request_payload_node_alloc();
+    request->payload->length = strlen(payload);
+    ff_request_payload_load_buff(request->payload, strlen(payload), payload);
+
+    ff_client_encrypt_request(request, &config);
+
+    // HKDF keys are derived during ingest rather than waiting for the cache
+    ff_decrypt_request_incremental(request, &config);
+
+    TEST_ASSERT_NOT_NULL_MESSAGE(request->decrypt_stream, "stream check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(11, request->decrypt_stream->decrypted_length, "decrypted length check failed");
+
+    ff_decrypt_request(request, &config);
+
+    TEST_ASSERT_EQUAL_MESSAGE(FF_REQUEST_STATE_DECRYPTED, request->state, "state check failed");
+    TEST_ASSERT_EQUAL_STRING_LEN_MESSAGE(payload, request->payload->value, 11, "payload check failed");
+
+    ff_request_free(request);
+}
+
+void test_request_encrypt_and_decrypt_chacha20_poly1305()
+{
+    struct ff_request *request = ff_request_alloc();
+    struct ff_encryption_config config = {.key = (uint8_t *)"testkey", .pbkdf2_iterations = 1000, .encryption_mode = FF_CRYPTO_MODE_CHACHA20_POLY1305};
+    char *payload = "hello world";
+    uint8_t *payload_buff = NULL;
+
+    request->options = malloc(sizeof(struct ff_request_option_node *) * FF_REQUEST_MAX_OPTIONS);
+    request->payload_length = strlen(payload);
+    request->payload = ff_request_payload_node_alloc();
+    request->payload->length = strlen(payload);
+    ff_request_payload_load_buff(request->payload, strlen(payload), payload);
+
+    TEST_ASSERT_EQUAL_MESSAGE(true, ff_client_encrypt_request(request, &config), "encrypt check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(FF_CRYPTO_MODE_CHACHA20_POLY1305, request->options[0]->value[0], "encryption mode check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(16, request->options[2]->length, "tag length check failed");
+
+    payload_buff = request->payload->value;
+    ff_decrypt_request(request, &config);
+
+    TEST_ASSERT_EQUAL_MESSAGE(FF_REQUEST_STATE_DECRYPTED, request->state, "state check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(payload_buff, request->payload->value, "in place check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(11, request->payload_length, "payload length check failed");
+    TEST_ASSERT_EQUAL_STRING_LEN_MESSAGE(payload, request->payload->value, 11, "payload check failed");
+
+    ff_request_free(request);
+}
+
+void test_request_decrypt_chacha20_poly1305_invalid_tag()
+{
+    struct ff_request *request = ff_request_alloc();
+    struct ff_encryption_config config = {.key = (uint8_t *)"testkey", .key_derivation_mode = FF_KEY_DERIVE_MODE_HKDF, .encryption_mode = FF_CRYPTO_MODE_CHACHA20_POLY1305};
+    char *payload = "hello world";
+
+    request->options = malloc(sizeof(struct ff_request_option_node *) * FF_REQUEST_MAX_OPTIONS);
+    request->payload_length = strlen(payload);
+    request->payload = ff_request_payload_node_alloc();
+    request->payload->length = strlen(payload);
+    ff_request_payload_load_buff(request->payload, strlen(payload), payload);
+
+    ff_client_encrypt_request(request, &config);
+
+    request->options[2]->value[0] ^= 1;
+    ff_decrypt_request(request, &config);
+
+    TEST_ASSERT_EQUAL_MESSAGE(FF_REQUEST_STATE_DECRYPTING_FAILED, request->state, "state check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(NULL, request->payload, "payload discarded check failed");
 
     ff_request_free(request);
 }
@@ -0,0 +1,167 @@
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "../include/unity.h"
+#include "../../src/crypto_pool.h"
+#include "../../src/crypto_pool_p.h"
+#include "../../src/stats.h"
+#include "../../src/alloc.h"
+#include "../../client/c/crypto.h"
+
+#define TEST_CRYPTO_POOL_REQUESTS 32
+
+struct test_crypto_pool_results
+{
+    struct ff_request *requests[TEST_CRYPTO_POOL_REQUESTS];
+    uint32_t length;
+    pthread_mutex_t mutex;
+    pthread_cond_t done;
+};
+
+void test_crypto_pool_on_decrypted(struct ff_request *request, void *context)
+{
+    struct test_crypto_pool_results *results = (struct test_crypto_pool_results *)context;
+
+    pthread_mutex_lock(&results->mutex);
+    results->requests[results->length++] = request;
+    pthread_cond_signal(&results->done);
+    pthread_mutex_unlock(&results->mutex);
+}
+
+struct ff_request *test_crypto_pool_alloc_request(struct ff_encryption_config *config, char *payload)
+{
+    struct ff_request *request = ff_request_alloc();
+
+    request->options = malloc(sizeof(struct ff_request_option_node *) * FF_REQUEST_MAX_OPTIONS);
+    request->payload_length = strlen(payload);
+    request->payload = ff_request_payload_node_alloc();
+    request->payload->length = strlen(payload);
+    ff_request_payload_load_buff(request->payload, strlen(payload), payload);
+
+    ff_client_encrypt_request(request, config);
+    request->state = FF_REQUEST_STATE_RECEIVED;
+
+    return request;
+}
+
+void test_crypto_pool_decrypts_batches()
+{
+    struct ff_encryption_config config = {.key = (uint8_t *)"testkey", .key_derivation_mode = FF_KEY_DERIVE_MODE_HKDF};
+    struct test_crypto_pool_results results = {.length = 0};
+    struct ff_crypto_pool *pool = NULL;
+
+    pthread_mutex_init(&results.mutex, NULL);
+    pthread_cond_init(&results.done, NULL);
+    ff_stats_reset();
+
+    pool = ff_crypto_pool_init(&config, 2, 4, test_crypto_pool_on_decrypted);
+
+    for (int i = 0; i < TEST_CRYPTO_POOL_REQUESTS; i++)
+    {
+        ff_crypto_pool_submit(pool, test_crypto_pool_alloc_request(&config, "hello world"), &results);
+    }
+
+    pthread_mutex_lock(&results.mutex);
+    while (results.length < TEST_CRYPTO_POOL_REQUESTS)
+    {
+        pthread_cond_wait(&results.done, &results.mutex);
+    }
+    pthread_mutex_unlock(&results.mutex);
+
+    for (int i = 0; i < TEST_CRYPTO_POOL_REQUESTS; i++)
+    {
+        TEST_ASSERT_EQUAL_MESSAGE(FF_REQUEST_STATE_DECRYPTED, results.requests[i]->state, "state check failed");
+        TEST_ASSERT_EQUAL_STRING_LEN_MESSAGE("hello world", results.requests[i]->payload->value, 11, "payload check failed");
+        ff_request_free(results.requests[i]);
+    }
+
+    TEST_ASSERT_EQUAL_MESSAGE(0, FF_STATS_GET(crypto_queue_depth), "queue depth check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(TEST_CRYPTO_POOL_REQUESTS, FF_STATS_GET(crypto_batch_requests), "batch requests check failed");
+    TEST_ASSERT_TRUE_MESSAGE(FF_STATS_GET(crypto_batches) >= TEST_CRYPTO_POOL_REQUESTS / 4, "batch size check failed");
+
+    ff_crypto_pool_free(pool);
+    pthread_cond_destroy(&results.done);
+    pthread_mutex_destroy(&results.mutex);
+    ff_stats_reset();
+}
+
+void test_crypto_pool_take_batch_limits_size()
+{
+    struct ff_encryption_config config = {.key = (uint8_t *)"testkey"};
+    struct ff_crypto_pool *pool = NULL;
+    struct ff_crypto_pool_job *batch = NULL;
+    struct ff_crypto_pool_job *tmp = NULL;
+    uint16_t length;
+
+    ff_stats_reset();
+
+    // No workers, batches are taken by hand
+    pool = ff_crypto_pool_init(&config, 0, 4, test_crypto_pool_on_decrypted);
+
+    for (int i = 0; i < 6; i++)
+    {
+        ff_crypto_pool_submit(pool, ff_request_alloc(), NULL);
+    }
+
+    TEST_ASSERT_EQUAL_MESSAGE(6, FF_STATS_GET(crypto_queue_depth), "queue depth (1) check failed");
+
+    for (int expected = 4; expected >= 2; expected -= 2)
+    {
+        length = ff_crypto_pool_take_batch(pool, &batch);
+        TEST_ASSERT_EQUAL_MESSAGE(expected, length, "batch length check failed");
+
+        while (batch != NULL)
+        {
+            tmp = batch;
+            batch = batch->next;
+            ff_request_free(tmp->request);
+            FREE(tmp);
+            length--;
+        }
+
+        TEST_ASSERT_EQUAL_MESSAGE(0, length, "batch list check failed");
+    }
+
+    TEST_ASSERT_EQUAL_MESSAGE(0, FF_STATS_GET(crypto_queue_depth), "queue depth (2) check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(NULL, pool->queue_last, "queue last check failed");
+
+    ff_crypto_pool_free(pool);
+    ff_stats_reset();
+}
+
+void *test_crypto_pool_pin_thread(void *args)
+{
+    struct ff_crypto_pool *pool = (struct ff_crypto_pool *)args;
+    cpu_set_t *pinned = calloc(1, sizeof(cpu_set_t));
+
+    // Wraps around to the first allowed CPU
+    ff_crypto_pool_pin_worker(pool, (uint16_t)pool->cpu_count);
+    pthread_getaffinity_np(pthread_self(), sizeof(cpu_set_t), pinned);
+
+    return pinned;
+}
+
+void test_crypto_pool_pin_worker_allowed_cpus()
+{
+    struct ff_encryption_config config = {.key = (uint8_t *)"testkey"};
+    struct ff_crypto_pool *pool = ff_crypto_pool_init(&config, 0, 1, test_crypto_pool_on_decrypted);
+    cpu_set_t *pinned = NULL;
+    pthread_t thread;
+    int first = 0;
+
+    TEST_ASSERT_GREATER_THAN_MESSAGE(0, pool->cpu_count, "cpu count check failed");
+
+    while (!CPU_ISSET(first, &pool->cpus))
+    {
+        first++;
+    }
+
+    pthread_create(&thread, NULL, test_crypto_pool_pin_thread, pool);
+    pthread_join(thread, (void **)&pinned);
+
+    TEST_ASSERT_EQUAL_MESSAGE(1, CPU_COUNT(pinned), "pinned count check failed");
+    TEST_ASSERT_TRUE_MESSAGE(CPU_ISSET(first, pinned), "pinned cpu check failed");
+
+    FREE(pinned);
+    ff_crypto_pool_free(pool);
+}
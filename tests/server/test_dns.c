@@ -0,0 +1,497 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "../include/unity.h"
+#include "../../src/dns.h"
+#include "../../src/dns_p.h"
+
+#define TEST_DNS_HOSTS_PATH "/tmp/ff_test_hosts"
+
+/**
+ * Answers queries on a local UDP port:
+ *   example.com      A 93.184.216.34 (TTL 60), no AAAA records
+ *   www.example.com  CNAME to example.com (TTL 30)
+ *   v6.example.com   AAAA 2001:db8::1 and A 192.0.2.1
+ *   missing.example  NXDOMAIN, SOA minimum 20
+ *   broken.example   SERVFAIL
+ *   big.example      truncated over UDP, A 198.51.100.7 over TCP
+ *   anything else    no answer
+ */
+struct test_dns_server
+{
+    int sockfd;
+    int tcp_sockfd;
+    uint16_t port;
+    pthread_t thread;
+    uint32_t queries;
+    uint32_t tcp_queries;
+    bool stopping;
+    char server[32];
+};
+
+size_t test_dns_write_name(uint8_t *buff, const char *name)
+{
+    // The query encoder writes the name after a 12 byte header
+    uint8_t message[FF_DNS_MAX_MESSAGE_LENGTH];
+    size_t length = ff_dns_query_encode(0, name, 0, message, sizeof(message));
+
+    memcpy(buff, message + FF_DNS_HEADER_LENGTH, length - FF_DNS_HEADER_LENGTH - 4);
+
+    return length - FF_DNS_HEADER_LENGTH - 4;
+}
+
+size_t test_dns_write_record(uint8_t *buff, const char *owner, uint16_t type, uint32_t ttl, const uint8_t *rdata, uint16_t rdata_length)
+{
+    size_t offset = 0;
+
+    if (owner == NULL)
+    {
+        // Compression pointer to the question name
+        buff[offset++] = 0xc0;
+        buff[offset++] = FF_DNS_HEADER_LENGTH;
+    }
+    else
+    {
+        offset += test_dns_write_name(buff, owner);
+    }
+
+    ff_dns_write_uint16(buff + offset, type);
+    ff_dns_write_uint16(buff + offset + 2, FF_DNS_CLASS_IN);
+    buff[offset + 4] = (uint8_t)(ttl >> 24);
+    buff[offset + 5] = (uint8_t)(ttl >> 16);
+    buff[offset + 6] = (uint8_t)(ttl >> 8);
+    buff[offset + 7] = (uint8_t)ttl;
+    ff_dns_write_uint16(buff + offset + 8, rdata_length);
+    memcpy(buff + offset + 10, rdata, rdata_length);
+
+    return offset + 10 + rdata_length;
+}
+
+size_t test_dns_write_soa(uint8_t *buff, uint32_t ttl, uint32_t minimum)
+{
+    uint8_t rdata[64];
+    size_t length = 0;
+
+    length += test_dns_write_name(rdata + length, "ns.example");
+    length += test_dns_write_name(rdata + length, "admin.example");
+    // Serial, refresh, retry, expire
+    memset(rdata + length, 0, 16);
+    length += 16;
+    rdata[length++] = (uint8_t)(minimum >> 24);
+    rdata[length++] = (uint8_t)(minimum >> 16);
+    rdata[length++] = (uint8_t)(minimum >> 8);
+    rdata[length++] = (uint8_t)minimum;
+
+    return test_dns_write_record(buff, "example", FF_DNS_TYPE_SOA, ttl, rdata, (uint16_t)length);
+}
+
+/**
+ * Builds the stub server's response to the query, returns 0 to not answer
+ */
+size_t test_dns_build_response(const uint8_t *query, size_t query_length, uint8_t *response, bool tcp)
+{
+    char name[FF_DNS_MAX_NAME_LENGTH + 2];
+    size_t offset = FF_DNS_HEADER_LENGTH;
+    uint16_t type;
+    uint16_t rcode = FF_DNS_RCODE_NOERROR;
+    uint16_t answers = 0;
+    uint16_t authorities = 0;
+    uint8_t target[64];
+    uint8_t address[16];
+
+    if (!ff_dns_read_name(query, query_length, &offset, name, sizeof(name)) || offset + 4 > query_length)
+    {
+        return 0;
+    }
+
+    type = ff_dns_read_uint16(query + offset);
+    offset += 4;
+    memcpy(response, query, offset);
+
+    if (strcmp(name, "www.example.com") == 0)
+    {
+        offset += test_dns_write_record(response + offset, NULL, FF_DNS_TYPE_CNAME, 30, target, (uint16_t)test_dns_write_name(target, "example.com"));
+        answers++;
+        snprintf(name, sizeof(name), "example.com");
+    }
+
+    if (strcmp(name, "example.com") == 0)
+    {
+        if (type == FF_DNS_TYPE_A)
+        {
+            inet_pton(AF_INET, "93.184.216.34", address);
+            offset += test_dns_write_record(response + offset, answers > 0 ? "example.com" : NULL, FF_DNS_TYPE_A, 60, address, 4);
+            answers++;
+        }
+        else
+        {
+            offset += test_dns_write_soa(response + offset, 3600, 15);
+            authorities++;
+        }
+    }
+    else if (strcmp(name, "v6.example.com") == 0)
+    {
+        inet_pton(type == FF_DNS_TYPE_A ? AF_INET : AF_INET6, type == FF_DNS_TYPE_A ? "192.0.2.1" : "2001:db8::1", address);
+        offset += test_dns_write_record(response + offset, NULL, type, 120, address, type == FF_DNS_TYPE_A ? 4 : 16);
+        answers++;
+    }
+    else if (strcmp(name, "missing.example") == 0)
+    {
+        rcode = FF_DNS_RCODE_NXDOMAIN;
+        offset += test_dns_write_soa(response + offset, 3600, 20);
+        authorities++;
+    }
+    else if (strcmp(name, "broken.example") == 0)
+    {
+        rcode = 2;
+    }
+    else if (strcmp(name, "big.example") == 0 && !tcp)
+    {
+        rcode = FF_DNS_FLAG_TC;
+    }
+    else if (strcmp(name, "big.example") == 0 && type == FF_DNS_TYPE_A)
+    {
+        inet_pton(AF_INET, "198.51.100.7", address);
+        offset += test_dns_write_record(response + offset, NULL, FF_DNS_TYPE_A, 60, address, 4);
+        answers++;
+    }
+    else if (strcmp(name, "big.example") == 0)
+    {
+        offset += test_dns_write_soa(response + offset, 3600, 15);
+        authorities++;
+    }
+    else if (answers == 0)
+    {
+        return 0;
+    }
+
+    ff_dns_write_uint16(response + 2, FF_DNS_FLAG_QR | FF_DNS_FLAG_RD | 0x0080 | rcode);
+    ff_dns_write_uint16(response + 6, answers);
+    ff_dns_write_uint16(response + 8, authorities);
+    ff_dns_write_uint16(response + 10, 0);
+
+    return offset;
+}
+
+void test_dns_server_answer_tcp(struct test_dns_server *server)
+{
+    uint8_t query[2 + FF_DNS_MAX_MESSAGE_LENGTH];
+    uint8_t response[2 + FF_DNS_MAX_MESSAGE_LENGTH];
+    size_t received = 0;
+    size_t response_length;
+    ssize_t length;
+    int sockfd = accept(server->tcp_sockfd, NULL, NULL);
+
+    if (sockfd < 0)
+    {
+        return;
+    }
+
+    while (received < 2 || received < 2 + (size_t)ff_dns_read_uint16(query))
+    {
+        if ((length = recv(sockfd, query + received, sizeof(query) - received, 0)) <= 0)
+        {
+            goto cleanup;
+        }
+
+        received += (size_t)length;
+    }
+
+    __atomic_add_fetch(&server->tcp_queries, 1, __ATOMIC_RELAXED);
+
+    if ((response_length = test_dns_build_response(query + 2, received - 2, response + 2, true)) > 0)
+    {
+        ff_dns_write_uint16(response, (uint16_t)response_length);
+        send(sockfd, response, response_length + 2, MSG_NOSIGNAL);
+    }
+
+cleanup:
+    close(sockfd);
+}
+
+void *test_dns_server_loop(void *args)
+{
+    struct test_dns_server *server = (struct test_dns_server *)args;
+    uint8_t query[FF_DNS_MAX_MESSAGE_LENGTH];
+    uint8_t response[FF_DNS_MAX_MESSAGE_LENGTH];
+    struct pollfd poll_fds[2] = {{.fd = server->sockfd, .events = POLLIN}, {.fd = server->tcp_sockfd, .events = POLLIN}};
+    struct sockaddr_storage source;
+    socklen_t source_length;
+    ssize_t received;
+    size_t response_length;
+
+    while (poll(poll_fds, 2, -1) > 0)
+    {
+        if (poll_fds[1].revents & POLLIN)
+        {
+            test_dns_server_answer_tcp(server);
+        }
+
+        if (!(poll_fds[0].revents & POLLIN))
+        {
+            continue;
+        }
+
+        source_length = sizeof(source);
+        received = recvfrom(server->sockfd, query, sizeof(query), 0, (struct sockaddr *)&source, &source_length);
+
+        if (__atomic_load_n(&server->stopping, __ATOMIC_ACQUIRE) || received <= 0)
+        {
+            break;
+        }
+
+        __atomic_add_fetch(&server->queries, 1, __ATOMIC_RELAXED);
+
+        if ((response_length = test_dns_build_response(query, (size_t)received, response, false)) > 0)
+        {
+            sendto(server->sockfd, response, response_length, 0, (struct sockaddr *)&source, source_length);
+        }
+    }
+
+    return NULL;
+}
+
+void test_dns_server_start(struct test_dns_server *server)
+{
+    struct sockaddr_in address = {.sin_family = AF_INET, .sin_port = 0};
+    socklen_t address_length = sizeof(address);
+
+    memset(server, 0, sizeof(struct test_dns_server));
+    inet_pton(AF_INET, "127.0.0.1", &address.sin_addr);
+
+    server->sockfd = socket(AF_INET, SOCK_DGRAM, 0);
+    bind(server->sockfd, (struct sockaddr *)&address, sizeof(address));
+    getsockname(server->sockfd, (struct sockaddr *)&address, &address_length);
+    server->port = ntohs(address.sin_port);
+
+    // Truncated answers are retried over TCP on the same port
+    server->tcp_sockfd = socket(AF_INET, SOCK_STREAM, 0);
+    setsockopt(server->tcp_sockfd, SOL_SOCKET, SO_REUSEADDR, &(int){1}, sizeof(int));
+    bind(server->tcp_sockfd, (struct sockaddr *)&address, sizeof(address));
+    listen(server->tcp_sockfd, 8);
+    snprintf(server->server, sizeof(server->server), "127.0.0.1:%u", server->port);
+
+    pthread_create(&server->thread, NULL, test_dns_server_loop, (void *)server);
+}
+
+void test_dns_server_stop(struct test_dns_server *server)
+{
+    struct sockaddr_in address = {.sin_family = AF_INET, .sin_port = htons(server->port)};
+    int sockfd = socket(AF_INET, SOCK_DGRAM, 0);
+
+    inet_pton(AF_INET, "127.0.0.1", &address.sin_addr);
+    __atomic_store_n(&server->stopping, true, __ATOMIC_RELEASE);
+    sendto(sockfd, "", 1, 0, (struct sockaddr *)&address, sizeof(address));
+    close(sockfd);
+
+    pthread_join(server->thread, NULL);
+    close(server->sockfd);
+    close(server->tcp_sockfd);
+}
+
+struct ff_dns_resolver *test_dns_resolver_init(struct test_dns_server *server)
+{
+    struct ff_dns_resolver *resolver = ff_dns_resolver_init(server->server, NULL);
+
+    // Unanswered names shouldn't slow the tests down
+    resolver->timeout_ms = 100;
+    resolver->attempts = 1;
+
+    return resolver;
+}
+
+void test_dns_query_encode()
+{
+    uint8_t buff[FF_DNS_MAX_MESSAGE_LENGTH];
+    uint8_t expected[] = {0x12, 0x34, 0x01, 0x00, 0, 1, 0, 0, 0, 0, 0, 0,
+                          1, 'a', 2, 'b', 'c', 0, 0, 28, 0, 1};
+    char long_label[70];
+
+    TEST_ASSERT_EQUAL_MESSAGE(sizeof(expected), ff_dns_query_encode(0x1234, "a.bc", FF_DNS_TYPE_AAAA, buff, sizeof(buff)), "length check failed");
+    TEST_ASSERT_EQUAL_MEMORY_MESSAGE(expected, buff, sizeof(expected), "message check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(sizeof(expected), ff_dns_query_encode(0x1234, "a.bc.", FF_DNS_TYPE_AAAA, buff, sizeof(buff)), "trailing dot check failed");
+
+    memset(long_label, 'a', sizeof(long_label) - 1);
+    long_label[sizeof(long_label) - 1] = '\0';
+
+    TEST_ASSERT_EQUAL_MESSAGE(0, ff_dns_query_encode(1, "", FF_DNS_TYPE_A, buff, sizeof(buff)), "empty check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(0, ff_dns_query_encode(1, "a..b", FF_DNS_TYPE_A, buff, sizeof(buff)), "empty label check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(0, ff_dns_query_encode(1, long_label, FF_DNS_TYPE_A, buff, sizeof(buff)), "long label check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(0, ff_dns_query_encode(1, "a.bc", FF_DNS_TYPE_A, buff, 16), "buffer check failed");
+}
+
+void test_dns_response_parse()
+{
+    uint8_t query[FF_DNS_MAX_MESSAGE_LENGTH];
+    uint8_t response[FF_DNS_MAX_MESSAGE_LENGTH];
+    size_t query_length = ff_dns_query_encode(0xbeef, "WWW.Example.com", FF_DNS_TYPE_A, query, sizeof(query));
+    size_t response_length = test_dns_build_response(query, query_length, response, false);
+    struct ff_dns_result result;
+    char address[INET_ADDRSTRLEN];
+
+    TEST_ASSERT_MESSAGE(ff_dns_response_parse(response, response_length, 0xbeef, "www.example.com", FF_DNS_TYPE_A, &result), "parse check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(FF_DNS_STATUS_OK, result.status, "status check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(1, result.length, "length check failed");
+    // The lower of the CNAME and A record TTLs
+    TEST_ASSERT_EQUAL_MESSAGE(30, result.ttl, "ttl check failed");
+    inet_ntop(AF_INET, &((struct sockaddr_in *)&result.addresses[0])->sin_addr, address, sizeof(address));
+    TEST_ASSERT_EQUAL_STRING_MESSAGE("93.184.216.34", address, "address check failed");
+
+    // Responses to other queries are ignored
+    TEST_ASSERT_FALSE_MESSAGE(ff_dns_response_parse(response, response_length, 0xbeee, "www.example.com", FF_DNS_TYPE_A, &result), "id check failed");
+    TEST_ASSERT_FALSE_MESSAGE(ff_dns_response_parse(response, response_length, 0xbeef, "example.com", FF_DNS_TYPE_A, &result), "question check failed");
+    TEST_ASSERT_FALSE_MESSAGE(ff_dns_response_parse(response, response_length, 0xbeef, "www.example.com", FF_DNS_TYPE_AAAA, &result), "type check failed");
+    TEST_ASSERT_FALSE_MESSAGE(ff_dns_response_parse(query, query_length, 0xbeef, "www.example.com", FF_DNS_TYPE_A, &result), "query check failed");
+
+    // Truncated records leave the lookup failed
+    TEST_ASSERT_MESSAGE(ff_dns_response_parse(response, response_length - 2, 0xbeef, "www.example.com", FF_DNS_TYPE_A, &result), "truncated parse check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(FF_DNS_STATUS_FAILED, result.status, "truncated status check failed");
+}
+
+void test_dns_response_parse_negative()
+{
+    uint8_t query[FF_DNS_MAX_MESSAGE_LENGTH];
+    uint8_t response[FF_DNS_MAX_MESSAGE_LENGTH];
+    size_t query_length;
+    size_t response_length;
+    struct ff_dns_result result;
+
+    query_length = ff_dns_query_encode(1, "missing.example", FF_DNS_TYPE_A, query, sizeof(query));
+    response_length = test_dns_build_response(query, query_length, response, false);
+
+    TEST_ASSERT_MESSAGE(ff_dns_response_parse(response, response_length, 1, "missing.example", FF_DNS_TYPE_A, &result), "nxdomain parse check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(FF_DNS_STATUS_NOT_FOUND, result.status, "nxdomain status check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(20, result.ttl, "nxdomain ttl check failed");
+
+    // No AAAA records
+    query_length = ff_dns_query_encode(2, "example.com", FF_DNS_TYPE_AAAA, query, sizeof(query));
+    response_length = test_dns_build_response(query, query_length, response, false);
+
+    TEST_ASSERT_MESSAGE(ff_dns_response_parse(response, response_length, 2, "example.com", FF_DNS_TYPE_AAAA, &result), "nodata parse check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(FF_DNS_STATUS_NOT_FOUND, result.status, "nodata status check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(15, result.ttl, "nodata ttl check failed");
+
+    query_length = ff_dns_query_encode(3, "broken.example", FF_DNS_TYPE_A, query, sizeof(query));
+    response_length = test_dns_build_response(query, query_length, response, false);
+
+    TEST_ASSERT_MESSAGE(ff_dns_response_parse(response, response_length, 3, "broken.example", FF_DNS_TYPE_A, &result), "servfail parse check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(FF_DNS_STATUS_FAILED, result.status, "servfail status check failed");
+}
+
+void test_dns_read_name_compression_loop()
+{
+    // A pointer to itself
+    uint8_t message[] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 'a', 0xc0, 12};
+    char name[FF_DNS_MAX_NAME_LENGTH + 2];
+    size_t offset = FF_DNS_HEADER_LENGTH;
+
+    TEST_ASSERT_FALSE_MESSAGE(ff_dns_read_name(message, sizeof(message), &offset, name, sizeof(name)), "loop check failed");
+
+    offset = FF_DNS_HEADER_LENGTH;
+    TEST_ASSERT_FALSE_MESSAGE(ff_dns_read_name(message, 14, &offset, name, sizeof(name)), "bounds check failed");
+}
+
+void test_dns_parse_server()
+{
+    struct sockaddr_storage address;
+    socklen_t address_length;
+
+    TEST_ASSERT_MESSAGE(ff_dns_parse_server("10.0.0.1", &address, &address_length), "ipv4 check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(53, ntohs(((struct sockaddr_in *)&address)->sin_port), "default port check failed");
+    TEST_ASSERT_MESSAGE(ff_dns_parse_server("10.0.0.1:5353", &address, &address_length), "ipv4 port check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(5353, ntohs(((struct sockaddr_in *)&address)->sin_port), "port check failed");
+    TEST_ASSERT_MESSAGE(ff_dns_parse_server("2001:db8::53", &address, &address_length), "ipv6 check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(AF_INET6, address.ss_family, "family check failed");
+    TEST_ASSERT_MESSAGE(ff_dns_parse_server("[2001:db8::53]:5353", &address, &address_length), "ipv6 port check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(5353, ntohs(((struct sockaddr_in6 *)&address)->sin6_port), "ipv6 port value check failed");
+
+    TEST_ASSERT_FALSE_MESSAGE(ff_dns_parse_server("dns.example", &address, &address_length), "name check failed");
+    TEST_ASSERT_FALSE_MESSAGE(ff_dns_parse_server("10.0.0.1:0", &address, &address_length), "zero port check failed");
+    TEST_ASSERT_FALSE_MESSAGE(ff_dns_parse_server("[2001:db8::53", &address, &address_length), "bracket check failed");
+}
+
+void test_dns_resolve_literal_and_hosts()
+{
+    struct test_dns_server server;
+    struct ff_dns_resolver *resolver = NULL;
+    struct ff_dns_result result;
+    FILE *fd = fopen(TEST_DNS_HOSTS_PATH, "w");
+
+    fputs("# comment\n127.0.0.1 localhost internal.test\n::1 localhost # trailing\nnot-an-ip ignored.test\n", fd);
+    fclose(fd);
+
+    test_dns_server_start(&server);
+    resolver = ff_dns_resolver_init(server.server, TEST_DNS_HOSTS_PATH);
+
+    TEST_ASSERT_EQUAL_MESSAGE(FF_DNS_STATUS_OK, ff_dns_resolve(resolver, "192.0.2.7", &result), "ipv4 literal check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(AF_INET, result.addresses[0].ss_family, "ipv4 family check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(FF_DNS_STATUS_OK, ff_dns_resolve(resolver, "[2001:db8::7]", &result), "ipv6 literal check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(AF_INET6, result.addresses[0].ss_family, "ipv6 family check failed");
+
+    TEST_ASSERT_EQUAL_MESSAGE(FF_DNS_STATUS_OK, ff_dns_resolve(resolver, "LocalHost", &result), "hosts check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(2, result.length, "hosts length check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(FF_DNS_STATUS_OK, ff_dns_resolve(resolver, "internal.test", &result), "hosts alias check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(0, __atomic_load_n(&server.queries, __ATOMIC_RELAXED), "queries check failed");
+
+    ff_dns_resolver_free(resolver);
+    test_dns_server_stop(&server);
+    remove(TEST_DNS_HOSTS_PATH);
+}
+
+void test_dns_resolve()
+{
+    struct test_dns_server server;
+    struct ff_dns_resolver *resolver = NULL;
+    struct ff_dns_result result;
+
+    test_dns_server_start(&server);
+    resolver = test_dns_resolver_init(&server);
+
+    TEST_ASSERT_EQUAL_MESSAGE(FF_DNS_STATUS_OK, ff_dns_resolve(resolver, "www.example.com", &result), "cname check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(1, result.length, "cname length check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(15, result.ttl, "cname ttl check failed");
+
+    TEST_ASSERT_EQUAL_MESSAGE(FF_DNS_STATUS_OK, ff_dns_resolve(resolver, "v6.example.com", &result), "dual stack check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(2, result.length, "dual stack length check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(AF_INET, result.addresses[0].ss_family, "ipv4 first check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(AF_INET6, result.addresses[1].ss_family, "ipv6 second check failed");
+
+    TEST_ASSERT_EQUAL_MESSAGE(FF_DNS_STATUS_NOT_FOUND, ff_dns_resolve(resolver, "missing.example", &result), "nxdomain check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(FF_DNS_STATUS_FAILED, ff_dns_resolve(resolver, "broken.example", &result), "servfail check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(FF_DNS_STATUS_FAILED, ff_dns_resolve(resolver, "silent.example", &result), "timeout check failed");
+
+    ff_dns_resolver_free(resolver);
+    test_dns_server_stop(&server);
+}
+
+void test_dns_read_resolv_conf()
+{
+    struct ff_dns_resolver resolver;
+    FILE *fd = fopen(TEST_DNS_HOSTS_PATH, "w");
+
+    fputs("# comment\nsearch example\nnameserver 10.0.0.1\nnameserver fe80::1%eth0\nnameserver [2001:db8::53]:5353\n"
+          "nameserver 10.0.0.2\nnameserver 10.0.0.3\n",
+          fd);
+    fclose(fd);
+
+    ff_dns_read_resolv_conf(TEST_DNS_HOSTS_PATH, &resolver);
+
+    TEST_ASSERT_EQUAL_MESSAGE(FF_DNS_MAX_SERVERS, resolver.servers_length, "length check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(AF_INET, resolver.servers[0].ss_family, "first server check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(AF_INET6, resolver.servers[1].ss_family, "second server check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(5353, ntohs(((struct sockaddr_in6 *)&resolver.servers[1])->sin6_port), "second port check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(AF_INET, resolver.servers[2].ss_family, "third server check failed");
+
+    remove(TEST_DNS_HOSTS_PATH);
+    ff_dns_read_resolv_conf(TEST_DNS_HOSTS_PATH, &resolver);
+
+    TEST_ASSERT_EQUAL_MESSAGE(1, resolver.servers_length, "default length check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(htonl(INADDR_LOOPBACK), ((struct sockaddr_in *)&resolver.servers[0])->sin_addr.s_addr, "default server check failed");
+}
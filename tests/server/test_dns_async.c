@@ -0,0 +1,239 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "../include/unity.h"
+#include "../../src/dns_async.h"
+#include "../../src/dns_async_p.h"
+#include "../../src/stats.h"
+
+// Stub DNS server from test_dns.c
+
+struct test_dns_async_waiter
+{
+    struct ff_event_loop *loop;
+    uint32_t completed;
+    bool on_loop_thread;
+    struct ff_dns_result result;
+    pthread_mutex_t mutex;
+    pthread_cond_t resolved;
+};
+
+void test_dns_async_resolved(const char *name, struct ff_dns_result *result, void *context)
+{
+    struct test_dns_async_waiter *waiter = (struct test_dns_async_waiter *)context;
+
+    (void)name;
+
+    pthread_mutex_lock(&waiter->mutex);
+    waiter->result = *result;
+    waiter->on_loop_thread = ff_event_loop_is_current(waiter->loop);
+    waiter->completed++;
+    pthread_cond_signal(&waiter->resolved);
+    pthread_mutex_unlock(&waiter->mutex);
+}
+
+void test_dns_async_waiter_init(struct test_dns_async_waiter *waiter, struct ff_event_loop *loop)
+{
+    memset(waiter, 0, sizeof(struct test_dns_async_waiter));
+    waiter->loop = loop;
+    pthread_mutex_init(&waiter->mutex, NULL);
+    pthread_cond_init(&waiter->resolved, NULL);
+}
+
+void test_dns_async_wait(struct test_dns_async_waiter *waiter, uint32_t completed)
+{
+    pthread_mutex_lock(&waiter->mutex);
+
+    while (waiter->completed < completed)
+    {
+        pthread_cond_wait(&waiter->resolved, &waiter->mutex);
+    }
+
+    pthread_mutex_unlock(&waiter->mutex);
+}
+
+void test_dns_async_waiter_free(struct test_dns_async_waiter *waiter)
+{
+    pthread_cond_destroy(&waiter->resolved);
+    pthread_mutex_destroy(&waiter->mutex);
+}
+
+void test_dns_async_resolve()
+{
+    struct test_dns_server server;
+    struct test_dns_async_waiter waiter;
+    struct ff_event_loop *loop = ff_event_loop_init();
+    struct ff_dns_resolver *resolver = NULL;
+    struct ff_dns_async_resolver *async = NULL;
+
+    test_dns_server_start(&server);
+    resolver = test_dns_resolver_init(&server);
+    async = ff_dns_async_resolver_init(resolver, loop);
+    test_dns_async_waiter_init(&waiter, loop);
+
+    ff_dns_async_resolve(async, "v6.example.com", test_dns_async_resolved, (void *)&waiter);
+    test_dns_async_wait(&waiter, 1);
+
+    TEST_ASSERT_EQUAL_MESSAGE(FF_DNS_STATUS_OK, waiter.result.status, "status check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(2, waiter.result.length, "length check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(AF_INET, waiter.result.addresses[0].ss_family, "ipv4 first check failed");
+    TEST_ASSERT_MESSAGE(waiter.on_loop_thread, "thread check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(2, __atomic_load_n(&server.queries, __ATOMIC_RELAXED), "queries check failed");
+
+    // Literals don't need a query but are still answered on the loop
+    ff_dns_async_resolve(async, "192.0.2.1", test_dns_async_resolved, (void *)&waiter);
+    test_dns_async_wait(&waiter, 2);
+
+    TEST_ASSERT_EQUAL_MESSAGE(FF_DNS_STATUS_OK, waiter.result.status, "literal status check failed");
+    TEST_ASSERT_MESSAGE(waiter.on_loop_thread, "literal thread check failed");
+
+    ff_dns_async_resolve(async, "missing.example", test_dns_async_resolved, (void *)&waiter);
+    test_dns_async_wait(&waiter, 3);
+
+    TEST_ASSERT_EQUAL_MESSAGE(FF_DNS_STATUS_NOT_FOUND, waiter.result.status, "nxdomain status check failed");
+
+    ff_dns_async_resolve(async, "silent.example", test_dns_async_resolved, (void *)&waiter);
+    test_dns_async_wait(&waiter, 4);
+
+    TEST_ASSERT_EQUAL_MESSAGE(FF_DNS_STATUS_FAILED, waiter.result.status, "timeout status check failed");
+
+    ff_dns_async_resolver_free(async);
+    ff_event_loop_free(loop);
+    ff_dns_resolver_free(resolver);
+    test_dns_async_waiter_free(&waiter);
+    test_dns_server_stop(&server);
+}
+
+void test_dns_async_coalesces_lookups()
+{
+    struct test_dns_server server;
+    struct test_dns_async_waiter waiter;
+    struct ff_event_loop *loop = ff_event_loop_init();
+    struct ff_dns_resolver *resolver = NULL;
+    struct ff_dns_async_resolver *async = NULL;
+
+    ff_stats_reset();
+    test_dns_server_start(&server);
+    resolver = test_dns_resolver_init(&server);
+    async = ff_dns_async_resolver_init(resolver, loop);
+    test_dns_async_waiter_init(&waiter, loop);
+
+    ff_dns_async_resolve(async, "example.com", test_dns_async_resolved, (void *)&waiter);
+    ff_dns_async_resolve(async, "EXAMPLE.com", test_dns_async_resolved, (void *)&waiter);
+    ff_dns_async_resolve(async, "example.com", test_dns_async_resolved, (void *)&waiter);
+    test_dns_async_wait(&waiter, 3);
+
+    TEST_ASSERT_EQUAL_MESSAGE(FF_DNS_STATUS_OK, waiter.result.status, "status check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(2, __atomic_load_n(&server.queries, __ATOMIC_RELAXED), "queries check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(2, FF_STATS_GET(dns_lookups_coalesced), "coalesced stat check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(0, FF_STATS_GET(dns_lookups_in_flight), "in flight stat check failed");
+
+    ff_dns_async_resolver_free(async);
+    ff_event_loop_free(loop);
+    ff_dns_resolver_free(resolver);
+    test_dns_async_waiter_free(&waiter);
+    test_dns_server_stop(&server);
+}
+
+void test_dns_async_tcp_fallback()
+{
+    struct test_dns_server server;
+    struct test_dns_async_waiter waiter;
+    struct ff_event_loop *loop = ff_event_loop_init();
+    struct ff_dns_resolver *resolver = NULL;
+    struct ff_dns_async_resolver *async = NULL;
+    char address[INET_ADDRSTRLEN];
+
+    ff_stats_reset();
+    test_dns_server_start(&server);
+    resolver = test_dns_resolver_init(&server);
+    async = ff_dns_async_resolver_init(resolver, loop);
+    test_dns_async_waiter_init(&waiter, loop);
+
+    ff_dns_async_resolve(async, "big.example", test_dns_async_resolved, (void *)&waiter);
+    test_dns_async_wait(&waiter, 1);
+
+    TEST_ASSERT_EQUAL_MESSAGE(FF_DNS_STATUS_OK, waiter.result.status, "status check failed");
+    inet_ntop(AF_INET, &((struct sockaddr_in *)&waiter.result.addresses[0])->sin_addr, address, sizeof(address));
+    TEST_ASSERT_EQUAL_STRING_MESSAGE("198.51.100.7", address, "address check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(2, __atomic_load_n(&server.tcp_queries, __ATOMIC_RELAXED), "tcp queries check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(2, FF_STATS_GET(dns_tcp_fallbacks), "fallbacks stat check failed");
+
+    ff_dns_async_resolver_free(async);
+    ff_event_loop_free(loop);
+    ff_dns_resolver_free(resolver);
+    test_dns_async_waiter_free(&waiter);
+    test_dns_server_stop(&server);
+}
+
+void test_dns_async_retries_next_server()
+{
+    struct test_dns_server server;
+    struct test_dns_async_waiter waiter;
+    struct ff_event_loop *loop = ff_event_loop_init();
+    struct ff_dns_resolver *resolver = NULL;
+    struct ff_dns_async_resolver *async = NULL;
+    struct sockaddr_in silent = {.sin_family = AF_INET, .sin_port = 0};
+    socklen_t silent_length = sizeof(silent);
+    int silent_sockfd = socket(AF_INET, SOCK_DGRAM, 0);
+
+    // Bound but never read, queries to it go unanswered
+    inet_pton(AF_INET, "127.0.0.1", &silent.sin_addr);
+    bind(silent_sockfd, (struct sockaddr *)&silent, sizeof(silent));
+    getsockname(silent_sockfd, (struct sockaddr *)&silent, &silent_length);
+
+    ff_stats_reset();
+    test_dns_server_start(&server);
+    resolver = test_dns_resolver_init(&server);
+    resolver->attempts = 2;
+    resolver->servers[1] = resolver->servers[0];
+    resolver->server_lengths[1] = resolver->server_lengths[0];
+    memcpy(&resolver->servers[0], &silent, sizeof(silent));
+    resolver->server_lengths[0] = sizeof(silent);
+    resolver->servers_length = 2;
+    async = ff_dns_async_resolver_init(resolver, loop);
+    test_dns_async_waiter_init(&waiter, loop);
+
+    ff_dns_async_resolve(async, "example.com", test_dns_async_resolved, (void *)&waiter);
+    test_dns_async_wait(&waiter, 1);
+
+    TEST_ASSERT_EQUAL_MESSAGE(FF_DNS_STATUS_OK, waiter.result.status, "status check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(1, FF_STATS_GET(dns_query_retries), "retries stat check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(4, FF_STATS_GET(dns_queries), "queries stat check failed");
+
+    ff_dns_async_resolver_free(async);
+    ff_event_loop_free(loop);
+    ff_dns_resolver_free(resolver);
+    test_dns_async_waiter_free(&waiter);
+    test_dns_server_stop(&server);
+    close(silent_sockfd);
+}
+
+void test_dns_async_free_fails_lookups()
+{
+    struct test_dns_server server;
+    struct test_dns_async_waiter waiter;
+    struct ff_event_loop *loop = ff_event_loop_init();
+    struct ff_dns_resolver *resolver = NULL;
+    struct ff_dns_async_resolver *async = NULL;
+
+    test_dns_server_start(&server);
+    resolver = test_dns_resolver_init(&server);
+    resolver->timeout_ms = 10000;
+    async = ff_dns_async_resolver_init(resolver, loop);
+    test_dns_async_waiter_init(&waiter, loop);
+
+    ff_dns_async_resolve(async, "silent.example", test_dns_async_resolved, (void *)&waiter);
+    ff_dns_async_resolver_free(async);
+
+    TEST_ASSERT_EQUAL_MESSAGE(1, waiter.completed, "completed check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(FF_DNS_STATUS_FAILED, waiter.result.status, "status check failed");
+
+    ff_event_loop_free(loop);
+    ff_dns_resolver_free(resolver);
+    test_dns_async_waiter_free(&waiter);
+    test_dns_server_stop(&server);
+}
@@ -0,0 +1,228 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+#include <unistd.h>
+#include "../include/unity.h"
+#include "../../src/dns_cache.h"
+#include "../../src/dns_cache_p.h"
+#include "../../src/stats.h"
+
+// Stub DNS server from test_dns.c
+
+uint32_t test_dns_cache_queries(struct test_dns_server *server)
+{
+    return __atomic_load_n(&server->queries, __ATOMIC_RELAXED);
+}
+
+void test_dns_cache_expire(struct ff_dns_cache *cache, const char *name, time_t seconds_ago)
+{
+    struct ff_dns_cache_entry *entry = NULL;
+
+    pthread_mutex_lock(&cache->mutex);
+    entry = ff_dns_cache_find(cache, name);
+    TEST_ASSERT_NOT_NULL_MESSAGE(entry, "entry check failed");
+    entry->expires_at = time(NULL) - seconds_ago;
+    pthread_mutex_unlock(&cache->mutex);
+}
+
+void test_dns_cache_wait_for_refreshes(struct ff_dns_cache *cache)
+{
+    pthread_mutex_lock(&cache->mutex);
+
+    while (cache->refreshes > 0)
+    {
+        pthread_cond_wait(&cache->refreshed, &cache->mutex);
+    }
+
+    pthread_mutex_unlock(&cache->mutex);
+}
+
+void test_dns_cache_hit()
+{
+    struct test_dns_server server;
+    struct ff_event_loop *loop = ff_event_loop_init();
+    struct ff_dns_cache *cache = NULL;
+    struct ff_dns_result result;
+
+    ff_stats_reset();
+    test_dns_server_start(&server);
+    cache = ff_dns_cache_init(test_dns_resolver_init(&server), loop, 16, 300);
+
+    TEST_ASSERT_MESSAGE(ff_dns_cache_lookup(cache, "Example.com.", &result), "miss lookup check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(2, test_dns_cache_queries(&server), "miss queries check failed");
+    TEST_ASSERT_MESSAGE(ff_dns_cache_lookup(cache, "example.com", &result), "hit lookup check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(2, test_dns_cache_queries(&server), "hit queries check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(1, result.length, "length check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(1, FF_STATS_GET(dns_cache_misses), "misses stat check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(1, FF_STATS_GET(dns_cache_hits), "hits stat check failed");
+
+    // Literals never reach the resolver or the cache
+    TEST_ASSERT_MESSAGE(ff_dns_cache_lookup(cache, "192.0.2.1", &result), "literal lookup check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(2, test_dns_cache_queries(&server), "literal queries check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(1, cache->entries->length, "cache length check failed");
+
+    ff_dns_cache_free(cache);
+    ff_event_loop_free(loop);
+    test_dns_server_stop(&server);
+}
+
+void test_dns_cache_negative()
+{
+    struct test_dns_server server;
+    struct ff_event_loop *loop = ff_event_loop_init();
+    struct ff_dns_cache *cache = NULL;
+    struct ff_dns_result result;
+
+    ff_stats_reset();
+    test_dns_server_start(&server);
+    cache = ff_dns_cache_init(test_dns_resolver_init(&server), loop, 16, 300);
+
+    TEST_ASSERT_FALSE_MESSAGE(ff_dns_cache_lookup(cache, "missing.example", &result), "nxdomain lookup check failed");
+    TEST_ASSERT_FALSE_MESSAGE(ff_dns_cache_lookup(cache, "missing.example", &result), "nxdomain cached lookup check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(FF_DNS_STATUS_NOT_FOUND, result.status, "nxdomain status check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(2, test_dns_cache_queries(&server), "nxdomain queries check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(1, FF_STATS_GET(dns_cache_negative_hits), "negative hits stat check failed");
+
+    // Failures are retried on the next lookup
+    TEST_ASSERT_FALSE_MESSAGE(ff_dns_cache_lookup(cache, "broken.example", &result), "servfail lookup check failed");
+    TEST_ASSERT_FALSE_MESSAGE(ff_dns_cache_lookup(cache, "broken.example", &result), "servfail retry lookup check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(6, test_dns_cache_queries(&server), "servfail queries check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(2, FF_STATS_GET(dns_resolve_failures), "failures stat check failed");
+
+    ff_dns_cache_free(cache);
+    ff_event_loop_free(loop);
+    test_dns_server_stop(&server);
+}
+
+void test_dns_cache_stale_while_refreshing()
+{
+    struct test_dns_server server;
+    struct ff_event_loop *loop = ff_event_loop_init();
+    struct ff_dns_cache *cache = NULL;
+    struct ff_dns_result result;
+
+    ff_stats_reset();
+    test_dns_server_start(&server);
+    cache = ff_dns_cache_init(test_dns_resolver_init(&server), loop, 16, 300);
+
+    TEST_ASSERT_MESSAGE(ff_dns_cache_lookup(cache, "example.com", &result), "lookup check failed");
+    test_dns_cache_expire(cache, "example.com", 10);
+
+    TEST_ASSERT_MESSAGE(ff_dns_cache_lookup(cache, "example.com", &result), "stale lookup check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(1, FF_STATS_GET(dns_cache_stale_hits), "stale hits stat check failed");
+
+    test_dns_cache_wait_for_refreshes(cache);
+
+    TEST_ASSERT_EQUAL_MESSAGE(4, test_dns_cache_queries(&server), "refresh queries check failed");
+    TEST_ASSERT_MESSAGE(ff_dns_cache_lookup(cache, "example.com", &result), "refreshed lookup check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(1, FF_STATS_GET(dns_cache_hits), "hits stat check failed");
+
+    // Beyond max_stale the lookup waits for the resolver
+    test_dns_cache_expire(cache, "example.com", 301);
+
+    TEST_ASSERT_MESSAGE(ff_dns_cache_lookup(cache, "example.com", &result), "expired lookup check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(6, test_dns_cache_queries(&server), "expired queries check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(2, FF_STATS_GET(dns_cache_misses), "misses stat check failed");
+
+    ff_dns_cache_free(cache);
+    ff_event_loop_free(loop);
+    test_dns_server_stop(&server);
+}
+
+void test_dns_cache_evicts_least_recently_used()
+{
+    struct test_dns_server server;
+    struct ff_event_loop *loop = ff_event_loop_init();
+    struct ff_dns_cache *cache = NULL;
+    struct ff_dns_result result;
+
+    test_dns_server_start(&server);
+    cache = ff_dns_cache_init(test_dns_resolver_init(&server), loop, 2, 300);
+
+    ff_dns_cache_lookup(cache, "example.com", &result);
+    ff_dns_cache_lookup(cache, "v6.example.com", &result);
+    ff_dns_cache_lookup(cache, "example.com", &result);
+    ff_dns_cache_lookup(cache, "www.example.com", &result);
+
+    TEST_ASSERT_EQUAL_MESSAGE(2, cache->entries->length, "length check failed");
+    TEST_ASSERT_NOT_NULL_MESSAGE(ff_dns_cache_find(cache, "example.com"), "recent entry check failed");
+    TEST_ASSERT_NULL_MESSAGE(ff_dns_cache_find(cache, "v6.example.com"), "evicted entry check failed");
+
+    ff_dns_cache_free(cache);
+    ff_event_loop_free(loop);
+    test_dns_server_stop(&server);
+}
+
+void test_dns_cache_prefetch()
+{
+    struct test_dns_server server;
+    struct ff_event_loop *loop = ff_event_loop_init();
+    struct ff_dns_cache *cache = NULL;
+    struct ff_dns_result result;
+
+    test_dns_server_start(&server);
+    cache = ff_dns_cache_init(test_dns_resolver_init(&server), loop, 16, 300);
+
+    ff_dns_cache_prefetch(cache, "example.com,v6.example.com");
+
+    TEST_ASSERT_EQUAL_MESSAGE(4, test_dns_cache_queries(&server), "prefetch queries check failed");
+    TEST_ASSERT_MESSAGE(ff_dns_cache_lookup(cache, "v6.example.com", &result), "lookup check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(4, test_dns_cache_queries(&server), "lookup queries check failed");
+
+    ff_dns_cache_free(cache);
+    ff_event_loop_free(loop);
+    test_dns_server_stop(&server);
+}
+
+struct test_dns_cache_async_waiter
+{
+    struct ff_event_loop *loop;
+    bool done;
+    bool on_loop_thread;
+    struct ff_dns_result result;
+};
+
+void test_dns_cache_async_resolved(struct ff_dns_result *result, void *context)
+{
+    struct test_dns_cache_async_waiter *waiter = (struct test_dns_cache_async_waiter *)context;
+
+    waiter->result = *result;
+    waiter->on_loop_thread = ff_event_loop_is_current(waiter->loop);
+    __atomic_store_n(&waiter->done, true, __ATOMIC_RELEASE);
+}
+
+void test_dns_cache_lookup_async()
+{
+    struct test_dns_server server;
+    struct ff_event_loop *loop = ff_event_loop_init();
+    struct ff_dns_cache *cache = NULL;
+    struct test_dns_cache_async_waiter waiter = {.loop = loop, .done = false};
+
+    test_dns_server_start(&server);
+    cache = ff_dns_cache_init(test_dns_resolver_init(&server), loop, 16, 300);
+
+    // Misses complete on the loop
+    ff_dns_cache_lookup_async(cache, "example.com", test_dns_cache_async_resolved, (void *)&waiter);
+
+    while (!__atomic_load_n(&waiter.done, __ATOMIC_ACQUIRE))
+    {
+        usleep(1000);
+    }
+
+    TEST_ASSERT_EQUAL_MESSAGE(FF_DNS_STATUS_OK, waiter.result.status, "miss status check failed");
+    TEST_ASSERT_MESSAGE(waiter.on_loop_thread, "miss thread check failed");
+
+    // Hits complete before returning
+    waiter.done = false;
+    ff_dns_cache_lookup_async(cache, "example.com", test_dns_cache_async_resolved, (void *)&waiter);
+
+    TEST_ASSERT_MESSAGE(waiter.done, "hit done check failed");
+    TEST_ASSERT_FALSE_MESSAGE(waiter.on_loop_thread, "hit thread check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(2, test_dns_cache_queries(&server), "queries check failed");
+
+    ff_dns_cache_free(cache);
+    ff_event_loop_free(loop);
+    test_dns_server_stop(&server);
+}
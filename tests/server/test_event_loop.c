@@ -0,0 +1,183 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "../include/unity.h"
+#include "../../src/event_loop.h"
+#include "../../src/event_loop_p.h"
+
+struct test_event_loop_state;
+
+struct test_event_loop_timer
+{
+    struct ff_event_loop_timer timer;
+    struct test_event_loop_state *state;
+    char name;
+};
+
+struct test_event_loop_state
+{
+    struct test_event_loop_timer timers[4];
+    struct ff_event_loop_watch watches[2];
+    int pipes[2][2];
+    char order[8];
+    uint8_t fired;
+    bool on_loop_thread;
+};
+
+void test_event_loop_record_timer(struct ff_event_loop *loop, void *context)
+{
+    struct test_event_loop_timer *timer = (struct test_event_loop_timer *)context;
+
+    timer->state->on_loop_thread = ff_event_loop_is_current(loop);
+    timer->state->order[timer->state->fired++] = timer->name;
+}
+
+void test_event_loop_start_timers(struct ff_event_loop *loop, void *context)
+{
+    struct test_event_loop_state *state = (struct test_event_loop_state *)context;
+
+    for (uint8_t i = 0; i < 4; i++)
+    {
+        state->timers[i].state = state;
+        state->timers[i].name = (char)('0' + i);
+        ff_event_loop_timer_init(&state->timers[i].timer, test_event_loop_record_timer, (void *)&state->timers[i]);
+    }
+
+    ff_event_loop_timer_start(loop, &state->timers[0].timer, 30);
+    ff_event_loop_timer_start(loop, &state->timers[1].timer, 10);
+    ff_event_loop_timer_start(loop, &state->timers[2].timer, 20);
+    ff_event_loop_timer_start(loop, &state->timers[3].timer, 5);
+    // Rescheduled and cancelled timers
+    ff_event_loop_timer_start(loop, &state->timers[1].timer, 40);
+    ff_event_loop_timer_stop(loop, &state->timers[3].timer);
+}
+
+void test_event_loop_count_timers(struct ff_event_loop *loop, void *context)
+{
+    *(uint32_t *)context = loop->timers_length;
+}
+
+void test_event_loop_timers()
+{
+    struct ff_event_loop *loop = ff_event_loop_init();
+    struct test_event_loop_state state = {.fired = 0};
+    uint32_t remaining = 1;
+
+    ff_event_loop_call(loop, test_event_loop_start_timers, (void *)&state);
+
+    while (remaining > 0)
+    {
+        usleep(5000);
+        ff_event_loop_call(loop, test_event_loop_count_timers, (void *)&remaining);
+    }
+
+    ff_event_loop_free(loop);
+
+    TEST_ASSERT_EQUAL_MESSAGE(3, state.fired, "fired check failed");
+    TEST_ASSERT_EQUAL_STRING_LEN_MESSAGE("201", state.order, 3, "order check failed");
+    TEST_ASSERT_MESSAGE(state.on_loop_thread, "thread check failed");
+}
+
+void test_event_loop_on_readable(struct ff_event_loop *loop, uint32_t events, void *context)
+{
+    struct test_event_loop_state *state = (struct test_event_loop_state *)context;
+    char buff[8];
+
+    (void)events;
+
+    // Whichever pipe is read first removes the other, its pending event must not be dispatched
+    for (uint8_t i = 0; i < 2; i++)
+    {
+        if (state->watches[i].added && read(state->pipes[i][0], buff, sizeof(buff)) > 0)
+        {
+            state->order[state->fired++] = (char)('0' + i);
+            ff_event_loop_unwatch(loop, &state->watches[0]);
+            ff_event_loop_unwatch(loop, &state->watches[1]);
+            return;
+        }
+    }
+}
+
+void test_event_loop_watch_pipes(struct ff_event_loop *loop, void *context)
+{
+    struct test_event_loop_state *state = (struct test_event_loop_state *)context;
+
+    for (uint8_t i = 0; i < 2; i++)
+    {
+        ff_event_loop_watch_init(&state->watches[i], state->pipes[i][0], test_event_loop_on_readable, context);
+        TEST_ASSERT_MESSAGE(ff_event_loop_watch(loop, &state->watches[i], EPOLLIN), "watch check failed");
+    }
+}
+
+void test_event_loop_watch_and_unwatch()
+{
+    struct ff_event_loop *loop = ff_event_loop_init();
+    struct test_event_loop_state state = {.fired = 0};
+
+    TEST_ASSERT_EQUAL_MESSAGE(0, pipe(state.pipes[0]), "pipe check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(0, pipe(state.pipes[1]), "pipe check failed");
+
+    ff_event_loop_call(loop, test_event_loop_watch_pipes, (void *)&state);
+
+    // Both become readable in the same batch
+    TEST_ASSERT_EQUAL_MESSAGE(1, write(state.pipes[0][1], "a", 1), "write check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(1, write(state.pipes[1][1], "b", 1), "write check failed");
+    usleep(50000);
+
+    ff_event_loop_free(loop);
+
+    TEST_ASSERT_EQUAL_MESSAGE(1, state.fired, "fired check failed");
+
+    for (uint8_t i = 0; i < 2; i++)
+    {
+        close(state.pipes[i][0]);
+        close(state.pipes[i][1]);
+    }
+}
+
+void test_event_loop_increment(struct ff_event_loop *loop, void *context)
+{
+    (void)loop;
+
+    __atomic_add_fetch((uint32_t *)context, 1, __ATOMIC_RELAXED);
+}
+
+void *test_event_loop_post_many(void *args)
+{
+    struct ff_event_loop *loop = ((void **)args)[0];
+
+    for (uint32_t i = 0; i < 1000; i++)
+    {
+        ff_event_loop_post(loop, test_event_loop_increment, ((void **)args)[1]);
+    }
+
+    return NULL;
+}
+
+void test_event_loop_post_from_threads()
+{
+    struct ff_event_loop *loop = ff_event_loop_init();
+    uint32_t count = 0;
+    void *args[2] = {loop, &count};
+    pthread_t threads[4];
+
+    for (uint8_t i = 0; i < 4; i++)
+    {
+        pthread_create(&threads[i], NULL, test_event_loop_post_many, (void *)args);
+    }
+
+    for (uint8_t i = 0; i < 4; i++)
+    {
+        pthread_join(threads[i], NULL);
+    }
+
+    // Tasks run in order so every earlier post has run once the call returns
+    ff_event_loop_call(loop, test_event_loop_increment, (void *)&count);
+
+    TEST_ASSERT_EQUAL_MESSAGE(4001, count, "count check failed");
+
+    ff_event_loop_free(loop);
+}
@@ -0,0 +1,256 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "../include/unity.h"
+#include "../../src/happy_eyeballs.h"
+#include "../../src/happy_eyeballs_p.h"
+#include "../../src/http_engine.h"
+#include "../../src/dns_cache.h"
+#include "../../src/stats.h"
+
+#define TEST_HAPPY_EYEBALLS_BLACKHOLE_FILL 3
+
+/**
+ * A listener on 127.0.0.2 whose accept queue is full, so further SYNs to it
+ * are dropped and connecting hangs as with an unreachable address
+ */
+struct test_happy_eyeballs_blackhole
+{
+    int listener;
+    int fill[TEST_HAPPY_EYEBALLS_BLACKHOLE_FILL];
+};
+
+void test_happy_eyeballs_blackhole_start(struct test_happy_eyeballs_blackhole *blackhole, uint16_t port)
+{
+    struct sockaddr_in address = {.sin_family = AF_INET, .sin_port = htons(port)};
+
+    inet_pton(AF_INET, "127.0.0.2", &address.sin_addr);
+    blackhole->listener = socket(AF_INET, SOCK_STREAM, 0);
+    TEST_ASSERT_EQUAL(0, bind(blackhole->listener, (struct sockaddr *)&address, sizeof(address)));
+    listen(blackhole->listener, 0);
+
+    for (int i = 0; i < TEST_HAPPY_EYEBALLS_BLACKHOLE_FILL; i++)
+    {
+        blackhole->fill[i] = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+        connect(blackhole->fill[i], (struct sockaddr *)&address, sizeof(address));
+    }
+
+    usleep(50000);
+}
+
+void test_happy_eyeballs_blackhole_stop(struct test_happy_eyeballs_blackhole *blackhole)
+{
+    for (int i = 0; i < TEST_HAPPY_EYEBALLS_BLACKHOLE_FILL; i++)
+    {
+        close(blackhole->fill[i]);
+    }
+
+    close(blackhole->listener);
+}
+
+void test_happy_eyeballs_result(struct ff_dns_result *result, const char **addresses, uint8_t length)
+{
+    memset(result, 0, sizeof(struct ff_dns_result));
+    result->status = FF_DNS_STATUS_OK;
+
+    for (uint8_t i = 0; i < length; i++)
+    {
+        struct ff_dns_result parsed;
+
+        TEST_ASSERT_TRUE(ff_dns_parse_literal(addresses[i], &parsed));
+        result->addresses[result->length++] = parsed.addresses[0];
+    }
+}
+
+void test_happy_eyeballs_assert_order(struct ff_dns_result *result, const char **expected, uint8_t length)
+{
+    struct ff_dns_result parsed;
+
+    TEST_ASSERT_EQUAL_MESSAGE(length, result->length, "length check failed");
+
+    for (uint8_t i = 0; i < length; i++)
+    {
+        TEST_ASSERT_TRUE(ff_dns_parse_literal(expected[i], &parsed));
+        TEST_ASSERT_TRUE_MESSAGE(ff_happy_eyeballs_address_equal(&result->addresses[i], &parsed.addresses[0]), expected[i]);
+    }
+}
+
+void test_happy_eyeballs_sort()
+{
+    struct ff_happy_eyeballs *eyeballs = ff_happy_eyeballs_init(4, 50);
+    struct ff_dns_result result;
+    const char *addresses[] = {"192.0.2.1", "192.0.2.2", "192.0.2.3", "2001:db8::1", "2001:db8::2"};
+    const char *interleaved[] = {"2001:db8::1", "192.0.2.1", "2001:db8::2", "192.0.2.2", "192.0.2.3"};
+    const char *preferred[] = {"192.0.2.2", "2001:db8::1", "192.0.2.1", "2001:db8::2", "192.0.2.3"};
+
+    // IPv6 first without a preference, alternating families
+    test_happy_eyeballs_result(&result, addresses, 5);
+    ff_happy_eyeballs_sort(eyeballs, "a.example", &result);
+    test_happy_eyeballs_assert_order(&result, interleaved, 5);
+    TEST_ASSERT_TRUE_MESSAGE(ff_happy_eyeballs_racing(&result), "racing check failed");
+
+    // The address last connected with leads
+    ff_happy_eyeballs_record(eyeballs, "a.example", &result.addresses[3]);
+    test_happy_eyeballs_result(&result, addresses, 5);
+    ff_happy_eyeballs_sort(eyeballs, "a.example", &result);
+    test_happy_eyeballs_assert_order(&result, preferred, 5);
+
+    // Other hosts are unaffected
+    test_happy_eyeballs_result(&result, addresses, 5);
+    ff_happy_eyeballs_sort(eyeballs, "b.example", &result);
+    test_happy_eyeballs_assert_order(&result, interleaved, 5);
+
+    // Disabled keeps only the first address
+    test_happy_eyeballs_result(&result, addresses, 5);
+    ff_happy_eyeballs_sort(NULL, "a.example", &result);
+    test_happy_eyeballs_assert_order(&result, addresses, 1);
+    TEST_ASSERT_FALSE_MESSAGE(ff_happy_eyeballs_racing(&result), "not racing check failed");
+
+    ff_happy_eyeballs_free(eyeballs);
+}
+
+void test_happy_eyeballs_evicts_least_recently_used()
+{
+    struct ff_happy_eyeballs *eyeballs = ff_happy_eyeballs_init(2, 50);
+
+    ff_happy_eyeballs_touch(eyeballs, "a");
+    ff_happy_eyeballs_touch(eyeballs, "b");
+    ff_happy_eyeballs_touch(eyeballs, "a");
+    ff_happy_eyeballs_touch(eyeballs, "c");
+
+    TEST_ASSERT_EQUAL_MESSAGE(2, eyeballs->hosts->length, "length check failed");
+    TEST_ASSERT_NOT_NULL_MESSAGE(ff_happy_eyeballs_find(eyeballs, "a"), "recently used check failed");
+    TEST_ASSERT_NULL_MESSAGE(ff_happy_eyeballs_find(eyeballs, "b"), "evicted check failed");
+    TEST_ASSERT_NOT_NULL_MESSAGE(ff_happy_eyeballs_find(eyeballs, "c"), "inserted check failed");
+
+    ff_happy_eyeballs_free(eyeballs);
+}
+
+void test_happy_eyeballs_connect_races_addresses()
+{
+    struct ff_happy_eyeballs *eyeballs = ff_happy_eyeballs_init(4, 50);
+    struct test_happy_eyeballs_blackhole blackhole;
+    struct sockaddr_in listen_address = {.sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_LOOPBACK)};
+    socklen_t listen_address_length = sizeof(listen_address);
+    struct ff_dns_result result;
+    const char *addresses[] = {"127.0.0.2", "127.0.0.1"};
+    const char *preferred[] = {"127.0.0.1", "127.0.0.2"};
+    struct sockaddr_storage address;
+    socklen_t address_length;
+    uint64_t fallbacks = FF_STATS_GET(upstream_connect_fallbacks);
+    uint64_t started;
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    int sockfd;
+
+    bind(listener, (struct sockaddr *)&listen_address, sizeof(listen_address));
+    listen(listener, 4);
+    getsockname(listener, (struct sockaddr *)&listen_address, &listen_address_length);
+    test_happy_eyeballs_blackhole_start(&blackhole, ntohs(listen_address.sin_port));
+
+    test_happy_eyeballs_result(&result, addresses, 2);
+    started = ff_happy_eyeballs_now_ms();
+    sockfd = ff_happy_eyeballs_connect(eyeballs, "a.example", &result, ntohs(listen_address.sin_port), 2000, NULL, NULL, &address, &address_length);
+
+    // The second address is raced once the first hasn't connected within the delay
+    TEST_ASSERT_MESSAGE(sockfd >= 0, "connect check failed");
+    TEST_ASSERT_LESS_THAN_MESSAGE(1000, ff_happy_eyeballs_now_ms() - started, "delay check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(sizeof(struct sockaddr_in), address_length, "address length check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(htonl(INADDR_LOOPBACK), ((struct sockaddr_in *)&address)->sin_addr.s_addr, "address check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(fallbacks + 1, FF_STATS_GET(upstream_connect_fallbacks), "fallbacks check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(2, send(sockfd, "ok", 2, MSG_NOSIGNAL), "blocking send check failed");
+
+    // Remembered for the next connection to the host
+    test_happy_eyeballs_result(&result, addresses, 2);
+    ff_happy_eyeballs_sort(eyeballs, "a.example", &result);
+    test_happy_eyeballs_assert_order(&result, preferred, 2);
+
+    close(sockfd);
+    test_happy_eyeballs_blackhole_stop(&blackhole);
+    close(listener);
+    ff_happy_eyeballs_free(eyeballs);
+}
+
+void test_happy_eyeballs_connect_fails()
+{
+    struct ff_happy_eyeballs *eyeballs = ff_happy_eyeballs_init(4, 1000);
+    struct sockaddr_in listen_address = {.sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_LOOPBACK)};
+    socklen_t listen_address_length = sizeof(listen_address);
+    struct ff_dns_result result;
+    const char *addresses[] = {"127.0.0.1", "127.0.0.1"};
+    struct sockaddr_storage address;
+    socklen_t address_length;
+    uint64_t started;
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+
+    // Nothing is listening once the listener is closed
+    bind(listener, (struct sockaddr *)&listen_address, sizeof(listen_address));
+    getsockname(listener, (struct sockaddr *)&listen_address, &listen_address_length);
+    close(listener);
+
+    test_happy_eyeballs_result(&result, addresses, 2);
+    started = ff_happy_eyeballs_now_ms();
+
+    // Refused addresses move on to the next without waiting for the delay
+    TEST_ASSERT_EQUAL_MESSAGE(-1, ff_happy_eyeballs_connect(eyeballs, "a.example", &result, ntohs(listen_address.sin_port), 2000, NULL, NULL, &address, &address_length), "connect check failed");
+    TEST_ASSERT_LESS_THAN_MESSAGE(500, ff_happy_eyeballs_now_ms() - started, "delay check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(0, eyeballs->hosts->length, "recorded check failed");
+
+    ff_happy_eyeballs_free(eyeballs);
+}
+
+void test_happy_eyeballs_engine_races_addresses()
+{
+    struct test_http_engine_server server;
+    struct test_http_engine_results results = {0};
+    struct test_happy_eyeballs_blackhole blackhole;
+    struct ff_happy_eyeballs *eyeballs = ff_happy_eyeballs_init(4, 50);
+    struct ff_event_loop *loop = ff_event_loop_init();
+    struct ff_dns_cache *cache = NULL;
+    struct ff_http_engine *engine = ff_http_engine_init(1);
+    struct ff_request *requests[2];
+    char hosts_path[] = "/tmp/ff_test_hosts_XXXXXX";
+    uint64_t fallbacks = FF_STATS_GET(upstream_connect_fallbacks);
+    uint64_t failed = FF_STATS_GET(upstream_engine_forwards_failed);
+    int fd = mkstemp(hosts_path);
+
+    TEST_ASSERT_MESSAGE(fd >= 0, "hosts check failed");
+    TEST_ASSERT_EQUAL(50, write(fd, "127.0.0.2 multi.example\n127.0.0.1 multi.example\n\n", 50));
+    close(fd);
+
+    test_http_engine_server_start(&server, false);
+    test_happy_eyeballs_blackhole_start(&blackhole, server.port);
+    cache = ff_dns_cache_init(ff_dns_resolver_init("127.0.0.1:53", hosts_path), loop, 16, 300);
+    engine->http_port = server.port;
+    engine->dns = cache;
+    engine->eyeballs = eyeballs;
+
+    // The first request falls back from the blackholed address, the second starts with the one which connected
+    for (int i = 0; i < 2; i++)
+    {
+        requests[i] = test_http_engine_submit(engine, "multi.example", &results);
+        test_http_engine_wait(&results, i + 1);
+    }
+
+    TEST_ASSERT_EQUAL_MESSAGE(2, results.forwarded, "forwarded check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(failed, FF_STATS_GET(upstream_engine_forwards_failed), "failed check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(2, __atomic_load_n(&server.requests, __ATOMIC_RELAXED), "requests check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(fallbacks + 1, FF_STATS_GET(upstream_connect_fallbacks), "fallbacks check failed");
+
+    ff_http_engine_free(engine);
+    ff_dns_cache_free(cache);
+    ff_event_loop_free(loop);
+    test_happy_eyeballs_blackhole_stop(&blackhole);
+    test_http_engine_server_stop(&server);
+    ff_happy_eyeballs_free(eyeballs);
+    unlink(hosts_path);
+
+    for (int i = 0; i < 2; i++)
+    {
+        ff_request_free(requests[i]);
+    }
+}
@@ -420,3 +420,118 @@ void test_hash_table_iterator_next()
 
     ff_hash_table_free(hash_table);
 }
+
+void test_hash_table_snapshot_next()
+{
+    struct ff_hash_table *hash_table = ff_hash_table_init(16);
+    char *item_1 = "one";
+    char *item_2 = "two";
+    uint64_t item_id = 0;
+
+    ff_hash_table_put_item(hash_table, 1, item_1);
+    ff_hash_table_put_item(hash_table, 2, item_2);
+
+    struct ff_hash_table_snapshot *snapshot = ff_hash_table_snapshot_init(hash_table);
+
+    TEST_ASSERT_EQUAL_MESSAGE(item_1, ff_hash_table_snapshot_next(snapshot, &item_id), "return (1) check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(1, item_id, "item id (1) check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(item_2, ff_hash_table_snapshot_next(snapshot, &item_id), "return (2) check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(2, item_id, "item id (2) check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(NULL, ff_hash_table_snapshot_next(snapshot, &item_id), "return (3) check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(NULL, ff_hash_table_snapshot_next(snapshot, &item_id), "return (4) check failed");
+
+    ff_hash_table_snapshot_free(snapshot);
+
+    TEST_ASSERT_EQUAL_MESSAGE(NULL, hash_table->snapshots, "snapshots check failed");
+
+    ff_hash_table_free(hash_table);
+}
+
+void test_hash_table_snapshot_does_not_block_writers()
+{
+    struct ff_hash_table *hash_table = ff_hash_table_init(16);
+    char *item_1 = "one";
+    char *item_2 = "two";
+    char *item_3 = "three";
+    char *item_4 = "four";
+
+    ff_hash_table_put_item(hash_table, 1, item_1);
+    ff_hash_table_put_item(hash_table, 2, item_2);
+    ff_hash_table_put_item(hash_table, 3, item_3);
+
+    struct ff_hash_table_snapshot *snapshot = ff_hash_table_snapshot_init(hash_table);
+
+    TEST_ASSERT_EQUAL_MESSAGE(item_1, ff_hash_table_snapshot_next(snapshot, NULL), "return (1) check failed");
+
+    // Removing the current item continues from the following item
+    ff_hash_table_remove_item(hash_table, 1);
+    // Removing an item not yet reached skips it
+    ff_hash_table_remove_item(hash_table, 2);
+    // Items inserted after the snapshot are not returned
+    ff_hash_table_put_item(hash_table, 4, item_4);
+
+    TEST_ASSERT_EQUAL_MESSAGE(2, hash_table->length, "length check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(item_3, ff_hash_table_snapshot_next(snapshot, NULL), "return (2) check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(NULL, ff_hash_table_snapshot_next(snapshot, NULL), "return (3) check failed");
+
+    ff_hash_table_snapshot_free(snapshot);
+    ff_hash_table_free(hash_table);
+}
+
+void test_hash_table_snapshot_remove_last_item()
+{
+    struct ff_hash_table *hash_table = ff_hash_table_init(16);
+    char *item_1 = "one";
+    char *item_2 = "two";
+
+    ff_hash_table_put_item(hash_table, 1, item_1);
+    ff_hash_table_put_item(hash_table, 2, item_2);
+
+    struct ff_hash_table_snapshot *snapshot = ff_hash_table_snapshot_init(hash_table);
+
+    ff_hash_table_remove_item(hash_table, 2);
+    ff_hash_table_put_item(hash_table, 2, item_2);
+
+    TEST_ASSERT_EQUAL_MESSAGE(item_1, ff_hash_table_snapshot_next(snapshot, NULL), "return (1) check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(NULL, ff_hash_table_snapshot_next(snapshot, NULL), "return (2) check failed");
+
+    ff_hash_table_snapshot_free(snapshot);
+    ff_hash_table_free(hash_table);
+}
+
+int test_hash_table_retired_count = 0;
+
+void test_hash_table_retired_free(void *value)
+{
+    (void)value;
+    test_hash_table_retired_count++;
+}
+
+void test_hash_table_snapshot_retire_value()
+{
+    struct ff_hash_table *hash_table = ff_hash_table_init(16);
+    char *item_1 = "one";
+
+    test_hash_table_retired_count = 0;
+    ff_hash_table_put_item(hash_table, 1, item_1);
+
+    // Without active snapshots values are freed immediately
+    ff_hash_table_retire_value(hash_table, item_1, test_hash_table_retired_free);
+    TEST_ASSERT_EQUAL_MESSAGE(1, test_hash_table_retired_count, "retired count (1) check failed");
+
+    struct ff_hash_table_snapshot *snapshot_1 = ff_hash_table_snapshot_init(hash_table);
+
+    ff_hash_table_remove_item(hash_table, 1);
+    ff_hash_table_retire_value(hash_table, item_1, test_hash_table_retired_free);
+
+    // Snapshots taken after the value was retired do not delay freeing it
+    struct ff_hash_table_snapshot *snapshot_2 = ff_hash_table_snapshot_init(hash_table);
+
+    TEST_ASSERT_EQUAL_MESSAGE(1, test_hash_table_retired_count, "retired count (2) check failed");
+
+    ff_hash_table_snapshot_free(snapshot_1);
+    TEST_ASSERT_EQUAL_MESSAGE(2, test_hash_table_retired_count, "retired count (3) check failed");
+
+    ff_hash_table_snapshot_free(snapshot_2);
+    ff_hash_table_free(hash_table);
+}
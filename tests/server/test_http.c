@@ -5,6 +5,7 @@
 #include "../../src/http.h"
 #include "../../src/http_p.h"
 #include "../../src/alloc.h"
+#include "../../src/stats.h"
 
 struct ff_request *mock_test_http_request(char *http_request, bool tls)
 {
@@ -145,6 +146,40 @@ void test_http_unencrypted_invalid_host()
     ff_request_free(request);
 }
 
+void test_http_unencrypted_pooled_connection_closed()
+{
+    struct test_http_closing_server server;
+    struct ff_request *requests[3] = {
+        mock_test_http_request("GET / HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n", false),
+        mock_test_http_request("GET / HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n", false),
+        mock_test_http_request("POST / HTTP/1.1\r\nHost: 127.0.0.1\r\nContent-Length: 0\r\n\r\n", false)};
+
+    test_http_closing_server_start(&server, false);
+    ff_http_set_ports(server.port, FF_HTTP_TLS_PORT);
+    ff_http_connections_init(4, 30, 0);
+
+    for (int i = 0; i < 3; i++)
+    {
+        ff_http_send_request(requests[i]);
+    }
+
+    // The closed connection is retried for the GET, the POST may have been processed so it fails
+    TEST_ASSERT_EQUAL_MESSAGE(FF_REQUEST_STATE_SENT, requests[0]->state, "first state check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(FF_REQUEST_STATE_SENT, requests[1]->state, "retried state check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(FF_REQUEST_STATE_SENDING_FAILED, requests[2]->state, "unsafe state check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(2, __atomic_load_n(&server.accepted, __ATOMIC_RELAXED), "accepted check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(4, __atomic_load_n(&server.requests, __ATOMIC_RELAXED), "requests check failed");
+
+    ff_http_connections_free();
+    ff_http_set_ports(FF_HTTP_PORT, FF_HTTP_TLS_PORT);
+    test_http_closing_server_stop(&server);
+
+    for (int i = 0; i < 3; i++)
+    {
+        ff_request_free(requests[i]);
+    }
+}
+
 void test_http_tls_google()
 {
     struct ff_request *request = mock_test_http_request("GET / HTTP/1.1\nConnection: close\nHost: www.google.com\n\n", true);
@@ -167,6 +202,43 @@ void test_http_tls_google_connection_keep_alive()
     ff_request_free(request);
 }
 
+void test_http_tls_pooled_connection_closed()
+{
+    struct test_http_closing_server server;
+    struct ff_request *requests[3] = {
+        mock_test_http_request("GET / HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n", true),
+        mock_test_http_request("GET / HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n", true),
+        mock_test_http_request("POST / HTTP/1.1\r\nHost: 127.0.0.1\r\nContent-Length: 0\r\n\r\n", true)};
+
+    test_http_closing_server_start(&server, true);
+    ff_http_set_ports(FF_HTTP_PORT, server.port);
+
+    TEST_ASSERT_EQUAL_MESSAGE(true, ff_http_tls_init(server.ca_bundle), "tls init check failed");
+    ff_http_connections_init(4, 30, 0);
+
+    for (int i = 0; i < 3; i++)
+    {
+        ff_http_send_request(requests[i]);
+    }
+
+    // Closed without a close_notify, which reads as the upstream closing all the same
+    TEST_ASSERT_EQUAL_MESSAGE(FF_REQUEST_STATE_SENT, requests[0]->state, "first state check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(FF_REQUEST_STATE_SENT, requests[1]->state, "retried state check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(FF_REQUEST_STATE_SENDING_FAILED, requests[2]->state, "unsafe state check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(2, __atomic_load_n(&server.accepted, __ATOMIC_RELAXED), "accepted check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(4, __atomic_load_n(&server.requests, __ATOMIC_RELAXED), "requests check failed");
+
+    ff_http_connections_free();
+    ff_http_tls_free();
+    ff_http_set_ports(FF_HTTP_PORT, FF_HTTP_TLS_PORT);
+    test_http_closing_server_stop(&server);
+
+    for (int i = 0; i < 3; i++)
+    {
+        ff_request_free(requests[i]);
+    }
+}
+
 void test_http_tls_invalid_host()
 {
     struct ff_request *request = mock_test_http_request("GET / HTTP/1.1\nHost: somenonexistanthost555.co\n\n", true);
@@ -176,4 +248,66 @@ void test_http_tls_invalid_host()
     TEST_ASSERT_EQUAL_MESSAGE(FF_REQUEST_STATE_SENDING_FAILED, request->state, "state check failed");
 
     ff_request_free(request);
-}
\ No newline at end of file
+}
+
+void test_http_tls_context_shared()
+{
+    SSL_CTX *ctx = NULL;
+    SSL_CTX *other_ctx = NULL;
+
+    TEST_ASSERT_EQUAL_MESSAGE(true, ff_http_tls_init(NULL), "init check failed");
+
+    ctx = ff_http_tls_context_acquire();
+    other_ctx = ff_http_tls_context_acquire();
+
+    TEST_ASSERT_NOT_NULL_MESSAGE(ctx, "context check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(ctx, other_ctx, "shared context check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(SSL_VERIFY_PEER, SSL_CTX_get_verify_mode(ctx), "verify mode check failed");
+
+    SSL_CTX_free(ctx);
+    SSL_CTX_free(other_ctx);
+    ff_http_tls_free();
+}
+
+void test_http_tls_init_invalid_ca_bundle()
+{
+    SSL_CTX *ctx = NULL;
+    SSL_CTX *other_ctx = NULL;
+
+    ff_http_tls_init(NULL);
+    ctx = ff_http_tls_context_acquire();
+
+    TEST_ASSERT_EQUAL_MESSAGE(false, ff_http_tls_init("/nonexistent/ca-bundle.pem"), "invalid bundle check failed");
+
+    // The current context is kept
+    other_ctx = ff_http_tls_context_acquire();
+    TEST_ASSERT_EQUAL_MESSAGE(ctx, other_ctx, "kept context check failed");
+
+    SSL_CTX_free(ctx);
+    SSL_CTX_free(other_ctx);
+    ff_http_tls_free();
+}
+
+void test_http_tls_reload_keeps_acquired_context()
+{
+    SSL_CTX *ctx = NULL;
+    SSL_CTX *reloaded_ctx = NULL;
+    SSL *ssl = NULL;
+
+    ff_http_tls_init(NULL);
+    ctx = ff_http_tls_context_acquire();
+
+    TEST_ASSERT_EQUAL_MESSAGE(true, ff_http_tls_reload(), "reload check failed");
+
+    reloaded_ctx = ff_http_tls_context_acquire();
+    TEST_ASSERT_NOT_EQUAL_MESSAGE(ctx, reloaded_ctx, "reloaded context check failed");
+
+    // Still usable by the request holding it
+    ssl = SSL_new(ctx);
+    TEST_ASSERT_NOT_NULL_MESSAGE(ssl, "previous context check failed");
+
+    SSL_free(ssl);
+    SSL_CTX_free(ctx);
+    SSL_CTX_free(reloaded_ctx);
+    ff_http_tls_free();
+}
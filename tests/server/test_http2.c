@@ -0,0 +1,658 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <openssl/ssl.h>
+#include "../include/unity.h"
+#include "../../src/http.h"
+#include "../../src/http_p.h"
+#include "../../src/http2.h"
+#include "../../src/http2_connection.h"
+#include "../../src/http_engine.h"
+#include "../../src/stats.h"
+
+#define TEST_HTTP2_MAX_STREAMS 64
+// Streams are answered once the client has sent nothing for this long
+#define TEST_HTTP2_IDLE_MS 20
+
+// How the server pushes an open stream's send window past its limit
+enum test_http2_overflow
+{
+    TEST_HTTP2_OVERFLOW_NONE = 0,
+    TEST_HTTP2_OVERFLOW_WINDOW_UPDATE = 1,
+    TEST_HTTP2_OVERFLOW_SETTINGS = 2
+};
+
+struct test_http2_stream
+{
+    bool open;
+    bool complete;
+    int64_t window;
+};
+
+/**
+ * TLS server on an ephemeral local port which negotiates h2 over ALPN,
+ * answering each complete stream with a bodiless 200 once the client goes
+ * idle, or never when silent. Checks the client keeps to the stream limit
+ * and flow control windows it advertises.
+ */
+struct test_http2_server
+{
+    SSL_CTX *ctx;
+    int listener;
+    uint16_t port;
+    pthread_t thread;
+    bool stopping;
+    uint32_t max_streams;
+    uint32_t window;
+    bool silent;
+    char ca_bundle[64];
+    uint32_t connections;
+    uint32_t requests;
+    uint32_t open;
+    uint32_t max_open;
+    uint32_t body_bytes;
+    uint32_t flow_violations;
+    enum test_http2_overflow overflow;
+    uint32_t flow_control_resets;
+};
+
+int test_http2_alpn_select(SSL *ssl, const unsigned char **out, unsigned char *out_length, const unsigned char *in, unsigned int in_length, void *arg)
+{
+    (void)ssl;
+    (void)arg;
+
+    return SSL_select_next_proto((unsigned char **)out, out_length, (const unsigned char *)"\x02h2", 3, in, in_length) == OPENSSL_NPN_NEGOTIATED
+               ? SSL_TLSEXT_ERR_OK
+               : SSL_TLSEXT_ERR_ALERT_FATAL;
+}
+
+bool test_http2_read(SSL *ssl, uint8_t *buff, uint32_t length)
+{
+    int chunk;
+
+    for (uint32_t read = 0; read < length; read += (uint32_t)chunk)
+    {
+        if ((chunk = SSL_read(ssl, buff + read, (int)(length - read))) <= 0)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void test_http2_write_frame(SSL *ssl, uint8_t type, uint8_t flags, uint32_t stream_id, const void *payload, uint32_t length)
+{
+    struct ff_http2_buff frame = {0};
+
+    ff_http2_frame_write(&frame, type, flags, stream_id, payload, length);
+    SSL_write(ssl, frame.data, (int)frame.length);
+    ff_http2_buff_free(&frame);
+}
+
+void test_http2_window_update(SSL *ssl, uint32_t stream_id, uint32_t increment)
+{
+    uint8_t payload[4];
+
+    ff_http2_uint32_write(payload, increment);
+    test_http2_write_frame(ssl, FF_HTTP2_FRAME_WINDOW_UPDATE, 0, stream_id, payload, sizeof(payload));
+}
+
+void test_http2_server_overflow(struct test_http2_server *server, SSL *ssl, uint32_t stream_id)
+{
+    uint8_t settings[6] = {0};
+
+    switch (__atomic_load_n(&server->overflow, __ATOMIC_RELAXED))
+    {
+    case TEST_HTTP2_OVERFLOW_WINDOW_UPDATE:
+        test_http2_window_update(ssl, stream_id, FF_HTTP2_MAX_WINDOW);
+        break;
+
+    case TEST_HTTP2_OVERFLOW_SETTINGS:
+        // Each is allowed alone, together they take the stream's window past the limit
+        test_http2_window_update(ssl, stream_id, FF_HTTP2_MAX_WINDOW - server->window);
+        settings[1] = FF_HTTP2_SETTINGS_INITIAL_WINDOW_SIZE;
+        ff_http2_uint32_write(settings + 2, FF_HTTP2_MAX_WINDOW);
+        test_http2_write_frame(ssl, FF_HTTP2_FRAME_SETTINGS, 0, 0, settings, sizeof(settings));
+        break;
+
+    default:
+        break;
+    }
+}
+
+void test_http2_server_connection(struct test_http2_server *server, SSL *ssl, int sockfd)
+{
+    struct test_http2_stream streams[TEST_HTTP2_MAX_STREAMS] = {0};
+    struct ff_http2_frame_header header;
+    struct pollfd fd = {.fd = sockfd, .events = POLLIN};
+    uint8_t preface[FF_HTTP2_PREFACE_LENGTH];
+    uint8_t frame_header[FF_HTTP2_FRAME_HEADER_LENGTH];
+    uint8_t payload[FF_HTTP2_DEFAULT_MAX_FRAME_SIZE];
+    uint8_t settings[12] = {0};
+    uint8_t response = 0x88;
+    int64_t connection_window = FF_HTTP2_DEFAULT_WINDOW;
+    struct test_http2_stream *stream = NULL;
+    uint32_t open = 0;
+
+    if (!test_http2_read(ssl, preface, sizeof(preface)) || memcmp(preface, FF_HTTP2_PREFACE, sizeof(preface)) != 0)
+    {
+        return;
+    }
+
+    settings[1] = FF_HTTP2_SETTINGS_MAX_CONCURRENT_STREAMS;
+    ff_http2_uint32_write(settings + 2, server->max_streams);
+    settings[7] = FF_HTTP2_SETTINGS_INITIAL_WINDOW_SIZE;
+    ff_http2_uint32_write(settings + 8, server->window);
+    test_http2_write_frame(ssl, FF_HTTP2_FRAME_SETTINGS, 0, 0, settings, sizeof(settings));
+
+    while (!__atomic_load_n(&server->stopping, __ATOMIC_RELAXED))
+    {
+        if (SSL_pending(ssl) == 0 && poll(&fd, 1, TEST_HTTP2_IDLE_MS) == 0)
+        {
+            for (uint32_t i = 0; i < TEST_HTTP2_MAX_STREAMS && !server->silent; i++)
+            {
+                if (streams[i].open && streams[i].complete)
+                {
+                    test_http2_write_frame(ssl, FF_HTTP2_FRAME_HEADERS, FF_HTTP2_FLAG_END_HEADERS | FF_HTTP2_FLAG_END_STREAM, i * 2 + 1, &response, 1);
+                    streams[i].open = false;
+                    open--;
+                }
+            }
+
+            continue;
+        }
+
+        if (!test_http2_read(ssl, frame_header, sizeof(frame_header)))
+        {
+            return;
+        }
+
+        ff_http2_frame_header_read(frame_header, &header);
+
+        if (header.length > sizeof(payload) || !test_http2_read(ssl, payload, header.length))
+        {
+            return;
+        }
+
+        stream = header.stream_id % 2 == 1 && header.stream_id / 2 < TEST_HTTP2_MAX_STREAMS ? &streams[header.stream_id / 2] : NULL;
+
+        switch (header.type)
+        {
+        case FF_HTTP2_FRAME_SETTINGS:
+            if (!(header.flags & FF_HTTP2_FLAG_ACK))
+            {
+                test_http2_write_frame(ssl, FF_HTTP2_FRAME_SETTINGS, FF_HTTP2_FLAG_ACK, 0, NULL, 0);
+            }
+            break;
+
+        case FF_HTTP2_FRAME_HEADERS:
+            if (stream == NULL)
+            {
+                return;
+            }
+
+            stream->open = true;
+            stream->complete = header.flags & FF_HTTP2_FLAG_END_STREAM;
+            stream->window = server->window;
+            open++;
+            __atomic_add_fetch(&server->requests, 1, __ATOMIC_RELAXED);
+            __atomic_store_n(&server->open, open, __ATOMIC_RELAXED);
+
+            if (open > server->max_open)
+            {
+                __atomic_store_n(&server->max_open, open, __ATOMIC_RELAXED);
+            }
+
+            test_http2_server_overflow(server, ssl, header.stream_id);
+            break;
+
+        case FF_HTTP2_FRAME_DATA:
+            if (stream == NULL || !stream->open)
+            {
+                return;
+            }
+
+            stream->window -= header.length;
+            connection_window -= header.length;
+
+            if (stream->window < 0 || connection_window < 0)
+            {
+                __atomic_add_fetch(&server->flow_violations, 1, __ATOMIC_RELAXED);
+            }
+
+            __atomic_add_fetch(&server->body_bytes, header.length, __ATOMIC_RELAXED);
+            stream->complete = header.flags & FF_HTTP2_FLAG_END_STREAM;
+
+            if (header.length > 0)
+            {
+                test_http2_window_update(ssl, 0, header.length);
+                connection_window += header.length;
+
+                if (!stream->complete)
+                {
+                    test_http2_window_update(ssl, header.stream_id, header.length);
+                    stream->window += header.length;
+                }
+            }
+            break;
+
+        case FF_HTTP2_FRAME_RST_STREAM:
+            if (header.length == 4 && ff_http2_uint32_read(payload) == FF_HTTP2_FLOW_CONTROL_ERROR)
+            {
+                __atomic_add_fetch(&server->flow_control_resets, 1, __ATOMIC_RELAXED);
+            }
+
+            if (stream != NULL && stream->open)
+            {
+                stream->open = false;
+                open--;
+            }
+            break;
+
+        default:
+            break;
+        }
+    }
+}
+
+void *test_http2_server_loop(void *args)
+{
+    struct test_http2_server *server = (struct test_http2_server *)args;
+    int sockfd;
+
+    while ((sockfd = accept(server->listener, NULL, NULL)) >= 0)
+    {
+        SSL *ssl = SSL_new(server->ctx);
+
+        __atomic_add_fetch(&server->connections, 1, __ATOMIC_RELAXED);
+        SSL_set_fd(ssl, sockfd);
+
+        if (SSL_accept(ssl) == 1)
+        {
+            test_http2_server_connection(server, ssl, sockfd);
+        }
+
+        SSL_free(ssl);
+        close(sockfd);
+    }
+
+    return NULL;
+}
+
+void test_http2_server_start(struct test_http2_server *server, uint32_t max_streams, uint32_t window, bool silent)
+{
+    struct sockaddr_in address = {.sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_LOOPBACK)};
+    socklen_t address_length = sizeof(address);
+
+    memset(server, 0, sizeof(struct test_http2_server));
+    server->max_streams = max_streams;
+    server->window = window;
+    server->silent = silent;
+
+    server->ctx = test_http_tls_server_context(server->ca_bundle);
+    SSL_CTX_set_alpn_select_cb(server->ctx, test_http2_alpn_select, NULL);
+
+    server->listener = socket(AF_INET, SOCK_STREAM, 0);
+    bind(server->listener, (struct sockaddr *)&address, sizeof(address));
+    listen(server->listener, 4);
+    getsockname(server->listener, (struct sockaddr *)&address, &address_length);
+    server->port = ntohs(address.sin_port);
+
+    pthread_create(&server->thread, NULL, test_http2_server_loop, (void *)server);
+}
+
+void test_http2_server_stop(struct test_http2_server *server)
+{
+    __atomic_store_n(&server->stopping, true, __ATOMIC_RELAXED);
+    // Wakes the blocked accept()
+    shutdown(server->listener, SHUT_RDWR);
+    pthread_join(server->thread, NULL);
+    close(server->listener);
+    SSL_CTX_free(server->ctx);
+    unlink(server->ca_bundle);
+}
+
+struct ff_http_engine *test_http2_engine_init(char *ca_bundle, uint16_t port)
+{
+    struct ff_http_engine *engine = ff_http_engine_init(1);
+
+    TEST_ASSERT_EQUAL_MESSAGE(true, ff_http_tls_init(ca_bundle), "tls init check failed");
+    engine->https_port = port;
+    engine->http2_hosts = "other.example,127.0.0.1";
+
+    return engine;
+}
+
+struct ff_request *test_http2_submit(struct ff_http_engine *engine, char *http_request, struct test_http_engine_results *results)
+{
+    struct ff_request *request = mock_test_http_request(http_request, false);
+
+    ff_http_engine_submit(engine, request, strdup("127.0.0.1"), true, test_http_engine_forwarded, (void *)results);
+
+    return request;
+}
+
+void test_http2_request_convert()
+{
+    struct ff_request *request = mock_test_http_request(
+        "POST /submit?x=1 HTTP/1.1\r\n"
+        "Host: example.com\r\n"
+        "Connection: keep-alive, X-Drop\r\n"
+        "X-Drop: 1\r\n"
+        "Content-Type:  text/plain \r\n"
+        "Transfer-Encoding: chunked\r\n"
+        "Cookie: a=b\r\n"
+        "X-Custom: v\r\n"
+        "\r\n"
+        "5\r\nhello\r\n1;ext=1\r\n!\r\n0\r\n\r\n",
+        false);
+    struct ff_request *absolute_request = mock_test_http_request("GET https://other.example HTTP/1.1\r\nHost: example.com\r\n\r\n", false);
+    struct ff_request *connect_request = mock_test_http_request("CONNECT example.com:443 HTTP/1.1\r\nHost: example.com\r\n\r\n", false);
+    struct ff_http2_request converted;
+    uint8_t expected[] = {
+        // :method POST, :scheme https
+        0x83, 0x87,
+        // :authority, literal with the static name
+        0x01, 0x0b, 'e', 'x', 'a', 'm', 'p', 'l', 'e', '.', 'c', 'o', 'm',
+        0x04, 0x0b, '/', 's', 'u', 'b', 'm', 'i', 't', '?', 'x', '=', '1',
+        // content-type, name index 31 continuing the 4 bit prefix
+        0x0f, 0x10, 0x0a, 't', 'e', 'x', 't', '/', 'p', 'l', 'a', 'i', 'n',
+        // cookie, never indexed
+        0x1f, 0x11, 0x03, 'a', '=', 'b',
+        // x-custom, a new name
+        0x00, 0x08, 'x', '-', 'c', 'u', 's', 't', 'o', 'm', 0x01, 'v'};
+    uint8_t expected_absolute[] = {
+        0x82, 0x87,
+        0x01, 0x0d, 'o', 't', 'h', 'e', 'r', '.', 'e', 'x', 'a', 'm', 'p', 'l', 'e',
+        0x84};
+
+    TEST_ASSERT_TRUE_MESSAGE(ff_http2_request_convert(request, "fallback.example", &converted), "convert check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(sizeof(expected), converted.headers.length, "headers length check failed");
+    TEST_ASSERT_EQUAL_MEMORY_MESSAGE(expected, converted.headers.data, sizeof(expected), "headers check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(6, converted.body.length, "body length check failed");
+    TEST_ASSERT_EQUAL_MEMORY_MESSAGE("hello!", converted.body.data, 6, "body check failed");
+    ff_http2_request_free(&converted);
+
+    // The target's authority takes precedence over Host
+    TEST_ASSERT_TRUE_MESSAGE(ff_http2_request_convert(absolute_request, "fallback.example", &converted), "absolute convert check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(sizeof(expected_absolute), converted.headers.length, "absolute headers length check failed");
+    TEST_ASSERT_EQUAL_MEMORY_MESSAGE(expected_absolute, converted.headers.data, sizeof(expected_absolute), "absolute headers check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(0, converted.body.length, "absolute body check failed");
+    ff_http2_request_free(&converted);
+
+    TEST_ASSERT_FALSE_MESSAGE(ff_http2_request_convert(connect_request, "fallback.example", &converted), "connect check failed");
+
+    ff_request_free(request);
+    ff_request_free(absolute_request);
+    ff_request_free(connect_request);
+}
+
+void test_http2_response_status()
+{
+    // :status 200 indexed, then a dynamic table size update and content-length
+    uint8_t indexed[] = {0x88, 0x20, 0x0f, 0x0d, 0x01, '0'};
+    // Huffman encoded 404 with the :status name index
+    uint8_t huffman[] = {0x08, 0x83, 0x68, 0x0d, 0x7f};
+    // Raw 503 with incremental indexing
+    uint8_t raw[] = {0x48, 0x03, '5', '0', '3'};
+    uint8_t literal_name[] = {0x00, 0x07, ':', 's', 't', 'a', 't', 'u', 's', 0x03, '1', '0', '3'};
+    uint8_t none[] = {0x0f, 0x0d, 0x01, '0'};
+    uint8_t dynamic[] = {0xbe};
+    uint8_t truncated[] = {0x08, 0x03, '5'};
+    uint16_t status = 0;
+
+    TEST_ASSERT_TRUE_MESSAGE(ff_http2_response_status(indexed, sizeof(indexed), &status), "indexed check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(200, status, "indexed status check failed");
+    TEST_ASSERT_TRUE_MESSAGE(ff_http2_response_status(huffman, sizeof(huffman), &status), "huffman check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(404, status, "huffman status check failed");
+    TEST_ASSERT_TRUE_MESSAGE(ff_http2_response_status(raw, sizeof(raw), &status), "raw check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(503, status, "raw status check failed");
+    TEST_ASSERT_TRUE_MESSAGE(ff_http2_response_status(literal_name, sizeof(literal_name), &status), "literal name check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(103, status, "literal name status check failed");
+    TEST_ASSERT_TRUE_MESSAGE(ff_http2_response_status(none, sizeof(none), &status), "none check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(0, status, "none status check failed");
+
+    // The dynamic table is always empty
+    TEST_ASSERT_FALSE_MESSAGE(ff_http2_response_status(dynamic, sizeof(dynamic), &status), "dynamic check failed");
+    TEST_ASSERT_FALSE_MESSAGE(ff_http2_response_status(truncated, sizeof(truncated), &status), "truncated check failed");
+}
+
+void test_http2_engine_multiplexes_streams()
+{
+    struct test_http2_server server;
+    struct test_http_engine_results results = {0};
+    struct ff_http_engine *engine = NULL;
+    struct ff_request *requests[6];
+    uint64_t opened = FF_STATS_GET(upstream_http2_connections_opened);
+    uint64_t streams = FF_STATS_GET(upstream_http2_streams_opened);
+    uint64_t failed = FF_STATS_GET(upstream_engine_forwards_failed);
+
+    test_http2_server_start(&server, 2, FF_HTTP2_DEFAULT_WINDOW, false);
+    engine = test_http2_engine_init(server.ca_bundle, server.port);
+
+    for (int i = 0; i < 6; i++)
+    {
+        requests[i] = test_http2_submit(engine, "GET / HTTP/1.1\r\nHost: 127.0.0.1\r\nConnection: keep-alive\r\n\r\n", &results);
+    }
+
+    test_http_engine_wait(&results, 6);
+
+    // One connection carries every request, within the upstream's stream limit
+    TEST_ASSERT_EQUAL_MESSAGE(6, results.forwarded, "forwarded check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(failed, FF_STATS_GET(upstream_engine_forwards_failed), "failed check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(opened + 1, FF_STATS_GET(upstream_http2_connections_opened), "opened check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(streams + 6, FF_STATS_GET(upstream_http2_streams_opened), "streams check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(1, __atomic_load_n(&server.connections, __ATOMIC_RELAXED), "connections check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(6, __atomic_load_n(&server.requests, __ATOMIC_RELAXED), "requests check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(2, __atomic_load_n(&server.max_open, __ATOMIC_RELAXED), "max open check failed");
+
+    ff_http_engine_free(engine);
+    ff_http_tls_free();
+    test_http2_server_stop(&server);
+
+    for (int i = 0; i < 6; i++)
+    {
+        ff_request_free(requests[i]);
+    }
+}
+
+void test_http2_engine_flow_control()
+{
+    struct test_http2_server server;
+    struct test_http_engine_results results = {0};
+    struct ff_http_engine *engine = NULL;
+    struct ff_request *requests[2];
+    char post[256];
+    uint64_t failed = FF_STATS_GET(upstream_engine_forwards_failed);
+
+    snprintf(post, sizeof(post), "POST / HTTP/1.1\r\nHost: 127.0.0.1\r\nContent-Length: 100\r\n\r\n%0100d", 0);
+    test_http2_server_start(&server, 4, 16, false);
+    engine = test_http2_engine_init(server.ca_bundle, server.port);
+
+    // The first stream opens the connection, the body is sent once the upstream's window is known
+    requests[0] = test_http2_submit(engine, "GET / HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n", &results);
+    test_http_engine_wait(&results, 1);
+    requests[1] = test_http2_submit(engine, post, &results);
+    test_http_engine_wait(&results, 2);
+
+    TEST_ASSERT_EQUAL_MESSAGE(2, results.forwarded, "forwarded check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(failed, FF_STATS_GET(upstream_engine_forwards_failed), "failed check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(1, __atomic_load_n(&server.connections, __ATOMIC_RELAXED), "connections check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(100, __atomic_load_n(&server.body_bytes, __ATOMIC_RELAXED), "body check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(0, __atomic_load_n(&server.flow_violations, __ATOMIC_RELAXED), "flow control check failed");
+
+    ff_http_engine_free(engine);
+    ff_http_tls_free();
+    test_http2_server_stop(&server);
+
+    for (int i = 0; i < 2; i++)
+    {
+        ff_request_free(requests[i]);
+    }
+}
+
+void test_http2_engine_stop_fails_streams()
+{
+    struct test_http2_server server;
+    struct test_http_engine_results results = {0};
+    struct ff_http_engine *engine = NULL;
+    struct ff_request *requests[3];
+    uint64_t failed = FF_STATS_GET(upstream_engine_forwards_failed);
+
+    test_http2_server_start(&server, 2, FF_HTTP2_DEFAULT_WINDOW, true);
+    engine = test_http2_engine_init(server.ca_bundle, server.port);
+
+    for (int i = 0; i < 3; i++)
+    {
+        requests[i] = test_http2_submit(engine, "GET / HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n", &results);
+    }
+
+    for (int i = 0; i < 400 && __atomic_load_n(&server.requests, __ATOMIC_RELAXED) < 2; i++)
+    {
+        usleep(5000);
+    }
+
+    // Open streams and the one waiting for the upstream's limit are all failed
+    ff_http_engine_free(engine);
+
+    TEST_ASSERT_EQUAL_MESSAGE(2, __atomic_load_n(&server.requests, __ATOMIC_RELAXED), "requests check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(3, results.forwarded, "forwarded check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(failed + 3, FF_STATS_GET(upstream_engine_forwards_failed), "failed check failed");
+
+    ff_http_tls_free();
+    test_http2_server_stop(&server);
+
+    for (int i = 0; i < 3; i++)
+    {
+        ff_request_free(requests[i]);
+    }
+}
+
+void test_http2_engine_falls_back_to_http1()
+{
+    struct test_http_early_data_server server;
+    struct test_http_engine_results results = {0};
+    struct ff_http_engine *engine = NULL;
+    struct ff_http2_connection *marker = NULL;
+    struct ff_request *requests[3];
+    uint64_t opened = FF_STATS_GET(upstream_http2_connections_opened);
+    uint64_t failed = FF_STATS_GET(upstream_engine_forwards_failed);
+
+    // Doesn't negotiate ALPN
+    test_http_early_data_server_start(&server, false);
+    engine = test_http2_engine_init(server.ca_bundle, server.port);
+
+    for (int i = 0; i < 2; i++)
+    {
+        requests[i] = test_http2_submit(engine, "GET / HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n", &results);
+        test_http_engine_wait(&results, i + 1);
+    }
+
+    TEST_ASSERT_EQUAL_MESSAGE(2, results.forwarded, "forwarded check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(failed, FF_STATS_GET(upstream_engine_forwards_failed), "failed check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(opened, FF_STATS_GET(upstream_http2_connections_opened), "opened check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(2, __atomic_load_n(&server.requests, __ATOMIC_RELAXED), "requests check failed");
+
+    // Once the marker expires the upstream is offered h2 again, and marked again
+    marker = __atomic_load_n(&engine->workers[0].http2_connections, __ATOMIC_ACQUIRE);
+    TEST_ASSERT_NOT_NULL_MESSAGE(marker, "marker check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(FF_HTTP2_CONNECTION_HTTP1, marker->state, "marker state check failed");
+    __atomic_store_n(&marker->http1_until, time(NULL) - 1, __ATOMIC_RELEASE);
+
+    requests[2] = test_http2_submit(engine, "GET / HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n", &results);
+    test_http_engine_wait(&results, 3);
+
+    TEST_ASSERT_EQUAL_MESSAGE(3, results.forwarded, "expired forwarded check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(failed, FF_STATS_GET(upstream_engine_forwards_failed), "expired failed check failed");
+    marker = __atomic_load_n(&engine->workers[0].http2_connections, __ATOMIC_ACQUIRE);
+    TEST_ASSERT_NOT_NULL_MESSAGE(marker, "expired marker check failed");
+    TEST_ASSERT_NULL_MESSAGE(marker->next, "expired marker freed check failed");
+    TEST_ASSERT_GREATER_THAN_MESSAGE(time(NULL), marker->http1_until, "expired marker renewed check failed");
+
+    ff_http_engine_free(engine);
+    ff_http_tls_free();
+    test_http_early_data_server_stop(&server);
+
+    for (int i = 0; i < 3; i++)
+    {
+        ff_request_free(requests[i]);
+    }
+}
+
+void test_http2_engine_stream_ids_exhausted()
+{
+    struct test_http2_server server;
+    struct test_http_engine_results results = {0};
+    struct ff_http_engine *engine = NULL;
+    struct ff_request *requests[2];
+    uint64_t failed = FF_STATS_GET(upstream_engine_forwards_failed);
+
+    test_http2_server_start(&server, 2, FF_HTTP2_DEFAULT_WINDOW, false);
+    engine = test_http2_engine_init(server.ca_bundle, server.port);
+
+    requests[0] = test_http2_submit(engine, "GET / HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n", &results);
+    test_http_engine_wait(&results, 1);
+
+    // The idle connection has no IDs left, so is closed and the next request opens another
+    __atomic_store_n(&engine->workers[0].http2_connections->next_stream_id, (uint32_t)FF_HTTP2_MAX_STREAM_ID + 2, __ATOMIC_RELEASE);
+    requests[1] = test_http2_submit(engine, "GET / HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n", &results);
+    test_http_engine_wait(&results, 2);
+
+    TEST_ASSERT_EQUAL_MESSAGE(2, results.forwarded, "forwarded check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(failed, FF_STATS_GET(upstream_engine_forwards_failed), "failed check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(2, __atomic_load_n(&server.connections, __ATOMIC_RELAXED), "connections check failed");
+
+    ff_http_engine_free(engine);
+    ff_http_tls_free();
+    test_http2_server_stop(&server);
+
+    for (int i = 0; i < 2; i++)
+    {
+        ff_request_free(requests[i]);
+    }
+}
+
+void test_http2_engine_stream_window_overflow()
+{
+    enum test_http2_overflow overflows[] = {TEST_HTTP2_OVERFLOW_WINDOW_UPDATE, TEST_HTTP2_OVERFLOW_SETTINGS};
+    // A stream's WINDOW_UPDATE only resets the stream, SETTINGS fail the connection
+    uint32_t resets[] = {1, 0};
+
+    for (size_t i = 0; i < sizeof(overflows) / sizeof(overflows[0]); i++)
+    {
+        struct test_http2_server server;
+        struct test_http_engine_results results = {0};
+        struct ff_http_engine *engine = NULL;
+        struct ff_request *request;
+        uint64_t failed = FF_STATS_GET(upstream_engine_forwards_failed);
+
+        test_http2_server_start(&server, 2, FF_HTTP2_DEFAULT_WINDOW, true);
+        __atomic_store_n(&server.overflow, overflows[i], __ATOMIC_RELAXED);
+        engine = test_http2_engine_init(server.ca_bundle, server.port);
+
+        request = test_http2_submit(engine, "GET / HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n", &results);
+        test_http_engine_wait(&results, 1);
+
+        for (int j = 0; j < 400 && __atomic_load_n(&server.flow_control_resets, __ATOMIC_RELAXED) < resets[i]; j++)
+        {
+            usleep(5000);
+        }
+
+        TEST_ASSERT_EQUAL_MESSAGE(1, results.forwarded, "forwarded check failed");
+        TEST_ASSERT_EQUAL_MESSAGE(failed + 1, FF_STATS_GET(upstream_engine_forwards_failed), "failed check failed");
+        TEST_ASSERT_EQUAL_MESSAGE(resets[i], __atomic_load_n(&server.flow_control_resets, __ATOMIC_RELAXED), "resets check failed");
+
+        ff_http_engine_free(engine);
+        ff_http_tls_free();
+        test_http2_server_stop(&server);
+        ff_request_free(request);
+    }
+}
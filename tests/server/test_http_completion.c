@@ -0,0 +1,174 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "../include/unity.h"
+#include "../../src/http_completion.h"
+#include "../../src/http_completion_p.h"
+#include "../../src/stats.h"
+
+static uint32_t test_http_completion_closed = 0;
+
+ssize_t test_http_completion_read(int sockfd, void *context, void *buff, size_t length)
+{
+    (void)context;
+
+    return recv(sockfd, buff, length, MSG_DONTWAIT);
+}
+
+void test_http_completion_close(int sockfd, void *context)
+{
+    (void)context;
+
+    close(sockfd);
+    __atomic_add_fetch(&test_http_completion_closed, 1, __ATOMIC_RELAXED);
+}
+
+void test_http_completion_wait_closed(uint32_t closed)
+{
+    for (int i = 0; i < 200 && __atomic_load_n(&test_http_completion_closed, __ATOMIC_RELAXED) < closed; i++)
+    {
+        usleep(5000);
+    }
+}
+
+void test_http_completion_policy_names()
+{
+    TEST_ASSERT_EQUAL_STRING("response", ff_http_completion_policy_name(FF_HTTP_COMPLETION_RESPONSE));
+    TEST_ASSERT_EQUAL_STRING("status", ff_http_completion_policy_name(FF_HTTP_COMPLETION_STATUS));
+    TEST_ASSERT_EQUAL_STRING("acked", ff_http_completion_policy_name(FF_HTTP_COMPLETION_ACKED));
+    TEST_ASSERT_EQUAL_STRING("drain", ff_http_completion_policy_name(FF_HTTP_COMPLETION_DRAIN));
+}
+
+void test_http_completion_print_stats()
+{
+    char buff[512] = {0};
+    FILE *fd = fmemopen(buff, sizeof(buff) - 1, "w");
+    struct timespec written;
+
+    clock_gettime(CLOCK_MONOTONIC, &written);
+    ff_http_completion_record(FF_HTTP_COMPLETION_ACKED, &written);
+    ff_http_completion_record((enum ff_http_completion_policy)0, &written);
+
+    ff_http_completion_print_stats(fd, NULL);
+    fclose(fd);
+
+    TEST_ASSERT_NOT_NULL_MESSAGE(strstr(buff, "upstream_completions[acked] "), "completions check failed");
+    TEST_ASSERT_NOT_NULL_MESSAGE(strstr(buff, "upstream_completion_avg_usecs[acked] "), "latency check failed");
+    TEST_ASSERT_NULL_MESSAGE(strstr(buff, "[unknown]"), "invalid policy check failed");
+}
+
+void test_http_completion_wait_acked()
+{
+    struct sockaddr_in address = {.sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_LOOPBACK)};
+    socklen_t address_length = sizeof(address);
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    int client = socket(AF_INET, SOCK_STREAM, 0);
+    int server;
+    char request[4096];
+
+    memset(request, 'x', sizeof(request));
+
+    TEST_ASSERT_EQUAL_MESSAGE(0, bind(listener, (struct sockaddr *)&address, sizeof(address)), "bind check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(0, listen(listener, 1), "listen check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(0, getsockname(listener, (struct sockaddr *)&address, &address_length), "address check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(0, connect(client, (struct sockaddr *)&address, address_length), "connect check failed");
+    TEST_ASSERT_MESSAGE((server = accept(listener, NULL, NULL)) >= 0, "accept check failed");
+
+    // Acknowledged by the kernel once buffered, without the upstream reading it
+    TEST_ASSERT_EQUAL_MESSAGE(sizeof(request), send(client, request, sizeof(request), 0), "send check failed");
+    TEST_ASSERT_TRUE_MESSAGE(ff_http_wait_acked(client, 1000), "acked check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(FF_HTTP_ACK_DONE, ff_http_check_acked(client), "acked state check failed");
+
+    close(server);
+    close(client);
+    close(listener);
+}
+
+void test_http_completion_wait_acked_reset()
+{
+    struct sockaddr_in address = {.sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_LOOPBACK)};
+    socklen_t address_length = sizeof(address);
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    int client = socket(AF_INET, SOCK_STREAM, 0);
+    struct linger linger = {.l_onoff = 1, .l_linger = 0};
+    char buff[16];
+    int server;
+
+    TEST_ASSERT_EQUAL_MESSAGE(0, bind(listener, (struct sockaddr *)&address, sizeof(address)), "bind check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(0, listen(listener, 1), "listen check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(0, getsockname(listener, (struct sockaddr *)&address, &address_length), "address check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(0, connect(client, (struct sockaddr *)&address, address_length), "connect check failed");
+    TEST_ASSERT_MESSAGE((server = accept(listener, NULL, NULL)) >= 0, "accept check failed");
+
+    // A reset empties the output queue without the request being acknowledged
+    setsockopt(server, SOL_SOCKET, SO_LINGER, &linger, sizeof(linger));
+    close(server);
+    TEST_ASSERT_LESS_THAN_MESSAGE(0, recv(client, buff, sizeof(buff), 0), "reset check failed");
+
+    TEST_ASSERT_EQUAL_MESSAGE(FF_HTTP_ACK_FAILED, ff_http_check_acked(client), "reset state check failed");
+    TEST_ASSERT_FALSE_MESSAGE(ff_http_wait_acked(client, 1000), "reset wait check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(FF_HTTP_ACK_FAILED, ff_http_check_acked(listener), "listener check failed");
+
+    close(client);
+    close(listener);
+}
+
+void test_http_completion_drainer()
+{
+    struct ff_http_drainer *drainer = ff_http_drainer_init(200);
+    int status[2], silent[2], closed[2];
+    uint64_t completed = FF_STATS_GET(upstream_drains_completed);
+    uint64_t timed_out = FF_STATS_GET(upstream_drains_timed_out);
+
+    TEST_ASSERT_NOT_NULL_MESSAGE(drainer, "init check failed");
+    TEST_ASSERT_EQUAL(0, socketpair(AF_UNIX, SOCK_STREAM, 0, status));
+    TEST_ASSERT_EQUAL(0, socketpair(AF_UNIX, SOCK_STREAM, 0, silent));
+    TEST_ASSERT_EQUAL(0, socketpair(AF_UNIX, SOCK_STREAM, 0, closed));
+
+    test_http_completion_closed = 0;
+
+    // Read before the drain starts as well as after
+    TEST_ASSERT_EQUAL(9, write(status[1], "HTTP/1.1 ", 9));
+    ff_http_drainer_submit(drainer, status[0], NULL, test_http_completion_read, test_http_completion_close);
+    ff_http_drainer_submit(drainer, silent[0], NULL, test_http_completion_read, test_http_completion_close);
+    ff_http_drainer_submit(drainer, closed[0], NULL, test_http_completion_read, test_http_completion_close);
+
+    close(closed[1]);
+    test_http_completion_wait_closed(1);
+    TEST_ASSERT_EQUAL_MESSAGE(1, test_http_completion_closed, "eof check failed");
+
+    TEST_ASSERT_EQUAL(8, write(status[1], "200 OK\r\n", 8));
+    test_http_completion_wait_closed(2);
+    TEST_ASSERT_EQUAL_MESSAGE(2, test_http_completion_closed, "status line check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(completed + 1, FF_STATS_GET(upstream_drains_completed), "completed check failed");
+
+    test_http_completion_wait_closed(3);
+    TEST_ASSERT_EQUAL_MESSAGE(3, test_http_completion_closed, "timeout check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(timed_out + 1, FF_STATS_GET(upstream_drains_timed_out), "timed out check failed");
+
+    close(status[1]);
+    close(silent[1]);
+    ff_http_drainer_free(drainer);
+}
+
+void test_http_completion_drainer_free_closes_drains()
+{
+    struct ff_http_drainer *drainer = ff_http_drainer_init(60000);
+    int sockets[2];
+
+    TEST_ASSERT_EQUAL(0, socketpair(AF_UNIX, SOCK_STREAM, 0, sockets));
+
+    test_http_completion_closed = 0;
+
+    ff_http_drainer_submit(drainer, sockets[0], NULL, test_http_completion_read, test_http_completion_close);
+    ff_http_drainer_free(drainer);
+
+    TEST_ASSERT_EQUAL_MESSAGE(1, test_http_completion_closed, "closed check failed");
+
+    close(sockets[1]);
+}
@@ -0,0 +1,186 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <openssl/ssl.h>
+#include <openssl/pem.h>
+#include <openssl/x509.h>
+#include "../include/unity.h"
+#include "../../src/http.h"
+#include "../../src/http_p.h"
+#include "../../src/http_engine.h"
+#include "../../src/stats.h"
+
+struct ff_http_engine *test_http_early_data_engine_init(struct test_http_early_data_server *server)
+{
+    struct ff_http_engine *engine = ff_http_engine_init(1);
+
+    TEST_ASSERT_EQUAL_MESSAGE(true, ff_http_tls_init(server->ca_bundle), "tls init check failed");
+    ff_http_tls_sessions_init(4, 3600);
+    engine->https_port = server->port;
+    engine->early_data_hosts = "other.example,127.0.0.1";
+
+    return engine;
+}
+
+struct ff_request *test_http_early_data_submit(struct ff_http_engine *engine, char *http_request, struct test_http_engine_results *results)
+{
+    struct ff_request *request = mock_test_http_request(http_request, false);
+
+    ff_http_engine_submit(engine, request, strdup("127.0.0.1"), true, test_http_engine_forwarded, (void *)results);
+    test_http_engine_wait(results, results->forwarded + 1);
+
+    return request;
+}
+
+void test_http_early_data_allowed()
+{
+    struct ff_request *request = mock_test_http_request("GET / HTTP/1.1\r\nHost: b.example\r\n\r\n", false);
+    struct ff_request *post_request = mock_test_http_request("POST / HTTP/1.1\r\nHost: b.example\r\n\r\n", false);
+
+    TEST_ASSERT_TRUE_MESSAGE(ff_http_early_data_allowed("a.example,b.example", request, "b.example"), "listed check failed");
+    TEST_ASSERT_TRUE_MESSAGE(ff_http_early_data_allowed("a.example,b.example", request, "A.Example"), "case check failed");
+    TEST_ASSERT_FALSE_MESSAGE(ff_http_early_data_allowed("a.example,b.example", request, "example"), "prefix check failed");
+    TEST_ASSERT_FALSE_MESSAGE(ff_http_early_data_allowed("a.example,b.example", request, "a.example.com"), "suffix check failed");
+    TEST_ASSERT_TRUE_MESSAGE(ff_http_early_data_allowed("a.example, b.example ", request, "b.example"), "whitespace check failed");
+    TEST_ASSERT_TRUE_MESSAGE(ff_http_early_data_allowed(" a.example ,b.example", request, "a.example"), "leading whitespace check failed");
+    TEST_ASSERT_FALSE_MESSAGE(ff_http_early_data_allowed(NULL, request, "b.example"), "disabled check failed");
+    TEST_ASSERT_FALSE_MESSAGE(ff_http_early_data_allowed("a.example,b.example", post_request, "b.example"), "unsafe check failed");
+
+    ff_request_free(request);
+    ff_request_free(post_request);
+}
+
+void test_http_early_data_engine_accepted()
+{
+    struct test_http_early_data_server server;
+    struct test_http_engine_results results = {0};
+    struct ff_http_engine *engine = NULL;
+    struct ff_request *requests[3];
+    uint64_t attempts = FF_STATS_GET(tls_early_data_attempts);
+    uint64_t accepted = FF_STATS_GET(tls_early_data_accepted);
+    uint64_t failed = FF_STATS_GET(upstream_engine_forwards_failed);
+
+    test_http_early_data_server_start(&server, false);
+    engine = test_http_early_data_engine_init(&server);
+
+    // The first connection has no ticket to resume
+    requests[0] = test_http_early_data_submit(engine, "GET / HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n", &results);
+    TEST_ASSERT_EQUAL_MESSAGE(attempts, FF_STATS_GET(tls_early_data_attempts), "first attempts check failed");
+
+    requests[1] = test_http_early_data_submit(engine, "GET / HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n", &results);
+    TEST_ASSERT_EQUAL_MESSAGE(attempts + 1, FF_STATS_GET(tls_early_data_attempts), "attempts check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(accepted + 1, FF_STATS_GET(tls_early_data_accepted), "accepted check failed");
+
+    // Unsafe methods wait for the handshake
+    requests[2] = test_http_early_data_submit(engine, "POST / HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n", &results);
+    TEST_ASSERT_EQUAL_MESSAGE(attempts + 1, FF_STATS_GET(tls_early_data_attempts), "unsafe attempts check failed");
+
+    TEST_ASSERT_EQUAL_MESSAGE(3, results.forwarded, "forwarded check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(failed, FF_STATS_GET(upstream_engine_forwards_failed), "failed check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(3, __atomic_load_n(&server.requests, __ATOMIC_RELAXED), "requests check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(1, __atomic_load_n(&server.early_data_requests, __ATOMIC_RELAXED), "early data requests check failed");
+
+    ff_http_engine_free(engine);
+    ff_http_tls_free();
+    test_http_early_data_server_stop(&server);
+
+    for (int i = 0; i < 3; i++)
+    {
+        ff_request_free(requests[i]);
+    }
+}
+
+void test_http_early_data_engine_rejected()
+{
+    struct test_http_early_data_server server;
+    struct test_http_engine_results results = {0};
+    struct ff_http_engine *engine = NULL;
+    struct ff_request *requests[2];
+    uint64_t attempts = FF_STATS_GET(tls_early_data_attempts);
+    uint64_t rejected = FF_STATS_GET(tls_early_data_rejected);
+    uint64_t failed = FF_STATS_GET(upstream_engine_forwards_failed);
+
+    test_http_early_data_server_start(&server, true);
+    engine = test_http_early_data_engine_init(&server);
+
+    for (int i = 0; i < 2; i++)
+    {
+        requests[i] = test_http_early_data_submit(engine, "GET / HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n", &results);
+    }
+
+    // The rejected request is sent again once the handshake has finished
+    TEST_ASSERT_EQUAL_MESSAGE(attempts + 1, FF_STATS_GET(tls_early_data_attempts), "attempts check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(rejected + 1, FF_STATS_GET(tls_early_data_rejected), "rejected check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(2, results.forwarded, "forwarded check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(failed, FF_STATS_GET(upstream_engine_forwards_failed), "failed check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(2, __atomic_load_n(&server.requests, __ATOMIC_RELAXED), "requests check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(0, __atomic_load_n(&server.early_data_requests, __ATOMIC_RELAXED), "early data requests check failed");
+
+    ff_http_engine_free(engine);
+    ff_http_tls_free();
+    test_http_early_data_server_stop(&server);
+
+    for (int i = 0; i < 2; i++)
+    {
+        ff_request_free(requests[i]);
+    }
+}
+
+void test_http_early_data_send_request(bool reject)
+{
+    struct test_http_early_data_server server;
+    struct ff_request *requests[3] = {
+        mock_test_http_request("GET / HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n", true),
+        mock_test_http_request("GET / HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n", true),
+        mock_test_http_request("POST / HTTP/1.1\r\nHost: 127.0.0.1\r\nContent-Length: 0\r\n\r\n", true)};
+    uint64_t attempts = FF_STATS_GET(tls_early_data_attempts);
+    uint64_t accepted = FF_STATS_GET(tls_early_data_accepted);
+    uint64_t rejected = FF_STATS_GET(tls_early_data_rejected);
+
+    test_http_early_data_server_start(&server, reject);
+    ff_http_set_ports(FF_HTTP_PORT, server.port);
+
+    TEST_ASSERT_EQUAL_MESSAGE(true, ff_http_tls_init(server.ca_bundle), "tls init check failed");
+    ff_http_tls_sessions_init(4, 3600);
+    ff_http_early_data_init("other.example, 127.0.0.1");
+
+    // The first connection has no ticket to send early data with, the POST is unsafe
+    for (int i = 0; i < 3; i++)
+    {
+        ff_http_send_request(requests[i]);
+        TEST_ASSERT_EQUAL_MESSAGE(FF_REQUEST_STATE_SENT, requests[i]->state, "state check failed");
+    }
+
+    TEST_ASSERT_EQUAL_MESSAGE(attempts + 1, FF_STATS_GET(tls_early_data_attempts), "attempts check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(accepted + (reject ? 0 : 1), FF_STATS_GET(tls_early_data_accepted), "accepted check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(rejected + (reject ? 1 : 0), FF_STATS_GET(tls_early_data_rejected), "rejected check failed");
+    // Rejected early data is sent again once the handshake has finished
+    TEST_ASSERT_EQUAL_MESSAGE(3, __atomic_load_n(&server.requests, __ATOMIC_RELAXED), "requests check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(reject ? 0 : 1, __atomic_load_n(&server.early_data_requests, __ATOMIC_RELAXED), "early data requests check failed");
+
+    ff_http_early_data_free();
+    ff_http_tls_free();
+    ff_http_set_ports(FF_HTTP_PORT, FF_HTTP_TLS_PORT);
+    test_http_early_data_server_stop(&server);
+
+    for (int i = 0; i < 3; i++)
+    {
+        ff_request_free(requests[i]);
+    }
+}
+
+void test_http_early_data_send_request_accepted()
+{
+    test_http_early_data_send_request(false);
+}
+
+void test_http_early_data_send_request_rejected()
+{
+    test_http_early_data_send_request(true);
+}
@@ -0,0 +1,378 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include "../include/unity.h"
+#include "../../src/http.h"
+#include "../../src/http_p.h"
+#include "../../src/http_engine.h"
+#include "../../src/stats.h"
+
+#define TEST_HTTP_ENGINE_MAX_CLIENTS 64
+#define TEST_HTTP_ENGINE_REQUESTS 32
+
+/**
+ * Answers each request with a short keep-alive response, or only the status
+ * line when status_only is set, on an ephemeral local port
+ */
+struct test_http_engine_server
+{
+    int listener;
+    int wake[2];
+    uint16_t port;
+    pthread_t thread;
+    bool status_only;
+    uint32_t accepted;
+    uint32_t requests;
+};
+
+struct test_http_engine_results
+{
+    uint32_t forwarded;
+};
+
+void *test_http_engine_server_loop(void *args)
+{
+    struct test_http_engine_server *server = (struct test_http_engine_server *)args;
+    struct pollfd fds[TEST_HTTP_ENGINE_MAX_CLIENTS + 2];
+    char buffs[TEST_HTTP_ENGINE_MAX_CLIENTS + 2][1024];
+    size_t lengths[TEST_HTTP_ENGINE_MAX_CLIENTS + 2] = {0};
+    nfds_t clients = 0;
+    char *response = server->status_only
+                         ? "HTTP/1.1 200 OK\r\n"
+                         : "HTTP/1.1 200 OK\r\nContent-Length: 5\r\n\r\nhello";
+
+    fds[0] = (struct pollfd){.fd = server->wake[0], .events = POLLIN};
+    fds[1] = (struct pollfd){.fd = server->listener, .events = POLLIN};
+
+    while (poll(fds, clients + 2, -1) >= 0 && fds[0].revents == 0)
+    {
+        for (nfds_t i = 2; i < clients + 2; i++)
+        {
+            ssize_t chunk;
+            char *end;
+
+            if (fds[i].revents == 0)
+            {
+                continue;
+            }
+
+            if ((chunk = recv(fds[i].fd, buffs[i] + lengths[i], sizeof(buffs[i]) - lengths[i] - 1, 0)) <= 0)
+            {
+                close(fds[i].fd);
+                fds[i] = fds[clients + 1];
+                memmove(buffs[i], buffs[clients + 1], lengths[clients + 1]);
+                lengths[i] = lengths[clients + 1];
+                clients--;
+                i--;
+                continue;
+            }
+
+            lengths[i] += (size_t)chunk;
+            buffs[i][lengths[i]] = '\0';
+
+            while ((end = strstr(buffs[i], "\r\n\r\n")) != NULL)
+            {
+                size_t consumed = (size_t)(end + 4 - buffs[i]);
+
+                __atomic_add_fetch(&server->requests, 1, __ATOMIC_RELAXED);
+                send(fds[i].fd, response, strlen(response), MSG_NOSIGNAL);
+                memmove(buffs[i], buffs[i] + consumed, lengths[i] - consumed + 1);
+                lengths[i] -= consumed;
+            }
+        }
+
+        if (fds[1].revents & POLLIN && clients < TEST_HTTP_ENGINE_MAX_CLIENTS)
+        {
+            int sockfd = accept(server->listener, NULL, NULL);
+
+            if (sockfd >= 0)
+            {
+                __atomic_add_fetch(&server->accepted, 1, __ATOMIC_RELAXED);
+                fds[clients + 2] = (struct pollfd){.fd = sockfd, .events = POLLIN};
+                lengths[clients + 2] = 0;
+                clients++;
+            }
+        }
+    }
+
+    for (nfds_t i = 2; i < clients + 2; i++)
+    {
+        close(fds[i].fd);
+    }
+
+    return NULL;
+}
+
+void test_http_engine_server_start(struct test_http_engine_server *server, bool status_only)
+{
+    struct sockaddr_in address = {.sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_LOOPBACK)};
+    socklen_t address_length = sizeof(address);
+
+    memset(server, 0, sizeof(struct test_http_engine_server));
+    server->status_only = status_only;
+    server->listener = socket(AF_INET, SOCK_STREAM, 0);
+    bind(server->listener, (struct sockaddr *)&address, sizeof(address));
+    // Accepts SYN data where the kernel allows fast open servers
+    setsockopt(server->listener, IPPROTO_TCP, TCP_FASTOPEN, &(int){TEST_HTTP_ENGINE_MAX_CLIENTS}, sizeof(int));
+    listen(server->listener, TEST_HTTP_ENGINE_MAX_CLIENTS);
+    getsockname(server->listener, (struct sockaddr *)&address, &address_length);
+    server->port = ntohs(address.sin_port);
+    TEST_ASSERT_EQUAL(0, pipe(server->wake));
+
+    pthread_create(&server->thread, NULL, test_http_engine_server_loop, (void *)server);
+}
+
+void test_http_engine_server_stop(struct test_http_engine_server *server)
+{
+    TEST_ASSERT_EQUAL(1, write(server->wake[1], "", 1));
+    pthread_join(server->thread, NULL);
+    close(server->listener);
+    close(server->wake[0]);
+    close(server->wake[1]);
+}
+
+void test_http_engine_forwarded(struct ff_request *request, void *context)
+{
+    struct test_http_engine_results *results = (struct test_http_engine_results *)context;
+
+    (void)request;
+
+    __atomic_add_fetch(&results->forwarded, 1, __ATOMIC_RELAXED);
+}
+
+void test_http_engine_wait(struct test_http_engine_results *results, uint32_t forwarded)
+{
+    for (int i = 0; i < 400 && __atomic_load_n(&results->forwarded, __ATOMIC_RELAXED) < forwarded; i++)
+    {
+        usleep(5000);
+    }
+}
+
+struct ff_request *test_http_engine_submit(struct ff_http_engine *engine, char *host_name, struct test_http_engine_results *results)
+{
+    struct ff_request *request = mock_test_http_request("GET / HTTP/1.1\r\nHost: localhost\r\n\r\n", false);
+
+    ff_http_engine_submit(engine, request, strdup(host_name), false, test_http_engine_forwarded, (void *)results);
+
+    return request;
+}
+
+void test_http_engine_forwards_requests()
+{
+    struct test_http_engine_server server;
+    struct test_http_engine_results results = {0};
+    struct ff_connection_pool *pool = ff_connection_pool_init(4, 30, 0, ff_http_connection_close);
+    struct ff_http_engine *engine = ff_http_engine_init(2);
+    struct ff_request *requests[TEST_HTTP_ENGINE_REQUESTS + 8];
+    uint64_t active = FF_STATS_GET(upstream_engine_forwards_active);
+    uint64_t failed = FF_STATS_GET(upstream_engine_forwards_failed);
+
+    test_http_engine_server_start(&server, false);
+    engine->http_port = server.port;
+    engine->connections = pool;
+
+    for (int i = 0; i < TEST_HTTP_ENGINE_REQUESTS; i++)
+    {
+        requests[i] = test_http_engine_submit(engine, "127.0.0.1", &results);
+    }
+
+    test_http_engine_wait(&results, TEST_HTTP_ENGINE_REQUESTS);
+
+    TEST_ASSERT_EQUAL_MESSAGE(TEST_HTTP_ENGINE_REQUESTS, results.forwarded, "concurrent forwarded check failed");
+
+    // Later requests go over the connections left idle in the pool
+    for (int i = TEST_HTTP_ENGINE_REQUESTS; i < TEST_HTTP_ENGINE_REQUESTS + 8; i++)
+    {
+        requests[i] = test_http_engine_submit(engine, "127.0.0.1", &results);
+        test_http_engine_wait(&results, i + 1);
+    }
+
+    TEST_ASSERT_EQUAL_MESSAGE(TEST_HTTP_ENGINE_REQUESTS + 8, results.forwarded, "forwarded check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(failed, FF_STATS_GET(upstream_engine_forwards_failed), "failed check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(TEST_HTTP_ENGINE_REQUESTS + 8, __atomic_load_n(&server.requests, __ATOMIC_RELAXED), "requests check failed");
+    TEST_ASSERT_LESS_THAN_MESSAGE(TEST_HTTP_ENGINE_REQUESTS + 8, __atomic_load_n(&server.accepted, __ATOMIC_RELAXED), "reuse check failed");
+
+    ff_http_engine_free(engine);
+    TEST_ASSERT_EQUAL_MESSAGE(active, FF_STATS_GET(upstream_engine_forwards_active), "active check failed");
+    ff_connection_pool_free(pool);
+    test_http_engine_server_stop(&server);
+
+    for (int i = 0; i < TEST_HTTP_ENGINE_REQUESTS + 8; i++)
+    {
+        ff_request_free(requests[i]);
+    }
+}
+
+void test_http_engine_connection_refused()
+{
+    struct sockaddr_in address = {.sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_LOOPBACK)};
+    socklen_t address_length = sizeof(address);
+    struct test_http_engine_results results = {0};
+    struct ff_http_engine *engine = ff_http_engine_init(1);
+    struct ff_request *request;
+    uint64_t failed = FF_STATS_GET(upstream_engine_forwards_failed);
+    int sockfd = socket(AF_INET, SOCK_STREAM, 0);
+
+    // A port nothing is listening on
+    bind(sockfd, (struct sockaddr *)&address, sizeof(address));
+    getsockname(sockfd, (struct sockaddr *)&address, &address_length);
+    close(sockfd);
+    engine->http_port = ntohs(address.sin_port);
+
+    request = test_http_engine_submit(engine, "127.0.0.1", &results);
+    test_http_engine_wait(&results, 1);
+
+    TEST_ASSERT_EQUAL_MESSAGE(1, results.forwarded, "forwarded check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(failed + 1, FF_STATS_GET(upstream_engine_forwards_failed), "failed check failed");
+
+    ff_http_engine_free(engine);
+    ff_request_free(request);
+}
+
+void test_http_engine_resolves_with_dns_cache()
+{
+    struct test_dns_server dns_server;
+    struct test_http_engine_server server;
+    struct test_http_engine_results results = {0};
+    struct ff_event_loop *loop = ff_event_loop_init();
+    struct ff_dns_cache *cache = NULL;
+    struct ff_http_engine *engine = ff_http_engine_init(1);
+    struct ff_request *found, *missing;
+    uint64_t failed = FF_STATS_GET(upstream_engine_forwards_failed);
+
+    test_dns_server_start(&dns_server);
+    test_http_engine_server_start(&server, false);
+    cache = ff_dns_cache_init(test_dns_resolver_init(&dns_server), loop, 16, 300);
+    engine->http_port = server.port;
+    engine->dns = cache;
+
+    found = test_http_engine_submit(engine, "127.0.0.1", &results);
+    missing = test_http_engine_submit(engine, "missing.example", &results);
+    test_http_engine_wait(&results, 2);
+
+    TEST_ASSERT_EQUAL_MESSAGE(2, results.forwarded, "forwarded check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(1, __atomic_load_n(&server.requests, __ATOMIC_RELAXED), "requests check failed");
+    // Only the missing host fails
+    TEST_ASSERT_EQUAL_MESSAGE(failed + 1, FF_STATS_GET(upstream_engine_forwards_failed), "failed check failed");
+
+    // The engine waits on the cache so is freed first
+    ff_http_engine_free(engine);
+    ff_dns_cache_free(cache);
+    ff_event_loop_free(loop);
+    test_http_engine_server_stop(&server);
+    test_dns_server_stop(&dns_server);
+    ff_request_free(found);
+    ff_request_free(missing);
+}
+
+void test_http_engine_completion_policies()
+{
+    struct test_http_engine_server server;
+    enum ff_http_completion_policy policies[] = {FF_HTTP_COMPLETION_RESPONSE, FF_HTTP_COMPLETION_STATUS, FF_HTTP_COMPLETION_ACKED, FF_HTTP_COMPLETION_DRAIN};
+    uint64_t failures[] = {1, 0, 0, 0};
+
+    // The response never finishes, so only policies that stop waiting succeed
+    test_http_engine_server_start(&server, true);
+
+    for (size_t i = 0; i < sizeof(policies) / sizeof(policies[0]); i++)
+    {
+        struct test_http_engine_results results = {0};
+        struct ff_http_engine *engine = ff_http_engine_init(1);
+        struct ff_request *request;
+        uint64_t failed = FF_STATS_GET(upstream_engine_forwards_failed);
+        char message[64];
+
+        engine->http_port = server.port;
+        engine->completion = policies[i];
+        engine->completion_timeout_ms = 2000;
+        engine->timeout_ms = 200;
+
+        request = test_http_engine_submit(engine, "127.0.0.1", &results);
+        test_http_engine_wait(&results, 1);
+
+        snprintf(message, sizeof(message), "%s failed check failed", ff_http_completion_policy_name(policies[i]));
+        TEST_ASSERT_EQUAL_MESSAGE(1, results.forwarded, "forwarded check failed");
+        TEST_ASSERT_EQUAL_MESSAGE(failed + failures[i], FF_STATS_GET(upstream_engine_forwards_failed), message);
+
+        ff_http_engine_free(engine);
+        ff_request_free(request);
+    }
+
+    test_http_engine_server_stop(&server);
+}
+
+void test_http_engine_free_fails_forwards()
+{
+    struct test_http_engine_server server;
+    struct test_http_engine_results results = {0};
+    struct ff_http_engine *engine = ff_http_engine_init(1);
+    struct ff_request *request;
+    uint64_t failed = FF_STATS_GET(upstream_engine_forwards_failed);
+
+    test_http_engine_server_start(&server, true);
+    engine->http_port = server.port;
+    engine->timeout_ms = 60000;
+
+    request = test_http_engine_submit(engine, "127.0.0.1", &results);
+
+    for (int i = 0; i < 400 && __atomic_load_n(&server.requests, __ATOMIC_RELAXED) == 0; i++)
+    {
+        usleep(5000);
+    }
+
+    ff_http_engine_free(engine);
+
+    TEST_ASSERT_EQUAL_MESSAGE(1, results.forwarded, "forwarded check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(failed + 1, FF_STATS_GET(upstream_engine_forwards_failed), "failed check failed");
+
+    test_http_engine_server_stop(&server);
+    ff_request_free(request);
+}
+
+void test_http_engine_pooled_connection_closed()
+{
+    struct test_http_closing_server server;
+    struct test_http_engine_results results = {0};
+    struct ff_connection_pool *pool = ff_connection_pool_init(4, 30, 0, ff_http_connection_close);
+    struct ff_http_engine *engine = ff_http_engine_init(1);
+    struct ff_request *requests[3];
+    uint64_t failed = FF_STATS_GET(upstream_engine_forwards_failed);
+
+    test_http_closing_server_start(&server, false);
+    engine->http_port = server.port;
+    engine->connections = pool;
+
+    requests[0] = test_http_engine_submit(engine, "127.0.0.1", &results);
+    test_http_engine_wait(&results, 1);
+
+    // Closed by the upstream once sent, so resent on a new connection
+    requests[1] = test_http_engine_submit(engine, "127.0.0.1", &results);
+    test_http_engine_wait(&results, 2);
+
+    // Not idempotent, so fails rather than risk being processed twice
+    requests[2] = mock_test_http_request("POST / HTTP/1.1\r\nHost: localhost\r\nContent-Length: 0\r\n\r\n", false);
+    ff_http_engine_submit(engine, requests[2], strdup("127.0.0.1"), false, test_http_engine_forwarded, (void *)&results);
+    test_http_engine_wait(&results, 3);
+
+    TEST_ASSERT_EQUAL_MESSAGE(3, results.forwarded, "forwarded check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(failed + 1, FF_STATS_GET(upstream_engine_forwards_failed), "failed check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(2, __atomic_load_n(&server.accepted, __ATOMIC_RELAXED), "accepted check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(4, __atomic_load_n(&server.requests, __ATOMIC_RELAXED), "requests check failed");
+
+    ff_http_engine_free(engine);
+    ff_connection_pool_free(pool);
+    test_http_closing_server_stop(&server);
+
+    for (int i = 0; i < 3; i++)
+    {
+        ff_request_free(requests[i]);
+    }
+}
@@ -0,0 +1,337 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include "../include/unity.h"
+#include "../../src/http_response.h"
+#include "../../src/http_response_p.h"
+
+struct test_http_response_stream
+{
+    const char *data;
+    size_t position;
+    // Bytes returned per read, exercises responses split across reads
+    size_t chunk_size;
+};
+
+ssize_t test_http_response_stream_read(void *context, void *buff, size_t length)
+{
+    struct test_http_response_stream *stream = (struct test_http_response_stream *)context;
+    size_t remaining = strlen(stream->data) - stream->position;
+
+    length = length > stream->chunk_size ? stream->chunk_size : length;
+    length = length > remaining ? remaining : length;
+
+    memcpy(buff, stream->data + stream->position, length);
+    stream->position += length;
+
+    return (ssize_t)length;
+}
+
+bool test_http_response_read(const char *data, size_t chunk_size, bool head_request, struct ff_http_response *response, size_t *consumed)
+{
+    struct test_http_response_stream stream = {.data = data, .position = 0, .chunk_size = chunk_size};
+    struct ff_http_reader reader;
+    bool read;
+
+    ff_http_reader_init(&reader, test_http_response_stream_read, &stream);
+    read = ff_http_response_read(&reader, head_request, response);
+
+    // Bytes handed to the reader less those still buffered
+    *consumed = stream.position - (reader.end - reader.start);
+
+    return read;
+}
+
+void test_http_response_content_length()
+{
+    const char *data = "HTTP/1.1 200 OK\r\nContent-Length: 5\r\n\r\nhelloHTTP/1.1 404 Not Found\r\n";
+    struct ff_http_response response;
+    size_t consumed;
+
+    TEST_ASSERT_MESSAGE(test_http_response_read(data, 3, false, &response, &consumed), "read check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(200, response.status, "status check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(5, response.content_length, "content length check failed");
+    TEST_ASSERT_MESSAGE(response.keep_alive, "keep alive check failed");
+    TEST_ASSERT_EQUAL_STRING_MESSAGE("HTTP/1.1 200 OK", response.status_line, "status line check failed");
+    // Positioned at the start of the next response
+    TEST_ASSERT_EQUAL_MESSAGE(strstr(data, "HTTP/1.1 404") - data, consumed, "consumed check failed");
+}
+
+void test_http_response_chunked()
+{
+    const char *data = "HTTP/1.1 200 OK\r\nTransfer-Encoding: gzip, chunked\r\n\r\n"
+                       "5;ext=1\r\nhello\r\n10\r\n0123456789abcdef\r\n0\r\nX-Trailer: 1\r\n\r\n";
+    struct ff_http_response response;
+    size_t consumed;
+
+    TEST_ASSERT_MESSAGE(test_http_response_read(data, 7, false, &response, &consumed), "read check failed");
+    TEST_ASSERT_MESSAGE(response.chunked, "chunked check failed");
+    TEST_ASSERT_MESSAGE(response.keep_alive, "keep alive check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(strlen(data), consumed, "consumed check failed");
+}
+
+void test_http_response_without_body()
+{
+    const char *head = "HTTP/1.1 200 OK\r\nContent-Length: 100\r\n\r\n";
+    const char *no_content = "HTTP/1.1 204 No Content\r\n\r\n";
+    const char *not_modified = "HTTP/1.1 304 Not Modified\r\nContent-Length: 100\r\n\r\n";
+    struct ff_http_response response;
+    size_t consumed;
+
+    TEST_ASSERT_MESSAGE(test_http_response_read(head, 64, true, &response, &consumed), "head read check failed");
+    TEST_ASSERT_MESSAGE(response.keep_alive, "head keep alive check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(strlen(head), consumed, "head consumed check failed");
+
+    TEST_ASSERT_MESSAGE(test_http_response_read(no_content, 64, false, &response, &consumed), "204 read check failed");
+    TEST_ASSERT_MESSAGE(response.keep_alive, "204 keep alive check failed");
+
+    TEST_ASSERT_MESSAGE(test_http_response_read(not_modified, 64, false, &response, &consumed), "304 read check failed");
+    TEST_ASSERT_MESSAGE(response.keep_alive, "304 keep alive check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(strlen(not_modified), consumed, "304 consumed check failed");
+}
+
+void test_http_response_interim_response()
+{
+    const char *data = "HTTP/1.1 100 Continue\r\n\r\nHTTP/1.1 201 Created\r\nContent-Length: 0\r\n\r\n";
+    struct ff_http_response response;
+    size_t consumed;
+
+    TEST_ASSERT_MESSAGE(test_http_response_read(data, 64, false, &response, &consumed), "read check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(201, response.status, "status check failed");
+    TEST_ASSERT_MESSAGE(response.keep_alive, "keep alive check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(strlen(data), consumed, "consumed check failed");
+}
+
+void test_http_response_not_reusable()
+{
+    struct ff_http_response response;
+    size_t consumed;
+
+    TEST_ASSERT_MESSAGE(test_http_response_read("HTTP/1.0 200 OK\r\nContent-Length: 0\r\n\r\n", 64, false, &response, &consumed), "1.0 read check failed");
+    TEST_ASSERT_FALSE_MESSAGE(response.keep_alive, "1.0 keep alive check failed");
+
+    TEST_ASSERT_MESSAGE(test_http_response_read("HTTP/1.0 200 OK\r\nConnection: Keep-Alive\r\nContent-Length: 0\r\n\r\n", 64, false, &response, &consumed), "1.0 keep alive read check failed");
+    TEST_ASSERT_MESSAGE(response.keep_alive, "1.0 keep alive header check failed");
+
+    TEST_ASSERT_MESSAGE(test_http_response_read("HTTP/1.1 200 OK\r\nConnection: close\r\nContent-Length: 0\r\n\r\n", 64, false, &response, &consumed), "close read check failed");
+    TEST_ASSERT_FALSE_MESSAGE(response.keep_alive, "close keep alive check failed");
+
+    // Only framed by the connection closing
+    TEST_ASSERT_MESSAGE(test_http_response_read("HTTP/1.1 200 OK\r\n\r\nhello", 64, false, &response, &consumed), "no length read check failed");
+    TEST_ASSERT_FALSE_MESSAGE(response.keep_alive, "no length keep alive check failed");
+
+    TEST_ASSERT_MESSAGE(test_http_response_read("HTTP/1.1 200 OK\r\nContent-Length: 2000000\r\n\r\n", 64, false, &response, &consumed), "large read check failed");
+    TEST_ASSERT_FALSE_MESSAGE(response.keep_alive, "large keep alive check failed");
+
+    TEST_ASSERT_MESSAGE(test_http_response_read("HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\n\r\n", 64, false, &response, &consumed), "101 read check failed");
+    TEST_ASSERT_FALSE_MESSAGE(response.keep_alive, "101 keep alive check failed");
+}
+
+void test_http_response_invalid()
+{
+    struct ff_http_response response;
+    size_t consumed;
+
+    TEST_ASSERT_FALSE_MESSAGE(test_http_response_read("", 64, false, &response, &consumed), "empty check failed");
+    TEST_ASSERT_FALSE_MESSAGE(test_http_response_read("SSH-2.0-OpenSSH\r\n\r\n", 64, false, &response, &consumed), "protocol check failed");
+    TEST_ASSERT_FALSE_MESSAGE(test_http_response_read("HTTP/1.1 2000 OK\r\n\r\n", 64, false, &response, &consumed), "status check failed");
+    TEST_ASSERT_FALSE_MESSAGE(test_http_response_read("HTTP/1.1 200 OK\r\nbad header\r\n\r\n", 64, false, &response, &consumed), "header check failed");
+    TEST_ASSERT_FALSE_MESSAGE(test_http_response_read("HTTP/1.1 200 OK\r\nContent-Length: 1\r\nContent-Length: 2\r\n\r\nab", 64, false, &response, &consumed), "conflicting length check failed");
+    TEST_ASSERT_FALSE_MESSAGE(test_http_response_read("HTTP/1.1 200 OK\r\nContent-Length: 10\r\n\r\nshort", 64, false, &response, &consumed), "truncated body check failed");
+    TEST_ASSERT_FALSE_MESSAGE(test_http_response_read("HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\nzz\r\n", 64, false, &response, &consumed), "chunk size check failed");
+}
+
+struct test_http_response_trickle
+{
+    const char *data;
+    size_t position;
+    // Bytes which have "arrived", reads past them would block
+    size_t available;
+};
+
+ssize_t test_http_response_trickle_read(void *context, void *buff, size_t length)
+{
+    struct test_http_response_trickle *trickle = (struct test_http_response_trickle *)context;
+    size_t total = strlen(trickle->data);
+    size_t available = trickle->available > total ? total : trickle->available;
+
+    if (trickle->position == total)
+    {
+        return 0;
+    }
+
+    if (trickle->position == available)
+    {
+        errno = EAGAIN;
+        return -1;
+    }
+
+    length = length > available - trickle->position ? available - trickle->position : length;
+    memcpy(buff, trickle->data + trickle->position, length);
+    trickle->position += length;
+
+    return (ssize_t)length;
+}
+
+// Frames the data as it arrives a few bytes at a time, returning the final result
+enum ff_http_frame_result test_http_response_frame_trickled(const char *data, bool status_only, struct ff_http_response *response, size_t *consumed)
+{
+    struct test_http_response_trickle trickle = {.data = data, .position = 0, .available = 0};
+    struct ff_http_reader reader;
+    struct ff_http_response_framer framer;
+    enum ff_http_frame_result result;
+
+    ff_http_reader_init(&reader, test_http_response_trickle_read, &trickle);
+    ff_http_response_framer_init(&framer, false, status_only);
+
+    do
+    {
+        trickle.available += 5;
+        result = ff_http_response_frame(&reader, &framer);
+    } while (result == FF_HTTP_FRAME_AGAIN);
+
+    memcpy(response, &framer.response, sizeof(struct ff_http_response));
+    *consumed = trickle.position - (reader.end - reader.start);
+
+    return result;
+}
+
+void test_http_response_frame()
+{
+    const char *content_length = "HTTP/1.1 100 Continue\r\n\r\nHTTP/1.1 200 OK\r\nContent-Length: 12\r\n\r\nhello world!HTTP/1.1";
+    const char *chunked = "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n"
+                          "5;ext=1\r\nhello\r\n10\r\n0123456789abcdef\r\n0\r\nX-Trailer: 1\r\n\r\n";
+    struct ff_http_response response;
+    size_t consumed;
+
+    TEST_ASSERT_EQUAL_MESSAGE(FF_HTTP_FRAME_DONE, test_http_response_frame_trickled(content_length, false, &response, &consumed), "length result check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(200, response.status, "length status check failed");
+    TEST_ASSERT_MESSAGE(response.keep_alive, "length keep alive check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(strstr(content_length, "!") - content_length + 1, consumed, "length consumed check failed");
+
+    TEST_ASSERT_EQUAL_MESSAGE(FF_HTTP_FRAME_DONE, test_http_response_frame_trickled(chunked, false, &response, &consumed), "chunked result check failed");
+    TEST_ASSERT_MESSAGE(response.keep_alive, "chunked keep alive check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(strlen(chunked), consumed, "chunked consumed check failed");
+
+    TEST_ASSERT_EQUAL_MESSAGE(FF_HTTP_FRAME_DONE, test_http_response_frame_trickled(chunked, true, &response, &consumed), "status result check failed");
+    TEST_ASSERT_EQUAL_STRING_MESSAGE("HTTP/1.1 200 OK", response.status_line, "status line check failed");
+    TEST_ASSERT_FALSE_MESSAGE(response.keep_alive, "status keep alive check failed");
+
+    TEST_ASSERT_EQUAL_MESSAGE(FF_HTTP_FRAME_DONE, test_http_response_frame_trickled("HTTP/1.1 200 OK\r\n\r\nclose delimited", false, &response, &consumed), "no length result check failed");
+    TEST_ASSERT_FALSE_MESSAGE(response.keep_alive, "no length keep alive check failed");
+
+    TEST_ASSERT_EQUAL_MESSAGE(FF_HTTP_FRAME_ERROR, test_http_response_frame_trickled("HTTP/1.1 200 OK\r\nContent-Length: 10\r\n\r\nshort", false, &response, &consumed), "truncated check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(FF_HTTP_FRAME_ERROR, test_http_response_frame_trickled("HTTP/1.1 200 OK\r\nContent-", false, &response, &consumed), "truncated head check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(FF_HTTP_FRAME_ERROR, test_http_response_frame_trickled("SSH-2.0-OpenSSH\r\n\r\n", true, &response, &consumed), "protocol check failed");
+}
+
+void test_http_request_keep_alive()
+{
+    struct ff_request *request = NULL;
+    bool head_request;
+
+    request = mock_test_http_request("GET / HTTP/1.1\r\nHost: example.com\r\n\r\n", false);
+    TEST_ASSERT_MESSAGE(ff_http_request_keep_alive(request, &head_request), "1.1 check failed");
+    TEST_ASSERT_FALSE_MESSAGE(head_request, "head check failed");
+    ff_request_free(request);
+
+    request = mock_test_http_request("HEAD / HTTP/1.1\nHost: example.com\nConnection: Upgrade, close\n\n", false);
+    TEST_ASSERT_FALSE_MESSAGE(ff_http_request_keep_alive(request, &head_request), "close check failed");
+    TEST_ASSERT_MESSAGE(head_request, "head check failed");
+    ff_request_free(request);
+
+    request = mock_test_http_request("GET / HTTP/1.0\nHost: example.com\n\n", false);
+    TEST_ASSERT_FALSE_MESSAGE(ff_http_request_keep_alive(request, &head_request), "1.0 check failed");
+    ff_request_free(request);
+
+    request = mock_test_http_request("GET / HTTP/1.0\nConnection: keep-alive\nHost: example.com\n\n", false);
+    TEST_ASSERT_MESSAGE(ff_http_request_keep_alive(request, &head_request), "1.0 keep alive check failed");
+    ff_request_free(request);
+
+    // Only headers are considered
+    request = mock_test_http_request("POST / HTTP/1.1\nHost: example.com\n\nConnection: close\n", false);
+    TEST_ASSERT_MESSAGE(ff_http_request_keep_alive(request, &head_request), "body check failed");
+    ff_request_free(request);
+}
+
+void test_http_request_is_safe()
+{
+    const char *safe[] = {"GET / HTTP/1.1\r\n\r\n", "HEAD / HTTP/1.1\r\n\r\n", "OPTIONS * HTTP/1.1\r\n\r\n"};
+    const char *unsafe[] = {"POST / HTTP/1.1\r\n\r\n", "DELETE / HTTP/1.1\r\n\r\n", "get / HTTP/1.1\r\n\r\n", "GETX / HTTP/1.1\r\n\r\n", "GET"};
+
+    for (size_t i = 0; i < sizeof(safe) / sizeof(safe[0]); i++)
+    {
+        struct ff_request *request = mock_test_http_request((char *)safe[i], false);
+        TEST_ASSERT_TRUE_MESSAGE(ff_http_request_is_safe(request), safe[i]);
+        ff_request_free(request);
+    }
+
+    for (size_t i = 0; i < sizeof(unsafe) / sizeof(unsafe[0]); i++)
+    {
+        struct ff_request *request = mock_test_http_request((char *)unsafe[i], false);
+        TEST_ASSERT_FALSE_MESSAGE(ff_http_request_is_safe(request), unsafe[i]);
+        ff_request_free(request);
+    }
+}
+
+void test_http_request_is_idempotent()
+{
+    const char *idempotent[] = {"GET / HTTP/1.1\r\n\r\n", "HEAD / HTTP/1.1\r\n\r\n", "PUT / HTTP/1.1\r\n\r\n", "DELETE / HTTP/1.1\r\n\r\n"};
+    const char *not_idempotent[] = {"POST / HTTP/1.1\r\n\r\n", "PATCH / HTTP/1.1\r\n\r\n", "put / HTTP/1.1\r\n\r\n", "PUT"};
+
+    for (size_t i = 0; i < sizeof(idempotent) / sizeof(idempotent[0]); i++)
+    {
+        struct ff_request *request = mock_test_http_request((char *)idempotent[i], false);
+        TEST_ASSERT_TRUE_MESSAGE(ff_http_request_is_idempotent(request), idempotent[i]);
+        ff_request_free(request);
+    }
+
+    for (size_t i = 0; i < sizeof(not_idempotent) / sizeof(not_idempotent[0]); i++)
+    {
+        struct ff_request *request = mock_test_http_request((char *)not_idempotent[i], false);
+        TEST_ASSERT_FALSE_MESSAGE(ff_http_request_is_idempotent(request), not_idempotent[i]);
+        ff_request_free(request);
+    }
+}
+
+void test_http_reader_closed()
+{
+    struct test_http_response_stream stream = {.data = "", .position = 0, .chunk_size = 64};
+    struct ff_http_reader reader;
+    struct ff_http_response response;
+
+    // The upstream closing before responding is told apart from other failures
+    ff_http_reader_init(&reader, test_http_response_stream_read, &stream);
+    TEST_ASSERT_FALSE_MESSAGE(ff_http_response_read(&reader, false, &response), "read check failed");
+    TEST_ASSERT_TRUE_MESSAGE(reader.closed, "closed check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(0, reader.received, "received check failed");
+
+    TEST_ASSERT_TRUE(ff_http_connection_reset(ECONNRESET));
+    TEST_ASSERT_TRUE(ff_http_connection_reset(EPIPE));
+    TEST_ASSERT_FALSE(ff_http_connection_reset(EAGAIN));
+    TEST_ASSERT_FALSE(ff_http_connection_reset(ETIMEDOUT));
+}
+
+void test_http_response_reusable()
+{
+    struct test_http_response_stream clean = {.data = "HTTP/1.1 200 OK\r\nContent-Length: 5\r\n\r\nhello", .position = 0, .chunk_size = 64};
+    struct test_http_response_stream leftover = {.data = "HTTP/1.1 200 OK\r\nContent-Length: 5\r\n\r\nhelloHTTP/1.1 200 OK\r\n", .position = 0, .chunk_size = 64};
+    struct test_http_response_stream closing = {.data = "HTTP/1.1 200 OK\r\nConnection: close\r\nContent-Length: 5\r\n\r\nhello", .position = 0, .chunk_size = 64};
+    struct ff_http_reader reader;
+    struct ff_http_response response;
+
+    ff_http_reader_init(&reader, test_http_response_stream_read, &clean);
+    TEST_ASSERT_TRUE_MESSAGE(ff_http_response_read(&reader, false, &response), "clean read check failed");
+    TEST_ASSERT_TRUE_MESSAGE(ff_http_response_reusable(&reader, &response), "clean reusable check failed");
+
+    // Bytes the upstream sent past the response would be read as the next one
+    ff_http_reader_init(&reader, test_http_response_stream_read, &leftover);
+    TEST_ASSERT_TRUE_MESSAGE(ff_http_response_read(&reader, false, &response), "leftover read check failed");
+    TEST_ASSERT_TRUE_MESSAGE(response.keep_alive, "leftover keep alive check failed");
+    TEST_ASSERT_FALSE_MESSAGE(ff_http_response_reusable(&reader, &response), "leftover reusable check failed");
+
+    ff_http_reader_init(&reader, test_http_response_stream_read, &closing);
+    TEST_ASSERT_TRUE_MESSAGE(ff_http_response_read(&reader, false, &response), "closing read check failed");
+    TEST_ASSERT_FALSE_MESSAGE(ff_http_response_reusable(&reader, &response), "closing reusable check failed");
+}
@@ -0,0 +1,291 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <openssl/ssl.h>
+#include <openssl/pem.h>
+#include <openssl/x509.h>
+#include "../include/unity.h"
+#include "../../src/http_p.h"
+
+#define TEST_HTTP_EARLY_DATA_MAX 16384
+
+/**
+ * Returns a TLS 1.3 server context with a self-signed certificate for
+ * 127.0.0.1, written to a temporary ca_bundle to trust
+ */
+SSL_CTX *test_http_tls_server_context(char *ca_bundle)
+{
+    EVP_PKEY *key = EVP_EC_gen("P-256");
+    X509 *cert = X509_new();
+    X509_NAME *name = X509_get_subject_name(cert);
+    SSL_CTX *ctx = NULL;
+    FILE *file = NULL;
+    int fd;
+
+    X509_set_version(cert, 2);
+    ASN1_INTEGER_set(X509_get_serialNumber(cert), 1);
+    X509_gmtime_adj(X509_getm_notBefore(cert), -60);
+    X509_gmtime_adj(X509_getm_notAfter(cert), 3600);
+    X509_set_pubkey(cert, key);
+    X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC, (const unsigned char *)"127.0.0.1", -1, -1, 0);
+    X509_set_issuer_name(cert, name);
+    X509_sign(cert, key, EVP_sha256());
+
+    strcpy(ca_bundle, "/tmp/ff_test_tls_XXXXXX");
+    TEST_ASSERT_MESSAGE((fd = mkstemp(ca_bundle)) >= 0, "ca bundle check failed");
+    file = fdopen(fd, "w");
+    PEM_write_X509(file, cert);
+    fclose(file);
+
+    ctx = SSL_CTX_new(TLS_server_method());
+    SSL_CTX_set_min_proto_version(ctx, TLS1_3_VERSION);
+    SSL_CTX_use_certificate(ctx, cert);
+    SSL_CTX_use_PrivateKey(ctx, key);
+
+    X509_free(cert);
+    EVP_PKEY_free(key);
+
+    return ctx;
+}
+
+/**
+ * HTTP server on a local port of 127.0.0.1, over TLS when started with
+ * tls set, which answers the first request on each connection and closes the
+ * connection on the next without responding, as an upstream timing out an
+ * idle keep-alive connection just as it's reused would
+ */
+struct test_http_closing_server
+{
+    SSL_CTX *ctx;
+    char ca_bundle[64];
+    int listener;
+    uint16_t port;
+    pthread_t thread;
+    uint32_t accepted;
+    uint32_t requests;
+};
+
+ssize_t test_http_closing_server_recv(int sockfd, SSL *ssl, char *buff, size_t length)
+{
+    return ssl == NULL ? recv(sockfd, buff, length, 0) : SSL_read(ssl, buff, (int)length);
+}
+
+bool test_http_closing_server_read(int sockfd, SSL *ssl)
+{
+    char buff[1024];
+    size_t length = 0;
+    ssize_t chunk;
+
+    while ((chunk = test_http_closing_server_recv(sockfd, ssl, buff + length, sizeof(buff) - length - 1)) > 0)
+    {
+        length += (size_t)chunk;
+        buff[length] = '\0';
+
+        if (strstr(buff, "\r\n\r\n") != NULL)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void *test_http_closing_server_loop(void *args)
+{
+    struct test_http_closing_server *server = (struct test_http_closing_server *)args;
+    char *response = "HTTP/1.1 200 OK\r\nContent-Length: 5\r\n\r\nhello";
+    int sockfd;
+
+    // Requests are sent one at a time so connections are served in turn
+    while ((sockfd = accept(server->listener, NULL, NULL)) >= 0)
+    {
+        SSL *ssl = NULL;
+
+        __atomic_add_fetch(&server->accepted, 1, __ATOMIC_RELAXED);
+
+        if (server->ctx != NULL)
+        {
+            ssl = SSL_new(server->ctx);
+            SSL_set_fd(ssl, sockfd);
+        }
+
+        if ((ssl == NULL || SSL_accept(ssl) == 1) && test_http_closing_server_read(sockfd, ssl))
+        {
+            __atomic_add_fetch(&server->requests, 1, __ATOMIC_RELAXED);
+
+            if (ssl == NULL)
+            {
+                send(sockfd, response, strlen(response), MSG_NOSIGNAL);
+            }
+            else
+            {
+                SSL_write(ssl, response, (int)strlen(response));
+            }
+
+            // Closed without a close_notify
+            if (test_http_closing_server_read(sockfd, ssl))
+            {
+                __atomic_add_fetch(&server->requests, 1, __ATOMIC_RELAXED);
+            }
+        }
+
+        SSL_free(ssl);
+        close(sockfd);
+    }
+
+    return NULL;
+}
+
+void test_http_closing_server_start(struct test_http_closing_server *server, bool tls)
+{
+    struct sockaddr_in address = {
+        .sin_family = AF_INET,
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK)};
+    socklen_t address_length = sizeof(address);
+
+    memset(server, 0, sizeof(struct test_http_closing_server));
+    server->listener = socket(AF_INET, SOCK_STREAM, 0);
+    setsockopt(server->listener, SOL_SOCKET, SO_REUSEADDR, &(int){1}, sizeof(int));
+
+    bind(server->listener, (struct sockaddr *)&address, sizeof(address));
+    getsockname(server->listener, (struct sockaddr *)&address, &address_length);
+    server->port = ntohs(address.sin_port);
+
+    if (tls)
+    {
+        server->ctx = test_http_tls_server_context(server->ca_bundle);
+    }
+
+    listen(server->listener, 4);
+    pthread_create(&server->thread, NULL, test_http_closing_server_loop, (void *)server);
+}
+
+void test_http_closing_server_stop(struct test_http_closing_server *server)
+{
+    // Wakes the blocked accept()
+    shutdown(server->listener, SHUT_RDWR);
+    pthread_join(server->thread, NULL);
+    close(server->listener);
+
+    if (server->ctx != NULL)
+    {
+        SSL_CTX_free(server->ctx);
+        unlink(server->ca_bundle);
+    }
+}
+
+/**
+ * TLS 1.3 server on a local port which issues tickets allowing
+ * early data, answering one request per connection. Early data is rejected
+ * at resumption when reject is set.
+ */
+struct test_http_early_data_server
+{
+    SSL_CTX *ctx;
+    int listener;
+    uint16_t port;
+    pthread_t thread;
+    bool reject;
+    // Self-signed certificate for 127.0.0.1 to trust
+    char ca_bundle[64];
+    uint32_t requests;
+    uint32_t early_data_requests;
+};
+
+int test_http_early_data_allow(SSL *ssl, void *arg)
+{
+    struct test_http_early_data_server *server = (struct test_http_early_data_server *)arg;
+
+    (void)ssl;
+
+    return server->reject ? 0 : 1;
+}
+
+void *test_http_early_data_server_loop(void *args)
+{
+    struct test_http_early_data_server *server = (struct test_http_early_data_server *)args;
+    char *response = "HTTP/1.1 200 OK\r\nContent-Length: 5\r\nConnection: close\r\n\r\nhello";
+    int sockfd;
+
+    while ((sockfd = accept(server->listener, NULL, NULL)) >= 0)
+    {
+        SSL *ssl = SSL_new(server->ctx);
+        char buff[1024];
+        size_t length = 0;
+        size_t read = 0;
+        int result;
+        bool early_data;
+
+        SSL_set_fd(ssl, sockfd);
+
+        while ((result = SSL_read_early_data(ssl, buff + length, sizeof(buff) - length - 1, &read)) == SSL_READ_EARLY_DATA_SUCCESS)
+        {
+            length += read;
+        }
+
+        early_data = length > 0;
+        buff[length] = '\0';
+
+        if (result == SSL_READ_EARLY_DATA_FINISH && SSL_accept(ssl) == 1)
+        {
+            while (strstr(buff, "\r\n\r\n") == NULL && (result = SSL_read(ssl, buff + length, (int)(sizeof(buff) - length - 1))) > 0)
+            {
+                length += (size_t)result;
+                buff[length] = '\0';
+            }
+
+            if (strstr(buff, "\r\n\r\n") != NULL)
+            {
+                __atomic_add_fetch(&server->requests, 1, __ATOMIC_RELAXED);
+                __atomic_add_fetch(&server->early_data_requests, early_data ? 1 : 0, __ATOMIC_RELAXED);
+                SSL_write(ssl, response, (int)strlen(response));
+                SSL_shutdown(ssl);
+            }
+        }
+
+        SSL_free(ssl);
+        close(sockfd);
+    }
+
+    return NULL;
+}
+
+void test_http_early_data_server_start(struct test_http_early_data_server *server, bool reject)
+{
+    struct sockaddr_in address = {
+        .sin_family = AF_INET,
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK)};
+    socklen_t address_length = sizeof(address);
+
+    memset(server, 0, sizeof(struct test_http_early_data_server));
+    server->reject = reject;
+    server->listener = socket(AF_INET, SOCK_STREAM, 0);
+    setsockopt(server->listener, SOL_SOCKET, SO_REUSEADDR, &(int){1}, sizeof(int));
+
+    bind(server->listener, (struct sockaddr *)&address, sizeof(address));
+    getsockname(server->listener, (struct sockaddr *)&address, &address_length);
+    server->port = ntohs(address.sin_port);
+
+    server->ctx = test_http_tls_server_context(server->ca_bundle);
+    SSL_CTX_set_max_early_data(server->ctx, TEST_HTTP_EARLY_DATA_MAX);
+    SSL_CTX_set_allow_early_data_cb(server->ctx, test_http_early_data_allow, (void *)server);
+
+    listen(server->listener, 4);
+    pthread_create(&server->thread, NULL, test_http_early_data_server_loop, (void *)server);
+}
+
+void test_http_early_data_server_stop(struct test_http_early_data_server *server)
+{
+    // Wakes the blocked accept()
+    shutdown(server->listener, SHUT_RDWR);
+    pthread_join(server->thread, NULL);
+    close(server->listener);
+    SSL_CTX_free(server->ctx);
+    unlink(server->ca_bundle);
+}
@@ -0,0 +1,180 @@
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "../include/unity.h"
+#include "../../src/key_cache.h"
+#include "../../src/stats.h"
+
+int test_key_cache_derive_count = 0;
+
+bool test_key_cache_derive(void *context, uint8_t key_derivation_mode, uint8_t *salt, uint16_t salt_length, struct ff_derived_key *out_key)
+{
+    bool *should_fail = (bool *)context;
+
+    __atomic_add_fetch(&test_key_cache_derive_count, 1, __ATOMIC_RELAXED);
+
+    if (should_fail != NULL && *should_fail)
+    {
+        return false;
+    }
+
+    for (uint16_t i = 0; i < out_key->length; i++)
+    {
+        out_key->key[i] = salt[i % salt_length] ^ key_derivation_mode;
+    }
+
+    return true;
+}
+
+bool test_key_cache_derive_slowly(void *context, uint8_t key_derivation_mode, uint8_t *salt, uint16_t salt_length, struct ff_derived_key *out_key)
+{
+    usleep(100000);
+
+    return test_key_cache_derive(context, key_derivation_mode, salt, salt_length, out_key);
+}
+
+void test_key_cache_hit_and_miss()
+{
+    struct ff_key_cache *cache = ff_key_cache_init(4);
+    struct ff_derived_key *key_1 = ff_derived_key_alloc(32);
+    struct ff_derived_key *key_2 = ff_derived_key_alloc(32);
+    uint8_t salt[] = "test123456789012";
+    bool res;
+
+    ff_stats_reset();
+    test_key_cache_derive_count = 0;
+
+    res = ff_key_cache_get(cache, FF_KEY_DERIVE_MODE_PBKDF2, salt, 16, key_1, test_key_cache_derive, NULL);
+    TEST_ASSERT_EQUAL_MESSAGE(true, res, "return (1) check failed");
+
+    res = ff_key_cache_get(cache, FF_KEY_DERIVE_MODE_PBKDF2, salt, 16, key_2, test_key_cache_derive, NULL);
+    TEST_ASSERT_EQUAL_MESSAGE(true, res, "return (2) check failed");
+
+    TEST_ASSERT_EQUAL_MEMORY_MESSAGE(key_1->key, key_2->key, 32, "key check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(1, test_key_cache_derive_count, "derive count check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(1, FF_STATS_GET(key_cache_hits), "hits check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(1, FF_STATS_GET(key_cache_misses), "misses check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(1, cache->entries->length, "length check failed");
+
+    // A different mode with the same salt is a separate entry
+    res = ff_key_cache_get(cache, 2, salt, 16, key_2, test_key_cache_derive, NULL);
+    TEST_ASSERT_EQUAL_MESSAGE(true, res, "return (3) check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(2, test_key_cache_derive_count, "derive count (2) check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(2, cache->entries->length, "length (2) check failed");
+
+    ff_derived_key_free(key_1);
+    ff_derived_key_free(key_2);
+    ff_key_cache_free(cache);
+    ff_stats_reset();
+}
+
+void test_key_cache_evicts_least_recently_used()
+{
+    struct ff_key_cache *cache = ff_key_cache_init(2);
+    struct ff_derived_key *key = ff_derived_key_alloc(32);
+    uint8_t salt_1[] = "salt1";
+    uint8_t salt_2[] = "salt2";
+    uint8_t salt_3[] = "salt3";
+
+    ff_stats_reset();
+    test_key_cache_derive_count = 0;
+
+    ff_key_cache_get(cache, FF_KEY_DERIVE_MODE_PBKDF2, salt_1, 5, key, test_key_cache_derive, NULL);
+    ff_key_cache_get(cache, FF_KEY_DERIVE_MODE_PBKDF2, salt_2, 5, key, test_key_cache_derive, NULL);
+    // Use salt 1 so salt 2 becomes the least recently used
+    ff_key_cache_get(cache, FF_KEY_DERIVE_MODE_PBKDF2, salt_1, 5, key, test_key_cache_derive, NULL);
+    ff_key_cache_get(cache, FF_KEY_DERIVE_MODE_PBKDF2, salt_3, 5, key, test_key_cache_derive, NULL);
+
+    TEST_ASSERT_EQUAL_MESSAGE(2, cache->entries->length, "length check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(1, FF_STATS_GET(key_cache_evictions), "evictions check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(3, test_key_cache_derive_count, "derive count check failed");
+
+    ff_key_cache_get(cache, FF_KEY_DERIVE_MODE_PBKDF2, salt_1, 5, key, test_key_cache_derive, NULL);
+    TEST_ASSERT_EQUAL_MESSAGE(3, test_key_cache_derive_count, "derive count (2) check failed");
+
+    ff_key_cache_get(cache, FF_KEY_DERIVE_MODE_PBKDF2, salt_2, 5, key, test_key_cache_derive, NULL);
+    TEST_ASSERT_EQUAL_MESSAGE(4, test_key_cache_derive_count, "derive count (3) check failed");
+
+    ff_derived_key_free(key);
+    ff_key_cache_free(cache);
+    ff_stats_reset();
+}
+
+void test_key_cache_failed_derivation_not_cached()
+{
+    struct ff_key_cache *cache = ff_key_cache_init(4);
+    struct ff_derived_key *key = ff_derived_key_alloc(32);
+    uint8_t salt[] = "test123456789012";
+    bool should_fail = true;
+    bool res;
+
+    test_key_cache_derive_count = 0;
+
+    res = ff_key_cache_get(cache, FF_KEY_DERIVE_MODE_PBKDF2, salt, 16, key, test_key_cache_derive, &should_fail);
+    TEST_ASSERT_EQUAL_MESSAGE(false, res, "return (1) check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(0, cache->entries->length, "length check failed");
+
+    should_fail = false;
+    res = ff_key_cache_get(cache, FF_KEY_DERIVE_MODE_PBKDF2, salt, 16, key, test_key_cache_derive, &should_fail);
+    TEST_ASSERT_EQUAL_MESSAGE(true, res, "return (2) check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(2, test_key_cache_derive_count, "derive count check failed");
+
+    ff_derived_key_free(key);
+    ff_key_cache_free(cache);
+    ff_stats_reset();
+}
+
+struct test_key_cache_thread_args
+{
+    struct ff_key_cache *cache;
+    struct ff_derived_key *key;
+    bool result;
+};
+
+void *test_key_cache_get_thread(void *context)
+{
+    struct test_key_cache_thread_args *args = (struct test_key_cache_thread_args *)context;
+    uint8_t salt[] = "test123456789012";
+
+    args->result = ff_key_cache_get(args->cache, FF_KEY_DERIVE_MODE_PBKDF2, salt, 16, args->key, test_key_cache_derive_slowly, NULL);
+
+    return NULL;
+}
+
+void test_key_cache_single_flight()
+{
+    struct ff_key_cache *cache = ff_key_cache_init(4);
+    struct test_key_cache_thread_args args[4];
+    pthread_t threads[4];
+
+    ff_stats_reset();
+    test_key_cache_derive_count = 0;
+
+    for (int i = 0; i < 4; i++)
+    {
+        args[i].cache = cache;
+        args[i].key = ff_derived_key_alloc(32);
+        args[i].result = false;
+        pthread_create(&threads[i], NULL, test_key_cache_get_thread, &args[i]);
+    }
+
+    for (int i = 0; i < 4; i++)
+    {
+        pthread_join(threads[i], NULL);
+        TEST_ASSERT_EQUAL_MESSAGE(true, args[i].result, "return check failed");
+        TEST_ASSERT_EQUAL_MEMORY_MESSAGE(args[0].key->key, args[i].key->key, 32, "key check failed");
+    }
+
+    TEST_ASSERT_EQUAL_MESSAGE(1, test_key_cache_derive_count, "derive count check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(1, FF_STATS_GET(key_cache_misses), "misses check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(3, FF_STATS_GET(key_cache_hits), "hits check failed");
+
+    for (int i = 0; i < 4; i++)
+    {
+        ff_derived_key_free(args[i].key);
+    }
+
+    ff_key_cache_free(cache);
+    ff_stats_reset();
+}
@@ -0,0 +1,146 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../include/unity.h"
+#include "../../src/keyring.h"
+#include "../../src/keyring_p.h"
+#include "../../src/crypto.h"
+#include "../../client/c/crypto.h"
+
+#define TEST_KEYRING_PATH "/tmp/ff_test_keyring"
+
+void test_keyring_write(const char *contents)
+{
+    FILE *fd = fopen(TEST_KEYRING_PATH, "w");
+    fputs(contents, fd);
+    fclose(fd);
+}
+
+void test_keyring_load()
+{
+    struct ff_encryption_config defaults = {.pbkdf2_iterations = 2000};
+    struct ff_keyring *keyring = NULL;
+    struct ff_keyring_key *key = NULL;
+
+    test_keyring_write("# rotated 2020-01-01\n1:firstkey\n\n2:secondkey\r\n");
+    keyring = ff_keyring_init(TEST_KEYRING_PATH, &defaults, 4);
+
+    TEST_ASSERT_NOT_NULL_MESSAGE(keyring, "init check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(2, keyring->length, "length check failed");
+
+    key = ff_keyring_acquire(keyring, 2);
+    TEST_ASSERT_NOT_NULL_MESSAGE(key, "acquire check failed");
+    TEST_ASSERT_EQUAL_STRING_MESSAGE("secondkey", (char *)key->encryption.key, "key check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(2000, key->encryption.pbkdf2_iterations, "defaults check failed");
+    TEST_ASSERT_NOT_NULL_MESSAGE(key->encryption.key_cache, "key cache check failed");
+    ff_keyring_release(key);
+
+    TEST_ASSERT_EQUAL_MESSAGE(NULL, ff_keyring_acquire(keyring, 3), "unknown id check failed");
+
+    ff_keyring_free(keyring);
+    remove(TEST_KEYRING_PATH);
+}
+
+void test_keyring_load_invalid()
+{
+    struct ff_encryption_config defaults = {.pbkdf2_iterations = 1000};
+    char *invalid_files[] = {"", "1:key\nkey\n", "0:key\n", "65536:key\n", "1:\n", "1x:key\n", "1:key\n1:other\n"};
+
+    for (size_t i = 0; i < sizeof(invalid_files) / sizeof(invalid_files[0]); i++)
+    {
+        test_keyring_write(invalid_files[i]);
+        TEST_ASSERT_EQUAL_MESSAGE(NULL, ff_keyring_init(TEST_KEYRING_PATH, &defaults, 0), "invalid file check failed");
+    }
+
+    remove(TEST_KEYRING_PATH);
+    TEST_ASSERT_EQUAL_MESSAGE(NULL, ff_keyring_init(TEST_KEYRING_PATH, &defaults, 0), "missing file check failed");
+}
+
+void test_keyring_reload_keeps_acquired_keys()
+{
+    struct ff_encryption_config defaults = {.pbkdf2_iterations = 1000};
+    struct ff_keyring *keyring = NULL;
+    struct ff_keyring_key *removed = NULL;
+    struct ff_keyring_key *unchanged = NULL;
+    struct ff_keyring_key *key = NULL;
+
+    test_keyring_write("1:firstkey\n2:secondkey\n3:thirdkey\n");
+    keyring = ff_keyring_init(TEST_KEYRING_PATH, &defaults, 4);
+
+    // Held by an in flight request across the reload
+    removed = ff_keyring_acquire(keyring, 1);
+    unchanged = ff_keyring_acquire(keyring, 2);
+
+    test_keyring_write("2:secondkey\n3:replacedkey\n4:fourthkey\n");
+    TEST_ASSERT_EQUAL_MESSAGE(true, ff_keyring_reload(keyring), "reload check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(3, keyring->length, "length check failed");
+
+    TEST_ASSERT_EQUAL_STRING_MESSAGE("firstkey", (char *)removed->encryption.key, "removed key check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(NULL, ff_keyring_acquire(keyring, 1), "removed id check failed");
+
+    key = ff_keyring_acquire(keyring, 2);
+    TEST_ASSERT_EQUAL_MESSAGE(unchanged, key, "unchanged key reused check failed");
+    ff_keyring_release(key);
+
+    key = ff_keyring_acquire(keyring, 3);
+    TEST_ASSERT_EQUAL_STRING_MESSAGE("replacedkey", (char *)key->encryption.key, "replaced key check failed");
+    ff_keyring_release(key);
+
+    // An invalid file keeps the current generation
+    test_keyring_write("garbage\n");
+    TEST_ASSERT_EQUAL_MESSAGE(false, ff_keyring_reload(keyring), "invalid reload check failed");
+
+    key = ff_keyring_acquire(keyring, 4);
+    TEST_ASSERT_NOT_NULL_MESSAGE(key, "kept key check failed");
+    ff_keyring_release(key);
+
+    ff_keyring_release(removed);
+    ff_keyring_release(unchanged);
+    ff_keyring_free(keyring);
+    remove(TEST_KEYRING_PATH);
+}
+
+void test_keyring_decrypt_request_by_key_id()
+{
+    struct ff_encryption_config client_config = {.key = (uint8_t *)"secondkey", .pbkdf2_iterations = 1000, .key_id = 2};
+    struct ff_encryption_config server_config = {.pbkdf2_iterations = 1000};
+    struct ff_request *request = NULL;
+    char *payload = "hello world";
+
+    test_keyring_write("1:firstkey\n2:secondkey\n");
+    server_config.keyring = ff_keyring_init(TEST_KEYRING_PATH, &server_config, 4);
+
+    for (int i = 0; i < 2; i++)
+    {
+        request = ff_request_alloc();
+        request->options = malloc(sizeof(struct ff_request_option_node *) * FF_REQUEST_MAX_OPTIONS);
+        request->payload_length = strlen(payload);
+        request->payload = ff_request_payload_node_alloc();
+        request->payload->length = strlen(payload);
+        ff_request_payload_load_buff(request->payload, strlen(payload), payload);
+
+        ff_client_encrypt_request(request, &client_config);
+
+        TEST_ASSERT_EQUAL_MESSAGE(FF_REQUEST_OPTION_TYPE_KEY_ID, request->options[5]->type, "key id option check failed");
+
+        ff_decrypt_request(request, &server_config);
+
+        if (i == 0)
+        {
+            TEST_ASSERT_EQUAL_MESSAGE(FF_REQUEST_STATE_DECRYPTED, request->state, "state check failed");
+            TEST_ASSERT_EQUAL_STRING_LEN_MESSAGE(payload, request->payload->value, 11, "payload check failed");
+        }
+        else
+        {
+            TEST_ASSERT_EQUAL_MESSAGE(FF_REQUEST_STATE_DECRYPTING_FAILED, request->state, "unknown key id state check failed");
+        }
+
+        ff_request_free(request);
+
+        // The second request names a key the proxy doesn't have
+        client_config.key_id = 7;
+    }
+
+    ff_keyring_free(server_config.keyring);
+    remove(TEST_KEYRING_PATH);
+}
@@ -0,0 +1,89 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "../include/unity.h"
+#include "../../src/fnv.h"
+#include "../../src/lru_table.h"
+
+struct test_lru_table_entry
+{
+    struct ff_lru_table_entry lru;
+    bool pinned;
+};
+
+uint32_t test_lru_table_released = 0;
+
+bool test_lru_table_evictable(struct ff_lru_table_entry *entry)
+{
+    return !((struct test_lru_table_entry *)entry)->pinned;
+}
+
+void test_lru_table_release(struct ff_lru_table_entry *entry)
+{
+    test_lru_table_released++;
+    free(entry);
+}
+
+void test_fnv_reference_vectors()
+{
+    // From the FNV reference test suite
+    TEST_ASSERT_EQUAL_UINT64_MESSAGE(0xcbf29ce484222325ULL, ff_fnv_hash_string(""), "empty check failed");
+    TEST_ASSERT_EQUAL_UINT64_MESSAGE(0xaf63dc4c8601ec8cULL, ff_fnv_hash_string("a"), "a check failed");
+    TEST_ASSERT_EQUAL_UINT64_MESSAGE(0x85944171f73967e8ULL, ff_fnv_hash_string("foobar"), "foobar check failed");
+    TEST_ASSERT_EQUAL_UINT64_MESSAGE(ff_fnv_hash("foobar", 6), ff_fnv_update(ff_fnv_hash("foo", 3), "bar", 3), "incremental check failed");
+}
+
+void test_lru_table_evicts_least_recently_used()
+{
+    struct ff_lru_table *table = ff_lru_table_init(2, NULL, test_lru_table_release);
+    struct ff_lru_table_entry *a = ff_lru_table_insert_string(table, "a", sizeof(struct test_lru_table_entry));
+    uint8_t key[] = {'b', 0, 1};
+
+    test_lru_table_released = 0;
+
+    TEST_ASSERT_EQUAL_STRING_MESSAGE("a", (char *)a->key, "key check failed");
+
+    // Byte keys may contain nulls
+    ff_lru_table_insert(table, key, sizeof(key), sizeof(struct test_lru_table_entry));
+    TEST_ASSERT_NOT_NULL_MESSAGE(ff_lru_table_find(table, key, sizeof(key)), "byte key check failed");
+    TEST_ASSERT_NULL_MESSAGE(ff_lru_table_find_string(table, "b"), "prefix check failed");
+
+    ff_lru_table_touch(table, a);
+    ff_lru_table_insert_string(table, "c", sizeof(struct test_lru_table_entry));
+
+    TEST_ASSERT_EQUAL_MESSAGE(2, table->length, "length check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(1, table->evictions, "evictions check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(1, test_lru_table_released, "released check failed");
+    TEST_ASSERT_EQUAL_PTR_MESSAGE(a, ff_lru_table_find_string(table, "a"), "recently used check failed");
+    TEST_ASSERT_NULL_MESSAGE(ff_lru_table_find(table, key, sizeof(key)), "evicted check failed");
+    TEST_ASSERT_EQUAL_PTR_MESSAGE(a, table->lru_first, "lru first check failed");
+
+    ff_lru_table_remove(table, a);
+
+    TEST_ASSERT_EQUAL_MESSAGE(1, table->length, "removed length check failed");
+    TEST_ASSERT_NULL_MESSAGE(ff_lru_table_find_string(table, "a"), "removed check failed");
+
+    ff_lru_table_free(table);
+
+    TEST_ASSERT_EQUAL_MESSAGE(3, test_lru_table_released, "free check failed");
+}
+
+void test_lru_table_keeps_unevictable_entries()
+{
+    struct ff_lru_table *table = ff_lru_table_init(1, test_lru_table_evictable, test_lru_table_release);
+    struct test_lru_table_entry *a = (struct test_lru_table_entry *)ff_lru_table_insert_string(table, "a", sizeof(struct test_lru_table_entry));
+
+    a->pinned = true;
+    ff_lru_table_insert_string(table, "b", sizeof(struct test_lru_table_entry));
+
+    TEST_ASSERT_EQUAL_MESSAGE(2, table->length, "over capacity check failed");
+    TEST_ASSERT_NOT_NULL_MESSAGE(ff_lru_table_find_string(table, "a"), "pinned check failed");
+
+    ff_lru_table_insert_string(table, "c", sizeof(struct test_lru_table_entry));
+
+    TEST_ASSERT_EQUAL_MESSAGE(2, table->length, "evicted length check failed");
+    TEST_ASSERT_NULL_MESSAGE(ff_lru_table_find_string(table, "b"), "evicted check failed");
+    TEST_ASSERT_NOT_NULL_MESSAGE(ff_lru_table_find_string(table, "c"), "inserted check failed");
+
+    ff_lru_table_free(table);
+}
@@ -0,0 +1,67 @@
+#include <stdlib.h>
+#include <string.h>
+#include "../include/unity.h"
+#include "../../src/crypto.h"
+#include "../../src/pbkdf2.h"
+
+void test_pbkdf2_matches_openssl(uint8_t *key, uint8_t *salt, uint16_t salt_length, uint32_t iterations, uint16_t key_length)
+{
+    struct ff_encryption_config config = {.key = key, .pbkdf2_iterations = iterations};
+    struct ff_derived_key *expected = ff_derived_key_alloc(key_length);
+    struct ff_derived_key *actual = ff_derived_key_alloc(key_length);
+
+    TEST_ASSERT_EQUAL_MESSAGE(true, ff_derive_key_pbkdf2(&config, salt, salt_length, expected), "openssl derive check failed");
+
+    config.pbkdf2 = ff_pbkdf2_hmac_sha256_init(key, strlen((char *)key));
+
+    TEST_ASSERT_EQUAL_MESSAGE(true, ff_derive_key_pbkdf2(&config, salt, salt_length, actual), "precomputed derive check failed");
+    TEST_ASSERT_EQUAL_MEMORY_MESSAGE(expected->key, actual->key, key_length, "derived key check failed");
+
+    ff_pbkdf2_hmac_sha256_free(config.pbkdf2);
+    ff_derived_key_free(expected);
+    ff_derived_key_free(actual);
+}
+
+void test_pbkdf2_hmac_sha256_derive()
+{
+    uint8_t salt[] = "test123456789012";
+
+    test_pbkdf2_matches_openssl((uint8_t *)"testkey", salt, 16, 1, 32);
+    test_pbkdf2_matches_openssl((uint8_t *)"testkey", salt, 16, 2, 32);
+    test_pbkdf2_matches_openssl((uint8_t *)"testkey", salt, 16, 1000, 32);
+    test_pbkdf2_matches_openssl((uint8_t *)"testkey", salt, 3, 1000, 16);
+}
+
+void test_pbkdf2_hmac_sha256_derive_multiple_blocks()
+{
+    uint8_t salt[] = "test123456789012";
+
+    test_pbkdf2_matches_openssl((uint8_t *)"testkey", salt, 16, 10, 64);
+    test_pbkdf2_matches_openssl((uint8_t *)"testkey", salt, 16, 10, 50);
+}
+
+void test_pbkdf2_hmac_sha256_derive_long_key()
+{
+    uint8_t salt[] = "test123456789012";
+    // Keys longer than the SHA-256 block size are hashed first
+    uint8_t key[] = "0123456789012345678901234567890123456789012345678901234567890123456789";
+
+    test_pbkdf2_matches_openssl(key, salt, 16, 100, 32);
+}
+
+void test_pbkdf2_hmac_sha256_rfc7914_vector()
+{
+    // PBKDF2-HMAC-SHA256 test vector from RFC 7914 section 11
+    uint8_t expected[] = {
+        0x55, 0xac, 0x04, 0x6e, 0x56, 0xe3, 0x08, 0x9f, 0xec, 0x16, 0x91, 0xc2, 0x25, 0x44, 0xb6, 0x05,
+        0xf9, 0x41, 0x85, 0x21, 0x6d, 0xde, 0x04, 0x65, 0xe6, 0x8b, 0x9d, 0x57, 0xc2, 0x0d, 0xac, 0xbc,
+        0x49, 0xca, 0x9c, 0xcc, 0xf1, 0x79, 0xb6, 0x45, 0x99, 0x16, 0x64, 0xb3, 0x9d, 0x77, 0xef, 0x31,
+        0x7c, 0x71, 0xb8, 0x45, 0xb1, 0xe3, 0x0b, 0xd5, 0x09, 0x11, 0x20, 0x41, 0xd3, 0xa1, 0x97, 0x83};
+    uint8_t out[64];
+    struct ff_pbkdf2_hmac_sha256 *pbkdf2 = ff_pbkdf2_hmac_sha256_init((uint8_t *)"passwd", 6);
+
+    TEST_ASSERT_EQUAL_MESSAGE(true, ff_pbkdf2_hmac_sha256_derive(pbkdf2, (uint8_t *)"salt", 4, 1, out, 64), "return check failed");
+    TEST_ASSERT_EQUAL_MEMORY_MESSAGE(expected, out, 64, "derived key check failed");
+
+    ff_pbkdf2_hmac_sha256_free(pbkdf2);
+}
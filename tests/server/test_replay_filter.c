@@ -0,0 +1,137 @@
+#include <stdlib.h>
+#include <string.h>
+#include "../include/unity.h"
+#include "../../src/replay_filter.h"
+#include "../../src/replay_filter_p.h"
+#include "../../src/crypto.h"
+#include "../../client/c/crypto.h"
+
+void test_replay_filter_insert_and_seen()
+{
+    struct ff_replay_filter *filter = ff_replay_filter_init(1024, 60);
+    uint8_t salt[16] = {1, 2, 3};
+    uint8_t iv[12] = {4, 5, 6};
+    uint8_t other_iv[12] = {4, 5, 7};
+
+    filter->rotated_at = 0;
+
+    TEST_ASSERT_EQUAL_MESSAGE(false, ff_replay_filter_seen_at(filter, salt, sizeof(salt), iv, sizeof(iv), 0), "unseen check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(true, ff_replay_filter_insert_at(filter, salt, sizeof(salt), iv, sizeof(iv), 0), "insert check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(true, ff_replay_filter_seen_at(filter, salt, sizeof(salt), iv, sizeof(iv), 1), "seen check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(false, ff_replay_filter_insert_at(filter, salt, sizeof(salt), iv, sizeof(iv), 1), "duplicate insert check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(false, ff_replay_filter_seen_at(filter, salt, sizeof(salt), other_iv, sizeof(other_iv), 1), "other iv check failed");
+
+    // Moving bytes between the salt and IV is a different pair
+    uint8_t pair[28] = {1, 2, 3};
+    ff_replay_filter_insert_at(filter, pair, 16, pair + 16, 12, 1);
+    TEST_ASSERT_EQUAL_MESSAGE(false, ff_replay_filter_seen_at(filter, pair, 15, pair + 15, 13, 1), "boundary check failed");
+
+    ff_replay_filter_free(filter);
+}
+
+void test_replay_filter_rotation()
+{
+    struct ff_replay_filter *filter = ff_replay_filter_init(1024, 60);
+    uint8_t salt[16] = {1, 2, 3};
+    uint8_t iv[12] = {4, 5, 6};
+
+    filter->rotated_at = 0;
+    ff_replay_filter_insert_at(filter, salt, sizeof(salt), iv, sizeof(iv), 10);
+
+    // Remembered in the previous generation for the next interval
+    TEST_ASSERT_EQUAL_MESSAGE(true, ff_replay_filter_seen_at(filter, salt, sizeof(salt), iv, sizeof(iv), 60), "previous generation check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(true, ff_replay_filter_seen_at(filter, salt, sizeof(salt), iv, sizeof(iv), 119), "previous generation end check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(false, ff_replay_filter_seen_at(filter, salt, sizeof(salt), iv, sizeof(iv), 120), "expired check failed");
+
+    // A filter idle for two intervals forgets both generations at once
+    ff_replay_filter_insert_at(filter, salt, sizeof(salt), iv, sizeof(iv), 130);
+    TEST_ASSERT_EQUAL_MESSAGE(false, ff_replay_filter_seen_at(filter, salt, sizeof(salt), iv, sizeof(iv), 300), "idle expired check failed");
+
+    ff_replay_filter_free(filter);
+}
+
+void test_replay_filter_false_positive_rate()
+{
+    uint32_t capacity = 10000;
+    struct ff_replay_filter *filter = ff_replay_filter_init(capacity, 60);
+    uint8_t salt[16] = {0};
+    uint8_t iv[12] = {0};
+    uint32_t false_positives = 0;
+
+    filter->rotated_at = 0;
+
+    for (uint32_t i = 0; i < capacity; i++)
+    {
+        memcpy(salt, &i, sizeof(i));
+        ff_replay_filter_insert_at(filter, salt, sizeof(salt), iv, sizeof(iv), 0);
+    }
+
+    iv[0] = 1;
+
+    for (uint32_t i = 0; i < 100000; i++)
+    {
+        memcpy(salt, &i, sizeof(i));
+        false_positives += ff_replay_filter_seen_at(filter, salt, sizeof(salt), iv, sizeof(iv), 0);
+    }
+
+    // Expected around 12 at capacity with a single generation in use
+    TEST_ASSERT_LESS_THAN_MESSAGE(100, false_positives, "false positive rate check failed");
+
+    ff_replay_filter_free(filter);
+}
+
+void test_replay_filter_rejects_replayed_request()
+{
+    struct ff_encryption_config config = {.key = (uint8_t *)"testkey", .key_derivation_mode = FF_KEY_DERIVE_MODE_HKDF};
+    struct ff_request *requests[3];
+    char *payload = "hello world";
+
+    config.replay_filter = ff_replay_filter_init(1024, 60);
+
+    for (int i = 0; i < 3; i++)
+    {
+        requests[i] = ff_request_alloc();
+        requests[i]->options = malloc(sizeof(struct ff_request_option_node *) * FF_REQUEST_MAX_OPTIONS);
+        requests[i]->payload_length = strlen(payload);
+        requests[i]->payload = ff_request_payload_node_alloc();
+        requests[i]->payload->length = strlen(payload);
+        ff_request_payload_load_buff(requests[i]->payload, strlen(payload), payload);
+    }
+
+    ff_client_encrypt_request(requests[0], &config);
+
+    // Copies of the encrypted request, the first with a forged tag
+    for (int i = 1; i < 3; i++)
+    {
+        memcpy(requests[i]->payload->value, requests[0]->payload->value, requests[0]->payload->length);
+
+        for (uint8_t j = 0; j < requests[0]->options_length; j++)
+        {
+            requests[i]->options[j] = ff_request_option_node_alloc();
+            requests[i]->options[j]->type = requests[0]->options[j]->type;
+            requests[i]->options[j]->length = requests[0]->options[j]->length;
+            ff_request_option_load_buff(requests[i]->options[j], requests[0]->options[j]->length, requests[0]->options[j]->value);
+        }
+
+        requests[i]->options_length = requests[0]->options_length;
+    }
+
+    requests[1]->options[2]->value[0] ^= 1;
+
+    // A forged request sharing the salt and IV mustn't block the genuine one
+    ff_decrypt_request(requests[1], &config);
+    TEST_ASSERT_EQUAL_MESSAGE(FF_REQUEST_STATE_DECRYPTING_FAILED, requests[1]->state, "forged state check failed");
+
+    ff_decrypt_request(requests[0], &config);
+    TEST_ASSERT_EQUAL_MESSAGE(FF_REQUEST_STATE_DECRYPTED, requests[0]->state, "state check failed");
+
+    ff_decrypt_request(requests[2], &config);
+    TEST_ASSERT_EQUAL_MESSAGE(FF_REQUEST_STATE_DECRYPTING_FAILED, requests[2]->state, "replay state check failed");
+
+    for (int i = 0; i < 3; i++)
+    {
+        ff_request_free(requests[i]);
+    }
+
+    ff_replay_filter_free(config.replay_filter);
+}
@@ -0,0 +1,211 @@
+#include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
+#include "../include/unity.h"
+#include "../../src/request_budget.h"
+#include "../../src/request_budget_p.h"
+#include "../../src/hash_table.h"
+#include "../../src/stats.h"
+
+struct ff_request *mock_test_budget_request(struct ff_hash_table *requests, uint64_t request_id, uint64_t payload_length, uint16_t port)
+{
+    struct ff_request *request = ff_request_alloc();
+    struct sockaddr_in *address = (struct sockaddr_in *)&request->source;
+
+    address->sin_family = AF_INET;
+    address->sin_port = htons(port);
+    address->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    request->request_id = request_id;
+    request->payload_length = payload_length;
+    ff_hash_table_put_item(requests, request_id, request);
+
+    return request;
+}
+
+void test_request_budget_admit_and_release()
+{
+    ff_stats_reset();
+    struct ff_hash_table *requests = ff_hash_table_init(16);
+    struct ff_request_budget *budget = ff_request_budget_init(requests, 0, 0, FF_REQUEST_BUDGET_POLICY_REFUSE);
+    struct ff_request *request = mock_test_budget_request(requests, 1, 100, 1000);
+
+    TEST_ASSERT_EQUAL_MESSAGE(true, ff_request_budget_admit(budget, request), "admit check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(ff_request_budget_charge(request), budget->used_bytes, "used bytes check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(1, budget->length, "length check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(budget->used_bytes, FF_STATS_GET(partial_requests_bytes), "stats bytes check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(1, FF_STATS_GET(partial_requests_active), "stats active check failed");
+
+    ff_request_budget_release(budget, request);
+
+    TEST_ASSERT_EQUAL_MESSAGE(0, budget->used_bytes, "used bytes after release check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(0, budget->length, "length after release check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(NULL, budget->lru_first, "lru first check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(NULL, budget->lru_last, "lru last check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(0, FF_STATS_GET(partial_requests_bytes), "stats bytes after release check failed");
+
+    ff_request_free(request);
+    ff_request_budget_free(budget);
+    ff_hash_table_free(requests);
+}
+
+void test_request_budget_refuse_when_exhausted()
+{
+    ff_stats_reset();
+    struct ff_hash_table *requests = ff_hash_table_init(16);
+    struct ff_request *request1 = mock_test_budget_request(requests, 1, 100, 1000);
+    struct ff_request *request2 = mock_test_budget_request(requests, 2, 100, 1001);
+    struct ff_request_budget *budget = ff_request_budget_init(requests, ff_request_budget_charge(request1) + 50, 0, FF_REQUEST_BUDGET_POLICY_REFUSE);
+
+    TEST_ASSERT_EQUAL_MESSAGE(true, ff_request_budget_admit(budget, request1), "admit 1 check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(false, ff_request_budget_admit(budget, request2), "admit 2 check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(1, FF_STATS_GET(partial_requests_refused_memory), "stats refused check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(request1, ff_hash_table_get_item(requests, 1), "request 1 retained check failed");
+
+    ff_request_budget_release(budget, request1);
+    ff_hash_table_remove_item(requests, 1);
+    ff_hash_table_remove_item(requests, 2);
+    ff_request_free(request1);
+    ff_request_free(request2);
+    ff_request_budget_free(budget);
+    ff_hash_table_free(requests);
+}
+
+void test_request_budget_evict_lru()
+{
+    ff_stats_reset();
+    struct ff_hash_table *requests = ff_hash_table_init(16);
+    struct ff_request *request1 = mock_test_budget_request(requests, 1, 100, 1000);
+    struct ff_request *request2 = mock_test_budget_request(requests, 2, 100, 1001);
+    struct ff_request *request3 = mock_test_budget_request(requests, 3, 100, 1002);
+    struct ff_request_budget *budget = ff_request_budget_init(requests, ff_request_budget_charge(request1) * 2, 0, FF_REQUEST_BUDGET_POLICY_EVICT_LRU);
+
+    TEST_ASSERT_EQUAL_MESSAGE(true, ff_request_budget_admit(budget, request1), "admit 1 check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(true, ff_request_budget_admit(budget, request2), "admit 2 check failed");
+
+    // Request 1 becomes the most recently active so request 2 is evicted
+    ff_request_budget_touch(budget, request1);
+
+    TEST_ASSERT_EQUAL_MESSAGE(true, ff_request_budget_admit(budget, request3), "admit 3 check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(NULL, ff_hash_table_get_item(requests, 2), "request 2 evicted check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(request1, ff_hash_table_get_item(requests, 1), "request 1 retained check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(request1, budget->lru_first, "lru first check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(request3, budget->lru_last, "lru last check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(1, FF_STATS_GET(partial_requests_evicted), "stats evicted check failed");
+
+    ff_request_budget_release(budget, request1);
+    ff_request_budget_release(budget, request3);
+    ff_hash_table_remove_item(requests, 1);
+    ff_hash_table_remove_item(requests, 3);
+    ff_request_free(request1);
+    ff_request_free(request3);
+    ff_request_budget_free(budget);
+    ff_hash_table_free(requests);
+}
+
+void test_request_budget_evict_largest()
+{
+    ff_stats_reset();
+    struct ff_hash_table *requests = ff_hash_table_init(16);
+    struct ff_request *request1 = mock_test_budget_request(requests, 1, 100, 1000);
+    struct ff_request *request2 = mock_test_budget_request(requests, 2, 500, 1001);
+    struct ff_request *request3 = mock_test_budget_request(requests, 3, 100, 1002);
+    struct ff_request_budget *budget = ff_request_budget_init(
+        requests,
+        ff_request_budget_charge(request1) + ff_request_budget_charge(request2),
+        0,
+        FF_REQUEST_BUDGET_POLICY_EVICT_LARGEST);
+
+    TEST_ASSERT_EQUAL_MESSAGE(true, ff_request_budget_admit(budget, request1), "admit 1 check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(true, ff_request_budget_admit(budget, request2), "admit 2 check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(true, ff_request_budget_admit(budget, request3), "admit 3 check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(NULL, ff_hash_table_get_item(requests, 2), "request 2 evicted check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(request1, ff_hash_table_get_item(requests, 1), "request 1 retained check failed");
+
+    ff_request_budget_free(budget);
+    ff_hash_table_remove_item(requests, 1);
+    ff_hash_table_remove_item(requests, 3);
+    ff_request_free(request1);
+    ff_request_free(request3);
+    ff_hash_table_free(requests);
+}
+
+void test_request_budget_source_quota()
+{
+    ff_stats_reset();
+    struct ff_hash_table *requests = ff_hash_table_init(16);
+    struct ff_request *request1 = mock_test_budget_request(requests, 1, 100, 1000);
+    struct ff_request *request2 = mock_test_budget_request(requests, 2, 100, 1000);
+    struct ff_request *request3 = mock_test_budget_request(requests, 3, 100, 1001);
+    struct ff_request *request4 = mock_test_budget_request(requests, 4, 100, 1000);
+    struct ff_request_budget *budget = ff_request_budget_init(requests, 0, 1, FF_REQUEST_BUDGET_POLICY_EVICT_LRU);
+
+    ((struct sockaddr_in *)&request4->source)->sin_addr.s_addr = htonl(INADDR_LOOPBACK + 1);
+
+    TEST_ASSERT_EQUAL_MESSAGE(true, ff_request_budget_admit(budget, request1), "admit 1 check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(false, ff_request_budget_admit(budget, request2), "admit 2 (same source) check failed");
+    // The quota is per address, another port doesn't get around it
+    TEST_ASSERT_EQUAL_MESSAGE(false, ff_request_budget_admit(budget, request3), "admit 3 (same address) check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(true, ff_request_budget_admit(budget, request4), "admit 4 (other source) check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(2, FF_STATS_GET(partial_requests_refused_source), "stats refused check failed");
+
+    // Releasing the first request frees up the quota for its source
+    ff_request_budget_release(budget, request1);
+    TEST_ASSERT_EQUAL_MESSAGE(true, ff_request_budget_admit(budget, request2), "admit 2 after release check failed");
+
+    ff_request_budget_free(budget);
+    ff_hash_table_remove_item(requests, 1);
+    ff_hash_table_remove_item(requests, 2);
+    ff_hash_table_remove_item(requests, 3);
+    ff_hash_table_remove_item(requests, 4);
+    ff_request_free(request1);
+    ff_request_free(request2);
+    ff_request_free(request3);
+    ff_request_free(request4);
+    ff_hash_table_free(requests);
+}
+
+void test_request_budget_source_ipv6()
+{
+    struct ff_request_budget_key key1;
+    struct ff_request_budget_key key2;
+    struct sockaddr_in6 address = {.sin6_family = AF_INET6, .sin6_port = htons(1000)};
+
+    // Addresses differing only past the first 16 bytes of the sockaddr are distinct sources
+    inet_pton(AF_INET6, "2001:db8::1", &address.sin6_addr);
+    ff_request_budget_source_key((struct sockaddr *)&address, &key1);
+    inet_pton(AF_INET6, "2001:db8::2", &address.sin6_addr);
+    address.sin6_port = htons(1001);
+    ff_request_budget_source_key((struct sockaddr *)&address, &key2);
+
+    TEST_ASSERT_EQUAL_MESSAGE(AF_INET6, key1.family, "family check failed");
+    TEST_ASSERT_FALSE_MESSAGE(memcmp(&key1, &key2, sizeof(key1)) == 0, "distinct check failed");
+
+    // The port isn't part of the key
+    inet_pton(AF_INET6, "2001:db8::1", &address.sin6_addr);
+    ff_request_budget_source_key((struct sockaddr *)&address, &key2);
+    TEST_ASSERT_TRUE_MESSAGE(memcmp(&key1, &key2, sizeof(key1)) == 0, "port check failed");
+}
+
+void test_request_budget_expire_and_collect()
+{
+    ff_stats_reset();
+    struct ff_hash_table *requests = ff_hash_table_init(16);
+    struct ff_request *request = mock_test_budget_request(requests, 1, 100, 1000);
+    struct ff_request_budget *budget = ff_request_budget_init(requests, 0, 0, FF_REQUEST_BUDGET_POLICY_EVICT_LRU);
+
+    ff_request_budget_admit(budget, request);
+
+    TEST_ASSERT_EQUAL_MESSAGE(true, ff_request_budget_expire(budget, 1), "expire check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(false, ff_request_budget_expire(budget, 1), "expire twice check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(NULL, ff_hash_table_get_item(requests, 1), "removed from table check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(request, budget->expired, "expired list check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(0, budget->used_bytes, "used bytes check failed");
+
+    ff_request_budget_collect(budget);
+
+    TEST_ASSERT_EQUAL_MESSAGE(NULL, budget->expired, "collected check failed");
+
+    ff_request_budget_free(budget);
+    ff_hash_table_free(requests);
+}
@@ -0,0 +1,69 @@
+#include <stdint.h>
+#include <string.h>
+#include "../include/unity.h"
+#include "../../src/siphash.h"
+
+void test_siphash_hash_bytes(uint8_t *data, size_t length, size_t split, uint8_t out_bytes[16])
+{
+    uint8_t key[FF_SIPHASH_KEY_LENGTH];
+    struct ff_siphash state;
+    uint64_t out[2];
+
+    for (int i = 0; i < FF_SIPHASH_KEY_LENGTH; i++)
+    {
+        key[i] = (uint8_t)i;
+    }
+
+    ff_siphash_init(&state, key);
+    ff_siphash_update(&state, data, split);
+    ff_siphash_update(&state, data + split, length - split);
+    ff_siphash_final128(&state, out);
+
+    for (int i = 0; i < 16; i++)
+    {
+        out_bytes[i] = (uint8_t)(out[i / 8] >> (8 * (i % 8)));
+    }
+}
+
+void test_siphash_reference_vectors()
+{
+    // From the SipHash reference implementation, key 00..0f and message 00..(n - 1)
+    uint8_t expected_0[] = {0xa3, 0x81, 0x7f, 0x04, 0xba, 0x25, 0xa8, 0xe6, 0x6d, 0xf6, 0x72, 0x14, 0xc7, 0x55, 0x02, 0x93};
+    uint8_t expected_15[] = {0x54, 0x93, 0xe9, 0x99, 0x33, 0xb0, 0xa8, 0x11, 0x7e, 0x08, 0xec, 0x0f, 0x97, 0xcf, 0xc3, 0xd9};
+    uint8_t expected_63[] = {0x51, 0x50, 0xd1, 0x77, 0x2f, 0x50, 0x83, 0x4a, 0x50, 0x3e, 0x06, 0x9a, 0x97, 0x3f, 0xbd, 0x7c};
+    uint8_t data[63];
+    uint8_t out[16];
+
+    for (int i = 0; i < 63; i++)
+    {
+        data[i] = (uint8_t)i;
+    }
+
+    test_siphash_hash_bytes(data, 0, 0, out);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY_MESSAGE(expected_0, out, 16, "empty message check failed");
+
+    test_siphash_hash_bytes(data, 15, 15, out);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY_MESSAGE(expected_15, out, 16, "15 byte message check failed");
+
+    test_siphash_hash_bytes(data, 63, 63, out);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY_MESSAGE(expected_63, out, 16, "63 byte message check failed");
+}
+
+void test_siphash_incremental_updates()
+{
+    uint8_t expected_63[] = {0x51, 0x50, 0xd1, 0x77, 0x2f, 0x50, 0x83, 0x4a, 0x50, 0x3e, 0x06, 0x9a, 0x97, 0x3f, 0xbd, 0x7c};
+    uint8_t data[63];
+    uint8_t out[16];
+
+    for (int i = 0; i < 63; i++)
+    {
+        data[i] = (uint8_t)i;
+    }
+
+    // Splits before, on and after word boundaries
+    for (size_t split = 0; split <= 63; split++)
+    {
+        test_siphash_hash_bytes(data, 63, split, out);
+        TEST_ASSERT_EQUAL_UINT8_ARRAY_MESSAGE(expected_63, out, 16, "split message check failed");
+    }
+}
@@ -0,0 +1,23 @@
+#include <stdlib.h>
+#include <string.h>
+#include "../include/unity.h"
+#include "../../src/stats.h"
+
+void test_stats_print()
+{
+    char buff[4096] = {0};
+    FILE *fd = fmemopen(buff, sizeof(buff) - 1, "w");
+
+    ff_stats_reset();
+    FF_STATS_ADD(partial_requests_bytes, 1234);
+    FF_STATS_INC(partial_requests_evicted);
+
+    ff_stats_print(fd);
+    fclose(fd);
+
+    TEST_ASSERT_NOT_NULL_MESSAGE(strstr(buff, "partial_requests_bytes 1234\n"), "bytes counter check failed");
+    TEST_ASSERT_NOT_NULL_MESSAGE(strstr(buff, "partial_requests_evicted 1\n"), "evicted counter check failed");
+    TEST_ASSERT_NOT_NULL_MESSAGE(strstr(buff, "partial_requests_refused_memory 0\n"), "refused counter check failed");
+
+    ff_stats_reset();
+}
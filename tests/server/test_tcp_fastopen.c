@@ -0,0 +1,192 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include "../include/unity.h"
+#include "../../src/tcp_fastopen.h"
+#include "../../src/tcp_fastopen_p.h"
+#include "../../src/stats.h"
+
+int test_tcp_fastopen_listen(struct sockaddr_in *address)
+{
+    socklen_t address_length = sizeof(struct sockaddr_in);
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+
+    memset(address, 0, sizeof(struct sockaddr_in));
+    address->sin_family = AF_INET;
+    address->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    bind(listener, (struct sockaddr *)address, sizeof(struct sockaddr_in));
+    listen(listener, 4);
+    getsockname(listener, (struct sockaddr *)address, &address_length);
+
+    return listener;
+}
+
+void test_tcp_fastopen_enable()
+{
+    struct ff_tcp_fastopen *fastopen = ff_tcp_fastopen_init(4, 2, 60);
+    uint64_t attempts = FF_STATS_GET(upstream_fastopen_attempts);
+    int sockfd = socket(AF_INET, SOCK_STREAM, 0);
+    int enabled = 0;
+    socklen_t enabled_length = sizeof(enabled);
+
+    TEST_ASSERT_FALSE_MESSAGE(ff_tcp_fastopen_enable(NULL, sockfd, "127.0.0.1:80"), "disabled check failed");
+    TEST_ASSERT_TRUE_MESSAGE(ff_tcp_fastopen_enable(fastopen, sockfd, "127.0.0.1:80"), "enable check failed");
+    TEST_ASSERT_EQUAL(0, getsockopt(sockfd, IPPROTO_TCP, TCP_FASTOPEN_CONNECT, &enabled, &enabled_length));
+    TEST_ASSERT_EQUAL_MESSAGE(1, enabled, "socket option check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(attempts + 1, FF_STATS_GET(upstream_fastopen_attempts), "attempts check failed");
+
+    close(sockfd);
+    ff_tcp_fastopen_free(fastopen);
+}
+
+void test_tcp_fastopen_record_fallbacks()
+{
+    struct ff_tcp_fastopen *fastopen = ff_tcp_fastopen_init(4, 2, 60);
+    struct sockaddr_in address;
+    int listener = test_tcp_fastopen_listen(&address);
+    uint64_t fallbacks = FF_STATS_GET(upstream_fastopen_fallbacks);
+
+    // The listener doesn't enable fast open so never acknowledges SYN data
+    for (int i = 0; i < 2; i++)
+    {
+        int sockfd = socket(AF_INET, SOCK_STREAM, 0);
+        int accepted;
+
+        TEST_ASSERT_TRUE_MESSAGE(ff_tcp_fastopen_enable(fastopen, sockfd, "upstream"), "enable check failed");
+        TEST_ASSERT_EQUAL_MESSAGE(0, connect(sockfd, (struct sockaddr *)&address, sizeof(address)), "connect check failed");
+        TEST_ASSERT_EQUAL_MESSAGE(4, send(sockfd, "GET ", 4, MSG_NOSIGNAL), "send check failed");
+        TEST_ASSERT_MESSAGE((accepted = accept(listener, NULL, NULL)) >= 0, "accept check failed");
+        TEST_ASSERT_TRUE_MESSAGE(ff_tcp_fastopen_record(fastopen, sockfd, "upstream", true), "established check failed");
+
+        close(accepted);
+        close(sockfd);
+    }
+
+    TEST_ASSERT_EQUAL_MESSAGE(fallbacks + 2, FF_STATS_GET(upstream_fastopen_fallbacks), "fallbacks check failed");
+
+    int sockfd = socket(AF_INET, SOCK_STREAM, 0);
+
+    TEST_ASSERT_FALSE_MESSAGE(ff_tcp_fastopen_enable(fastopen, sockfd, "upstream"), "skipped check failed");
+    TEST_ASSERT_TRUE_MESSAGE(ff_tcp_fastopen_enable(fastopen, sockfd, "other"), "other destination check failed");
+
+    close(sockfd);
+    close(listener);
+    ff_tcp_fastopen_free(fastopen);
+}
+
+void test_tcp_fastopen_record_failed_connection()
+{
+    struct ff_tcp_fastopen *fastopen = ff_tcp_fastopen_init(4, 2, 60);
+    struct sockaddr_in address;
+    int sockfd = socket(AF_INET, SOCK_STREAM, 0);
+    int plain = socket(AF_INET, SOCK_STREAM, 0);
+
+    // Nothing is listening once the listener is closed
+    close(test_tcp_fastopen_listen(&address));
+
+    TEST_ASSERT_TRUE_MESSAGE(ff_tcp_fastopen_enable(fastopen, sockfd, "upstream"), "enable check failed");
+    // With a cookie cached connecting is deferred, so the refusal is seen by the first write
+    connect(sockfd, (struct sockaddr *)&address, sizeof(address));
+    TEST_ASSERT_LESS_THAN_MESSAGE(0, send(sockfd, "GET ", 4, MSG_NOSIGNAL), "send check failed");
+    TEST_ASSERT_NOT_EQUAL(0, connect(plain, (struct sockaddr *)&address, sizeof(address)));
+
+    TEST_ASSERT_TRUE_MESSAGE(ff_tcp_fastopen_record(fastopen, plain, "upstream", false), "not enabled check failed");
+    TEST_ASSERT_FALSE_MESSAGE(ff_tcp_fastopen_record(fastopen, sockfd, "upstream", false), "failed check failed");
+    TEST_ASSERT_FALSE_MESSAGE(ff_tcp_fastopen_enable(fastopen, plain, "upstream"), "skipped check failed");
+
+    close(plain);
+    close(sockfd);
+    ff_tcp_fastopen_free(fastopen);
+}
+
+void test_tcp_fastopen_record_reset_connection()
+{
+    struct ff_tcp_fastopen *fastopen = ff_tcp_fastopen_init(4, 2, 60);
+    struct sockaddr_in address;
+    int listener = test_tcp_fastopen_listen(&address);
+    int sockfd = socket(AF_INET, SOCK_STREAM, 0);
+    struct linger linger = {.l_onoff = 1, .l_linger = 0};
+    struct tcp_info info;
+    socklen_t info_length = sizeof(info);
+    char buff[4];
+    int accepted;
+
+    TEST_ASSERT_TRUE_MESSAGE(ff_tcp_fastopen_enable(fastopen, sockfd, "upstream"), "enable check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(0, connect(sockfd, (struct sockaddr *)&address, sizeof(address)), "connect check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(4, send(sockfd, "GET ", 4, MSG_NOSIGNAL), "send check failed");
+    TEST_ASSERT_MESSAGE((accepted = accept(listener, NULL, NULL)) >= 0, "accept check failed");
+
+    // Closing with a zero linger resets the established connection
+    setsockopt(accepted, SOL_SOCKET, SO_LINGER, &linger, sizeof(linger));
+    close(accepted);
+    TEST_ASSERT_LESS_THAN_MESSAGE(0, recv(sockfd, buff, sizeof(buff), 0), "recv check failed");
+    getsockopt(sockfd, IPPROTO_TCP, TCP_INFO, &info, &info_length);
+    TEST_ASSERT_EQUAL_MESSAGE(TCP_CLOSE, info.tcpi_state, "state check failed");
+
+    // The request may have reached the upstream, so it isn't reported as undelivered
+    TEST_ASSERT_TRUE_MESSAGE(ff_tcp_fastopen_record(fastopen, sockfd, "upstream", true), "delivered check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(0, ff_tcp_fastopen_find(fastopen, "upstream")->disabled_until, "backoff check failed");
+
+    close(sockfd);
+    close(listener);
+    ff_tcp_fastopen_free(fastopen);
+}
+
+void test_tcp_fastopen_evicts_least_recently_used()
+{
+    struct ff_tcp_fastopen *fastopen = ff_tcp_fastopen_init(2, 2, 60);
+
+    ff_tcp_fastopen_touch(fastopen, "a");
+    ff_tcp_fastopen_touch(fastopen, "b");
+    ff_tcp_fastopen_touch(fastopen, "a");
+    ff_tcp_fastopen_touch(fastopen, "c");
+
+    TEST_ASSERT_EQUAL_MESSAGE(2, fastopen->destinations->length, "length check failed");
+    TEST_ASSERT_NOT_NULL_MESSAGE(ff_tcp_fastopen_find(fastopen, "a"), "recently used check failed");
+    TEST_ASSERT_NULL_MESSAGE(ff_tcp_fastopen_find(fastopen, "b"), "evicted check failed");
+    TEST_ASSERT_NOT_NULL_MESSAGE(ff_tcp_fastopen_find(fastopen, "c"), "inserted check failed");
+
+    ff_tcp_fastopen_free(fastopen);
+}
+
+void test_tcp_fastopen_engine_forwards_requests()
+{
+    struct test_http_engine_server server;
+    struct test_http_engine_results results = {0};
+    struct ff_tcp_fastopen *fastopen = ff_tcp_fastopen_init(4, 3, 60);
+    struct ff_http_engine *engine = ff_http_engine_init(1);
+    struct ff_request *requests[4];
+    uint64_t attempts = FF_STATS_GET(upstream_fastopen_attempts);
+    uint64_t failed = FF_STATS_GET(upstream_engine_forwards_failed);
+
+    test_http_engine_server_start(&server, false);
+    engine->http_port = server.port;
+    engine->fastopen = fastopen;
+
+    // A new connection per request, whether or not the SYN data is accepted
+    for (int i = 0; i < 4; i++)
+    {
+        requests[i] = test_http_engine_submit(engine, "127.0.0.1", &results);
+        test_http_engine_wait(&results, i + 1);
+    }
+
+    TEST_ASSERT_EQUAL_MESSAGE(4, results.forwarded, "forwarded check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(failed, FF_STATS_GET(upstream_engine_forwards_failed), "failed check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(4, __atomic_load_n(&server.requests, __ATOMIC_RELAXED), "requests check failed");
+    TEST_ASSERT_GREATER_THAN_MESSAGE(attempts, FF_STATS_GET(upstream_fastopen_attempts), "attempts check failed");
+
+    ff_http_engine_free(engine);
+    ff_tcp_fastopen_free(fastopen);
+    test_http_engine_server_stop(&server);
+
+    for (int i = 0; i < 4; i++)
+    {
+        ff_request_free(requests[i]);
+    }
+}
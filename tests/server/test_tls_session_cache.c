@@ -0,0 +1,132 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <openssl/ssl.h>
+#include "../include/unity.h"
+#include "../../src/tls_session_cache.h"
+#include "../../src/tls_session_cache_p.h"
+
+SSL_SESSION *test_tls_session_alloc(int version)
+{
+    SSL_SESSION *session = SSL_SESSION_new();
+    uint8_t id[32] = {1, 2, 3};
+
+    SSL_SESSION_set1_id(session, id, sizeof(id));
+    SSL_SESSION_set_protocol_version(session, version);
+    SSL_SESSION_set_time(session, (long)time(NULL));
+    SSL_SESSION_set_timeout(session, 7200);
+
+    return session;
+}
+
+void test_tls_session_cache_put_and_get()
+{
+    struct ff_tls_session_cache *cache = ff_tls_session_cache_init(4, 3600);
+    SSL_SESSION *session = test_tls_session_alloc(TLS1_2_VERSION);
+    SSL_SESSION *cached = NULL;
+
+    TEST_ASSERT_EQUAL_MESSAGE(NULL, ff_tls_session_cache_get(cache, "example.com:443"), "miss check failed");
+
+    ff_tls_session_cache_put(cache, "example.com:443", session);
+
+    // TLS 1.2 sessions are reused until they expire
+    for (int i = 0; i < 2; i++)
+    {
+        cached = ff_tls_session_cache_get(cache, "example.com:443");
+        TEST_ASSERT_EQUAL_MESSAGE(session, cached, "hit check failed");
+        SSL_SESSION_free(cached);
+    }
+
+    TEST_ASSERT_EQUAL_MESSAGE(NULL, ff_tls_session_cache_get(cache, "example.com:8443"), "other port check failed");
+
+    ff_tls_session_cache_free(cache);
+}
+
+void test_tls_session_cache_tls13_tickets_used_once()
+{
+    struct ff_tls_session_cache *cache = ff_tls_session_cache_init(4, 3600);
+    SSL_SESSION *session = test_tls_session_alloc(TLS1_3_VERSION);
+    SSL_SESSION *cached = NULL;
+
+    ff_tls_session_cache_put(cache, "example.com:443", session);
+
+    cached = ff_tls_session_cache_get(cache, "example.com:443");
+    TEST_ASSERT_EQUAL_MESSAGE(session, cached, "hit check failed");
+    SSL_SESSION_free(cached);
+
+    TEST_ASSERT_EQUAL_MESSAGE(NULL, ff_tls_session_cache_get(cache, "example.com:443"), "single use check failed");
+
+    ff_tls_session_cache_free(cache);
+}
+
+void test_tls_session_cache_expiry()
+{
+    struct ff_tls_session_cache *cache = ff_tls_session_cache_init(4, 3600);
+    SSL_SESSION *session = test_tls_session_alloc(TLS1_2_VERSION);
+    struct ff_tls_session_cache_entry *entry = NULL;
+
+    ff_tls_session_cache_put(cache, "example.com:443", session);
+
+    entry = ff_tls_session_cache_find(cache, "example.com:443");
+    entry->stored_at -= 3600;
+
+    TEST_ASSERT_EQUAL_MESSAGE(NULL, ff_tls_session_cache_get(cache, "example.com:443"), "max age check failed");
+
+    // The server's lifetime hint also applies
+    session = test_tls_session_alloc(TLS1_2_VERSION);
+    SSL_SESSION_set_time(session, (long)time(NULL) - 120);
+    SSL_SESSION_set_timeout(session, 60);
+    ff_tls_session_cache_put(cache, "example.com:443", session);
+
+    TEST_ASSERT_EQUAL_MESSAGE(NULL, ff_tls_session_cache_get(cache, "example.com:443"), "server lifetime check failed");
+
+    ff_tls_session_cache_free(cache);
+}
+
+void test_tls_session_cache_evicts_least_recently_used()
+{
+    struct ff_tls_session_cache *cache = ff_tls_session_cache_init(2, 3600);
+    SSL_SESSION *cached = NULL;
+
+    ff_tls_session_cache_put(cache, "a.com:443", test_tls_session_alloc(TLS1_2_VERSION));
+    ff_tls_session_cache_put(cache, "b.com:443", test_tls_session_alloc(TLS1_2_VERSION));
+
+    cached = ff_tls_session_cache_get(cache, "a.com:443");
+    SSL_SESSION_free(cached);
+
+    ff_tls_session_cache_put(cache, "c.com:443", test_tls_session_alloc(TLS1_2_VERSION));
+
+    TEST_ASSERT_EQUAL_MESSAGE(2, cache->entries->length, "length check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(NULL, ff_tls_session_cache_get(cache, "b.com:443"), "evicted check failed");
+
+    cached = ff_tls_session_cache_get(cache, "a.com:443");
+    TEST_ASSERT_NOT_NULL_MESSAGE(cached, "recently used check failed");
+    SSL_SESSION_free(cached);
+
+    ff_tls_session_cache_free(cache);
+}
+
+void test_tls_session_cache_handshake_stats()
+{
+    struct ff_tls_session_cache *cache = ff_tls_session_cache_init(4, 3600);
+    char buff[512] = {0};
+    FILE *fd = fmemopen(buff, sizeof(buff), "w");
+
+    ff_tls_session_cache_put(cache, "example.com:443", test_tls_session_alloc(TLS1_2_VERSION));
+    ff_tls_session_cache_record_handshake(cache, "example.com:443", false);
+    ff_tls_session_cache_record_handshake(cache, "example.com:443", true);
+    ff_tls_session_cache_record_handshake(cache, "example.com:443", true);
+
+    // Stats survive the sessions being dropped
+    ff_tls_session_cache_flush(cache);
+    TEST_ASSERT_EQUAL_MESSAGE(NULL, ff_tls_session_cache_get(cache, "example.com:443"), "flush check failed");
+
+    ff_tls_session_cache_print_stats(fd, cache);
+    fclose(fd);
+
+    TEST_ASSERT_NOT_NULL_MESSAGE(strstr(buff, "tls_handshakes_resumed[example.com:443] 2\n"), "resumed stats check failed");
+    TEST_ASSERT_NOT_NULL_MESSAGE(strstr(buff, "tls_handshakes_full[example.com:443] 1\n"), "full stats check failed");
+
+    ff_tls_session_cache_free(cache);
+}
@@ -0,0 +1,357 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "../include/unity.h"
+#include "../../src/upstream_limits.h"
+#include "../../src/upstream_limits_p.h"
+#include "../../src/http_engine.h"
+#include "../../src/stats.h"
+
+/**
+ * Records the order queued waiters are admitted in
+ */
+struct test_upstream_limits_admissions
+{
+    struct ff_upstream_waiter *order[8];
+    uint8_t length;
+};
+
+void test_upstream_limits_admitted(struct ff_upstream_waiter *waiter)
+{
+    struct test_upstream_limits_admissions *admissions = (struct test_upstream_limits_admissions *)waiter->context;
+
+    admissions->order[admissions->length++] = waiter;
+}
+
+struct ff_upstream_host *test_upstream_limits_host(struct ff_upstream_limits *limits, const char *name)
+{
+    return ff_upstream_limits_find(limits, name);
+}
+
+void test_upstream_limits_acquire_and_release()
+{
+    struct ff_upstream_limits *limits = ff_upstream_limits_init(16, 2, 2, 1000, false);
+    struct test_upstream_limits_admissions admissions = {0};
+    struct ff_upstream_waiter waiters[5];
+    uint64_t rejected = FF_STATS_GET(upstream_limit_rejected);
+    char buff[1024] = {0};
+    FILE *fd = NULL;
+
+    for (int i = 0; i < 5; i++)
+    {
+        waiters[i] = (struct ff_upstream_waiter){.on_admitted = test_upstream_limits_admitted, .context = (void *)&admissions};
+    }
+
+    TEST_ASSERT_EQUAL(FF_UPSTREAM_LIMITS_ADMITTED, ff_upstream_limits_acquire(NULL, "a.example", &waiters[0]));
+
+    TEST_ASSERT_EQUAL(FF_UPSTREAM_LIMITS_ADMITTED, ff_upstream_limits_acquire(limits, "a.example", &waiters[0]));
+    TEST_ASSERT_EQUAL(FF_UPSTREAM_LIMITS_ADMITTED, ff_upstream_limits_acquire(limits, "a.example", &waiters[1]));
+    TEST_ASSERT_EQUAL(FF_UPSTREAM_LIMITS_QUEUED, ff_upstream_limits_acquire(limits, "a.example", &waiters[2]));
+    TEST_ASSERT_EQUAL(FF_UPSTREAM_LIMITS_QUEUED, ff_upstream_limits_acquire(limits, "a.example", &waiters[3]));
+    TEST_ASSERT_EQUAL(FF_UPSTREAM_LIMITS_REJECTED, ff_upstream_limits_acquire(limits, "a.example", &waiters[4]));
+    TEST_ASSERT_EQUAL_MESSAGE(rejected + 1, FF_STATS_GET(upstream_limit_rejected), "rejected check failed");
+
+    // Other hosts have limits of their own
+    TEST_ASSERT_EQUAL(FF_UPSTREAM_LIMITS_ADMITTED, ff_upstream_limits_acquire(limits, "b.example", &waiters[4]));
+
+    fd = fmemopen(buff, sizeof(buff) - 1, "w");
+    ff_upstream_limits_print_stats(fd, (void *)limits);
+    fclose(fd);
+    TEST_ASSERT_NOT_NULL_MESSAGE(strstr(buff, "upstream_in_flight[a.example] 2\n"), "in flight check failed");
+    TEST_ASSERT_NOT_NULL_MESSAGE(strstr(buff, "upstream_queue_depth[a.example] 2\n"), "depth check failed");
+    TEST_ASSERT_NOT_NULL_MESSAGE(strstr(buff, "upstream_queue_rejected[a.example] 1\n"), "rejected stat check failed");
+
+    // Queued requests are admitted in arrival order as slots are released
+    ff_upstream_limits_release(limits, "a.example", NULL);
+    ff_upstream_limits_release(limits, "a.example", NULL);
+
+    TEST_ASSERT_EQUAL_MESSAGE(2, admissions.length, "admissions check failed");
+    TEST_ASSERT_EQUAL_PTR(&waiters[2], admissions.order[0]);
+    TEST_ASSERT_EQUAL_PTR(&waiters[3], admissions.order[1]);
+    TEST_ASSERT_FALSE_MESSAGE(ff_upstream_limits_cancel(limits, &waiters[2], true), "cancel check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(2, test_upstream_limits_host(limits, "a.example")->in_flight, "in flight check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(2, test_upstream_limits_host(limits, "a.example")->admitted_from_queue, "admitted check failed");
+
+    for (int i = 0; i < 2; i++)
+    {
+        ff_upstream_limits_release(limits, "a.example", NULL);
+    }
+
+    ff_upstream_limits_release(limits, "b.example", NULL);
+    TEST_ASSERT_EQUAL_MESSAGE(0, test_upstream_limits_host(limits, "a.example")->in_flight, "released check failed");
+
+    ff_upstream_limits_free(limits);
+}
+
+void test_upstream_limits_cancel()
+{
+    struct ff_upstream_limits *limits = ff_upstream_limits_init(16, 1, 4, 1000, false);
+    struct test_upstream_limits_admissions admissions = {0};
+    struct ff_upstream_waiter waiters[3];
+    uint64_t timeouts = FF_STATS_GET(upstream_limit_queue_timeouts);
+
+    for (int i = 0; i < 3; i++)
+    {
+        waiters[i] = (struct ff_upstream_waiter){.on_admitted = test_upstream_limits_admitted, .context = (void *)&admissions};
+    }
+
+    TEST_ASSERT_EQUAL(FF_UPSTREAM_LIMITS_ADMITTED, ff_upstream_limits_acquire(limits, "a.example", &waiters[0]));
+    TEST_ASSERT_EQUAL(FF_UPSTREAM_LIMITS_QUEUED, ff_upstream_limits_acquire(limits, "a.example", &waiters[1]));
+    TEST_ASSERT_EQUAL(FF_UPSTREAM_LIMITS_QUEUED, ff_upstream_limits_acquire(limits, "a.example", &waiters[2]));
+
+    TEST_ASSERT_TRUE_MESSAGE(ff_upstream_limits_cancel(limits, &waiters[1], true), "cancel check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(1, test_upstream_limits_host(limits, "a.example")->queue_length, "depth check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(1, test_upstream_limits_host(limits, "a.example")->queue_timeouts, "timeouts check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(timeouts + 1, FF_STATS_GET(upstream_limit_queue_timeouts), "timeouts stat check failed");
+
+    // The cancelled waiter is skipped
+    ff_upstream_limits_release(limits, "a.example", NULL);
+
+    TEST_ASSERT_EQUAL_MESSAGE(1, admissions.length, "admissions check failed");
+    TEST_ASSERT_EQUAL_PTR(&waiters[2], admissions.order[0]);
+
+    ff_upstream_limits_release(limits, "a.example", NULL);
+    ff_upstream_limits_free(limits);
+}
+
+void *test_upstream_limits_wait_thread(void *args)
+{
+    struct ff_upstream_limits *limits = (struct ff_upstream_limits *)args;
+
+    return ff_upstream_limits_wait(limits, "a.example") ? (void *)limits : NULL;
+}
+
+void test_upstream_limits_wait()
+{
+    struct ff_upstream_limits *limits = ff_upstream_limits_init(16, 1, 4, 50, false);
+    uint64_t timeouts = FF_STATS_GET(upstream_limit_queue_timeouts);
+    pthread_t thread;
+    void *result = NULL;
+
+    TEST_ASSERT_TRUE(ff_upstream_limits_wait(NULL, "a.example"));
+    TEST_ASSERT_TRUE(ff_upstream_limits_wait(limits, "a.example"));
+
+    // Nothing is released within the queue timeout
+    TEST_ASSERT_FALSE_MESSAGE(ff_upstream_limits_wait(limits, "a.example"), "timeout check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(timeouts + 1, FF_STATS_GET(upstream_limit_queue_timeouts), "timeouts check failed");
+
+    limits->queue_timeout_ms = 5000;
+    pthread_create(&thread, NULL, test_upstream_limits_wait_thread, (void *)limits);
+
+    for (int i = 0; i < 400 && test_upstream_limits_host(limits, "a.example")->queue_length == 0; i++)
+    {
+        usleep(5000);
+    }
+
+    ff_upstream_limits_release(limits, "a.example", NULL);
+    pthread_join(thread, &result);
+
+    TEST_ASSERT_EQUAL_PTR_MESSAGE(limits, result, "admitted check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(1, test_upstream_limits_host(limits, "a.example")->in_flight, "in flight check failed");
+
+    ff_upstream_limits_release(limits, "a.example", NULL);
+    ff_upstream_limits_free(limits);
+}
+
+void test_upstream_limits_adaptive()
+{
+    struct ff_upstream_limits *limits = ff_upstream_limits_init(16, 10, 4, 1000, true);
+    struct ff_upstream_waiter waiter = {0};
+    struct ff_upstream_sample failed = {.success = false};
+    struct ff_upstream_sample fast = {.success = true, .connect_usecs = 100, .response_usecs = 1000};
+    struct ff_upstream_sample slow = {.success = true, .response_usecs = 5000};
+    struct ff_upstream_host *entry = NULL;
+    uint64_t decreases = FF_STATS_GET(upstream_limit_decreases);
+
+    ff_upstream_limits_acquire(limits, "a.example", &waiter);
+    entry = test_upstream_limits_host(limits, "a.example");
+    TEST_ASSERT_EQUAL_MESSAGE(10, ff_upstream_limits_current(entry), "initial check failed");
+
+    // The first failure backs off, those in flight with it don't back off again
+    ff_upstream_limits_release(limits, "a.example", &failed);
+    TEST_ASSERT_EQUAL_MESSAGE(9, ff_upstream_limits_current(entry), "backoff check failed");
+
+    for (int i = 0; i < 8; i++)
+    {
+        ff_upstream_limits_acquire(limits, "a.example", &waiter);
+        ff_upstream_limits_release(limits, "a.example", &failed);
+    }
+
+    TEST_ASSERT_EQUAL_MESSAGE(9, ff_upstream_limits_current(entry), "once per window check failed");
+
+    ff_upstream_limits_acquire(limits, "a.example", &waiter);
+    ff_upstream_limits_release(limits, "a.example", &failed);
+    TEST_ASSERT_EQUAL_MESSAGE(8, ff_upstream_limits_current(entry), "second backoff check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(decreases + 2, FF_STATS_GET(upstream_limit_decreases), "decreases check failed");
+
+    // Requests near the baseline grow it back by one per limit's worth, up to the maximum
+    for (int i = 0; i < 100; i++)
+    {
+        ff_upstream_limits_acquire(limits, "a.example", &waiter);
+        ff_upstream_limits_release(limits, "a.example", &fast);
+    }
+
+    TEST_ASSERT_EQUAL_MESSAGE(10, ff_upstream_limits_current(entry), "recovered check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(100, entry->connect_baseline, "connect baseline check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(1000, entry->response_baseline, "response baseline check failed");
+
+    // Responses slower than the baseline allows count as congestion
+    ff_upstream_limits_acquire(limits, "a.example", &waiter);
+    ff_upstream_limits_release(limits, "a.example", &slow);
+    TEST_ASSERT_EQUAL_MESSAGE(9, ff_upstream_limits_current(entry), "slow check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(1000 + 4000 / FF_UPSTREAM_LIMITS_BASELINE_DECAY, entry->response_baseline, "decay check failed");
+
+    ff_upstream_limits_free(limits);
+}
+
+void test_upstream_limits_evicts_idle_hosts()
+{
+    struct ff_upstream_limits *limits = ff_upstream_limits_init(2, 1, 4, 1000, false);
+    struct ff_upstream_waiter waiter = {0};
+
+    ff_upstream_limits_acquire(limits, "a.example", &waiter);
+    ff_upstream_limits_acquire(limits, "b.example", &waiter);
+    ff_upstream_limits_release(limits, "b.example", NULL);
+
+    // a.example is least recently used but has a request in flight
+    ff_upstream_limits_acquire(limits, "c.example", &waiter);
+
+    TEST_ASSERT_EQUAL_MESSAGE(2, limits->hosts->length, "length check failed");
+    TEST_ASSERT_NOT_NULL_MESSAGE(test_upstream_limits_host(limits, "a.example"), "a check failed");
+    TEST_ASSERT_NULL_MESSAGE(test_upstream_limits_host(limits, "b.example"), "b check failed");
+    TEST_ASSERT_NOT_NULL_MESSAGE(test_upstream_limits_host(limits, "c.example"), "c check failed");
+
+    ff_upstream_limits_free(limits);
+}
+
+void test_upstream_limits_engine_queues_requests()
+{
+    struct test_http_engine_server server;
+    struct test_http_engine_results results = {0};
+    struct ff_upstream_limits *limits = ff_upstream_limits_init(16, 2, TEST_HTTP_ENGINE_REQUESTS, 5000, false);
+    struct ff_http_engine *engine = ff_http_engine_init(2);
+    struct ff_request *requests[TEST_HTTP_ENGINE_REQUESTS];
+    uint64_t queued = FF_STATS_GET(upstream_limit_queued);
+    uint64_t failed = FF_STATS_GET(upstream_engine_forwards_failed);
+
+    test_http_engine_server_start(&server, false);
+    engine->http_port = server.port;
+    engine->limits = limits;
+
+    for (int i = 0; i < TEST_HTTP_ENGINE_REQUESTS; i++)
+    {
+        requests[i] = test_http_engine_submit(engine, "127.0.0.1", &results);
+    }
+
+    test_http_engine_wait(&results, TEST_HTTP_ENGINE_REQUESTS);
+
+    TEST_ASSERT_EQUAL_MESSAGE(TEST_HTTP_ENGINE_REQUESTS, results.forwarded, "forwarded check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(failed, FF_STATS_GET(upstream_engine_forwards_failed), "failed check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(TEST_HTTP_ENGINE_REQUESTS, __atomic_load_n(&server.requests, __ATOMIC_RELAXED), "requests check failed");
+    TEST_ASSERT_TRUE_MESSAGE(FF_STATS_GET(upstream_limit_queued) > queued, "queued check failed");
+
+    ff_http_engine_free(engine);
+    TEST_ASSERT_EQUAL_MESSAGE(0, test_upstream_limits_host(limits, "127.0.0.1")->in_flight, "in flight check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(0, test_upstream_limits_host(limits, "127.0.0.1")->queue_length, "depth check failed");
+
+    test_http_engine_server_stop(&server);
+    ff_upstream_limits_free(limits);
+
+    for (int i = 0; i < TEST_HTTP_ENGINE_REQUESTS; i++)
+    {
+        ff_request_free(requests[i]);
+    }
+}
+
+void test_upstream_limits_engine_queue_timeout()
+{
+    struct test_http_engine_server server;
+    struct test_http_engine_results results = {0};
+    struct ff_upstream_limits *limits = ff_upstream_limits_init(16, 1, 1, 100, false);
+    struct ff_http_engine *engine = ff_http_engine_init(1);
+    struct ff_request *requests[3];
+    uint64_t timeouts = FF_STATS_GET(upstream_limit_queue_timeouts);
+    uint64_t rejected = FF_STATS_GET(upstream_limit_rejected);
+    uint64_t failed = FF_STATS_GET(upstream_engine_forwards_failed);
+
+    // The response never finishes, so the first request holds the only slot
+    test_http_engine_server_start(&server, true);
+    engine->http_port = server.port;
+    engine->timeout_ms = 60000;
+    engine->limits = limits;
+
+    for (int i = 0; i < 3; i++)
+    {
+        requests[i] = test_http_engine_submit(engine, "127.0.0.1", &results);
+    }
+
+    // The second times out in the queue, the third finds it full
+    test_http_engine_wait(&results, 2);
+
+    TEST_ASSERT_EQUAL_MESSAGE(2, results.forwarded, "forwarded check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(failed + 2, FF_STATS_GET(upstream_engine_forwards_failed), "failed check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(timeouts + 1, FF_STATS_GET(upstream_limit_queue_timeouts), "timeouts check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(rejected + 1, FF_STATS_GET(upstream_limit_rejected), "rejected check failed");
+
+    ff_http_engine_free(engine);
+
+    TEST_ASSERT_EQUAL_MESSAGE(3, results.forwarded, "freed check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(0, test_upstream_limits_host(limits, "127.0.0.1")->in_flight, "in flight check failed");
+
+    test_http_engine_server_stop(&server);
+    ff_upstream_limits_free(limits);
+
+    for (int i = 0; i < 3; i++)
+    {
+        ff_request_free(requests[i]);
+    }
+}
+
+void test_upstream_limits_engine_free_fails_queued()
+{
+    struct test_http_engine_server server;
+    struct test_http_engine_results results = {0};
+    struct ff_upstream_limits *limits = ff_upstream_limits_init(16, 1, 4, 60000, false);
+    struct ff_http_engine *engine = ff_http_engine_init(2);
+    struct ff_request *requests[4];
+    uint64_t failed = FF_STATS_GET(upstream_engine_forwards_failed);
+
+    test_http_engine_server_start(&server, true);
+    engine->http_port = server.port;
+    engine->timeout_ms = 60000;
+    engine->limits = limits;
+
+    for (int i = 0; i < 4; i++)
+    {
+        requests[i] = test_http_engine_submit(engine, "127.0.0.1", &results);
+    }
+
+    for (int i = 0; i < 400 && test_upstream_limits_host(limits, "127.0.0.1") == NULL; i++)
+    {
+        usleep(5000);
+    }
+
+    for (int i = 0; i < 400 && test_upstream_limits_host(limits, "127.0.0.1")->queue_length < 3; i++)
+    {
+        usleep(5000);
+    }
+
+    // Stopping admits queued requests across workers as others finish, each still fails
+    ff_http_engine_free(engine);
+
+    TEST_ASSERT_EQUAL_MESSAGE(4, results.forwarded, "forwarded check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(failed + 4, FF_STATS_GET(upstream_engine_forwards_failed), "failed check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(0, test_upstream_limits_host(limits, "127.0.0.1")->in_flight, "in flight check failed");
+    TEST_ASSERT_EQUAL_MESSAGE(0, test_upstream_limits_host(limits, "127.0.0.1")->queue_length, "depth check failed");
+
+    test_http_engine_server_stop(&server);
+    ff_upstream_limits_free(limits);
+
+    for (int i = 0; i < 4; i++)
+    {
+        ff_request_free(requests[i]);
+    }
+}